@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <algorithm>
+#include <cstring>
 
 #include "util.h"
 #include "net_util.h"
@@ -144,6 +146,126 @@ ipaddr32_t AnonymizeIPAddr_PrefixMD5::anonymize(ipaddr32_t input)
 	return htonl(output);
 	}
 
+// Entries of the /24 cache, beyond which it starts over.
+static const size_t max_prefix24_entries = 1 << 20;
+
+AnonymizeIPAddr_CryptoPAn::AnonymizeIPAddr_CryptoPAn()
+	: prefix16(1 << 16, 0)
+	{
+	ctx = EVP_CIPHER_CTX_new();
+
+	// Derive a key from the seed, so that --seed gives stable results.
+	std::string key;
+
+	for ( const char* label : {"Crypto-PAn key", "Crypto-PAn pad"} )
+		{
+		uint8_t digest[16];
+		hmac_md5(strlen(label), (const u_char*) label, digest);
+		key.append((const char*) digest, sizeof(digest));
+		}
+
+	SetKey(key);
+	}
+
+AnonymizeIPAddr_CryptoPAn::~AnonymizeIPAddr_CryptoPAn()
+	{
+	EVP_CIPHER_CTX_free(ctx);
+	}
+
+bool AnonymizeIPAddr_CryptoPAn::SetKey(const std::string& key)
+	{
+	if ( key.size() != 32 )
+		return false;
+
+	const u_char* k = (const u_char*) key.data();
+
+	if ( ! EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), nullptr, k, nullptr) )
+		reporter->InternalError("can't initialize AES for anonymization");
+
+	EVP_CIPHER_CTX_set_padding(ctx, 0);
+	Encrypt(k + 16, pad);
+
+	std::fill(prefix16.begin(), prefix16.end(), 0);
+	prefix24.clear();
+	mapping.clear();
+	return true;
+	}
+
+void AnonymizeIPAddr_CryptoPAn::Encrypt(const uint8_t* in, uint8_t* out)
+	{
+	int len;
+	EVP_EncryptUpdate(ctx, out, &len, in, 16);
+	}
+
+uint32_t AnonymizeIPAddr_CryptoPAn::Flips(const uint8_t* addr, int from, int to)
+	{
+	uint32_t flips = 0;
+	uint8_t block[16];
+	uint8_t out[16];
+
+	for ( int pos = from; pos < to; ++pos )
+		{
+		// The first pos bits of the address, followed by the pad's.
+		int n = pos / 8;
+		int rem = pos % 8;
+
+		memcpy(block, addr, n);
+		memcpy(block + n, pad + n, 16 - n);
+
+		if ( rem )
+			block[n] = (addr[n] & (0xff << (8 - rem))) | (pad[n] & (0xff >> rem));
+
+		Encrypt(block, out);
+		flips |= uint32_t(out[0] >> 7) << (31 - pos % 32);
+		}
+
+	return flips;
+	}
+
+uint32_t AnonymizeIPAddr_CryptoPAn::PrefixFlips(const uint8_t* addr)
+	{
+	uint32_t key24 = (addr[0] << 16) | (addr[1] << 8) | addr[2];
+	auto i = prefix24.find(key24);
+
+	if ( i != prefix24.end() )
+		return i->second;
+
+	uint32_t& flips16 = prefix16[key24 >> 8];
+
+	if ( ! (flips16 & 1) )
+		flips16 = Flips(addr, 0, 16) | 1;
+
+	uint32_t flips = (flips16 & 0xffff0000) | Flips(addr, 16, 24);
+
+	if ( prefix24.size() >= max_prefix24_entries )
+		prefix24.clear();
+
+	prefix24[key24] = flips;
+	return flips;
+	}
+
+ipaddr32_t AnonymizeIPAddr_CryptoPAn::anonymize(ipaddr32_t input)
+	{
+	uint8_t addr[16] = {0};
+	memcpy(addr, &input, sizeof(input));
+
+	uint32_t flips = PrefixFlips(addr) | Flips(addr, 24, 32);
+	return input ^ htonl(flips);
+	}
+
+bool AnonymizeIPAddr_CryptoPAn::Anonymize6(const uint32_t* input, uint32_t* output)
+	{
+	uint8_t addr[16];
+	memcpy(addr, input, sizeof(addr));
+
+	output[0] = input[0] ^ htonl(PrefixFlips(addr) | Flips(addr, 24, 32));
+
+	for ( int i = 1; i < 4; ++i )
+		output[i] = input[i] ^ htonl(Flips(addr, 32 * i, 32 * (i + 1)));
+
+	return true;
+	}
+
 AnonymizeIPAddr_A50::~AnonymizeIPAddr_A50()
 	{
 	for ( unsigned int i = 0; i < blocks.size(); ++i )
@@ -362,6 +484,23 @@ static zeek::TableValPtr anon_preserve_orig_addr;
 static zeek::TableValPtr anon_preserve_resp_addr;
 static zeek::TableValPtr anon_preserve_other_addr;
 
+static TableVal* anon_preserve_table(ip_addr_anonymization_class_t cl, int* method)
+	{
+	switch ( cl ) {
+	case ORIG_ADDR: // client address
+		*method = orig_addr_anonymization;
+		return anon_preserve_orig_addr.get();
+
+	case RESP_ADDR: // server address
+		*method = resp_addr_anonymization;
+		return anon_preserve_resp_addr.get();
+
+	default:
+		*method = other_addr_anonymization;
+		return anon_preserve_other_addr.get();
+	}
+	}
+
 void zeek::detail::init_ip_addr_anonymizers()
 	{
 	ip_anonymizer[KEEP_ORIG_ADDR] = nullptr;
@@ -370,6 +509,17 @@ void zeek::detail::init_ip_addr_anonymizers()
 	ip_anonymizer[PREFIX_PRESERVING_A50] = new AnonymizeIPAddr_A50();
 	ip_anonymizer[PREFIX_PRESERVING_MD5] = new AnonymizeIPAddr_PrefixMD5();
 
+	auto cryptopan = new AnonymizeIPAddr_CryptoPAn();
+	ip_anonymizer[PREFIX_PRESERVING_CRYPTOPAN] = cryptopan;
+
+	if ( const auto& key = zeek::id::find_val("anonymization_key") )
+		{
+		const auto& k = key->AsStringVal()->ToStdString();
+
+		if ( ! k.empty() && ! cryptopan->SetKey(k) )
+			reporter->Error("anonymization_key must have 32 bytes, using a key derived from the seed");
+		}
+
 	auto id = global_scope()->Find("preserve_orig_addr");
 
 	if ( id )
@@ -388,27 +538,10 @@ void zeek::detail::init_ip_addr_anonymizers()
 
 ipaddr32_t zeek::detail::anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl)
 	{
-	TableVal* preserve_addr = nullptr;
 	auto addr = zeek::make_intrusive<zeek::AddrVal>(ip);
 
 	int method = -1;
-
-	switch ( cl ) {
-	case ORIG_ADDR: // client address
-		preserve_addr = anon_preserve_orig_addr.get();
-		method = orig_addr_anonymization;
-		break;
-
-	case RESP_ADDR: // server address
-		preserve_addr = anon_preserve_resp_addr.get();
-		method = resp_addr_anonymization;
-		break;
-
-	default:
-		preserve_addr = anon_preserve_other_addr.get();
-		method = other_addr_anonymization;
-		break;
-	}
+	TableVal* preserve_addr = anon_preserve_table(cl, &method);
 
 	ipaddr32_t new_ip = 0;
 
@@ -436,6 +569,48 @@ ipaddr32_t zeek::detail::anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_
 	return new_ip;
 	}
 
+bool zeek::detail::anonymize_ip(const IPAddr& ip, enum ip_addr_anonymization_class_t cl,
+                               IPAddr* result)
+	{
+	const uint32_t* bytes;
+	ip.GetBytes(&bytes);
+
+	if ( ip.GetFamily() == IPv4 )
+		{
+		ipaddr32_t new_ip = anonymize_ip(*bytes, cl);
+		*result = IPAddr(IPv4, &new_ip, IPAddr::Network);
+		return true;
+		}
+
+	int method = -1;
+	TableVal* preserve_addr = anon_preserve_table(cl, &method);
+	auto addr = zeek::make_intrusive<zeek::AddrVal>(ip);
+
+	if ( (preserve_addr && preserve_addr->FindOrDefault(addr)) || method == KEEP_ORIG_ADDR )
+		*result = ip;
+
+	else if ( method < 0 || method >= NUM_ADDR_ANONYMIZATION_METHODS )
+		reporter->InternalError("invalid IP anonymization method");
+
+	else if ( ! ip_anonymizer[method] )
+		reporter->InternalError("IP anonymizer not initialized");
+
+	else
+		{
+		uint32_t new_ip[4];
+
+		if ( ! ip_anonymizer[method]->Anonymize6(bytes, new_ip) )
+			return false;
+
+		*result = IPAddr(IPv6, new_ip, IPAddr::Network);
+		}
+
+#ifdef LOG_ANONYMIZATION_MAPPING
+	log_anonymization_mapping(ip, *result);
+#endif
+	return true;
+	}
+
 #ifdef LOG_ANONYMIZATION_MAPPING
 
 #include "NetVar.h"
@@ -450,4 +625,12 @@ void zeek::detail::log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output
 		);
 	}
 
+void zeek::detail::log_anonymization_mapping(const IPAddr& input, const IPAddr& output)
+	{
+	if ( anonymization_mapping )
+		mgr.Enqueue(anonymization_mapping,
+		            zeek::make_intrusive<zeek::AddrVal>(input),
+		            zeek::make_intrusive<zeek::AddrVal>(output));
+	}
+
 #endif
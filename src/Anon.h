@@ -12,8 +12,14 @@
 
 #include <vector>
 #include <map>
+#include <string>
+#include <unordered_map>
 #include <cstdint>
 
+#include <openssl/evp.h>
+
+class IPAddr;
+
 namespace zeek::detail {
 
 // TODO: Anon.h may not be the right place to put these functions ...
@@ -31,6 +37,7 @@ enum ip_addr_anonymization_method_t {
 	RANDOM_MD5,
 	PREFIX_PRESERVING_A50,
 	PREFIX_PRESERVING_MD5,
+	PREFIX_PRESERVING_CRYPTOPAN,
 	NUM_ADDR_ANONYMIZATION_METHODS,
 };
 
@@ -49,6 +56,11 @@ public:
 
 	virtual ipaddr32_t anonymize(ipaddr32_t addr) = 0;
 
+	// Anonymizes an IPv6 address, given as four words in network order.
+	// Returns false if the method only supports IPv4.
+	virtual bool Anonymize6(const uint32_t* input, uint32_t* output)
+		{ return false; }
+
 	bool PreserveNet(ipaddr32_t input);
 
 protected:
@@ -120,13 +132,62 @@ protected:
 	Node* find_node(ipaddr32_t);
 };
 
+// Prefix-preserving anonymization as in Crypto-PAn (Xu et al., "Prefix-
+// Preserving IP Address Anonymization", ICNP 2002), for IPv4 and IPv6.
+// Each bit gets flipped depending on the AES encryption of the bits
+// before it, padded with a secret. OpenSSL uses the CPU's AES
+// instructions where available. As the flips for the first bits only
+// depend on the bits before them, they're cached per /16 and /24 prefix,
+// which leaves eight encryptions for most IPv4 addresses rather than 32.
+class AnonymizeIPAddr_CryptoPAn : public AnonymizeIPAddr {
+public:
+	AnonymizeIPAddr_CryptoPAn();
+	~AnonymizeIPAddr_CryptoPAn() override;
+
+	// Sets the 32-byte key, with the AES key followed by the secret
+	// that the pad derives from, as other Crypto-PAn implementations
+	// take it. Without one, the key derives from Zeek's seed. Returns
+	// false if the key has the wrong size.
+	bool SetKey(const std::string& key);
+
+	ipaddr32_t anonymize(ipaddr32_t addr) override;
+	bool Anonymize6(const uint32_t* input, uint32_t* output) override;
+
+protected:
+	// Returns the flips for bits [from, to) of the address, which must
+	// lie within the same 32-bit word, in the bit positions that they
+	// have within that word (in host order).
+	uint32_t Flips(const uint8_t* addr, int from, int to);
+
+	// Returns the flips for the first 24 bits of the address, from the
+	// caches where possible.
+	uint32_t PrefixFlips(const uint8_t* addr);
+
+	void Encrypt(const uint8_t* in, uint8_t* out);
+
+	EVP_CIPHER_CTX* ctx;
+	uint8_t pad[16];
+
+	// Flips of the first 16 bits, indexed by them. The lowest bit marks
+	// entries that have been computed.
+	std::vector<uint32_t> prefix16;
+
+	// Flips of the first 24 bits, keyed by them.
+	std::unordered_map<uint32_t, uint32_t> prefix24;
+};
+
 // The global IP anonymizers.
 extern AnonymizeIPAddr* ip_anonymizer[NUM_ADDR_ANONYMIZATION_METHODS];
 
 void init_ip_addr_anonymizers();
 ipaddr32_t anonymize_ip(ipaddr32_t ip, enum ip_addr_anonymization_class_t cl);
 
+// Anonymizes an IPv4 or IPv6 address. Returns false if the class's method
+// doesn't support IPv6.
+bool anonymize_ip(const IPAddr& ip, enum ip_addr_anonymization_class_t cl, IPAddr* result);
+
 #define LOG_ANONYMIZATION_MAPPING
 void log_anonymization_mapping(ipaddr32_t input, ipaddr32_t output);
+void log_anonymization_mapping(const IPAddr& input, const IPAddr& output);
 
 }
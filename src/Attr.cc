@@ -22,6 +22,7 @@ const char* attr_name(AttrTag t)
 		"&group", "&log", "&error_handler", "&type_column",
 		"(&tracked)", "&on_change", "&broker_store",
 		"&broker_allow_complex_type", "&backend", "&deprecated",
+		"&if_field", "&if_port", "&if_analyzer",
 	};
 
 	return attr_names[int(t)];
@@ -726,6 +727,12 @@ void Attributes::CheckAttr(Attr* a)
 		Error("&priority only applicable to event bodies");
 		break;
 
+	case ATTR_IF_FIELD:
+	case ATTR_IF_PORT:
+	case ATTR_IF_ANALYZER:
+		Error(fmt("%s only applicable to event bodies", attr_name(a->Tag())));
+		break;
+
 	case ATTR_GROUP:
 		if ( type->Tag() != TYPE_FUNC ||
 		     type->AsFuncType()->Flavor() != FUNC_FLAVOR_EVENT )
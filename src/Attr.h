@@ -46,9 +46,15 @@ enum AttrTag {
 	ATTR_BROKER_STORE_ALLOW_COMPLEX, // for Broker store backed tables
 	ATTR_BACKEND, // for Broker store backed tables
 	ATTR_DEPRECATED,
+	ATTR_IF_FIELD,	// for event body filters
+	ATTR_IF_PORT,	// for event body filters
+	ATTR_IF_ANALYZER,	// for event body filters
 	NUM_ATTRS // this item should always be last
 };
 
+// Returns the script-level name of an attribute, such as "&default".
+const char* attr_name(AttrTag t);
+
 class Attr;
 using AttrPtr = zeek::IntrusivePtr<Attr>;
 class Attributes;
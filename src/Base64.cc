@@ -179,6 +179,36 @@ int Base64Converter::Decode(int len, const char* data, int* pblen, char** pbuf)
 			base64_padding = 0;
 			}
 
+		// Between groups, decode runs of complete groups without
+		// padding or illegal characters directly. Anything else goes
+		// through the character-wise path below.
+		if ( base64_group_next == 0 && ! base64_after_padding )
+			{
+			const unsigned char* d = (const unsigned char*) data;
+
+			while ( len - dlen >= 4 && buf + 3 <= *pbuf + blen )
+				{
+				const unsigned char* g = d + dlen;
+
+				int k0 = base64_table[g[0]];
+				int k1 = base64_table[g[1]];
+				int k2 = base64_table[g[2]];
+				int k3 = base64_table[g[3]];
+
+				if ( (k0 | k1 | k2 | k3) < 0 ||
+				     g[0] == '=' || g[1] == '=' || g[2] == '=' || g[3] == '=' )
+					break;
+
+				uint32_t bit32 = (k0 << 18) | (k1 << 12) | (k2 << 6) | k3;
+				buf[0] = char((bit32 >> 16) & 0xff);
+				buf[1] = char((bit32 >> 8) & 0xff);
+				buf[2] = char(bit32 & 0xff);
+
+				buf += 3;
+				dlen += 4;
+				}
+			}
+
 		if ( dlen >= len )
 			break;
 
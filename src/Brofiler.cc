@@ -35,11 +35,17 @@ void Brofiler::AddStmt(zeek::detail::Stmt* s)
 	stmts.push_back(s);
 	}
 
+bool Brofiler::UseBinaryFormat() const
+	{
+	const char* format = zeekenv("ZEEK_PROFILER_FORMAT");
+	return format && strcmp(format, "binary") == 0;
+	}
+
 bool Brofiler::ReadStats()
 	{
 	char* bf = zeekenv("ZEEK_PROFILER_FILE");
 
-	if ( ! bf )
+	if ( ! bf || UseBinaryFormat() )
 		return false;
 
 	std::ifstream ifs;
@@ -85,19 +91,14 @@ bool Brofiler::ReadStats()
 	return true;
 	}
 
-bool Brofiler::WriteStats()
+FILE* Brofiler::OpenStatsFile(char* bf)
 	{
-	char* bf = zeekenv("ZEEK_PROFILER_FILE");
-
-	if ( ! bf )
-		return false;
-
 	SafeDirname dirname{bf};
 
 	if ( ! ensure_intermediate_dirs(dirname.result.data()) )
 		{
 		reporter->Error("Failed to open ZEEK_PROFILER_FILE destination '%s' for writing", bf);
-		return false;
+		return nullptr;
 		}
 
 	FILE* f;
@@ -112,7 +113,7 @@ bool Brofiler::WriteStats()
 		if ( fd == -1 )
 			{
 			reporter->Error("Failed to generate unique file name from ZEEK_PROFILER_FILE: %s", bf);
-			return false;
+			return nullptr;
 			}
 		f = fdopen(fd, "w");
 		}
@@ -124,7 +125,90 @@ bool Brofiler::WriteStats()
 	if ( ! f )
 		{
 		reporter->Error("Failed to open ZEEK_PROFILER_FILE destination '%s' for writing", bf);
+		return nullptr;
+		}
+
+	return f;
+	}
+
+static void write_u32(FILE* f, uint32_t v)
+	{
+	unsigned char b[4] = { static_cast<unsigned char>(v),
+	                       static_cast<unsigned char>(v >> 8),
+	                       static_cast<unsigned char>(v >> 16),
+	                       static_cast<unsigned char>(v >> 24) };
+	fwrite(b, sizeof(b), 1, f);
+	}
+
+void Brofiler::WriteBinaryStats(FILE* f)
+	{
+	map<string, uint32_t> file_idx;
+	vector<const string*> files;
+	vector<uint32_t> stmt_files;
+	vector<unsigned char> bits((stmts.size() + 7) / 8);
+	size_t n = 0;
+
+	for ( const auto& s : stmts )
+		{
+		auto loc = s->GetLocationInfo();
+		string file = loc->filename ? loc->filename : "<unknown>";
+		auto it = file_idx.find(file);
+
+		if ( it == file_idx.end() )
+			{
+			it = file_idx.emplace(std::move(file), files.size()).first;
+			files.emplace_back(&it->first);
+			}
+
+		stmt_files.emplace_back(it->second);
+
+		if ( s->GetAccessCount() )
+			bits[n / 8] |= 1 << (n % 8);
+
+		++n;
+		}
+
+	fwrite("ZCOV", 4, 1, f);
+	write_u32(f, 1);
+	write_u32(f, files.size());
+	write_u32(f, stmts.size());
+
+	for ( const auto& file : files )
+		{
+		write_u32(f, file->size());
+		fwrite(file->data(), file->size(), 1, f);
+		}
+
+	n = 0;
+
+	for ( const auto& s : stmts )
+		{
+		auto loc = s->GetLocationInfo();
+		write_u32(f, stmt_files[n++]);
+		write_u32(f, loc->first_line);
+		write_u32(f, loc->last_line);
+		}
+
+	fwrite(bits.data(), bits.size(), 1, f);
+	}
+
+bool Brofiler::WriteStats()
+	{
+	char* bf = zeekenv("ZEEK_PROFILER_FILE");
+
+	if ( ! bf )
 		return false;
+
+	FILE* f = OpenStatsFile(bf);
+
+	if ( ! f )
+		return false;
+
+	if ( UseBinaryFormat() )
+		{
+		WriteBinaryStats(f);
+		fclose(f);
+		return true;
 		}
 
 	for ( list<zeek::detail::Stmt*>::const_iterator it = stmts.begin();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdio>
 #include <map>
 #include <utility>
 #include <list>
@@ -18,7 +19,8 @@ public:
 
 	/**
 	 * Imports Bro script Stmt usage information from file pointed to by
-	 * environment variable ZEEK_PROFILER_FILE.
+	 * environment variable ZEEK_PROFILER_FILE. Files in the binary format
+	 * (see WriteStats()) aren't read, those get merged offline.
 	 *
 	 * @return: true if usage info was read, otherwise false.
 	 */
@@ -31,6 +33,12 @@ public:
 	 * ".XXXXXX" (exactly 6 X's), then it is first passed through mkstemp
 	 * to get a unique file.
 	 *
+	 * If environment variable ZEEK_PROFILER_FORMAT is "binary", this
+	 * writes just one bit per Stmt, whether it was executed, along with
+	 * its location. That needs neither descriptions of the Stmts nor the
+	 * usage info of earlier runs, so it's cheap enough for production.
+	 * The coverage-render script turns such files into the text format.
+	 *
 	 * @return: true when usage info is written, otherwise false.
 	 */
 	bool WriteStats();
@@ -43,6 +51,29 @@ public:
 	void AddStmt(zeek::detail::Stmt* s);
 
 private:
+	/**
+	 * Opens the file pointed to by ZEEK_PROFILER_FILE for writing, or
+	 * returns null after reporting an error.
+	 */
+	FILE* OpenStatsFile(char* bf);
+
+	/**
+	 * Writes the binary format of WriteStats(), which is:
+	 *
+	 *   "ZCOV", version (1), number of files, number of Stmts
+	 *   per file: length of its name, name
+	 *   per Stmt: index of its file, first line, last line
+	 *   a bit per Stmt, the lowest of the first byte for the first one
+	 *
+	 * Numbers are unsigned 32-bit little-endian integers.
+	 */
+	void WriteBinaryStats(FILE* f);
+
+	/**
+	 * @return: true if ZEEK_PROFILER_FORMAT selects the binary format.
+	 */
+	bool UseBinaryFormat() const;
+
 	/**
 	 * The current, global Brofiler instance creates this list at parse-time.
 	 */
@@ -0,0 +1,1310 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "Bytecode.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "DebugLogger.h"
+#include "Desc.h"
+#include "Expr.h"
+#include "Frame.h"
+#include "Func.h"
+#include "ID.h"
+#include "Reporter.h"
+#include "Scope.h"
+#include "Var.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// How a register holds the values of a given type.
+enum class Kind { VAL, INT, UINT, DOUBLE };
+
+Kind kind_of(const zeek::Type* t)
+	{
+	switch ( t->Tag() ) {
+	case zeek::TYPE_BOOL:
+	case zeek::TYPE_INT:
+		return Kind::INT;
+
+	case zeek::TYPE_COUNT:
+	case zeek::TYPE_COUNTER:
+		return Kind::UINT;
+
+	case zeek::TYPE_DOUBLE:
+	case zeek::TYPE_TIME:
+	case zeek::TYPE_INTERVAL:
+		return Kind::DOUBLE;
+
+	default:
+		return Kind::VAL;
+	}
+	}
+
+Kind kind_of(const Expr* e)
+	{
+	return kind_of(e->GetType().get());
+	}
+
+// Returns the type of Val the interpreter creates for a result of the
+// given type, or TYPE_VOID if it's not one of the native kinds.
+zeek::TypeTag box_tag(const zeek::Type* t)
+	{
+	switch ( t->Tag() ) {
+	case zeek::TYPE_BOOL:
+	case zeek::TYPE_INT:
+	case zeek::TYPE_DOUBLE:
+	case zeek::TYPE_TIME:
+	case zeek::TYPE_INTERVAL:
+		return t->Tag();
+
+	case zeek::TYPE_COUNT:
+	case zeek::TYPE_COUNTER:
+		return zeek::TYPE_COUNT;
+
+	default:
+		return zeek::TYPE_VOID;
+	}
+	}
+
+zeek::TypeTag box_tag(const Expr* e)
+	{
+	return box_tag(e->GetType().get());
+	}
+
+// The tag of the Val that a result of the given kind is stored as by the
+// arithmetic coercions.
+zeek::TypeTag coerce_tag(Kind k)
+	{
+	switch ( k ) {
+	case Kind::INT:		return zeek::TYPE_INT;
+	case Kind::UINT:	return zeek::TYPE_COUNT;
+	case Kind::DOUBLE:	return zeek::TYPE_DOUBLE;
+	default:		return zeek::TYPE_VOID;
+	}
+	}
+
+Kind tag_kind(zeek::TypeTag t)
+	{
+	switch ( t ) {
+	case zeek::TYPE_BOOL:
+	case zeek::TYPE_INT:
+		return Kind::INT;
+
+	case zeek::TYPE_COUNT:
+		return Kind::UINT;
+
+	case zeek::TYPE_DOUBLE:
+	case zeek::TYPE_TIME:
+	case zeek::TYPE_INTERVAL:
+		return Kind::DOUBLE;
+
+	default:
+		return Kind::VAL;
+	}
+	}
+
+// Returns the variable an assignment-like expression targets, or null if
+// it's anything but a plain variable.
+const NameExpr* lvalue_name(const Expr* e)
+	{
+	if ( e->Tag() == EXPR_REF )
+		e = static_cast<const UnaryExpr*>(e)->Op();
+
+	if ( e->Tag() != EXPR_NAME )
+		return nullptr;
+
+	auto n = e->AsNameExpr();
+
+	if ( n->Id()->IsType() )
+		return nullptr;
+
+	return n;
+	}
+
+ValPtr box(BytecodeReg& r, zeek::TypeTag tag)
+	{
+	if ( r.v )
+		return r.v;
+
+	switch ( tag ) {
+	case zeek::TYPE_BOOL:
+		r.v = zeek::val_mgr->Bool(r.i);
+		break;
+
+	case zeek::TYPE_INT:
+		r.v = zeek::val_mgr->Int(r.i);
+		break;
+
+	case zeek::TYPE_COUNT:
+		r.v = zeek::val_mgr->Count(r.u);
+		break;
+
+	case zeek::TYPE_DOUBLE:
+		r.v = zeek::make_intrusive<zeek::DoubleVal>(r.d);
+		break;
+
+	case zeek::TYPE_TIME:
+		r.v = zeek::make_intrusive<zeek::TimeVal>(r.d);
+		break;
+
+	case zeek::TYPE_INTERVAL:
+		r.v = zeek::make_intrusive<zeek::IntervalVal>(r.d);
+		break;
+
+	default:
+		break;
+	}
+
+	return r.v;
+	}
+
+void unbox(BytecodeReg& r, Kind k)
+	{
+	switch ( k ) {
+	case Kind::INT:
+		r.i = r.v->ForceAsInt();
+		break;
+
+	case Kind::UINT:
+		r.u = r.v->ForceAsUInt();
+		break;
+
+	case Kind::DOUBLE:
+		r.d = r.v->InternalDouble();
+		break;
+
+	case Kind::VAL:
+		break;
+	}
+	}
+
+BytecodeOp with_kind(BytecodeOp first, Kind k)
+	{
+	// Relies on the _V, _I, _U, _D ordering of the load instructions.
+	return BytecodeOp(first + int(k));
+	}
+
+} // namespace
+
+class BytecodeCompiler {
+public:
+	BytecodeCompiler(CompiledStmt* arg_target, bool arg_validate)
+		: target(arg_target), validate(arg_validate)
+		{ }
+
+	// Returns false if the compiled code would do nothing but call
+	// into the interpreter.
+	bool Compile(const Stmt* body)
+		{
+		CompileStmt(body);
+		Emit(BytecodeInstr(OP_END));
+		target->num_regs = max_regs;
+		return num_native > 0;
+		}
+
+private:
+	struct Operand {
+		int reg;
+		Kind kind;
+		zeek::TypeTag tag;	// for boxing a native result
+		bool pure;	// no side effects, all compiled natively
+	};
+
+	struct Loop {
+		int next_target;
+		std::vector<int> breaks;	// instructions to patch
+	};
+
+	void CompileStmt(const Stmt* s);
+	void CompileIf(const IfStmt* s);
+	void CompileWhile(const WhileStmt* s);
+	void CompileReturn(const ReturnStmt* s);
+	void CompileExec(const Stmt* s);
+
+	// Compiles an expression, returning the register with its value.
+	// If *check* is set and validation is enabled, pure expressions
+	// are checked against the interpreter.
+	Operand CompileExpr(const Expr* e, bool check = true);
+	Operand CompileNative(const Expr* e);
+	Operand CompileBinary(const BinaryExpr* e);
+	Operand CompileBool(const BinaryExpr* e);
+	Operand CompileCond(const CondExpr* e);
+	Operand CompileCoerce(const UnaryExpr* e);
+	Operand CompileAssign(const AssignExpr* e);
+	Operand CompileUpdate(const Expr* e, const NameExpr* n,
+	                      const Expr* rhs);
+	Operand Load(const NameExpr* n);
+	void Store(const NameExpr* n, const Operand& o);
+	Operand Fallback(const Expr* e);
+
+	int NewReg()
+		{
+		int r = next_reg++;
+		max_regs = std::max(max_regs, next_reg);
+		return r;
+		}
+
+	int Emit(const BytecodeInstr& in)
+		{
+		target->code.push_back(in);
+		return target->code.size() - 1;
+		}
+
+	int Here() const
+		{ return target->code.size(); }
+
+	BytecodeInstr& At(int i)
+		{ return target->code[i]; }
+
+	CompiledStmt* target;
+	bool validate;
+
+	int next_reg = 0;
+	int max_regs = 0;
+	int num_native = 0;
+
+	// Instructions whose null_target becomes the end of the current
+	// statement.
+	std::vector<int>* null_fixups = nullptr;
+
+	// Whether the current statement calls into the interpreter.
+	bool had_fallback = false;
+
+	std::vector<Loop> loops;
+};
+
+void BytecodeCompiler::CompileStmt(const Stmt* s)
+	{
+	int saved_reg = next_reg;
+	auto saved_fixups = null_fixups;
+	bool saved_fallback = had_fallback;
+
+	std::vector<int> fixups;
+	null_fixups = &fixups;
+	had_fallback = false;
+
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+		for ( const auto& stmt : s->AsStmtList()->Stmts() )
+			CompileStmt(stmt);
+		break;
+
+	case STMT_EXPR:
+		CompileExpr(static_cast<const ExprStmt*>(s)->StmtExpr());
+		break;
+
+	case STMT_IF:
+		CompileIf(static_cast<const IfStmt*>(s));
+		break;
+
+	case STMT_WHILE:
+		CompileWhile(static_cast<const WhileStmt*>(s));
+		break;
+
+	case STMT_RETURN:
+		CompileReturn(static_cast<const ReturnStmt*>(s));
+		break;
+
+	case STMT_NEXT:
+		{
+		BytecodeInstr in(loops.empty() ? OP_RETURN_FLOW : OP_JUMP);
+		in.b = loops.empty() ? FLOW_LOOP : loops.back().next_target;
+		Emit(in);
+		++num_native;
+		}
+		break;
+
+	case STMT_BREAK:
+		if ( loops.empty() )
+			{
+			BytecodeInstr in(OP_RETURN_FLOW);
+			in.b = FLOW_BREAK;
+			Emit(in);
+			}
+		else
+			loops.back().breaks.push_back(Emit(BytecodeInstr(OP_JUMP)));
+
+		++num_native;
+		break;
+
+	case STMT_NULL:
+		break;
+
+	default:
+		CompileExec(s);
+		break;
+	}
+
+	for ( auto i : fixups )
+		At(i).null_target = Here();
+
+	if ( had_fallback && s->Tag() != STMT_LIST )
+		Emit(BytecodeInstr(OP_CHECK_DELAYED));
+
+	next_reg = saved_reg;
+	null_fixups = saved_fixups;
+	had_fallback = saved_fallback || had_fallback;
+	}
+
+void BytecodeCompiler::CompileIf(const IfStmt* s)
+	{
+	const Expr* cond = s->StmtExpr();
+
+	if ( cond->GetType()->Tag() != zeek::TYPE_BOOL )
+		{
+		CompileExec(s);
+		return;
+		}
+
+	auto c = CompileExpr(cond);
+
+	BytecodeInstr jf(c.kind == Kind::INT ? OP_JUMP_IF_FALSE_I : OP_JUMP_IF_ZERO_V);
+	jf.a = c.reg;
+	int jump_false = Emit(jf);
+	++num_native;
+
+	CompileStmt(s->TrueBranch());
+	int jump_end = Emit(BytecodeInstr(OP_JUMP));
+
+	At(jump_false).b = Here();
+	CompileStmt(s->FalseBranch());
+	At(jump_end).b = Here();
+	}
+
+void BytecodeCompiler::CompileWhile(const WhileStmt* s)
+	{
+	const Expr* cond = s->Condition();
+
+	if ( cond->GetType()->Tag() != zeek::TYPE_BOOL )
+		{
+		CompileExec(s);
+		return;
+		}
+
+	int top = Here();
+	auto c = CompileExpr(cond);
+
+	BytecodeInstr jf(c.kind == Kind::INT ? OP_JUMP_IF_FALSE_I : OP_JUMP_IF_ZERO_V);
+	jf.a = c.reg;
+	int jump_exit = Emit(jf);
+	++num_native;
+
+	loops.push_back({top, {}});
+	CompileStmt(s->Body());
+
+	BytecodeInstr jt(OP_JUMP);
+	jt.b = top;
+	Emit(jt);
+
+	// Any null result of the condition also ends the loop; the fixups
+	// get patched to here at the end of the statement.
+	At(jump_exit).b = Here();
+
+	for ( auto i : loops.back().breaks )
+		At(i).b = Here();
+
+	loops.pop_back();
+	}
+
+void BytecodeCompiler::CompileReturn(const ReturnStmt* s)
+	{
+	++num_native;
+
+	const Expr* e = s->StmtExpr();
+
+	if ( ! e )
+		{
+		Emit(BytecodeInstr(OP_RETURN_NONE));
+		return;
+		}
+
+	auto o = CompileExpr(e);
+
+	BytecodeInstr ret(OP_RETURN);
+	ret.a = o.reg;
+	ret.tag = o.tag;
+	Emit(ret);
+
+	// An unset value returns nothing.
+	for ( auto i : *null_fixups )
+		At(i).null_target = Here();
+
+	null_fixups->clear();
+	Emit(BytecodeInstr(OP_RETURN_NONE));
+	}
+
+void BytecodeCompiler::CompileExec(const Stmt* s)
+	{
+	BytecodeInstr in(OP_EXEC);
+	in.s = s;
+	in.b = -1;
+	in.c = loops.empty() ? -1 : loops.back().next_target;
+
+	int i = Emit(in);
+
+	// The interpreter handles delayed execution itself here.
+	if ( ! loops.empty() )
+		loops.back().breaks.push_back(i);
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileExpr(const Expr* e, bool check)
+	{
+	auto o = CompileNative(e);
+
+	if ( validate && check && o.pure && o.kind != Kind::VAL &&
+	     e->Tag() != EXPR_CONST && e->Tag() != EXPR_NAME )
+		{
+		BytecodeInstr in(OP_VALIDATE);
+		in.a = o.reg;
+		in.tag = o.tag;
+		in.e = e;
+		Emit(in);
+		}
+
+	return o;
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileNative(const Expr* e)
+	{
+	switch ( e->Tag() ) {
+	case EXPR_CONST:
+		{
+		BytecodeReg k;
+		k.v = {zeek::NewRef{}, static_cast<const ConstExpr*>(e)->Value()};
+
+		if ( ! k.v )
+			return Fallback(e);
+
+		auto kind = kind_of(e);
+		unbox(k, kind);
+
+		target->consts.push_back(k);
+
+		BytecodeInstr in(OP_LOADK);
+		in.a = NewReg();
+		in.b = target->consts.size() - 1;
+		Emit(in);
+		++num_native;
+
+		return {in.a, kind, box_tag(e), true};
+		}
+
+	case EXPR_NAME:
+		if ( e->AsNameExpr()->Id()->IsType() )
+			return Fallback(e);
+
+		return Load(e->AsNameExpr());
+
+	case EXPR_ADD:
+	case EXPR_SUB:
+	case EXPR_TIMES:
+	case EXPR_DIVIDE:
+	case EXPR_MOD:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_GE:
+	case EXPR_GT:
+		return CompileBinary(static_cast<const BinaryExpr*>(e));
+
+	case EXPR_AND_AND:
+	case EXPR_OR_OR:
+		return CompileBool(static_cast<const BinaryExpr*>(e));
+
+	case EXPR_COND:
+		return CompileCond(static_cast<const CondExpr*>(e));
+
+	case EXPR_NOT:
+		{
+		auto op = static_cast<const UnaryExpr*>(e)->Op();
+
+		if ( op->GetType()->Tag() != zeek::TYPE_BOOL ||
+		     e->GetType()->Tag() != zeek::TYPE_BOOL )
+			return Fallback(e);
+
+		auto o = CompileExpr(op, false);
+
+		BytecodeInstr in(OP_NOT_I);
+		in.a = NewReg();
+		in.b = o.reg;
+		Emit(in);
+		++num_native;
+
+		return {in.a, Kind::INT, zeek::TYPE_BOOL, o.pure};
+		}
+
+	case EXPR_NEGATE:
+		{
+		auto op = static_cast<const UnaryExpr*>(e)->Op();
+		auto t = op->GetType()->Tag();
+		BytecodeOp code;
+
+		if ( t == zeek::TYPE_INT && e->GetType()->Tag() == zeek::TYPE_INT )
+			code = OP_NEG_I;
+		else if ( (t == zeek::TYPE_DOUBLE || t == zeek::TYPE_INTERVAL) &&
+		          e->GetType()->Tag() == t )
+			code = OP_NEG_D;
+		else
+			return Fallback(e);
+
+		auto o = CompileExpr(op, false);
+
+		BytecodeInstr in(code);
+		in.a = NewReg();
+		in.b = o.reg;
+		Emit(in);
+		++num_native;
+
+		return {in.a, kind_of(e), t, o.pure};
+		}
+
+	case EXPR_ARITH_COERCE:
+		return CompileCoerce(static_cast<const UnaryExpr*>(e));
+
+	case EXPR_ASSIGN:
+		return CompileAssign(static_cast<const AssignExpr*>(e));
+
+	case EXPR_ADD_TO:
+	case EXPR_REMOVE_FROM:
+		{
+		auto be = static_cast<const BinaryExpr*>(e);
+		auto n = lvalue_name(be->Op1());
+
+		if ( ! n )
+			return Fallback(e);
+
+		return CompileUpdate(e, n, be->Op2());
+		}
+
+	case EXPR_INCR:
+	case EXPR_DECR:
+		{
+		auto n = lvalue_name(static_cast<const UnaryExpr*>(e)->Op());
+
+		if ( ! n )
+			return Fallback(e);
+
+		return CompileUpdate(e, n, nullptr);
+		}
+
+	default:
+		return Fallback(e);
+	}
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileBinary(const BinaryExpr* e)
+	{
+	auto k = kind_of(e->Op1());
+	auto rk = kind_of(e);
+	bool is_cmp = e->Tag() >= EXPR_LT && e->Tag() <= EXPR_GT;
+
+	if ( k == Kind::VAL || kind_of(e->Op2()) != k || rk == Kind::VAL )
+		return Fallback(e);
+
+	if ( is_cmp ? e->GetType()->Tag() != zeek::TYPE_BOOL : rk != k )
+		return Fallback(e);
+
+	if ( e->Tag() == EXPR_MOD && k == Kind::DOUBLE )
+		return Fallback(e);
+
+	if ( (e->Tag() == EXPR_ADD || e->Tag() == EXPR_SUB ||
+	      e->Tag() == EXPR_TIMES || e->Tag() == EXPR_DIVIDE) &&
+	     e->GetType()->Tag() == zeek::TYPE_BOOL )
+		return Fallback(e);
+
+	BytecodeOp first;
+
+	switch ( e->Tag() ) {
+	case EXPR_ADD:		first = OP_ADD_I; break;
+	case EXPR_SUB:		first = OP_SUB_I; break;
+	case EXPR_TIMES:	first = OP_MUL_I; break;
+	case EXPR_DIVIDE:	first = OP_DIV_I; break;
+	case EXPR_MOD:		first = OP_MOD_I; break;
+	case EXPR_LT:		first = OP_LT_I; break;
+	case EXPR_LE:		first = OP_LE_I; break;
+	case EXPR_EQ:		first = OP_EQ_I; break;
+	case EXPR_NE:		first = OP_NE_I; break;
+	case EXPR_GE:		first = OP_GE_I; break;
+	case EXPR_GT:		first = OP_GT_I; break;
+	default:		return Fallback(e);
+	}
+
+	auto o1 = CompileExpr(e->Op1(), false);
+	auto o2 = CompileExpr(e->Op2(), false);
+
+	// The arithmetic and comparison instructions come in _I, _U, _D
+	// order.
+	BytecodeInstr in(BytecodeOp(first + int(k) - int(Kind::INT)));
+	in.a = NewReg();
+	in.b = o1.reg;
+	in.c = o2.reg;
+	in.e = e;
+	Emit(in);
+	++num_native;
+
+	return {in.a, rk, box_tag(e), o1.pure && o2.pure};
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileBool(const BinaryExpr* e)
+	{
+	if ( e->Op1()->GetType()->Tag() != zeek::TYPE_BOOL ||
+	     e->Op2()->GetType()->Tag() != zeek::TYPE_BOOL ||
+	     e->GetType()->Tag() != zeek::TYPE_BOOL )
+		return Fallback(e);
+
+	int dest = NewReg();
+
+	auto o1 = CompileExpr(e->Op1(), false);
+
+	BytecodeInstr mv1(OP_MOVE);
+	mv1.a = dest;
+	mv1.b = o1.reg;
+	Emit(mv1);
+
+	// Short-circuit with the first operand as the result.
+	BytecodeInstr j(e->Tag() == EXPR_AND_AND ? OP_JUMP_IF_FALSE_I : OP_JUMP_IF_TRUE_I);
+	j.a = dest;
+	int jump = Emit(j);
+
+	auto o2 = CompileExpr(e->Op2(), false);
+
+	BytecodeInstr mv2(OP_MOVE);
+	mv2.a = dest;
+	mv2.b = o2.reg;
+	Emit(mv2);
+
+	At(jump).b = Here();
+	++num_native;
+
+	return {dest, Kind::INT, zeek::TYPE_BOOL, o1.pure && o2.pure};
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileCond(const CondExpr* e)
+	{
+	auto rk = kind_of(e);
+	auto rt = box_tag(e);
+
+	if ( e->Op1()->GetType()->Tag() != zeek::TYPE_BOOL ||
+	     kind_of(e->Op2()) != rk || kind_of(e->Op3()) != rk ||
+	     box_tag(e->Op2()) != rt || box_tag(e->Op3()) != rt )
+		return Fallback(e);
+
+	int dest = NewReg();
+
+	auto c = CompileExpr(e->Op1(), false);
+
+	BytecodeInstr jf(OP_JUMP_IF_FALSE_I);
+	jf.a = c.reg;
+	int jump_false = Emit(jf);
+
+	auto o2 = CompileExpr(e->Op2(), false);
+
+	BytecodeInstr mv2(OP_MOVE);
+	mv2.a = dest;
+	mv2.b = o2.reg;
+	Emit(mv2);
+
+	int jump_end = Emit(BytecodeInstr(OP_JUMP));
+	At(jump_false).b = Here();
+
+	auto o3 = CompileExpr(e->Op3(), false);
+
+	BytecodeInstr mv3(OP_MOVE);
+	mv3.a = dest;
+	mv3.b = o3.reg;
+	Emit(mv3);
+
+	At(jump_end).b = Here();
+	++num_native;
+
+	return {dest, rk, rt, c.pure && o2.pure && o3.pure};
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileCoerce(const UnaryExpr* e)
+	{
+	auto from = kind_of(e->Op());
+	auto to = kind_of(e);
+
+	if ( from == Kind::VAL || to == Kind::VAL )
+		return Fallback(e);
+
+	BytecodeOp code = OP_COERCE_N;
+
+	if ( from == Kind::INT && to == Kind::UINT )
+		code = OP_I2U;
+	else if ( from == Kind::INT && to == Kind::DOUBLE )
+		code = OP_I2D;
+	else if ( from == Kind::UINT && to == Kind::INT )
+		code = OP_U2I;
+	else if ( from == Kind::UINT && to == Kind::DOUBLE )
+		code = OP_U2D;
+	else if ( from == Kind::DOUBLE && to == Kind::INT )
+		code = OP_D2I;
+	else if ( from == Kind::DOUBLE && to == Kind::UINT )
+		code = OP_D2U;
+
+	auto o = CompileExpr(e->Op(), false);
+
+	BytecodeInstr in(code);
+	in.a = NewReg();
+	in.b = o.reg;
+	Emit(in);
+	++num_native;
+
+	return {in.a, to, coerce_tag(to), o.pure};
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileAssign(const AssignExpr* e)
+	{
+	auto n = lvalue_name(e->Op1());
+
+	if ( ! n )
+		return Fallback(e);
+
+	auto o = CompileExpr(e->Op2());
+	Store(n, o);
+	++num_native;
+
+	o.pure = false;
+	return o;
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::CompileUpdate(const Expr* e,
+                                                          const NameExpr* n,
+                                                          const Expr* rhs)
+	{
+	auto k = kind_of(n);
+
+	if ( k == Kind::VAL || kind_of(e) != k )
+		return Fallback(e);
+
+	BytecodeOp code;
+
+	if ( rhs )
+		{
+		// += and -=
+		if ( kind_of(rhs) != k || n->GetType()->Tag() == zeek::TYPE_BOOL )
+			return Fallback(e);
+
+		code = e->Tag() == EXPR_ADD_TO ? OP_ADD_I : OP_SUB_I;
+		code = BytecodeOp(code + int(k) - int(Kind::INT));
+		}
+
+	else
+		{
+		// ++ and --
+		if ( k == Kind::DOUBLE || n->GetType()->Tag() == zeek::TYPE_BOOL )
+			return Fallback(e);
+
+		if ( e->Tag() == EXPR_INCR )
+			code = k == Kind::INT ? OP_INCR_I : OP_INCR_U;
+		else
+			code = k == Kind::INT ? OP_DECR_I : OP_DECR_U;
+		}
+
+	auto o1 = Load(n);
+	Operand o2 = o1;
+
+	if ( rhs )
+		o2 = CompileExpr(rhs);
+
+	BytecodeInstr in(code);
+	in.a = NewReg();
+	in.b = o1.reg;
+	in.c = o2.reg;
+	in.e = e;
+	Emit(in);
+	++num_native;
+
+	Operand result{in.a, k, box_tag(e), false};
+	Store(n, result);
+
+	return result;
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::Load(const NameExpr* n)
+	{
+	auto k = kind_of(n);
+	auto first = n->Id()->IsGlobal() ? OP_LOAD_GLOBAL_V : OP_LOAD_LOCAL_V;
+
+	BytecodeInstr in(with_kind(first, k));
+	in.a = NewReg();
+	in.e = n;
+	Emit(in);
+	++num_native;
+
+	return {in.a, k, box_tag(n), true};
+	}
+
+void BytecodeCompiler::Store(const NameExpr* n, const Operand& o)
+	{
+	BytecodeInstr in(n->Id()->IsGlobal() ? OP_STORE_GLOBAL : OP_STORE_LOCAL);
+	in.b = o.reg;
+	in.tag = o.tag;
+	in.id = n->Id();
+	Emit(in);
+	}
+
+BytecodeCompiler::Operand BytecodeCompiler::Fallback(const Expr* e)
+	{
+	auto k = kind_of(e);
+
+	BytecodeInstr in(with_kind(OP_EVAL_V, k));
+	in.a = NewReg();
+	in.tag = box_tag(e);
+	in.e = e;
+	null_fixups->push_back(Emit(in));
+
+	had_fallback = true;
+
+	return {in.a, k, in.tag, false};
+	}
+
+StmtPtr CompiledStmt::Compile(const StmtPtr& body, bool validate)
+	{
+	if ( body->Tag() == STMT_COMPILED )
+		return nullptr;
+
+	auto cs = new CompiledStmt(body);
+	StmtPtr rval{zeek::AdoptRef{}, cs};
+
+	BytecodeCompiler c(cs, validate);
+
+	if ( ! c.Compile(body.get()) )
+		return nullptr;
+
+	return rval;
+	}
+
+CompiledStmt::CompiledStmt(StmtPtr arg_original)
+	: Stmt(STMT_COMPILED), original(std::move(arg_original))
+	{
+	SetLocationInfo(original->GetLocationInfo());
+	}
+
+CompiledStmt::~CompiledStmt()
+	{
+	}
+
+ValPtr CompiledStmt::Exec(Frame* f, stmt_flow_type& flow) const
+	{
+	RegisterAccess();
+	flow = FLOW_NEXT;
+
+	// Most bodies get by with a few registers, which we then keep on
+	// the stack.
+	constexpr int NUM_STACK_REGS = 16;
+	BytecodeReg stack_regs[NUM_STACK_REGS];
+	std::unique_ptr<BytecodeReg[]> heap_regs;
+	BytecodeReg* r = stack_regs;
+
+	if ( num_regs > NUM_STACK_REGS )
+		{
+		heap_regs = std::make_unique<BytecodeReg[]>(num_regs);
+		r = heap_regs.get();
+		}
+
+	const BytecodeInstr* start = code.data();
+	const BytecodeInstr* pc = start;
+
+#define LOAD_VAR(get, unbox_field) \
+		{ \
+		auto n = static_cast<const NameExpr*>(in.e); \
+		const auto& v = get; \
+		if ( ! v ) \
+			reporter->ExprRuntimeError(n, "value used but not set"); \
+		auto& d = r[in.a]; \
+		d.v = v; \
+		unbox_field; \
+		} \
+		break;
+
+#define ARITH(op, field, oper) \
+	case op: \
+		{ \
+		auto& d = r[in.a]; \
+		d.field = r[in.b].field oper r[in.c].field; \
+		d.v = nullptr; \
+		} \
+		break;
+
+#define ARITH_CHECKED(op, field, oper, msg) \
+	case op: \
+		{ \
+		if ( r[in.c].field == 0 ) \
+			reporter->ExprRuntimeError(in.e, msg); \
+		auto& d = r[in.a]; \
+		d.field = r[in.b].field oper r[in.c].field; \
+		d.v = nullptr; \
+		} \
+		break;
+
+#define COMPARE(op, field, oper) \
+	case op: \
+		{ \
+		auto& d = r[in.a]; \
+		d.i = r[in.b].field oper r[in.c].field; \
+		d.v = nullptr; \
+		} \
+		break;
+
+#define CONVERT(op, from, to, type) \
+	case op: \
+		{ \
+		auto& d = r[in.a]; \
+		d.to = static_cast<type>(r[in.b].from); \
+		d.v = nullptr; \
+		} \
+		break;
+
+	for ( ; ; )
+		{
+		const BytecodeInstr& in = *pc++;
+
+		switch ( in.op ) {
+		case OP_LOADK:
+			r[in.a] = consts[in.b];
+			break;
+
+		case OP_MOVE:
+			r[in.a] = r[in.b];
+			break;
+
+		case OP_LOAD_LOCAL_V:
+			LOAD_VAR(f->GetElementByID({zeek::NewRef{}, n->Id()}), )
+		case OP_LOAD_LOCAL_I:
+			LOAD_VAR(f->GetElementByID({zeek::NewRef{}, n->Id()}), d.i = v->ForceAsInt())
+		case OP_LOAD_LOCAL_U:
+			LOAD_VAR(f->GetElementByID({zeek::NewRef{}, n->Id()}), d.u = v->ForceAsUInt())
+		case OP_LOAD_LOCAL_D:
+			LOAD_VAR(f->GetElementByID({zeek::NewRef{}, n->Id()}), d.d = v->InternalDouble())
+
+		case OP_LOAD_GLOBAL_V:
+			LOAD_VAR(n->Id()->GetVal(), )
+		case OP_LOAD_GLOBAL_I:
+			LOAD_VAR(n->Id()->GetVal(), d.i = v->ForceAsInt())
+		case OP_LOAD_GLOBAL_U:
+			LOAD_VAR(n->Id()->GetVal(), d.u = v->ForceAsUInt())
+		case OP_LOAD_GLOBAL_D:
+			LOAD_VAR(n->Id()->GetVal(), d.d = v->InternalDouble())
+
+		case OP_STORE_LOCAL:
+			f->SetElement(in.id, box(r[in.b], in.tag));
+			break;
+
+		case OP_STORE_GLOBAL:
+			in.id->SetVal(box(r[in.b], in.tag));
+			break;
+
+		ARITH(OP_ADD_I, i, +)
+		ARITH(OP_ADD_U, u, +)
+		ARITH(OP_ADD_D, d, +)
+		ARITH(OP_SUB_I, i, -)
+		ARITH(OP_SUB_U, u, -)
+		ARITH(OP_SUB_D, d, -)
+		ARITH(OP_MUL_I, i, *)
+		ARITH(OP_MUL_U, u, *)
+		ARITH(OP_MUL_D, d, *)
+		ARITH_CHECKED(OP_DIV_I, i, /, "division by zero")
+		ARITH_CHECKED(OP_DIV_U, u, /, "division by zero")
+		ARITH_CHECKED(OP_DIV_D, d, /, "division by zero")
+		ARITH_CHECKED(OP_MOD_I, i, %, "modulo by zero")
+		ARITH_CHECKED(OP_MOD_U, u, %, "modulo by zero")
+
+		COMPARE(OP_LT_I, i, <)
+		COMPARE(OP_LT_U, u, <)
+		COMPARE(OP_LT_D, d, <)
+		COMPARE(OP_LE_I, i, <=)
+		COMPARE(OP_LE_U, u, <=)
+		COMPARE(OP_LE_D, d, <=)
+		COMPARE(OP_EQ_I, i, ==)
+		COMPARE(OP_EQ_U, u, ==)
+		COMPARE(OP_EQ_D, d, ==)
+		COMPARE(OP_NE_I, i, !=)
+		COMPARE(OP_NE_U, u, !=)
+		COMPARE(OP_NE_D, d, !=)
+		COMPARE(OP_GE_I, i, >=)
+		COMPARE(OP_GE_U, u, >=)
+		COMPARE(OP_GE_D, d, >=)
+		COMPARE(OP_GT_I, i, >)
+		COMPARE(OP_GT_U, u, >)
+		COMPARE(OP_GT_D, d, >)
+
+		case OP_NOT_I:
+			{
+			auto& d = r[in.a];
+			d.i = ! r[in.b].i;
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_NEG_I:
+			{
+			auto& d = r[in.a];
+			d.i = - r[in.b].i;
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_NEG_D:
+			{
+			auto& d = r[in.a];
+			d.d = - r[in.b].d;
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_INCR_I:
+			{
+			auto& d = r[in.a];
+			d.i = r[in.b].i + 1;
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_INCR_U:
+			{
+			auto& d = r[in.a];
+			d.u = r[in.b].u + 1;
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_DECR_I:
+			{
+			auto& d = r[in.a];
+			d.i = r[in.b].i - 1;
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_DECR_U:
+			{
+			// Same as the interpreter, which goes through int.
+			bro_int_t k = static_cast<bro_int_t>(r[in.b].u) - 1;
+
+			if ( k < 0 )
+				reporter->ExprRuntimeError(in.e, "count underflow");
+
+			auto& d = r[in.a];
+			d.u = k;
+			d.v = nullptr;
+			}
+			break;
+
+		CONVERT(OP_I2U, i, u, bro_uint_t)
+		CONVERT(OP_I2D, i, d, double)
+		CONVERT(OP_U2I, u, i, bro_int_t)
+		CONVERT(OP_U2D, u, d, double)
+		CONVERT(OP_D2I, d, i, bro_int_t)
+		CONVERT(OP_D2U, d, u, bro_uint_t)
+
+		case OP_COERCE_N:
+			{
+			auto& d = r[in.a];
+			d = r[in.b];
+			d.v = nullptr;
+			}
+			break;
+
+		case OP_JUMP:
+			pc = start + in.b;
+			break;
+
+		case OP_JUMP_IF_FALSE_I:
+			if ( ! r[in.a].i )
+				pc = start + in.b;
+			break;
+
+		case OP_JUMP_IF_TRUE_I:
+			if ( r[in.a].i )
+				pc = start + in.b;
+			break;
+
+		case OP_JUMP_IF_ZERO_V:
+			if ( r[in.a].v->IsZero() )
+				pc = start + in.b;
+			break;
+
+		case OP_EVAL_V:
+		case OP_EVAL_I:
+		case OP_EVAL_U:
+		case OP_EVAL_D:
+			{
+			auto v = in.e->Eval(f);
+
+			if ( ! v )
+				{
+				pc = start + in.null_target;
+				break;
+				}
+
+			auto& d = r[in.a];
+			d.v = std::move(v);
+			unbox(d, Kind(in.op - OP_EVAL_V));
+			}
+			break;
+
+		case OP_EXEC:
+			{
+			stmt_flow_type sflow = FLOW_NEXT;
+			auto result = in.s->Exec(f, sflow);
+
+			if ( sflow == FLOW_BREAK && in.b >= 0 )
+				pc = start + in.b;
+
+			else if ( sflow == FLOW_LOOP && in.c >= 0 )
+				pc = start + in.c;
+
+			else if ( sflow != FLOW_NEXT || result || f->HasDelayed() )
+				{
+				flow = sflow;
+				return result;
+				}
+			}
+			break;
+
+		case OP_CHECK_DELAYED:
+			if ( f->HasDelayed() )
+				return nullptr;
+			break;
+
+		case OP_RETURN:
+			flow = FLOW_RETURN;
+			return box(r[in.a], in.tag);
+
+		case OP_RETURN_NONE:
+			flow = FLOW_RETURN;
+			return nullptr;
+
+		case OP_RETURN_FLOW:
+			flow = stmt_flow_type(in.b);
+			return nullptr;
+
+		case OP_END:
+			return nullptr;
+
+		case OP_VALIDATE:
+			{
+			auto v = in.e->Eval(f);
+			const auto& reg = r[in.a];
+			bool same = false;
+
+			if ( v && box_tag(v->GetType().get()) == in.tag )
+				{
+				switch ( tag_kind(in.tag) ) {
+				case Kind::INT:
+					same = v->ForceAsInt() == reg.i;
+					break;
+
+				case Kind::UINT:
+					same = v->ForceAsUInt() == reg.u;
+					break;
+
+				case Kind::DOUBLE:
+					same = v->InternalDouble() == reg.d ||
+					       (std::isnan(reg.d) && std::isnan(v->InternalDouble()));
+					break;
+
+				case Kind::VAL:
+					break;
+				}
+				}
+
+			if ( ! same )
+				ValidationFailed(in, reg, v);
+			}
+			break;
+		}
+		}
+
+#undef LOAD_VAR
+#undef ARITH
+#undef ARITH_CHECKED
+#undef COMPARE
+#undef CONVERT
+	}
+
+void CompiledStmt::ValidationFailed(const BytecodeInstr& in,
+                                    const BytecodeReg& r,
+                                    const ValPtr& v) const
+	{
+	ODesc ed;
+	in.e->Describe(&ed);
+
+	BytecodeReg copy = r;
+	ODesc cd;
+	box(copy, in.tag)->Describe(&cd);
+
+	ODesc vd;
+
+	if ( v )
+		v->Describe(&vd);
+	else
+		vd.Add("<unset>");
+
+	const Location* loc = in.e->GetLocationInfo();
+
+	reporter->InternalWarning("bytecode mismatch for '%s' at %s, line %d: %s (interpreter: %s)",
+	                          ed.Description(),
+	                          loc->filename ? loc->filename : "<unknown>",
+	                          loc->first_line, cd.Description(),
+	                          vd.Description());
+	}
+
+bool CompiledStmt::IsPure() const
+	{
+	return original->IsPure();
+	}
+
+void CompiledStmt::Describe(ODesc* d) const
+	{
+	original->Describe(d);
+	}
+
+TraversalCode CompiledStmt::Traverse(TraversalCallback* cb) const
+	{
+	return original->Traverse(cb);
+	}
+
+void compile_script_functions(bool validate)
+	{
+	int num_bodies = 0;
+	int num_compiled = 0;
+
+	for ( const auto& [name, id] : global_scope()->Vars() )
+		{
+		if ( ! id->HasVal() || ! id->GetType() ||
+		     id->GetType()->Tag() != zeek::TYPE_FUNC )
+			continue;
+
+		auto func = id->GetVal()->AsFunc();
+
+		if ( func->GetKind() != zeek::Func::SCRIPT_FUNC )
+			continue;
+
+		// Copy, as replacing bodies modifies the original.
+		auto bodies = func->GetBodies();
+
+		for ( const auto& body : bodies )
+			{
+			++num_bodies;
+
+			if ( auto compiled = CompiledStmt::Compile(body.stmts, validate) )
+				{
+				func->ReplaceBody(body.stmts, std::move(compiled));
+				++num_compiled;
+				}
+			}
+		}
+
+	DBG_LOG(DBG_SCRIPTS, "compiled %d of %d function bodies to bytecode",
+	        num_compiled, num_bodies);
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,190 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Stmt.h"
+#include "Type.h"
+#include "Val.h"
+
+namespace zeek::detail {
+
+class Expr;
+
+/**
+ * A register of compiled script code. Values of the basic numeric types
+ * (bool, int, count, double, time, interval) are held unboxed. *v* holds
+ * the corresponding Val once one exists, so that values that are just
+ * passed along are never re-created. For all other types only *v* is
+ * used.
+ */
+struct BytecodeReg {
+	union {
+		bro_int_t i;
+		bro_uint_t u;
+		double d;
+	};
+
+	ValPtr v;
+
+	BytecodeReg() : i(0)	{ }
+};
+
+// Instruction opcodes. The suffix denotes the kind of operands: _I for
+// int and bool, _U for count, _D for the double types, and _V for boxed
+// values of any type.
+enum BytecodeOp : uint8_t {
+	OP_LOADK,		// a = consts[b]
+	OP_MOVE,		// a = b
+
+	OP_LOAD_LOCAL_V, OP_LOAD_LOCAL_I, OP_LOAD_LOCAL_U, OP_LOAD_LOCAL_D,
+	OP_LOAD_GLOBAL_V, OP_LOAD_GLOBAL_I, OP_LOAD_GLOBAL_U, OP_LOAD_GLOBAL_D,
+	OP_STORE_LOCAL,		// id = box(b)
+	OP_STORE_GLOBAL,	// id = box(b)
+
+	OP_ADD_I, OP_ADD_U, OP_ADD_D,	// a = b + c
+	OP_SUB_I, OP_SUB_U, OP_SUB_D,
+	OP_MUL_I, OP_MUL_U, OP_MUL_D,
+	OP_DIV_I, OP_DIV_U, OP_DIV_D,
+	OP_MOD_I, OP_MOD_U,
+
+	OP_LT_I, OP_LT_U, OP_LT_D,	// a = b < c, as bool
+	OP_LE_I, OP_LE_U, OP_LE_D,
+	OP_EQ_I, OP_EQ_U, OP_EQ_D,
+	OP_NE_I, OP_NE_U, OP_NE_D,
+	OP_GE_I, OP_GE_U, OP_GE_D,
+	OP_GT_I, OP_GT_U, OP_GT_D,
+
+	OP_NOT_I,		// a = ! b
+	OP_NEG_I, OP_NEG_D,	// a = - b
+	OP_INCR_I, OP_INCR_U,	// a = b + 1
+	OP_DECR_I, OP_DECR_U,	// a = b - 1, checking for count underflow
+
+	// Arithmetic coercions, a = b. The _N variant keeps the kind of
+	// operand, but forces a new Val of the target type.
+	OP_I2U, OP_I2D, OP_U2I, OP_U2D, OP_D2I, OP_D2U, OP_COERCE_N,
+
+	OP_JUMP,		// goto b
+	OP_JUMP_IF_FALSE_I,	// if ( ! a ) goto b
+	OP_JUMP_IF_TRUE_I,	// if ( a ) goto b
+	OP_JUMP_IF_ZERO_V,	// if ( a->IsZero() ) goto b
+
+	// Evaluates *e* with the AST interpreter, a = e->Eval().
+	OP_EVAL_V, OP_EVAL_I, OP_EVAL_U, OP_EVAL_D,
+
+	// Executes *s* with the AST interpreter. b and c are the targets of
+	// "break" and "next" if inside of a compiled loop, -1 otherwise.
+	OP_EXEC,
+
+	OP_CHECK_DELAYED,	// return if the frame got delayed
+	OP_RETURN,		// return box(a)
+	OP_RETURN_NONE,		// return nothing with FLOW_RETURN
+	OP_RETURN_FLOW,		// return nothing with flow b
+	OP_END,			// fall off the end of the body
+
+	// Compares a against e->Eval() and warns if they differ.
+	OP_VALIDATE,
+};
+
+/**
+ * A single instruction of compiled script code.
+ */
+struct BytecodeInstr {
+	BytecodeOp op;
+
+	// For instructions that may need to box a native value, the type
+	// of the Val to create; TYPE_VOID for registers that are boxed
+	// already.
+	zeek::TypeTag tag = zeek::TYPE_VOID;
+
+	int a = 0;
+	int b = 0;
+	int c = 0;
+
+	// Where to continue if an operand evaluated by the interpreter
+	// turns out as unset. This mirrors how the AST interpreter skips
+	// the remainder of a statement in that case.
+	int null_target = -1;
+
+	union {
+		const Expr* e;
+		const Stmt* s;
+		ID* id;
+	};
+
+	explicit BytecodeInstr(BytecodeOp arg_op) : op(arg_op), e(nullptr)	{ }
+};
+
+/**
+ * A function body lowered into register-based bytecode. Statements and
+ * expressions on the basic numeric types, local and global variables,
+ * and control flow compile to instructions that the dispatch loop in
+ * Exec() runs directly. Everything else remains with the AST interpreter,
+ * which the bytecode calls into; this therefore always preserves the
+ * semantics of the original body.
+ *
+ * This is selected at startup through --script-exec. In its "validate"
+ * mode, compiled expressions that have no side effects are additionally
+ * evaluated by the AST interpreter and any differences reported.
+ */
+class CompiledStmt final : public Stmt {
+public:
+	/**
+	 * Compiles a function body.
+	 *
+	 * @param body The body's statements.
+	 *
+	 * @param validate Whether to check compiled expressions against the
+	 * AST interpreter at run-time.
+	 *
+	 * @return The compiled body, or null if there's nothing in *body*
+	 * that would benefit from compilation.
+	 */
+	static StmtPtr Compile(const StmtPtr& body, bool validate);
+
+	~CompiledStmt() override;
+
+	ValPtr Exec(Frame* f, stmt_flow_type& flow) const override;
+	bool IsPure() const override;
+
+	void Describe(ODesc* d) const override;
+	TraversalCode Traverse(TraversalCallback* cb) const override;
+
+	/**
+	 * Returns the AST the body was compiled from.
+	 */
+	const StmtPtr& Original() const	{ return original; }
+
+	/**
+	 * Returns the number of bytecode instructions.
+	 */
+	size_t NumInstructions() const	{ return code.size(); }
+
+private:
+	friend class BytecodeCompiler;
+
+	explicit CompiledStmt(StmtPtr arg_original);
+
+	// Reports a mismatch found by OP_VALIDATE.
+	void ValidationFailed(const BytecodeInstr& in, const BytecodeReg& r,
+	                      const ValPtr& v) const;
+
+	StmtPtr original;
+	std::vector<BytecodeInstr> code;
+	std::vector<BytecodeReg> consts;
+	int num_regs = 0;
+};
+
+/**
+ * Compiles the bodies of all global script functions, events, and hooks
+ * into bytecode. Bodies that can't benefit keep using the AST
+ * interpreter.
+ *
+ * @param validate Whether the compiled code checks its results against
+ * the AST interpreter.
+ */
+void compile_script_functions(bool validate);
+
+} // namespace zeek::detail
@@ -50,6 +50,17 @@ CompositeHash::CompositeHash(zeek::TypeListPtr composite_type)
 		singleton_tag = type->GetTypes()[0]->InternalType();
 		size = 0;
 		key = nullptr;
+
+		switch ( type->GetTypes()[0]->Tag() ) {
+		case zeek::TYPE_ADDR:	atomic = AtomicIndex::ADDR; break;
+		case zeek::TYPE_SUBNET:	atomic = AtomicIndex::SUBNET; break;
+		case zeek::TYPE_COUNT:	atomic = AtomicIndex::COUNT; break;
+		case zeek::TYPE_INT:	atomic = AtomicIndex::INT; break;
+		case zeek::TYPE_PORT:	atomic = AtomicIndex::PORT; break;
+		case zeek::TYPE_STRING:	atomic = AtomicIndex::STRING; break;
+		case zeek::TYPE_ENUM:	atomic = AtomicIndex::ENUM; break;
+		default:		break;
+		}
 		}
 
 	else
@@ -388,7 +399,107 @@ std::unique_ptr<HashKey> CompositeHash::MakeHashKey(const zeek::Val& argv, bool
 	return std::make_unique<HashKey>((k == key), (void*) k, kp - k);
 	}
 
-std::unique_ptr<HashKey> CompositeHash::ComputeSingletonHash(const zeek::Val* v, bool type_check) const
+const HashKey* CompositeHash::MakeLookupKey(const zeek::Val& argv, bool type_check,
+                                            LookupHashKey& lk) const
+	{
+	auto v = &argv;
+
+	if ( is_singleton )
+		{
+		auto sv = SingletonVal(v, type_check);
+
+		if ( ! sv )
+			return nullptr;
+
+		// These need to match what ComputeSingletonHash() does.
+		switch ( singleton_tag ) {
+		case zeek::TYPE_INTERNAL_INT:
+		case zeek::TYPE_INTERNAL_UNSIGNED:
+			lk.key.emplace(sv->ForceAsInt());
+			return &*lk.key;
+
+		case zeek::TYPE_INTERNAL_DOUBLE:
+			lk.key.emplace(sv->InternalDouble());
+			return &*lk.key;
+
+		case zeek::TYPE_INTERNAL_STRING:
+			lk.key.emplace(sv->AsString());
+			return &*lk.key;
+
+		case zeek::TYPE_INTERNAL_ADDR:
+			{
+			auto bytes = reinterpret_cast<uint32_t*>(lk.buf);
+			sv->AsAddr().CopyIPv6(bytes);
+			lk.key.emplace(bytes, 4);
+			return &*lk.key;
+			}
+
+		case zeek::TYPE_INTERNAL_SUBNET:
+			{
+			// The layout of IPPrefix::MakeHashKey().
+			const auto& prefix = sv->AsSubNet();
+			auto bytes = reinterpret_cast<uint32_t*>(lk.buf);
+			prefix.Prefix().CopyIPv6(bytes);
+			bytes[4] = prefix.Length();
+			lk.key.emplace(bytes, 5);
+			return &*lk.key;
+			}
+
+		default:
+			lk.heap_key = ComputeSingletonHash(sv, false);
+			return lk.heap_key.get();
+		}
+		}
+
+	if ( is_complex_type && v->GetType()->Tag() != zeek::TYPE_LIST )
+		{
+		lk.heap_key = MakeHashKey(*v, type_check);
+		return lk.heap_key.get();
+		}
+
+	int sz = size;
+
+	if ( ! key )
+		{
+		sz = ComputeKeySize(v, type_check, false);
+
+		if ( sz == 0 )
+			return nullptr;
+
+		type_check = false;	// no need to type-check again.
+		}
+
+	if ( sz > LookupHashKey::STACK_SIZE )
+		{
+		lk.heap_key = MakeHashKey(*v, type_check);
+		return lk.heap_key.get();
+		}
+
+	const auto& tl = type->GetTypes();
+
+	if ( type_check && v->GetType()->Tag() != zeek::TYPE_LIST )
+		return nullptr;
+
+	auto lv = v->AsListVal();
+
+	if ( type_check && lv->Length() != static_cast<int>(tl.size()) )
+		return nullptr;
+
+	char* k = lk.buf;
+	char* kp = k;
+
+	for ( auto i = 0u; i < tl.size(); ++i )
+		{
+		kp = SingleValHash(type_check, kp, tl[i].get(), lv->Idx(i).get(), false);
+		if ( ! kp )
+			return nullptr;
+		}
+
+	lk.key.emplace(k, kp - k, HashKey::HashBytes(k, kp - k), true);
+	return &*lk.key;
+	}
+
+const zeek::Val* CompositeHash::SingletonVal(const zeek::Val* v, bool type_check) const
 	{
 	if ( v->GetType()->Tag() == zeek::TYPE_LIST )
 		{
@@ -403,6 +514,16 @@ std::unique_ptr<HashKey> CompositeHash::ComputeSingletonHash(const zeek::Val* v,
 	if ( type_check && v->GetType()->InternalType() != singleton_tag )
 		return nullptr;
 
+	return v;
+	}
+
+std::unique_ptr<HashKey> CompositeHash::ComputeSingletonHash(const zeek::Val* v, bool type_check) const
+	{
+	v = SingletonVal(v, type_check);
+
+	if ( ! v )
+		return nullptr;
+
 	switch ( singleton_tag ) {
 	case zeek::TYPE_INTERNAL_INT:
 	case zeek::TYPE_INTERNAL_UNSIGNED:
@@ -712,6 +833,13 @@ int CompositeHash::SizeAlign(int offset, unsigned int size) const
 zeek::ListValPtr CompositeHash::RecoverVals(const HashKey& k) const
 	{
 	auto l = zeek::make_intrusive<zeek::ListVal>(zeek::TYPE_ANY);
+
+	if ( atomic != AtomicIndex::NONE )
+		{
+		l->Append(RecoverAtomicVal(k.Key(), k.Size()));
+		return l;
+		}
+
 	const auto& tl = type->GetTypes();
 	const char* kp = (const char*) k.Key();
 	const char* const k_end = kp + k.Size();
@@ -730,6 +858,43 @@ zeek::ListValPtr CompositeHash::RecoverVals(const HashKey& k) const
 	return l;
 	}
 
+zeek::ValPtr CompositeHash::RecoverAtomicVal(const void* key, int size) const
+	{
+	// These need to match what ComputeSingletonHash() does.
+	switch ( atomic ) {
+	case AtomicIndex::ADDR:
+		return zeek::make_intrusive<zeek::AddrVal>(
+			IPAddr(IPv6, static_cast<const uint32_t*>(key), IPAddr::Network));
+
+	case AtomicIndex::SUBNET:
+		{
+		auto kp = static_cast<const uint32_t*>(key);
+		return zeek::make_intrusive<zeek::SubNetVal>(kp, kp[4]);
+		}
+
+	case AtomicIndex::COUNT:
+		return zeek::val_mgr->Count(*static_cast<const bro_uint_t*>(key));
+
+	case AtomicIndex::INT:
+		return zeek::val_mgr->Int(*static_cast<const bro_int_t*>(key));
+
+	case AtomicIndex::PORT:
+		return zeek::val_mgr->Port(*static_cast<const bro_uint_t*>(key));
+
+	case AtomicIndex::STRING:
+		return zeek::make_intrusive<zeek::StringVal>(
+			new zeek::String((const zeek::byte_vec) key, size, true));
+
+	case AtomicIndex::ENUM:
+		return type->GetTypes()[0]->AsEnumType()->GetEnumVal(
+			*static_cast<const bro_int_t*>(key));
+
+	default:
+		reporter->InternalError("bad index type in CompositeHash::RecoverAtomicVal");
+		return nullptr;
+	}
+	}
+
 const char* CompositeHash::RecoverOneVal(
 	const HashKey& k, const char* kp0,
 	const char* const k_end, zeek::Type* t,
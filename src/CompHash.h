@@ -3,19 +3,46 @@
 #pragma once
 
 #include <memory>
+#include <optional>
 
 #include "Type.h"
 #include "IntrusivePtr.h"
+#include "Hash.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(ListVal, zeek);
-class HashKey;
 
 namespace zeek {
 using ListValPtr = zeek::IntrusivePtr<ListVal>;
 }
 
+/**
+ * Storage for a hash key that's needed only briefly, such as for a table
+ * lookup. CompositeHash::MakeLookupKey() builds keys of atomic singleton
+ * indices, and compound keys of up to STACK_SIZE bytes, in here without
+ * allocating any memory.
+ */
+class LookupHashKey {
+public:
+	static constexpr int STACK_SIZE = 64;
+
+	LookupHashKey() = default;
+	LookupHashKey(const LookupHashKey&) = delete;
+	LookupHashKey& operator=(const LookupHashKey&) = delete;
+
+private:
+	friend class CompositeHash;
+
+	std::optional<HashKey> key;
+	std::unique_ptr<HashKey> heap_key;	// for keys that don't fit
+	alignas(double) char buf[STACK_SIZE];
+};
+
 class CompositeHash {
 public:
+	// The atomic types that a singleton index can have for its keys to
+	// get recovered directly, without going through RecoverOneVal().
+	enum class AtomicIndex { NONE, ADDR, SUBNET, COUNT, INT, PORT, STRING, ENUM };
+
 	explicit CompositeHash(zeek::TypeListPtr composite_type);
 	~CompositeHash();
 
@@ -27,6 +54,13 @@ public:
 	HashKey* ComputeHash(const zeek::Val* v, bool type_check) const
 		{ return MakeHashKey(*v, type_check).release(); }
 
+	// Like MakeHashKey(), but builds the key in *lk* if possible rather
+	// than on the heap. The returned key remains valid as long as both
+	// *lk* and *v* do, and must not be stored. Returns nullptr if *v*
+	// fails to typecheck.
+	const HashKey* MakeLookupKey(const zeek::Val& v, bool type_check,
+	                             LookupHashKey& lk) const;
+
 	// Given a hash key, recover the values used to create it.
 	zeek::ListValPtr RecoverVals(const HashKey& k) const;
 
@@ -34,11 +68,24 @@ public:
 	zeek::ListValPtr RecoverVals(const HashKey* k) const
 		{ return RecoverVals(*k); }
 
+	// Returns the atomic type of a singleton index, or NONE if the
+	// index isn't one.
+	AtomicIndex Atomic() const	{ return atomic; }
+
+	// For an atomic singleton index, recovers the value that a key
+	// was made from, given the key's bytes. Unlike RecoverVals(), this
+	// doesn't wrap the value into a list.
+	zeek::ValPtr RecoverAtomicVal(const void* key, int size) const;
+
 	unsigned int MemoryAllocation() const { return padded_sizeof(*this) + pad_size(size); }
 
 protected:
 	std::unique_ptr<HashKey> ComputeSingletonHash(const zeek::Val* v, bool type_check) const;
 
+	// Returns the value that a singleton index consists of, or nullptr
+	// if *v* fails to typecheck.
+	const zeek::Val* SingletonVal(const zeek::Val* v, bool type_check) const;
+
 	// Computes the piece of the hash for Val*, returning the new kp.
 	// Used as a helper for ComputeHash in the non-singleton case.
 	char* SingleValHash(bool type_check, char* kp, zeek::Type* bt, zeek::Val* v,
@@ -102,4 +149,5 @@ protected:
 	bool is_complex_type;
 
 	zeek::InternalTypeTag singleton_tag;
+	AtomicIndex atomic = AtomicIndex::NONE;
 };
@@ -6,14 +6,18 @@
 
 #include <ctype.h>
 
+#include "ConnMemory.h"
 #include "Desc.h"
 #include "Net.h"
 #include "NetVar.h"
 #include "Event.h"
 #include "Sessions.h"
+#include "Stats.h"
 #include "Reporter.h"
 #include "Timer.h"
 #include "iosource/IOSource.h"
+#include "iosource/Manager.h"
+#include "iosource/PktSrc.h"
 #include "analyzer/protocol/pia/PIA.h"
 #include "binpac.h"
 #include "TunnelEncapsulation.h"
@@ -94,7 +98,9 @@ Connection::Connection(NetSessions* s, const ConnIDKey& k, double t, const ConnI
 
 	is_active = 1;
 	skip = 0;
+	bypass = 0;
 	weird = 0;
+	num_bytes = 0;
 
 	suppress_event = 0;
 
@@ -103,6 +109,8 @@ Connection::Connection(NetSessions* s, const ConnIDKey& k, double t, const ConnI
 
 	timers_canceled = 0;
 	inactivity_timeout = 0;
+	inactivity_prev = inactivity_next = nullptr;
+	inactivity_slice = -1;
 	installed_status_timer = 0;
 
 	finished = 0;
@@ -112,6 +120,7 @@ Connection::Connection(NetSessions* s, const ConnIDKey& k, double t, const ConnI
 
 	root_analyzer = nullptr;
 	primary_PIA = nullptr;
+	memory_account = conn_memory_limiter ? new ConnMemoryAccount(this) : nullptr;
 
 	++current_connections;
 	++total_connections;
@@ -127,6 +136,10 @@ Connection::~Connection()
 	if ( ! finished )
 		reporter->InternalError("Done() not called before destruction of Connection");
 
+	// Covers data delivered after Done().
+	if ( analyzer_profiler )
+		analyzer_profiler->ConnectionDone(this);
+
 	CancelTimers();
 
 	if ( conn_val )
@@ -135,6 +148,13 @@ Connection::~Connection()
 	delete root_analyzer;
 	delete encapsulation;
 
+	// Files may still hold on to the account.
+	if ( memory_account )
+		{
+		memory_account->Detach();
+		Unref(memory_account);
+		}
+
 	--current_connections;
 	}
 
@@ -180,6 +200,9 @@ void Connection::Done()
 
 	if ( root_analyzer && ! root_analyzer->IsFinished() )
 		root_analyzer->Done();
+
+	if ( analyzer_profiler )
+		analyzer_profiler->ConnectionDone(this);
 	}
 
 void Connection::NextPacket(double t, bool is_orig,
@@ -191,6 +214,7 @@ void Connection::NextPacket(double t, bool is_orig,
 	{
 	current_timestamp = t;
 	current_pkt = pkt;
+	num_bytes += len;
 
 	if ( Skipping() )
 		return;
@@ -217,6 +241,48 @@ void Connection::NextPacket(double t, bool is_orig,
 	current_pkt = nullptr;
 	}
 
+void Connection::Bypass(double shunt_timeout)
+	{
+	if ( bypass )
+		return;
+
+	bypass = 1;
+
+	// Capture only sees the outer headers of tunneled connections.
+	if ( encapsulation && encapsulation->Depth() > 0 )
+		return;
+
+	iosource::PktSrc* ps = iosource_mgr->GetPktSrc();
+
+	if ( ! ps || ! ps->IsLive() )
+		return;
+
+	uint8_t proto;
+
+	switch ( ConnTransport() ) {
+	case TRANSPORT_TCP:
+		proto = IPPROTO_TCP;
+		break;
+
+	case TRANSPORT_UDP:
+		proto = IPPROTO_UDP;
+		break;
+
+	default:
+		return;
+	}
+
+	ConnID id;
+	id.src_addr = orig_addr;
+	id.dst_addr = resp_addr;
+	id.src_port = orig_port;
+	id.dst_port = resp_port;
+	id.is_one_way = false;
+
+	if ( ps->ShuntFlow(id, proto, shunt_timeout) )
+		DBG_LOG(DBG_PKTIO, "shunted connection %s", uid.Base62("C").c_str());
+	}
+
 void Connection::SetLifetime(double lifetime)
 	{
 	ADD_TIMER(&Connection::DeleteTimer, network_time + lifetime, 0,
@@ -288,8 +354,24 @@ void Connection::InactivityTimer(double t)
 		++killed_by_inactivity;
 		}
 	else
-		ADD_TIMER(&Connection::InactivityTimer,
-		          last_time + inactivity_timeout, 0, TIMER_CONN_INACTIVITY);
+		ScheduleInactivityCheck(last_time + inactivity_timeout);
+	}
+
+void Connection::ScheduleInactivityCheck(double t)
+	{
+	auto scanner = sessions->GetInactivityScanner();
+
+	if ( ! scanner->Enabled() )
+		{
+		ADD_TIMER(&Connection::InactivityTimer, t, 0, TIMER_CONN_INACTIVITY);
+		return;
+		}
+
+	// Same conditions as for adding timers.
+	if ( timers_canceled || ! key_valid )
+		return;
+
+	scanner->Add(this, t);
 	}
 
 void Connection::RemoveConnectionTimer(double t)
@@ -311,9 +393,11 @@ void Connection::SetInactivityTimeout(double timeout)
 			break;
 			}
 
+	if ( inactivity_slice >= 0 )
+		sessions->GetInactivityScanner()->Remove(this);
+
 	if ( timeout )
-		ADD_TIMER(&Connection::InactivityTimer,
-				last_time + timeout, 0, TIMER_CONN_INACTIVITY);
+		ScheduleInactivityCheck(last_time + timeout);
 
 	inactivity_timeout = timeout;
 	}
@@ -350,16 +434,19 @@ const zeek::RecordValPtr& Connection::ConnVal()
 
 		TransportProto prot_type = ConnTransport();
 
-		auto id_val = zeek::make_intrusive<zeek::RecordVal>(zeek::id::conn_id);
-		id_val->Assign(0, zeek::make_intrusive<zeek::AddrVal>(orig_addr));
-		id_val->Assign(1, zeek::val_mgr->Port(ntohs(orig_port), prot_type));
-		id_val->Assign(2, zeek::make_intrusive<zeek::AddrVal>(resp_addr));
-		id_val->Assign(3, zeek::val_mgr->Port(ntohs(resp_port), prot_type));
+		// The record comes with empty conn_id and endpoint records as
+		// well as the empty service set, so we fill those in rather
+		// than allocating new ones.
+		auto id_val = conn_val->GetField(0)->AsRecordVal();
+		id_val->AssignAddr(0, orig_addr);
+		id_val->AssignPort(1, ntohs(orig_port), prot_type);
+		id_val->AssignAddr(2, resp_addr);
+		id_val->AssignPort(3, ntohs(resp_port), prot_type);
 
-		auto orig_endp = zeek::make_intrusive<zeek::RecordVal>(zeek::id::endpoint);
-		orig_endp->Assign(0, zeek::val_mgr->Count(0));
-		orig_endp->Assign(1, zeek::val_mgr->Count(0));
-		orig_endp->Assign(4, zeek::val_mgr->Count(orig_flow_label));
+		auto orig_endp = conn_val->GetField(1)->AsRecordVal();
+		orig_endp->AssignCount(0, 0);
+		orig_endp->AssignCount(1, 0);
+		orig_endp->AssignCount(4, orig_flow_label);
 
 		const int l2_len = sizeof(orig_l2_addr);
 		char null[l2_len]{};
@@ -367,19 +454,15 @@ const zeek::RecordValPtr& Connection::ConnVal()
 		if ( memcmp(&orig_l2_addr, &null, l2_len) != 0 )
 			orig_endp->Assign(5, zeek::make_intrusive<zeek::StringVal>(fmt_mac(orig_l2_addr, l2_len)));
 
-		auto resp_endp = zeek::make_intrusive<zeek::RecordVal>(zeek::id::endpoint);
-		resp_endp->Assign(0, zeek::val_mgr->Count(0));
-		resp_endp->Assign(1, zeek::val_mgr->Count(0));
-		resp_endp->Assign(4, zeek::val_mgr->Count(resp_flow_label));
+		auto resp_endp = conn_val->GetField(2)->AsRecordVal();
+		resp_endp->AssignCount(0, 0);
+		resp_endp->AssignCount(1, 0);
+		resp_endp->AssignCount(4, resp_flow_label);
 
 		if ( memcmp(&resp_l2_addr, &null, l2_len) != 0 )
 			resp_endp->Assign(5, zeek::make_intrusive<zeek::StringVal>(fmt_mac(resp_l2_addr, l2_len)));
 
-		conn_val->Assign(0, std::move(id_val));
-		conn_val->Assign(1, std::move(orig_endp));
-		conn_val->Assign(2, std::move(resp_endp));
 		// 3 and 4 are set below.
-		conn_val->Assign(5, zeek::make_intrusive<zeek::TableVal>(zeek::id::string_set));	// service
 		conn_val->Assign(6, zeek::val_mgr->EmptyString());	// history
 
 		if ( ! uid )
@@ -391,20 +474,28 @@ const zeek::RecordValPtr& Connection::ConnVal()
 			conn_val->Assign(8, encapsulation->ToVal());
 
 		if ( vlan != 0 )
-			conn_val->Assign(9, zeek::val_mgr->Int(vlan));
+			conn_val->AssignInt(9, vlan);
 
 		if ( inner_vlan != 0 )
-			conn_val->Assign(10, zeek::val_mgr->Int(inner_vlan));
+			conn_val->AssignInt(10, inner_vlan);
 
 		}
 
 	if ( root_analyzer )
 		root_analyzer->UpdateConnVal(conn_val.get());
 
-	conn_val->Assign(3, zeek::make_intrusive<zeek::TimeVal>(start_time));	// ###
-	conn_val->Assign(4, zeek::make_intrusive<zeek::IntervalVal>(last_time - start_time));
-	conn_val->Assign(6, zeek::make_intrusive<zeek::StringVal>(history.c_str()));
-	conn_val->Assign(11, zeek::val_mgr->Bool(is_successful));
+	conn_val->AssignDouble(3, start_time);	// ###
+	conn_val->AssignDouble(4, last_time - start_time);
+
+	// The history changes far less often than this gets called, so only
+	// allocate a new value when it differs.
+	const auto& hist_val = conn_val->GetField(6);
+
+	if ( ! hist_val || hist_val->AsString()->Len() != static_cast<int>(history.size()) ||
+	     memcmp(hist_val->AsString()->Bytes(), history.data(), history.size()) != 0 )
+		conn_val->Assign(6, zeek::val_mgr->InternedString(history.size(), history.data()));
+
+	conn_val->AssignBool(11, is_successful);
 
 	conn_val->SetOrigin(this);
 
@@ -571,6 +662,9 @@ void Connection::CancelTimers()
 	for ( const auto& timer : tmp )
 		timer_mgr->Cancel(timer);
 
+	if ( inactivity_slice >= 0 )
+		sessions->GetInactivityScanner()->Remove(this);
+
 	timers_canceled = 1;
 	timers.clear();
 	}
@@ -615,6 +709,7 @@ unsigned int Connection::MemoryAllocation() const
 		+ (timers.MemoryAllocation() - padded_sizeof(timers))
 		+ (conn_val ? conn_val->MemoryAllocation() : 0)
 		+ (root_analyzer ? root_analyzer->MemoryAllocation(): 0)
+		+ (weird_state ? padded_sizeof(*weird_state) : 0)
 		// login_conn is just a casted 'this'.
 		// primary_PIA is already contained in the analyzer tree.
 		;
@@ -698,7 +793,7 @@ void Connection::CheckFlowLabel(bool is_orig, uint32_t flow_label)
 		if ( conn_val )
 			{
 			zeek::RecordVal* endp = conn_val->GetField(is_orig ? 1 : 2)->AsRecordVal();
-			endp->Assign(4, zeek::val_mgr->Count(flow_label));
+			endp->AssignCount(4, flow_label);
 			}
 
 		if ( connection_flow_label_changed &&
@@ -721,8 +816,11 @@ void Connection::CheckFlowLabel(bool is_orig, uint32_t flow_label)
 		saw_first_resp_packet = 1;
 	}
 
-bool Connection::PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
+bool Connection::PermitWeird(WeirdID id, uint64_t threshold, uint64_t rate,
                              double duration)
 	{
-	return ::PermitWeird(weird_state, name, threshold, rate, duration);
+	if ( ! weird_state )
+		weird_state = std::make_unique<WeirdStateMap>();
+
+	return ::PermitWeird(*weird_state, id, threshold, rate, duration);
 	}
@@ -4,6 +4,7 @@
 
 #include <sys/types.h>
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <type_traits>
@@ -16,6 +17,7 @@
 #include "WeirdState.h"
 #include "ZeekArgs.h"
 #include "IntrusivePtr.h"
+#include "MemoryArena.h"
 #include "iosource/Packet.h"
 
 #include "analyzer/Tag.h"
@@ -29,6 +31,7 @@ class RuleHdrTest;
 class Specific_RE_Matcher;
 class RuleEndpointState;
 class EncapsulationStack;
+class ConnMemoryAccount;
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Val, zeek);
 
@@ -70,6 +73,12 @@ public:
 	           uint32_t flow, const Packet* pkt, const EncapsulationStack* arg_encap);
 	~Connection() override;
 
+	static void* operator new(size_t size)
+		{ return zeek::detail::arena_alloc(zeek::detail::MemoryArena::Connection, size); }
+
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::arena_free(zeek::detail::MemoryArena::Connection, ptr, size); }
+
 	// Invoked when an encapsulation is discovered. It records the
 	// encapsulation with the connection and raises a "tunnel_changed"
 	// event if it's different from the previous encapsulation (or the
@@ -153,6 +162,17 @@ public:
 	void SetSkip(bool do_skip)		{ skip = do_skip ? 1 : 0; }
 	bool Skipping() const			{ return skip; }
 
+	// Stops analyzing the connection's payload while still tracking
+	// its state and sizes. TCP connections drop their analyzers above
+	// the transport layer and stop reassembling. If the packet source
+	// supports it, it gets asked to stop capturing the connection,
+	// with shunt_timeout as the inactivity timeout of its rule.
+	void Bypass(double shunt_timeout = 0.0);
+	bool Bypassing() const			{ return bypass; }
+
+	// Returns the number of IP bytes seen in both directions.
+	uint64_t NumBytes() const		{ return num_bytes; }
+
 	// Arrange for the connection to expire after the given amount of time.
 	void SetLifetime(double lifetime);
 
@@ -271,6 +291,11 @@ public:
 	unsigned int MemoryAllocation() const;
 	unsigned int MemoryAllocationConnVal() const;
 
+	// Returns the running totals of the memory buffering the
+	// connection's data, or nullptr if they're not kept (see
+	// ConnMemory.h).
+	ConnMemoryAccount* MemoryAccount() const	{ return memory_account; }
+
 	static uint64_t TotalConnections()
 		{ return total_connections; }
 	static uint64_t CurrentConnections()
@@ -324,7 +349,7 @@ public:
 	uint32_t GetOrigFlowLabel() { return orig_flow_label; }
 	uint32_t GetRespFlowLabel() { return resp_flow_label; }
 
-	bool PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
+	bool PermitWeird(WeirdID id, uint64_t threshold, uint64_t rate,
 	                 double duration);
 
 protected:
@@ -339,6 +364,11 @@ protected:
 
 	// Allow other classes to access pointers to these:
 	friend class ConnectionTimer;
+	friend class InactivityScanner;
+
+	// Checks the connection's inactivity at time t, or up to one
+	// slice later with batched checks.
+	void ScheduleInactivityCheck(double t);
 
 	void InactivityTimer(double t);
 	void StatusUpdateTimer(double t);
@@ -360,6 +390,13 @@ protected:
 	u_char resp_l2_addr[Packet::l2_addr_len];	// Link-layer responder address, if available
 	double start_time, last_time;
 	double inactivity_timeout;
+	uint64_t num_bytes;
+
+	// The InactivityScanner list holding the connection, if any.
+	Connection* inactivity_prev;
+	Connection* inactivity_next;
+	int64_t inactivity_slice;	// -1 if not in a list
+
 	zeek::RecordValPtr conn_val;
 	LoginConn* login_conn;	// either nil, or this
 	const EncapsulationStack* encapsulation; // tunnels
@@ -369,6 +406,7 @@ protected:
 	unsigned int timers_canceled:1;
 	unsigned int is_active:1;
 	unsigned int skip:1;
+	unsigned int bypass:1;
 	unsigned int weird:1;
 	unsigned int finished:1;
 	unsigned int record_packets:1, record_contents:1;
@@ -385,9 +423,13 @@ protected:
 
 	analyzer::TransportLayerAnalyzer* root_analyzer;
 	analyzer::pia::PIA* primary_PIA;
+	ConnMemoryAccount* memory_account;
 
 	Bro::UID uid;	// Globally unique connection ID.
-	WeirdStateMap weird_state;
+
+	// Allocated on the first rate-limited weird, which most connections
+	// never see.
+	std::unique_ptr<WeirdStateMap> weird_state;
 };
 
 class ConnectionTimer final : public Timer {
@@ -0,0 +1,143 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "ConnMemory.h"
+
+#include <inttypes.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Conn.h"
+#include "ID.h"
+#include "Reporter.h"
+#include "Val.h"
+#include "util.h"
+
+std::list<ConnMemoryAccount*> ConnMemoryAccount::accounts;
+int64_t ConnMemoryAccount::global_total = 0;
+
+ConnMemoryAccount::ConnMemoryAccount(Connection* arg_conn)
+	: conn(arg_conn)
+	{
+	pos = accounts.insert(accounts.end(), this);
+	}
+
+ConnMemoryAccount::~ConnMemoryAccount()
+	{
+	Detach();
+
+	// Anything left was never released through Adjust().
+	global_total -= total;
+	}
+
+void ConnMemoryAccount::Detach()
+	{
+	if ( ! conn )
+		return;
+
+	accounts.erase(pos);
+	conn = nullptr;
+	}
+
+const char* ConnMemoryAccount::KindName(ConnMemoryKind kind)
+	{
+	switch ( kind ) {
+	case CONN_MEM_REASSEMBLY:	return "reassembly";
+	case CONN_MEM_PIA:		return "pia";
+	case CONN_MEM_ANALYZER:		return "analyzers";
+	case CONN_MEM_FILES:		return "files";
+	case CONN_MEM_NUM_KINDS:	break;
+	}
+
+	return "<unknown>";
+	}
+
+ConnMemoryLimiter* ConnMemoryLimiter::Create()
+	{
+	auto per_conn_limit = zeek::id::find_val("conn_memory_limit")->AsCount();
+	auto global_limit = zeek::id::find_val("conn_memory_global_limit")->AsCount();
+
+	if ( ! per_conn_limit && ! global_limit )
+		return nullptr;
+
+	auto l = new ConnMemoryLimiter();
+	l->per_conn_limit = per_conn_limit;
+	l->global_limit = global_limit;
+	return l;
+	}
+
+void ConnMemoryLimiter::Check(Connection* c)
+	{
+	auto a = c->MemoryAccount();
+
+	if ( per_conn_limit && a && a->Bytes() > per_conn_limit && ! c->Bypassing() )
+		Shed(c, "per-connection");
+
+	if ( ! global_limit )
+		return;
+
+	int64_t total = ConnMemoryAccount::GlobalBytes();
+
+	if ( total < checked_bytes )
+		checked_bytes = total;
+
+	if ( total > global_limit && total > checked_bytes )
+		ShedLargest();
+	}
+
+void ConnMemoryLimiter::ShedLargest()
+	{
+	int64_t remaining = ConnMemoryAccount::GlobalBytes();
+	std::vector<ConnMemoryAccount*> candidates;
+
+	for ( auto a : ConnMemoryAccount::accounts )
+		{
+		if ( a->conn->Bypassing() )
+			remaining -= a->total;
+		else if ( a->total > 0 )
+			candidates.push_back(a);
+		}
+
+	std::sort(candidates.begin(), candidates.end(),
+	          [](const ConnMemoryAccount* a, const ConnMemoryAccount* b)
+	          { return a->total > b->total; });
+
+	for ( auto a : candidates )
+		{
+		if ( remaining <= global_limit )
+			break;
+
+		remaining -= a->total;
+		Shed(a->conn, "global");
+		}
+
+	checked_bytes = ConnMemoryAccount::GlobalBytes();
+	}
+
+void ConnMemoryLimiter::Shed(Connection* c, const char* limit)
+	{
+	auto a = c->MemoryAccount();
+	++num_shed;
+
+	std::string kinds;
+
+	for ( int i = 0; i < CONN_MEM_NUM_KINDS; ++i )
+		{
+		auto kind = static_cast<ConnMemoryKind>(i);
+
+		if ( ! kinds.empty() )
+			kinds += ", ";
+
+		kinds += fmt("%s %" PRId64, ConnMemoryAccount::KindName(kind), a->Bytes(kind));
+		}
+
+	c->Weird("conn_memory_limit_exceeded",
+	         fmt("%s limit, %" PRId64 " bytes", limit, a->Bytes()));
+
+	reporter->Info("conn memory: bypassing %s over the %s limit with %" PRId64 " bytes (%s)",
+	               c->GetUID().Base62("C").c_str(), limit, a->Bytes(), kinds.c_str());
+
+	c->Bypass();
+	}
@@ -0,0 +1,114 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <list>
+
+#include "Obj.h"
+
+class Connection;
+
+// What the memory of a connection goes to.
+enum ConnMemoryKind {
+	CONN_MEM_REASSEMBLY,	// TCP stream reassembly
+	CONN_MEM_PIA,		// protocol detection buffers
+	CONN_MEM_ANALYZER,	// analyzers' line buffers
+	CONN_MEM_FILES,		// buffers of the files it transferred
+	CONN_MEM_NUM_KINDS,
+};
+
+// Keeps running totals of the memory that buffers a connection's data,
+// which the components doing the buffering adjust as they go. That
+// makes them available at any time without walking the analyzer tree
+// like Connection::MemoryAllocation() does. Connections only have an
+// account while a ConnMemoryLimiter is in place.
+//
+// Files can outlive the connection their data came from, so they keep a
+// reference to its account. Once the connection is gone, the account
+// still tracks what the files release.
+class ConnMemoryAccount final : public zeek::Obj {
+public:
+	explicit ConnMemoryAccount(Connection* conn);
+	~ConnMemoryAccount() override;
+
+	void Adjust(ConnMemoryKind kind, int64_t delta)
+		{
+		bytes[kind] += delta;
+		total += delta;
+		global_total += delta;
+		}
+
+	int64_t Bytes() const	{ return total; }
+	int64_t Bytes(ConnMemoryKind kind) const	{ return bytes[kind]; }
+
+	// Returns the connection, or nullptr once it's gone.
+	Connection* Conn() const	{ return conn; }
+
+	// Called by the connection when it goes away.
+	void Detach();
+
+	// Returns the bytes in all accounts together.
+	static int64_t GlobalBytes()	{ return global_total; }
+
+	static const char* KindName(ConnMemoryKind kind);
+
+private:
+	friend class ConnMemoryLimiter;
+
+	Connection* conn;
+	int64_t total = 0;
+	int64_t bytes[CONN_MEM_NUM_KINDS] = {};
+
+	std::list<ConnMemoryAccount*>::iterator pos;
+
+	// Accounts of the connections still around.
+	static std::list<ConnMemoryAccount*> accounts;
+	static int64_t global_total;
+};
+
+// Stops the analysis of connections whose buffers take up too much
+// memory, so that a few pathological ones can't take down a worker. A
+// connection over conn_memory_limit gets bypassed, as by
+// bypass_connection(). With all connections together over
+// conn_memory_global_limit, the largest ones get bypassed until the
+// others fit. Either way, the connection gets a
+// conn_memory_limit_exceeded weird and a line in reporter.log.
+//
+// Bypassing a TCP connection frees its buffers with its next packet, so
+// connections already bypassed don't count towards the global limit.
+// Others have little beyond their protocol detection buffer, which
+// dpd_buffer_size bounds already.
+class ConnMemoryLimiter {
+public:
+	// Returns a limiter configured through the conn_memory_* script
+	// constants, or nullptr if they don't set any limit.
+	static ConnMemoryLimiter* Create();
+
+	// Checks the limits after a packet of the given connection.
+	void Check(Connection* c);
+
+	// Returns the number of connections bypassed so far.
+	uint64_t NumShed() const	{ return num_shed; }
+
+private:
+	ConnMemoryLimiter() = default;
+
+	void Shed(Connection* c, const char* limit);
+	void ShedLargest();
+
+	int64_t per_conn_limit = 0;
+	int64_t global_limit = 0;
+
+	// The total when the largest connections last got looked at,
+	// lowered as memory gets released. Only growth beyond it calls for
+	// another look, so that what the limiter can't do anything about,
+	// such as buffers of files whose connections are gone, doesn't get
+	// the connections scanned for each packet.
+	int64_t checked_bytes = 0;
+
+	uint64_t num_shed = 0;
+};
+
+extern ConnMemoryLimiter* conn_memory_limiter;
@@ -0,0 +1,336 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "ConstFold.h"
+
+#include <stdio.h>
+
+#include "DebugLogger.h"
+#include "Expr.h"
+#include "Func.h"
+#include "ID.h"
+#include "Reporter.h"
+#include "Scope.h"
+#include "Stmt.h"
+#include "Val.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// Values of these types can't be modified in place, so a constant of
+// one of them always has the same value.
+bool is_immutable_type(const zeek::Type* t)
+	{
+	switch ( t->Tag() ) {
+	case zeek::TYPE_BOOL:
+	case zeek::TYPE_INT:
+	case zeek::TYPE_COUNT:
+	case zeek::TYPE_COUNTER:
+	case zeek::TYPE_DOUBLE:
+	case zeek::TYPE_TIME:
+	case zeek::TYPE_INTERVAL:
+	case zeek::TYPE_STRING:
+	case zeek::TYPE_PORT:
+	case zeek::TYPE_ADDR:
+	case zeek::TYPE_SUBNET:
+	case zeek::TYPE_ENUM:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
+// Evaluates e, which must be free of side effects.
+ValPtr eval_static(const Expr* e)
+	{
+	try
+		{
+		return e->Eval(nullptr);
+		}
+	catch ( InterpreterException& )
+		{
+		return nullptr;
+		}
+	}
+
+// Returns the value that e always evaluates to, or null if that's not
+// known before running it. This accepts only operators that can't fail
+// at run-time, so that folding doesn't move any errors to startup.
+ValPtr static_value(const Expr* e)
+	{
+	if ( ! is_immutable_type(e->GetType().get()) )
+		return nullptr;
+
+	switch ( e->Tag() ) {
+	case EXPR_CONST:
+		return {zeek::NewRef{}, e->ExprVal()};
+
+	case EXPR_NAME:
+		{
+		auto id = static_cast<const NameExpr*>(e)->Id();
+
+		// Once parsing is done, only &redef lets anything change
+		// a constant.
+		if ( ! id->IsGlobal() || ! id->IsConst() || id->IsOption() ||
+		     id->IsRedefinable() || ! id->HasVal() )
+			return nullptr;
+
+		return id->GetVal();
+		}
+
+	case EXPR_NOT:
+	case EXPR_NEGATE:
+	case EXPR_POSITIVE:
+	case EXPR_ARITH_COERCE:
+		{
+		auto op = static_cast<const UnaryExpr*>(e)->Op();
+
+		if ( ! static_value(op) )
+			return nullptr;
+
+		return eval_static(e);
+		}
+
+	case EXPR_AND_AND:
+	case EXPR_OR_OR:
+		{
+		auto be = static_cast<const BinaryExpr*>(e);
+		bool is_and = e->Tag() == EXPR_AND_AND;
+		auto v1 = static_value(be->Op1());
+
+		if ( ! v1 )
+			return nullptr;
+
+		// A short-circuit result doesn't depend on the second
+		// operand, as it never gets evaluated then.
+		if ( v1->IsZero() == is_and )
+			return zeek::val_mgr->Bool(! is_and);
+
+		auto v2 = static_value(be->Op2());
+
+		if ( ! v2 )
+			return nullptr;
+
+		return zeek::val_mgr->Bool(! v2->IsZero());
+		}
+
+	case EXPR_ADD:
+	case EXPR_TIMES:
+	case EXPR_EQ:
+	case EXPR_NE:
+	case EXPR_LT:
+	case EXPR_LE:
+	case EXPR_GT:
+	case EXPR_GE:
+		{
+		auto be = static_cast<const BinaryExpr*>(e);
+
+		if ( ! static_value(be->Op1()) || ! static_value(be->Op2()) )
+			return nullptr;
+
+		return eval_static(e);
+		}
+
+	case EXPR_COND:
+		{
+		auto ce = static_cast<const CondExpr*>(e);
+		auto c = static_value(ce->Op1());
+
+		if ( ! c )
+			return nullptr;
+
+		return static_value(c->IsZero() ? ce->Op3() : ce->Op2());
+		}
+
+	default:
+		return nullptr;
+	}
+	}
+
+class ConstantFolder {
+public:
+	explicit ConstantFolder(bool arg_report) : report(arg_report)	{ }
+
+	// Folds everything nested inside of s.
+	void FoldIn(Stmt* s);
+
+	// Returns what s itself folds into, or null if it stays as it is.
+	// Returns a NullStmt if s can go away entirely.
+	StmtPtr Replacement(Stmt* s);
+
+	int NumFolded() const	{ return num_folded; }
+
+private:
+	// Records a change, with the location of the condition that led
+	// to it.
+	void Report(const Expr* cond, const char* what);
+
+	bool report;
+	int num_folded = 0;
+};
+
+void ConstantFolder::FoldIn(Stmt* s)
+	{
+	switch ( s->Tag() ) {
+	case STMT_LIST:
+	case STMT_EVENT_BODY_LIST:
+		{
+		auto& stmts = static_cast<StmtList*>(s)->Stmts();
+
+		for ( int i = 0; i < stmts.length(); ++i )
+			{
+			Stmt* child = stmts[i];
+			FoldIn(child);
+
+			auto repl = Replacement(child);
+
+			if ( ! repl )
+				continue;
+
+			if ( repl->Tag() == STMT_NULL )
+				stmts.remove_nth(i--);
+			else
+				stmts.replace(i, repl.release());
+
+			Unref(child);
+			}
+		}
+		break;
+
+	case STMT_IF:
+		{
+		auto is = static_cast<IfStmt*>(s);
+		auto s1 = const_cast<Stmt*>(is->TrueBranch());
+		auto s2 = const_cast<Stmt*>(is->FalseBranch());
+
+		FoldIn(s1);
+		FoldIn(s2);
+
+		if ( auto repl = Replacement(s1) )
+			is->SetTrueBranch(std::move(repl));
+
+		if ( auto repl = Replacement(s2) )
+			is->SetFalseBranch(std::move(repl));
+		}
+		break;
+
+	case STMT_WHILE:
+		{
+		auto ws = static_cast<WhileStmt*>(s);
+		auto body = const_cast<Stmt*>(ws->Body());
+
+		FoldIn(body);
+
+		if ( auto repl = Replacement(body) )
+			ws->SetBody(std::move(repl));
+		}
+		break;
+
+	case STMT_FOR:
+		{
+		auto fs = static_cast<ForStmt*>(s);
+		auto body = const_cast<Stmt*>(fs->LoopBody());
+
+		FoldIn(body);
+
+		if ( auto repl = Replacement(body) )
+			fs->AddBody(std::move(repl));
+		}
+		break;
+
+	case STMT_SWITCH:
+		for ( auto c : *static_cast<SwitchStmt*>(s)->Cases() )
+			FoldIn(c->Body());
+		break;
+
+	default:
+		break;
+	}
+	}
+
+StmtPtr ConstantFolder::Replacement(Stmt* s)
+	{
+	switch ( s->Tag() ) {
+	case STMT_IF:
+		{
+		auto is = static_cast<IfStmt*>(s);
+		auto cond = is->StmtExpr();
+		auto v = static_value(cond);
+
+		if ( ! v )
+			return nullptr;
+
+		// Same as IfStmt::DoExec(), which treats anything non-zero
+		// as true.
+		if ( v->IsZero() )
+			{
+			Report(cond, "condition is always false, removed the 'if' branch");
+			return {zeek::NewRef{}, const_cast<Stmt*>(is->FalseBranch())};
+			}
+
+		Report(cond, "condition is always true, removed the 'else' branch");
+		return {zeek::NewRef{}, const_cast<Stmt*>(is->TrueBranch())};
+		}
+
+	case STMT_WHILE:
+		{
+		auto cond = static_cast<WhileStmt*>(s)->Condition();
+		auto v = static_value(cond);
+
+		if ( ! v || ! v->IsZero() )
+			return nullptr;
+
+		Report(cond, "condition is always false, removed the loop");
+		return zeek::make_intrusive<NullStmt>();
+		}
+
+	default:
+		return nullptr;
+	}
+	}
+
+void ConstantFolder::Report(const Expr* cond, const char* what)
+	{
+	++num_folded;
+
+	if ( ! report )
+		return;
+
+	auto loc = cond->GetLocationInfo();
+
+	fprintf(stderr, "const-fold: %s, line %d: %s\n",
+	        loc->filename ? loc->filename : "<no location>",
+	        loc->first_line, what);
+	}
+
+} // namespace
+
+void fold_script_constants(bool report)
+	{
+	ConstantFolder cf(report);
+
+	for ( const auto& [name, id] : global_scope()->Vars() )
+		{
+		if ( ! id->HasVal() || ! id->GetType() ||
+		     id->GetType()->Tag() != zeek::TYPE_FUNC )
+			continue;
+
+		auto func = id->GetVal()->AsFunc();
+
+		if ( func->GetKind() != zeek::Func::SCRIPT_FUNC )
+			continue;
+
+		for ( const auto& body : func->GetBodies() )
+			cf.FoldIn(body.stmts.get());
+		}
+
+	if ( report )
+		fprintf(stderr, "const-fold: folded %d statements\n", cf.NumFolded());
+
+	DBG_LOG(DBG_SCRIPTS, "folded %d statements with constant conditions",
+	        cf.NumFolded());
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,23 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+namespace zeek::detail {
+
+/**
+ * Removes statically dead code from the bodies of all global script
+ * functions, events, and hooks. An "if" whose condition depends only on
+ * literals and on global constants without &redef gets replaced by the
+ * branch it always takes, and a "while" whose condition is always false
+ * goes away. Such constants can't change once parsing has finished, so
+ * this needs to run after all scripts have been loaded but before any of
+ * them execute.
+ *
+ * Conditions fold only if evaluating them can't have side effects or
+ * raise run-time errors, so the behavior of the scripts doesn't change.
+ *
+ * @param report Whether to print each change to stderr, for auditing.
+ */
+void fold_script_constants(bool report);
+
+} // namespace zeek::detail
@@ -3,12 +3,51 @@
 #include "zeek-config.h"
 
 #include "DFA.h"
+
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "EquivClass.h"
 #include "Desc.h"
 #include "Hash.h"
 
 unsigned int DFA_State::transition_counter = 0;
 
+// Limits the entries of a DFA_Table, so that it stays small enough to be
+// worth having over the states.
+static constexpr size_t max_dfa_table_entries = 256 * 1024;
+
+// Marks a missing state in serialized machines.
+static constexpr uint32_t NO_SERIALIZED_STATE = 0xffffffff;
+
+static void put_uint32(std::string* buf, uint32_t v)
+	{
+	buf->append(reinterpret_cast<const char*>(&v), sizeof(v));
+	}
+
+// Reads from the data of a serialized machine, failing at its end.
+struct SerializedDFA_Reader {
+	const u_char* p;
+	const u_char* end;
+
+	bool Get(uint32_t* v)
+		{
+		if ( static_cast<size_t>(end - p) < sizeof(*v) )
+			return false;
+
+		memcpy(v, p, sizeof(*v));
+		p += sizeof(*v);
+		return true;
+		}
+};
+
 DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 			NFA_state_list* arg_nfa_states,
 			AcceptingSet* arg_accept)
@@ -27,6 +66,22 @@ DFA_State::DFA_State(int arg_state_num, const EquivClass* ec,
 		xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
 	}
 
+DFA_State::DFA_State(int arg_state_num, int arg_num_sym,
+			AcceptingSet* arg_accept)
+	{
+	state_num = arg_state_num;
+	num_sym = arg_num_sym;
+	nfa_states = nullptr;
+	accept = arg_accept;
+	meta_ec = nullptr;
+	mark = nullptr;
+
+	xtions = new DFA_State*[num_sym];
+
+	for ( int i = 0; i < num_sym; ++i )
+		xtions[i] = DFA_UNCOMPUTED_STATE_PTR;
+	}
+
 DFA_State::~DFA_State()
 	{
 	delete [] xtions;
@@ -78,6 +133,7 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	int equiv_sym = meta_ec->EquivRep(sym);
 	if ( xtions[equiv_sym] != DFA_UNCOMPUTED_STATE_PTR )
 		{
+		++machine->xtions_computed;
 		AddXtion(sym, xtions[equiv_sym]);
 		return xtions[sym];
 		}
@@ -85,6 +141,7 @@ DFA_State* DFA_State::ComputeXtion(int sym, DFA_Machine* machine)
 	const EquivClass* ec = machine->EC();
 
 	DFA_State* next_d;
+	++machine->xtions_computed;
 
 	NFA_state_list* ns = SymFollowSet(equiv_sym, ec);
 	if ( ns->length() > 0 )
@@ -401,6 +458,20 @@ DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec)
 		}
 	}
 
+DFA_Machine::DFA_Machine(NFA_Machine* n, EquivClass* arg_ec,
+			DFA_State_Cache* cache, DFA_State* start,
+			int num_states)
+	{
+	state_count = num_states;
+
+	nfa = n;
+	Ref(n);
+
+	ec = arg_ec;
+	dfa_state_cache = cache;
+	start_state = start;
+	}
+
 DFA_Machine::~DFA_Machine()
 	{
 	delete dfa_state_cache;
@@ -427,6 +498,7 @@ unsigned int DFA_Machine::MemoryAllocation() const
 	return padded_sizeof(*this)
 		+ s.mem
 		+ padded_sizeof(*start_state)
+		+ (table ? table->MemoryAllocation() : 0)
 		+ nfa->MemoryAllocation();
 	}
 
@@ -469,3 +541,310 @@ int DFA_Machine::Rep(int sym)
 
 	return -1;
 	}
+
+bool DFA_Machine::Determinize(int max_states)
+	{
+	if ( ! start_state )
+		return true;
+
+	int num_ecs = ec->NumClasses();
+	std::vector<DFA_State*> pending{start_state};
+	std::unordered_set<DFA_State*> seen{start_state};
+
+	while ( ! pending.empty() )
+		{
+		DFA_State* s = pending.back();
+		pending.pop_back();
+
+		for ( int sym = 0; sym < num_ecs; ++sym )
+			{
+			DFA_State* next = s->Xtion(sym, this);
+
+			if ( ! next || ! seen.insert(next).second )
+				continue;
+
+			if ( NumStates() > max_states )
+				return false;
+
+			pending.push_back(next);
+			}
+		}
+
+	return true;
+	}
+
+void DFA_Machine::BuildTable()
+	{
+	if ( table )
+		for ( auto s : table->states )
+			s->table_idx = -1;
+
+	xtions_in_table = xtions_computed;
+
+	if ( ! start_state )
+		return;
+
+	int num_ecs = ec->NumClasses();
+	size_t max_states = std::max(max_dfa_table_entries / num_ecs, size_t(1));
+
+	auto t = std::make_unique<DFA_Table>();
+	t->num_sym = num_ecs;
+	t->states.push_back(start_state);
+	start_state->table_idx = 0;
+
+	for ( size_t i = 0; i < t->states.size(); ++i )
+		for ( int sym = 0; sym < num_ecs; ++sym )
+			{
+			DFA_State* next = t->states[i]->xtions[sym];
+
+			if ( next && next != DFA_UNCOMPUTED_STATE_PTR &&
+			     next->table_idx < 0 && t->states.size() < max_states )
+				{
+				next->table_idx = t->states.size();
+				t->states.push_back(next);
+				}
+			}
+
+	t->next.reserve(t->states.size() * num_ecs);
+
+	for ( auto s : t->states )
+		for ( int sym = 0; sym < num_ecs; ++sym )
+			{
+			DFA_State* next = s->xtions[sym];
+
+			if ( ! next )
+				t->next.push_back(DFA_Table::JAM);
+
+			else if ( next == DFA_UNCOMPUTED_STATE_PTR || next->table_idx < 0 )
+				t->next.push_back(DFA_Table::COLD);
+
+			else
+				t->next.push_back(next->table_idx |
+				                  (next->Accept() ? DFA_Table::ACCEPT : 0));
+			}
+
+	const int* ecs = ec->EquivClasses();
+	t->skip_idx.reserve(t->states.size());
+
+	for ( auto s : t->states )
+		{
+		DFA_Table::SkipBytes sb{};
+
+		if ( ! s->Accept() )
+			for ( int c = 0; c < 256 && sb.num_bytes <= DFA_Table::max_skip_bytes; ++c )
+				{
+				if ( s->xtions[ecs[c]] == s )
+					continue;
+
+				if ( sb.num_bytes < DFA_Table::max_skip_bytes )
+					sb.bytes[sb.num_bytes] = c;
+
+				sb.bitmap[c >> 3] |= 1 << (c & 7);
+				++sb.num_bytes;
+				}
+
+		if ( s->Accept() || sb.num_bytes == 0 || sb.num_bytes > DFA_Table::max_skip_bytes )
+			t->skip_idx.push_back(-1);
+		else
+			{
+			t->skip_idx.push_back(t->skips.size());
+			t->skips.push_back(sb);
+			}
+		}
+
+	table = std::move(t);
+	}
+
+int DFA_Table::Skip(uint32_t idx, const u_char* data, int len) const
+	{
+	const SkipBytes& sb = skips[skip_idx[idx]];
+
+	if ( sb.num_bytes == 1 )
+		{
+		auto p = static_cast<const u_char*>(memchr(data, sb.bytes[0], len));
+		return p ? p - data : len;
+		}
+
+	int i = 0;
+
+#ifdef __SSE2__
+	__m128i needles[max_skip_bytes];
+
+	for ( int j = 0; j < sb.num_bytes; ++j )
+		needles[j] = _mm_set1_epi8(sb.bytes[j]);
+
+	for ( ; i + 16 <= len; i += 16 )
+		{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+
+		for ( int j = 1; j < sb.num_bytes; ++j )
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[j]));
+
+		if ( int mask = _mm_movemask_epi8(hits) )
+			return i + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; i < len; ++i )
+		if ( sb.bitmap[data[i] >> 3] & (1 << (data[i] & 7)) )
+			break;
+
+	return i;
+	}
+
+bool DFA_Machine::Serialize(std::string* buf)
+	{
+	int num_syms = ec->NumSyms();
+	int num_ecs = ec->NumClasses();
+	const int* ecs = ec->EquivClasses();
+
+	// Number the states in the order we reach them.
+	std::vector<DFA_State*> states;
+	std::unordered_map<DFA_State*, uint32_t> index;
+
+	if ( start_state )
+		{
+		states.push_back(start_state);
+		index[start_state] = 0;
+		}
+
+	for ( size_t i = 0; i < states.size(); ++i )
+		for ( int sym = 0; sym < num_ecs; ++sym )
+			{
+			DFA_State* next = states[i]->xtions[sym];
+
+			if ( next == DFA_UNCOMPUTED_STATE_PTR )
+				return false;
+
+			if ( next && index.emplace(next, states.size()).second )
+				states.push_back(next);
+			}
+
+	put_uint32(buf, num_syms);
+
+	for ( int i = 0; i < num_syms; ++i )
+		put_uint32(buf, ecs[i]);
+
+	put_uint32(buf, num_ecs);
+	put_uint32(buf, states.size());
+	put_uint32(buf, start_state ? 0 : NO_SERIALIZED_STATE);
+
+	for ( auto s : states )
+		{
+		const AcceptingSet* accept = s->Accept();
+		put_uint32(buf, accept ? accept->size() : 0);
+
+		if ( accept )
+			for ( auto a : *accept )
+				put_uint32(buf, a);
+
+		for ( int sym = 0; sym < num_ecs; ++sym )
+			{
+			DFA_State* next = s->xtions[sym];
+			put_uint32(buf, next ? index[next] : NO_SERIALIZED_STATE);
+			}
+		}
+
+	return true;
+	}
+
+DFA_Machine* DFA_Machine::Unserialize(NFA_Machine* n, EquivClass* ec,
+			const u_char* data, size_t len)
+	{
+	SerializedDFA_Reader r{data, data + len};
+	uint32_t num_syms;
+
+	if ( ! r.Get(&num_syms) || num_syms != static_cast<uint32_t>(ec->NumSyms()) )
+		return nullptr;
+
+	const int* ecs = ec->EquivClasses();
+
+	for ( uint32_t i = 0; i < num_syms; ++i )
+		{
+		uint32_t v;
+
+		if ( ! r.Get(&v) || v != static_cast<uint32_t>(ecs[i]) )
+			return nullptr;
+		}
+
+	uint32_t num_ecs, num_states, start;
+
+	if ( ! r.Get(&num_ecs) || num_ecs != static_cast<uint32_t>(ec->NumClasses()) ||
+	     ! r.Get(&num_states) || ! r.Get(&start) )
+		return nullptr;
+
+	if ( (start == NO_SERIALIZED_STATE) != (num_states == 0) ||
+	     (num_states > 0 && start >= num_states) )
+		return nullptr;
+
+	// Each state needs at least its transitions.
+	if ( num_ecs > 0 && num_states > len / sizeof(uint32_t) / num_ecs )
+		return nullptr;
+
+	std::vector<AcceptingSet*> accepts;
+	std::vector<uint32_t> xtions;
+	xtions.reserve(static_cast<size_t>(num_states) * num_ecs);
+
+	auto fail = [&accepts]()
+		{
+		for ( auto a : accepts )
+			delete a;
+
+		return nullptr;
+		};
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		{
+		uint32_t num_accept;
+
+		if ( ! r.Get(&num_accept) )
+			return fail();
+
+		AcceptingSet* accept = num_accept ? new AcceptingSet : nullptr;
+		accepts.push_back(accept);
+
+		for ( uint32_t j = 0; j < num_accept; ++j )
+			{
+			uint32_t a;
+
+			if ( ! r.Get(&a) )
+				return fail();
+
+			accept->insert(static_cast<AcceptIdx>(a));
+			}
+
+		for ( uint32_t sym = 0; sym < num_ecs; ++sym )
+			{
+			uint32_t next;
+
+			if ( ! r.Get(&next) ||
+			     (next != NO_SERIALIZED_STATE && next >= num_states) )
+				return fail();
+
+			xtions.push_back(next);
+			}
+		}
+
+	std::vector<DFA_State*> states(num_states);
+	DFA_State_Cache* cache = new DFA_State_Cache();
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		{
+		states[i] = new DFA_State(i, num_ecs, accepts[i]);
+
+		// These states never get looked up by their NFA states, so
+		// any unique digest will do.
+		cache->Insert(states[i], DigestStr(reinterpret_cast<const u_char*>(&i), sizeof(i)));
+		}
+
+	for ( uint32_t i = 0; i < num_states; ++i )
+		for ( uint32_t sym = 0; sym < num_ecs; ++sym )
+			{
+			uint32_t next = xtions[i * num_ecs + sym];
+			states[i]->AddXtion(sym, next == NO_SERIALIZED_STATE ? nullptr : states[next]);
+			}
+
+	return new DFA_Machine(n, ec, cache, num_states ? states[start] : nullptr,
+	                       num_states);
+	}
@@ -5,9 +5,12 @@
 
 #include "RE.h" // for typedef AcceptingSet
 #include "Obj.h"
+#include "HugePages.h"
 
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <assert.h>
 #include <sys/types.h> // for u_char
@@ -28,10 +31,22 @@ class DFA_State : public zeek::Obj {
 public:
 	DFA_State(int state_num, const EquivClass* ec,
 			NFA_state_list* nfa_states, AcceptingSet* accept);
+
+	// Creates a state without NFA states behind it, as used by machines
+	// restored from a DFA cache. The caller has to set all of its
+	// transitions through AddXtion(), as there's nothing to compute
+	// them from.
+	DFA_State(int state_num, int num_sym, AcceptingSet* accept);
+
 	~DFA_State() override;
 
 	int StateNum() const		{ return state_num; }
-	int NFAStateNum() const		{ return nfa_states->length(); }
+
+	// The state's position in its machine's DFA_Table, or -1 if the
+	// table doesn't cover it.
+	int TableIndex() const		{ return table_idx; }
+
+	int NFAStateNum() const		{ return nfa_states ? nfa_states->length() : 0; }
 	void AddXtion(int sym, DFA_State* next_state);
 
 	inline DFA_State* Xtion(int sym, DFA_Machine* machine);
@@ -56,12 +71,14 @@ public:
 
 protected:
 	friend class DFA_State_Cache;
+	friend class DFA_Machine;	// for DFA_Machine::Serialize
 
 	DFA_State* ComputeXtion(int sym, DFA_Machine* machine);
 	void AppendIfNew(int sym, int_list* sym_list);
 
 	int state_num;
 	int num_sym;
+	int table_idx = -1;
 
 	DFA_State** xtions;
 
@@ -109,6 +126,68 @@ private:
 	std::map<DigestStr, DFA_State*> states;
 };
 
+// A dense copy of the transitions between a machine's states, which
+// matching runs over instead of chasing DFA_State pointers. Each entry
+// holds the table index of the state that a symbol leads to, with
+// ACCEPT set if that state accepts.  Transitions that jam, that haven't
+// been computed yet, or that leave the table have special entries;
+// for those, matching continues on the DFA_State behind the current
+// index.
+class DFA_Table {
+public:
+	static constexpr uint32_t ACCEPT = 0x80000000;
+	static constexpr uint32_t COLD = 0x7ffffffe;	// use the DFA_State
+	static constexpr uint32_t JAM = 0x7fffffff;
+
+	uint32_t Next(uint32_t idx, int sym) const
+		{ return next[idx * num_sym + sym]; }
+
+	// Strips ACCEPT from an entry.
+	static uint32_t Index(uint32_t entry)	{ return entry & ~ACCEPT; }
+
+	DFA_State* State(uint32_t idx) const	{ return states[idx]; }
+
+	// Returns true if a state doesn't accept and only leaves itself on
+	// a few input bytes, such as the first bytes of the literals in
+	// ".*foo|.*bar". Matching can then use Skip() to scan ahead for
+	// those bytes rather than stepping through the table.
+	bool CanSkip(uint32_t idx) const	{ return skip_idx[idx] >= 0; }
+
+	// Returns the number of bytes at the start of data that leave a
+	// state for which CanSkip() is true where it is.
+	int Skip(uint32_t idx, const u_char* data, int len) const;
+
+	unsigned int MemoryAllocation() const
+		{
+		return padded_sizeof(*this)
+			+ pad_size(next.capacity() * sizeof(uint32_t))
+			+ pad_size(states.capacity() * sizeof(DFA_State*))
+			+ pad_size(skip_idx.capacity() * sizeof(int))
+			+ pad_size(skips.capacity() * sizeof(SkipBytes));
+		}
+
+protected:
+	friend class DFA_Machine;
+
+	// States leaving themselves on more bytes than this aren't worth
+	// scanning for.
+	static constexpr int max_skip_bytes = 8;
+
+	// The bytes that make a state go elsewhere.
+	struct SkipBytes {
+		int num_bytes;
+		u_char bytes[max_skip_bytes];
+		uint8_t bitmap[256 / 8];
+	};
+
+	int num_sym = 0;
+	// Large tables get backed by huge pages, as matching jumps around.
+	std::vector<uint32_t, zeek::detail::HugePageAllocator<uint32_t>> next;
+	std::vector<DFA_State*> states;	// by table index
+	std::vector<int> skip_idx;	// by table index, into skips, or -1
+	std::vector<SkipBytes> skips;
+};
+
 class DFA_Machine : public zeek::Obj {
 public:
 	DFA_Machine(NFA_Machine* n, EquivClass* ec);
@@ -127,10 +206,52 @@ public:
 
 	unsigned int MemoryAllocation() const;
 
+	// Computes all of the machine's states and transitions up front,
+	// rather than as input gets matched. Stops once there are more than
+	// max_states states, as some patterns blow up when determinized.
+	// Returns true if the machine is complete.
+	bool Determinize(int max_states);
+
+	// Appends a representation of a complete machine (see Determinize())
+	// to buf, including the equivalence classes it was built for.
+	// Returns false if the machine isn't complete.
+	bool Serialize(std::string* buf);
+
+	// Restores a machine from data written by Serialize(). Returns nil
+	// if the data doesn't represent a machine for the given equivalence
+	// classes, in which case the caller needs to build one from the NFA.
+	static DFA_Machine* Unserialize(NFA_Machine* n, EquivClass* ec,
+	                                const u_char* data, size_t len);
+
+	// Returns the machine's transition table, or nil if it doesn't have
+	// one yet. To be called once at the start of each matching run: the
+	// table gets (re)built after enough consecutive runs that don't
+	// compute new transitions, as by then the states that the input
+	// visits seem settled.
+	const DFA_Table* Table()
+		{
+		if ( xtions_computed != xtions_last_run )
+			{
+			xtions_last_run = xtions_computed;
+			quiet_runs = 0;
+			}
+
+		else if ( quiet_runs < table_quiet_runs &&
+			  ++quiet_runs == table_quiet_runs &&
+			  (! table || xtions_computed != xtions_in_table) )
+			BuildTable();
+
+		return table.get();
+		}
+
 protected:
 	friend class DFA_State;	// for DFA_State::ComputeXtion
 	friend class DFA_State_Cache;
 
+	// For Unserialize(), which sets up the states itself.
+	DFA_Machine(NFA_Machine* n, EquivClass* ec, DFA_State_Cache* cache,
+	            DFA_State* start, int num_states);
+
 	int state_count;
 
 	// The state list has to be sorted according to IDs.
@@ -143,6 +264,19 @@ protected:
 	DFA_State_Cache* dfa_state_cache;
 
 	NFA_Machine* nfa;
+
+	// Puts the states reachable from the start state through computed
+	// transitions into a new table, nearest ones first, up to a size
+	// limit.
+	void BuildTable();
+
+	static constexpr int table_quiet_runs = 1000;
+
+	std::unique_ptr<DFA_Table> table;
+	unsigned int xtions_computed = 0;	// ever, by ComputeXtion()
+	unsigned int xtions_last_run = 0;	// as of the last Table()
+	unsigned int xtions_in_table = 0;	// as of the last BuildTable()
+	int quiet_runs = 0;
 };
 
 inline DFA_State* DFA_State::Xtion(int sym, DFA_Machine* machine)
@@ -0,0 +1,263 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "DFACache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "EquivClass.h"
+#include "Reporter.h"
+#include "digest.h"
+
+namespace zeek::detail {
+
+DFA_Cache* dfa_cache = nullptr;
+
+// Written at the start of the file, followed by the format version, the
+// digest of the scripts and signatures, and the number of machines.
+static constexpr char dfa_cache_magic[4] = { 'Z', 'D', 'F', 'A' };
+static constexpr uint32_t dfa_cache_version = 2;
+
+// Machines with more states than this stay lazy, as determinizing them
+// fully would take too much time and memory.
+static constexpr int max_cached_dfa_states = 100000;
+
+DFA_Cache::~DFA_Cache()
+	{
+	for ( auto& r : recorded )
+		Unref(r.second);
+
+	if ( mapping )
+		munmap(mapping, mapping_len);
+	}
+
+DFA_Cache::Digest DFA_Cache::KeyDigest(const std::string& key)
+	{
+	u_char digest[MD5_DIGEST_LENGTH];
+	internal_md5(reinterpret_cast<const u_char*>(key.data()), key.size(), digest);
+	return Digest(reinterpret_cast<const char*>(digest), sizeof(digest));
+	}
+
+std::string DFA_Cache::FilesDigest(const std::vector<std::string>& files,
+                                   const std::string& code)
+	{
+	EVP_MD_CTX* ctx = hash_init(Hash_MD5);
+	char buf[8192];
+
+	for ( const auto& file : files )
+		{
+		// Include the terminating NUL to separate the names from the
+		// contents.
+		hash_update(ctx, file.c_str(), file.size() + 1);
+
+		FILE* f = fopen(file.c_str(), "r");
+
+		if ( ! f )
+			continue;
+
+		size_t n;
+
+		while ( (n = fread(buf, 1, sizeof(buf), f)) > 0 )
+			hash_update(ctx, buf, n);
+
+		fclose(f);
+		}
+
+	hash_update(ctx, code.data(), code.size());
+
+	u_char digest[MD5_DIGEST_LENGTH];
+	hash_final(ctx, digest);
+	return std::string(reinterpret_cast<const char*>(digest), sizeof(digest));
+	}
+
+bool DFA_Cache::Load(const std::string& file)
+	{
+	int fd = open(file.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		reporter->Error("can't open DFA cache %s: %s", file.c_str(), strerror(errno));
+		return false;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || st.st_size == 0 )
+		{
+		reporter->Error("can't read DFA cache %s", file.c_str());
+		close(fd);
+		return false;
+		}
+
+	mapping_len = st.st_size;
+	mapping = mmap(nullptr, mapping_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( mapping == MAP_FAILED )
+		{
+		reporter->Error("can't map DFA cache %s: %s", file.c_str(), strerror(errno));
+		mapping = nullptr;
+		return false;
+		}
+
+	auto p = static_cast<const u_char*>(mapping);
+	auto end = p + mapping_len;
+
+	auto get = [&p, end](uint32_t* v)
+		{
+		if ( static_cast<size_t>(end - p) < sizeof(*v) )
+			return false;
+
+		memcpy(v, p, sizeof(*v));
+		p += sizeof(*v);
+		return true;
+		};
+
+	uint32_t version, num_entries;
+
+	if ( mapping_len < sizeof(dfa_cache_magic) ||
+	     memcmp(p, dfa_cache_magic, sizeof(dfa_cache_magic)) != 0 )
+		{
+		reporter->Error("%s is not a DFA cache", file.c_str());
+		return false;
+		}
+
+	p += sizeof(dfa_cache_magic);
+
+	if ( ! get(&version) || version != dfa_cache_version ||
+	     static_cast<size_t>(end - p) < MD5_DIGEST_LENGTH )
+		{
+		reporter->Error("DFA cache %s has an unsupported format", file.c_str());
+		return false;
+		}
+
+	loaded_files_digest.assign(reinterpret_cast<const char*>(p), MD5_DIGEST_LENGTH);
+	p += MD5_DIGEST_LENGTH;
+
+	if ( ! get(&num_entries) )
+		{
+		reporter->Error("DFA cache %s is truncated", file.c_str());
+		return false;
+		}
+
+	for ( uint32_t i = 0; i < num_entries; ++i )
+		{
+		uint32_t len;
+
+		if ( static_cast<size_t>(end - p) < MD5_DIGEST_LENGTH )
+			break;
+
+		Digest digest(reinterpret_cast<const char*>(p), MD5_DIGEST_LENGTH);
+		p += MD5_DIGEST_LENGTH;
+
+		if ( ! get(&len) || static_cast<size_t>(end - p) < len )
+			break;
+
+		entries[std::move(digest)] = {p, len};
+		p += len;
+		}
+
+	if ( entries.size() != num_entries )
+		{
+		reporter->Error("DFA cache %s is truncated", file.c_str());
+		entries.clear();
+		return false;
+		}
+
+	return true;
+	}
+
+DFA_Machine* DFA_Cache::MakeDFA(const std::string& key, NFA_Machine* nfa, EquivClass* ec)
+	{
+	auto digest = KeyDigest(key);
+	DFA_Machine* dfa = nullptr;
+
+	if ( auto it = entries.find(digest); it != entries.end() )
+		dfa = DFA_Machine::Unserialize(nfa, ec, it->second.first, it->second.second);
+
+	if ( ! dfa )
+		dfa = new DFA_Machine(nfa, ec);
+
+	if ( recording )
+		{
+		Ref(dfa);
+		recorded.emplace_back(std::move(digest), dfa);
+		}
+
+	return dfa;
+	}
+
+bool DFA_Cache::Save(const std::string& file)
+	{
+	// Patterns that get compiled more than once map to the same entry.
+	std::map<Digest, std::string> machines;
+	int num_skipped = 0;
+
+	for ( auto& [digest, dfa] : recorded )
+		{
+		if ( machines.count(digest) )
+			continue;
+
+		std::string buf;
+
+		if ( ! dfa->Determinize(max_cached_dfa_states) || ! dfa->Serialize(&buf) )
+			{
+			++num_skipped;
+			continue;
+			}
+
+		machines.emplace(digest, std::move(buf));
+		}
+
+	// Write to a temporary file first, so that processes starting up
+	// meanwhile never see a partial one.
+	auto tmp = file + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		{
+		reporter->Error("can't write DFA cache %s: %s", tmp.c_str(), strerror(errno));
+		return false;
+		}
+
+	std::string header(dfa_cache_magic, sizeof(dfa_cache_magic));
+	uint32_t n = machines.size();
+	header.append(reinterpret_cast<const char*>(&dfa_cache_version), sizeof(dfa_cache_version));
+	saved_files_digest.resize(MD5_DIGEST_LENGTH);
+	header.append(saved_files_digest);
+	header.append(reinterpret_cast<const char*>(&n), sizeof(n));
+
+	bool ok = fwrite(header.data(), header.size(), 1, f) == 1;
+
+	for ( const auto& [digest, buf] : machines )
+		{
+		uint32_t len = buf.size();
+
+		ok = ok && fwrite(digest.data(), digest.size(), 1, f) == 1 &&
+		     fwrite(&len, sizeof(len), 1, f) == 1 &&
+		     (len == 0 || fwrite(buf.data(), len, 1, f) == 1);
+		}
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), file.c_str()) < 0 )
+		{
+		reporter->Error("can't write DFA cache %s: %s", file.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	reporter->Info("wrote %zu DFAs to %s, %d were too large to determinize",
+	               machines.size(), file.c_str(), num_skipped);
+
+	return true;
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,126 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "DFA.h"
+
+namespace zeek::detail {
+
+/**
+ * A file of fully determinized DFAs for the patterns and signatures of a
+ * configuration. "zeek --build-dfa-cache <file>" writes one after loading
+ * all scripts and signatures, and "zeek --dfa-cache <file>" maps it into
+ * memory and restores machines from it as the corresponding patterns get
+ * compiled. That saves building them at startup, as well as computing
+ * their states lazily while the first traffic comes in.
+ *
+ * Each machine is stored under a digest of the patterns it matches,
+ * along with the equivalence classes it was built for. Patterns without
+ * a stored machine, such as ones that changed since writing the file or
+ * that were too large to determinize fully, get their DFA built as
+ * usual.
+ *
+ * The file also records a digest of the scripts and signature files it
+ * was built from, so that starting with different ones can point out
+ * that it needs rebuilding.
+ */
+class DFA_Cache {
+public:
+	~DFA_Cache();
+
+	/**
+	 * Maps a cache file into memory.
+	 *
+	 * @param file The name of the file.
+	 *
+	 * @return False if the file can't be read or isn't a DFA cache, after
+	 * reporting why.
+	 */
+	bool Load(const std::string& file);
+
+	/**
+	 * Computes the digest of a configuration's scripts and signatures.
+	 *
+	 * @param files The names of all script and signature files loaded.
+	 *
+	 * @param code Script code that didn't come from a file, such as
+	 * given with -e.
+	 *
+	 * @return An MD5 of the file names and their contents.
+	 */
+	static std::string FilesDigest(const std::vector<std::string>& files,
+	                               const std::string& code);
+
+	/**
+	 * Returns whether the loaded cache file was built from the scripts
+	 * and signatures with the given FilesDigest().
+	 */
+	bool BuiltFrom(const std::string& files_digest) const
+		{ return loaded_files_digest == files_digest; }
+
+	/**
+	 * Sets the FilesDigest() that Save() records.
+	 */
+	void SetFilesDigest(std::string files_digest)
+		{ saved_files_digest = std::move(files_digest); }
+
+	/**
+	 * Makes MakeDFA() keep the machines it returns, for Save().
+	 */
+	void RecordMachines()	{ recording = true; }
+
+	/**
+	 * Returns the DFA for an NFA, restoring it from the loaded cache file
+	 * if that has one for the given key, and creating it otherwise.
+	 *
+	 * @param key Identifies the patterns that the NFA matches, including
+	 * any flags that affect how they match.
+	 *
+	 * @param nfa The NFA.
+	 *
+	 * @param ec The equivalence classes for the NFA's input symbols.
+	 *
+	 * @return The DFA, which the caller owns.
+	 */
+	DFA_Machine* MakeDFA(const std::string& key, NFA_Machine* nfa, EquivClass* ec);
+
+	/**
+	 * Fully determinizes the machines that MakeDFA() has returned since
+	 * RecordMachines() and writes them to a cache file. Machines with
+	 * too many states get left out.
+	 *
+	 * @param file The name of the file.
+	 *
+	 * @return False if the file can't be written, after reporting why.
+	 */
+	bool Save(const std::string& file);
+
+private:
+	// An MD5 of a key passed to MakeDFA().
+	using Digest = std::string;
+
+	static Digest KeyDigest(const std::string& key);
+
+	// The serialized machines of the loaded file, by digest. These
+	// point into its mapping.
+	std::map<Digest, std::pair<const u_char*, size_t>> entries;
+
+	void* mapping = nullptr;
+	size_t mapping_len = 0;
+
+	std::string loaded_files_digest;
+	std::string saved_files_digest;
+
+	bool recording = false;
+	std::vector<std::pair<Digest, DFA_Machine*>> recorded;	// we hold a ref
+};
+
+// Only set when running with one of the DFA cache options.
+extern DFA_Cache* dfa_cache;
+
+} // namespace zeek::detail
@@ -374,6 +374,7 @@ void DNS_Mapping::Save(FILE* f) const
 		fprintf(f, "%s\n", addrs[i].AsString().c_str());
 	}
 
+#define MAX_PENDING_REQUESTS 20
 
 DNS_Mgr::DNS_Mgr(DNS_MgrMode arg_mode)
 	{
@@ -384,9 +385,13 @@ DNS_Mgr::DNS_Mgr(DNS_MgrMode arg_mode)
 	cache_name = dir = nullptr;
 
 	asyncs_pending = 0;
+	max_pending = MAX_PENDING_REQUESTS;
+	negative_ttl = 0;
 	num_requests = 0;
 	successful = 0;
 	failed = 0;
+	memset(latency, 0, sizeof(latency));
+	total_latency = 0.0;
 	nb_dns = nullptr;
 	}
 
@@ -452,6 +457,9 @@ void DNS_Mgr::InitPostScript()
 	{
 	dm_rec = zeek::id::find_type<zeek::RecordType>("dns_mapping");
 
+	max_pending = zeek::id::find_val("dns_max_pending_requests")->AsCount();
+	negative_ttl = zeek::id::find_val("dns_negative_cache_ttl")->AsInterval();
+
 	// Registering will call Init()
 	iosource_mgr->Register(this, true);
 
@@ -590,8 +598,6 @@ void DNS_Mgr::Verify()
 	{
 	}
 
-#define MAX_PENDING_REQUESTS 20
-
 void DNS_Mgr::Resolve()
 	{
 	if ( ! nb_dns )
@@ -733,7 +739,7 @@ zeek::ValPtr DNS_Mgr::BuildMappingVal(DNS_Mapping* dm)
 void DNS_Mgr::AddResult(DNS_Mgr_Request* dr, struct nb_dns_result* r)
 	{
 	struct hostent* h = (r && r->host_errno == 0) ? r->hostent : nullptr;
-	u_int32_t ttl = (r && r->host_errno == 0) ? r->ttl : 0;
+	u_int32_t ttl = (r && r->host_errno == 0) ? r->ttl : negative_ttl;
 
 	DNS_Mapping* new_dm;
 	DNS_Mapping* prev_dm;
@@ -1172,7 +1178,7 @@ static bool DoRequest(nb_dns_info* nb_dns, DNS_Mgr_Request* dr)
 
 void DNS_Mgr::IssueAsyncRequests()
 	{
-	while ( asyncs_queued.size() && asyncs_pending < MAX_PENDING_REQUESTS )
+	while ( asyncs_queued.size() && asyncs_pending < max_pending )
 		{
 		AsyncRequest* req = asyncs_queued.front();
 		asyncs_queued.pop_front();
@@ -1209,6 +1215,22 @@ void DNS_Mgr::IssueAsyncRequests()
 		}
 	}
 
+void DNS_Mgr::RecordLatency(double issued)
+	{
+	double elapsed = current_time() - issued;
+	auto ms = static_cast<uint64_t>(elapsed * 1000.0);
+	int bucket = 0;
+
+	while ( ms > 0 && bucket < DNS_LATENCY_BUCKETS - 1 )
+		{
+		ms >>= 1;
+		++bucket;
+		}
+
+	++latency[bucket];
+	total_latency += elapsed;
+	}
+
 void DNS_Mgr::CheckAsyncAddrRequest(const IPAddr& addr, bool timeout)
 	{
 	// Note that this code is a mirror of that for CheckAsyncHostRequest.
@@ -1223,6 +1245,7 @@ void DNS_Mgr::CheckAsyncAddrRequest(const IPAddr& addr, bool timeout)
 		if ( name )
 			{
 			++successful;
+			RecordLatency(i->second->time);
 			i->second->Resolved(name);
 			}
 
@@ -1255,6 +1278,7 @@ void DNS_Mgr::CheckAsyncTextRequest(const char* host, bool timeout)
 		if ( name )
 			{
 			++successful;
+			RecordLatency(i->second->time);
 			i->second->Resolved(name);
 			}
 
@@ -1289,6 +1313,7 @@ void DNS_Mgr::CheckAsyncHostRequest(const char* host, bool timeout)
 		if ( addrs )
 			{
 			++successful;
+			RecordLatency(i->second->time);
 			i->second->Resolved(addrs.get());
 			}
 
@@ -1455,6 +1480,8 @@ void DNS_Mgr::GetStats(Stats* stats)
 	stats->cached_hosts = host_mappings.size();
 	stats->cached_addresses = addr_mappings.size();
 	stats->cached_texts = text_mappings.size();
+	memcpy(stats->latency, latency, sizeof(latency));
+	stats->total_latency = total_latency;
 	}
 
 void DNS_Mgr::Terminate()
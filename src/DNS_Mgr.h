@@ -45,6 +45,11 @@ enum DNS_MgrMode {
 // Number of seconds we'll wait for a reply.
 #define DNS_TIMEOUT 5
 
+// Number of buckets of the reply latency histogram.  Bucket i counts
+// replies that took less than 2^i milliseconds (and, except for the
+// first, at least 2^(i-1)); the last one counts all slower replies.
+#define DNS_LATENCY_BUCKETS 14
+
 class DNS_Mgr final : public iosource::IOSource {
 public:
 	explicit DNS_Mgr(DNS_MgrMode mode);
@@ -93,6 +98,8 @@ public:
 		unsigned long cached_hosts;
 		unsigned long cached_addresses;
 		unsigned long cached_texts;
+		unsigned long latency[DNS_LATENCY_BUCKETS];	// of async requests
+		double total_latency;	// in seconds, over all of those
 	};
 
 	void GetStats(Stats* stats);
@@ -130,6 +137,10 @@ protected:
 	// Issue as many queued async requests as slots are available.
 	void IssueAsyncRequests();
 
+	// Adds the time since the given request was issued to the latency
+	// histogram.
+	void RecordLatency(double issued);
+
 	// Finish the request if we have a result.  If not, time it out if
 	// requested.
 	void CheckAsyncAddrRequest(const IPAddr& addr, bool timeout);
@@ -233,10 +244,16 @@ protected:
 	TimeoutQueue asyncs_timeouts;
 
 	int asyncs_pending;
+	int max_pending;	// at most that many async requests at a time
+
+	// How long failed lookups stay cached before being retried.
+	uint32_t negative_ttl;
 
 	unsigned long num_requests;
 	unsigned long successful;
 	unsigned long failed;
+	unsigned long latency[DNS_LATENCY_BUCKETS];
+	double total_latency;
 };
 
 extern DNS_Mgr* dns_mgr;
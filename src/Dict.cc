@@ -6,53 +6,90 @@
 #include <memory.h>
 #endif
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "3rdparty/doctest.h"
 
 #include "Dict.h"
+#include "HugePages.h"
 #include "Reporter.h"
 
-// If the mean bucket length exceeds the following then Insert() will
-// increase the size of the hash table.
-constexpr double DEFAULT_DENSITY_THRESH = 3.0;
+// Maximum fraction of slots that may be occupied by entries and tombstones,
+// as numerator/denominator. Linear probing remains fast up to this load.
+constexpr int MAX_LOAD_NUM = 3;
+constexpr int MAX_LOAD_DENOM = 4;
 
-// Threshold above which we do not try to ensure that the hash size
-// is prime.
-constexpr int PRIME_THRESH = 1000;
+static int max_load(int capacity)
+	{
+	return capacity / MAX_LOAD_DENOM * MAX_LOAD_NUM;
+	}
 
-// Default number of hash buckets in dictionary.  The dictionary will
-// increase the size of the hash table as needed.
+// Default number of slots in a dictionary.  The dictionary will grow the
+// table as needed.
 constexpr int DEFAULT_DICT_SIZE = 16;
 
+// Number of old slots to move over with every modification while resizing.
+// Moving at least 8 guarantees that resizing finishes before the new
+// table fills up, unless iterations keep it from moving entries for a
+// while.
+constexpr int RESIZE_STEP = 16;
+
 namespace zeek {
 namespace detail {
 
 class DictEntry {
 public:
-	DictEntry(void* k, int l, hash_t h, void* val) : key(k), len(l), hash(h), value(val) {}
+	enum State : uint8_t { EMPTY, FULL, DELETED };
 
-	~DictEntry()
+	bool Matches(const void* k, int l, hash_t h) const
 		{
-		delete [] (char*) key;
+		return state == FULL && hash == h && len == l && ! memcmp(k, key, l);
 		}
 
-	void* key;
-	int len;
-	hash_t hash;
-	void* value;
+	void* key = nullptr;
+	void* value = nullptr;
+	hash_t hash = 0;
+	int len = 0;
+	State state = EMPTY;
 };
 
+// Slot arrays of large dictionaries, such as those of big script tables,
+// are randomly accessed, so they get backed by huge pages if possible.
+static DictEntry* new_slots(int capacity)
+	{
+	auto slots = static_cast<DictEntry*>(huge_page_alloc(capacity * sizeof(DictEntry)));
+	std::uninitialized_value_construct_n(slots, capacity);
+	return slots;
+	}
+
+static void delete_slots(DictEntry* slots, int capacity)
+	{
+	huge_page_free(slots, capacity * sizeof(DictEntry));
+	}
+
 } //namespace detail
 
-// The value of an iteration cookie is the bucket and offset within the
-// bucket at which to start looking for the next value to return.
+// An iteration cookie first walks the slots of the table we're resizing
+// from, if any, and then those of the current one.
 class IterCookie {
 public:
-	IterCookie(int b, int o) : bucket(b), offset(o) {}
+	enum { OLD_TABLE, CURRENT_TABLE, DONE };
+
+	int table = OLD_TABLE;
+	int slot = 0;
+
+	// For robust cookies, entries inserted during iteration into slots
+	// the cookie has passed already. We keep copies of the keys, and
+	// skip those no longer present when we get to them.
+	struct InsertedKey {
+		hash_t hash;
+		std::string key;
+	};
 
-	int bucket, offset;
-	zeek::PList<detail::DictEntry>** ttbl = nullptr;
-	const int* num_buckets_p = nullptr;
-	zeek::PList<detail::DictEntry> inserted;	// inserted while iterating
+	std::vector<InsertedKey> inserted;
 };
 
 } // namespace zeek
@@ -171,28 +208,240 @@ TEST_CASE("dict iteration")
 	zeek::IterCookie* it = dict.InitForIteration();
 	CHECK(it != nullptr);
 	int count = 0;
+	bool seen1 = false;
+	bool seen2 = false;
 
+	// Iteration order depends on the hash values.
 	while ( uint32_t* entry = dict.NextEntry(it_key, it) )
 		{
-		if ( count == 0 )
+		if ( it_key->Hash() == key2->Hash() )
 			{
-			CHECK(it_key->Hash() == key2->Hash());
+			CHECK(! seen2);
 			CHECK(*entry == 10);
+			seen2 = true;
 			}
 		else
 			{
 			CHECK(it_key->Hash() == key->Hash());
+			CHECK(! seen1);
 			CHECK(*entry == 15);
+			seen1 = true;
 			}
 		count++;
 
 		delete it_key;
 		}
 
+	CHECK(count == 2);
+	CHECK(it == nullptr);
+
 	delete key;
 	delete key2;
 	}
 
+TEST_CASE("dict iteration with keys in place")
+	{
+	zeek::PDict<uint32_t> dict;
+	uint32_t vals[2] = {15, 10};
+
+	for ( uint32_t i = 0; i < 2; ++i )
+		{
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	zeek::IterCookie* it = dict.InitForIteration();
+	const void* key;
+	int key_size;
+	int count = 0;
+
+	while ( uint32_t* entry = dict.NextEntry(key, key_size, it) )
+		{
+		CHECK(key_size == sizeof(uint32_t));
+		CHECK(*entry == vals[*static_cast<const uint32_t*>(key)]);
+		++count;
+		}
+
+	CHECK(count == 2);
+	CHECK(it == nullptr);
+	}
+
+TEST_CASE("dict robust iteration")
+	{
+	zeek::PDict<uint32_t> dict;
+	std::vector<uint32_t> vals(1000);
+
+	for ( uint32_t i = 0; i < 100; ++i )
+		{
+		vals[i] = i;
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	zeek::IterCookie* it = dict.InitForIteration();
+	dict.MakeRobustCookie(it);
+
+	std::vector<bool> seen(vals.size());
+	HashKey* it_key;
+	int count = 0;
+
+	while ( uint32_t* entry = dict.NextEntry(it_key, it) )
+		{
+		CHECK(! seen[*entry]);
+		seen[*entry] = true;
+		delete it_key;
+
+		// Insert enough entries to make the table grow while
+		// iterating, and remove some we haven't seen yet.
+		if ( count++ == 10 )
+			{
+			for ( uint32_t i = 100; i < vals.size(); ++i )
+				{
+				vals[i] = i;
+				HashKey key(i);
+				dict.Insert(&key, &vals[i]);
+				}
+
+			for ( uint32_t i = 0; i < 100; ++i )
+				{
+				if ( ! seen[i] && i % 2 )
+					{
+					HashKey key(i);
+					dict.Remove(&key);
+					}
+				}
+			}
+		}
+
+	for ( uint32_t i = 0; i < vals.size(); ++i )
+		{
+		HashKey key(i);
+		CHECK(seen[i] == (dict.Lookup(&key) != nullptr));
+		}
+
+	CHECK(dict.Length() > 900);
+	}
+
+TEST_CASE("dict resize paused by iteration")
+	{
+	zeek::PDict<uint32_t> dict;
+	std::vector<uint32_t> vals(1000);
+
+	for ( uint32_t i = 0; i < vals.size(); ++i )
+		vals[i] = i;
+
+	// Fill the initial 32 slots up to their load of 24.
+	for ( uint32_t i = 0; i < 24; ++i )
+		{
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	// Start a resize to 64 slots while a robust cookie keeps the
+	// entries from moving, and insert until the new table is just
+	// short of its load of 48, with no room left for the old entries.
+	zeek::IterCookie* it = dict.InitForIteration();
+	dict.MakeRobustCookie(it);
+
+	for ( uint32_t i = 24; i < 71; ++i )
+		{
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	dict.StopIteration(it);
+
+	// With the cookie gone, the entries move over along with these.
+	for ( uint32_t i = 71; i < vals.size(); ++i )
+		{
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+
+		HashKey removed(i - 71);
+		dict.Remove(&removed);
+		}
+
+	CHECK(dict.Length() == 71);
+
+	for ( uint32_t i = 0; i < vals.size(); ++i )
+		{
+		HashKey key(i);
+		CHECK(dict.Lookup(&key) == (i < vals.size() - 71 ? nullptr : &vals[i]));
+		}
+	}
+
+TEST_CASE("dict reserve")
+	{
+	zeek::PDict<uint32_t> dict(zeek::ORDERED);
+	std::vector<uint32_t> vals(5000);
+
+	for ( uint32_t i = 0; i < 10; ++i )
+		{
+		vals[i] = i;
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	unsigned int before = dict.MemoryAllocation();
+	dict.Reserve(vals.size());
+	CHECK(dict.MemoryAllocation() > before);
+	CHECK(dict.Length() == 10);
+
+	for ( uint32_t i = 10; i < vals.size(); ++i )
+		{
+		vals[i] = i;
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	for ( uint32_t i = 0; i < vals.size(); ++i )
+		{
+		HashKey key(i);
+		CHECK(dict.Lookup(&key) == &vals[i]);
+		}
+
+	CHECK(*dict.NthEntry(0) == 0);
+	CHECK(*dict.NthEntry(4999) == 4999);
+
+	dict.Clear();
+	dict.Reserve(100);
+	CHECK(dict.Length() == 0);
+
+	HashKey key(uint32_t(1));
+	dict.Insert(&key, &vals[1]);
+	CHECK(dict.Lookup(&key) == &vals[1]);
+	}
+
+TEST_CASE("dict lookup by hash")
+	{
+	zeek::PDict<uint32_t> dict;
+	std::vector<uint32_t> vals(1000);
+
+	for ( uint32_t i = 0; i < vals.size(); ++i )
+		{
+		vals[i] = i;
+		HashKey key(i);
+		dict.Insert(&key, &vals[i]);
+		}
+
+	for ( uint32_t i = 0; i < vals.size(); i += 100 )
+		{
+		HashKey key(i);
+		std::vector<zeek::Dictionary::HashMatch> matches;
+		dict.LookupHash(key.Hash(), &matches);
+
+		REQUIRE(matches.size() == 1);
+		CHECK(matches[0].value == &vals[i]);
+		CHECK(matches[0].key_size == key.Size());
+		CHECK(memcmp(matches[0].key, key.Key(), key.Size()) == 0);
+
+		dict.Remove(&key);
+		matches.clear();
+		dict.LookupHash(key.Hash(), &matches);
+		CHECK(matches.empty());
+		}
+	}
+
 TEST_SUITE_END();
 
 namespace zeek {
@@ -200,7 +449,7 @@ namespace zeek {
 Dictionary::Dictionary(DictOrder ordering, int initial_size)
 	{
 	if ( ordering == ORDERED )
-		order = new zeek::PList<detail::DictEntry>;
+		order = new std::vector<detail::DictEntry>;
 
 	if ( initial_size > 0 )
 		Init(initial_size);
@@ -215,191 +464,228 @@ Dictionary::~Dictionary()
 void Dictionary::Clear()
 	{
 	DeInit();
-	tbl = nullptr;
-	tbl2 = nullptr;
-	num_entries = 0;
-	num_entries2 = 0;
+
+	if ( order )
+		order->clear();
 	}
 
 void Dictionary::DeInit()
 	{
-	if ( ! tbl )
-		return;
+	DeInitTable(&tbl);
+	DeInitTable(&old);
+	old_next_slot = 0;
+	}
 
-	for ( int i = 0; i < num_buckets; ++i )
-		if ( tbl[i] )
-			{
-			zeek::PList<detail::DictEntry>* chain = tbl[i];
-			for ( const auto& e : *chain )
-				{
-				if ( delete_func )
-					delete_func(e->value);
-				delete e;
-				}
+void Dictionary::DeInitTable(Table* t)
+	{
+	for ( int i = 0; i < t->capacity; ++i )
+		{
+		detail::DictEntry& e = t->slots[i];
 
-			delete chain;
-			}
+		if ( e.state != detail::DictEntry::FULL )
+			continue;
 
-	delete [] tbl;
-	tbl = nullptr;
+		if ( delete_func )
+			delete_func(e.value);
 
-	if ( ! tbl2 )
-		return;
+		delete [] (char*) e.key;
+		}
 
-	for ( int i = 0; i < num_buckets2; ++i )
-		if ( tbl2[i] )
-			{
-			zeek::PList<detail::DictEntry>* chain = tbl2[i];
-			for ( const auto& e : *chain )
-				{
-				if ( delete_func )
-					delete_func(e->value);
-				delete e;
-				}
+	detail::delete_slots(t->slots, t->capacity);
+	*t = Table();
+	}
 
-			delete chain;
-			}
+detail::DictEntry* Dictionary::FindEntry(const Table& t, const void* key,
+                                         int key_size, hash_t hash) const
+	{
+	if ( ! t.num_entries )
+		return nullptr;
+
+	int mask = t.capacity - 1;
 
-	delete [] tbl2;
-	tbl2 = nullptr;
+	for ( int i = hash & mask; ; i = (i + 1) & mask )
+		{
+		detail::DictEntry& e = t.slots[i];
+
+		if ( e.state == detail::DictEntry::EMPTY )
+			return nullptr;
+
+		if ( e.Matches(key, key_size, hash) )
+			return &e;
+		}
 	}
 
-void* Dictionary::Lookup(const void* key, int key_size, hash_t hash) const
+detail::DictEntry* Dictionary::FindEntry(const void* key, int key_size,
+                                         hash_t hash) const
 	{
-	if ( ! tbl && ! tbl2 )
-		return nullptr;
+	if ( auto e = FindEntry(tbl, key, key_size, hash) )
+		return e;
+
+	return FindEntry(old, key, key_size, hash);
+	}
+
+int Dictionary::FindFreeSlot(const Table& t, hash_t hash) const
+	{
+	int mask = t.capacity - 1;
+	int i = hash & mask;
 
-	hash_t h;
-	zeek::PList<detail::DictEntry>* chain;
+	while ( t.slots[i].state == detail::DictEntry::FULL )
+		i = (i + 1) & mask;
 
-	// Figure out which hash table to look in.
-	h = hash % num_buckets;
-	if ( ! tbl2 || h >= tbl_next_ind )
-		chain = tbl[h];
-	else
-		chain = tbl2[hash % num_buckets2];
+	return i;
+	}
 
-	if ( chain )
+void* Dictionary::Lookup(const void* key, int key_size, hash_t hash) const
+	{
+	auto e = FindEntry(key, key_size, hash);
+	return e ? e->value : nullptr;
+	}
+
+void Dictionary::LookupHash(hash_t hash, std::vector<HashMatch>* matches) const
+	{
+	for ( const Table* t : {&tbl, &old} )
 		{
-		for ( const auto& entry : *chain )
+		if ( ! t->num_entries )
+			continue;
+
+		int mask = t->capacity - 1;
+
+		for ( int i = hash & mask; ; i = (i + 1) & mask )
 			{
-			if ( entry->hash == hash && entry->len == key_size &&
-			     ! memcmp(key, entry->key, key_size) )
-				return entry->value;
+			const detail::DictEntry& e = t->slots[i];
+
+			if ( e.state == detail::DictEntry::EMPTY )
+				break;
+
+			if ( e.state == detail::DictEntry::FULL && e.hash == hash )
+				matches->push_back({e.key, e.len, e.value});
 			}
 		}
-
-	return nullptr;
 	}
 
 void* Dictionary::Insert(void* key, int key_size, hash_t hash, void* val,
 				bool copy_key)
 	{
-	if ( ! tbl )
+	if ( ! tbl.slots )
 		Init(DEFAULT_DICT_SIZE);
 
-	detail::DictEntry* new_entry = new detail::DictEntry(key, key_size, hash, val);
-	void* old_val = Insert(new_entry, copy_key);
-
-	if ( old_val )
+	if ( auto e = FindEntry(key, key_size, hash) )
 		{
-		// We didn't need the new detail::DictEntry, the key was already
-		// present.
-		delete new_entry;
+		// The key is present already, so we don't need the new copy.
+		void* old_val = e->value;
+		e->value = val;
+		delete [] (char*) key;
+		return old_val;
 		}
-	else if ( order )
-		order->push_back(new_entry);
 
-	// Resize logic.
-	if ( tbl2 )
-		MoveChains();
-	else if ( num_entries >= thresh_entries )
-		StartChangeSize(num_buckets * 2 + 1);
+	if ( copy_key )
+		{
+		void* old_key = key;
+		key = (void*) new char[key_size];
+		memcpy(key, old_key, key_size);
+		delete [] (char*) old_key;
+		}
 
-	return old_val;
+	AddEntry(key, key_size, hash, val);
+	return nullptr;
 	}
 
-void* Dictionary::Remove(const void* key, int key_size, hash_t hash,
-				bool dont_delete)
+void* Dictionary::InsertCopy(const void* key, int key_size, hash_t hash, void* val)
 	{
-	if ( ! tbl && ! tbl2 )
-		return nullptr;
-
-	hash_t h;
-	zeek::PList<detail::DictEntry>* chain;
-	int* num_entries_ptr;
+	if ( ! tbl.slots )
+		Init(DEFAULT_DICT_SIZE);
 
-	// Figure out which hash table to look in
-	h = hash % num_buckets;
-	if ( ! tbl2 || h >= tbl_next_ind )
-		{
-		chain = tbl[h];
-		num_entries_ptr = &num_entries;
-		}
-	else
+	if ( auto e = FindEntry(key, key_size, hash) )
 		{
-		chain = tbl2[hash % num_buckets2];
-		num_entries_ptr = &num_entries2;
+		void* old_val = e->value;
+		e->value = val;
+		return old_val;
 		}
 
-	if ( ! chain )
-		return nullptr;
+	auto new_key = new char[key_size];
+	memcpy(new_key, key, key_size);
+	AddEntry(new_key, key_size, hash, val);
+	return nullptr;
+	}
 
-	size_t chain_length = chain->length();
+void Dictionary::AddEntry(void* key, int key_size, hash_t hash, void* val)
+	{
+	if ( tbl.num_entries + tbl.num_deleted >= max_load(tbl.capacity) )
+		StartResize();
 
-	for ( auto i = 0u; i < chain_length; ++i )
-		{
-		detail::DictEntry* entry = (*chain)[i];
+	int slot = FindFreeSlot(tbl, hash);
+	detail::DictEntry& e = tbl.slots[slot];
 
-		if ( entry->hash == hash && entry->len == key_size &&
-		     ! memcmp(key, entry->key, key_size) )
-			{
-			void* entry_value = DoRemove(entry, h, chain, i);
+	if ( e.state == detail::DictEntry::DELETED )
+		--tbl.num_deleted;
 
-			if ( dont_delete )
-				entry->key = nullptr;
+	e.key = key;
+	e.len = key_size;
+	e.hash = hash;
+	e.value = val;
+	e.state = detail::DictEntry::FULL;
+	++tbl.num_entries;
 
-			delete entry;
-			--*num_entries_ptr;
-			return entry_value;
-			}
+	if ( order )
+		order->push_back(e);
+
+	++cumulative_entries;
+	if ( max_num_entries < Length() )
+		max_num_entries = Length();
+
+	// For ongoing iterations: If we already passed the slot where this
+	// entry was put, remember it in the cookie.
+	for ( const auto& c : cookies )
+		{
+		if ( Visited(c, &tbl, slot) )
+			c->inserted.push_back({hash, std::string((const char*) key, key_size)});
 		}
 
-	return nullptr;
+	MoveEntries(RESIZE_STEP);
 	}
 
-void* Dictionary::DoRemove(detail::DictEntry* entry, hash_t h,
-				zeek::PList<detail::DictEntry>* chain, int chain_offset)
+void* Dictionary::Remove(const void* key, int key_size, hash_t hash,
+				bool dont_delete)
 	{
-	void* entry_value = entry->value;
+	Table* t = &tbl;
+	detail::DictEntry* e = FindEntry(tbl, key, key_size, hash);
 
-	chain->remove_nth(chain_offset);
-	if ( order )
-		order->remove(entry);
+	if ( ! e )
+		{
+		t = &old;
+		e = FindEntry(old, key, key_size, hash);
+		}
 
-	// Adjust existing cookies.
-	for ( const auto& c : cookies )
+	if ( ! e )
+		return nullptr;
+
+	void* entry_value = e->value;
+
+	if ( order )
 		{
-		// Is the affected bucket the current one?
-		if ( (unsigned int) c->bucket == h )
+		for ( auto it = order->begin(); it != order->end(); ++it )
 			{
-			if ( c->offset > chain_offset )
-				--c->offset;
-
-			// The only other important case here occurs when we
-			// are deleting the current entry which
-			// simultaniously happens to be the last one in this
-			// bucket. This means that we would have to move on
-			// to the next non-empty bucket. Fortunately,
-			// NextEntry() will do exactly the right thing in
-			// this case. :-)
+			if ( it->key == e->key )
+				{
+				order->erase(it);
+				break;
+				}
 			}
-
-		// This item may have been inserted during this iteration.
-		if ( (unsigned int) c->bucket > h )
-			c->inserted.remove(entry);
 		}
 
+	if ( ! dont_delete )
+		delete [] (char*) e->key;
+
+	// Leave a tombstone, so that entries behind it remain reachable and
+	// ongoing iterations don't see any entries moving. Cookies that
+	// remember the entry as inserted will skip it once they get to it.
+	*e = detail::DictEntry();
+	e->state = detail::DictEntry::DELETED;
+	--t->num_entries;
+	++t->num_deleted;
+
+	MoveEntries(RESIZE_STEP);
+
 	return entry_value;
 	}
 
@@ -408,353 +694,288 @@ void* Dictionary::NthEntry(int n, const void*& key, int& key_len) const
 	if ( ! order || n < 0 || n >= Length() )
 		return nullptr;
 
-	detail::DictEntry* entry = (*order)[n];
-	key = entry->key;
-	key_len = entry->len;
-	return entry->value;
+	const detail::DictEntry& entry = (*order)[n];
+	key = entry.key;
+	key_len = entry.len;
+	return Lookup(entry.key, entry.len, entry.hash);
 	}
 
 IterCookie* Dictionary::InitForIteration() const
 	{
-	return new IterCookie(0, 0);
+	return new IterCookie();
 	}
 
 void Dictionary::StopIteration(IterCookie* cookie) const
 	{
+	const_cast<zeek::PList<IterCookie>*>(&cookies)->remove(cookie);
 	delete cookie;
 	}
 
 void* Dictionary::NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) const
 	{
-	if ( ! tbl && ! tbl2 )
-		{
-		const_cast<zeek::PList<IterCookie>*>(&cookies)->remove(cookie);
-		delete cookie;
-		cookie = nullptr;
+	auto e = NextDictEntry(cookie);
+
+	if ( ! e )
 		return nullptr;
-		}
 
-	// If there are any inserted entries, return them first.
-	// That keeps the list small and helps avoiding searching
-	// a large list when deleting an entry.
+	if ( return_hash )
+		h = new HashKey(e->key, e->len, e->hash);
 
-	detail::DictEntry* entry;
+	return e->value;
+	}
 
-	if ( cookie->inserted.length() )
-		{
-		// Return the last one. Order doesn't matter,
-		// and removing from the tail is cheaper.
-		entry = cookie->inserted.remove_nth(cookie->inserted.length()-1);
-		if ( return_hash )
-			h = new HashKey(entry->key, entry->len, entry->hash);
+void* Dictionary::NextEntry(const void*& key, int& key_size, IterCookie*& cookie) const
+	{
+	auto e = NextDictEntry(cookie);
 
-		return entry->value;
-		}
+	if ( ! e )
+		return nullptr;
 
-	int b = cookie->bucket;
-	int o = cookie->offset;
-	zeek::PList<detail::DictEntry>** ttbl;
-	const int* num_buckets_p;
+	key = e->key;
+	key_size = e->len;
+	return e->value;
+	}
 
-	if ( ! cookie->ttbl )
+const detail::DictEntry* Dictionary::NextDictEntry(IterCookie*& cookie) const
+	{
+	// If there are any inserted entries, return them first.
+	// That keeps the list small.
+	while ( ! cookie->inserted.empty() )
 		{
-		// XXX maybe we could update cookie->b from tbl_next_ind here?
-		cookie->ttbl = tbl;
-		cookie->num_buckets_p = &num_buckets;
-		}
+		IterCookie::InsertedKey k = std::move(cookie->inserted.back());
+		cookie->inserted.pop_back();
 
-	ttbl = cookie->ttbl;
-	num_buckets_p = cookie->num_buckets_p;
+		auto e = FindEntry(k.key.data(), k.key.size(), k.hash);
 
-	if ( ttbl[b] && ttbl[b]->length() > o )
-		{
-		entry = (*ttbl[b])[o];
-		++cookie->offset;
-		if ( return_hash )
-			h = new HashKey(entry->key, entry->len, entry->hash);
-		return entry->value;
-		}
+		if ( ! e )
+			// Removed in the meantime.
+			continue;
 
-	++b;	// Move on to next non-empty bucket.
-	while ( b < *num_buckets_p && (! ttbl[b] || ttbl[b]->length() == 0) )
-		++b;
+		return e;
+		}
 
-	if ( b >= *num_buckets_p )
+	while ( cookie->table != IterCookie::DONE )
 		{
-		// If we're resizing, we need to search the 2nd table too.
-		if ( ttbl == tbl && tbl2 )
+		const Table& t = cookie->table == IterCookie::OLD_TABLE ? old : tbl;
+
+		while ( cookie->slot < t.capacity )
 			{
-			cookie->ttbl = tbl2;
-			cookie->num_buckets_p = &num_buckets2;
-			cookie->bucket = 0;
-			cookie->offset = 0;
-			return Dictionary::NextEntry(h, cookie, return_hash);
-			}
+			const detail::DictEntry& e = t.slots[cookie->slot++];
 
-		// All done.
+			if ( e.state != detail::DictEntry::FULL )
+				continue;
 
-		// FIXME: I don't like removing the const here. But is there
-		// a better way?
-		const_cast<zeek::PList<IterCookie>*>(&cookies)->remove(cookie);
-		delete cookie;
-		cookie = nullptr;
-		return nullptr;
-		}
+			return &e;
+			}
 
-	entry = (*ttbl[b])[0];
-	if ( return_hash )
-		h = new HashKey(entry->key, entry->len, entry->hash);
+		++cookie->table;
+		cookie->slot = 0;
+		}
 
-	cookie->bucket = b;
-	cookie->offset = 1;
+	// All done.
 
-	return entry->value;
+	// FIXME: I don't like removing the const here. But is there
+	// a better way?
+	const_cast<zeek::PList<IterCookie>*>(&cookies)->remove(cookie);
+	delete cookie;
+	cookie = nullptr;
+	return nullptr;
 	}
 
-void Dictionary::Init(int size)
+bool Dictionary::Visited(const IterCookie* c, const Table* t, int slot) const
 	{
-	num_buckets = NextPrime(size);
-	tbl = new zeek::PList<detail::DictEntry>*[num_buckets];
+	if ( c->table == IterCookie::DONE )
+		return true;
 
-	for ( int i = 0; i < num_buckets; ++i )
-		tbl[i] = nullptr;
+	if ( t == &old )
+		return c->table == IterCookie::CURRENT_TABLE ||
+			(c->table == IterCookie::OLD_TABLE && slot < c->slot);
 
-	max_num_entries = num_entries = 0;
-	SetDensityThresh(DEFAULT_DENSITY_THRESH);
+	return c->table == IterCookie::CURRENT_TABLE && slot < c->slot;
 	}
 
-void Dictionary::Init2(int size)
+void Dictionary::Init(int size)
 	{
-	num_buckets2 = NextPrime(size);
-	tbl2 = new zeek::PList<detail::DictEntry>*[num_buckets2];
+	int capacity = DEFAULT_DICT_SIZE;
 
-	for ( int i = 0; i < num_buckets2; ++i )
-		tbl2[i] = nullptr;
+	while ( max_load(capacity) < size )
+		capacity *= 2;
 
-	max_num_entries2 = num_entries2 = 0;
+	tbl.slots = detail::new_slots(capacity);
+	tbl.capacity = capacity;
 	}
 
-// private
-void* Dictionary::Insert(detail::DictEntry* new_entry, bool copy_key)
+void Dictionary::Reserve(int size)
 	{
-	if ( ! tbl )
-		Init(DEFAULT_DICT_SIZE);
-
-	zeek::PList<detail::DictEntry>** ttbl;
-	int* num_entries_ptr;
-	int* max_num_entries_ptr;
-	hash_t h = new_entry->hash % num_buckets;
+	if ( order )
+		order->reserve(size);
 
-	// We must be careful when we are in the middle of resizing.
-	// If the new entry hashes to a bucket in the old table we
-	// haven't moved yet, we need to put it in the old table. If
-	// we didn't do it this way, we would sometimes have to
-	// search both tables which is probably more expensive.
+	int capacity = tbl.capacity ? tbl.capacity : DEFAULT_DICT_SIZE;
 
-	if ( ! tbl2 || h >= tbl_next_ind )
-		{
-		ttbl = tbl;
-		num_entries_ptr = &num_entries;
-		max_num_entries_ptr = &max_num_entries;
-		}
-	else
-		{
-		ttbl = tbl2;
-		h = new_entry->hash % num_buckets2;
-		num_entries_ptr = &num_entries2;
-		max_num_entries_ptr = &max_num_entries2;
-		}
+	while ( max_load(capacity) < size )
+		capacity *= 2;
 
-	zeek::PList<detail::DictEntry>* chain = ttbl[h];
+	if ( capacity == tbl.capacity )
+		return;
 
-	int n = new_entry->len;
+	// Moving everything right away, rather than a few entries with
+	// every insertion, as the caller is about to add many anyway.
+	Table new_tbl;
+	new_tbl.slots = detail::new_slots(capacity);
+	new_tbl.capacity = capacity;
+	FinishResize(&new_tbl);
+	}
 
-	if ( chain )
-		{
-		for ( int i = 0; i < chain->length(); ++i )
-			{
-			detail::DictEntry* entry = (*chain)[i];
+Dictionary::Table Dictionary::NewTable() const
+	{
+	// Size the new table so that it's at most half full with the
+	// current entries; tombstones don't carry over. That leaves room
+	// for enough insertions to move all entries over before it needs
+	// to be resized itself.
+	int capacity = tbl.capacity;
+
+	while ( capacity / 2 < Length() + 1 )
+		capacity *= 2;
+
+	Table new_tbl;
+	new_tbl.slots = detail::new_slots(capacity);
+	new_tbl.capacity = capacity;
+	return new_tbl;
+	}
 
-			if ( entry->hash == new_entry->hash &&
-			     entry->len == n &&
-			     ! memcmp(entry->key, new_entry->key, n) )
-				{
-				void* old_value = entry->value;
-				entry->value = new_entry->value;
-				return old_value;
-				}
-			}
-		}
-	else
-		// Create new chain.
-		chain = ttbl[h] = new zeek::PList<detail::DictEntry>;
+void Dictionary::StartResize()
+	{
+	Table new_tbl = NewTable();
 
-	// If we got this far, then we couldn't use an existing copy
-	// of the key, so make a new one if necessary.
-	if ( copy_key )
+	if ( old.slots )
 		{
-		void* old_key = new_entry->key;
-		new_entry->key = (void*) new char[n];
-		memcpy(new_entry->key, old_key, n);
-		delete (char*) old_key;
+		// We're still moving entries out of the previous old table,
+		// probably because an iteration kept us from doing so.
+		// Rather than juggling three tables, move everything into
+		// the new one right away.
+		FinishResize(&new_tbl);
+		return;
 		}
 
-	// We happen to know (:-() that appending is more efficient
-	// on lists than prepending.
-	chain->push_back(new_entry);
-
-	++cumulative_entries;
-	if ( *max_num_entries_ptr < ++*num_entries_ptr )
-		*max_num_entries_ptr = *num_entries_ptr;
+	old = tbl;
+	old_next_slot = 0;
+	tbl = new_tbl;
 
-	// For ongoing iterations: If we already passed the bucket where this
-	// entry was put, add it to the cookie's list of inserted entries.
+	// Cookies walking the current table now walk the old one.
 	for ( const auto& c : cookies )
 		{
-		if ( h < (unsigned int) c->bucket )
-			c->inserted.push_back(new_entry);
+		if ( c->table == IterCookie::CURRENT_TABLE )
+			c->table = IterCookie::OLD_TABLE;
 		}
-
-	return nullptr;
 	}
 
-int Dictionary::NextPrime(int n) const
+void Dictionary::MoveEntries(int num_slots)
 	{
-	if ( (n & 0x1) == 0 )
-		// Even.
-		++n;
-
-	if ( n > PRIME_THRESH )
-		// Too expensive to test for primality, just stick with it.
-		return n;
+	// Do not change the current distribution if there's an ongoing
+	// iteration.
+	if ( ! old.slots || ! cookies.empty() )
+		return;
 
-	while ( ! IsPrime(n) )
-		n += 2;
+	// Insertions while an iteration paused the moving may have left the
+	// new table without room for the rest of the old one. Then we move
+	// everything into a larger table right away.
+	if ( tbl.num_entries + tbl.num_deleted + old.num_entries >= max_load(tbl.capacity) )
+		{
+		Table new_tbl = NewTable();
+		FinishResize(&new_tbl);
+		return;
+		}
 
-	return n;
-	}
+	int end = std::min(old_next_slot + num_slots, old.capacity);
 
-bool Dictionary::IsPrime(int n) const
-	{
-	for ( int j = 3; j * j <= n; ++j )
-		if ( n % j == 0 )
-			return false;
+	for ( ; old_next_slot < end; ++old_next_slot )
+		{
+		detail::DictEntry& e = old.slots[old_next_slot];
 
-	return true;
-	}
+		if ( e.state != detail::DictEntry::FULL )
+			continue;
 
-void Dictionary::StartChangeSize(int new_size)
-	{
-	// Only start resizing if there isn't any iteration in progress.
-	if ( ! cookies.empty() )
-		return;
+		detail::DictEntry& new_e = tbl.slots[FindFreeSlot(tbl, e.hash)];
 
-	if ( tbl2 )
-		reporter->InternalError("Dictionary::StartChangeSize() tbl2 not NULL");
+		if ( new_e.state == detail::DictEntry::DELETED )
+			--tbl.num_deleted;
 
-	Init2(new_size);
+		new_e = e;
+		++tbl.num_entries;
+		--old.num_entries;
 
-	tbl_next_ind = 0;
+		e = detail::DictEntry();
+		e.state = detail::DictEntry::DELETED;
+		}
 
-	// Preserve threshold density
-	SetDensityThresh2(DensityThresh());
+	if ( old_next_slot >= old.capacity || old.num_entries == 0 )
+		{
+		detail::delete_slots(old.slots, old.capacity);
+		old = Table();
+		old_next_slot = 0;
+		}
 	}
 
-void Dictionary::MoveChains()
+void Dictionary::FinishResize(Table* new_tbl)
 	{
-	// Do not change current distribution if there an ongoing iteration.
-	if ( ! cookies.empty() )
-		return;
-
-	// Attempt to move this many entries (must do at least 2)
-	int num = 8;
-
-	do
+	// Ongoing iterations remember what they haven't visited yet, as all
+	// entries are going to move.
+	for ( const auto& c : cookies )
 		{
-		zeek::PList<detail::DictEntry>* chain = tbl[tbl_next_ind++];
-
-		if ( ! chain )
-			continue;
-
-		tbl[tbl_next_ind - 1] = nullptr;
-
-		for ( const auto& elem : *chain )
+		for ( const Table* t : { &old, &tbl } )
 			{
-			Insert(elem, false);
-			--num_entries;
-			--num;
+			for ( int i = 0; i < t->capacity; ++i )
+				{
+				const detail::DictEntry& e = t->slots[i];
+
+				if ( e.state == detail::DictEntry::FULL && ! Visited(c, t, i) )
+					c->inserted.push_back({e.hash, std::string((const char*) e.key, e.len)});
+				}
 			}
 
-		delete chain;
+		c->table = IterCookie::DONE;
 		}
-	while ( num > 0 && int(tbl_next_ind) < num_buckets );
 
-	if ( int(tbl_next_ind) >= num_buckets )
-		FinishChangeSize();
-	}
-
-void Dictionary::FinishChangeSize()
-	{
-	// Cheap safety check.
-	if ( num_entries != 0 )
-		reporter->InternalError(
-		    "Dictionary::FinishChangeSize: num_entries is %d\n",
-		    num_entries);
+	for ( Table* t : { &old, &tbl } )
+		{
+		for ( int i = 0; i < t->capacity; ++i )
+			{
+			const detail::DictEntry& e = t->slots[i];
 
-	for ( int i = 0; i < num_buckets; ++i )
-		delete tbl[i];
-	delete [] tbl;
+			if ( e.state != detail::DictEntry::FULL )
+				continue;
 
-	tbl = tbl2;
-	tbl2 = nullptr;
+			new_tbl->slots[FindFreeSlot(*new_tbl, e.hash)] = e;
+			++new_tbl->num_entries;
+			}
 
-	num_buckets = num_buckets2;
-	num_entries = num_entries2;
-	max_num_entries = max_num_entries2;
-	den_thresh = den_thresh2;
-	thresh_entries = thresh_entries2;
+		detail::delete_slots(t->slots, t->capacity);
+		*t = Table();
+		}
 
-	num_buckets2 = 0;
-	num_entries2 = 0;
-	max_num_entries2 = 0;
-	den_thresh2 = 0;
-	thresh_entries2 = 0;
+	tbl = *new_tbl;
+	old_next_slot = 0;
 	}
 
 unsigned int Dictionary::MemoryAllocation() const
 	{
-	int size = padded_sizeof(*this);
+	int size = padded_sizeof(*this) + TableAllocation();
 
-	if ( ! tbl )
-		return size;
+	for ( const Table* t : { &tbl, &old } )
+		for ( int i = 0; i < t->capacity; ++i )
+			if ( t->slots[i].state == detail::DictEntry::FULL )
+				size += pad_size(t->slots[i].len);
 
-	for ( int i = 0; i < num_buckets; ++i )
-		if ( tbl[i] )
-			{
-			zeek::PList<detail::DictEntry>* chain = tbl[i];
-			for ( const auto& c : *chain )
-				size += padded_sizeof(detail::DictEntry) + pad_size(c->len);
-			size += chain->MemoryAllocation();
-			}
+	return size;
+	}
 
-	size += pad_size(num_buckets * sizeof(zeek::PList<detail::DictEntry>*));
+unsigned int Dictionary::TableAllocation() const
+	{
+	int size = pad_size(tbl.capacity * sizeof(detail::DictEntry)) +
+		pad_size(old.capacity * sizeof(detail::DictEntry));
 
 	if ( order )
-		size += order->MemoryAllocation();
-
-	if ( tbl2 )
-		{
-		for ( int i = 0; i < num_buckets2; ++i )
-			if ( tbl2[i] )
-				{
-				zeek::PList<detail::DictEntry>* chain = tbl2[i];
-				for ( const auto& c : *chain )
-					size += padded_sizeof(detail::DictEntry) + pad_size(c->len);
-				size += chain->MemoryAllocation();
-				}
-
-		size += pad_size(num_buckets2 * sizeof(zeek::PList<detail::DictEntry>*));
-		}
+		size += pad_size(order->capacity() * sizeof(detail::DictEntry));
 
 	return size;
 	}
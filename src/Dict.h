@@ -4,6 +4,8 @@
 
 #include "zeek-config.h"
 
+#include <vector>
+
 #include "List.h"
 #include "Hash.h"
 
@@ -48,6 +50,23 @@ public:
 	void* Insert(void* key, int key_size, hash_t hash, void* val,
 			bool copy_key);
 
+	// Same, but leaves the key to the caller, copying it only if it's
+	// new. Returns previous value, or 0 if none.
+	void* InsertCopy(const void* key, int key_size, hash_t hash, void* val);
+
+	// An entry found by LookupHash(). The key belongs to the dictionary
+	// and stays valid until the entry gets removed.
+	struct HashMatch {
+		const void* key;
+		int key_size;
+		void* value;
+	};
+
+	// Appends all entries with the given (unmodulated) hash to matches.
+	// There's rarely more than one. This lets callers that keep track of
+	// entries by their hashes find their keys again.
+	void LookupHash(hash_t hash, std::vector<HashMatch>* matches) const;
+
 	// Removes the given element.  Returns a pointer to the element in
 	// case it needs to be deleted.  Returns 0 if no such element exists.
 	// If dontdelete is true, the key's bytes will not be deleted.
@@ -58,14 +77,11 @@ public:
 
 	// Number of entries.
 	int Length() const
-		{ return tbl2 ? num_entries + num_entries2 : num_entries; }
+		{ return tbl.num_entries + old.num_entries; }
 
 	// Largest it's ever been.
 	int MaxLength() const
-		{
-		return tbl2 ?
-			max_num_entries + max_num_entries2 : max_num_entries;
-		}
+		{ return max_num_entries; }
 
 	// Total number of entries ever.
 	uint64_t NumCumulativeInserts() const
@@ -99,12 +115,18 @@ public:
 	//
 	// Unexpected results will occur if the elements of
 	// the dictionary are changed between calls to NextEntry() without
-	// first calling InitForIteration().
+	// first calling InitForIteration(), unless the cookie is robust (see
+	// below).
 	//
 	// If return_hash is true, a HashKey for the entry is returned in h,
 	// which should be delete'd when no longer needed.
 	IterCookie* InitForIteration() const;
 	void* NextEntry(HashKey*& h, IterCookie*& cookie, int return_hash) const;
+
+	// Same, but returns the entry's key as the dictionary holds it
+	// rather than a copy. The key stays valid until the entry gets
+	// removed.
+	void* NextEntry(const void*& key, int& key_size, IterCookie*& cookie) const;
 	void StopIteration(IterCookie* cookie) const;
 
 	void SetDeleteFunc(dict_delete_func f)		{ delete_func = f; }
@@ -118,70 +140,78 @@ public:
 	void MakeRobustCookie(IterCookie* cookie)
 		{ cookies.push_back(cookie); }
 
+	int NumRobustCookies() const	{ return cookies.length(); }
+
 	// Remove all entries.
 	void Clear();
 
+	// Makes room for a total of the given number of entries, so that
+	// adding up to that many doesn't need to resize along the way.
+	void Reserve(int size);
+
 	unsigned int MemoryAllocation() const;
 
+	// The part of MemoryAllocation() taken by the slots, which unlike
+	// the rest doesn't need to look at the entries.
+	unsigned int TableAllocation() const;
+
 private:
+	// The entries live directly in an array of slots, which is searched
+	// with linear probing. Removed entries leave tombstones behind until
+	// the next resize, so that removals never move other entries.
+	struct Table {
+		zeek::detail::DictEntry* slots = nullptr;
+		int capacity = 0;	// always a power of two
+		int num_entries = 0;
+		int num_deleted = 0;
+	};
+
 	void Init(int size);
-	void Init2(int size);	// initialize second table for resizing
 	void DeInit();
+	void DeInitTable(Table* t);
 
-	// Internal version of Insert().
-	void* Insert(zeek::detail::DictEntry* entry, bool copy_key);
+	// Returns the slot holding the given key, or nullptr if there's none.
+	zeek::detail::DictEntry* FindEntry(const Table& t, const void* key,
+	                                   int key_size, hash_t hash) const;
+	zeek::detail::DictEntry* FindEntry(const void* key, int key_size,
+	                                   hash_t hash) const;
 
-	void* DoRemove(zeek::detail::DictEntry* entry, hash_t h,
-	               zeek::PList<zeek::detail::DictEntry>* chain, int chain_offset);
+	// Adds an entry for a key that isn't in the table yet, taking
+	// ownership of the key.
+	void AddEntry(void* key, int key_size, hash_t hash, void* val);
 
-	int NextPrime(int n) const;
-	bool IsPrime(int n) const;
-	void StartChangeSize(int new_size);
-	void FinishChangeSize();
-	void MoveChains();
+	// Returns the slot at which a key that isn't in the table yet goes.
+	int FindFreeSlot(const Table& t, hash_t hash) const;
 
-	// The following get and set the "density" threshold - if the
-	// average hash chain length exceeds this threshold, the
-	// table will be resized.  The default value is 3.0.
-	double DensityThresh() const	{ return den_thresh; }
+	// A resize allocates a new table, and then moves the entries from the
+	// old one over a few at a time with every modification. That pauses
+	// while there are robust cookies.
+	Table NewTable() const;
+	void StartResize();
+	void MoveEntries(int num_slots);
 
-	void SetDensityThresh(double thresh)
-		{
-		den_thresh = thresh;
-		thresh_entries = int(thresh * double(num_buckets));
-		}
-
-	// Same for the second table, when resizing.
-	void SetDensityThresh2(double thresh)
-		{
-		den_thresh2 = thresh;
-		thresh_entries2 = int(thresh * double(num_buckets2));
-		}
+	// Moves all entries of both tables into the given one, which then
+	// becomes the current table. Robust cookies remember the entries
+	// they haven't visited yet.
+	void FinishResize(Table* new_tbl);
 
-	// Normally we only have tbl.
-	// When we're resizing, we'll have tbl (old) and tbl2 (new)
-	// tbl_next_ind keeps track of how much we've moved to tbl2
-	// (it's the next index we're going to move).
-	zeek::PList<zeek::detail::DictEntry>** tbl = nullptr;
-	int num_buckets = 0;
-	int num_entries = 0;
-	int max_num_entries = 0;
-	int thresh_entries = 0;
-	uint64_t cumulative_entries = 0;
-	double den_thresh = 0.0;
+	bool Visited(const IterCookie* c, const Table* t, int slot) const;
 
-	// Resizing table (replicates tbl above).
-	zeek::PList<zeek::detail::DictEntry>** tbl2 = nullptr;
-	int num_buckets2 = 0;
-	int num_entries2 = 0;
-	int max_num_entries2 = 0;
+	// Returns the next entry of an iteration, or nullptr when done,
+	// deleting the cookie then.
+	const zeek::detail::DictEntry* NextDictEntry(IterCookie*& cookie) const;
 
-	int thresh_entries2 = 0;
-	double den_thresh2 = 0;
+	// The current table, and the one we're moving entries out of while
+	// resizing. Lookups need to check both.
+	Table tbl;
+	Table old;
+	int old_next_slot = 0;	// next slot of old to move
 
-	hash_t tbl_next_ind = 0;
+	int max_num_entries = 0;
+	uint64_t cumulative_entries = 0;
 
-	zeek::PList<zeek::detail::DictEntry>* order = nullptr;
+	// For ordered dictionaries, the keys in order of insertion.
+	std::vector<zeek::detail::DictEntry>* order = nullptr;
 	dict_delete_func delete_func = nullptr;
 
 	zeek::PList<IterCookie> cookies;
@@ -220,6 +250,8 @@ public:
 		}
 	T* NextEntry(HashKey*& h, IterCookie*& cookie) const
 		{ return (T*) Dictionary::NextEntry(h, cookie, 1); }
+	T* NextEntry(const void*& key, int& key_size, IterCookie*& cookie) const
+		{ return (T*) Dictionary::NextEntry(key, key_size, cookie); }
 	T* RemoveEntry(const HashKey* key)
 		{ return (T*) Remove(key->Key(), key->Size(), key->Hash()); }
 	T* RemoveEntry(const HashKey& key)
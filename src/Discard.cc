@@ -22,6 +22,68 @@ Discarder::Discarder()
 	check_icmp = zeek::id::find_func("discarder_check_icmp");
 
 	discarder_maxlen = static_cast<int>(zeek::id::find_val("discarder_maxlen")->AsCount());
+
+	CompileRules();
+	}
+
+void Discarder::CompileRules()
+	{
+	const auto& rule_vals = zeek::id::find_val<zeek::VectorVal>("discarder_rules");
+
+	for ( unsigned int i = 0; i < rule_vals->Size(); ++i )
+		{
+		const auto& rv = rule_vals->At(i);
+
+		if ( ! rv )
+			continue;
+
+		auto r = rv->AsRecordVal();
+		Rule rule;
+
+		const auto& src = r->GetField("src");
+		rule.has_src = src != nullptr;
+		if ( src )
+			rule.src = src->AsSubNet();
+
+		const auto& dst = r->GetField("dst");
+		rule.has_dst = dst != nullptr;
+		if ( dst )
+			rule.dst = dst->AsSubNet();
+
+		rule.proto = -1;
+		rule.src_port = -1;
+		rule.dst_port = -1;
+
+		for ( auto p : {"src_p", "dst_p"} )
+			{
+			const auto& pv = r->GetField(p);
+
+			if ( ! pv )
+				continue;
+
+			auto port = pv->AsPortVal();
+			int proto = port->IsTCP() ? IPPROTO_TCP :
+			            (port->IsUDP() ? IPPROTO_UDP :
+			             (port->IsICMP() ? IPPROTO_ICMP : IPPROTO_RAW));
+
+			if ( rule.proto >= 0 && rule.proto != proto )
+				// Can't match anything, as with a BPF filter.
+				proto = IPPROTO_RAW;
+
+			rule.proto = proto;
+
+			if ( p[0] == 's' )
+				rule.src_port = port->Port();
+			else
+				rule.dst_port = port->Port();
+			}
+
+		rule.tcp_flags = r->GetFieldOrDefault("tcp_flags")->AsCount();
+
+		rule.probability = r->GetFieldOrDefault("probability")->AsDouble();
+
+		rules.push_back(rule);
+		}
 	}
 
 Discarder::~Discarder()
@@ -30,13 +92,106 @@ Discarder::~Discarder()
 
 bool Discarder::IsActive()
 	{
-	return check_ip || check_tcp || check_udp || check_icmp;
+	return check_ip || check_tcp || check_udp || check_icmp || ! rules.empty();
+	}
+
+bool Discarder::MatchRules(const IP_Hdr* ip, int len, int caplen)
+	{
+	IPAddr src = ip->SrcAddr();
+	IPAddr dst = ip->DstAddr();
+
+	// The transport header, if there's a complete one. Fragments other
+	// than the first one only match rules without ports.
+	int proto = ip->NextProto();
+
+	if ( proto == IPPROTO_ICMPV6 )
+		proto = IPPROTO_ICMP;
+
+	int src_port = -1;
+	int dst_port = -1;
+	uint32_t tcp_flags = 0;
+
+	int ip_hdr_len = ip->HdrLen();
+	len -= ip_hdr_len;
+	caplen -= ip_hdr_len;
+	const u_char* data = ip->Payload();
+
+	if ( ip->FragOffset() == 0 )
+		{
+		switch ( proto ) {
+		case IPPROTO_TCP:
+			if ( len >= static_cast<int>(sizeof(struct tcphdr)) &&
+			     caplen >= static_cast<int>(sizeof(struct tcphdr)) )
+				{
+				const struct tcphdr* tp = (const struct tcphdr*) data;
+				src_port = ntohs(tp->th_sport);
+				dst_port = ntohs(tp->th_dport);
+				tcp_flags = tp->th_flags;
+				}
+			break;
+
+		case IPPROTO_UDP:
+			if ( len >= static_cast<int>(sizeof(struct udphdr)) &&
+			     caplen >= static_cast<int>(sizeof(struct udphdr)) )
+				{
+				const struct udphdr* up = (const struct udphdr*) data;
+				src_port = ntohs(up->uh_sport);
+				dst_port = ntohs(up->uh_dport);
+				}
+			break;
+
+		case IPPROTO_ICMP:
+			// Like for connections, the type and the code take the
+			// place of the ports.
+			if ( len >= 2 && caplen >= 2 )
+				{
+				src_port = data[0];
+				dst_port = data[1];
+				}
+			break;
+		}
+		}
+
+	for ( const auto& r : rules )
+		{
+		if ( r.has_src && ! r.src.Contains(src) )
+			continue;
+
+		if ( r.has_dst && ! r.dst.Contains(dst) )
+			continue;
+
+		if ( r.proto >= 0 )
+			{
+			if ( r.proto != proto || src_port < 0 )
+				continue;
+
+			if ( r.src_port >= 0 && r.src_port != src_port )
+				continue;
+
+			if ( r.dst_port >= 0 && r.dst_port != dst_port )
+				continue;
+			}
+
+		if ( r.tcp_flags && proto == IPPROTO_TCP &&
+		     (src_port < 0 || (tcp_flags & r.tcp_flags)) )
+			// At least one of the flags is set (or we can't tell),
+			// so don't drop.
+			continue;
+
+		return r.probability >= 1.0 ||
+		       zeek::random_number() < r.probability * static_cast<double>(zeek::max_random());
+		}
+
+	return false;
 	}
 
 bool Discarder::NextPacket(const IP_Hdr* ip, int len, int caplen)
 	{
 	bool discard_packet = false;
 
+	if ( ! rules.empty() && MatchRules(ip, len, caplen) )
+		return true;
+
 	if ( check_ip )
 		{
 		zeek::Args args{ip->ToPktHdrVal()};
@@ -4,7 +4,10 @@
 
 #include <sys/types.h> // for u_char
 
+#include <vector>
+
 #include "IntrusivePtr.h"
+#include "IPAddr.h"
 
 class IP_Hdr;
 
@@ -25,6 +28,25 @@ public:
 	bool NextPacket(const IP_Hdr* ip, int len, int caplen);
 
 protected:
+	// A compiled entry of the discarder_rules script variable.
+	struct Rule {
+		bool has_src;
+		IPPrefix src;
+		bool has_dst;
+		IPPrefix dst;
+		int proto;	// IPPROTO_* the ports apply to, or -1 for any
+		int src_port;	// -1 for any
+		int dst_port;	// -1 for any
+		uint32_t tcp_flags;
+		double probability;
+	};
+
+	void CompileRules();
+
+	// Returns true if the first rule matching the packet says to
+	// discard it.
+	bool MatchRules(const IP_Hdr* ip, int len, int caplen);
+
 	zeek::Val* BuildData(const u_char* data, int hdrlen, int len, int caplen);
 
 	zeek::FuncPtr check_ip;
@@ -32,6 +54,8 @@ protected:
 	zeek::FuncPtr check_udp;
 	zeek::FuncPtr check_icmp;
 
+	std::vector<Rule> rules;
+
 	// Maximum amount of application data passed to filtering functions.
 	int discarder_maxlen;
 };
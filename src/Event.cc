@@ -3,6 +3,8 @@
 #include "zeek-config.h"
 
 #include "Event.h"
+#include "EventTrace.h"
+#include "MemoryArena.h"
 #include "Desc.h"
 #include "Func.h"
 #include "NetVar.h"
@@ -18,6 +20,60 @@ EventMgr mgr;
 uint64_t num_events_queued = 0;
 uint64_t num_events_dispatched = 0;
 
+// Maximum number of released events kept for reuse once a drain cycle
+// finishes.
+static constexpr size_t MAX_POOLED_EVENTS = 4096;
+
+namespace {
+
+struct PooledEvent {
+	PooledEvent* next;
+};
+
+PooledEvent* event_pool = nullptr;
+size_t event_pool_size = 0;
+
+}
+
+void* Event::operator new(size_t size)
+	{
+	if ( size != sizeof(Event) || ! event_pool )
+		return zeek::detail::arena_alloc(zeek::detail::MemoryArena::Transient, size);
+
+	PooledEvent* e = event_pool;
+	event_pool = e->next;
+	--event_pool_size;
+	return e;
+	}
+
+void Event::operator delete(void* ptr, size_t size)
+	{
+	if ( ! ptr )
+		return;
+
+	if ( size != sizeof(Event) )
+		{
+		zeek::detail::arena_free(zeek::detail::MemoryArena::Transient, ptr, size);
+		return;
+		}
+
+	auto e = static_cast<PooledEvent*>(ptr);
+	e->next = event_pool;
+	event_pool = e;
+	++event_pool_size;
+	}
+
+void Event::TrimPool(size_t max_keep)
+	{
+	while ( event_pool_size > max_keep )
+		{
+		PooledEvent* e = event_pool;
+		event_pool = e->next;
+		--event_pool_size;
+		zeek::detail::arena_free(zeek::detail::MemoryArena::Transient, e, sizeof(Event));
+		}
+	}
+
 Event::Event(EventHandlerPtr arg_handler, zeek::Args arg_args,
              SourceID arg_src, analyzer::ID arg_aid, Obj* arg_obj)
 	: handler(arg_handler),
@@ -124,6 +180,11 @@ void EventMgr::QueueEvent(const EventHandlerPtr &h, val_list* vl,
 void EventMgr::Enqueue(const EventHandlerPtr& h, zeek::Args vl,
                        SourceID src, analyzer::ID aid, Obj* obj)
 	{
+	// Handler bodies may have declared that they don't care about
+	// these arguments, in which case there's no need for the event.
+	if ( h.operator->() && ! h->WantsArgs(vl) )
+		return;
+
 	QueueEvent(new Event(h, std::move(vl), src, aid, obj));
 	}
 
@@ -134,6 +195,9 @@ void EventMgr::QueueEvent(Event* event)
 	if ( done )
 		return;
 
+	if ( zeek::detail::event_trace_recorder )
+		zeek::detail::event_trace_recorder->Record(event);
+
 	if ( ! head )
 		{
 		head = tail = event;
@@ -155,7 +219,7 @@ void EventMgr::Dispatch(Event* event, bool no_remote)
 	Unref(event);
 	}
 
-void EventMgr::Drain()
+void EventMgr::Drain(bool bounded)
 	{
 	if ( event_queue_flush_point )
 		Enqueue(event_queue_flush_point, zeek::Args{});
@@ -166,6 +230,15 @@ void EventMgr::Drain()
 
 	draining = true;
 
+	bounded = bounded && (max_remote_events_per_drain > 0 ||
+	                      max_remote_drain_time > 0);
+	double deadline = bounded && max_remote_drain_time > 0 ?
+		current_time() + max_remote_drain_time : 0;
+	int remote_dispatched = 0;
+	bool over_budget = false;
+	Event* deferred_head = nullptr;
+	Event* deferred_tail = nullptr;
+
 	// Past Bro versions drained as long as there events, including when
 	// a handler queued new events during its execution. This could lead
 	// to endless loops in case a handler kept triggering its own event.
@@ -183,6 +256,23 @@ void EventMgr::Drain()
 			{
 			Event* next = current->NextEvent();
 
+			if ( over_budget && current->Source() == SOURCE_BROKER )
+				{
+				// Keep it, in order, for the next drain.
+				current->SetNext(nullptr);
+
+				if ( deferred_tail )
+					deferred_tail->SetNext(current);
+				else
+					deferred_head = current;
+
+				deferred_tail = current;
+				current = next;
+				continue;
+				}
+
+			bool remote = current->Source() == SOURCE_BROKER;
+
 			current_src = current->Source();
 			current_aid = current->Analyzer();
 			current->Dispatch();
@@ -190,13 +280,41 @@ void EventMgr::Drain()
 
 			++num_events_dispatched;
 			current = next;
+
+			if ( bounded && ! over_budget )
+				{
+				if ( remote )
+					++remote_dispatched;
+
+				over_budget =
+					(max_remote_events_per_drain > 0 &&
+					 remote_dispatched >= max_remote_events_per_drain) ||
+					(deadline > 0 && current_time() > deadline);
+				}
 			}
 		}
 
+	if ( deferred_head )
+		{
+		// The deferred events go ahead of whatever got queued since.
+		deferred_tail->SetNext(head);
+		head = deferred_head;
+
+		if ( ! tail )
+			tail = deferred_tail;
+
+		// Make sure the main loop comes back to them.
+		queue_flare.Fire();
+		}
+
 	// Note: we might eventually need a general way to specify things to
 	// do after draining events.
 	draining = false;
 
+	// Release what a burst of events left in the pool beyond what
+	// regular operation needs.
+	Event::TrimPool(MAX_POOLED_EVENTS);
+
 	// Make sure all of the triggers get processed every time the events
 	// drain.
 	trigger_mgr->Process();
@@ -223,8 +341,10 @@ void EventMgr::Process()
 	// If we don't have a source, or the source is closed, or we're
 	// reading live (which includes pseudo-realtime), advance the time
 	// here to the current time since otherwise it won't move forward.
+	// When replaying events, they carry the time along instead.
 	iosource::PktSrc* pkt_src = iosource_mgr->GetPktSrc();
-	if ( ! pkt_src || ! pkt_src->IsOpen() || reading_live )
+	if ( (! pkt_src || ! pkt_src->IsOpen() || reading_live) &&
+	     ! zeek::detail::event_trace_replayer )
 		net_update_time(current_time());
 
 	queue_flare.Extinguish();
@@ -30,6 +30,17 @@ public:
 
 	void Describe(ODesc* d) const override;
 
+	// Events are allocated from a free list of previously released
+	// ones, as they're created and destroyed at very high rates.
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
+	/**
+	 * Returns memory held by the free list to the system, keeping at
+	 * most the given number of events for reuse.
+	 */
+	static void TrimPool(size_t max_keep);
+
 protected:
 	friend class EventMgr;
 
@@ -114,7 +125,10 @@ public:
 
 	void Dispatch(Event* event, bool no_remote = false);
 
-	void Drain();
+	// Dispatches the queued events.  If *bounded*, remote events in
+	// excess of max_remote_events_per_drain or max_remote_drain_time
+	// remain queued for a later call, ahead of newer events.
+	void Drain(bool bounded = false);
 	bool IsDraining() const	{ return draining; }
 
 	bool HasEvents() const	{ return head != nullptr; }
@@ -0,0 +1,178 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "EventFilter.h"
+
+#include <algorithm>
+
+#include "Attr.h"
+#include "Conn.h"
+#include "Expr.h"
+#include "Type.h"
+#include "Val.h"
+#include "analyzer/Manager.h"
+
+namespace zeek::detail {
+
+// Returns the values of an attribute that takes either a single value of
+// the given type or a set of them, or an empty list after reporting an
+// error.
+static std::vector<ValPtr> attr_values(const Attr* a, const ValPtr& v,
+                                       zeek::TypeTag t, const char* what)
+	{
+	std::vector<ValPtr> vals;
+	const auto& vt = v->GetType();
+
+	if ( vt->Tag() == t )
+		vals.emplace_back(v);
+
+	else if ( vt->IsSet() && vt->AsTableType()->GetIndexTypes().size() == 1 &&
+	          vt->AsTableType()->GetIndexTypes()[0]->Tag() == t )
+		{
+		auto lv = v->AsTableVal()->ToPureListVal();
+
+		for ( int i = 0; i < lv->Length(); ++i )
+			vals.emplace_back(lv->Idx(i));
+		}
+
+	else
+		a->Error(fmt("%s requires a %s or a set of them", attr_name(a->Tag()), what));
+
+	return vals;
+	}
+
+EventFilterPtr EventFilter::Build(const std::vector<AttrPtr>& attrs,
+                                  const zeek::FuncType* ft)
+	{
+	EventFilterPtr f;
+
+	for ( const auto& a : attrs )
+		{
+		auto tag = a->Tag();
+
+		if ( tag != ATTR_IF_FIELD && tag != ATTR_IF_PORT && tag != ATTR_IF_ANALYZER )
+			continue;
+
+		if ( ft->Flavor() != FUNC_FLAVOR_EVENT )
+			{
+			a->Error(fmt("%s only applicable to event bodies", attr_name(tag)));
+			continue;
+			}
+
+		const auto& params = ft->Params();
+
+		if ( params->NumFields() == 0 ||
+		     params->GetFieldType(0)->GetName() != "connection" )
+			{
+			a->Error(fmt("%s requires the event's first parameter to be a connection",
+			             attr_name(tag)));
+			continue;
+			}
+
+		auto v = a->GetExpr()->Eval(nullptr);
+
+		if ( ! v )
+			{
+			a->Error("cannot evaluate attribute expression");
+			continue;
+			}
+
+		if ( ! f )
+			f = std::make_shared<EventFilter>();
+
+		switch ( tag ) {
+		case ATTR_IF_FIELD:
+			{
+			if ( v->GetType()->Tag() != TYPE_STRING )
+				{
+				a->Error("&if_field requires the name of a connection field");
+				break;
+				}
+
+			auto rt = params->GetFieldType(0)->AsRecordType();
+			auto name = v->AsStringVal()->CheckString();
+			int offset = rt->FieldOffset(name);
+
+			if ( offset < 0 )
+				{
+				a->Error(fmt("connection has no field '%s'", name));
+				break;
+				}
+
+			f->fields.push_back(offset);
+			}
+			break;
+
+		case ATTR_IF_PORT:
+			for ( const auto& p : attr_values(a.get(), v, TYPE_PORT, "port") )
+				f->ports.push_back(p->InternalUnsigned());
+			break;
+
+		case ATTR_IF_ANALYZER:
+			for ( const auto& e : attr_values(a.get(), v, TYPE_ENUM, "Analyzer::Tag") )
+				{
+				auto atag = analyzer_mgr->GetComponentTag(e.get());
+
+				if ( ! atag )
+					{
+					a->Error("&if_analyzer requires an analyzer tag");
+					break;
+					}
+
+				f->analyzers.push_back(atag);
+				}
+			break;
+
+		default:
+			break;
+		}
+		}
+
+	return f;
+	}
+
+bool EventFilter::Accepts(const zeek::Args& args) const
+	{
+	if ( args.empty() || ! args[0] )
+		return true;
+
+	auto c = args[0]->AsRecordVal();
+
+	for ( auto field : fields )
+		if ( ! c->GetField(field) )
+			return false;
+
+	if ( ! ports.empty() )
+		{
+		// $id$resp_p, at the same offsets that Connection::ConnVal()
+		// uses.
+		const auto& id = c->GetField(0);
+
+		if ( id )
+			{
+			const auto& resp_p = id->AsRecordVal()->GetField(3);
+
+			if ( resp_p &&
+			     std::find(ports.begin(), ports.end(),
+			               resp_p->InternalUnsigned()) == ports.end() )
+				return false;
+			}
+		}
+
+	if ( ! analyzers.empty() )
+		{
+		// Records that scripts build themselves don't belong to a
+		// connection, so there's nothing to check them against.
+		auto conn = dynamic_cast<Connection*>(c->GetOrigin());
+
+		if ( conn &&
+		     std::none_of(analyzers.begin(), analyzers.end(),
+		                  [conn](const analyzer::Tag& t)
+		                  { return conn->FindAnalyzer(t) != nullptr; }) )
+			return false;
+		}
+
+	return true;
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,66 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "IntrusivePtr.h"
+#include "ZeekArgs.h"
+#include "analyzer/Tag.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(Attr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(FuncType, zeek);
+
+namespace zeek::detail {
+
+using AttrPtr = zeek::IntrusivePtr<Attr>;
+
+class EventFilter;
+using EventFilterPtr = std::shared_ptr<EventFilter>;
+
+/**
+ * A condition on the connection that an event handler body declares it
+ * cares about, through the &if_field, &if_port and &if_analyzer
+ * attributes. A body carrying one only runs for events whose connection
+ * matches it, and an event whose handler bodies all rule out its
+ * connection doesn't get queued at all. This replaces guards like
+ * "if ( ! c?$http ) return;" at the top of a handler with something that
+ * gets checked before the event even exists.
+ */
+class EventFilter {
+public:
+	/**
+	 * Builds the filter for an event handler body from its attributes,
+	 * reporting any that don't apply.
+	 *
+	 * @param attrs The attributes of the body.
+	 *
+	 * @param ft The type of the event.
+	 *
+	 * @return The filter, or null if the attributes don't restrict the
+	 * body.
+	 */
+	static EventFilterPtr Build(const std::vector<AttrPtr>& attrs,
+	                            const zeek::FuncType* ft);
+
+	/**
+	 * Returns whether a handler body with this filter runs for the given
+	 * event arguments. The first of those is the connection.
+	 */
+	bool Accepts(const zeek::Args& args) const;
+
+private:
+	// Offsets of connection fields that need to be set.
+	std::vector<int> fields;
+
+	// Responder ports the connection needs to use one of, in the masked
+	// form that PortVal uses internally. Empty if any will do.
+	std::vector<uint32_t> ports;
+
+	// Analyzers the connection needs to have one of. Empty if any will
+	// do.
+	std::vector<analyzer::Tag> analyzers;
+};
+
+} // namespace zeek::detail
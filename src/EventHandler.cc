@@ -6,6 +6,7 @@
 #include "NetVar.h"
 #include "ID.h"
 #include "Var.h"
+#include "Stats.h"
 
 #include "broker/Manager.h"
 #include "broker/Data.h"
@@ -26,6 +27,14 @@ EventHandler::operator bool() const
 			   || ! auto_publish.empty());
 	}
 
+bool EventHandler::WantsArgs(const zeek::Args& args) const
+	{
+	if ( ! local || generate_always || ! auto_publish.empty() || new_event )
+		return true;
+
+	return local->HasBodiesFor(args);
+	}
+
 const zeek::FuncTypePtr& EventHandler::GetType(bool check_export)
 	{
 	if ( type )
@@ -56,6 +65,8 @@ void EventHandler::Call(zeek::Args* vl, bool no_remote)
 	DEBUG_MSG("Event: %s\n", Name());
 #endif
 
+	EventProfileScope eps(event_profiler, this, Name());
+
 	if ( new_event )
 		NewEvent(vl);
 
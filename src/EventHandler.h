@@ -52,6 +52,11 @@ public:
 	// Returns true if there is at least one local or remote handler.
 	explicit operator  bool() const;
 
+	// Returns false if raising the event with the given arguments would
+	// have no effect, because the event filters of all of the local
+	// handler's bodies rule them out and nothing else sees the event.
+	bool WantsArgs(const zeek::Args& args) const;
+
 	void SetUsed()	{ used = true; }
 	bool Used()	{ return used; }
 
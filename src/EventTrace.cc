@@ -0,0 +1,282 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "EventTrace.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include <caf/binary_deserializer.hpp>
+#include <caf/binary_serializer.hpp>
+
+#include "broker/Data.h"
+#include "Event.h"
+#include "EventRegistry.h"
+#include "Frame.h"
+#include "Net.h"
+#include "NetVar.h"
+#include "Reporter.h"
+#include "Timer.h"
+
+namespace zeek::detail {
+
+EventTraceRecorder* event_trace_recorder = nullptr;
+EventTraceReplayer* event_trace_replayer = nullptr;
+
+// Written at the start of the file, followed by the format version. Each
+// event then follows as a length, the network time when it was raised,
+// and a serialized broker::vector of its name and arguments. Integers and
+// times are stored in host byte order; traces aren't meant to move
+// between architectures.
+static constexpr char trace_magic[8] = { 'Z', 'E', 'E', 'K', 'E', 'V', 'T', 'S' };
+static constexpr uint32_t trace_version = 1;
+
+EventTraceRecorder* EventTraceRecorder::Open(const std::string& path, std::string* error)
+	{
+	FILE* f = fopen(path.c_str(), "w");
+
+	if ( ! f )
+		{
+		*error = strerror(errno);
+		return nullptr;
+		}
+
+	if ( fwrite(trace_magic, sizeof(trace_magic), 1, f) != 1 ||
+	     fwrite(&trace_version, sizeof(trace_version), 1, f) != 1 )
+		{
+		*error = strerror(errno);
+		fclose(f);
+		return nullptr;
+		}
+
+	return new EventTraceRecorder(f, path);
+	}
+
+EventTraceRecorder::~EventTraceRecorder()
+	{
+	Close();
+	}
+
+void EventTraceRecorder::Record(const Event* event)
+	{
+	// Replaying the events that don't come from scripts runs the
+	// script code raising the others again.
+	if ( ! f || suspended || ! g_frame_stack.empty() )
+		return;
+
+	const auto& h = event->Handler();
+
+	if ( ! h.operator->() || h == event_queue_flush_point )
+		return;
+
+	broker::vector args;
+	args.reserve(event->Args().size());
+
+	for ( const auto& arg : event->Args() )
+		{
+		auto d = bro_broker::val_to_data(arg.get());
+
+		if ( ! d )
+			{
+			++num_unconvertible;
+			return;
+			}
+
+		args.emplace_back(std::move(*d));
+		}
+
+	broker::vector ev{std::string(h->Name()), std::move(args)};
+
+	buf.clear();
+	caf::binary_serializer sink{nullptr, buf};
+
+	if ( sink(ev) )
+		{
+		++num_unconvertible;
+		return;
+		}
+
+	uint32_t len = buf.size();
+
+	if ( fwrite(&len, sizeof(len), 1, f) != 1 ||
+	     fwrite(&network_time, sizeof(network_time), 1, f) != 1 ||
+	     fwrite(buf.data(), len, 1, f) != 1 )
+		{
+		reporter->Error("can't write event trace %s: %s", path.c_str(), strerror(errno));
+		fclose(f);
+		f = nullptr;
+		return;
+		}
+
+	++num_recorded;
+	}
+
+void EventTraceRecorder::Close()
+	{
+	if ( ! f )
+		return;
+
+	if ( fclose(f) != 0 )
+		reporter->Error("can't write event trace %s: %s", path.c_str(), strerror(errno));
+
+	f = nullptr;
+
+	if ( num_unconvertible )
+		reporter->Warning("%" PRIu64 " events left out of event trace %s, their arguments can't be serialized",
+		                  num_unconvertible, path.c_str());
+	}
+
+EventTraceReplayer* EventTraceReplayer::Open(const std::string& path, std::string* error)
+	{
+	FILE* f = fopen(path.c_str(), "r");
+
+	if ( ! f )
+		{
+		*error = strerror(errno);
+		return nullptr;
+		}
+
+	char magic[sizeof(trace_magic)];
+	uint32_t version;
+
+	if ( fread(magic, sizeof(magic), 1, f) != 1 ||
+	     memcmp(magic, trace_magic, sizeof(magic)) != 0 ||
+	     fread(&version, sizeof(version), 1, f) != 1 )
+		{
+		*error = "not an event trace";
+		fclose(f);
+		return nullptr;
+		}
+
+	if ( version != trace_version )
+		{
+		*error = fmt("unsupported event trace version %" PRIu32, version);
+		fclose(f);
+		return nullptr;
+		}
+
+	auto replayer = new EventTraceReplayer(f, path);
+	replayer->have_pending = replayer->ReadNext();
+	return replayer;
+	}
+
+EventTraceReplayer::~EventTraceReplayer()
+	{
+	if ( f )
+		fclose(f);
+	}
+
+bool EventTraceReplayer::ReadNext()
+	{
+	uint32_t len;
+
+	if ( fread(&len, sizeof(len), 1, f) != 1 )
+		{
+		if ( ferror(f) )
+			reporter->Error("can't read event trace %s: %s", path.c_str(), strerror(errno));
+
+		return false;
+		}
+
+	pending.resize(len);
+
+	if ( fread(&pending_time, sizeof(pending_time), 1, f) != 1 ||
+	     (len && fread(pending.data(), len, 1, f) != 1) )
+		{
+		reporter->Error("event trace %s is truncated", path.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+void EventTraceReplayer::Replay()
+	{
+	broker::vector ev;
+	caf::binary_deserializer source{nullptr, pending.data(), pending.size()};
+
+	if ( source(ev) || ev.size() != 2 )
+		{
+		++num_skipped;
+		return;
+		}
+
+	auto name = caf::get_if<std::string>(&ev[0]);
+	auto args = caf::get_if<broker::vector>(&ev[1]);
+	auto handler = name ? event_registry->Lookup(*name) : nullptr;
+
+	// The scripts may not know the event anymore, or declare it
+	// differently now.
+	if ( ! args || ! handler || ! handler->GetType(false) )
+		{
+		++num_skipped;
+		return;
+		}
+
+	const auto& arg_types = handler->GetType(false)->ParamList()->GetTypes();
+
+	if ( arg_types.size() != args->size() )
+		{
+		++num_skipped;
+		return;
+		}
+
+	zeek::Args vl;
+	vl.reserve(args->size());
+
+	for ( size_t i = 0; i < args->size(); ++i )
+		{
+		auto val = bro_broker::data_to_val(std::move((*args)[i]), arg_types[i].get());
+
+		if ( ! val )
+			{
+			++num_skipped;
+			return;
+			}
+
+		vl.emplace_back(std::move(val));
+		}
+
+	mgr.Enqueue(handler, std::move(vl));
+	++num_replayed;
+	}
+
+void EventTraceReplayer::Process()
+	{
+	if ( ! have_pending )
+		{
+		SetClosed(true);
+		return;
+		}
+
+	double t = pending_time;
+
+	if ( ! bro_start_network_time )
+		bro_start_network_time = t;
+
+	// network_time never goes back.
+	net_update_time(timer_mgr->Time() < t ? t : timer_mgr->Time());
+	expire_timers();
+
+	// Events raised at the same time usually come from the same packet,
+	// so they get processed together like that packet's would.
+	while ( have_pending && pending_time == t )
+		{
+		Replay();
+		have_pending = ReadNext();
+		}
+
+	if ( ! have_pending )
+		SetClosed(true);
+	}
+
+void EventTraceReplayer::Done()
+	{
+	if ( num_skipped )
+		reporter->Warning("%" PRIu64 " of %" PRIu64 " events in event trace %s skipped, their handlers are unknown or don't match",
+		                  num_skipped, num_skipped + num_replayed, path.c_str());
+
+	event_trace_replayer = nullptr;
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,127 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "iosource/IOSource.h"
+
+class Event;
+
+namespace zeek::detail {
+
+/**
+ * Records the events that Zeek's core raises, along with the network time
+ * when they were, into a trace file that EventTraceReplayer feeds back
+ * into the event queue later. "zeek --record-events <file>" sets one up.
+ *
+ * Events that script code raises, directly or through a BiF, or schedules
+ * aren't recorded, as replaying the recorded ones runs that code again.
+ * Neither are those raised while setting up and shutting down, such as
+ * zeek_init. Arguments get converted like Broker does for remote events;
+ * events with arguments it can't convert are left out.
+ */
+class EventTraceRecorder {
+public:
+	/**
+	 * Creates a trace file.
+	 *
+	 * @param path The file to write.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return The recorder, or null on error.
+	 */
+	static EventTraceRecorder* Open(const std::string& path, std::string* error);
+
+	~EventTraceRecorder();
+
+	/**
+	 * Records an event about to be queued, unless script code raises it.
+	 */
+	void Record(const Event* event);
+
+	/**
+	 * Suspends recording while scheduled events get raised. Calls nest.
+	 */
+	void Suspend()	{ ++suspended; }
+	void Resume()	{ --suspended; }
+
+	/**
+	 * Finishes the file and reports events that weren't recorded.
+	 */
+	void Close();
+
+private:
+	EventTraceRecorder(FILE* f, std::string path)
+		: f(f), path(std::move(path))	{ }
+
+	FILE* f;
+	std::string path;
+	std::vector<char> buf;
+	int suspended = 0;
+
+	uint64_t num_recorded = 0;
+	uint64_t num_unconvertible = 0;
+};
+
+/**
+ * Feeds the events of a trace file written by EventTraceRecorder into the
+ * event queue, in place of reading packets. Network time follows what got
+ * recorded, so timers expire as they did originally. As no analysis takes
+ * place, that measures the cost of running the scripts on their own.
+ * "zeek --replay-events <file>" sets one up.
+ */
+class EventTraceReplayer : public iosource::IOSource {
+public:
+	/**
+	 * Opens a trace file.
+	 *
+	 * @param path The file to read.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return The replayer, or null on error.
+	 */
+	static EventTraceReplayer* Open(const std::string& path, std::string* error);
+
+	~EventTraceReplayer() override;
+
+	// IOSource interface.
+	double GetNextTimeout() override	{ return 0; }
+	void Process() override;
+	void Done() override;
+	const char* Tag() override	{ return "EventTraceReplayer"; }
+
+private:
+	EventTraceReplayer(FILE* f, std::string path)
+		: f(f), path(std::move(path))	{ }
+
+	// Reads the next event into the pending one. Returns false at the
+	// end of the trace or if it's corrupt.
+	bool ReadNext();
+
+	// Queues the pending event.
+	void Replay();
+
+	FILE* f;
+	std::string path;
+
+	// The next event, still serialized, and when it was raised.
+	bool have_pending = false;
+	double pending_time = 0;
+	std::vector<char> pending;
+
+	uint64_t num_replayed = 0;
+	uint64_t num_skipped = 0;
+};
+
+// Only set when running with --record-events and --replay-events,
+// respectively.
+extern EventTraceRecorder* event_trace_recorder;
+extern EventTraceReplayer* event_trace_replayer;
+
+} // namespace zeek::detail
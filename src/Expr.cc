@@ -4,6 +4,7 @@
 
 #include "Expr.h"
 #include "Event.h"
+#include "EventTrace.h"
 #include "Desc.h"
 #include "Frame.h"
 #include "Func.h"
@@ -19,6 +20,7 @@
 #include "module_util.h"
 #include "DebugLogger.h"
 #include "Hash.h"
+#include "VectorOps.h"
 
 #include "broker/Data.h"
 
@@ -503,6 +505,10 @@ ValPtr BinaryExpr::Eval(Frame* f) const
 			return nullptr;
 			}
 
+		if ( auto v_result = fold_numeric_vectors(tag, v1.get(), v2.get(),
+		                                          GetType<zeek::VectorType>()) )
+			return v_result;
+
 		auto v_result = zeek::make_intrusive<zeek::VectorVal>(GetType<zeek::VectorType>());
 
 		for ( unsigned int i = 0; i < v_op1->Size(); ++i )
@@ -519,6 +525,10 @@ ValPtr BinaryExpr::Eval(Frame* f) const
 
 	if ( IsVector(GetType()->Tag()) && (is_vec1 || is_vec2) )
 		{ // fold vector against scalar
+		if ( auto v_result = fold_numeric_vectors(tag, v1.get(), v2.get(),
+		                                          GetType<zeek::VectorType>()) )
+			return v_result;
+
 		VectorVal* vv = (is_vec1 ? v1 : v2)->AsVectorVal();
 		auto v_result = zeek::make_intrusive<zeek::VectorVal>(GetType<zeek::VectorType>());
 
@@ -2297,17 +2307,19 @@ ValPtr AssignExpr::Eval(Frame* f) const
 		return nullptr;
 		}
 
-	if ( auto v = op2->Eval(f) )
-		{
-		op1->Assign(f, v);
+	auto v = op2->Eval(f);
 
-		if ( val )
-			return val;
+	if ( ! v )
+		return nullptr;
 
-		return v;
+	if ( val )
+		{
+		op1->Assign(f, std::move(v));
+		return val;
 		}
-	else
-		return nullptr;
+
+	op1->Assign(f, v);
+	return v;
 	}
 
 zeek::TypePtr AssignExpr::InitType() const
@@ -2581,6 +2593,9 @@ void IndexExpr::Add(Frame* f)
 	if ( ! v2 )
 		return;
 
+	if ( v1->AsTableVal()->IsReadOnly() )
+		RuntimeError("cannot modify a frozen table");
+
 	v1->AsTableVal()->Assign(std::move(v2), nullptr);
 	}
 
@@ -2599,6 +2614,9 @@ void IndexExpr::Delete(Frame* f)
 	if ( ! v2 )
 		return;
 
+	if ( v1->AsTableVal()->IsReadOnly() )
+		RuntimeError("cannot modify a frozen table");
+
 	v1->AsTableVal()->Remove(*v2);
 	}
 
@@ -2657,8 +2675,18 @@ ValPtr IndexExpr::Eval(Frame* f) const
 
 		return v_result;
 		}
-	else
-		return Fold(v1.get(), v2.get());
+
+	// Table lookups are the common case. Handled here, they can use the
+	// index without taking another reference.
+	if ( v1->GetType()->Tag() == zeek::TYPE_TABLE && ! IsError() )
+		{
+		if ( auto v = v1->AsTableVal()->FindOrDefault(v2) )
+			return v;
+
+		RuntimeError("no such index");
+		}
+
+	return Fold(v1.get(), v2.get());
 	}
 
 static int get_slice_index(int idx, int len)
@@ -2820,6 +2848,9 @@ void IndexExpr::Assign(Frame* f, ValPtr v)
 		}
 
 	case zeek::TYPE_TABLE:
+		if ( v1->AsTableVal()->IsReadOnly() )
+			RuntimeError("cannot modify a frozen table");
+
 		if ( ! v1->AsTableVal()->Assign(std::move(v2), std::move(v)) )
 			{
 			v = std::move(v_extra);
@@ -3070,6 +3101,35 @@ ValPtr RecordConstructorExpr::InitVal(const zeek::Type* t, ValPtr aggr) const
 	return nullptr;
 	}
 
+ValPtr RecordConstructorExpr::Eval(Frame* f) const
+	{
+	if ( IsError() )
+		return nullptr;
+
+	// Same as folding the list's value, but moves the field values
+	// straight into the record rather than through a ListVal.
+	const expr_list& exprs = op->AsListExpr()->Exprs();
+	auto rt = zeek::cast_intrusive<RecordType>(type);
+
+	if ( exprs.length() != rt->NumFields() )
+		RuntimeErrorWithCallStack("inconsistency evaluating record constructor");
+
+	auto rv = zeek::make_intrusive<zeek::RecordVal>(std::move(rt));
+
+	loop_over_list(exprs, i)
+		{
+		auto v = exprs[i]->Eval(f);
+
+		if ( ! v )
+			// Reported like ListExpr::Eval() would.
+			reporter->ExprRuntimeError(op.get(), "uninitialized list value");
+
+		rv->Assign(i, std::move(v));
+		}
+
+	return rv;
+	}
+
 ValPtr RecordConstructorExpr::Fold(Val* v) const
 	{
 	ListVal* lv = v->AsListVal();
@@ -3838,8 +3898,17 @@ ScheduleTimer::~ScheduleTimer()
 
 void ScheduleTimer::Dispatch(double /* t */, bool /* is_expire */)
 	{
-	if ( event )
-		mgr.Enqueue(event, std::move(args));
+	if ( ! event )
+		return;
+
+	// Replays raise the event again when the handler scheduling it runs.
+	if ( event_trace_recorder )
+		event_trace_recorder->Suspend();
+
+	mgr.Enqueue(event, std::move(args));
+
+	if ( event_trace_recorder )
+		event_trace_recorder->Resume();
 	}
 
 ScheduleExpr::ScheduleExpr(ExprPtr arg_when, EventExprPtr arg_event)
@@ -4162,6 +4231,9 @@ ValPtr CallExpr::Eval(Frame* f) const
 			}
 		}
 
+	if ( inlined_func && ! ScriptFunc::CallsObserved() )
+		return inlined_func->EvalInlined(inlined_body.get(), args.get(), f);
+
 	ValPtr ret;
 	auto func_val = func->Eval(f);
 	auto v = eval_list(f, args.get());
@@ -4184,6 +4256,12 @@ ValPtr CallExpr::Eval(Frame* f) const
 	return ret;
 	}
 
+void CallExpr::Inline(const ScriptFunc* f, ExprPtr body)
+	{
+	inlined_func = f;
+	inlined_body = std::move(body);
+	}
+
 TraversalCode CallExpr::Traverse(TraversalCallback* cb) const
 	{
 	TraversalCode tc = cb->PreExpr(this);
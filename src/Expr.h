@@ -78,6 +78,7 @@ class AssignExpr;
 class CallExpr;
 class EventExpr;
 class Stmt;
+class ScriptFunc;
 
 class Expr;
 using ExprPtr = zeek::IntrusivePtr<Expr>;
@@ -597,6 +598,8 @@ public:
 	explicit RecordConstructorExpr(ListExprPtr constructor_list);
 	~RecordConstructorExpr() override;
 
+	ValPtr Eval(Frame* f) const override;
+
 protected:
 	ValPtr InitVal(const zeek::Type* t, ValPtr aggr) const override;
 	ValPtr Fold(Val* v) const override;
@@ -773,11 +776,23 @@ public:
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
 
+	/**
+	 * Makes the call evaluate the function's returned expression
+	 * directly, rather than invoking it, see inline_script_functions().
+	 *
+	 * @param f the function, which can't change anymore.
+	 * @param body the expression *f* returns, per ScriptFunc::ReturnedExpr().
+	 */
+	void Inline(const ScriptFunc* f, ExprPtr body);
+
 protected:
 	void ExprDescribe(ODesc* d) const override;
 
 	ExprPtr func;
 	ListExprPtr args;
+
+	const ScriptFunc* inlined_func = nullptr;
+	ExprPtr inlined_body;
 };
 
 
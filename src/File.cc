@@ -17,9 +17,15 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 #include "Attr.h"
 #include "Type.h"
@@ -30,6 +36,143 @@
 #include "Reporter.h"
 #include "Desc.h"
 #include "Var.h"
+#include "const.bif.h"
+
+namespace zeek::detail {
+
+// The part of a file that the writer thread works on.
+struct AsyncFileOutput {
+	explicit AsyncFileOutput(FILE* arg_f) : f(arg_f)	{ }
+
+	FILE* f;
+
+	// The rest is guarded by the writer's mutex, except for error.
+	std::string pending;	// data not yet taken by the writer thread
+	bool queued = false;	// whether the file is in the writer's queue
+	bool busy = false;	// whether the writer thread is writing it
+	std::atomic<int> error{0};	// errno of the first failed write
+};
+
+// A single thread writing out all files that use async_file_output, so
+// that contents files of many connections don't need a thread each.
+class AsyncFileWriter {
+public:
+	~AsyncFileWriter()	{ Stop(); }
+
+	// Appends data to the file's pending output. Returns false if that
+	// would take the memory of all pending output beyond
+	// async_file_buffer_size, in which case the data gets dropped.
+	bool Write(AsyncFileOutput* o, const char* data, size_t len);
+
+	// Waits until the file's output has been written.
+	void Sync(AsyncFileOutput* o);
+
+	// Writes out what's pending and stops the thread. Write() starts
+	// it again.
+	void Stop();
+
+private:
+	void Run();
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;	// wakes up the writer thread
+	std::condition_variable idle;	// signals written output
+	std::deque<AsyncFileOutput*> queue;
+	uint64_t buffered = 0;
+	bool done = false;
+};
+
+bool AsyncFileWriter::Write(AsyncFileOutput* o, const char* data, size_t len)
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if ( buffered + len > zeek::BifConst::async_file_buffer_size )
+			return false;
+
+		if ( ! thread.joinable() )
+			thread = std::thread(&AsyncFileWriter::Run, this);
+
+		o->pending.append(data, len);
+		buffered += len;
+
+		// Output of a busy file gets queued again once it's written.
+		if ( o->queued || o->busy )
+			return true;
+
+		o->queued = true;
+		queue.push_back(o);
+		}
+
+	cond.notify_one();
+	return true;
+	}
+
+void AsyncFileWriter::Sync(AsyncFileOutput* o)
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [o] { return ! o->queued && ! o->busy; });
+	}
+
+void AsyncFileWriter::Stop()
+	{
+	if ( ! thread.joinable() )
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	done = true;
+	lock.unlock();
+
+	cond.notify_one();
+	thread.join();
+	done = false;
+	}
+
+void AsyncFileWriter::Run()
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+	std::string data;
+
+	while ( true )
+		{
+		cond.wait(lock, [this] { return done || ! queue.empty(); });
+
+		if ( queue.empty() )
+			break;
+
+		AsyncFileOutput* o = queue.front();
+		queue.pop_front();
+		o->queued = false;
+		o->busy = true;
+		data.clear();
+		std::swap(data, o->pending);
+		lock.unlock();
+
+		if ( ! o->error )
+			{
+			if ( fwrite(data.data(), data.size(), 1, o->f) < 1 ||
+			     fflush(o->f) != 0 )
+				o->error = errno ? errno : EIO;
+			}
+
+		lock.lock();
+		buffered -= data.size();
+		o->busy = false;
+
+		if ( ! o->pending.empty() )
+			{
+			o->queued = true;
+			queue.push_back(o);
+			}
+
+		idle.notify_all();
+		}
+	}
+
+static AsyncFileWriter async_file_writer;
+
+} // namespace zeek::detail
 
 std::list<std::pair<std::string, BroFile*>> BroFile::open_files;
 
@@ -172,6 +315,8 @@ void BroFile::Init()
 	attrs = nullptr;
 	buffered = true;
 	raw_output = false;
+	async = nullptr;
+	dropped_bytes = 0;
 
 #ifdef USE_PERFTOOLS_DEBUG
 	heap_checker->IgnoreObject(this);
@@ -188,6 +333,8 @@ FILE* BroFile::Seek(long new_position)
 	if ( ! File() )
 		return nullptr;
 
+	SyncAsyncOutput();
+
 	if ( fseek(f, new_position, SEEK_SET) < 0 )
 		reporter->Error("seek failed");
 
@@ -199,6 +346,8 @@ void BroFile::SetBuf(bool arg_buffered)
 	if ( ! f )
 		return;
 
+	SyncAsyncOutput();
+
 	if ( setvbuf(f, NULL, arg_buffered ? _IOFBF : _IOLBF, 0) != 0 )
 		reporter->Error("setvbuf failed");
 
@@ -217,6 +366,12 @@ bool BroFile::Close()
 	if ( ! f )
 		return false;
 
+	StopAsyncOutput();
+
+	if ( dropped_bytes )
+		reporter->Warning("dropped %" PRIu64 " bytes of output to %s",
+		                  dropped_bytes, Name());
+
 	fclose(f);
 	f = nullptr;
 	open_time = 0;
@@ -291,8 +446,9 @@ zeek::RecordVal* BroFile::Rotate()
 	info->Assign<zeek::TimeVal>(2, open_time);
 
 	Unlink();
+	StopAsyncOutput();
 
- 	fclose(f);
+	fclose(f);
 	f = nullptr;
 
 	Open(newf);
@@ -307,6 +463,8 @@ void BroFile::CloseOpenFiles()
 		auto el = it++;
 		(*el).second->Close();
 		}
+
+	zeek::detail::async_file_writer.Stop();
 	}
 
 bool BroFile::Write(const char* data, int len)
@@ -317,12 +475,63 @@ bool BroFile::Write(const char* data, int len)
 	if ( ! len )
 		len = strlen(data);
 
+	if ( UseAsyncOutput() )
+		{
+		if ( async->error )
+			{
+			errno = async->error;
+			return false;
+			}
+
+		if ( ! zeek::detail::async_file_writer.Write(async, data, len) )
+			dropped_bytes += len;
+
+		return true;
+		}
+
 	if ( fwrite(data, len, 1, f) < 1 )
 		return false;
 
 	return true;
 	}
 
+void BroFile::Flush()
+	{
+	// The writer thread flushes whatever it writes.
+	if ( ! async )
+		fflush(f);
+	}
+
+bool BroFile::UseAsyncOutput()
+	{
+	if ( async )
+		return true;
+
+	// The standard streams stay with the main thread, which has others
+	// writing to them as well.
+	if ( ! zeek::BifConst::async_file_output ||
+	     ! f || f == stdin || f == stdout || f == stderr )
+		return false;
+
+	// Whatever the main thread buffered goes first.
+	fflush(f);
+	async = new zeek::detail::AsyncFileOutput(f);
+	return true;
+	}
+
+void BroFile::SyncAsyncOutput()
+	{
+	if ( async )
+		zeek::detail::async_file_writer.Sync(async);
+	}
+
+void BroFile::StopAsyncOutput()
+	{
+	SyncAsyncOutput();
+	delete async;
+	async = nullptr;
+	}
+
 void BroFile::RaiseOpenEvent()
 	{
 	if ( ! ::file_opened )
@@ -335,6 +544,7 @@ void BroFile::RaiseOpenEvent()
 
 double BroFile::Size()
 	{
+	SyncAsyncOutput();
 	fflush(f);
 	struct stat s;
 	if ( fstat(fileno(f), &s) < 0 )
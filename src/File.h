@@ -26,6 +26,8 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(PrintStmt, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Attributes, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(RecordVal, zeek);
 
+namespace zeek::detail { struct AsyncFileOutput; }
+
 class BroFile;
 using BroFilePtr = zeek::IntrusivePtr<BroFile>;
 
@@ -41,9 +43,14 @@ public:
 	// Returns false if an error occured.
 	bool Write(const char* data, int len = 0);
 
-	void Flush()	{ fflush(f); }
+	// Writes out buffered content. With async_file_output, that only
+	// hands it to the writer thread.
+	void Flush();
 
-	FILE* Seek(long position);	// seek to absolute position
+	// Seeks to an absolute position. With async_file_output, that first
+	// waits for the writer thread to catch up with this file, so that
+	// the caller can then use the returned FILE directly.
+	FILE* Seek(long position);
 
 	void SetBuf(bool buffered);	// false=line buffered, true=fully buffered
 
@@ -85,6 +92,10 @@ public:
 	void EnableRawOutput()		{ raw_output = true; }
 	bool IsRawOutput() const	{ return raw_output; }
 
+	// Returns the number of bytes that got dropped because the writer
+	// thread fell more than async_file_buffer_size behind.
+	uint64_t DroppedBytes() const	{ return dropped_bytes; }
+
 protected:
 
 	friend class zeek::detail::PrintStmt;
@@ -110,6 +121,18 @@ protected:
 	// Raises a file_opened event.
 	void RaiseOpenEvent();
 
+	// Whether writes should go through the writer thread, starting to
+	// use it if so.
+	bool UseAsyncOutput();
+
+	// Waits until the writer thread has written everything so far, so
+	// that the main thread may use f again. Reports drops and errors of
+	// the writer thread.
+	void SyncAsyncOutput();
+
+	// Detaches from the writer thread after syncing with it.
+	void StopAsyncOutput();
+
 	FILE* f;
 	zeek::TypePtr t;
 	char* name;
@@ -120,6 +143,9 @@ protected:
 	bool buffered;
 	bool raw_output;
 
+	zeek::detail::AsyncFileOutput* async;	// non-nil while using the writer thread
+	uint64_t dropped_bytes;
+
 	static const int MIN_BUFFER_SIZE = 1024;
 
 private:
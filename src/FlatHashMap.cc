@@ -0,0 +1,123 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "FlatHashMap.h"
+
+#include <map>
+
+#include "3rdparty/doctest.h"
+
+namespace {
+
+struct IdentityHash {
+	hash_t operator()(int k) const	{ return static_cast<hash_t>(k); }
+};
+
+// Maps all keys to the same few buckets to exercise collision handling.
+struct CollidingHash {
+	hash_t operator()(int k) const	{ return static_cast<hash_t>(k % 3); }
+};
+
+}
+
+TEST_SUITE_BEGIN("FlatHashMap");
+
+TEST_CASE("flat hash map insertion and lookup")
+	{
+	zeek::detail::FlatHashMap<int, int, IdentityHash> m;
+	CHECK(m.empty());
+	CHECK(m.find(1) == m.end());
+
+	m[1] = 10;
+	m.insert_or_assign(2, 20);
+	CHECK(m.size() == 2);
+	CHECK(m.find(1)->second == 10);
+	CHECK(m.find(2)->second == 20);
+
+	m.insert_or_assign(2, 21);
+	CHECK(m.size() == 2);
+	CHECK(m.find(2)->second == 21);
+
+	auto h = m.Hash(3);
+	m.insert_or_assign(3, 30, h);
+	CHECK(m.find(3, h)->second == 30);
+	}
+
+TEST_CASE("flat hash map removal")
+	{
+	zeek::detail::FlatHashMap<int, int, CollidingHash> m;
+
+	for ( int i = 0; i < 100; ++i )
+		m[i] = i;
+
+	CHECK(m.size() == 100);
+	CHECK(m.erase(1000) == 0);
+
+	for ( int i = 0; i < 100; i += 2 )
+		CHECK(m.erase(i) == 1);
+
+	CHECK(m.size() == 50);
+
+	for ( int i = 0; i < 100; ++i )
+		{
+		if ( i % 2 )
+			CHECK(m.find(i)->second == i);
+		else
+			CHECK(m.find(i) == m.end());
+		}
+
+	m.clear();
+	CHECK(m.empty());
+	CHECK(m.capacity() == 0);
+	CHECK(m.find(1) == m.end());
+	}
+
+TEST_CASE("flat hash map matches std::map")
+	{
+	zeek::detail::FlatHashMap<int, int, IdentityHash> m;
+	std::map<int, int> ref;
+
+	// Keys chosen so that they cluster in the table, which exercises
+	// wrap-around and backward-shift deletion.
+	for ( int round = 0; round < 4; ++round )
+		{
+		for ( int i = 0; i < 1000; ++i )
+			{
+			int k = (i * 7919 + round) % 1024;
+			m[k] = i;
+			ref[k] = i;
+
+			if ( i % 3 == 0 )
+				{
+				int r = (k * 31) % 1024;
+				CHECK(m.erase(r) == ref.erase(r));
+				}
+			}
+		}
+
+	CHECK(m.size() == ref.size());
+
+	size_t n = 0;
+	for ( const auto& entry : m )
+		{
+		CHECK(ref.count(entry.first) == 1);
+		CHECK(ref[entry.first] == entry.second);
+		++n;
+		}
+
+	CHECK(n == ref.size());
+	}
+
+TEST_CASE("flat hash map reserve")
+	{
+	zeek::detail::FlatHashMap<int, int, IdentityHash> m;
+	m.reserve(1000);
+	auto cap = m.capacity();
+	CHECK(cap >= 1000);
+
+	for ( int i = 0; i < 1000; ++i )
+		m[i] = i;
+
+	CHECK(m.capacity() == cap);
+	}
+
+TEST_SUITE_END();
@@ -0,0 +1,324 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "Hash.h"
+
+namespace zeek::detail {
+
+/**
+ * A hash map using open addressing with linear probing over a single,
+ * flat array of slots. Each slot stores the entry together with its hash
+ * value, so probing rarely has to compare keys and resizing never needs
+ * to rehash them. Removal uses backward-shift deletion, so there are no
+ * tombstones that would slow down lookups over time.
+ *
+ * The interface mirrors the subset of std::map used for session
+ * tracking. Iteration order is unspecified. Iterators and pointers to
+ * entries are invalidated by any insertion or removal; store pointers as
+ * values if their targets need to remain stable.
+ *
+ * @tparam Key The key type, which must be default-constructible.
+ *
+ * @tparam T The mapped type, which must be default-constructible.
+ *
+ * @tparam Hasher A functor returning a hash_t for a key. For keys that
+ * are derived from network traffic this should be a keyed hash, such as
+ * one based on KeyedHash::Hash64(), to avoid complexity attacks.
+ */
+template <typename Key, typename T, typename Hasher,
+          typename KeyEqual = std::equal_to<Key>>
+class FlatHashMap {
+public:
+	using key_type = Key;
+	using mapped_type = T;
+	using value_type = std::pair<Key, T>;
+
+private:
+	struct Slot {
+		// Zero marks an empty slot; see NonZero().
+		hash_t hash = 0;
+		value_type entry;
+	};
+
+	template <typename SlotPtr, typename Ref>
+	class Iter {
+	public:
+		Iter(SlotPtr s, SlotPtr e) : cur(s), end(e)	{ SkipEmpty(); }
+
+		Ref operator*() const	{ return cur->entry; }
+		auto operator->() const	{ return &cur->entry; }
+
+		Iter& operator++()
+			{
+			++cur;
+			SkipEmpty();
+			return *this;
+			}
+
+		bool operator==(const Iter& other) const	{ return cur == other.cur; }
+		bool operator!=(const Iter& other) const	{ return cur != other.cur; }
+
+	private:
+		friend class FlatHashMap;
+
+		void SkipEmpty()
+			{
+			while ( cur != end && cur->hash == 0 )
+				++cur;
+			}
+
+		SlotPtr cur;
+		SlotPtr end;
+	};
+
+public:
+	using iterator = Iter<Slot*, value_type&>;
+	using const_iterator = Iter<const Slot*, const value_type&>;
+
+	FlatHashMap() = default;
+
+	/**
+	 * Returns the hash the map uses for a key. This can be passed to the
+	 * methods taking a precomputed hash when the same key is looked up
+	 * more than once.
+	 */
+	hash_t Hash(const Key& key) const
+		{ return NonZero(hasher(key)); }
+
+	iterator find(const Key& key)
+		{ return find(key, Hash(key)); }
+
+	const_iterator find(const Key& key) const
+		{ return find(key, Hash(key)); }
+
+	/**
+	 * Looks up a key using a hash previously returned by Hash().
+	 */
+	iterator find(const Key& key, hash_t h)
+		{
+		size_t idx = FindIndex(key, h);
+
+		if ( idx == npos )
+			return end();
+
+		return iterator(slots.data() + idx, slots.data() + slots.size());
+		}
+
+	const_iterator find(const Key& key, hash_t h) const
+		{
+		size_t idx = FindIndex(key, h);
+
+		if ( idx == npos )
+			return end();
+
+		return const_iterator(slots.data() + idx, slots.data() + slots.size());
+		}
+
+	/**
+	 * Returns the value associated with a key, inserting a
+	 * default-constructed one if the key isn't present yet.
+	 */
+	T& operator[](const Key& key)
+		{ return Insert(key, Hash(key)); }
+
+	/**
+	 * Inserts or overwrites the value associated with a key, using a
+	 * hash previously returned by Hash().
+	 *
+	 * @return A reference to the stored value.
+	 */
+	T& insert_or_assign(const Key& key, T value, hash_t h)
+		{
+		T& v = Insert(key, h);
+		v = std::move(value);
+		return v;
+		}
+
+	T& insert_or_assign(const Key& key, T value)
+		{ return insert_or_assign(key, std::move(value), Hash(key)); }
+
+	/**
+	 * Removes a key from the map.
+	 *
+	 * @return The number of entries removed, i.e. 0 or 1.
+	 */
+	size_t erase(const Key& key)
+		{ return erase(key, Hash(key)); }
+
+	size_t erase(const Key& key, hash_t h)
+		{
+		size_t idx = FindIndex(key, h);
+
+		if ( idx == npos )
+			return 0;
+
+		EraseIndex(idx);
+		return 1;
+		}
+
+	void clear()
+		{
+		std::vector<Slot>().swap(slots);
+		num_entries = 0;
+		}
+
+	/**
+	 * Ensures that at least the given number of entries can be stored
+	 * without growing the table.
+	 */
+	void reserve(size_t n)
+		{
+		size_t cap = slots.empty() ? MIN_CAPACITY : slots.size();
+
+		while ( n > MaxLoad(cap) )
+			cap *= 2;
+
+		if ( cap != slots.size() )
+			Resize(cap);
+		}
+
+	size_t size() const	{ return num_entries; }
+	bool empty() const	{ return num_entries == 0; }
+
+	/**
+	 * Returns the number of slots currently allocated.
+	 */
+	size_t capacity() const	{ return slots.size(); }
+
+	/**
+	 * Returns the number of bytes allocated for the slots.
+	 */
+	size_t MemoryAllocation() const
+		{ return slots.capacity() * sizeof(Slot); }
+
+	iterator begin()
+		{ return iterator(slots.data(), slots.data() + slots.size()); }
+	iterator end()
+		{ return iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+
+	const_iterator begin() const
+		{ return const_iterator(slots.data(), slots.data() + slots.size()); }
+	const_iterator end() const
+		{ return const_iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+
+private:
+	static constexpr size_t npos = static_cast<size_t>(-1);
+	static constexpr size_t MIN_CAPACITY = 16;
+
+	// We keep the load factor at or below 3/4, where linear probing
+	// still needs only few probes per lookup.
+	static size_t MaxLoad(size_t cap)
+		{ return cap - cap / 4; }
+
+	static hash_t NonZero(hash_t h)
+		{ return h ? h : 1; }
+
+	size_t Mask() const
+		{ return slots.size() - 1; }
+
+	size_t FindIndex(const Key& key, hash_t h) const
+		{
+		if ( slots.empty() )
+			return npos;
+
+		size_t mask = Mask();
+
+		for ( size_t idx = h & mask; ; idx = (idx + 1) & mask )
+			{
+			const Slot& s = slots[idx];
+
+			if ( s.hash == 0 )
+				return npos;
+
+			if ( s.hash == h && key_equal(s.entry.first, key) )
+				return idx;
+			}
+		}
+
+	T& Insert(const Key& key, hash_t h)
+		{
+		size_t idx = FindIndex(key, h);
+
+		if ( idx != npos )
+			return slots[idx].entry.second;
+
+		if ( slots.empty() || num_entries + 1 > MaxLoad(slots.size()) )
+			Resize(slots.empty() ? MIN_CAPACITY : slots.size() * 2);
+
+		size_t mask = Mask();
+		idx = h & mask;
+
+		while ( slots[idx].hash != 0 )
+			idx = (idx + 1) & mask;
+
+		Slot& s = slots[idx];
+		s.hash = h;
+		s.entry.first = key;
+		s.entry.second = T();
+		++num_entries;
+
+		return s.entry.second;
+		}
+
+	void EraseIndex(size_t idx)
+		{
+		size_t mask = Mask();
+		size_t hole = idx;
+
+		// Shift subsequent entries of the probe sequence back into the
+		// hole, so that lookups never stop early at an empty slot.
+		for ( size_t next = (hole + 1) & mask; slots[next].hash != 0;
+		      next = (next + 1) & mask )
+			{
+			size_t home = slots[next].hash & mask;
+
+			// Move the entry only if its home position isn't
+			// cyclically within (hole, next].
+			bool in_range = ( hole <= next ) ? ( hole < home && home <= next )
+			                                 : ( hole < home || home <= next );
+
+			if ( in_range )
+				continue;
+
+			slots[hole] = std::move(slots[next]);
+			hole = next;
+			}
+
+		slots[hole] = Slot();
+		--num_entries;
+		}
+
+	void Resize(size_t new_cap)
+		{
+		std::vector<Slot> old(new_cap);
+		old.swap(slots);
+
+		size_t mask = Mask();
+
+		for ( auto& s : old )
+			{
+			if ( s.hash == 0 )
+				continue;
+
+			size_t idx = s.hash & mask;
+
+			while ( slots[idx].hash != 0 )
+				idx = (idx + 1) & mask;
+
+			slots[idx] = std::move(s);
+			}
+		}
+
+	std::vector<Slot> slots;
+	size_t num_entries = 0;
+	Hasher hasher;
+	KeyEqual key_equal;
+};
+
+} // namespace zeek::detail
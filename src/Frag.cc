@@ -38,14 +38,18 @@ FragReassembler::FragReassembler(NetSessions* arg_s,
 	if ( ip4 )
 		{
 		proto_hdr_len = ip->HdrLen();
-		proto_hdr = new u_char[64];	// max IP header + slop
+		proto_hdr = proto_hdr_buf;
 		// Don't do a structure copy - need to pick up options, too.
 		memcpy((void*) proto_hdr, (const void*) ip4, proto_hdr_len);
 		}
 	else
 		{
 		proto_hdr_len = ip->HdrLen() - 8; // minus length of fragment header
-		proto_hdr = new u_char[proto_hdr_len];
+
+		if ( proto_hdr_len <= sizeof(proto_hdr_buf) )
+			proto_hdr = proto_hdr_buf;
+		else
+			proto_hdr = new u_char[proto_hdr_len];
 		memcpy(proto_hdr, ip->IP6_Hdr(), proto_hdr_len);
 		}
 
@@ -67,7 +71,10 @@ FragReassembler::FragReassembler(NetSessions* arg_s,
 FragReassembler::~FragReassembler()
 	{
 	DeleteTimer();
-	delete [] proto_hdr;
+
+	if ( proto_hdr != proto_hdr_buf )
+		delete [] proto_hdr;
+
 	delete reassembled_pkt;
 	}
 
@@ -314,6 +321,15 @@ void FragReassembler::BlockInserted(DataBlockMap::const_iterator /* it */)
 		}
 	}
 
+void FragReassembler::Evict()
+	{
+	// A datagram can't be reassembled with fragments missing, so there's
+	// nothing to deliver.  The reassembler stays around until it expires,
+	// in case the fragments get retransmitted.
+	Weird("fragment_reassembly_evicted");
+	block_list.Clear();
+	}
+
 void FragReassembler::Expire(double t)
 	{
 	block_list.Clear();
@@ -323,6 +339,13 @@ void FragReassembler::Expire(double t)
 	sessions->Remove(this);
 	}
 
+void FragReassembler::Discard()
+	{
+	Weird("fragment_reassembly_evicted");
+	DeleteTimer();
+	sessions->Remove(this);
+	}
+
 void FragReassembler::DeleteTimer()
 	{
 	if ( expire_timer )
@@ -3,10 +3,12 @@
 #pragma once
 
 #include "util.h" // for bro_uint_t
+#include "Hash.h"
 #include "IPAddr.h"
 #include "Reassem.h"
 #include "Timer.h"
 
+#include <list>
 #include <tuple>
 
 #include <sys/types.h> // for u_char
@@ -22,6 +24,17 @@ typedef void (FragReassembler::*frag_timer_func)(double t);
 
 using FragReassemblerKey = std::tuple<IPAddr, IPAddr, bro_uint_t>;
 
+struct FragReassemblerKeyHash {
+	hash_t operator()(const FragReassemblerKey& k) const
+		{
+		uint32_t buf[9];
+		std::get<0>(k).CopyIPv6(&buf[0]);
+		std::get<1>(k).CopyIPv6(&buf[4]);
+		buf[8] = static_cast<uint32_t>(std::get<2>(k));
+		return KeyedHash::Hash64(buf, sizeof(buf));
+		}
+};
+
 class FragReassembler : public Reassembler {
 public:
 	FragReassembler(NetSessions* s, const IP_Hdr* ip, const u_char* pkt,
@@ -31,6 +44,11 @@ public:
 	void AddFragment(double t, const IP_Hdr* ip, const u_char* pkt);
 
 	void Expire(double t);
+
+	// Gives up on the datagram to free its memory, unlike Evict()
+	// which only drops the fragments buffered so far.
+	void Discard();
+
 	void DeleteTimer();
 	void ClearTimer()	{ expire_timer = nullptr; }
 
@@ -38,8 +56,11 @@ public:
 	const FragReassemblerKey& Key() const	{ return key; }
 
 protected:
+	friend class NetSessions;
+
 	void BlockInserted(DataBlockMap::const_iterator it) override;
 	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override;
+	void Evict() override;
 	void Weird(const char* name) const;
 
 	u_char* proto_hdr;
@@ -50,6 +71,12 @@ protected:
 	uint16_t next_proto; // first IPv6 fragment header's next proto field
 	uint16_t proto_hdr_len;
 
+	// Holds the header unless it has too many IPv6 extension headers.
+	u_char proto_hdr_buf[64];	// max IP header + slop
+
+	// Position in the sessions' list of reassemblers by age.
+	std::list<FragReassembler*>::iterator age_pos;
+
 	FragTimer* expire_timer;
 };
 
@@ -146,6 +146,19 @@ void Frame::Reset(int startIdx)
 		ClearElement(i);
 	}
 
+void Frame::Recycle(const zeek::Args* fn_args)
+	{
+	Reset(0);
+
+	func_args = fn_args;
+	next_stmt = nullptr;
+	break_before_next_stmt = false;
+	break_on_return = false;
+	trigger = nullptr;
+	call = nullptr;
+	delayed = false;
+	}
+
 void Frame::Describe(ODesc* d) const
 	{
 	if ( ! d->IsBinary() )
@@ -188,6 +201,25 @@ Frame* Frame::Clone() const
 	return other;
 	}
 
+Frame* Frame::CloneOffsets(const std::vector<int>& offsets) const
+	{
+	if ( offset_map && ! offset_map->empty() )
+		return Clone();
+
+	Frame* other = new Frame(size, function, func_args);
+
+	other->CaptureClosure(closure, outer_ids);
+
+	other->call = call;
+	other->trigger = trigger;
+
+	for ( auto i : offsets )
+		if ( i < size && frame[i].val )
+			other->frame[i].val = frame[i].val->Clone();
+
+	return other;
+	}
+
 static bool val_is_func(const zeek::ValPtr& v, ScriptFunc* func)
 	{
 	if ( v->GetType()->Tag() != zeek::TYPE_FUNC )
@@ -105,6 +105,16 @@ public:
 	 */
 	void Reset(int startIdx);
 
+	/**
+	 * Prepares the frame for reuse by another invocation of the same
+	 * function. This clears all elements as well as the trigger, call,
+	 * and debugger state. The frame must not have a closure.
+	 *
+	 * @param fn_args the arguments of the new invocation, or null while
+	 * the frame sits unused.
+	 */
+	void Recycle(const zeek::Args* fn_args);
+
 	/**
 	 * Describes the frame and all of its values.
 	 */
@@ -161,6 +171,16 @@ public:
 	 */
 	Frame* Clone() const;
 
+	/**
+	 * Like Clone(), but only copies the values at the given offsets,
+	 * leaving all others null. Frames that look up values by name
+	 * instead of offset get cloned entirely.
+	 *
+	 * @param offsets the offsets of the values to copy.
+	 * @return a copy of this frame.
+	 */
+	Frame* CloneOffsets(const std::vector<int>& offsets) const;
+
 	/**
 	 * Clones a Frame, only making copies of the values associated with
 	 * the IDs in selection. Cloning a frame does not deep-copy its
@@ -0,0 +1,113 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "FrozenTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Dict.h"
+#include "Val.h"
+
+namespace zeek::detail {
+
+FrozenTable::FrozenTable(const PDict<TableEntryVal>& entries, bool is_set)
+	{
+	struct Entry {
+		const void* key;
+		int key_size;
+		hash_t hash;
+		const TableEntryVal* val;
+	};
+
+	std::vector<Entry> sorted;
+	sorted.reserve(entries.Length());
+	size_t key_bytes = 0;
+
+	IterCookie* c = entries.InitForIteration();
+	HashKey* k;
+	TableEntryVal* v;
+
+	// The keys are copied before the iteration ends, so the ones the
+	// iteration hands out need to live until then.
+	std::vector<std::unique_ptr<HashKey>> iter_keys;
+	iter_keys.reserve(entries.Length());
+
+	while ( (v = entries.NextEntry(k, c)) )
+		{
+		iter_keys.emplace_back(k);
+		sorted.push_back({k->Key(), k->Size(), k->Hash(), v});
+		key_bytes += k->Size();
+		}
+
+	std::sort(sorted.begin(), sorted.end(),
+	          [](const Entry& a, const Entry& b) { return a.hash < b.hash; });
+
+	size = sorted.size();
+	block_size = size * sizeof(hash_t) + (size + 1) * sizeof(uint32_t) + key_bytes;
+	block = std::make_unique<char[]>(block_size);
+
+	auto hash_block = reinterpret_cast<hash_t*>(block.get());
+	auto offset_block = reinterpret_cast<uint32_t*>(hash_block + size);
+	auto key_block = reinterpret_cast<char*>(offset_block + size + 1);
+
+	if ( ! is_set )
+		vals.reserve(size);
+
+	uint32_t offset = 0;
+
+	for ( int i = 0; i < size; ++i )
+		{
+		const auto& e = sorted[i];
+		hash_block[i] = e.hash;
+		offset_block[i] = offset;
+		memcpy(key_block + offset, e.key, e.key_size);
+		offset += e.key_size;
+
+		if ( ! is_set )
+			vals.push_back(e.val->GetVal());
+		}
+
+	offset_block[size] = offset;
+
+	hashes = hash_block;
+	offsets = offset_block;
+	keys = key_block;
+	}
+
+FrozenTable::~FrozenTable() = default;
+
+int FrozenTable::Find(const HashKey& k) const
+	{
+	auto first = std::lower_bound(hashes, hashes + size, k.Hash());
+
+	for ( auto h = first; h != hashes + size && *h == k.Hash(); ++h )
+		{
+		int i = h - hashes;
+
+		if ( KeySize(i) == k.Size() && memcmp(Key(i), k.Key(), k.Size()) == 0 )
+			return i;
+		}
+
+	return -1;
+	}
+
+const ValPtr& FrozenTable::Value(int i) const
+	{
+	return vals.empty() ? Val::nil : vals[i];
+	}
+
+void FrozenTable::Restore(PDict<TableEntryVal>* entries) const
+	{
+	entries->Reserve(size);
+
+	for ( int i = 0; i < size; ++i )
+		entries->InsertCopy(Key(i), KeySize(i), hashes[i], new TableEntryVal(Value(i)));
+	}
+
+unsigned int FrozenTable::MemoryAllocation() const
+	{
+	return padded_sizeof(*this) + pad_size(block_size) +
+		pad_size(vals.capacity() * sizeof(ValPtr));
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,108 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <memory>
+#include <vector>
+
+#include "Hash.h"
+#include "IntrusivePtr.h"
+
+namespace zeek {
+
+class Val;
+class TableEntryVal;
+template<typename T> class PDict;
+using ValPtr = IntrusivePtr<Val>;
+
+namespace detail {
+
+/**
+ * The entries of a table that got frozen, see TableVal::Freeze(). The
+ * keys are stored back to back in a single allocation, together with
+ * their hashes, sorted, and the offsets of the keys, so that an entry
+ * costs its key's bytes plus twelve bytes, rather than a dictionary slot,
+ * a copy of the key and a TableEntryVal each. Lookups are binary searches
+ * on the hashes.
+ *
+ * The values stay regular Vals, as table lookups hand them out as such.
+ * Sets don't have any.
+ */
+class FrozenTable {
+public:
+	/**
+	 * Copies the entries of a table.
+	 *
+	 * @param entries The table's entries.
+	 *
+	 * @param is_set True if the table is a set, so that there are no
+	 * values to keep.
+	 */
+	FrozenTable(const PDict<TableEntryVal>& entries, bool is_set);
+	~FrozenTable();
+
+	/**
+	 * @return The number of entries.
+	 */
+	int Size() const	{ return size; }
+
+	/**
+	 * Looks up an entry.
+	 *
+	 * @param k The key of the entry, as the table's CompositeHash
+	 * computes it.
+	 *
+	 * @return The position of the entry, or -1 if there is none.
+	 */
+	int Find(const HashKey& k) const;
+
+	/**
+	 * @return The hash of the key of the entry at a position.
+	 */
+	hash_t Hash(int i) const	{ return hashes[i]; }
+
+	/**
+	 * @return The bytes of the key of the entry at a position.
+	 */
+	const void* Key(int i) const	{ return keys + offsets[i]; }
+
+	/**
+	 * @return The size of the key of the entry at a position.
+	 */
+	int KeySize(int i) const	{ return offsets[i + 1] - offsets[i]; }
+
+	/**
+	 * @return The value of the entry at a position, or nil for sets.
+	 */
+	const ValPtr& Value(int i) const;
+
+	/**
+	 * Turns the entries back into ones of a table's dictionary.
+	 *
+	 * @param entries The dictionary to insert them into.
+	 */
+	void Restore(PDict<TableEntryVal>* entries) const;
+
+	/**
+	 * @return The number of bytes allocated for the entries, not
+	 * counting what their values allocate.
+	 */
+	unsigned int MemoryAllocation() const;
+
+private:
+	int size = 0;
+	size_t block_size = 0;
+
+	// One allocation holding all of the following.
+	std::unique_ptr<char[]> block;
+	const hash_t* hashes = nullptr;		// sorted
+	const uint32_t* offsets = nullptr;	// into keys, one more than entries
+	const char* keys = nullptr;
+
+	std::vector<ValPtr> vals;	// in the order of the keys; empty for sets
+};
+
+} // namespace detail
+} // namespace zeek
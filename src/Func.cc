@@ -48,6 +48,7 @@
 #include "Sessions.h"
 #include "RE.h"
 #include "Event.h"
+#include "EventFilter.h"
 #include "Traverse.h"
 #include "Reporter.h"
 #include "plugin/Manager.h"
@@ -74,7 +75,6 @@ extern	RETSIGTYPE sig_handler(int signo);
 namespace zeek::detail {
 std::vector<CallInfo> call_stack;
 bool did_builtin_init = false;
-static const std::pair<bool, zeek::ValPtr> empty_hook_result(false, nullptr);
 } // namespace zeek::detail
 
 namespace zeek {
@@ -141,11 +141,34 @@ Func::~Func() = default;
 
 void Func::AddBody(zeek::detail::StmtPtr /* new_body */,
                    const std::vector<zeek::detail::IDPtr>& /* new_inits */,
-                   size_t /* new_frame_size */, int /* priority */)
+                   size_t /* new_frame_size */, int /* priority */,
+                   zeek::detail::EventFilterPtr /* filter */)
 	{
 	Internal("Func::AddBody called");
 	}
 
+bool Func::HasBodiesFor(const zeek::Args& args) const
+	{
+	for ( const auto& body : bodies )
+		if ( ! body.filter || body.filter->Accepts(args) )
+			return true;
+
+	return false;
+	}
+
+void Func::ReplaceBody(const zeek::detail::StmtPtr& old_body,
+                       zeek::detail::StmtPtr new_body)
+	{
+	for ( auto& body : bodies )
+		{
+		if ( body.stmts == old_body )
+			{
+			body.stmts = std::move(new_body);
+			return;
+			}
+		}
+	}
+
 void Func::SetScope(zeek::detail::ScopePtr newscope)
 	{
 	scope = std::move(newscope);
@@ -296,7 +319,8 @@ namespace detail {
 
 ScriptFunc::ScriptFunc(const zeek::detail::IDPtr& arg_id, zeek::detail::StmtPtr arg_body,
                        const std::vector<zeek::detail::IDPtr>& aggr_inits,
-                       size_t arg_frame_size, int priority)
+                       size_t arg_frame_size, int priority,
+                       zeek::detail::EventFilterPtr filter)
 	: Func(SCRIPT_FUNC)
 	{
 	name = arg_id->Name();
@@ -308,8 +332,15 @@ ScriptFunc::ScriptFunc(const zeek::detail::IDPtr& arg_id, zeek::detail::StmtPtr
 		Body b;
 		b.stmts = AddInits(std::move(arg_body), aggr_inits);
 		b.priority = priority;
+		b.filter = std::move(filter);
 		bodies.push_back(b);
 		}
+
+	UpdateFrameEscape();
+	}
+
+ScriptFunc::ScriptFunc() : zeek::Func(SCRIPT_FUNC)
+	{
 	}
 
 ScriptFunc::~ScriptFunc()
@@ -334,14 +365,17 @@ zeek::ValPtr ScriptFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent) c
 	if ( sample_logger )
 		sample_logger->FunctionSeen(this);
 
-	auto [handled, hook_result] = PLUGIN_HOOK_WITH_RESULT(HOOK_CALL_FUNCTION,
-	                                                      HookCallFunction(this, parent, args),
-	                                                      empty_hook_result);
+	// Without any plugin hooking calls, this is all that's left of the
+	// hook on the path of a call.
+	if ( plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_CALL_FUNCTION) )
+		{
+		auto [handled, hook_result] = plugin_mgr->HookCallFunction(this, parent, args);
 
-	CheckPluginResult(handled, hook_result, Flavor());
+		CheckPluginResult(handled, hook_result, Flavor());
 
-	if ( handled )
-		return hook_result;
+		if ( handled )
+			return hook_result;
+		}
 
 	if ( bodies.empty() )
 		{
@@ -350,7 +384,7 @@ zeek::ValPtr ScriptFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent) c
 		return Flavor() == zeek::FUNC_FLAVOR_HOOK ? zeek::val_mgr->True() : nullptr;
 		}
 
-	auto f = zeek::make_intrusive<zeek::detail::Frame>(frame_size, this, args);
+	auto f = NewFrame(args);
 
 	if ( closure )
 		f->CaptureClosure(closure, outer_ids);
@@ -362,6 +396,10 @@ zeek::ValPtr ScriptFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent) c
 		f->SetCall(parent->GetCall());
 		}
 
+	// Ticks since scripts last ran belong to the core.
+	if ( ScriptSampler::pending && script_sampler && g_frame_stack.empty() )
+		script_sampler->SampleCore();
+
 	g_frame_stack.push_back(f.get());	// used for backtracing
 	const zeek::detail::CallExpr* call_expr = parent ? parent->GetCall() : nullptr;
 	call_stack.emplace_back(CallInfo{call_expr, this, *args});
@@ -380,6 +418,9 @@ zeek::ValPtr ScriptFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent) c
 
 	for ( const auto& body : bodies )
 		{
+		if ( body.filter && ! body.filter->Accepts(*args) )
+			continue;
+
 		if ( sample_logger )
 			sample_logger->LocationSeen(
 				body.stmts->GetLocationInfo());
@@ -396,6 +437,11 @@ zeek::ValPtr ScriptFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent) c
 
 		f->Reset(args->size());
 
+		// Event and hook bodies are told apart by their location.
+		EventProfileScope eps(event_profiler, body.stmts.get(), Name(),
+		                      Flavor() == zeek::FUNC_FLAVOR_FUNCTION ?
+		                      nullptr : body.stmts->GetLocationInfo());
+
 		try
 			{
 			result = body.stmts->Exec(f.get(), flow);
@@ -465,13 +511,147 @@ zeek::ValPtr ScriptFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent) c
 		}
 
 	g_frame_stack.pop_back();
+	ReleaseFrame(std::move(f));
+
+	return result;
+	}
+
+const zeek::detail::Expr* ScriptFunc::ReturnedExpr() const
+	{
+	if ( Flavor() != zeek::FUNC_FLAVOR_FUNCTION || bodies.size() != 1 ||
+	     bodies[0].filter || closure )
+		return nullptr;
+
+	if ( frame_size != static_cast<size_t>(GetType()->Params()->NumFields()) )
+		return nullptr;
+
+	const zeek::detail::Stmt* s = bodies[0].stmts.get();
+
+	if ( s->Tag() == STMT_LIST )
+		{
+		const auto& stmts = s->AsStmtList()->Stmts();
+
+		if ( stmts.length() != 1 )
+			return nullptr;
+
+		s = stmts[0];
+		}
+
+	if ( s->Tag() != STMT_RETURN )
+		return nullptr;
+
+	return static_cast<const zeek::detail::ReturnStmt*>(s)->StmtExpr();
+	}
+
+zeek::ValPtr ScriptFunc::EvalInlined(const zeek::detail::Expr* body,
+                                     const zeek::detail::ListExpr* args,
+                                     zeek::detail::Frame* parent) const
+	{
+	auto f = NewFrame(nullptr);
+	const auto& exprs = args->Exprs();
+
+	for ( int i = 0; i < exprs.length(); ++i )
+		{
+		auto v = exprs[i]->Eval(parent);
+
+		if ( ! v )
+			{
+			ReleaseFrame(std::move(f));
+			return nullptr;
+			}
+
+		f->SetElement(i, std::move(v));
+		}
+
+	zeek::ValPtr result;
+
+	try
+		{
+		result = body->Eval(f.get());
+		}
+
+	catch ( InterpreterException& e )
+		{
+		ReleaseFrame(std::move(f));
+		throw;
+		}
 
+	ReleaseFrame(std::move(f));
 	return result;
 	}
 
+bool ScriptFunc::CallsObserved()
+	{
+	return segment_logger || sample_logger || script_sampler ||
+	       event_profiler || g_trace_state.DoTrace() ||
+	       plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_CALL_FUNCTION);
+	}
+
+zeek::detail::FramePtr ScriptFunc::NewFrame(const zeek::Args* args) const
+	{
+	if ( frame_pool.empty() )
+		return zeek::make_intrusive<zeek::detail::Frame>(frame_size, this, args);
+
+	auto f = std::move(frame_pool.back());
+	frame_pool.pop_back();
+	f->Recycle(args);
+	return f;
+	}
+
+void ScriptFunc::ReleaseFrame(zeek::detail::FramePtr f) const
+	{
+	// Recursion rarely goes deep, so a few frames suffice.
+	constexpr size_t MAX_POOLED_FRAMES = 8;
+
+	// Anything still referencing the frame, such as a lambda or the
+	// debugger, gets to keep it to itself.
+	if ( frame_escapes || closure || g_policy_debug || f->RefCnt() != 1 ||
+	     frame_pool.size() >= MAX_POOLED_FRAMES )
+		return;
+
+	// Release the frame's values right away rather than on reuse.
+	f->Recycle(nullptr);
+	frame_pool.push_back(std::move(f));
+	}
+
+class LambdaFinder : public TraversalCallback {
+public:
+	TraversalCode PreExpr(const zeek::detail::Expr* expr) override
+		{
+		if ( expr->Tag() != zeek::detail::EXPR_LAMBDA )
+			return TC_CONTINUE;
+
+		found = true;
+		return TC_ABORTALL;
+		}
+
+	bool found = false;
+};
+
+void ScriptFunc::UpdateFrameEscape()
+	{
+	// Frames are sized for the largest body, so any pooled ones may be
+	// too small now.
+	frame_pool.clear();
+	frame_escapes = false;
+
+	for ( const auto& body : bodies )
+		{
+		LambdaFinder lf;
+		body.stmts->Traverse(&lf);
+
+		if ( lf.found )
+			{
+			frame_escapes = true;
+			break;
+			}
+		}
+	}
+
 void ScriptFunc::AddBody(zeek::detail::StmtPtr new_body,
                          const std::vector<zeek::detail::IDPtr>& new_inits,
-                         size_t new_frame_size, int priority)
+                         size_t new_frame_size, int priority,
+                         zeek::detail::EventFilterPtr filter)
 	{
 	if ( new_frame_size > frame_size )
 		frame_size = new_frame_size;
@@ -493,9 +673,12 @@ void ScriptFunc::AddBody(zeek::detail::StmtPtr new_body,
 	Body b;
 	b.stmts = new_body;
 	b.priority = priority;
+	b.filter = std::move(filter);
 
 	bodies.push_back(b);
 	sort(bodies.begin(), bodies.end());
+
+	UpdateFrameEscape();
 	}
 
 void ScriptFunc::AddClosure(id_list ids, zeek::detail::Frame* f)
@@ -569,6 +752,7 @@ zeek::FuncPtr ScriptFunc::DoClone()
 	CopyStateInto(other.get());
 
 	other->frame_size = frame_size;
+	other->frame_escapes = frame_escapes;
 	other->closure = closure ? closure->SelectiveClone(outer_ids, this) : nullptr;
 	other->weak_closure_ref = false;
 	other->outer_ids = outer_ids;
@@ -641,18 +825,20 @@ zeek::ValPtr BuiltinFunc::Invoke(zeek::Args* args, zeek::detail::Frame* parent)
 	DEBUG_MSG("Function: %s\n", Name());
 #endif
 	SegmentProfiler prof(segment_logger, Name());
+	EventProfileScope eps(event_profiler, this, Name());
 
 	if ( sample_logger )
 		sample_logger->FunctionSeen(this);
 
-	auto [handled, hook_result] = PLUGIN_HOOK_WITH_RESULT(HOOK_CALL_FUNCTION,
-	                                                      HookCallFunction(this, parent, args),
-	                                                      empty_hook_result);
+	if ( plugin_mgr->HavePluginForHook(zeek::plugin::HOOK_CALL_FUNCTION) )
+		{
+		auto [handled, hook_result] = plugin_mgr->HookCallFunction(this, parent, args);
 
-	CheckPluginResult(handled, hook_result, zeek::FUNC_FLAVOR_FUNCTION);
+		CheckPluginResult(handled, hook_result, zeek::FUNC_FLAVOR_FUNCTION);
 
-	if ( handled )
-		return hook_result;
+		if ( handled )
+			return hook_result;
+		}
 
 	if ( g_trace_state.DoTrace() )
 		{
@@ -748,6 +934,12 @@ static int get_func_priority(const std::vector<zeek::detail::AttrPtr>& attrs)
 		if ( a->Tag() == zeek::detail::ATTR_DEPRECATED )
 			continue;
 
+		// Handled by EventFilter::Build().
+		if ( a->Tag() == zeek::detail::ATTR_IF_FIELD ||
+		     a->Tag() == zeek::detail::ATTR_IF_PORT ||
+		     a->Tag() == zeek::detail::ATTR_IF_ANALYZER )
+			continue;
+
 		if ( a->Tag() != zeek::detail::ATTR_PRIORITY )
 			{
 			a->Error("illegal attribute for function body");
@@ -785,6 +977,7 @@ function_ingredients::function_ingredients(zeek::detail::ScopePtr scope, zeek::d
 	const auto& attrs = this->scope->Attrs();
 
 	priority = (attrs ? get_func_priority(*attrs) : 0);
+	filter = (attrs ? EventFilter::Build(*attrs, id->GetType()->AsFuncType()) : nullptr);
 	this->body = std::move(body);
 	}
 
@@ -950,10 +1143,18 @@ void init_builtin_funcs()
 	GapStats = zeek::id::find_type<zeek::RecordType>("GapStats");
 	EventStats = zeek::id::find_type<zeek::RecordType>("EventStats");
 	TimerStats = zeek::id::find_type<zeek::RecordType>("TimerStats");
+	TriggerStats = zeek::id::find_type<zeek::RecordType>("TriggerStats");
+	ValPoolStats = zeek::id::find_type<zeek::RecordType>("ValPoolStats");
+	MemoryArenaStats = zeek::id::find_type<zeek::RecordType>("MemoryArenaStats");
+	HugePageStats = zeek::id::find_type<zeek::RecordType>("HugePageStats");
 	FileAnalysisStats = zeek::id::find_type<zeek::RecordType>("FileAnalysisStats");
 	ThreadStats = zeek::id::find_type<zeek::RecordType>("ThreadStats");
 	BrokerStats = zeek::id::find_type<zeek::RecordType>("BrokerStats");
 	ReporterStats = zeek::id::find_type<zeek::RecordType>("ReporterStats");
+	LogWriterStats = zeek::id::find_type<zeek::RecordType>("LogWriterStats");
+	AnalyzerStats = zeek::id::find_type<zeek::RecordType>("AnalyzerStats");
+	HeavyConnection = zeek::id::find_type<zeek::RecordType>("HeavyConnection");
+	PacketLatencyStats = zeek::id::find_type<zeek::RecordType>("PacketLatencyStats");
 
 	var_sizes = zeek::id::find_type("var_sizes")->AsTableType();
 
@@ -21,14 +21,19 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(Scope, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Val, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Stmt, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(CallExpr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Expr, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(ListExpr, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(ID, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(FuncType, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Frame, zeek::detail);
 
 namespace zeek::detail {
+class EventFilter;
 using ScopePtr = zeek::IntrusivePtr<detail::Scope>;
 using IDPtr = zeek::IntrusivePtr<ID>;
 using StmtPtr = zeek::IntrusivePtr<Stmt>;
+using FramePtr = zeek::IntrusivePtr<Frame>;
+using EventFilterPtr = std::shared_ptr<EventFilter>;
 }
 
 namespace caf {
@@ -64,6 +69,7 @@ public:
 	struct Body {
 		zeek::detail::StmtPtr stmts;
 		int priority;
+		zeek::detail::EventFilterPtr filter;	// null if always run
 		bool operator<(const Body& other) const
 			{ return priority > other.priority; } // reverse sort
 	};
@@ -71,6 +77,12 @@ public:
 	const std::vector<Body>& GetBodies() const	{ return bodies; }
 	bool HasBodies() const	{ return bodies.size(); }
 
+	/**
+	 * Returns whether any of the function's bodies runs for the given
+	 * arguments, as determined by the event filters of its bodies.
+	 */
+	bool HasBodiesFor(const zeek::Args& args) const;
+
 	[[deprecated("Remove in v4.1. Use Invoke() instead.")]]
 	zeek::Val* Call(val_list* args, zeek::detail::Frame* parent = nullptr) const;
 
@@ -99,7 +111,18 @@ public:
 	// Add a new event handler to an existing function (event).
 	virtual void AddBody(zeek::detail::StmtPtr new_body,
 	                     const std::vector<zeek::detail::IDPtr>& new_inits,
-	                     size_t new_frame_size, int priority = 0);
+	                     size_t new_frame_size, int priority = 0,
+	                     zeek::detail::EventFilterPtr filter = nullptr);
+
+	/**
+	 * Replaces one of the function's bodies, keeping its priority.
+	 *
+	 * @param old_body The statements of the body to replace.
+	 *
+	 * @param new_body The statements to execute instead.
+	 */
+	void ReplaceBody(const zeek::detail::StmtPtr& old_body,
+	                 zeek::detail::StmtPtr new_body);
 
 	virtual void SetScope(zeek::detail::ScopePtr newscope);
 	virtual zeek::detail::Scope* GetScope() const		{ return scope.get(); }
@@ -151,7 +174,8 @@ class ScriptFunc final : public zeek::Func {
 public:
 	ScriptFunc(const zeek::detail::IDPtr& id, zeek::detail::StmtPtr body,
 	        const std::vector<zeek::detail::IDPtr>& inits,
-	        size_t frame_size, int priority);
+	        size_t frame_size, int priority,
+	        zeek::detail::EventFilterPtr filter = nullptr);
 
 	~ScriptFunc() override;
 
@@ -189,16 +213,44 @@ public:
 
 	void AddBody(zeek::detail::StmtPtr new_body,
 	             const std::vector<zeek::detail::IDPtr>& new_inits,
-	             size_t new_frame_size, int priority) override;
+	             size_t new_frame_size, int priority,
+	             zeek::detail::EventFilterPtr filter) override;
 
 	/** Sets this function's outer_id list. */
 	void SetOuterIDs(id_list ids)
 		{ outer_ids = std::move(ids); }
 
+	/**
+	 * Returns the expression that the function returns if it has a
+	 * single body doing nothing but that, and no locals besides its
+	 * parameters. Calls to such functions can get inlined.
+	 */
+	const zeek::detail::Expr* ReturnedExpr() const;
+
+	/**
+	 * Evaluates an inlined call: binds the values of the arguments to
+	 * the parameters and evaluates the expression ReturnedExpr()
+	 * returned, skipping the rest of what Invoke() does.
+	 *
+	 * @param body the function's returned expression.
+	 * @param args the arguments of the call.
+	 * @param parent the frame of the caller.
+	 * @return the result of the call.
+	 */
+	zeek::ValPtr EvalInlined(const zeek::detail::Expr* body,
+	                         const zeek::detail::ListExpr* args,
+	                         zeek::detail::Frame* parent) const;
+
+	/**
+	 * Returns whether calls currently need to go through Invoke(), as
+	 * plugins, profiling or tracing watch them.
+	 */
+	static bool CallsObserved();
+
 	void Describe(ODesc* d) const override;
 
 protected:
-	ScriptFunc() : zeek::Func(SCRIPT_FUNC)	{}
+	ScriptFunc();
 	zeek::detail::StmtPtr AddInits(
 		zeek::detail::StmtPtr body,
 		const std::vector<zeek::detail::IDPtr>& inits);
@@ -217,8 +269,28 @@ protected:
 	void SetClosureFrame(zeek::detail::Frame* f);
 
 private:
+	// Returns a frame for a new invocation, reusing a pooled one if
+	// possible.
+	zeek::detail::FramePtr NewFrame(const zeek::Args* args) const;
+
+	// Returns a frame to the pool once an invocation has finished,
+	// unless something still references it.
+	void ReleaseFrame(zeek::detail::FramePtr f) const;
+
+	// Determines whether any body could capture its frame beyond the
+	// invocation, which rules out pooling frames.
+	void UpdateFrameEscape();
+
 	size_t frame_size;
 
+	// Set if frames may outlive their invocation, i.e., if a body
+	// contains a lambda that could capture them.
+	bool frame_escapes = false;
+
+	// Frames of finished invocations, cleared and ready for reuse. There
+	// may be more than one for recursive functions.
+	mutable std::vector<zeek::detail::FramePtr> frame_pool;
+
 	// List of the outer IDs used in the function.
 	id_list outer_ids;
 	// The frame the ScriptFunc was initialized in.
@@ -267,6 +339,7 @@ struct function_ingredients {
 	std::vector<IDPtr> inits;
 	int frame_size;
 	int priority;
+	EventFilterPtr filter;
 	ScopePtr scope;
 };
 
@@ -0,0 +1,180 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "FuncInline.h"
+
+#include <stdio.h>
+#include <map>
+
+#include "DebugLogger.h"
+#include "Expr.h"
+#include "Func.h"
+#include "ID.h"
+#include "Scope.h"
+#include "Stmt.h"
+#include "Traverse.h"
+#include "Val.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// Bounds the size of the expressions that get inlined, counted in
+// expression nodes.
+constexpr int max_inlined_expr_size = 32;
+
+// Checks whether an expression is small and calls nothing, so that
+// evaluating it can't get back to any call site.
+class LeafChecker : public TraversalCallback {
+public:
+	TraversalCode PreExpr(const Expr* e) override
+		{
+		switch ( e->Tag() ) {
+		case EXPR_CALL:
+		case EXPR_LAMBDA:
+		case EXPR_EVENT:
+		case EXPR_SCHEDULE:
+			is_leaf = false;
+			return TC_ABORTALL;
+
+		default:
+			break;
+		}
+
+		if ( ++size > max_inlined_expr_size )
+			{
+			is_leaf = false;
+			return TC_ABORTALL;
+			}
+
+		return TC_CONTINUE;
+		}
+
+	bool is_leaf = true;
+	int size = 0;
+};
+
+class CallInliner : public TraversalCallback {
+public:
+	explicit CallInliner(bool arg_report) : report(arg_report)	{ }
+
+	TraversalCode PreExpr(const Expr* e) override;
+
+	int NumInlined() const	{ return num_inlined; }
+
+private:
+	// Returns the expression to inline for calls to the function that
+	// id holds, or null if its calls can't get inlined.
+	const Expr* InlinedExpr(const ID* id);
+
+	bool report;
+	int num_inlined = 0;
+
+	// Previous outcomes of InlinedExpr(), per function.
+	std::map<const ScriptFunc*, const Expr*> inlineable;
+};
+
+const Expr* CallInliner::InlinedExpr(const ID* id)
+	{
+	// Once parsing is done, only &redef lets anything change a
+	// constant.
+	if ( ! id->IsGlobal() || ! id->IsConst() || id->IsOption() ||
+	     id->IsRedefinable() || ! id->HasVal() )
+		return nullptr;
+
+	auto func = id->GetVal()->AsFunc();
+
+	if ( func->GetKind() != zeek::Func::SCRIPT_FUNC )
+		return nullptr;
+
+	auto sf = static_cast<const ScriptFunc*>(func);
+	auto it = inlineable.find(sf);
+
+	if ( it != inlineable.end() )
+		return it->second;
+
+	auto body = sf->ReturnedExpr();
+
+	if ( body )
+		{
+		LeafChecker lc;
+		body->Traverse(&lc);
+
+		if ( ! lc.is_leaf )
+			body = nullptr;
+		}
+
+	inlineable[sf] = body;
+	return body;
+	}
+
+TraversalCode CallInliner::PreExpr(const Expr* e)
+	{
+	if ( e->Tag() != EXPR_CALL )
+		return TC_CONTINUE;
+
+	auto call = static_cast<const CallExpr*>(e);
+
+	if ( call->Func()->Tag() != EXPR_NAME )
+		return TC_CONTINUE;
+
+	auto id = static_cast<const NameExpr*>(call->Func())->Id();
+
+	if ( id->GetType()->Tag() != zeek::TYPE_FUNC )
+		return TC_CONTINUE;
+
+	auto body = InlinedExpr(id);
+
+	if ( ! body )
+		return TC_CONTINUE;
+
+	auto sf = static_cast<const ScriptFunc*>(id->GetVal()->AsFunc());
+
+	if ( call->Args()->Exprs().length() !=
+	     sf->GetType()->Params()->NumFields() )
+		return TC_CONTINUE;
+
+	const_cast<CallExpr*>(call)->Inline(sf, {zeek::NewRef{}, const_cast<Expr*>(body)});
+	++num_inlined;
+
+	if ( report )
+		{
+		auto loc = call->GetLocationInfo();
+
+		fprintf(stderr, "inline-funcs: %s, line %d: inlined call to %s\n",
+		        loc->filename ? loc->filename : "<no location>",
+		        loc->first_line, id->Name());
+		}
+
+	return TC_CONTINUE;
+	}
+
+} // namespace
+
+void inline_script_functions(bool report)
+	{
+	CallInliner ci(report);
+
+	for ( const auto& [name, id] : global_scope()->Vars() )
+		{
+		if ( ! id->HasVal() || ! id->GetType() ||
+		     id->GetType()->Tag() != zeek::TYPE_FUNC )
+			continue;
+
+		auto func = id->GetVal()->AsFunc();
+
+		if ( func->GetKind() != zeek::Func::SCRIPT_FUNC )
+			continue;
+
+		for ( const auto& body : func->GetBodies() )
+			body.stmts->Traverse(&ci);
+		}
+
+	if ( report )
+		fprintf(stderr, "inline-funcs: inlined %d calls\n", ci.NumInlined());
+
+	DBG_LOG(DBG_SCRIPTS, "inlined %d calls to script functions",
+	        ci.NumInlined());
+	}
+
+} // namespace zeek::detail
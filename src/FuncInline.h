@@ -0,0 +1,26 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+namespace zeek::detail {
+
+/**
+ * Inlines calls to small script functions in the bodies of all global
+ * script functions, events, and hooks. A call gets inlined if it targets
+ * a global function that can't get redefined anymore and whose only body
+ * returns an expression of its parameters that doesn't call anything
+ * itself, such as Site::is_local_addr(). Such a call evaluates that
+ * expression right away, without the argument list, call stack entries,
+ * and statement execution of a regular invocation. This needs to run
+ * after all scripts have been loaded but before any of them execute.
+ *
+ * Inlined calls don't show up in backtraces and reporter call stacks.
+ * They fall back to regular invocations whenever plugins, profiling or
+ * tracing observe function calls.
+ *
+ * @param report Whether to print each inlined call to stderr, for
+ * debugging.
+ */
+void inline_script_functions(bool report);
+
+} // namespace zeek::detail
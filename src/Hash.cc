@@ -49,7 +49,15 @@ void KeyedHash::InitOptions()
 
 hash64_t KeyedHash::Hash64(const void* bytes, uint64_t size)
 	{
+#ifdef ENABLE_HIGHWAYHASH_HASH64
+	// Dispatches to the best implementation the CPU supports (AVX2,
+	// SSE4.1, NEON, or portable), determined once on first use.
+	hash64_t result;
+	highwayhash::InstructionSets::Run<highwayhash::HighwayHash>(shared_highwayhash_key, reinterpret_cast<const char *>(bytes), size, &result);
+	return result;
+#else
 	return highwayhash::SipHash(shared_siphash_key, reinterpret_cast<const char *>(bytes), size);
+#endif
 	}
 
 void KeyedHash::Hash128(const void* bytes, uint64_t size, hash128_t* result)
@@ -53,6 +53,10 @@ public:
 	 * This should be used for internal hashes that do not have to be stable over
 	 * the cluster/runs - like, e.g. connection ID generation.
 	 *
+	 * This uses SipHash by default. When configured with --enable-highwayhash,
+	 * it uses HighwayHash instead, with the vector instructions that the CPU
+	 * supports.
+	 *
 	 * @param bytes Bytes to hash
 	 *
 	 * @param size Size of bytes
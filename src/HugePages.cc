@@ -0,0 +1,237 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "HugePages.h"
+
+#include <sys/mman.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+namespace {
+
+// Transparent huge pages need regions aligned to their size.
+constexpr size_t THP_SIZE = 2 * 1024 * 1024;
+
+struct Region {
+	size_t len;
+	bool hugetlb;
+	bool transparent;
+};
+
+std::mutex regions_mutex;
+std::unordered_map<void*, Region> regions;
+HugePageStats stats;
+
+bool use_transparent = true;
+size_t hugetlb_size = 0;
+
+size_t round_up(size_t n, size_t to)
+	{
+	return (n + to - 1) / to * to;
+	}
+
+void* map_hugetlb(size_t len)
+	{
+#if defined(MAP_HUGETLB)
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#if defined(MAP_HUGE_SHIFT)
+	// Selects the page size other than the default one.
+	flags |= __builtin_ctzll(hugetlb_size) << MAP_HUGE_SHIFT;
+#endif
+	void* p = mmap(nullptr, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+	return p == MAP_FAILED ? nullptr : p;
+#else
+	return nullptr;
+#endif
+	}
+
+// Maps len bytes aligned to THP_SIZE by mapping more and trimming the rest.
+void* map_aligned(size_t len)
+	{
+	size_t map_len = len + THP_SIZE;
+	void* m = mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+	               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if ( m == MAP_FAILED )
+		return nullptr;
+
+	auto start = reinterpret_cast<uintptr_t>(m);
+	auto aligned = round_up(start, THP_SIZE);
+
+	if ( aligned > start )
+		munmap(m, aligned - start);
+
+	if ( auto end = start + map_len; end > aligned + len )
+		munmap(reinterpret_cast<void*>(aligned + len), end - aligned - len);
+
+	return reinterpret_cast<void*>(aligned);
+	}
+
+uint64_t read_anon_huge_pages()
+	{
+	uint64_t kb = 0;
+
+#ifdef __linux__
+	FILE* f = fopen("/proc/self/smaps_rollup", "r");
+
+	if ( ! f )
+		return 0;
+
+	char line[256];
+
+	while ( fgets(line, sizeof(line), f) )
+		{
+		unsigned long long n;
+
+		if ( sscanf(line, "AnonHugePages: %llu kB", &n) == 1 )
+			{
+			kb = n;
+			break;
+			}
+		}
+
+	fclose(f);
+#endif
+
+	return kb * 1024;
+	}
+
+}
+
+void configure_huge_pages(bool transparent, size_t hugetlb_page_size)
+	{
+	std::lock_guard<std::mutex> lock(regions_mutex);
+	use_transparent = transparent;
+
+	// Only powers of two make for page sizes.
+	if ( hugetlb_page_size & (hugetlb_page_size - 1) )
+		hugetlb_page_size = 0;
+
+	hugetlb_size = hugetlb_page_size;
+	}
+
+void* huge_page_alloc(size_t size)
+	{
+	if ( size < HUGE_PAGE_MIN_REGION )
+		{
+		if ( auto p = malloc(size ? size : 1) )
+			return p;
+
+		throw std::bad_alloc();
+		}
+
+	std::lock_guard<std::mutex> lock(regions_mutex);
+	Region r{0, false, false};
+	void* p = nullptr;
+
+	if ( hugetlb_size )
+		{
+		r.len = round_up(size, hugetlb_size);
+		p = map_hugetlb(r.len);
+		r.hugetlb = p != nullptr;
+		}
+
+	if ( ! p )
+		{
+		r.len = round_up(size, THP_SIZE);
+		p = map_aligned(r.len);
+
+		if ( ! p )
+			throw std::bad_alloc();
+
+#if defined(MADV_HUGEPAGE)
+		if ( use_transparent )
+			r.transparent = madvise(p, r.len, MADV_HUGEPAGE) == 0;
+#endif
+		}
+
+	regions[p] = r;
+	++stats.regions;
+	stats.mapped += r.len;
+
+	if ( r.hugetlb )
+		stats.hugetlb += r.len;
+
+	if ( r.transparent )
+		stats.transparent += r.len;
+
+	return p;
+	}
+
+void huge_page_free(void* ptr, size_t size)
+	{
+	if ( ! ptr )
+		return;
+
+	if ( size < HUGE_PAGE_MIN_REGION )
+		{
+		free(ptr);
+		return;
+		}
+
+	std::lock_guard<std::mutex> lock(regions_mutex);
+	auto i = regions.find(ptr);
+
+	if ( i == regions.end() )
+		return;
+
+	const auto& r = i->second;
+	munmap(ptr, r.len);
+
+	--stats.regions;
+	stats.mapped -= r.len;
+
+	if ( r.hugetlb )
+		stats.hugetlb -= r.len;
+
+	if ( r.transparent )
+		stats.transparent -= r.len;
+
+	regions.erase(i);
+	}
+
+HugePageStats huge_page_stats()
+	{
+	HugePageStats s;
+
+		{
+		std::lock_guard<std::mutex> lock(regions_mutex);
+		s = stats;
+		}
+
+	s.anon_huge_pages = read_anon_huge_pages();
+	return s;
+	}
+
+TEST_CASE("huge page regions")
+	{
+	auto before = huge_page_stats();
+
+	auto small = static_cast<char*>(huge_page_alloc(100));
+	auto large = static_cast<char*>(huge_page_alloc(HUGE_PAGE_MIN_REGION + 1));
+	auto during = huge_page_stats();
+
+	CHECK(during.regions == before.regions + 1);
+	CHECK(during.mapped == before.mapped + 2 * HUGE_PAGE_MIN_REGION);
+	CHECK(reinterpret_cast<uintptr_t>(large) % THP_SIZE == 0);
+	CHECK(large[HUGE_PAGE_MIN_REGION] == 0);
+
+	memset(small, 1, 100);
+	memset(large, 1, HUGE_PAGE_MIN_REGION + 1);
+
+	huge_page_free(small, 100);
+	huge_page_free(large, HUGE_PAGE_MIN_REGION + 1);
+	huge_page_free(nullptr, HUGE_PAGE_MIN_REGION);
+	auto after = huge_page_stats();
+
+	CHECK(after.regions == before.regions);
+	CHECK(after.mapped == before.mapped);
+	}
+
+} // namespace zeek::detail
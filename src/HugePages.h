@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace zeek::detail {
+
+/**
+ * Regions at least this large get mapped so that they can be backed by
+ * huge pages. Smaller ones come from malloc().
+ */
+constexpr size_t HUGE_PAGE_MIN_REGION = 2 * 1024 * 1024;
+
+/**
+ * Statistics of the regions allocated with huge_page_alloc().
+ */
+struct HugePageStats {
+	uint64_t regions = 0;           ///< Live regions mapped separately.
+	uint64_t mapped = 0;            ///< Bytes mapped for them.
+	uint64_t hugetlb = 0;           ///< Bytes of those in explicit huge pages.
+	uint64_t transparent = 0;       ///< Bytes of those advised for transparent huge pages.
+	uint64_t anon_huge_pages = 0;   ///< Bytes of the process in transparent huge pages (Linux only).
+};
+
+/**
+ * Sets how huge_page_alloc() maps regions from now on. Until called,
+ * regions are advised for transparent huge pages.
+ *
+ * @param transparent Whether to advise the kernel to back regions with
+ * transparent huge pages.
+ * @param hugetlb_page_size If non-zero, the size of explicit huge pages,
+ * e.g. 2MB or 1GB, to map regions with first. That needs pages of that
+ * size reserved with the kernel, and falls back to normal pages if none
+ * are left.
+ */
+void configure_huge_pages(bool transparent, size_t hugetlb_page_size);
+
+/**
+ * Allocates memory for a large, long-lived and randomly accessed region,
+ * which benefits from getting backed by huge pages with fewer TLB misses.
+ * Regions of at least HUGE_PAGE_MIN_REGION bytes get mapped and zeroed,
+ * smaller ones come from malloc().
+ *
+ * @param size The number of bytes to allocate.
+ * @return The memory. Throws std::bad_alloc if there is none left.
+ */
+void* huge_page_alloc(size_t size);
+
+/**
+ * Releases memory allocated by huge_page_alloc().
+ *
+ * @param ptr The memory, which may be null.
+ * @param size The size passed to huge_page_alloc().
+ */
+void huge_page_free(void* ptr, size_t size);
+
+/**
+ * @return The current statistics of regions allocated with
+ * huge_page_alloc().
+ */
+HugePageStats huge_page_stats();
+
+/**
+ * An allocator for containers using huge_page_alloc().
+ */
+template <typename T>
+struct HugePageAllocator {
+	using value_type = T;
+
+	HugePageAllocator() = default;
+
+	template <typename U>
+	HugePageAllocator(const HugePageAllocator<U>&)	{ }
+
+	T* allocate(size_t n)
+		{ return static_cast<T*>(huge_page_alloc(n * sizeof(T))); }
+
+	void deallocate(T* p, size_t n)
+		{ huge_page_free(p, n * sizeof(T)); }
+
+	template <typename U>
+	bool operator==(const HugePageAllocator<U>&) const	{ return true; }
+
+	template <typename U>
+	bool operator!=(const HugePageAllocator<U>&) const	{ return false; }
+};
+
+} // namespace zeek::detail
@@ -0,0 +1,537 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "HyperscanEngine.h"
+
+#ifdef USE_HYPERSCAN
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hs/hs.h>
+
+#include "Reporter.h"
+
+namespace zeek::detail {
+
+// Shared by all databases, as we only ever scan one at a time.
+static hs_scratch_t* scratch = nullptr;
+
+// Appends a byte to a Hyperscan expression, escaped.
+static void append_hex(std::string* out, int c)
+	{
+	char buf[8];
+	snprintf(buf, sizeof(buf), "\\x%02x", c & 0xff);
+	*out += buf;
+	}
+
+// Appends the value of the escape sequence at p, which follows its
+// backslash, the way that Zeek's pattern scanner reads it. Returns false
+// if it's incomplete.
+static bool append_escape(const char*& p, const char* end, std::string* out)
+	{
+	if ( p == end || *p == '\n' )
+		return false;
+
+	char c = *p++;
+
+	switch ( c ) {
+	case 'b': append_hex(out, '\b'); return true;
+	case 'f': append_hex(out, '\f'); return true;
+	case 'n': append_hex(out, '\n'); return true;
+	case 'r': append_hex(out, '\r'); return true;
+	case 't': append_hex(out, '\t'); return true;
+	case 'a': append_hex(out, '\a'); return true;
+	case 'v': append_hex(out, '\v'); return true;
+
+	case 'x':
+		if ( end - p < 2 || ! isxdigit(p[0]) || ! isxdigit(p[1]) )
+			return false;
+
+		*out += "\\x";
+		*out += *p++;
+		*out += *p++;
+		return true;
+
+	default:
+		break;
+	}
+
+	if ( c >= '0' && c <= '7' )
+		{
+		// The scanner takes all of the digits, of which only the
+		// first three count.
+		int v = c - '0';
+
+		for ( int i = 1; p < end && *p >= '0' && *p <= '7'; ++i, ++p )
+			if ( i < 3 )
+				v = (v << 3) | (*p - '0');
+
+		append_hex(out, v);
+		return true;
+		}
+
+	append_hex(out, c);
+	return true;
+	}
+
+// Translates the rest of a character class, following its '['.
+static bool translate_ccl(const char*& p, const char* end, std::string* out)
+	{
+	*out += '[';
+
+	if ( p < end && *p == '^' )
+		{
+		*out += '^';
+		++p;
+		}
+
+	for ( bool first = true; p < end; first = false )
+		{
+		char c = *p++;
+
+		if ( c == ']' && ! first )
+			{
+			*out += ']';
+			return true;
+			}
+
+		if ( c == '\n' )
+			return false;
+
+		if ( c == '\\' )
+			{
+			if ( ! append_escape(p, end, out) )
+				return false;
+			}
+
+		else if ( c == '[' && p < end && *p == ':' )
+			{
+			auto close = strstr(p, ":]");
+
+			if ( ! close || close >= end )
+				return false;
+
+			*out += '[';
+			out->append(p, close + 2);
+			p = close + 2;
+			}
+
+		else if ( c == '-' || isalnum(c) )
+			*out += c;
+
+		else
+			append_hex(out, c);
+		}
+
+	return false;
+	}
+
+// Translates a pattern from Zeek's syntax into Hyperscan's, returning
+// false for anything that doesn't translate faithfully. A leading '^'
+// carries over, and sets *bol. A trailing '$' only does if allow_eol is
+// true.
+static bool translate_pattern(const std::string& pat, bool allow_eol,
+                              std::string* out, bool* bol)
+	{
+	const char* p = pat.c_str();
+	const char* end = p + pat.size();
+
+	// Whether each open group is case-insensitive. Hyperscan would
+	// fold the case of escaped letters, quoted strings and character
+	// classes in there too, but Zeek doesn't.
+	std::vector<bool> groups;
+	bool ci = false;
+
+	*bol = false;
+
+	if ( p < end && *p == '^' )
+		{
+		*bol = true;
+		*out += '^';
+		++p;
+		}
+
+	while ( p < end )
+		{
+		char c = *p++;
+
+		switch ( c ) {
+		case '\\':
+			if ( ci || ! append_escape(p, end, out) )
+				return false;
+			break;
+
+		case '"':
+			if ( ci )
+				return false;
+
+			while ( p < end && *p != '"' )
+				{
+				if ( *p == '\n' )
+					return false;
+
+				if ( *p == '\\' )
+					{
+					if ( ! append_escape(++p, end, out) )
+						return false;
+					}
+				else
+					append_hex(out, *p++);
+				}
+
+			if ( p == end )
+				return false;
+
+			++p;
+			break;
+
+		case '[':
+			if ( ci || ! translate_ccl(p, end, out) )
+				return false;
+			break;
+
+		case '{':
+			if ( p == end || ! isdigit(*p) )
+				return false;	// a definition
+
+			*out += '{';
+
+			while ( p < end && (isdigit(*p) || *p == ',') )
+				*out += *p++;
+
+			if ( p == end || *p != '}' )
+				return false;
+
+			*out += *p++;
+			break;
+
+		case '(':
+			if ( p < end && *p == '?' )
+				{
+				if ( end - p < 3 || strncmp(p, "?i:", 3) != 0 )
+					return false;
+
+				*out += "(?i:";
+				p += 3;
+				groups.push_back(true);
+				ci = true;
+				}
+			else
+				{
+				*out += '(';
+				groups.push_back(ci);
+				}
+			break;
+
+		case ')':
+			if ( groups.empty() )
+				return false;
+
+			groups.pop_back();
+			ci = ! groups.empty() && groups.back();
+			*out += ')';
+			break;
+
+		case '$':
+			if ( p != end || ! allow_eol )
+				return false;
+
+			*out += "\\z";
+			break;
+
+		case '^':
+		case '}':
+		case '\n':
+			return false;
+
+		case '|':
+		case '*':
+		case '+':
+		case '?':
+		case '.':
+			*out += c;
+			break;
+
+		default:
+			if ( isalnum(c) )
+				*out += c;
+			else
+				append_hex(out, c);
+		}
+		}
+
+	return groups.empty();
+	}
+
+class HyperscanEngine final : public RE_Engine {
+public:
+	HyperscanEngine(hs_database_t* arg_db, std::vector<int> arg_idxs,
+	                std::vector<bool> arg_needs_bol)
+		: db(arg_db), idxs(std::move(arg_idxs)), needs_bol(std::move(arg_needs_bol))
+		{ }
+
+	~HyperscanEngine() override	{ hs_free_database(db); }
+
+	bool MatchAll(const u_char* bv, int n) override;
+	int Match(const u_char* bv, int n) override;
+	std::unique_ptr<RE_EngineStream> NewStream() override;
+
+	unsigned int MemoryAllocation() const override
+		{
+		size_t size = 0;
+		hs_database_size(db, &size);
+		return padded_sizeof(*this) + pad_size(size);
+		}
+
+private:
+	friend class HyperscanStream;
+
+	hs_database_t* db;
+	std::vector<int> idxs;		// by Hyperscan ID
+	std::vector<bool> needs_bol;	// by Hyperscan ID
+};
+
+class HyperscanStream final : public RE_EngineStream {
+public:
+	explicit HyperscanStream(const HyperscanEngine* arg_engine)
+		: engine(arg_engine)
+		{ }
+
+	~HyperscanStream() override
+		{
+		if ( stream )
+			hs_close_stream(stream, nullptr, nullptr, nullptr);
+		}
+
+	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear,
+	           AcceptingMatchSet* matches) override;
+
+	void Clear() override
+		{
+		if ( stream )
+			hs_reset_stream(stream, 0, nullptr, nullptr, nullptr);
+
+		offset = 0;
+		started = bol_at_start = jammed = false;
+		}
+
+private:
+	struct Context {
+		HyperscanStream* s;
+		AcceptingMatchSet* matches;
+		unsigned long long base;	// stream offset of the chunk
+		int bol;	// 1 if the chunk started with BOL
+		bool added;
+	};
+
+	static int OnMatch(unsigned int id, unsigned long long from,
+	                   unsigned long long to, unsigned int flags, void* ctx);
+
+	const HyperscanEngine* engine;
+	hs_stream_t* stream = nullptr;
+	unsigned long long offset = 0;	// bytes scanned since the start
+
+	// These stand in for the DFA's BOL and EOL transitions. It only
+	// takes BOL at the start of the stream and jams on it anywhere
+	// else, as it does on EOL, since the patterns we take have no
+	// other '^' or '$' in them.
+	bool started = false;
+	bool bol_at_start = false;
+	bool jammed = false;
+};
+
+bool HyperscanEngine::MatchAll(const u_char* bv, int n)
+	{
+	struct Context {
+		unsigned long long n;
+		bool found;
+	} ctx{static_cast<unsigned long long>(n), false};
+
+	auto on_match = [](unsigned int id, unsigned long long from,
+	                   unsigned long long to, unsigned int flags, void* arg)
+		{
+		auto c = static_cast<Context*>(arg);
+
+		if ( to != c->n )
+			return 0;
+
+		c->found = true;
+		return 1;	// stop scanning
+		};
+
+	hs_scan(db, reinterpret_cast<const char*>(bv), n, 0, scratch, on_match, &ctx);
+	return ctx.found;
+	}
+
+int HyperscanEngine::Match(const u_char* bv, int n)
+	{
+	unsigned long long first = 0;
+
+	auto on_match = [](unsigned int id, unsigned long long from,
+	                   unsigned long long to, unsigned int flags, void* arg)
+		{
+		*static_cast<unsigned long long*>(arg) = to;
+		return 1;	// matches come in order of their end
+		};
+
+	hs_scan(db, reinterpret_cast<const char*>(bv), n, 0, scratch, on_match, &first);
+	return first;
+	}
+
+std::unique_ptr<RE_EngineStream> HyperscanEngine::NewStream()
+	{
+	return std::make_unique<HyperscanStream>(this);
+	}
+
+int HyperscanStream::OnMatch(unsigned int id, unsigned long long from,
+                             unsigned long long to, unsigned int flags, void* arg)
+	{
+	auto c = static_cast<Context*>(arg);
+
+	if ( c->s->engine->needs_bol[id] && ! c->s->bol_at_start )
+		return 0;
+
+	// The same position that RE_Match_State gives matches: that of the
+	// symbol completing them within the chunk, with BOL as the first.
+	MatchPos pos = to - c->base - 1 + c->bol;
+
+	if ( c->matches->emplace(c->s->engine->idxs[id], pos).second )
+		c->added = true;
+
+	return 0;
+	}
+
+bool HyperscanStream::Match(const u_char* bv, int n, bool bol, bool eol, bool clear,
+                            AcceptingMatchSet* matches)
+	{
+	if ( clear )
+		Clear();
+
+	if ( jammed )
+		return false;
+
+	if ( bol )
+		{
+		if ( started )
+			{
+			jammed = true;
+			return false;
+			}
+
+		started = bol_at_start = true;
+		}
+
+	if ( ! stream && hs_open_stream(engine->db, 0, &stream) != HS_SUCCESS )
+		{
+		reporter->Error("can't open Hyperscan stream");
+		jammed = true;
+		return false;
+		}
+
+	Context ctx{this, matches, offset, bol ? 1 : 0, false};
+
+	if ( n > 0 )
+		{
+		hs_scan_stream(stream, reinterpret_cast<const char*>(bv), n, 0,
+		               scratch, OnMatch, &ctx);
+		offset += n;
+		started = true;
+		}
+
+	if ( eol )
+		jammed = true;
+
+	return ctx.added;
+	}
+
+std::unique_ptr<RE_Engine> make_hyperscan_engine(const std::vector<RE_EnginePattern>& patterns,
+                                                 match_type mt, bool multiline, bool stream)
+	{
+	if ( patterns.empty() )
+		return nullptr;
+
+	std::vector<std::string> exprs;
+	std::vector<unsigned int> flags;
+	std::vector<unsigned int> ids;
+	std::vector<int> idxs;
+	std::vector<bool> needs_bol;
+
+	for ( const auto& p : patterns )
+		{
+		std::string expr;
+		bool bol;
+
+		if ( mt == MATCH_EXACTLY )
+			expr = "^(?:";
+		else
+			expr = "(?:";
+
+		if ( ! translate_pattern(p.text, ! stream, &expr, &bol) )
+			return nullptr;
+
+		expr += ')';
+
+		unsigned int f = multiline ? HS_FLAG_DOTALL : 0;
+
+		if ( stream )
+			// RE_Match_State only keeps the first match of each.
+			f |= HS_FLAG_SINGLEMATCH;
+
+		hs_expr_info_t* info = nullptr;
+		hs_compile_error_t* error = nullptr;
+
+		if ( hs_expression_info(expr.c_str(), f, &info, &error) != HS_SUCCESS )
+			{
+			hs_free_compile_error(error);
+			return nullptr;
+			}
+
+		// The DFA has its own ideas about where empty matches
+		// happen.
+		bool empty = info->min_width == 0;
+		free(info);
+
+		if ( empty )
+			return nullptr;
+
+		ids.push_back(exprs.size());
+		exprs.push_back(std::move(expr));
+		flags.push_back(f);
+		idxs.push_back(p.idx);
+		needs_bol.push_back(bol);
+		}
+
+	std::vector<const char*> cexprs;
+
+	for ( const auto& e : exprs )
+		cexprs.push_back(e.c_str());
+
+	hs_database_t* db = nullptr;
+	hs_compile_error_t* error = nullptr;
+
+	if ( hs_compile_multi(cexprs.data(), flags.data(), ids.data(), cexprs.size(),
+	                      stream ? HS_MODE_STREAM : HS_MODE_BLOCK, nullptr,
+	                      &db, &error) != HS_SUCCESS )
+		{
+		// Some patterns are too large for Hyperscan, which the DFA
+		// takes care of then.
+		hs_free_compile_error(error);
+		return nullptr;
+		}
+
+	if ( hs_alloc_scratch(db, &scratch) != HS_SUCCESS )
+		{
+		reporter->Error("can't allocate Hyperscan scratch space");
+		hs_free_database(db);
+		return nullptr;
+		}
+
+	return std::make_unique<HyperscanEngine>(db, std::move(idxs), std::move(needs_bol));
+	}
+
+} // namespace zeek::detail
+
+#endif
@@ -0,0 +1,25 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#ifdef USE_HYPERSCAN
+
+#include "REEngine.h"
+
+namespace zeek::detail {
+
+/**
+ * An RE_EngineFactory matching patterns with Hyperscan, in block mode for
+ * script patterns and in streaming mode for signatures. It turns down
+ * patterns that use constructs it can't translate faithfully, such as
+ * "{name}" definitions, anchors anywhere but at the start (or, outside of
+ * streams, the end), and patterns that match the empty string.
+ */
+std::unique_ptr<RE_Engine> make_hyperscan_engine(const std::vector<RE_EnginePattern>& patterns,
+                                                 match_type mt, bool multiline, bool stream);
+
+} // namespace zeek::detail
+
+#endif
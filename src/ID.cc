@@ -13,6 +13,7 @@
 #include "Scope.h"
 #include "Type.h"
 #include "File.h"
+#include "MemoryAccount.h"
 #include "Traverse.h"
 #include "Val.h"
 #include "zeekygen/Manager.h"
@@ -148,6 +149,9 @@ void ID::ClearVal()
 
 void ID::SetVal(zeek::ValPtr v)
 	{
+	if ( memory_account )
+		memory_account->Reassign(val.get(), v.get());
+
 	val = std::move(v);
 	Modified();
 
@@ -19,6 +19,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(RecordType, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(TableType, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(VectorType, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(EnumType, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(MemoryAccount, zeek::detail);
 
 namespace zeek {
 class Type;
@@ -161,6 +162,10 @@ public:
 	void AddOptionHandler(zeek::FuncPtr callback, int priority);
 	std::vector<Func*> GetOptionHandlers() const;
 
+	// Sets the account tracking the memory of the global's values, see
+	// MemoryAccount.h.
+	void SetMemoryAccount(MemoryAccount* a)	{ memory_account = a; }
+
 protected:
 	void EvalFunc(ExprPtr ef, ExprPtr ev);
 
@@ -179,6 +184,7 @@ protected:
 	AttributesPtr attrs;
 	// contains list of functions that are called when an option changes
 	std::multimap<int, zeek::FuncPtr> option_handlers;
+	MemoryAccount* memory_account = nullptr;
 
 };
 
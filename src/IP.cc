@@ -64,8 +64,8 @@ zeek::RecordValPtr IPv6_Hdr::ToVal(zeek::VectorValPtr chain) const
 		rv->Assign(2, zeek::val_mgr->Count(ntohs(ip6->ip6_plen)));
 		rv->Assign(3, zeek::val_mgr->Count(ip6->ip6_nxt));
 		rv->Assign(4, zeek::val_mgr->Count(ip6->ip6_hlim));
-		rv->Assign(5, zeek::make_intrusive<zeek::AddrVal>(IPAddr(ip6->ip6_src)));
-		rv->Assign(6, zeek::make_intrusive<zeek::AddrVal>(IPAddr(ip6->ip6_dst)));
+		rv->Assign(5, zeek::val_mgr->Addr(IPAddr(ip6->ip6_src)));
+		rv->Assign(6, zeek::val_mgr->Addr(IPAddr(ip6->ip6_dst)));
 		if ( ! chain )
 			chain = zeek::make_intrusive<zeek::VectorVal>(
 			    zeek::id::find_type<zeek::VectorType>("ip6_ext_hdr_chain"));
@@ -340,8 +340,8 @@ zeek::RecordValPtr IP_Hdr::ToIPHdrVal() const
 		rval->Assign(3, zeek::val_mgr->Count(ntohs(ip4->ip_id)));
 		rval->Assign(4, zeek::val_mgr->Count(ip4->ip_ttl));
 		rval->Assign(5, zeek::val_mgr->Count(ip4->ip_p));
-		rval->Assign(6, zeek::make_intrusive<zeek::AddrVal>(ip4->ip_src.s_addr));
-		rval->Assign(7, zeek::make_intrusive<zeek::AddrVal>(ip4->ip_dst.s_addr));
+		rval->Assign(6, zeek::val_mgr->Addr(IPAddr(ip4->ip_src)));
+		rval->Assign(7, zeek::val_mgr->Addr(IPAddr(ip4->ip_dst)));
 		}
 	else
 		{
@@ -475,7 +475,6 @@ static inline bool isIPv6ExtHeader(uint8_t type)
 
 IPv6_Hdr_Chain::~IPv6_Hdr_Chain()
 	{
-	for ( size_t i = 0; i < chain.size(); ++i ) delete chain[i];
 #ifdef ENABLE_MOBILE_IPV6
 	delete homeAddr;
 #endif
@@ -496,6 +495,14 @@ void IPv6_Hdr_Chain::Init(const struct ip6_hdr* ip6, int total_len,
 		return;
 		}
 
+	if ( ! isIPv6ExtHeader(ip6->ip6_nxt) )
+		{
+		// The common case: no extension headers.
+		Append(IPv6_Hdr(IPPROTO_IPV6, hdrs));
+		length = sizeof(struct ip6_hdr);
+		return;
+		}
+
 	do
 		{
 		// We can't determine a given header's length if there's less than
@@ -504,25 +511,22 @@ void IPv6_Hdr_Chain::Init(const struct ip6_hdr* ip6, int total_len,
 			return;
 
 		current_type = next_type;
-		IPv6_Hdr* p = new IPv6_Hdr(current_type, hdrs);
+		IPv6_Hdr p(current_type, hdrs);
 
-		next_type = p->NextHdr();
-		uint16_t cur_len = p->Length();
+		next_type = p.NextHdr();
+		uint16_t cur_len = p.Length();
 
 		// If this header is truncated, don't add it to chain, don't go further.
 		if ( cur_len > total_len )
-			{
-			delete p;
 			return;
-			}
 
 		if ( set_next && next_type == IPPROTO_FRAGMENT )
 			{
-			p->ChangeNext(next);
+			p.ChangeNext(next);
 			next_type = next;
 			}
 
-		chain.push_back(p);
+		Append(p);
 
 		// Check for routing headers and remember final destination address.
 		if ( current_type == IPPROTO_ROUTING )
@@ -548,13 +552,13 @@ void IPv6_Hdr_Chain::Init(const struct ip6_hdr* ip6, int total_len,
 
 bool IPv6_Hdr_Chain::IsFragment() const
 	{
-	if ( chain.empty() )
+	if ( num_hdrs == 0 )
 		{
 		reporter->InternalWarning("empty IPv6 header chain");
 		return false;
 		}
 
-	return chain[chain.size()-1]->Type() == IPPROTO_FRAGMENT;
+	return (*this)[num_hdrs-1]->Type() == IPPROTO_FRAGMENT;
 	}
 
 IPAddr IPv6_Hdr_Chain::SrcAddr() const
@@ -563,13 +567,13 @@ IPAddr IPv6_Hdr_Chain::SrcAddr() const
 	if ( homeAddr )
 		return IPAddr(*homeAddr);
 #endif
-	if ( chain.empty() )
+	if ( num_hdrs == 0 )
 		{
 		reporter->InternalWarning("empty IPv6 header chain");
 		return IPAddr();
 		}
 
-	return IPAddr(((const struct ip6_hdr*)(chain[0]->Data()))->ip6_src);
+	return IPAddr(((const struct ip6_hdr*)((*this)[0]->Data()))->ip6_src);
 	}
 
 IPAddr IPv6_Hdr_Chain::DstAddr() const
@@ -577,13 +581,13 @@ IPAddr IPv6_Hdr_Chain::DstAddr() const
 	if ( finalDst )
 		return IPAddr(*finalDst);
 
-	if ( chain.empty() )
+	if ( num_hdrs == 0 )
 		{
 		reporter->InternalWarning("empty IPv6 header chain");
 		return IPAddr();
 		}
 
-	return IPAddr(((const struct ip6_hdr*)(chain[0]->Data()))->ip6_dst);
+	return IPAddr(((const struct ip6_hdr*)((*this)[0]->Data()))->ip6_dst);
 	}
 
 void IPv6_Hdr_Chain::ProcessRoutingHeader(const struct ip6_rthdr* r, uint16_t len)
@@ -688,11 +692,11 @@ zeek::VectorValPtr IPv6_Hdr_Chain::ToVal() const
 	static auto ip6_ext_hdr_chain_type = zeek::id::find_type<zeek::VectorType>("ip6_ext_hdr_chain");
 	auto rval = zeek::make_intrusive<zeek::VectorVal>(ip6_ext_hdr_chain_type);
 
-	for ( size_t i = 1; i < chain.size(); ++i )
+	for ( size_t i = 1; i < num_hdrs; ++i )
 		{
-		auto v = chain[i]->ToVal();
+		auto v = (*this)[i]->ToVal();
 		auto ext_hdr = zeek::make_intrusive<zeek::RecordVal>(ip6_ext_hdr_type);
-		uint8_t type = chain[i]->Type();
+		uint8_t type = (*this)[i]->Type();
 		ext_hdr->Assign(0, zeek::val_mgr->Count(type));
 
 		switch (type) {
@@ -764,7 +768,7 @@ IPv6_Hdr_Chain* IPv6_Hdr_Chain::Copy(const ip6_hdr* new_hdr) const
 	if ( finalDst )
 		rval->finalDst = new IPAddr(*finalDst);
 
-	if ( chain.empty() )
+	if ( num_hdrs == 0 )
 		{
 		reporter->InternalWarning("empty IPv6 header chain");
 		delete rval;
@@ -772,12 +776,12 @@ IPv6_Hdr_Chain* IPv6_Hdr_Chain::Copy(const ip6_hdr* new_hdr) const
 		}
 
 	const u_char* new_data = (const u_char*)new_hdr;
-	const u_char* old_data = chain[0]->Data();
+	const u_char* old_data = (*this)[0]->Data();
 
-	for ( size_t i = 0; i < chain.size(); ++i )
+	for ( size_t i = 0; i < num_hdrs; ++i )
 		{
-		int off = chain[i]->Data() - old_data;
-		rval->chain.push_back(new IPv6_Hdr(chain[i]->Type(), new_data + off));
+		int off = (*this)[i]->Data() - old_data;
+		rval->Append(IPv6_Hdr((*this)[i]->Type(), new_data + off));
 		}
 
 	return rval;
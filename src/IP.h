@@ -52,6 +52,8 @@ public:
 	 */
 	IPv6_Hdr(uint8_t t, const u_char* d) : type(t), data(d) {}
 
+	IPv6_Hdr() = default;
+
 	/**
 	 * Replace the value of the next protocol field.
 	 */
@@ -149,8 +151,8 @@ public:
 	zeek::RecordVal* BuildRecordVal(zeek::VectorVal* chain = nullptr) const;
 
 protected:
-	uint8_t type;
-	const u_char* data;
+	uint8_t type = 0;
+	const u_char* data = nullptr;
 };
 
 class IPv6_Hdr_Chain {
@@ -172,7 +174,7 @@ public:
 	/**
 	 * Returns the number of headers in the chain.
 	 */
-	size_t Size() const { return chain.size(); }
+	size_t Size() const { return num_hdrs; }
 
 	/**
 	 * Returns the sum of the length of all headers in the chain in bytes.
@@ -182,7 +184,8 @@ public:
 	/**
 	 * Accesses the header at the given location in the chain.
 	 */
-	const IPv6_Hdr* operator[](const size_t i) const { return chain[i]; }
+	const IPv6_Hdr* operator[](const size_t i) const
+		{ return i < NUM_INLINE_HDRS ? &inline_chain[i] : &extra_chain[i - NUM_INLINE_HDRS]; }
 
 	/**
 	 * Returns whether the header chain indicates a fragmented packet.
@@ -194,7 +197,7 @@ public:
 	 */
 	const struct ip6_frag* GetFragHdr() const
 		{ return IsFragment() ?
-				(const struct ip6_frag*)chain[chain.size()-1]->Data(): nullptr; }
+				(const struct ip6_frag*)(*this)[num_hdrs-1]->Data(): nullptr; }
 
 	/**
 	 * If the header chain is a fragment, returns the offset in number of bytes
@@ -245,6 +248,9 @@ protected:
 	// point to a fragment
 	friend class FragReassembler;
 
+	// for keeping the chain of an IPv6 packet inline
+	friend class IP_Hdr;
+
 	IPv6_Hdr_Chain() = default;
 
 	/**
@@ -262,6 +268,19 @@ protected:
 	void Init(const struct ip6_hdr* ip6, int total_len, bool set_next,
 	          uint16_t next = 0);
 
+	/**
+	 * Adds a header to the end of the chain.
+	 */
+	void Append(const IPv6_Hdr& hdr)
+		{
+		if ( num_hdrs < NUM_INLINE_HDRS )
+			inline_chain[num_hdrs] = hdr;
+		else
+			extra_chain.push_back(hdr);
+
+		++num_hdrs;
+		}
+
 	/**
 	 * Process a routing header and allocate/remember the final destination
 	 * address if it has segments left and is a valid routing header.
@@ -276,7 +295,15 @@ protected:
 	void ProcessDstOpts(const struct ip6_dest* d, uint16_t len);
 #endif
 
-	std::vector<IPv6_Hdr*> chain;
+	/**
+	 * The headers of the chain. Packets rarely carry more than a couple
+	 * of extension headers, so the first ones are kept inline rather
+	 * than allocated separately.
+	 */
+	static constexpr size_t NUM_INLINE_HDRS = 4;
+	IPv6_Hdr inline_chain[NUM_INLINE_HDRS];
+	std::vector<IPv6_Hdr> extra_chain;
+	size_t num_hdrs = 0;
 
 	/**
 	 * The summation of all header lengths in the chain in bytes.
@@ -327,11 +354,19 @@ public:
 	 */
 	IP_Hdr(const struct ip6_hdr* arg_ip6, bool arg_del, int len,
 	       const IPv6_Hdr_Chain* c = nullptr)
-		: ip6(arg_ip6), ip6_hdrs(c ? c : new IPv6_Hdr_Chain(ip6, len)),
-		  del(arg_del)
+		: ip6(arg_ip6), ip6_hdrs(c), del(arg_del)
 		{
+		if ( ! c )
+			{
+			own_ip6_hdrs.Init(ip6, len, false);
+			ip6_hdrs = &own_ip6_hdrs;
+			}
 		}
 
+	// ip6_hdrs may point into the object itself.
+	IP_Hdr(const IP_Hdr&) = delete;
+	IP_Hdr& operator=(const IP_Hdr&) = delete;
+
 	/**
 	 * Copy a header.  The internal buffer which contains the header data
 	 * must not be truncated.  Also note that if that buffer points to a full
@@ -344,7 +379,8 @@ public:
 	 */
 	~IP_Hdr()
 		{
-		delete ip6_hdrs;
+		if ( ip6_hdrs != &own_ip6_hdrs )
+			delete ip6_hdrs;
 
 		if ( del )
 			{
@@ -559,5 +595,6 @@ private:
 	const struct ip* ip4 = nullptr;
 	const struct ip6_hdr* ip6 = nullptr;
 	const IPv6_Hdr_Chain* ip6_hdrs = nullptr;
+	IPv6_Hdr_Chain own_ip6_hdrs; // the chain unless one was passed in
 	bool del;
 };
@@ -19,6 +19,27 @@ namespace analyzer { class ExpectedConn; }
 
 typedef in_addr in4_addr;
 
+/**
+ * The packed form of a ConnIDKey between two IPv4 addresses, which make up
+ * most connections on typical networks. Keeping just the addresses' four
+ * bytes, it takes a third of the space and hashes and compares faster.
+ */
+struct ConnIDKey4 {
+	uint32_t ip1;
+	uint32_t ip2;
+	uint16_t port1;
+	uint16_t port2;
+
+	ConnIDKey4() : ip1(0), ip2(0), port1(0), port2(0)
+		{ }
+
+	bool operator==(const ConnIDKey4& rhs) const
+		{
+		return ip1 == rhs.ip1 && ip2 == rhs.ip2 &&
+		       port1 == rhs.port1 && port2 == rhs.port2;
+		}
+};
+
 struct ConnIDKey {
 	in6_addr ip1;
 	in6_addr ip2;
@@ -41,6 +62,34 @@ struct ConnIDKey {
 
 		return *this;
 		}
+
+	/**
+	 * @return true if both addresses are IPv4 ones, so that the key can
+	 * be packed into a ConnIDKey4.
+	 */
+	bool IsIPv4() const
+		{ return IsV4Mapped(ip1) && IsV4Mapped(ip2); }
+
+	/**
+	 * @return the packed form of a key for which IsIPv4() holds.
+	 */
+	ConnIDKey4 PackIPv4() const
+		{
+		ConnIDKey4 k;
+		memcpy(&k.ip1, &ip1.s6_addr[12], sizeof(k.ip1));
+		memcpy(&k.ip2, &ip2.s6_addr[12], sizeof(k.ip2));
+		k.port1 = port1;
+		k.port2 = port2;
+		return k;
+		}
+
+private:
+	static bool IsV4Mapped(const in6_addr& a)
+		{
+		static const uint8_t prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0,
+		                                    0, 0, 0xff, 0xff };
+		return memcmp(a.s6_addr, prefix, sizeof(prefix)) == 0;
+		}
 };
 
 /**
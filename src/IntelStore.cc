@@ -0,0 +1,365 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "IntelStore.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "broker/Data.h"
+#include "Type.h"
+#include "Var.h"
+
+namespace zeek {
+
+IMPLEMENT_OPAQUE_VALUE(IntelStoreVal)
+
+static std::string to_lower(const std::string& s)
+	{
+	std::string rval = s;
+	std::transform(rval.begin(), rval.end(), rval.begin(),
+	               [](unsigned char c) { return std::tolower(c); });
+	return rval;
+	}
+
+IntelStoreVal::IntelStoreVal() : OpaqueVal(intel_store_type)
+	{
+	prefixes.SetDeleteFunction(DeletePrefixEntry);
+	}
+
+IntelStoreVal::~IntelStoreVal()
+	{
+	}
+
+void IntelStoreVal::DeletePrefixEntry(void* data)
+	{
+	delete static_cast<PrefixEntry*>(data);
+	}
+
+IntelStoreVal::Kind IntelStoreVal::KindOf(bro_int_t type) const
+	{
+	auto it = kinds.find(type);
+
+	if ( it != kinds.end() )
+		return it->second;
+
+	static const auto& intel_type = zeek::id::find_type<zeek::EnumType>("Intel::Type");
+	const char* name = intel_type->Lookup(type);
+	Kind kind = Kind::Other;
+
+	if ( name )
+		{
+		if ( strcmp(name, "Intel::ADDR") == 0 )
+			kind = Kind::Addr;
+		else if ( strcmp(name, "Intel::SUBNET") == 0 )
+			kind = Kind::Subnet;
+		else if ( strcmp(name, "Intel::DOMAIN") == 0 )
+			kind = Kind::Domain;
+		else if ( strcmp(name, "Intel::URL") == 0 )
+			kind = Kind::URL;
+		}
+
+	kinds.emplace(type, kind);
+	return kind;
+	}
+
+IntelStoreVal::PrefixEntry* IntelStoreVal::FindPrefix(const IPPrefix& prefix) const
+	{
+	return static_cast<PrefixEntry*>(prefixes.Lookup(prefix.Prefix(),
+	                                                 prefix.LengthIPv6(), true));
+	}
+
+bool IntelStoreVal::InsertPrefix(const IPPrefix& prefix, bool is_addr)
+	{
+	auto entry = FindPrefix(prefix);
+
+	if ( ! entry )
+		{
+		entry = new PrefixEntry{prefix};
+		prefixes.Insert(prefix.Prefix(), prefix.LengthIPv6(), entry);
+		}
+
+	bool& present = is_addr ? entry->is_addr : entry->is_subnet;
+
+	if ( present )
+		return false;
+
+	present = true;
+	++num_prefixes;
+	return true;
+	}
+
+bool IntelStoreVal::RemovePrefix(const IPPrefix& prefix, bool is_addr)
+	{
+	auto entry = FindPrefix(prefix);
+
+	if ( ! entry )
+		return false;
+
+	bool& present = is_addr ? entry->is_addr : entry->is_subnet;
+
+	if ( ! present )
+		return false;
+
+	present = false;
+	--num_prefixes;
+
+	if ( ! entry->is_addr && ! entry->is_subnet )
+		{
+		prefixes.Remove(prefix.Prefix(), prefix.LengthIPv6());
+		delete entry;
+		}
+
+	return true;
+	}
+
+bool IntelStoreVal::Insert(const std::string& indicator, bro_int_t type, std::string* error)
+	{
+	switch ( KindOf(type) ) {
+	case Kind::Addr:
+		{
+		in6_addr a;
+
+		if ( ! IPAddr::ConvertString(indicator.c_str(), &a) )
+			{
+			*error = fmt("invalid address indicator '%s'", indicator.c_str());
+			return false;
+			}
+
+		return InsertPrefix(IPPrefix(IPAddr(a), 128, true), true);
+		}
+
+	case Kind::Subnet:
+		{
+		IPPrefix p;
+
+		if ( ! IPPrefix::ConvertString(indicator.c_str(), &p) )
+			{
+			*error = fmt("invalid subnet indicator '%s'", indicator.c_str());
+			return false;
+			}
+
+		return InsertPrefix(p, false);
+		}
+
+	default:
+		if ( ! strings[type].insert(to_lower(indicator)).second )
+			return false;
+
+		++num_strings;
+		return true;
+	}
+	}
+
+bool IntelStoreVal::Remove(const std::string& indicator, bro_int_t type)
+	{
+	switch ( KindOf(type) ) {
+	case Kind::Addr:
+		{
+		in6_addr a;
+		return IPAddr::ConvertString(indicator.c_str(), &a) &&
+		       RemovePrefix(IPPrefix(IPAddr(a), 128, true), true);
+		}
+
+	case Kind::Subnet:
+		{
+		IPPrefix p;
+		return IPPrefix::ConvertString(indicator.c_str(), &p) &&
+		       RemovePrefix(p, false);
+		}
+
+	default:
+		{
+		auto it = strings.find(type);
+
+		if ( it == strings.end() || ! it->second.erase(to_lower(indicator)) )
+			return false;
+
+		--num_strings;
+		return true;
+		}
+	}
+	}
+
+bool IntelStoreVal::Contains(const std::string& indicator, bro_int_t type) const
+	{
+	switch ( KindOf(type) ) {
+	case Kind::Addr:
+		{
+		in6_addr a;
+
+		if ( ! IPAddr::ConvertString(indicator.c_str(), &a) )
+			return false;
+
+		auto entry = FindPrefix(IPPrefix(IPAddr(a), 128, true));
+		return entry && entry->is_addr;
+		}
+
+	case Kind::Subnet:
+		{
+		IPPrefix p;
+
+		if ( ! IPPrefix::ConvertString(indicator.c_str(), &p) )
+			return false;
+
+		auto entry = FindPrefix(p);
+		return entry && entry->is_subnet;
+		}
+
+	default:
+		{
+		auto it = strings.find(type);
+		return it != strings.end() && it->second.count(to_lower(indicator));
+		}
+	}
+	}
+
+VectorValPtr IntelStoreVal::MatchAddr(const IPAddr& addr) const
+	{
+	auto matches = make_intrusive<VectorVal>(zeek::id::string_vec);
+
+	// Most addresses match nothing, which the longest-prefix lookup
+	// tells quickly.
+	if ( ! prefixes.Lookup(addr, 128) )
+		return matches;
+
+	for ( const auto& match : prefixes.FindAll(addr, 128) )
+		{
+		auto entry = static_cast<const PrefixEntry*>(std::get<1>(match));
+
+		if ( entry->is_addr && entry->prefix.LengthIPv6() == 128 )
+			matches->Assign(matches->Size(), make_intrusive<StringVal>(addr.AsString()));
+
+		if ( entry->is_subnet )
+			matches->Assign(matches->Size(), make_intrusive<StringVal>(entry->prefix.AsString()));
+		}
+
+	return matches;
+	}
+
+void IntelStoreVal::MatchCandidates(const std::unordered_set<std::string>& set,
+                                    const std::string& s, char sep, bool suffixes,
+                                    VectorVal* matches) const
+	{
+	// The string itself, then each part of it beginning after (for
+	// suffixes) or ending with (for prefixes) a separator.
+	if ( set.count(s) )
+		matches->Assign(matches->Size(), make_intrusive<StringVal>(s));
+
+	if ( suffixes )
+		{
+		for ( auto i = s.find(sep); i != std::string::npos; i = s.find(sep, i + 1) )
+			if ( i + 1 < s.size() && set.count(s.substr(i + 1)) )
+				matches->Assign(matches->Size(), make_intrusive<StringVal>(s.substr(i + 1)));
+		}
+	else
+		{
+		for ( auto i = s.find(sep); i != std::string::npos; i = s.find(sep, i + 1) )
+			if ( i + 1 < s.size() && set.count(s.substr(0, i + 1)) )
+				matches->Assign(matches->Size(), make_intrusive<StringVal>(s.substr(0, i + 1)));
+		}
+	}
+
+VectorValPtr IntelStoreVal::Match(const std::string& seen, bro_int_t type,
+                                  bool domain_suffixes, bool url_prefixes) const
+	{
+	auto matches = make_intrusive<VectorVal>(zeek::id::string_vec);
+	auto it = strings.find(type);
+
+	if ( it == strings.end() || it->second.empty() )
+		return matches;
+
+	auto s = to_lower(seen);
+	auto kind = KindOf(type);
+
+	if ( kind == Kind::Domain && domain_suffixes )
+		MatchCandidates(it->second, s, '.', true, matches.get());
+
+	else if ( kind == Kind::URL && url_prefixes )
+		MatchCandidates(it->second, s, '/', false, matches.get());
+
+	else if ( it->second.count(s) )
+		matches->Assign(0, make_intrusive<StringVal>(s));
+
+	return matches;
+	}
+
+broker::expected<broker::data> IntelStoreVal::DoSerialize() const
+	{
+	// Addresses and subnets go by their flags, other indicators by
+	// their type.
+	broker::vector nets;
+	broker::vector others;
+
+	auto i = const_cast<PrefixTable&>(prefixes).InitIterator();
+
+	while ( auto data = const_cast<PrefixTable&>(prefixes).GetNext(&i) )
+		{
+		auto entry = static_cast<const PrefixEntry*>(data);
+		nets.emplace_back(broker::vector{entry->prefix.AsString(),
+		                                 entry->is_addr, entry->is_subnet});
+		}
+
+	for ( const auto& [type, set] : strings )
+		for ( const auto& s : set )
+			others.emplace_back(broker::vector{static_cast<broker::integer>(type), s});
+
+	return {broker::vector{std::move(nets), std::move(others)}};
+	}
+
+bool IntelStoreVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() == 2) )
+		return false;
+
+	auto nets = caf::get_if<broker::vector>(&(*v)[0]);
+	auto others = caf::get_if<broker::vector>(&(*v)[1]);
+
+	if ( ! (nets && others) )
+		return false;
+
+	for ( const auto& n : *nets )
+		{
+		auto e = caf::get_if<broker::vector>(&n);
+
+		if ( ! (e && e->size() == 3) )
+			return false;
+
+		auto s = caf::get_if<std::string>(&(*e)[0]);
+		auto is_addr = caf::get_if<bool>(&(*e)[1]);
+		auto is_subnet = caf::get_if<bool>(&(*e)[2]);
+		IPPrefix p;
+
+		if ( ! (s && is_addr && is_subnet && IPPrefix::ConvertString(s->c_str(), &p)) )
+			return false;
+
+		if ( *is_addr )
+			InsertPrefix(p, true);
+
+		if ( *is_subnet )
+			InsertPrefix(p, false);
+		}
+
+	for ( const auto& o : *others )
+		{
+		auto e = caf::get_if<broker::vector>(&o);
+
+		if ( ! (e && e->size() == 2) )
+			return false;
+
+		auto type = caf::get_if<broker::integer>(&(*e)[0]);
+		auto s = caf::get_if<std::string>(&(*e)[1]);
+
+		if ( ! (type && s) )
+			return false;
+
+		if ( strings[*type].insert(*s).second )
+			++num_strings;
+		}
+
+	return true;
+	}
+
+}
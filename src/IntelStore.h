@@ -0,0 +1,114 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "OpaqueVal.h"
+#include "PrefixTable.h"
+
+namespace zeek {
+
+/**
+ * The indicators of the Intel framework, indexed for matching what gets
+ * seen against them natively. Addresses and subnets live in a prefix
+ * tree, all other indicators in a hash set per indicator type. Lookups of
+ * domains can also match any of the domains they're in, and lookups of
+ * URLs any URL that's a prefix of them at a path separator.
+ *
+ * Indicators are kept just as keys; their metadata stays with the
+ * scripts. Except for addresses and subnets, they are case-insensitive.
+ */
+class IntelStoreVal : public OpaqueVal {
+public:
+	IntelStoreVal();
+	~IntelStoreVal() override;
+
+	/**
+	 * Adds an indicator.
+	 *
+	 * @param indicator The indicator as given in an Intel::Item.
+	 *
+	 * @param type The indicator's Intel::Type value.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return True if the indicator is new, false if it was present or
+	 * is invalid.
+	 */
+	bool Insert(const std::string& indicator, bro_int_t type, std::string* error);
+
+	/**
+	 * Removes an indicator.
+	 *
+	 * @return True if the indicator was present.
+	 */
+	bool Remove(const std::string& indicator, bro_int_t type);
+
+	/**
+	 * Returns true if the indicator is present as is.
+	 */
+	bool Contains(const std::string& indicator, bro_int_t type) const;
+
+	/**
+	 * Returns the address and subnet indicators matching an address, in
+	 * the form of the indicators.
+	 */
+	VectorValPtr MatchAddr(const IPAddr& addr) const;
+
+	/**
+	 * Returns the indicators of a type matching a seen string, in
+	 * lower case.
+	 *
+	 * @param domain_suffixes If true, domains match the domains they're
+	 * in, like "example.com" does "www.example.com".
+	 *
+	 * @param url_prefixes If true, URLs match the URLs they start with
+	 * up to a "/", like "example.com/a/" does "example.com/a/b".
+	 */
+	VectorValPtr Match(const std::string& seen, bro_int_t type,
+	                   bool domain_suffixes, bool url_prefixes) const;
+
+	/**
+	 * Returns the number of indicators.
+	 */
+	size_t Size() const	{ return num_prefixes + num_strings; }
+
+protected:
+	DECLARE_OPAQUE_VALUE(IntelStoreVal)
+
+private:
+	enum class Kind { Addr, Subnet, Domain, URL, Other };
+
+	struct PrefixEntry {
+		IPPrefix prefix;
+		bool is_addr = false;
+		bool is_subnet = false;
+	};
+
+	static void DeletePrefixEntry(void* data);
+
+	// Determines how to index an Intel::Type value.
+	Kind KindOf(bro_int_t type) const;
+
+	bool InsertPrefix(const IPPrefix& prefix, bool is_addr);
+	bool RemovePrefix(const IPPrefix& prefix, bool is_addr);
+	PrefixEntry* FindPrefix(const IPPrefix& prefix) const;
+
+	// A string set's lookup for any of the candidate substrings.
+	void MatchCandidates(const std::unordered_set<std::string>& set,
+	                     const std::string& s, char sep, bool suffixes,
+	                     VectorVal* matches) const;
+
+	PrefixTable prefixes;
+	std::unordered_map<bro_int_t, std::unordered_set<std::string>> strings;
+	size_t num_prefixes = 0;
+	size_t num_strings = 0;
+
+	mutable std::unordered_map<bro_int_t, Kind> kinds;
+};
+
+}
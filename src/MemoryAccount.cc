@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "MemoryAccount.h"
+
+#include "ID.h"
+#include "Metrics.h"
+#include "NetVar.h"
+#include "Scope.h"
+#include "Val.h"
+
+namespace zeek::detail {
+
+static std::map<std::string, std::unique_ptr<MemoryAccount>> global_accounts;
+static std::map<std::string, std::unique_ptr<MemoryAccount>> module_accounts;
+
+void MemoryAccount::Reassign(Val* old_val, Val* new_val)
+	{
+	if ( old_val == new_val )
+		return;
+
+	int64_t delta = 0;
+
+	if ( old_val )
+		{
+		delta -= old_val->MemoryAllocation();
+		set_memory_account(old_val, this, nullptr);
+		}
+
+	if ( new_val )
+		{
+		delta += new_val->MemoryAllocation();
+		set_memory_account(new_val, nullptr, this);
+		}
+
+	Adjust(delta);
+	}
+
+void init_global_memory_accounts(MetricsRegistry* registry)
+	{
+	if ( ! zeek::BifConst::track_global_sizes )
+		return;
+
+	for ( const auto& [name, id] : global_scope()->Vars() )
+		{
+		if ( id->IsType() || ! id->GetType() )
+			continue;
+
+		auto tag = id->GetType()->Tag();
+
+		if ( tag != TYPE_TABLE && tag != TYPE_VECTOR && tag != TYPE_RECORD )
+			continue;
+
+		auto& module = module_accounts[id->ModuleName()];
+
+		if ( ! module )
+			module = std::make_unique<MemoryAccount>(id->ModuleName(), nullptr);
+
+		auto account = std::make_unique<MemoryAccount>(name, module.get());
+		account->Reassign(nullptr, id->GetVal().get());
+		id->SetMemoryAccount(account.get());
+
+		const MemoryAccount* a = account.get();
+		registry->AddGauge("zeek_script_global_bytes",
+		                   "Memory held by script-level globals.",
+		                   "global=\"" + name + "\"",
+		                   [a] { return a->Bytes(); });
+
+		global_accounts.emplace(name, std::move(account));
+		}
+
+	for ( const auto& [name, module] : module_accounts )
+		{
+		const MemoryAccount* a = module.get();
+		registry->AddGauge("zeek_script_module_bytes",
+		                   "Memory held by the script-level globals of a module.",
+		                   "module=\"" + name + "\"",
+		                   [a] { return a->Bytes(); });
+		}
+	}
+
+const MemoryAccount* global_memory_account(const std::string& name)
+	{
+	auto it = global_accounts.find(name);
+	return it != global_accounts.end() ? it->second.get() : nullptr;
+	}
+
+const std::map<std::string, std::unique_ptr<MemoryAccount>>& module_memory_accounts()
+	{
+	return module_accounts;
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,90 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace zeek { class Val; }
+
+namespace zeek::detail {
+
+class MetricsRegistry;
+
+/**
+ * Keeps a running total of the memory that a script-level global holds,
+ * and of that of all globals in its module. The tables, vectors and
+ * records making up a global's value point to its account, and adjust it
+ * by what each of their modifications adds or removes (see
+ * set_memory_account()). That makes the totals available at any time
+ * without walking the values like Val::MemoryAllocation() does.
+ *
+ * The totals are estimates along the lines of Val::MemoryAllocation().
+ * Values held by more than one global count towards the account of the
+ * one they were first added to only as they change. Modifications made
+ * other than through the Val interfaces, such as sorting a vector in
+ * place, aren't seen.
+ */
+class MemoryAccount {
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param name The name of the global or module.
+	 * @param parent The account of the global's module, or null for
+	 * that of a module.
+	 */
+	MemoryAccount(std::string name, MemoryAccount* parent)
+		: name(std::move(name)), parent(parent)	{ }
+
+	const std::string& Name() const	{ return name; }
+
+	/**
+	 * @return The bytes currently accounted for.
+	 */
+	int64_t Bytes() const	{ return bytes; }
+
+	/**
+	 * Accounts for a change in memory of a value belonging to the global.
+	 */
+	void Adjust(int64_t delta)
+		{
+		bytes += delta;
+
+		if ( parent )
+			parent->bytes += delta;
+		}
+
+	/**
+	 * Moves the account from the previous value of the global to its
+	 * new one.
+	 */
+	void Reassign(Val* old_val, Val* new_val);
+
+private:
+	std::string name;
+	MemoryAccount* parent;
+	int64_t bytes = 0;
+};
+
+/**
+ * Starts accounting the memory of all globals holding tables, sets,
+ * vectors or records, if \c track_global_sizes is set, and registers
+ * metrics for them. Called once the scripts are parsed.
+ */
+void init_global_memory_accounts(MetricsRegistry* registry);
+
+/**
+ * @return The account of a global by its name, or null if its memory
+ * isn't tracked.
+ */
+const MemoryAccount* global_memory_account(const std::string& name);
+
+/**
+ * @return The accounts of all modules with tracked globals, by name.
+ */
+const std::map<std::string, std::unique_ptr<MemoryAccount>>& module_memory_accounts();
+
+} // namespace zeek::detail
@@ -0,0 +1,185 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "MemoryArena.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#if defined(USE_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#elif defined(USE_MIMALLOC)
+#include <mimalloc.h>
+#endif
+
+#include "3rdparty/doctest.h"
+
+namespace zeek::detail {
+
+namespace {
+
+struct ArenaState {
+	uint64_t allocations = 0;
+	uint64_t requested = 0;
+#if defined(USE_JEMALLOC)
+	bool initialized = false;
+	unsigned index = 0;
+	int flags = 0;
+#elif defined(USE_MIMALLOC)
+	mi_heap_t* heap = nullptr;
+#endif
+};
+
+ArenaState arenas[NUM_MEMORY_ARENAS];
+
+#if defined(USE_JEMALLOC)
+// Each arena gets its own thread cache, which is fine as they're only
+// used from the main thread. That keeps memory cached for one arena from
+// getting handed out for another.
+void init_arena(ArenaState* a)
+	{
+	unsigned tcache;
+	size_t sz = sizeof(unsigned);
+
+	if ( mallctl("arenas.create", &a->index, &sz, nullptr, 0) != 0 ||
+	     mallctl("tcache.create", &tcache, &sz, nullptr, 0) != 0 )
+		// Fall back to the default arena.
+		a->flags = 0;
+	else
+		a->flags = MALLOCX_ARENA(a->index) | MALLOCX_TCACHE(tcache);
+
+	a->initialized = true;
+	}
+
+size_t arena_stat(const ArenaState& a, const char* name)
+	{
+	char key[128];
+	snprintf(key, sizeof(key), "stats.arenas.%u.%s", a.index, name);
+
+	size_t val = 0;
+	size_t sz = sizeof(val);
+
+	if ( mallctl(key, &val, &sz, nullptr, 0) != 0 )
+		return 0;
+
+	return val;
+	}
+#endif
+
+}
+
+void* arena_alloc(MemoryArena arena, size_t size)
+	{
+	auto& a = arenas[static_cast<int>(arena)];
+	void* ptr;
+
+	if ( size == 0 )
+		size = 1;
+
+#if defined(USE_JEMALLOC)
+	if ( ! a.initialized )
+		init_arena(&a);
+
+	ptr = mallocx(size, a.flags);
+#elif defined(USE_MIMALLOC)
+	if ( ! a.heap )
+		a.heap = mi_heap_new();
+
+	ptr = a.heap ? mi_heap_malloc(a.heap, size) : mi_malloc(size);
+#else
+	ptr = malloc(size);
+#endif
+
+	if ( ! ptr )
+		throw std::bad_alloc();
+
+	++a.allocations;
+	a.requested += size;
+	return ptr;
+	}
+
+void arena_free(MemoryArena arena, void* ptr, size_t size)
+	{
+	if ( ! ptr )
+		return;
+
+	auto& a = arenas[static_cast<int>(arena)];
+
+	if ( size == 0 )
+		size = 1;
+
+	--a.allocations;
+	a.requested -= size;
+
+#if defined(USE_JEMALLOC)
+	sdallocx(ptr, size, a.flags);
+#elif defined(USE_MIMALLOC)
+	mi_free(ptr);
+#else
+	free(ptr);
+#endif
+	}
+
+const char* arena_name(MemoryArena arena)
+	{
+	switch ( arena ) {
+	case MemoryArena::Script:
+		return "script";
+	case MemoryArena::Connection:
+		return "connection";
+	case MemoryArena::Transient:
+		return "transient";
+	}
+
+	return "unknown";
+	}
+
+MemoryArenaStats arena_stats(MemoryArena arena)
+	{
+	const auto& a = arenas[static_cast<int>(arena)];
+	MemoryArenaStats s;
+	s.allocations = a.allocations;
+	s.requested = a.requested;
+
+#if defined(USE_JEMALLOC)
+	if ( ! a.initialized || ! a.flags )
+		return s;
+
+	// Refresh jemalloc's cached statistics.
+	uint64_t epoch = 1;
+	size_t sz = sizeof(epoch);
+	mallctl("epoch", &epoch, &sz, &epoch, sz);
+
+	size_t page = 0;
+	sz = sizeof(page);
+	mallctl("arenas.page", &page, &sz, nullptr, 0);
+
+	s.allocated = arena_stat(a, "small.allocated") + arena_stat(a, "large.allocated");
+	s.active = arena_stat(a, "pactive") * page;
+	s.dirty = arena_stat(a, "pdirty") * page;
+	s.resident = arena_stat(a, "resident");
+	s.mapped = arena_stat(a, "mapped");
+#endif
+
+	return s;
+	}
+
+TEST_CASE("memory arena accounting")
+	{
+	auto before = arena_stats(MemoryArena::Transient);
+
+	auto p = arena_alloc(MemoryArena::Transient, 100);
+	auto q = arena_alloc(MemoryArena::Transient, 0);
+	auto during = arena_stats(MemoryArena::Transient);
+	CHECK(during.allocations == before.allocations + 2);
+	CHECK(during.requested == before.requested + 101);
+
+	arena_free(MemoryArena::Transient, p, 100);
+	arena_free(MemoryArena::Transient, q, 0);
+	arena_free(MemoryArena::Transient, nullptr, 10);
+	auto after = arena_stats(MemoryArena::Transient);
+	CHECK(after.allocations == before.allocations);
+	CHECK(after.requested == before.requested);
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,72 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace zeek::detail {
+
+/**
+ * The subsystems whose memory gets allocated from separate arenas, so that
+ * their differing lifetimes don't fragment each other's pages, and so that
+ * their usage can be told apart.
+ */
+enum class MemoryArena {
+	Script,     ///< Script-level values, much of which is long-lived.
+	Connection, ///< Connections and their reassembly buffers.
+	Transient,  ///< Events, which don't outlive a drain of the event queue.
+};
+
+constexpr int NUM_MEMORY_ARENAS = 3;
+
+/**
+ * Statistics of a memory arena. Only the counters of the live
+ * allocations are available in all builds; the others need Zeek to be
+ * built with jemalloc and are zero otherwise.
+ */
+struct MemoryArenaStats {
+	uint64_t allocations = 0; ///< Live allocations.
+	uint64_t requested = 0;   ///< Bytes requested by live allocations.
+	uint64_t allocated = 0;   ///< Bytes allocated, including size class rounding.
+	uint64_t active = 0;      ///< Bytes in pages with live allocations.
+	uint64_t dirty = 0;       ///< Bytes in unused pages not yet returned to the OS.
+	uint64_t resident = 0;    ///< Bytes of the arena resident in memory.
+	uint64_t mapped = 0;      ///< Bytes mapped by the arena.
+};
+
+/**
+ * Allocates memory from an arena. With jemalloc, each arena is a separate
+ * jemalloc arena, and with mimalloc a separate heap. Otherwise, this
+ * allocates with malloc() and just keeps track of the usage.
+ *
+ * Arenas may only be used from the main thread.
+ *
+ * @param arena The arena to allocate from.
+ * @param size The number of bytes to allocate.
+ * @return The memory. Throws std::bad_alloc if there is none left.
+ */
+void* arena_alloc(MemoryArena arena, size_t size);
+
+/**
+ * Releases memory allocated by arena_alloc().
+ *
+ * @param arena The arena the memory was allocated from.
+ * @param ptr The memory, which may be null.
+ * @param size The size passed to arena_alloc().
+ */
+void arena_free(MemoryArena arena, void* ptr, size_t size);
+
+/**
+ * @return The name of an arena, for reporting its statistics.
+ */
+const char* arena_name(MemoryArena arena);
+
+/**
+ * @return The current statistics of an arena.
+ */
+MemoryArenaStats arena_stats(MemoryArena arena);
+
+} // namespace zeek::detail
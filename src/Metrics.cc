@@ -0,0 +1,502 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "Metrics.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "Conn.h"
+#include "DNS_Mgr.h"
+#include "Event.h"
+#include "Net.h"
+#include "Reassem.h"
+#include "Reporter.h"
+#include "Sessions.h"
+#include "Timer.h"
+#include "util.h"
+#include "iosource/Manager.h"
+#include "iosource/PktSrc.h"
+#include "threading/Manager.h"
+
+namespace zeek::detail {
+
+MetricsRegistry* metrics_registry = nullptr;
+
+// Requests beyond this size get rejected.
+static constexpr size_t max_request_size = 8192;
+
+// Beyond this many clients, the ones that have been connected the longest
+// get dropped.
+static constexpr size_t max_clients = 16;
+
+// Clients that haven't completed their request after this many seconds get
+// dropped when another one connects.
+static constexpr double client_timeout = 5.0;
+
+static const char* openmetrics_type = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+MetricsRegistry::Family* MetricsRegistry::GetFamily(Type type, const std::string& name,
+                                                    const std::string& help)
+	{
+	for ( auto& f : families )
+		if ( f.name == name )
+			{
+			if ( f.type != type )
+				reporter->InternalError("metric %s registered with different types", name.c_str());
+
+			return &f;
+			}
+
+	families.push_back({type, name, help, {}});
+	return &families.back();
+	}
+
+void MetricsRegistry::AddCounter(const std::string& name, const std::string& help,
+                                 const std::string& labels, Sampler sampler)
+	{
+	GetFamily(Type::Counter, name, help)->series.push_back({labels, std::move(sampler), {}});
+	}
+
+void MetricsRegistry::AddGauge(const std::string& name, const std::string& help,
+                               const std::string& labels, Sampler sampler)
+	{
+	GetFamily(Type::Gauge, name, help)->series.push_back({labels, std::move(sampler), {}});
+	}
+
+void MetricsRegistry::AddHistogram(const std::string& name, const std::string& help,
+                                   const std::string& labels, HistogramSampler sampler)
+	{
+	GetFamily(Type::Histogram, name, help)->series.push_back({labels, {}, std::move(sampler)});
+	}
+
+// Appends a sample line, merging the series' labels with an extra one.
+static void add_sample(std::string* out, const std::string& name, const std::string& labels,
+                       const std::string& extra_label, double value)
+	{
+	out->append(name);
+
+	if ( ! labels.empty() || ! extra_label.empty() )
+		{
+		out->append("{");
+		out->append(labels);
+
+		if ( ! labels.empty() && ! extra_label.empty() )
+			out->append(",");
+
+		out->append(extra_label);
+		out->append("}");
+		}
+
+	out->append(fmt(" %.16g\n", value));
+	}
+
+std::string MetricsRegistry::Render() const
+	{
+	std::string out;
+
+	for ( const auto& f : families )
+		{
+		const char* type = f.type == Type::Counter ? "counter" :
+		                   f.type == Type::Gauge ? "gauge" : "histogram";
+
+		out.append(fmt("# TYPE %s %s\n", f.name.c_str(), type));
+		out.append(fmt("# HELP %s %s\n", f.name.c_str(), f.help.c_str()));
+
+		for ( const auto& s : f.series )
+			{
+			switch ( f.type ) {
+			case Type::Counter:
+				add_sample(&out, f.name + "_total", s.labels, "", s.sampler());
+				break;
+
+			case Type::Gauge:
+				add_sample(&out, f.name, s.labels, "", s.sampler());
+				break;
+
+			case Type::Histogram:
+				{
+				auto h = s.histogram_sampler();
+				uint64_t count = 0;
+
+				for ( size_t i = 0; i < h.counts.size(); ++i )
+					{
+					count += h.counts[i];
+
+					auto le = i < h.upper_bounds.size() ?
+						fmt("le=\"%.16g\"", h.upper_bounds[i]) : "le=\"+Inf\"";
+
+					add_sample(&out, f.name + "_bucket", s.labels, le, count);
+					}
+
+				add_sample(&out, f.name + "_count", s.labels, "", count);
+				add_sample(&out, f.name + "_sum", s.labels, "", h.sum);
+				break;
+				}
+			}
+			}
+		}
+
+	out.append("# EOF\n");
+	return out;
+	}
+
+MetricsServer::MetricsServer(const MetricsRegistry* arg_registry)
+	: registry(arg_registry)
+	{
+	}
+
+MetricsServer::~MetricsServer()
+	{
+	Done();
+	}
+
+bool MetricsServer::Listen(const IPAddr& addr, uint32_t port)
+	{
+	struct sockaddr_storage ss;
+	socklen_t ss_len;
+	memset(&ss, 0, sizeof(ss));
+
+	if ( addr.GetFamily() == IPv4 )
+		{
+		auto sa = reinterpret_cast<struct sockaddr_in*>(&ss);
+		sa->sin_family = AF_INET;
+		sa->sin_port = htons(port);
+		addr.CopyIPv4(&sa->sin_addr);
+		ss_len = sizeof(*sa);
+		}
+	else
+		{
+		auto sa = reinterpret_cast<struct sockaddr_in6*>(&ss);
+		sa->sin6_family = AF_INET6;
+		sa->sin6_port = htons(port);
+		addr.CopyIPv6(&sa->sin6_addr);
+		ss_len = sizeof(*sa);
+		}
+
+	listen_fd = socket(ss.ss_family, SOCK_STREAM, 0);
+
+	if ( listen_fd < 0 )
+		{
+		reporter->Error("can't create metrics socket: %s", strerror(errno));
+		return false;
+		}
+
+	int on = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	if ( bind(listen_fd, reinterpret_cast<struct sockaddr*>(&ss), ss_len) < 0 ||
+	     listen(listen_fd, max_clients) < 0 ||
+	     fcntl(listen_fd, F_SETFL, O_NONBLOCK) < 0 )
+		{
+		reporter->Error("can't listen for metrics scrapes on %s port %u: %s",
+		                addr.AsString().c_str(), port, strerror(errno));
+		safe_close(listen_fd);
+		listen_fd = -1;
+		return false;
+		}
+
+	fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+
+	if ( ! iosource_mgr->RegisterFd(listen_fd, this) )
+		{
+		reporter->Error("can't register metrics socket with the main loop");
+		safe_close(listen_fd);
+		listen_fd = -1;
+		return false;
+		}
+
+	return true;
+	}
+
+void MetricsServer::Process()
+	{
+	Accept();
+
+	for ( size_t i = 0; i < clients.size(); )
+		{
+		if ( Serve(&clients[i]) )
+			++i;
+		else
+			{
+			Close(clients[i]);
+			clients.erase(clients.begin() + i);
+			}
+		}
+	}
+
+void MetricsServer::Accept()
+	{
+	if ( listen_fd < 0 )
+		return;
+
+	for ( ; ; )
+		{
+		int fd = accept(listen_fd, nullptr, nullptr);
+
+		if ( fd < 0 )
+			{
+			if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+				reporter->Warning("can't accept metrics scrape: %s", strerror(errno));
+
+			return;
+			}
+
+		if ( fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+		     ! iosource_mgr->RegisterFd(fd, this) )
+			{
+			safe_close(fd);
+			continue;
+			}
+
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+		double now = current_time(true);
+
+		// Make room by dropping clients that are taking too long, or
+		// else the longest connected one.
+		for ( size_t i = 0; i < clients.size(); )
+			{
+			if ( now - clients[i].connected > client_timeout ||
+			     clients.size() >= max_clients )
+				{
+				Close(clients[i]);
+				clients.erase(clients.begin() + i);
+				}
+			else
+				++i;
+			}
+
+		clients.push_back({fd, now, {}});
+		}
+	}
+
+bool MetricsServer::Serve(Client* c)
+	{
+	char buf[1024];
+
+	for ( ; ; )
+		{
+		auto n = read(c->fd, buf, sizeof(buf));
+
+		if ( n > 0 )
+			{
+			c->request.append(buf, n);
+
+			if ( c->request.size() > max_request_size )
+				{
+				Respond(c, "413 Payload Too Large", "text/plain", "request too large\n");
+				return false;
+				}
+
+			continue;
+			}
+
+		if ( n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) )
+			break;
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+
+		// Closed or failed before completing the request.
+		return false;
+		}
+
+	if ( c->request.find("\r\n\r\n") == std::string::npos &&
+	     c->request.find("\n\n") == std::string::npos )
+		return true;
+
+	auto line_end = c->request.find_first_of("\r\n");
+	auto request_line = c->request.substr(0, line_end);
+	auto path_start = request_line.find(' ');
+	auto path_end = request_line.find(' ', path_start + 1);
+
+	if ( path_start == std::string::npos || path_end == std::string::npos ||
+	     request_line.compare(0, path_start, "GET") != 0 )
+		{
+		Respond(c, "405 Method Not Allowed", "text/plain", "only GET is supported\n");
+		return false;
+		}
+
+	auto path = request_line.substr(path_start + 1, path_end - path_start - 1);
+
+	if ( path == "/metrics" || path == "/" )
+		Respond(c, "200 OK", openmetrics_type, registry->Render());
+	else
+		Respond(c, "404 Not Found", "text/plain", "metrics are at /metrics\n");
+
+	return false;
+	}
+
+void MetricsServer::Respond(Client* c, const char* status, const std::string& content_type,
+                            const std::string& body)
+	{
+	std::string response = fmt("HTTP/1.1 %s\r\n"
+	                           "Content-Type: %s\r\n"
+	                           "Content-Length: %zu\r\n"
+	                           "Connection: close\r\n\r\n",
+	                           status, content_type.c_str(), body.size());
+	response.append(body);
+
+	const char* p = response.data();
+	size_t left = response.size();
+
+	while ( left > 0 )
+		{
+		auto n = write(c->fd, p, left);
+
+		if ( n < 0 && errno == EINTR )
+			continue;
+
+		if ( n <= 0 )
+			// Doesn't take the response at once, give up on it.
+			return;
+
+		p += n;
+		left -= n;
+		}
+	}
+
+void MetricsServer::Close(const Client& c)
+	{
+	iosource_mgr->UnregisterFd(c.fd, this);
+	safe_close(c.fd);
+	}
+
+void MetricsServer::Done()
+	{
+	// This runs while the IO manager is shutting down, when there's no
+	// need to unregister the descriptors anymore.
+	for ( const auto& c : clients )
+		safe_close(c.fd);
+
+	clients.clear();
+
+	if ( listen_fd >= 0 )
+		{
+		safe_close(listen_fd);
+		listen_fd = -1;
+		}
+	}
+
+static double pkt_src_stat(uint64_t iosource::PktSrc::Stats::* field)
+	{
+	iosource::PktSrc* ps = iosource_mgr->GetPktSrc();
+
+	if ( ! ps )
+		return 0;
+
+	iosource::PktSrc::Stats stats;
+	ps->Statistics(&stats);
+	return stats.*field;
+	}
+
+static SessionStats session_stats()
+	{
+	SessionStats s;
+	memset(&s, 0, sizeof(s));
+
+	if ( sessions )
+		sessions->GetStats(s);
+
+	return s;
+	}
+
+void register_core_metrics(MetricsRegistry* r)
+	{
+	r->AddCounter("zeek_packets_received", "Packets received by the packet source.", "",
+	              [] { return pkt_src_stat(&iosource::PktSrc::Stats::received); });
+	r->AddCounter("zeek_packets_dropped", "Packets dropped by the packet source.", "",
+	              [] { return pkt_src_stat(&iosource::PktSrc::Stats::dropped); });
+	r->AddCounter("zeek_packets_link", "Packets seen on the link before filtering.", "",
+	              [] { return pkt_src_stat(&iosource::PktSrc::Stats::link); });
+	r->AddCounter("zeek_bytes_received", "Bytes received by the packet source.", "",
+	              [] { return pkt_src_stat(&iosource::PktSrc::Stats::bytes_received); });
+	r->AddCounter("zeek_packets_processed", "Packets processed by the session manager.", "",
+	              [] { return session_stats().num_packets; });
+
+	r->AddGauge("zeek_connections", "Connections currently in memory.", "protocol=\"tcp\"",
+	            [] { return session_stats().num_TCP_conns; });
+	r->AddGauge("zeek_connections", "Connections currently in memory.", "protocol=\"udp\"",
+	            [] { return session_stats().num_UDP_conns; });
+	r->AddGauge("zeek_connections", "Connections currently in memory.", "protocol=\"icmp\"",
+	            [] { return session_stats().num_ICMP_conns; });
+	r->AddCounter("zeek_connections_created", "Connections created.", "protocol=\"tcp\"",
+	              [] { return session_stats().cumulative_TCP_conns; });
+	r->AddCounter("zeek_connections_created", "Connections created.", "protocol=\"udp\"",
+	              [] { return session_stats().cumulative_UDP_conns; });
+	r->AddCounter("zeek_connections_created", "Connections created.", "protocol=\"icmp\"",
+	              [] { return session_stats().cumulative_ICMP_conns; });
+	r->AddCounter("zeek_conn_cache_hits", "Packets whose connection was found in the connection cache.", "",
+	              [] { return session_stats().conn_cache_hits; });
+	r->AddCounter("zeek_conn_cache_misses", "Packets whose connection had to be looked up in the session tables.", "",
+	              [] { return session_stats().conn_cache_misses; });
+
+	r->AddGauge("zeek_fragment_reassemblers", "Fragmented datagrams waiting for reassembly.", "",
+	            [] { return session_stats().num_fragments; });
+	r->AddCounter("zeek_fragment_evictions", "Fragment reassemblers discarded to stay within frag_memory_limit.", "",
+	              [] { return session_stats().fragment_evictions; });
+
+	r->AddGauge("zeek_reassembly_bytes", "Data buffered for reassembly.", "type=\"tcp\"",
+	            [] { return Reassembler::MemoryAllocation(REASSEM_TCP); });
+	r->AddGauge("zeek_reassembly_bytes", "Data buffered for reassembly.", "type=\"frag\"",
+	            [] { return Reassembler::MemoryAllocation(REASSEM_FRAG); });
+	r->AddGauge("zeek_reassembly_bytes", "Data buffered for reassembly.", "type=\"file\"",
+	            [] { return Reassembler::MemoryAllocation(REASSEM_FILE); });
+	r->AddCounter("zeek_reassembly_evictions", "Reassemblers evicted to stay within reassembly_memory_budget.", "",
+	              [] { return Reassembler::NumEvictions(); });
+
+	r->AddGauge("zeek_timers", "Pending timers.", "",
+	            [] { return timer_mgr ? timer_mgr->Size() : 0; });
+	r->AddCounter("zeek_timers_created", "Timers created.", "",
+	              [] { return timer_mgr ? timer_mgr->CumulativeNum() : 0; });
+
+	r->AddCounter("zeek_events_queued", "Events queued.", "",
+	              [] { return num_events_queued; });
+	r->AddCounter("zeek_events_dispatched", "Events dispatched.", "",
+	              [] { return num_events_dispatched; });
+
+	r->AddGauge("zeek_threads", "Threads, such as log writers and input readers.", "",
+	            [] { return thread_mgr ? thread_mgr->NumThreads() : 0; });
+
+	r->AddCounter("zeek_dns_requests", "Asynchronous DNS requests.", "",
+	              []
+		{
+		DNS_Mgr::Stats s;
+		dns_mgr->GetStats(&s);
+		return s.requests;
+		});
+	r->AddHistogram("zeek_dns_reply_seconds", "How long replies to asynchronous DNS requests took.", "",
+	                []
+		{
+		DNS_Mgr::Stats s;
+		dns_mgr->GetStats(&s);
+
+		MetricsRegistry::Histogram h;
+
+		for ( int i = 0; i < DNS_LATENCY_BUCKETS; ++i )
+			{
+			if ( i < DNS_LATENCY_BUCKETS - 1 )
+				h.upper_bounds.push_back((1 << i) / 1000.0);
+
+			h.counts.push_back(s.latency[i]);
+			}
+
+		h.sum = s.total_latency;
+		return h;
+		});
+
+	r->AddGauge("zeek_memory_bytes", "Memory used by the process.", "",
+	            []
+		{
+		uint64_t total, malloced;
+		get_memory_usage(&total, &malloced);
+		return total;
+		});
+	}
+
+} // namespace zeek::detail
@@ -0,0 +1,156 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "IPAddr.h"
+#include "iosource/IOSource.h"
+
+namespace zeek::detail {
+
+/**
+ * A registry of the core's runtime metrics. Subsystems register a
+ * sampling function for each of their counters, gauges and histograms,
+ * which gets called only when the metrics are rendered, so keeping them
+ * registered costs nothing while processing traffic.
+ *
+ * Metrics belong to families that share a name, type and help text, and
+ * a family can have several series that differ in their labels, such as
+ * one per transport protocol.
+ */
+class MetricsRegistry {
+public:
+	using Sampler = std::function<double()>;
+
+	/**
+	 * The state of a histogram. The counts are per bucket rather than
+	 * cumulative, with one more count than there are upper bounds for
+	 * the values beyond the last one.
+	 */
+	struct Histogram {
+		std::vector<double> upper_bounds;
+		std::vector<uint64_t> counts;
+		double sum = 0.0;
+	};
+
+	using HistogramSampler = std::function<Histogram()>;
+
+	/**
+	 * Registers a monotonically increasing counter.
+	 *
+	 * @param name The family name, without the "_total" suffix.
+	 *
+	 * @param help A description of the family.
+	 *
+	 * @param labels The series' labels in OpenMetrics notation, such as
+	 * ``protocol="tcp"``, or empty.
+	 *
+	 * @param sampler Returns the current value.
+	 */
+	void AddCounter(const std::string& name, const std::string& help,
+	                const std::string& labels, Sampler sampler);
+
+	/**
+	 * Registers a gauge, with parameters like AddCounter().
+	 */
+	void AddGauge(const std::string& name, const std::string& help,
+	              const std::string& labels, Sampler sampler);
+
+	/**
+	 * Registers a histogram, with parameters like AddCounter().
+	 */
+	void AddHistogram(const std::string& name, const std::string& help,
+	                  const std::string& labels, HistogramSampler sampler);
+
+	/**
+	 * Samples all metrics and renders them in the OpenMetrics text format.
+	 */
+	std::string Render() const;
+
+private:
+	enum class Type { Counter, Gauge, Histogram };
+
+	struct Series {
+		std::string labels;
+		Sampler sampler;
+		HistogramSampler histogram_sampler;
+	};
+
+	struct Family {
+		Type type;
+		std::string name;
+		std::string help;
+		std::vector<Series> series;
+	};
+
+	Family* GetFamily(Type type, const std::string& name, const std::string& help);
+
+	std::vector<Family> families;	// in the order of registration
+};
+
+/**
+ * Serves the metrics of a registry over HTTP from within the main loop,
+ * without running any script code. Scrapes are small enough to be
+ * answered in one go: the server reads a client's request once it's
+ * complete and writes the response without blocking, disconnecting the
+ * client if the response doesn't fit into its socket buffer.
+ */
+class MetricsServer final : public iosource::IOSource {
+public:
+	explicit MetricsServer(const MetricsRegistry* registry);
+	~MetricsServer() override;
+
+	/**
+	 * Starts listening for scrapes.
+	 *
+	 * @param addr The address to listen on.
+	 *
+	 * @param port The TCP port to listen on.
+	 *
+	 * @return False if the socket can't be set up, after reporting why.
+	 */
+	bool Listen(const IPAddr& addr, uint32_t port);
+
+	// IOSource interface.
+	void Process() override;
+	void Done() override;
+	const char* Tag() override	{ return "MetricsServer"; }
+	double GetNextTimeout() override	{ return -1; }
+
+private:
+	struct Client {
+		int fd;
+		double connected;
+		std::string request;
+	};
+
+	void Accept();
+
+	// Reads what the client has sent, answering the request once it's
+	// complete.  Returns false if the client is done with.
+	bool Serve(Client* c);
+
+	void Respond(Client* c, const char* status, const std::string& content_type,
+	             const std::string& body);
+
+	void Close(const Client& c);
+
+	const MetricsRegistry* registry;
+	int listen_fd = -1;
+	std::vector<Client> clients;
+};
+
+/**
+ * Registers the metrics of the core's subsystems: packet sources,
+ * sessions, timers, events, reassembly, threads, DNS and memory.
+ */
+void register_core_metrics(MetricsRegistry* registry);
+
+// Created at startup, for subsystems to register their metrics with.
+extern MetricsRegistry* metrics_registry;
+
+} // namespace zeek::detail
@@ -32,10 +32,13 @@ extern "C" {
 #include "Reporter.h"
 #include "Scope.h"
 #include "Anon.h"
+#include "Overload.h"
 #include "PacketDumper.h"
+#include "Stats.h"
 #include "iosource/Manager.h"
 #include "iosource/PktSrc.h"
 #include "iosource/PktDumper.h"
+#include "iosource/PacketBalancer.h"
 #include "plugin/Manager.h"
 #include "broker/Manager.h"
 
@@ -49,6 +52,8 @@ bool reading_live = false;
 bool reading_traces = false;
 bool have_pending_timers = false;
 double pseudo_realtime = 0.0;
+int num_flow_shards = 0;
+int flow_shard = 0;
 double network_time = 0.0;	// time according to last packet timestamp
 				// (or current time)
 double processing_start_time = 0.0;	// time started working on current pkt
@@ -220,6 +225,14 @@ void expire_timers(iosource::PktSrc* src_ps)
 			max_timer_expires - current_dispatched);
 	}
 
+// Records how long a stage of processing a packet took, and starts the next.
+static void end_packet_stage(PacketLatencyProfiler::Stage stage, double* stage_start)
+	{
+	double now = PacketLatencyProfiler::Now();
+	packet_latency_profiler->Record(stage, now - *stage_start);
+	*stage_start = now;
+	}
+
 void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 	{
 	if ( ! bro_start_network_time )
@@ -233,12 +246,37 @@ void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 	// network_time never goes back.
 	net_update_time(timer_mgr->Time() < t ? t : timer_mgr->Time());
 
+	if ( packet_balancer )
+		{
+		// Offline input can wait for the workers to catch up.
+		packet_balancer->Dispatch(pkt, ! src_ps->IsLive());
+		return;
+		}
+
 	current_pktsrc = src_ps;
 	current_iosrc = src_ps;
 	processing_start_time = t;
 
+	double packet_start = 0;
+	double stage_start = 0;
+
+	if ( packet_latency_profiler )
+		{
+		packet_start = stage_start = PacketLatencyProfiler::Now();
+
+		if ( src_ps->IsLive() )
+			packet_latency_profiler->Record(PacketLatencyProfiler::LAG,
+			                                current_time(true) - t);
+		}
+
 	expire_timers(src_ps);
 
+	if ( overload_controller )
+		overload_controller->Update(t, src_ps->IsLive());
+
+	if ( packet_latency_profiler )
+		end_packet_stage(PacketLatencyProfiler::TIMERS, &stage_start);
+
 	SegmentProfiler* sp = nullptr;
 
 	if ( load_sample )
@@ -259,8 +297,23 @@ void net_packet_dispatch(double t, const Packet* pkt, iosource::PktSrc* src_ps)
 			}
 		}
 
-	sessions->NextPacket(t, pkt);
-	mgr.Drain();
+	// Packets of other shards' flows still drive network time and
+	// timers above, so that each shard sees the same clock.
+	if ( num_flow_shards <= 1 ||
+	     iosource::PacketBalancer::FlowHash(pkt) % num_flow_shards == static_cast<uint64_t>(flow_shard) )
+		sessions->NextPacket(t, pkt);
+
+	if ( packet_latency_profiler )
+		end_packet_stage(PacketLatencyProfiler::SESSIONS, &stage_start);
+
+	mgr.Drain(true);
+
+	if ( packet_latency_profiler )
+		{
+		end_packet_stage(PacketLatencyProfiler::EVENTS, &stage_start);
+		packet_latency_profiler->Record(PacketLatencyProfiler::TOTAL,
+		                                stage_start - packet_start);
+		}
 
 	if ( sp )
 		{
@@ -325,7 +378,7 @@ void net_run()
 			expire_timers();
 			}
 
-		mgr.Drain();
+		mgr.Drain(true);
 
 		processing_start_time = 0.0;	// = "we're not processing now"
 		current_dispatched = 0;
@@ -393,6 +446,13 @@ void net_finish(int drain_events)
 			sessions->Done();
 		}
 
+	if ( packet_balancer )
+		{
+		packet_balancer->Finish();
+		delete packet_balancer;
+		packet_balancer = nullptr;
+		}
+
 #ifdef DEBUG
 	extern int reassem_seen_bytes, reassem_copied_bytes;
 	// DEBUG_MSG("Reassembly (TCP and IP/Frag): %d bytes seen, %d bytes copied\n",
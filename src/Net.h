@@ -60,6 +60,12 @@ extern bool have_pending_timers;
 // is the speedup (1 = real-time, 0.5 = half real-time, etc.).
 extern double pseudo_realtime;
 
+// If > 1, we only analyze the flows whose hash modulo this value equals
+// flow_shard, while still advancing network time with every packet, so
+// that several processes can split up reading one trace.
+extern int num_flow_shards;
+extern int flow_shard;
+
 // When we started processing the current packet and corresponding event
 // queue.
 extern double processing_start_time;
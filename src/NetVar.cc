@@ -7,6 +7,7 @@
 #include "EventHandler.h"
 #include "Val.h"
 #include "ID.h"
+#include "Reassem.h"
 
 zeek::RecordType* conn_id;
 zeek::RecordType* endpoint;
@@ -33,6 +34,8 @@ zeek::RecordType* mime_match;
 int watchdog_interval;
 
 int max_timer_expires;
+int max_remote_events_per_drain;
+double max_remote_drain_time;
 
 int ignore_checksums;
 int partial_connection_ok;
@@ -42,6 +45,7 @@ int tcp_match_undelivered;
 int encap_hdr_size;
 
 double frag_timeout;
+bro_uint_t frag_memory_limit;
 
 double tcp_SYN_timeout;
 double tcp_session_timer;
@@ -62,6 +66,7 @@ double non_analyzed_lifetime;
 double tcp_inactivity_timeout;
 double udp_inactivity_timeout;
 double icmp_inactivity_timeout;
+double inactivity_check_interval;
 
 int tcp_storm_thresh;
 double tcp_storm_interarrival_thresh;
@@ -80,9 +85,12 @@ zeek::TableVal* udp_content_ports;
 bool udp_content_deliver_all_orig;
 bool udp_content_deliver_all_resp;
 bool udp_content_delivery_ports_use_resp;
+bool udp_counting_only_flows;
 
 double dns_session_timeout;
 double rpc_timeout;
+double rpc_call_timeout;
+bro_uint_t rpc_max_outstanding_calls;
 
 int mime_segment_length;
 int mime_segment_overlap_length;
@@ -93,6 +101,7 @@ int http_entity_data_delivery_size;
 zeek::RecordType* http_stats_rec;
 zeek::RecordType* http_message_stat;
 int truncate_http_URI;
+int http_max_decompression_ratio;
 
 zeek::RecordType* pm_mapping;
 zeek::TableType* pm_mappings;
@@ -126,6 +135,7 @@ zeek::TableVal* stp_skip_src;
 double table_expire_interval;
 double table_expire_delay;
 int table_incremental_step;
+int table_index_cache_max;
 
 double connection_status_update_interval;
 
@@ -202,6 +212,7 @@ void init_general_global_var()
 	table_expire_interval = zeek::id::find_val("table_expire_interval")->AsInterval();
 	table_expire_delay = zeek::id::find_val("table_expire_delay")->AsInterval();
 	table_incremental_step = zeek::id::find_val("table_incremental_step")->AsCount();
+	table_index_cache_max = zeek::id::find_val("table_index_cache_max")->AsCount();
 	packet_filter_default = zeek::id::find_val("packet_filter_default")->AsBool();
 	sig_max_group_size = zeek::id::find_val("sig_max_group_size")->AsCount();
 	check_for_unused_event_handlers = zeek::id::find_val("check_for_unused_event_handlers")->AsBool();
@@ -229,6 +240,7 @@ void init_net_var()
 	encap_hdr_size = zeek::id::find_val("encap_hdr_size")->AsCount();
 
 	frag_timeout = zeek::id::find_val("frag_timeout")->AsInterval();
+	frag_memory_limit = zeek::id::find_val("frag_memory_limit")->AsCount();
 
 	tcp_SYN_timeout = zeek::id::find_val("tcp_SYN_timeout")->AsInterval();
 	tcp_session_timer = zeek::id::find_val("tcp_session_timer")->AsInterval();
@@ -242,11 +254,13 @@ void init_net_var()
 	tcp_max_above_hole_without_any_acks = zeek::id::find_val("tcp_max_above_hole_without_any_acks")->AsCount();
 	tcp_excessive_data_without_further_acks = zeek::id::find_val("tcp_excessive_data_without_further_acks")->AsCount();
 	tcp_max_old_segments = zeek::id::find_val("tcp_max_old_segments")->AsCount();
+	Reassembler::SetMemoryBudget(zeek::id::find_val("reassembly_memory_budget")->AsCount());
 
 	non_analyzed_lifetime = zeek::id::find_val("non_analyzed_lifetime")->AsInterval();
 	tcp_inactivity_timeout = zeek::id::find_val("tcp_inactivity_timeout")->AsInterval();
 	udp_inactivity_timeout = zeek::id::find_val("udp_inactivity_timeout")->AsInterval();
 	icmp_inactivity_timeout = zeek::id::find_val("icmp_inactivity_timeout")->AsInterval();
+	inactivity_check_interval = zeek::id::find_val("inactivity_check_interval")->AsInterval();
 
 	tcp_storm_thresh = zeek::id::find_val("tcp_storm_thresh")->AsCount();
 	tcp_storm_interarrival_thresh = zeek::id::find_val("tcp_storm_interarrival_thresh")->AsInterval();
@@ -262,19 +276,28 @@ void init_net_var()
 		bool(zeek::id::find_val("udp_content_deliver_all_resp")->AsBool());
 	udp_content_delivery_ports_use_resp =
 		bool(zeek::id::find_val("udp_content_delivery_ports_use_resp")->AsBool());
+	udp_counting_only_flows =
+		bool(zeek::id::find_val("udp_counting_only_flows")->AsBool());
 
 	dns_session_timeout = zeek::id::find_val("dns_session_timeout")->AsInterval();
 	rpc_timeout = zeek::id::find_val("rpc_timeout")->AsInterval();
+	rpc_call_timeout = zeek::id::find_val("rpc_call_timeout")->AsInterval();
+	rpc_max_outstanding_calls = zeek::id::find_val("rpc_max_outstanding_calls")->AsCount();
 
 	watchdog_interval = int(zeek::id::find_val("watchdog_interval")->AsInterval());
 
 	max_timer_expires = zeek::id::find_val("max_timer_expires")->AsCount();
+	max_remote_events_per_drain = zeek::id::find_val("max_remote_events_per_drain")->AsCount();
+	max_remote_drain_time = zeek::id::find_val("max_remote_drain_time")->AsInterval();
 
 	mime_segment_length = zeek::id::find_val("mime_segment_length")->AsCount();
 	mime_segment_overlap_length = zeek::id::find_val("mime_segment_overlap_length")->AsCount();
 
 	http_entity_data_delivery_size = zeek::id::find_val("http_entity_data_delivery_size")->AsCount();
 	truncate_http_URI = zeek::id::find_val("truncate_http_URI")->AsInt();
+	http_max_decompression_ratio = zeek::id::find_val("http_max_decompression_ratio")->AsCount();
+
+	zeek::val_mgr->InitPools();
 
 	dns_skip_all_auth = zeek::id::find_val("dns_skip_all_auth")->AsBool();
 	dns_skip_all_addl = zeek::id::find_val("dns_skip_all_addl")->AsBool();
@@ -288,15 +311,15 @@ void init_net_var()
 	orig_addr_anonymization = 0;
 	if ( const auto& id = zeek::id::find("orig_addr_anonymization") )
 		if ( const auto& v = id->GetVal() )
-			orig_addr_anonymization = v->AsInt();
+			orig_addr_anonymization = v->AsEnum();
 	resp_addr_anonymization = 0;
 	if ( const auto& id = zeek::id::find("resp_addr_anonymization") )
 		if ( const auto& v = id->GetVal() )
-			resp_addr_anonymization = v->AsInt();
+			resp_addr_anonymization = v->AsEnum();
 	other_addr_anonymization = 0;
 	if ( const auto& id = zeek::id::find("other_addr_anonymization") )
 		if ( const auto& v = id->GetVal() )
-			other_addr_anonymization = v->AsInt();
+			other_addr_anonymization = v->AsEnum();
 
 	connection_status_update_interval = 0.0;
 	if ( const auto& id = zeek::id::find("connection_status_update_interval") )
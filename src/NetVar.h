@@ -52,6 +52,8 @@ extern zeek::RecordType* mime_match;
 extern int watchdog_interval;
 
 extern int max_timer_expires;
+extern int max_remote_events_per_drain;
+extern double max_remote_drain_time;
 
 extern int ignore_checksums;
 extern int partial_connection_ok;
@@ -61,6 +63,7 @@ extern int tcp_match_undelivered;
 extern int encap_hdr_size;
 
 extern double frag_timeout;
+extern bro_uint_t frag_memory_limit;
 
 extern double tcp_SYN_timeout;
 extern double tcp_session_timer;
@@ -82,6 +85,7 @@ extern double non_analyzed_lifetime;
 extern double tcp_inactivity_timeout;
 extern double udp_inactivity_timeout;
 extern double icmp_inactivity_timeout;
+extern double inactivity_check_interval;
 
 extern int tcp_storm_thresh;
 extern double tcp_storm_interarrival_thresh;
@@ -107,9 +111,12 @@ extern zeek::TableVal* udp_content_ports;
 extern bool udp_content_deliver_all_orig;
 extern bool udp_content_deliver_all_resp;
 extern bool udp_content_delivery_ports_use_resp;
+extern bool udp_counting_only_flows;
 
 extern double dns_session_timeout;
 extern double rpc_timeout;
+extern double rpc_call_timeout;
+extern bro_uint_t rpc_max_outstanding_calls;
 
 extern int mime_segment_length;
 extern int mime_segment_overlap_length;
@@ -124,6 +131,7 @@ extern zeek::RecordType* http_stats_rec;
 [[deprecated("Remove in v4.1.  Perform your own lookup.")]]
 extern zeek::RecordType* http_message_stat;
 extern int truncate_http_URI;
+extern int http_max_decompression_ratio;
 
 [[deprecated("Remove in v4.1.  Perform your own lookup.")]]
 extern zeek::RecordType* pm_mapping;
@@ -176,6 +184,7 @@ extern zeek::TableVal* stp_skip_src;
 extern double table_expire_interval;
 extern double table_expire_delay;
 extern int table_incremental_step;
+extern int table_index_cache_max;
 
 extern int orig_addr_anonymization, resp_addr_anonymization;
 extern int other_addr_anonymization;
@@ -3,6 +3,7 @@
 #include "Notifier.h"
 #include "DebugLogger.h"
 
+#include <cinttypes>
 #include <set>
 
 notifier::Registry notifier::registry;
@@ -21,6 +22,9 @@ notifier::Registry::~Registry()
 	{
 	while ( registrations.begin() != registrations.end() )
 		Unregister(registrations.begin()->first);
+
+	while ( key_registrations.begin() != key_registrations.end() )
+		Unregister(key_registrations.begin()->first);
 	}
 
 void notifier::Registry::Register(Modifiable* m, notifier::Receiver* r)
@@ -31,6 +35,14 @@ void notifier::Registry::Register(Modifiable* m, notifier::Receiver* r)
 	++m->num_receivers;
 	}
 
+void notifier::Registry::Register(Modifiable* m, notifier::Receiver* r, uint64_t key)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "registering object %p key %" PRIu64 " for receiver %p", m, key, r);
+
+	key_registrations[m].insert({key, r});
+	++m->num_receivers;
+	}
+
 void notifier::Registry::Unregister(Modifiable* m, notifier::Receiver* r)
 	{
 	DBG_LOG(DBG_NOTIFIERS, "unregistering object %p from receiver %p", m, r);
@@ -47,6 +59,29 @@ void notifier::Registry::Unregister(Modifiable* m, notifier::Receiver* r)
 		}
 	}
 
+void notifier::Registry::Unregister(Modifiable* m, notifier::Receiver* r, uint64_t key)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "unregistering object %p key %" PRIu64 " from receiver %p", m, key, r);
+
+	auto km = key_registrations.find(m);
+	if ( km == key_registrations.end() )
+		return;
+
+	auto x = km->second.equal_range(key);
+	for ( auto i = x.first; i != x.second; i++ )
+		{
+		if ( i->second == r )
+			{
+			--m->num_receivers;
+			km->second.erase(i);
+			break;
+			}
+		}
+
+	if ( km->second.empty() )
+		key_registrations.erase(km);
+	}
+
 void notifier::Registry::Unregister(Modifiable* m)
 	{
 	DBG_LOG(DBG_NOTIFIERS, "unregistering object %p from all notifiers", m);
@@ -56,6 +91,13 @@ void notifier::Registry::Unregister(Modifiable* m)
 		--i->first->num_receivers;
 
 	registrations.erase(x.first, x.second);
+
+	auto km = key_registrations.find(m);
+	if ( km != key_registrations.end() )
+		{
+		m->num_receivers -= km->second.size();
+		key_registrations.erase(km);
+		}
 	}
 
 void notifier::Registry::Modified(Modifiable* m)
@@ -65,6 +107,29 @@ void notifier::Registry::Modified(Modifiable* m)
 	auto x = registrations.equal_range(m);
 	for ( auto i = x.first; i != x.second; i++ )
 		i->second->Modified(m);
+
+	// Without a key, any of the keys may have changed.
+	auto km = key_registrations.find(m);
+	if ( km != key_registrations.end() )
+		for ( auto& r : km->second )
+			r.second->Modified(m);
+	}
+
+void notifier::Registry::Modified(Modifiable* m, uint64_t key)
+	{
+	DBG_LOG(DBG_NOTIFIERS, "object %p key %" PRIu64 " has been modified", m, key);
+
+	auto x = registrations.equal_range(m);
+	for ( auto i = x.first; i != x.second; i++ )
+		i->second->Modified(m);
+
+	auto km = key_registrations.find(m);
+	if ( km == key_registrations.end() )
+		return;
+
+	auto y = km->second.equal_range(key);
+	for ( auto i = y.first; i != y.second; i++ )
+		i->second->Modified(m);
 	}
 
 void notifier::Registry::Terminate()
@@ -74,6 +139,10 @@ void notifier::Registry::Terminate()
 	for ( auto& r : registrations )
 		receivers.emplace(r.second);
 
+	for ( auto& km : key_registrations )
+		for ( auto& r : km.second )
+			receivers.emplace(r.second);
+
 	for ( auto& r : receivers )
 		r->Terminate();
 	}
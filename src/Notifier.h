@@ -52,6 +52,20 @@ public:
 	 */
 	void Register(Modifiable* m, Receiver* r);
 
+	/**
+	 * Registers a receiver to be informed only when an object changes in
+	 * a way that might affect a particular key, such as a table entry.
+	 * Modifications that don't specify a key notify all keyed receivers
+	 * as well.
+	 *
+	 * @param m object to track, as with the unkeyed version.
+	 *
+	 * @param r receiver to notify on changes, as with the unkeyed version.
+	 *
+	 * @param key the hash of the key the receiver depends on.
+	 */
+	void Register(Modifiable* m, Receiver* r, uint64_t key);
+
 	/**
 	 * Cancels a receiver's request to be informed about an object's
 	 * modification. The arguments to the method must match what was
@@ -63,6 +77,19 @@ public:
 	 */
 	void Unregister(Modifiable* m, Receiver* Receiver);
 
+	/**
+	 * Cancels a receiver's request to be informed about changes to one
+	 * of an object's keys. The arguments to the method must match what
+	 * was originally registered.
+	 *
+	 * @param m object to no loger track.
+	 *
+	 * @param r receiver to no longer notify.
+	 *
+	 * @param key the key's hash.
+	 */
+	void Unregister(Modifiable* m, Receiver* r, uint64_t key);
+
 	/**
 	 * Cancels any active receiver requests to be informed about a
 	 * partilar object's modifications.
@@ -84,8 +111,15 @@ private:
 	// Will be called from the object itself.
 	void Modified(Modifiable* m);
 
+	// Inform the receivers of a modification to one of an object's keys:
+	// those registered for the whole object, and those for that key.
+	void Modified(Modifiable* m, uint64_t key);
+
 	typedef std::unordered_multimap<Modifiable*, Receiver*> ModifiableMap;
 	ModifiableMap registrations;
+
+	typedef std::unordered_multimap<uint64_t, Receiver*> KeyMap;
+	std::unordered_map<Modifiable*, KeyMap> key_registrations;
 };
 
 /**
@@ -109,12 +143,25 @@ public:
 			registry.Modified(this);
 		}
 
+	/**
+	 * Signals a modification that can only affect the given key, such as
+	 * the insertion or removal of a table entry. Receivers registered
+	 * for other keys won't be notified.
+	 *
+	 * @param key the hash of the key.
+	 */
+	void Modified(uint64_t key)
+		{
+		if ( num_receivers )
+			registry.Modified(this, key);
+		}
+
 protected:
 	friend class Registry;
 
 	virtual ~Modifiable();
 
-	// Number of currently registered receivers.
+	// Number of currently registered receivers, keyed or not.
 	uint64_t num_receivers = 0;
 };
 
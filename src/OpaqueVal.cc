@@ -9,6 +9,7 @@
 #include "Scope.h"
 #include "Desc.h"
 #include "Var.h"
+#include "RE.h"
 #include "probabilistic/BloomFilter.h"
 #include "probabilistic/CardinalityCounter.h"
 
@@ -1038,4 +1039,105 @@ ValPtr ParaglobVal::DoClone(CloneState* state)
 		}
 	}
 
+PatternSetVal::PatternSetVal() : OpaqueVal(pattern_set_type)
+	{
+	}
+
+PatternSetVal::~PatternSetVal() = default;
+
+IntrusivePtr<PatternSetVal> PatternSetVal::Make(std::vector<std::string> patterns)
+	{
+	auto ps = IntrusivePtr<PatternSetVal>{AdoptRef{}, new PatternSetVal()};
+	ps->patterns = std::move(patterns);
+
+	if ( ! ps->Compile() )
+		return nullptr;
+
+	return ps;
+	}
+
+bool PatternSetVal::Compile()
+	{
+	matcher = nullptr;
+
+	string_list set;
+	int_list idx;
+
+	// The accepting states' indices must not be zero, so they are off
+	// by one from the patterns'.
+	for ( size_t i = 0; i < patterns.size(); ++i )
+		{
+		if ( patterns[i].empty() )
+			continue;
+
+		set.push_back(const_cast<char*>(patterns[i].c_str()));
+		idx.push_back(i + 1);
+		}
+
+	if ( set.empty() )
+		return true;
+
+	auto m = std::make_unique<Specific_RE_Matcher>(MATCH_EXACTLY);
+
+	if ( ! m->CompileSet(set, idx) )
+		return false;
+
+	matcher = std::move(m);
+	return true;
+	}
+
+VectorValPtr PatternSetVal::Match(const String* s) const
+	{
+	auto rval = zeek::make_intrusive<VectorVal>(zeek::id::index_vec);
+
+	if ( ! matcher )
+		return rval;
+
+	RE_Match_State state(matcher.get());
+	state.Match(s->Bytes(), s->Len(), true, true, false);
+
+	for ( const auto& [idx, pos] : state.AcceptedMatches() )
+		rval->Assign(rval->Size(), zeek::val_mgr->Count(idx - 1));
+
+	return rval;
+	}
+
+IMPLEMENT_OPAQUE_VALUE(PatternSetVal)
+
+broker::expected<broker::data> PatternSetVal::DoSerialize() const
+	{
+	broker::vector d;
+
+	for ( const auto& p : patterns )
+		d.emplace_back(p);
+
+	return {std::move(d)};
+	}
+
+bool PatternSetVal::DoUnserialize(const broker::data& data)
+	{
+	auto d = caf::get_if<broker::vector>(&data);
+	if ( ! d )
+		return false;
+
+	patterns.clear();
+
+	for ( const auto& p : *d )
+		{
+		auto s = caf::get_if<std::string>(&p);
+		if ( ! s )
+			return false;
+
+		patterns.push_back(*s);
+		}
+
+	return Compile();
+	}
+
+ValPtr PatternSetVal::DoClone(CloneState* state)
+	{
+	// The set can't change once compiled.
+	return {NewRef{}, this};
+	}
+
 }
@@ -14,6 +14,8 @@
 
 namespace broker { class data; }
 
+class Specific_RE_Matcher;
+
 namespace probabilistic {
 	class BloomFilter;
 	class CardinalityCounter;
@@ -383,6 +385,52 @@ private:
 	std::unique_ptr<paraglob::Paraglob> internal_paraglob;
 };
 
+/**
+ * A set of patterns compiled together into a single DFA, whose accepting
+ * states tell which of the patterns matched, so that one pass over a
+ * string finds all of them. The patterns match anywhere in the string,
+ * as with the "in" operator.
+ */
+class PatternSetVal : public OpaqueVal {
+public:
+	/**
+	 * Compiles a set of patterns.
+	 *
+	 * @param patterns The patterns' texts, as
+	 * RE_Matcher::AnywherePatternText() has them. Empty texts stand in
+	 * for patterns that match nothing.
+	 *
+	 * @return The compiled set, or null if a pattern didn't compile.
+	 */
+	static IntrusivePtr<PatternSetVal> Make(std::vector<std::string> patterns);
+
+	~PatternSetVal() override;
+
+	/**
+	 * Returns the indices of the patterns that match a string, in
+	 * increasing order.
+	 */
+	VectorValPtr Match(const String* s) const;
+
+	/**
+	 * Returns the number of patterns in the set.
+	 */
+	size_t Size() const	{ return patterns.size(); }
+
+	ValPtr DoClone(CloneState* state) override;
+
+protected:
+	PatternSetVal();
+
+	DECLARE_OPAQUE_VALUE(PatternSetVal)
+
+private:
+	bool Compile();
+
+	std::vector<std::string> patterns;
+	std::unique_ptr<Specific_RE_Matcher> matcher;
+};
+
 }
 
 using OpaqueMgr [[deprecated("Remove in v4.1. Use zeek::OpaqueMgr instead.")]] = zeek::OpaqueMgr;
@@ -36,6 +36,11 @@ void zeek::Options::filter_supervised_node_options()
 	ignore_checksums = og.ignore_checksums;
 	use_watchdog = og.use_watchdog;
 	pseudo_realtime = og.pseudo_realtime;
+	flow_shard = og.flow_shard;
+	num_flow_shards = og.num_flow_shards;
+	script_exec_mode = og.script_exec_mode;
+	const_fold_mode = og.const_fold_mode;
+	inline_funcs_mode = og.inline_funcs_mode;
 	dns_mode = og.dns_mode;
 
 	bare_mode = og.bare_mode;
@@ -46,6 +51,8 @@ void zeek::Options::filter_supervised_node_options()
 
 	pcap_filter = og.pcap_filter;
 	signature_files = og.signature_files;
+	dfa_cache_file = og.dfa_cache_file;
+	use_hyperscan = og.use_hyperscan;
 
 	// TODO: These are likely to be handled in a node-specific or
 	// use-case-specific way.  e.g. interfaces is already handled for the
@@ -114,6 +121,16 @@ void zeek::usage(const char* prog, int code)
 	fprintf(stderr, "    -M|--mem-profile               | record heap [perftools]\n");
 #endif
 	fprintf(stderr, "    --pseudo-realtime[=<speedup>]  | enable pseudo-realtime for performance evaluation (default 1)\n");
+	fprintf(stderr, "    --script-exec <mode>           | run script functions with the AST interpreter ('ast', the default), compiled to bytecode ('bytecode'), or compiled and checked against the interpreter ('validate')\n");
+	fprintf(stderr, "    --const-fold <mode>            | remove script code made dead by constant conditions ('on', the default), keep it ('off'), or remove it and list each change on stderr ('report')\n");
+	fprintf(stderr, "    --inline-funcs <mode>          | inline calls to small script functions ('on'), don't ('off', the default), or inline them and list each call on stderr ('report')\n");
+	fprintf(stderr, "    --dfa-cache <file>             | restore pattern and signature DFAs from given file\n");
+	fprintf(stderr, "    --build-dfa-cache <file>       | fully build pattern and signature DFAs, write them to given file, and exit\n");
+	fprintf(stderr, "    --hyperscan                    | match patterns and signatures with Hyperscan where possible\n");
+	fprintf(stderr, "    --balance-packets <prefix>:<n> | spread packets across <n> local workers reading shmring::<prefix>.<i>, instead of analyzing them\n");
+	fprintf(stderr, "    --flow-shard <i>/<n>           | only analyze the flows that hash to shard <i> of <n>, for splitting up a trace across processes\n");
+	fprintf(stderr, "    --record-events <file>         | record the events that the core raises to given file\n");
+	fprintf(stderr, "    --replay-events <file>         | raise the events recorded in given file, instead of reading packets\n");
 	fprintf(stderr, "    -j|--jobs                      | enable supervisor mode\n");
 
 #ifdef USE_IDMEF
@@ -129,8 +146,10 @@ void zeek::usage(const char* prog, int code)
 	fprintf(stderr, "    $ZEEK_SEED_FILE                | file to load seeds from (not set)\n");
 	fprintf(stderr, "    $ZEEK_LOG_SUFFIX               | ASCII log file extension (.%s)\n", logging::writer::Ascii::LogExt().c_str());
 	fprintf(stderr, "    $ZEEK_PROFILER_FILE            | Output file for script execution statistics (not set)\n");
+	fprintf(stderr, "    $ZEEK_PROFILER_FORMAT          | Format of script execution statistics, 'text' or 'binary' (%s)\n", zeekenv("ZEEK_PROFILER_FORMAT") ? zeekenv("ZEEK_PROFILER_FORMAT") : "text");
 	fprintf(stderr, "    $ZEEK_DISABLE_ZEEKYGEN         | Disable Zeekygen documentation support (%s)\n", zeekenv("ZEEK_DISABLE_ZEEKYGEN") ? "set" : "not set");
 	fprintf(stderr, "    $ZEEK_DNS_RESOLVER             | IPv4/IPv6 address of DNS resolver to use (%s)\n", zeekenv("ZEEK_DNS_RESOLVER") ? zeekenv("ZEEK_DNS_RESOLVER") : "not set, will use first IPv4 address from /etc/resolv.conf");
+	fprintf(stderr, "    $ZEEK_TIMER_MGR                | timer manager implementation, 'pq' or 'wheel' (%s)\n", zeekenv("ZEEK_TIMER_MGR") ? zeekenv("ZEEK_TIMER_MGR") : "pq");
 	fprintf(stderr, "    $ZEEK_DEBUG_LOG_STDERR         | Use stderr for debug logs generated via the -B flag");
 
 	fprintf(stderr, "\n");
@@ -229,6 +248,16 @@ zeek::Options zeek::parse_cmdline(int argc, char** argv)
 #endif
 
 		{"pseudo-realtime",	optional_argument, nullptr,	'E'},
+		{"script-exec",		required_argument, nullptr,	'O'},
+		{"const-fold",		required_argument, nullptr,	'K'},
+		{"inline-funcs",	required_argument, nullptr,	'J'},
+		{"dfa-cache",		required_argument, nullptr,	'L'},
+		{"build-dfa-cache",	required_argument, nullptr,	'R'},
+		{"hyperscan",		no_argument,		nullptr,	'Y'},
+		{"balance-packets",	required_argument, nullptr,	'A'},
+		{"flow-shard",		required_argument, nullptr,	'Z'},
+		{"record-events",	required_argument, nullptr,	'g'},
+		{"replay-events",	required_argument, nullptr,	'y'},
 		{"jobs",	optional_argument, nullptr,	'j'},
 		{"test",		no_argument,		nullptr,	'#'},
 
@@ -341,6 +370,63 @@ zeek::Options zeek::parse_cmdline(int argc, char** argv)
 			if ( optarg )
 				rval.pseudo_realtime = atof(optarg);
 			break;
+		case 'O':
+			if ( ! streq(optarg, "ast") && ! streq(optarg, "bytecode") &&
+			     ! streq(optarg, "validate") )
+				{
+				fprintf(stderr, "ERROR: unknown script execution mode '%s'\n", optarg);
+				usage(zargs[0], 1);
+				}
+
+			rval.script_exec_mode = optarg;
+			break;
+		case 'K':
+			if ( ! streq(optarg, "on") && ! streq(optarg, "off") &&
+			     ! streq(optarg, "report") )
+				{
+				fprintf(stderr, "ERROR: unknown constant folding mode '%s'\n", optarg);
+				usage(zargs[0], 1);
+				}
+
+			rval.const_fold_mode = optarg;
+			break;
+		case 'J':
+			if ( ! streq(optarg, "on") && ! streq(optarg, "off") &&
+			     ! streq(optarg, "report") )
+				{
+				fprintf(stderr, "ERROR: unknown function inlining mode '%s'\n", optarg);
+				usage(zargs[0], 1);
+				}
+
+			rval.inline_funcs_mode = optarg;
+			break;
+		case 'L':
+			rval.dfa_cache_file = optarg;
+			break;
+		case 'R':
+			rval.dfa_cache_output_file = optarg;
+			break;
+		case 'Y':
+			rval.use_hyperscan = true;
+			break;
+		case 'A':
+			rval.balance_packets = optarg;
+			break;
+		case 'Z':
+			if ( sscanf(optarg, "%d/%d", &rval.flow_shard, &rval.num_flow_shards) != 2 ||
+			     rval.num_flow_shards <= 0 || rval.flow_shard < 0 ||
+			     rval.flow_shard >= rval.num_flow_shards )
+				{
+				fprintf(stderr, "ERROR: expected --flow-shard <i>/<n> with 0 <= i < n\n");
+				usage(zargs[0], 1);
+				}
+			break;
+		case 'g':
+			rval.record_events_file = optarg;
+			break;
+		case 'y':
+			rval.replay_events_file = optarg;
+			break;
 		case 'F':
 			if ( rval.dns_mode != DNS_DEFAULT )
 				usage(zargs[0], 1);
@@ -413,6 +499,12 @@ zeek::Options zeek::parse_cmdline(int argc, char** argv)
 			break;
 		}
 
+	if ( rval.replay_events_file && (rval.pcap_file || rval.interface) )
+		{
+		fprintf(stderr, "ERROR: Using --replay-events is not allowed when reading packets.\n");
+		exit(1);
+		}
+
 	// Process remaining arguments. X=Y arguments indicate script
 	// variable/parameter assignments. X::Y arguments indicate plugins to
 	// activate/query. The remainder are treated as scripts to load.
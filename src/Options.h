@@ -45,6 +45,11 @@ struct Options {
 	bool ignore_checksums = false;
 	bool use_watchdog = false;
 	double pseudo_realtime = 0;
+	int flow_shard = 0;
+	int num_flow_shards = 0;
+	std::string script_exec_mode = "ast"; // "ast", "bytecode", or "validate"
+	std::string const_fold_mode = "on"; // "on", "off", or "report"
+	std::string inline_funcs_mode = "off"; // "on", "off", or "report"
 	DNS_MgrMode dns_mode = DNS_DEFAULT;
 
 	bool supervisor_mode = false;
@@ -55,6 +60,7 @@ struct Options {
 	bool perftools_profile = false;
 	bool deterministic_mode = false;
 	bool abort_on_scripting_errors = false;
+	bool use_hyperscan = false;
 
 	bool run_unit_tests = false;
 	std::vector<std::string> doctest_args;
@@ -69,6 +75,11 @@ struct Options {
 	std::optional<std::string> random_seed_output_file;
 	std::optional<std::string> process_status_file;
 	std::optional<std::string> zeekygen_config_file;
+	std::optional<std::string> dfa_cache_file;
+	std::optional<std::string> dfa_cache_output_file;
+	std::optional<std::string> balance_packets;
+	std::optional<std::string> record_events_file;
+	std::optional<std::string> replay_events_file;
 	std::string libidmef_dtd_file = "idmef-message.dtd";
 
 	std::set<std::string> plugins_to_load;
@@ -0,0 +1,122 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "Overload.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Event.h"
+#include "ID.h"
+#include "NetVar.h"
+#include "Reporter.h"
+#include "Timer.h"
+#include "Val.h"
+#include "util.h"
+#include "iosource/PacketBalancer.h"
+
+OverloadController* OverloadController::Create()
+	{
+	auto max_lag = zeek::id::find_val("overload_max_lag")->AsInterval();
+	auto max_event_queue = zeek::id::find_val("overload_max_event_queue")->AsCount();
+	auto max_timers = zeek::id::find_val("overload_max_timers")->AsCount();
+
+	if ( max_lag <= 0 && ! max_event_queue && ! max_timers )
+		return nullptr;
+
+	auto oc = new OverloadController();
+	oc->max_lag = max_lag;
+	oc->max_event_queue = max_event_queue;
+	oc->max_timers = max_timers;
+	oc->check_interval = zeek::id::find_val("overload_check_interval")->AsInterval();
+	oc->recover_fraction = zeek::id::find_val("overload_recover_fraction")->AsDouble();
+	oc->max_level = static_cast<Level>(std::min(
+		zeek::id::find_val("overload_max_level")->AsCount(),
+		static_cast<bro_uint_t>(SAMPLE_CONNECTIONS)));
+	oc->bulk_bytes = zeek::id::find_val("overload_bulk_bytes")->AsCount();
+
+	auto rate = zeek::id::find_val("overload_connection_sample_rate")->AsDouble();
+
+	if ( rate > 0 && rate < 1 )
+		oc->sample_every = static_cast<uint64_t>(std::lround(1 / rate));
+
+	return oc;
+	}
+
+bool OverloadController::ShedConnection(const Packet* pkt)
+	{
+	if ( level < SAMPLE_CONNECTIONS || sample_every <= 1 )
+		return false;
+
+	if ( iosource::PacketBalancer::FlowHash(pkt) % sample_every == 0 )
+		return false;
+
+	++connections_shed;
+	return true;
+	}
+
+void OverloadController::Check(double t, bool live)
+	{
+	next_check = t + check_interval;
+
+	// Lag in live capture shows as packets getting processed long after
+	// they arrived.
+	double lag = live ? current_time(true) - t : 0;
+	int queued = mgr.Size();
+	int timers = timer_mgr->Size();
+
+	bool over = (max_lag > 0 && lag > max_lag) ||
+	            (max_event_queue && queued > max_event_queue) ||
+	            (max_timers && timers > max_timers);
+
+	bool under = (max_lag <= 0 || lag < max_lag * recover_fraction) &&
+	             (! max_event_queue || queued < max_event_queue * recover_fraction) &&
+	             (! max_timers || timers < max_timers * recover_fraction);
+
+	if ( ! over && ! under )
+		return;
+
+	if ( over && level == max_level )
+		return;
+
+	if ( under && level == NONE )
+		return;
+
+	char why[256];
+	snprintf(why, sizeof(why), "lag %.3fs, %d queued events, %d timers",
+	         lag, queued, timers);
+
+	SetLevel(static_cast<Level>(over ? level + 1 : level - 1), why);
+	}
+
+void OverloadController::SetLevel(Level new_level, const char* why)
+	{
+	auto old_level = level;
+	level = new_level;
+
+	reporter->Info("overload: shed level %s -> %s (%s); shed since the last change: "
+	               "%" PRIu64 " DPD, %" PRIu64 " payload, %" PRIu64 " files, "
+	               "%" PRIu64 " connections",
+	               LevelName(old_level), LevelName(new_level), why,
+	               dpd_shed, payload_shed, files_shed, connections_shed);
+
+	dpd_shed = payload_shed = files_shed = connections_shed = 0;
+
+	if ( overload_level_changed )
+		mgr.Enqueue(overload_level_changed,
+		            zeek::val_mgr->Count(new_level),
+		            zeek::val_mgr->Count(old_level));
+	}
+
+const char* OverloadController::LevelName(Level l)
+	{
+	switch ( l ) {
+	case NONE:			return "none";
+	case NO_DPD:			return "no-dpd";
+	case NO_BULK_PAYLOAD:		return "no-bulk-payload";
+	case NO_FILES:			return "no-files";
+	case SAMPLE_CONNECTIONS:	return "sample-connections";
+	}
+
+	return "<unknown>";
+	}
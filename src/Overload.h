@@ -0,0 +1,112 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+
+class Packet;
+
+// Sheds analysis in a fixed order when the main thread can't keep up,
+// so that an overloaded worker degrades in a predictable way rather than
+// through random capture loss. Each level includes all lower ones:
+//
+//   1. New connections get no dynamic protocol detection.
+//   2. Connections beyond a size threshold stop payload analysis.
+//   3. New files don't get analyzed.
+//   4. Only a sample of new connections gets analyzed at all.
+//
+// The controller rises one level at a time while any of packet lag,
+// event queue depth, or timer backlog exceeds its limit, and steps back
+// down once all of them have dropped well below. Each change gets
+// reported.
+class OverloadController {
+public:
+	enum Level {
+		NONE = 0,
+		NO_DPD,
+		NO_BULK_PAYLOAD,
+		NO_FILES,
+		SAMPLE_CONNECTIONS,
+	};
+
+	// Returns a controller configured through the overload_* script
+	// constants, or nullptr if they don't enable any limit.
+	static OverloadController* Create();
+
+	// Checks the load, at most once per overload_check_interval of
+	// network time. t is the current packet's timestamp, and live says
+	// whether it's being captured right now, as only then its lag means
+	// anything.
+	void Update(double t, bool live)
+		{
+		if ( t >= next_check )
+			Check(t, live);
+		}
+
+	Level CurrentLevel() const	{ return level; }
+
+	// Whether a new connection should go without dynamic protocol
+	// detection.
+	bool ShedDPD()
+		{
+		if ( level < NO_DPD )
+			return false;
+
+		++dpd_shed;
+		return true;
+		}
+
+	// Whether a connection that has seen the given number of bytes
+	// should stop analyzing its payload.
+	bool ShedPayload(uint64_t num_bytes)
+		{
+		if ( level < NO_BULK_PAYLOAD || num_bytes <= bulk_bytes )
+			return false;
+
+		++payload_shed;
+		return true;
+		}
+
+	// Whether a new file should go unanalyzed.
+	bool ShedFile()
+		{
+		if ( level < NO_FILES )
+			return false;
+
+		++files_shed;
+		return true;
+		}
+
+	// Whether to not analyze a new connection. The choice depends on
+	// the connection's addresses and ports only, so that it holds for
+	// all of its packets.
+	bool ShedConnection(const Packet* pkt);
+
+	static const char* LevelName(Level l);
+
+private:
+	OverloadController() = default;
+
+	void Check(double t, bool live);
+	void SetLevel(Level new_level, const char* why);
+
+	double max_lag = 0;
+	int max_event_queue = 0;
+	int max_timers = 0;
+	double check_interval = 0;
+	double recover_fraction = 0;
+	Level max_level = NONE;
+	uint64_t bulk_bytes = 0;
+	uint64_t sample_every = 1;
+
+	Level level = NONE;
+	double next_check = 0;
+
+	// What got shed since the last level change.
+	uint64_t dpd_shed = 0;
+	uint64_t payload_shed = 0;
+	uint64_t files_shed = 0;
+	uint64_t connections_shed = 0;
+};
+
+extern OverloadController* overload_controller;
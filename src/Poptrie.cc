@@ -0,0 +1,252 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Poptrie.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <tuple>
+
+#include "3rdparty/doctest.h"
+
+using namespace zeek::detail;
+
+Poptrie::Poptrie(std::vector<Prefix> arg_prefixes)
+	: prefixes(std::move(arg_prefixes))
+	{
+	// Sorting puts the prefixes below any node next to each other.
+	std::sort(prefixes.begin(), prefixes.end(),
+	          [](const Prefix& a, const Prefix& b)
+		          {
+		          for ( int i = 0; i < 4; ++i )
+			          if ( a.key[i] != b.key[i] )
+				          return a.key[i] < b.key[i];
+
+		          return a.len < b.len;
+		          });
+
+	// Prefixes of length zero match everything. Below the root, the
+	// ones not longer than the depth have been accounted for.
+	int rank = -1;
+	uint32_t value = 0;
+
+	for ( const auto& p : prefixes )
+		if ( p.len == 0 && p.rank > rank )
+			{
+			rank = p.rank;
+			value = p.value;
+			}
+
+	nodes.resize(1);
+	Build(0, 0, prefixes.size(), 0, rank, value);
+
+	nodes.shrink_to_fit();
+	leaves.shrink_to_fit();
+	prefixes = {};
+	}
+
+void Poptrie::Build(size_t node, size_t lo, size_t hi, int depth,
+                    int inherited_rank, uint32_t inherited_value)
+	{
+	constexpr int slots = 1 << stride;
+
+	int best_rank[slots];
+	uint32_t best[slots];
+	size_t child_lo[slots];
+	size_t child_hi[slots];
+
+	for ( int c = 0; c < slots; ++c )
+		{
+		best_rank[c] = inherited_rank;
+		best[c] = inherited_value;
+		child_lo[c] = child_hi[c] = 0;
+		}
+
+	for ( size_t i = lo; i < hi; ++i )
+		{
+		const Prefix& p = prefixes[i];
+
+		if ( p.len <= depth )
+			continue;
+
+		unsigned int c = Chunk(p.key, depth);
+
+		if ( p.len <= depth + stride )
+			{
+			// Expand the prefix to all slots it covers.
+			unsigned int end = c + (1u << (depth + stride - p.len));
+
+			for ( unsigned int j = c; j < end; ++j )
+				if ( p.rank > best_rank[j] )
+					{
+					best_rank[j] = p.rank;
+					best[j] = p.value;
+					}
+			}
+
+		else
+			{
+			if ( child_lo[c] == child_hi[c] )
+				child_lo[c] = i;
+
+			child_hi[c] = i + 1;
+			}
+		}
+
+	uint64_t vector = 0;
+	uint64_t leafvec = 0;
+	uint32_t base0 = leaves.size();
+
+	for ( int c = 0; c < slots; ++c )
+		{
+		if ( child_lo[c] != child_hi[c] )
+			vector |= uint64_t(1) << c;
+
+		else if ( leaves.size() == base0 || leaves.back() != best[c] )
+			{
+			leafvec |= uint64_t(1) << c;
+			leaves.push_back(best[c]);
+			}
+		}
+
+	// A node's children need to be next to each other, so allocate them
+	// all before descending into any.
+	uint32_t base1 = nodes.size();
+	nodes.resize(base1 + __builtin_popcountll(vector));
+	nodes[node] = {vector, leafvec, base0, base1};
+
+	uint32_t child = base1;
+
+	for ( int c = 0; c < slots; ++c )
+		if ( child_lo[c] != child_hi[c] )
+			Build(child++, child_lo[c], child_hi[c], depth + stride,
+			      best_rank[c], best[c]);
+	}
+
+TEST_SUITE_BEGIN("Poptrie");
+
+namespace {
+
+uint32_t brute_force(const std::vector<Poptrie::Prefix>& prefixes, const uint32_t* key)
+	{
+	int rank = -1;
+	uint32_t value = 0;
+
+	for ( const auto& p : prefixes )
+		{
+		bool match = true;
+
+		for ( int i = 0; i < 4 && match; ++i )
+			{
+			int bits = std::min(std::max(p.len - 32 * i, 0), 32);
+			uint32_t mask = bits ? ~uint32_t(0) << (32 - bits) : 0;
+			match = (key[i] & mask) == p.key[i];
+			}
+
+		if ( match && p.rank > rank )
+			{
+			rank = p.rank;
+			value = p.value;
+			}
+		}
+
+	return value;
+	}
+
+}
+
+TEST_CASE("poptrie longest prefix match")
+	{
+	std::vector<Poptrie::Prefix> prefixes = {
+		{{0x0a000000}, 8, 8, 1},	// 10/8
+		{{0x0a010000}, 16, 16, 2},	// 10.1/16
+		{{0x0a010200}, 24, 24, 3},	// 10.1.2/24
+		{{0x0a010203}, 32, 32, 4},	// 10.1.2.3/32
+		{{0xc0a80000}, 13, 13, 5},	// 192.168/13
+	};
+
+	Poptrie t(prefixes);
+
+	uint32_t k1[4] = {0x0a010203};
+	uint32_t k2[4] = {0x0a010204};
+	uint32_t k3[4] = {0x0a01ff00};
+	uint32_t k4[4] = {0x0aff0000};
+	uint32_t k5[4] = {0xc0afffff};
+	uint32_t k6[4] = {0xc0b00000};
+
+	CHECK(t.Lookup(k1) == 4);
+	CHECK(t.Lookup(k2) == 3);
+	CHECK(t.Lookup(k3) == 2);
+	CHECK(t.Lookup(k4) == 1);
+	CHECK(t.Lookup(k5) == 5);
+	CHECK(t.Lookup(k6) == 0);
+
+	prefixes.push_back({{0}, 0, 0, 6});
+	Poptrie with_default(prefixes);
+	CHECK(with_default.Lookup(k1) == 4);
+	CHECK(with_default.Lookup(k6) == 6);
+	}
+
+TEST_CASE("poptrie ranks")
+	{
+	// Two defaults, as when shorter IPv6 prefixes cover all of IPv4.
+	Poptrie t({{{0}, 0, 90, 1}, {{0}, 0, 95, 2}, {{0x01000000}, 8, 104, 3}});
+
+	uint32_t k1[4] = {0x01020304};
+	uint32_t k2[4] = {0x02020304};
+	CHECK(t.Lookup(k1) == 3);
+	CHECK(t.Lookup(k2) == 2);
+	}
+
+TEST_CASE("poptrie matches brute force")
+	{
+	std::mt19937 rng(42);
+
+	for ( int key_bits : {32, 128} )
+		{
+		std::vector<Poptrie::Prefix> prefixes;
+		std::set<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t, int>> seen;
+		int words = key_bits / 32;
+
+		// Few distinct top bits, so that prefixes nest.
+		for ( uint32_t v = 1; v <= 2000; ++v )
+			{
+			Poptrie::Prefix p = {{0, 0, 0, 0}, int(rng() % (key_bits + 1)), 0, v};
+			p.rank = p.len;
+
+			for ( int i = 0; i < words; ++i )
+				{
+				p.key[i] = rng() & 0xf0ff00ff;
+				int bits = std::min(std::max(p.len - 32 * i, 0), 32);
+				p.key[i] &= bits ? ~uint32_t(0) << (32 - bits) : 0;
+				}
+
+			// Like in a table, each prefix occurs only once.
+			if ( seen.insert({p.key[0], p.key[1], p.key[2], p.key[3], p.len}).second )
+				prefixes.push_back(p);
+			}
+
+		Poptrie t(prefixes);
+
+		for ( int n = 0; n < 20000; ++n )
+			{
+			uint32_t key[4] = {0, 0, 0, 0};
+
+			// Half the keys extend a prefix, half are random.
+			if ( n % 2 )
+				{
+				const auto& p = prefixes[rng() % prefixes.size()];
+
+				for ( int i = 0; i < words; ++i )
+					key[i] = p.key[i] | (rng() & 0x0000ff00);
+				}
+			else
+				for ( int i = 0; i < words; ++i )
+					key[i] = rng() & 0xf0ffffff;
+
+			REQUIRE(t.Lookup(key) == brute_force(prefixes, key));
+			}
+		}
+	}
+
+TEST_SUITE_END();
@@ -0,0 +1,111 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zeek::detail {
+
+/**
+ * A compressed multibit trie for longest-prefix matching, following
+ * Poptrie (Asai and Ohara, SIGCOMM 2015). Each node covers six bits of the
+ * key with two 64-bit vectors, one marking which of its 64 slots lead to
+ * child nodes and one marking where runs of identical leaves start, so
+ * that a population count finds the next node or the result. Lookups
+ * thus take at most one node per six bits, all held in two contiguous
+ * arrays.
+ *
+ * The trie is immutable; it gets rebuilt to reflect changes.
+ */
+class Poptrie {
+public:
+	struct Prefix {
+		// The key bits, most significant first, with the bits beyond
+		// the prefix's length zero.
+		uint32_t key[4];
+
+		// The number of leading key bits that the prefix fixes.
+		int len;
+
+		// Decides between prefixes that match: the highest rank wins.
+		// That's normally the length, but can differ if the keys are
+		// part of a larger address space.
+		int rank;
+
+		// Returned by lookups matching the prefix. Zero is reserved
+		// for "no match".
+		uint32_t value;
+	};
+
+	/**
+	 * Builds the trie.
+	 *
+	 * @param prefixes The prefixes to match, in any order. Keys have up
+	 * to 128 bits; shorter ones are padded with zeros.
+	 */
+	explicit Poptrie(std::vector<Prefix> prefixes);
+
+	/**
+	 * Returns the value of the highest-ranking prefix matching a key, or
+	 * zero if none does.
+	 *
+	 * @param key The key's bits, most significant first, padded with
+	 * zeros like the prefixes' keys.
+	 */
+	uint32_t Lookup(const uint32_t* key) const
+		{
+		const Node* n = &nodes[0];
+		int depth = 0;
+
+		for ( ; ; )
+			{
+			unsigned int c = Chunk(key, depth);
+			uint64_t mask = (uint64_t(2) << c) - 1;
+
+			if ( ! (n->vector & (uint64_t(1) << c)) )
+				return leaves[n->base0 + __builtin_popcountll(n->leafvec & mask) - 1];
+
+			n = &nodes[n->base1 + __builtin_popcountll(n->vector & mask) - 1];
+			depth += stride;
+			}
+		}
+
+	/**
+	 * Returns the memory that the trie's arrays take up, in bytes.
+	 */
+	size_t MemoryAllocation() const
+		{
+		return nodes.capacity() * sizeof(Node) + leaves.capacity() * sizeof(uint32_t);
+		}
+
+private:
+	static constexpr int stride = 6;
+
+	struct Node {
+		uint64_t vector;	// slots leading to child nodes
+		uint64_t leafvec;	// slots starting a new run of leaves
+		uint32_t base0;		// index of the first leaf
+		uint32_t base1;		// index of the first child
+	};
+
+	// Returns the stride bits of the key starting at bit depth.
+	static unsigned int Chunk(const uint32_t* key, int depth)
+		{
+		int w = depth / 32;
+		uint64_t v = (uint64_t(key[w]) << 32) | (w < 3 ? key[w + 1] : 0);
+		return (v >> (64 - stride - depth % 32)) & ((1 << stride) - 1);
+		}
+
+	// Fills in the node for the prefixes [lo, hi), which share their
+	// first depth bits, inheriting the best match found above.
+	void Build(size_t node, size_t lo, size_t hi, int depth,
+	           int inherited_rank, uint32_t inherited_value);
+
+	std::vector<Prefix> prefixes;	// only during construction
+	std::vector<Node> nodes;
+	std::vector<uint32_t> leaves;
+};
+
+} // namespace zeek::detail
@@ -2,6 +2,11 @@
 #include "Reporter.h"
 #include "Val.h"
 
+#include <algorithm>
+
+// Lookups to see before building a trie, at the least.
+static const uint64_t min_trie_lookups = 32;
+
 prefix_t* PrefixTable::MakePrefix(const IPAddr& addr, int width)
 	{
 	prefix_t* prefix = (prefix_t*) safe_malloc(sizeof(prefix_t));
@@ -21,6 +26,8 @@ IPPrefix PrefixTable::PrefixToIPPrefix(prefix_t* prefix)
 
 void* PrefixTable::Insert(const IPAddr& addr, int width, void* data)
 	{
+	Invalidate(addr, width);
+
 	prefix_t* prefix = MakePrefix(addr, width);
 	patricia_node_t* node = patricia_lookup(tree, prefix);
 	Deref_Prefix(prefix);
@@ -88,14 +95,16 @@ std::list<std::tuple<IPPrefix,void*>> PrefixTable::FindAll(const zeek::SubNetVal
 
 void* PrefixTable::Lookup(const IPAddr& addr, int width, bool exact) const
 	{
+	void* data;
+
+	if ( ! exact && width == 128 && TrieLookup(addr, &data) )
+		return data;
+
 	prefix_t* prefix = MakePrefix(addr, width);
 	patricia_node_t* node =
 		exact ? patricia_search_exact(tree, prefix) :
 			patricia_search_best(tree, prefix);
 
-	int elems = 0;
-	patricia_node_t** list = nullptr;
-
 	Deref_Prefix(prefix);
 	return node ? node->data : nullptr;
 	}
@@ -133,6 +142,8 @@ void* PrefixTable::Remove(const IPAddr& addr, int width)
 	if ( ! node )
 		return nullptr;
 
+	Invalidate(addr, width);
+
 	void* old = node->data;
 	patricia_remove(tree, node);
 
@@ -162,6 +173,120 @@ void* PrefixTable::Remove(const zeek::Val* value)
 	}
 	}
 
+bool PrefixTable::TrieLookup(const IPAddr& addr, void** data) const
+	{
+	bool v4 = addr.GetFamily() == IPv4;
+	LazyTrie* t = v4 ? &trie4 : &trie6;
+
+	if ( ! t->trie )
+		{
+		// A rebuild costs about as much as a few tree lookups per
+		// prefix, so wait for enough lookups to make up for it.
+		auto needed = std::max<uint64_t>(min_trie_lookups, tree->num_active_node / 4);
+
+		if ( ++t->lookups < needed )
+			return false;
+
+		BuildTrie(t, v4);
+		}
+
+	const uint32_t* bytes;
+	int words = addr.GetBytes(&bytes);
+	uint32_t key[4] = {0, 0, 0, 0};
+
+	for ( int i = 0; i < words; ++i )
+		key[i] = ntohl(bytes[i]);
+
+	*data = t->data[t->trie->Lookup(key)];
+	return true;
+	}
+
+void PrefixTable::BuildTrie(LazyTrie* t, bool v4) const
+	{
+	// IPv4 addresses live in ::ffff:0:0/96. That trie gets the prefixes
+	// within, shortened to their IPv4 part, and the ones covering it as
+	// matching everything, ranked by their original lengths.
+	static const uint32_t v4_mapped[4] = {0, 0, 0xffff, 0};
+
+	std::vector<zeek::detail::Poptrie::Prefix> prefixes;
+	t->data.assign(1, nullptr);
+
+	std::vector<patricia_node_t*> stack;
+
+	if ( tree->head )
+		stack.push_back(tree->head);
+
+	while ( ! stack.empty() )
+		{
+		patricia_node_t* node = stack.back();
+		stack.pop_back();
+
+		if ( node->l )
+			stack.push_back(node->l);
+
+		if ( node->r )
+			stack.push_back(node->r);
+
+		if ( ! node->prefix )
+			continue;
+
+		const uint32_t* bytes = reinterpret_cast<const uint32_t*>(&node->prefix->add.sin6);
+		int len = node->prefix->bitlen;
+		uint32_t key[4];
+
+		for ( int i = 0; i < 4; ++i )
+			key[i] = ntohl(bytes[i]);
+
+		// Whether the prefix agrees with ::ffff:0:0/96 on the bits
+		// they both fix.
+		bool mapped = true;
+
+		for ( int i = 0; i < 3 && mapped; ++i )
+			{
+			int bits = std::min(std::max(len - 32 * i, 0), 32);
+			uint32_t mask = bits ? ~uint32_t(0) << (32 - bits) : 0;
+			mapped = (key[i] & mask) == v4_mapped[i];
+			}
+
+		zeek::detail::Poptrie::Prefix p = {{0, 0, 0, 0}, 0, len, uint32_t(t->data.size())};
+
+		if ( v4 )
+			{
+			if ( ! mapped )
+				continue;
+
+			if ( len > 96 )
+				{
+				p.key[0] = key[3];
+				p.len = len - 96;
+				}
+			}
+
+		else
+			{
+			if ( mapped && len >= 96 )
+				continue;
+
+			std::copy(key, key + 4, p.key);
+			p.len = len;
+			}
+
+		prefixes.push_back(p);
+		t->data.push_back(node->data);
+		}
+
+	t->trie = std::make_unique<zeek::detail::Poptrie>(std::move(prefixes));
+	}
+
+void PrefixTable::Invalidate(const IPAddr& addr, int width)
+	{
+	// Prefixes inside ::ffff:0:0/96 only matter for IPv4 lookups.
+	if ( addr.GetFamily() != IPv4 || width < 96 )
+		trie6 = {};
+
+	trie4 = {};
+	}
+
 PrefixTable::iterator PrefixTable::InitIterator()
 	{
 	iterator i;
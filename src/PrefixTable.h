@@ -5,8 +5,11 @@ extern "C" {
 }
 
 #include <list>
+#include <memory>
+#include <vector>
 
 #include "IPAddr.h"
+#include "Poptrie.h"
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Val, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(SubNetVal, zeek);
@@ -46,7 +49,12 @@ public:
 	void* Remove(const IPAddr& addr, int width);
 	void* Remove(const zeek::Val* value);
 
-	void Clear()	{ Clear_Patricia(tree, delete_function); }
+	void Clear()
+		{
+		Clear_Patricia(tree, delete_function);
+		trie4 = {};
+		trie6 = {};
+		}
 
 	// Sets a function to call for each node when table is cleared/destroyed.
 	void SetDeleteFunction(data_fn_t del_fn)	{ delete_function = del_fn; }
@@ -55,9 +63,28 @@ public:
 	void* GetNext(iterator* i);
 
 private:
+	// Longest-prefix matches of single addresses go through a Poptrie
+	// per address family, built from the tree. Modifications drop the
+	// affected family's trie, and lookups use the tree until there have
+	// been enough of them to pay for rebuilding it.
+	struct LazyTrie {
+		std::unique_ptr<zeek::detail::Poptrie> trie;
+		std::vector<void*> data;	// by the trie's values
+		uint64_t lookups = 0;		// since the last modification
+	};
+
 	static prefix_t* MakePrefix(const IPAddr& addr, int width);
 	static IPPrefix PrefixToIPPrefix(prefix_t* p);
 
+	// Looks up the address in the family's trie. Returns false if the
+	// trie isn't available.
+	bool TrieLookup(const IPAddr& addr, void** data) const;
+	void BuildTrie(LazyTrie* t, bool v4) const;
+	void Invalidate(const IPAddr& addr, int width);
+
 	patricia_tree_t* tree;
 	data_fn_t delete_function;
+
+	mutable LazyTrie trie4;
+	mutable LazyTrie trie6;
 };
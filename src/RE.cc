@@ -7,6 +7,8 @@
 #include <utility>
 
 #include "DFA.h"
+#include "DFACache.h"
+#include "REEngine.h"
 #include "CCL.h"
 #include "EquivClass.h"
 #include "Reporter.h"
@@ -18,10 +20,22 @@ Specific_RE_Matcher* rem;
 NFA_Machine* nfa = nullptr;
 int case_insensitive = 0;
 
+zeek::detail::RE_EngineFactory zeek::detail::re_engine_factory = nullptr;
+
 extern int RE_parse(void);
 extern void RE_set_input(const char* str);
 extern void RE_done_with_scan();
 
+// Returns the DFA for an NFA just parsed, going through the DFA cache if
+// there is one. The key identifies what the NFA matches.
+static DFA_Machine* make_dfa(const std::string& key, NFA_Machine* n, EquivClass* ec)
+	{
+	if ( zeek::detail::dfa_cache )
+		return zeek::detail::dfa_cache->MakeDFA(key, n, ec);
+
+	return new DFA_Machine(n, ec);
+	}
+
 Specific_RE_Matcher::Specific_RE_Matcher(match_type arg_mt, int arg_multiline)
 : equiv_class(NUM_SYM)
 	{
@@ -66,6 +80,9 @@ void Specific_RE_Matcher::ConvertCCLs()
 
 void Specific_RE_Matcher::AddPat(const char* new_pat)
 	{
+	if ( engine_usable )
+		engine_patterns.emplace_back(new_pat);
+
 	if ( mt == MATCH_EXACTLY )
 		AddExactPat(new_pat);
 	else
@@ -114,6 +131,9 @@ void Specific_RE_Matcher::MakeCaseInsensitive()
 
 	delete [] pattern_text;
 	pattern_text = s;
+
+	for ( auto& p : engine_patterns )
+		p = "(?i:" + p + ")";
 	}
 
 bool Specific_RE_Matcher::Compile(bool lazy)
@@ -138,13 +158,26 @@ bool Specific_RE_Matcher::Compile(bool lazy)
 	EC()->BuildECs();
 	ConvertCCLs();
 
-	dfa = new DFA_Machine(nfa, EC());
+	std::string key = fmt("C%d:%d:", mt, multiline);
+	key += pattern_text;
+
+	dfa = make_dfa(key + DefsKey(), nfa, EC());
 
 	Unref(nfa);
 	nfa = nullptr;
 
 	ecs = EC()->EquivClasses();
 
+	if ( engine_usable )
+		{
+		std::vector<zeek::detail::RE_EnginePattern> patterns;
+
+		for ( const auto& p : engine_patterns )
+			patterns.push_back({p, 0});
+
+		MakeEngine(patterns, false);
+		}
+
 	return true;
 	}
 
@@ -189,12 +222,47 @@ bool Specific_RE_Matcher::CompileSet(const string_list& set, const int_list& idx
 	EC()->BuildECs();
 	ConvertCCLs();
 
-	dfa = new DFA_Machine(nfa, EC());
+	std::string key = fmt("S%d:", multiline);
+
+	loop_over_list(set, j)
+		{
+		key += fmt("%d:%zu:", idx[j], strlen(set[j]));
+		key += set[j];
+		}
+
+	dfa = make_dfa(key + DefsKey(), nfa, EC());
 	ecs = EC()->EquivClasses();
 
+	std::vector<zeek::detail::RE_EnginePattern> patterns;
+
+	loop_over_list(set, k)
+		patterns.push_back({set[k], static_cast<int>(idx[k])});
+
+	MakeEngine(patterns, true);
+
 	return true;
 	}
 
+void Specific_RE_Matcher::MakeEngine(const std::vector<zeek::detail::RE_EnginePattern>& patterns,
+                                     bool stream)
+	{
+	if ( zeek::detail::re_engine_factory )
+		engine = zeek::detail::re_engine_factory(patterns, mt, multiline, stream);
+	}
+
+std::string Specific_RE_Matcher::DefsKey() const
+	{
+	std::string key;
+
+	for ( const auto& [name, def] : defs )
+		{
+		key += fmt(":%zu:%zu:", name.size(), def.size());
+		key += name + def;
+		}
+
+	return key;
+	}
+
 std::string Specific_RE_Matcher::LookupDef(const std::string& def)
 	{
 	const auto& iter = defs.find(def);
@@ -242,18 +310,37 @@ bool Specific_RE_Matcher::MatchAll(const u_char* bv, int n)
 		// matched is empty.
 		return n == 0;
 
+	if ( engine )
+		return engine->MatchAll(bv, n);
+
+	const DFA_Table* t = dfa->Table();
 	DFA_State* d = dfa->StartState();
 	d = d->Xtion(ecs[SYM_BOL], dfa);
 
-	while ( d )
+	int i = 0;
+
+	if ( t && d && d->TableIndex() >= 0 )
 		{
-		if ( --n < 0 )
-			break;
+		// Stays in the table for as long as the input does, leaving
+		// the rest to the loop below.
+		uint32_t s = d->TableIndex();
 
-		int ec = ecs[*(bv++)];
-		d = d->Xtion(ec, dfa);
+		for ( ; i < n; ++i )
+			{
+			uint32_t next = DFA_Table::Index(t->Next(s, ecs[bv[i]]));
+
+			if ( next >= DFA_Table::COLD )
+				break;
+
+			s = next;
+			}
+
+		d = t->State(s);
 		}
 
+	for ( ; d && i < n; ++i )
+		d = d->Xtion(ecs[bv[i]], dfa);
+
 	if ( d )
 		d = d->Xtion(ecs[SYM_EOL], dfa);
 
@@ -267,12 +354,43 @@ int Specific_RE_Matcher::Match(const u_char* bv, int n)
 		// An empty pattern matches anything.
 		return 1;
 
+	if ( engine )
+		return engine->Match(bv, n);
+
+	const DFA_Table* t = dfa->Table();
 	DFA_State* d = dfa->StartState();
 
 	d = d->Xtion(ecs[SYM_BOL], dfa);
 	if ( ! d ) return 0;
 
-	for ( int i = 0; i < n; ++i )
+	int i = 0;
+
+	if ( t && d->TableIndex() >= 0 )
+		{
+		// Same as the loop below, for as long as the input stays in
+		// the table. The special entries never have ACCEPT set.
+		uint32_t s = d->TableIndex();
+
+		for ( ; i < n; ++i )
+			{
+			uint32_t next = t->Next(s, ecs[bv[i]]);
+
+			if ( next & DFA_Table::ACCEPT )
+				return i + 1;
+
+			if ( next >= DFA_Table::COLD )
+				break;
+
+			if ( next == s && t->CanSkip(s) )
+				i += t->Skip(s, bv + i + 1, n - i - 1);
+
+			s = next;
+			}
+
+		d = t->State(s);
+		}
+
+	for ( ; i < n; ++i )
 		{
 		int ec = ecs[bv[i]];
 		d = d->Xtion(ec, dfa);
@@ -308,9 +426,59 @@ inline void RE_Match_State::AddMatches(const AcceptingSet& as,
 		accepted_matches.insert(am_idx(*it, position));
 	}
 
+inline bool RE_Match_State::Step(int ec)
+	{
+	DFA_State* next_state = current_state->Xtion(ec, dfa);
+
+	if ( ! next_state )
+		{
+		current_state = nullptr;
+		return false;
+		}
+
+	const AcceptingSet* ac = next_state->Accept();
+
+	if ( ac )
+		AddMatches(*ac, current_pos);
+
+	++current_pos;
+
+	current_state = next_state;
+	return true;
+	}
+
+RE_Match_State::RE_Match_State(Specific_RE_Matcher* matcher)
+	{
+	dfa = matcher->DFA() ? matcher->DFA() : nullptr;
+	ecs = matcher->EC()->EquivClasses();
+	current_pos = -1;
+	current_state = nullptr;
+
+	if ( matcher->Engine() )
+		stream = matcher->Engine()->NewStream();
+	}
+
+RE_Match_State::~RE_Match_State() = default;
+
+void RE_Match_State::Clear()
+	{
+	current_pos = -1;
+	current_state = nullptr;
+	accepted_matches.clear();
+
+	if ( stream )
+		stream->Clear();
+	}
+
 bool RE_Match_State::Match(const u_char* bv, int n,
 				bool bol, bool eol, bool clear)
 	{
+	if ( stream )
+		{
+		current_pos = n + bol + eol;
+		return stream->Match(bv, n, bol, eol, clear, &accepted_matches);
+		}
+
 	if ( current_pos == -1 )
 		{
 		// First call to Match().
@@ -337,37 +505,52 @@ bool RE_Match_State::Match(const u_char* bv, int n,
 
 	size_t old_matches = accepted_matches.size();
 
-	int ec;
-	int m = bol ? n + 1 : n;
-	int e = eol ? -1 : 0;
+	if ( bol && ! Step(ecs[SYM_BOL]) )
+		return accepted_matches.size() != old_matches;
 
-	while ( --m >= e )
-		{
-		if ( m == n )
-			ec = ecs[SYM_BOL];
-		else if ( m == -1 )
-			ec = ecs[SYM_EOL];
-		else
-			ec = ecs[*(bv++)];
+	int i = 0;
 
-		DFA_State* next_state = current_state->Xtion(ec,dfa);
+	if ( const DFA_Table* t = dfa->Table(); t && current_state->TableIndex() >= 0 )
+		{
+		// Same as the loop below, for as long as the input stays in
+		// the table.
+		uint32_t s = current_state->TableIndex();
 
-		if ( ! next_state )
+		for ( ; i < n; ++i )
 			{
-			current_state = nullptr;
-			break;
-			}
+			uint32_t next = t->Next(s, ecs[bv[i]]);
+			uint32_t idx = DFA_Table::Index(next);
 
-		const AcceptingSet* ac = next_state->Accept();
+			if ( idx >= DFA_Table::COLD )
+				break;
 
-		if ( ac )
-			AddMatches(*ac, current_pos);
+			if ( next & DFA_Table::ACCEPT )
+				AddMatches(*t->State(idx)->Accept(), current_pos);
+
+			++current_pos;
 
-		++current_pos;
+			if ( idx == s && t->CanSkip(s) )
+				{
+				// Nothing can happen until one of the bytes
+				// leaving the state comes along.
+				int skip = t->Skip(s, bv + i + 1, n - i - 1);
+				current_pos += skip;
+				i += skip;
+				}
 
-		current_state = next_state;
+			s = idx;
+			}
+
+		current_state = t->State(s);
 		}
 
+	for ( ; i < n; ++i )
+		if ( ! Step(ecs[bv[i]]) )
+			break;
+
+	if ( current_state && eol )
+		Step(ecs[SYM_EOL]);
+
 	return accepted_matches.size() != old_matches;
 	}
 
@@ -388,7 +571,32 @@ int Specific_RE_Matcher::LongestMatch(const u_char* bv, int n)
 	if ( d->Accept() )
 		last_accept = 0;
 
-	for ( int i = 0; i < n; ++i )
+	int i = 0;
+
+	if ( const DFA_Table* t = dfa->Table(); t && d->TableIndex() >= 0 )
+		{
+		// Same as the loop below, for as long as the input stays in
+		// the table.
+		uint32_t s = d->TableIndex();
+
+		for ( ; i < n; ++i )
+			{
+			uint32_t next = t->Next(s, ecs[bv[i]]);
+			uint32_t idx = DFA_Table::Index(next);
+
+			if ( idx >= DFA_Table::COLD )
+				break;
+
+			if ( next & DFA_Table::ACCEPT )
+				last_accept = i + 1;
+
+			s = idx;
+			}
+
+		d = t->State(s);
+		}
+
+	for ( ; i < n; ++i )
 		{
 		int ec = ecs[bv[i]];
 		d = d->Xtion(ec, dfa);
@@ -435,6 +643,7 @@ unsigned int Specific_RE_Matcher::MemoryAllocation() const
 		+ ccl_list.MemoryAllocation() - padded_sizeof(ccl_list)
 		+ equiv_class.Size() - padded_sizeof(EquivClass)
 		+ (dfa ? dfa->MemoryAllocation() : 0) // this is ref counted; consider the bytes here?
+		+ (engine ? engine->MemoryAllocation() : 0)
 		+ padded_sizeof(*any_ccl)
 		+ padded_sizeof(*accepted) // NOLINT(bugprone-sizeof-container)
 		+ accepted->size() * padded_sizeof(AcceptingSet::key_type);
@@ -468,16 +677,71 @@ RE_Matcher::~RE_Matcher()
 	delete re_exact;
 	}
 
+// Returns whether a pattern consists of ordinary characters only, which
+// it then stores, unescaped, in literal.
+static bool is_literal_pattern(const char* pat, std::string* literal)
+	{
+	literal->clear();
+
+	for ( const char* p = pat; *p; ++p )
+		{
+		unsigned char c = *p;
+
+		if ( c == '\\' )
+			{
+			// Escaped punctuation stands for itself. Letters and
+			// digits start escape sequences, which we leave to the
+			// regular machinery.
+			c = *++p;
+
+			if ( ! c || isalnum(c) )
+				return false;
+			}
+
+		else if ( strchr(".[]()*+?{}|^$\"/", c) )
+			return false;
+
+		literal->push_back(c);
+		}
+
+	return ! literal->empty();
+	}
+
 void RE_Matcher::AddPat(const char* new_pat)
 	{
 	re_anywhere->AddPat(new_pat);
 	re_exact->AddPat(new_pat);
+
+	has_literal = ++num_pats == 1 && is_literal_pattern(new_pat, &literal);
 	}
 
 void RE_Matcher::MakeCaseInsensitive()
 	{
 	re_anywhere->MakeCaseInsensitive();
 	re_exact->MakeCaseInsensitive();
+	has_literal = false;
+	}
+
+int RE_Matcher::FindPrefixMatch(const u_char* s, int n, int* match_len)
+	{
+	if ( has_literal )
+		{
+		*match_len = literal.size();
+		return strstr_n(n, s, literal.size(), (const u_char*) literal.data());
+		}
+
+	for ( int offset = 0; offset < n; ++offset )
+		{
+		int len = MatchPrefix(s + offset, n - offset);
+
+		if ( len > 0 )
+			{
+			*match_len = len;
+			return offset;
+			}
+		}
+
+	return -1;
 	}
 
 bool RE_Matcher::Compile(bool lazy)
@@ -8,7 +8,9 @@
 
 #include <set>
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include <sys/types.h> // for u_char
 #include <ctype.h>
@@ -24,6 +26,12 @@ class Specific_RE_Matcher;
 class RE_Matcher;
 class DFA_State;
 
+namespace zeek::detail {
+class RE_Engine;
+class RE_EngineStream;
+struct RE_EnginePattern;
+}
+
 extern int case_insensitive;
 extern CCL* curr_ccl;
 extern NFA_Machine* nfa;
@@ -54,7 +62,11 @@ public:
 
 	void MakeCaseInsensitive();
 
-	void SetPat(const char* pat)	{ pattern_text = copy_string(pat); }
+	void SetPat(const char* pat)
+		{
+		pattern_text = copy_string(pat);
+		engine_usable = false;
+		}
 
 	bool Compile(bool lazy = false);
 
@@ -108,6 +120,10 @@ public:
 
 	DFA_Machine* DFA() const		{ return dfa; }
 
+	// Returns the engine matching in place of the DFA, if any (see
+	// zeek::detail::re_engine_factory).
+	zeek::detail::RE_Engine* Engine() const	{ return engine.get(); }
+
 	void Dump(FILE* f);
 
 	unsigned int MemoryAllocation() const;
@@ -124,6 +140,14 @@ protected:
 	bool MatchAll(const u_char* bv, int n);
 	int Match(const u_char* bv, int n);
 
+	// Returns the definitions' part of the key identifying the DFA in
+	// the DFA cache.
+	std::string DefsKey() const;
+
+	// Sets up the engine for the given patterns if there's a factory.
+	void MakeEngine(const std::vector<zeek::detail::RE_EnginePattern>& patterns,
+	                bool stream);
+
 	match_type mt;
 	int multiline;
 	char* pattern_text;
@@ -136,17 +160,18 @@ protected:
 	DFA_Machine* dfa;
 	CCL* any_ccl;
 	AcceptingSet* accepted;
+
+	// The patterns added through AddPat(), for the engine, which can't
+	// be used if there's pattern text that didn't come from there.
+	std::vector<std::string> engine_patterns;
+	bool engine_usable = true;
+	std::unique_ptr<zeek::detail::RE_Engine> engine;
 };
 
 class RE_Match_State {
 public:
-	explicit RE_Match_State(Specific_RE_Matcher* matcher)
-		{
-		dfa = matcher->DFA() ? matcher->DFA() : nullptr;
-		ecs = matcher->EC()->EquivClasses();
-		current_pos = -1;
-		current_state = nullptr;
-		}
+	explicit RE_Match_State(Specific_RE_Matcher* matcher);
+	~RE_Match_State();
 
 	const AcceptingMatchSet& AcceptedMatches() const
 		{ return accepted_matches; }
@@ -158,15 +183,14 @@ public:
 	// If clear is true, starts matching over.
 	bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear);
 
-	void Clear()
-		{
-		current_pos = -1;
-		current_state = nullptr;
-		accepted_matches.clear();
-		}
+	void Clear();
 
 	void AddMatches(const AcceptingSet& as, MatchPos position);
 
+	// Moves current_state along a transition, recording any matches.
+	// Returns false, with current_state nil, if the machine jams.
+	bool Step(int ec);
+
 protected:
 	DFA_Machine* dfa;
 	int* ecs;
@@ -174,6 +198,9 @@ protected:
 	AcceptingMatchSet accepted_matches;
 	DFA_State* current_state;
 	int current_pos;
+
+	// Used instead of the DFA if the matcher has an engine.
+	std::unique_ptr<zeek::detail::RE_EngineStream> stream;
 };
 
 class RE_Matcher final {
@@ -217,6 +244,18 @@ public:
 	const char* PatternText() const	{ return re_exact->PatternText(); }
 	const char* AnywherePatternText() const	{ return re_anywhere->PatternText(); }
 
+	// If the pattern only matches a single, non-empty string, returns
+	// that string, so that callers can search for it directly rather
+	// than running the DFA at each position. Returns nullptr otherwise.
+	const std::string* Literal() const
+		{ return has_literal ? &literal : nullptr; }
+
+	// Returns the offset of the first position in s at which
+	// MatchPrefix() finds a non-empty match, storing the match's length
+	// in match_len, or -1 if there's none. Literal patterns get searched
+	// for directly.
+	int FindPrefixMatch(const u_char* s, int n, int* match_len);
+
 	unsigned int MemoryAllocation() const
 		{
 		return padded_sizeof(*this)
@@ -227,6 +266,10 @@ public:
 protected:
 	Specific_RE_Matcher* re_anywhere;
 	Specific_RE_Matcher* re_exact;
+
+	int num_pats = 0;
+	bool has_literal = false;
+	std::string literal;
 };
 
 extern RE_Matcher* RE_Matcher_conjunction(const RE_Matcher* re1, const RE_Matcher* re2);
@@ -0,0 +1,105 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h> // for u_char
+
+#include "RE.h"
+
+namespace zeek::detail {
+
+class RE_EngineStream;
+
+/**
+ * A pattern as handed to an RE_Engine: the text the user wrote, in Zeek's
+ * syntax, and the index that matches of it get reported under.
+ */
+struct RE_EnginePattern {
+	std::string text;
+	int idx;
+};
+
+/**
+ * An alternative to the NFA/DFA machinery for matching the patterns of a
+ * Specific_RE_Matcher. That machinery still gets built as the reference,
+ * and it stays in charge of anything an engine doesn't take on: an
+ * engine factory returns null for patterns it can't match exactly as
+ * the DFA would, and Specific_RE_Matcher falls back to the DFA for them.
+ */
+class RE_Engine {
+public:
+	virtual ~RE_Engine() = default;
+
+	/**
+	 * Returns whether the patterns match all of the data. Only used for
+	 * MATCH_EXACTLY matchers.
+	 */
+	virtual bool MatchAll(const u_char* bv, int n) = 0;
+
+	/**
+	 * Returns the position just beyond where the first match in the data
+	 * ends, or 0 if there's none. Only used for MATCH_ANYWHERE matchers.
+	 */
+	virtual int Match(const u_char* bv, int n) = 0;
+
+	/**
+	 * Returns a new stream for matching data that arrives in chunks,
+	 * standing in for the DFA in an RE_Match_State.
+	 */
+	virtual std::unique_ptr<RE_EngineStream> NewStream() = 0;
+
+	virtual unsigned int MemoryAllocation() const = 0;
+};
+
+/**
+ * The state of matching one stream of data with an RE_Engine.
+ */
+class RE_EngineStream {
+public:
+	virtual ~RE_EngineStream() = default;
+
+	/**
+	 * Matches the next chunk of the stream, with the same semantics as
+	 * RE_Match_State::Match().
+	 *
+	 * @param matches Gets the index and position of the first match of
+	 * each pattern added, with positions counted from the start of the
+	 * chunk as RE_Match_State does.
+	 *
+	 * @return True if this added to *matches*.
+	 */
+	virtual bool Match(const u_char* bv, int n, bool bol, bool eol, bool clear,
+	                   AcceptingMatchSet* matches) = 0;
+
+	/**
+	 * Starts the stream over.
+	 */
+	virtual void Clear() = 0;
+};
+
+/**
+ * Returns an engine for the given patterns, or null if it can't match
+ * them.
+ *
+ * @param patterns The patterns.
+ *
+ * @param mt Whether the patterns need to match all of the data or
+ * anywhere in it. Pattern sets for streams always use MATCH_EXACTLY.
+ *
+ * @param multiline True if '.' matches newlines.
+ *
+ * @param stream True if the engine gets used through NewStream() rather
+ * than MatchAll() and Match().
+ */
+using RE_EngineFactory = std::unique_ptr<RE_Engine> (*)(const std::vector<RE_EnginePattern>& patterns,
+                                                        match_type mt, bool multiline, bool stream);
+
+// Set to use an engine other than the DFA for the patterns getting
+// compiled from then on.
+extern RE_EngineFactory re_engine_factory;
+
+} // namespace zeek::detail
@@ -16,6 +16,10 @@
 
 #include <math.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define log2of10 3.32192809488736234787
 /*  RT_LOG2  --  Calculate log to the base 2  */
 static double rt_log2(double x)
@@ -26,6 +30,60 @@ static double rt_log2(double x)
 // RT_INCIRC = pow(pow(256.0, (double) (RT_MONTEN / 2)) - 1, 2.0);
 #define RT_INCIRC 281474943156225.0
 
+/*  BLOCK_SUMS  --  Sum up products of neighbouring bytes, bytes, and
+		    squares of bytes of at most RT_BLOCK bytes.  With
+		    "next", the product of the last byte and the one
+		    following the block is included. */
+static void block_sums(const unsigned char* p, int n, bool next,
+                       uint32_t* r_s1, uint32_t* r_s2, uint32_t* r_s3)
+{
+	uint32_t s1 = 0, s2 = 0, s3 = 0;
+	int i = 0;
+
+#ifdef __SSE2__
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v1 = zero, v2 = zero, v3 = zero;
+
+	/* The loads of p + i + 1 must stay within the buffer. */
+	for (; i + 17 <= n; i += 16)
+		{
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+		__m128i alo = _mm_unpacklo_epi8(a, zero);
+		__m128i ahi = _mm_unpackhi_epi8(a, zero);
+		__m128i blo = _mm_unpacklo_epi8(b, zero);
+		__m128i bhi = _mm_unpackhi_epi8(b, zero);
+
+		v1 = _mm_add_epi32(v1, _mm_madd_epi16(alo, blo));
+		v1 = _mm_add_epi32(v1, _mm_madd_epi16(ahi, bhi));
+		v2 = _mm_add_epi64(v2, _mm_sad_epu8(a, zero));
+		v3 = _mm_add_epi32(v3, _mm_madd_epi16(alo, alo));
+		v3 = _mm_add_epi32(v3, _mm_madd_epi16(ahi, ahi));
+		}
+
+	uint32_t t[4];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(t), v1);
+	s1 = t[0] + t[1] + t[2] + t[3];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(t), v2);
+	s2 = t[0] + t[2];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(t), v3);
+	s3 = t[0] + t[1] + t[2] + t[3];
+#endif
+
+	for (; i < n; i++)
+		{
+		if (i + 1 < n || next)
+			s1 += (uint32_t) p[i] * p[i + 1];
+
+		s2 += p[i];
+		s3 += (uint32_t) p[i] * p[i];
+		}
+
+	*r_s1 = s1;
+	*r_s2 = s2;
+	*r_s3 = s3;
+}
+
 RandTest::RandTest()
 	{
 	totalc = 0;
@@ -40,54 +98,125 @@ RandTest::RandTest()
 		}
 	}
 
+// Bytes that add() processes at a time with 32-bit sums, small enough that
+// none of them can overflow.
+#define RT_BLOCK 16384
+
+// Buffers from this size on get counted into separate histograms.
+#define RT_SPLIT_HISTOGRAM 1024
+
 void RandTest::add(const void *buf, int bufl)
 	{
 	const unsigned char *bp = static_cast<const unsigned char*>(buf);
-	int oc;
 
-	while (bufl-- > 0)
+	if (bufl <= 0)
+		return;
+
+	totalc += bufl;
+
+	/* Update the histogram.  For larger buffers, consecutive bytes
+	   go into four separate histograms so that runs of the same
+	   value don't all wait on the same counter. */
+	if (bufl >= RT_SPLIT_HISTOGRAM)
 		{
-		oc = *bp++;
-		ccount[oc]++;   /* Update counter for this bin */
-		totalc++;
-
-		/* Update inside / outside circle counts for Monte Carlo
- 		   computation of PI */
-		monte[mp++] = oc;  /* Save character for Monte Carlo */
-		if (mp >= RT_MONTEN)  /* Calculate every RT_MONTEN character */
-			{
-			mp = 0;
-			mcount++;
-			montex = 0;
-			montey = 0;
-			for (int mj=0; mj < RT_MONTEN/2; mj++)
-				{
-				montex = (montex * 256.0) + monte[mj];
-				montey = (montey * 256.0) + monte[(RT_MONTEN / 2) + mj];
-				}
-			if (montex*montex + montey*montey <= RT_INCIRC)
-				{
-				inmont++;
-				}
-			}
+		uint32_t hist[4][256] = {};
+		int i = 0;
 
-		/* Update calculation of serial correlation coefficient */
-		if (sccfirst)
+		for (; i + 4 <= bufl; i += 4)
 			{
-			sccfirst = 0;
-			scclast = 0;
-			sccu0 = oc;
-			}
-		else
-			{
-			scct1 = scct1 + scclast * oc;
+			hist[0][bp[i]]++;
+			hist[1][bp[i + 1]]++;
+			hist[2][bp[i + 2]]++;
+			hist[3][bp[i + 3]]++;
 			}
 
-		scct2 = scct2 + oc;
-		scct3 = scct3 + (oc * oc);
-		scclast = oc;
-		oc <<= 1;
+		for (; i < bufl; i++)
+			hist[0][bp[i]]++;
+
+		for (i = 0; i < 256; i++)
+			ccount[i] += (int64_t) hist[0][i] + hist[1][i] + hist[2][i] + hist[3][i];
+		}
+	else
+		{
+		for (int i = 0; i < bufl; i++)
+			ccount[bp[i]]++;
+		}
+
+	/* Update calculation of serial correlation coefficient.  The
+	   sums are taken over blocks in integers, with SSE2 where
+	   available, and stay exact in the doubles as long as the
+	   original per-byte sums did. */
+	if (sccfirst)
+		{
+		sccfirst = 0;
+		scclast = 0;
+		sccu0 = bp[0];
+		}
+	else
+		scct1 = scct1 + scclast * bp[0];
+
+	for (int off = 0; off < bufl; off += RT_BLOCK)
+		{
+		int n = bufl - off < RT_BLOCK ? bufl - off : RT_BLOCK;
+		uint32_t s1, s2, s3;
+
+		/* Include the product across the block boundary. */
+		block_sums(bp + off, n, off + n < bufl, &s1, &s2, &s3);
+
+		scct1 += s1;
+		scct2 += s2;
+		scct3 += s3;
+		}
+
+	scclast = bp[bufl - 1];
+
+	/* Update inside / outside circle counts for Monte Carlo
+	   computation of PI, every RT_MONTEN characters.  The
+	   co-ordinates have 24 bits each, so integer math decides
+	   exactly like the original doubles. */
+	int i = 0;
+
+	if (mp > 0)
+		{
+		while (mp < RT_MONTEN && i < bufl)
+			monte[mp++] = bp[i++];
+
+		if (mp < RT_MONTEN)
+			return;
+
+		unsigned char group[RT_MONTEN];
+
+		for (int mj = 0; mj < RT_MONTEN; mj++)
+			group[mj] = monte[mj];
+
+		mp = 0;
+		add_monte(group);
+		}
+
+	for (; i + RT_MONTEN <= bufl; i += RT_MONTEN)
+		add_monte(bp + i);
+
+	while (i < bufl)
+		monte[mp++] = bp[i++];
+	}
+
+void RandTest::add_monte(const unsigned char* m)
+	{
+	uint64_t x = 0, y = 0;
+
+	for (int mj = 0; mj < RT_MONTEN / 2; mj++)
+		{
+		x = (x << 8) | m[mj];
+		y = (y << 8) | m[(RT_MONTEN / 2) + mj];
 		}
+
+	mcount++;
+
+	if (x * x + y * y <= (uint64_t) RT_INCIRC)
+		inmont++;
+
+	montex = x;
+	montey = y;
 	}
 
 void RandTest::end(double* r_ent, double* r_chisq,
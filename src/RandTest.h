@@ -18,6 +18,9 @@ public:
 	         double* r_montepicalc, double* r_scc);
 
 private:
+	// Counts one group of RT_MONTEN bytes for the Monte Carlo estimate.
+	void add_monte(const unsigned char* m);
+
 	friend class zeek::EntropyVal;
 
 	int64_t ccount[256];  /* Bins to count occurrences of values */
@@ -5,18 +5,110 @@
 
 #include <algorithm>
 
+#include "ConnMemory.h"
 #include "Desc.h"
+#include "MemoryArena.h"
 
 using std::min;
 
 uint64_t Reassembler::total_size = 0;
 uint64_t Reassembler::sizes[REASSEM_NUM];
 
+std::list<Reassembler*> Reassembler::lru;
+bool Reassembler::evicting = false;
+uint64_t Reassembler::memory_budget = 0;
+uint64_t Reassembler::num_evictions = 0;
+uint64_t Reassembler::evicted_bytes = 0;
+
+// The smallest size class, which has to fit a free list link, and the
+// number of classes, each twice the size of the previous one.  Larger
+// blocks get allocated individually.
+static constexpr uint64_t min_slab_block = 16;
+static constexpr int num_slab_classes = 6;
+static constexpr uint64_t max_slab_block = min_slab_block << (num_slab_classes - 1);
+
+static constexpr uint64_t slab_size = 64 * 1024;
+
+namespace {
+
+struct FreeBlock {
+	FreeBlock* next;
+};
+
+struct SlabClass {
+	FreeBlock* free = nullptr;
+
+	// The part of the current slab that hasn't been handed out yet.
+	u_char* avail = nullptr;
+	u_char* avail_end = nullptr;
+};
+
+}
+
+static SlabClass slab_classes[num_slab_classes];
+
+static int slab_class(uint64_t size)
+	{
+	int c = 0;
+
+	while ( (min_slab_block << c) < size )
+		++c;
+
+	return c;
+	}
+
+u_char* DataBlock::Allocate(uint64_t size)
+	{
+	if ( size > max_slab_block )
+		return static_cast<u_char*>(
+			zeek::detail::arena_alloc(zeek::detail::MemoryArena::Connection, size));
+
+	auto c = slab_class(size);
+	auto& sc = slab_classes[c];
+
+	if ( sc.free )
+		{
+		auto b = sc.free;
+		sc.free = b->next;
+		return reinterpret_cast<u_char*>(b);
+		}
+
+	if ( sc.avail == sc.avail_end )
+		{
+		// Slabs stay around for good, as their blocks get freed in no
+		// particular order.  They only get reused from the free list.
+		sc.avail = static_cast<u_char*>(
+			zeek::detail::arena_alloc(zeek::detail::MemoryArena::Connection, slab_size));
+		sc.avail_end = sc.avail + slab_size;
+		}
+
+	auto b = sc.avail;
+	sc.avail += min_slab_block << c;
+	return b;
+	}
+
+void DataBlock::Release(u_char* b, uint64_t size)
+	{
+	if ( ! b )
+		return;
+
+	if ( size > max_slab_block )
+		{
+		zeek::detail::arena_free(zeek::detail::MemoryArena::Connection, b, size);
+		return;
+		}
+
+	auto& sc = slab_classes[slab_class(size)];
+	auto fb = reinterpret_cast<FreeBlock*>(b);
+	fb->next = sc.free;
+	sc.free = fb;
+	}
+
 DataBlock::DataBlock(const u_char* data, uint64_t size, uint64_t arg_seq)
 	{
 	seq = arg_seq;
 	upper = seq + size;
-	block = new u_char[size];
+	block = Allocate(size);
 	memcpy(block, data, size);
 	}
 
@@ -51,6 +143,10 @@ void DataBlockList::Delete(DataBlockMap::const_iterator it)
 
 	Reassembler::total_size -= size + sizeof(DataBlock);
 	Reassembler::sizes[reassembler->rtype] -= size + sizeof(DataBlock);
+
+	if ( reassembler->memory_account )
+		reassembler->memory_account->Adjust(CONN_MEM_REASSEMBLY,
+		                                    -int64_t(size + sizeof(DataBlock)));
 	}
 
 DataBlock DataBlockList::Remove(DataBlockMap::const_iterator it)
@@ -70,6 +166,10 @@ void DataBlockList::Clear()
 	auto total = total_data_size + total_db_size;
 	Reassembler::total_size -= total;
 	Reassembler::sizes[reassembler->rtype] -= total;
+
+	if ( reassembler->memory_account )
+		reassembler->memory_account->Adjust(CONN_MEM_REASSEMBLY, -int64_t(total));
+
 	total_data_size = 0;
 	block_map.clear();
 	}
@@ -109,6 +209,10 @@ DataBlockList::Insert(uint64_t seq, uint64_t upper, const u_char* data,
 	Reassembler::sizes[reassembler->rtype] += size + sizeof(DataBlock);
 	Reassembler::total_size += size + sizeof(DataBlock);
 
+	if ( reassembler->memory_account )
+		reassembler->memory_account->Adjust(CONN_MEM_REASSEMBLY,
+		                                    size + sizeof(DataBlock));
+
 	return rval;
 	}
 
@@ -271,6 +375,16 @@ Reassembler::Reassembler(uint64_t init_seq, ReassemblerType reassem_type)
 	{
 	}
 
+Reassembler::Reassembler()
+	{
+	}
+
+Reassembler::~Reassembler()
+	{
+	if ( in_lru )
+		lru.erase(lru_pos);
+	}
+
 void Reassembler::CheckOverlap(const DataBlockList& list,
                                uint64_t seq, uint64_t len,
                                const u_char* data)
@@ -345,13 +459,88 @@ void Reassembler::NewBlock(double t, uint64_t seq, uint64_t len, const u_char* d
 		len -= amount_old;
 		}
 
+	++busy;
 	auto it = block_list.Insert(seq, upper_seq, data);;
 	BlockInserted(it);
+	--busy;
+
+	if ( memory_budget )
+		{
+		Touch();
+
+		if ( total_size > memory_budget )
+			EnforceMemoryBudget();
+		}
 	}
 
 uint64_t Reassembler::TrimToSeq(uint64_t seq)
 	{
-	return block_list.Trim(seq, max_old_blocks, &old_block_list);
+	++busy;
+	auto rval = block_list.Trim(seq, max_old_blocks, &old_block_list);
+	--busy;
+	return rval;
+	}
+
+void Reassembler::Touch()
+	{
+	if ( in_lru )
+		lru.splice(lru.end(), lru, lru_pos);
+	else
+		{
+		lru_pos = lru.insert(lru.end(), this);
+		in_lru = true;
+		}
+	}
+
+void Reassembler::EnforceMemoryBudget()
+	{
+	// Evicting delivers data, which may add blocks to other reassemblers
+	// in turn.  Those don't start evicting on their own.
+	if ( evicting )
+		return;
+
+	evicting = true;
+
+	while ( total_size > memory_budget )
+		{
+		// Start over each time, as evicting may have changed the list.
+		// Reassemblers that are busy, such as the one that has just
+		// gotten new data, get passed over.
+		auto it = lru.begin();
+
+		while ( it != lru.end() && (*it)->busy )
+			++it;
+
+		if ( it == lru.end() )
+			break;
+
+		Reassembler* r = *it;
+		lru.erase(it);
+		r->in_lru = false;
+
+		uint64_t size = r->TotalSize();
+
+		if ( size == 0 )
+			continue;
+
+		++r->busy;
+		r->Evict();
+		--r->busy;
+
+		++num_evictions;
+		evicted_bytes += size - r->TotalSize();
+		}
+
+	evicting = false;
+	}
+
+void Reassembler::Evict()
+	{
+	if ( HasBlocks() )
+		TrimToSeq(block_list.LastBlock().upper);
+
+	// Trimming may have moved blocks here.
+	ClearOldBlocks();
 	}
 
 void Reassembler::ClearBlocks()
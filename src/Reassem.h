@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <list>
 #include <map>
 
 #include "Obj.h"
@@ -24,7 +25,7 @@ enum ReassemblerType {
 };
 
 class Reassembler;
-
+class ConnMemoryAccount;
 
 /**
  * A block/segment of data for use in the reassembly process.
@@ -42,7 +43,7 @@ public:
 		seq = other.seq;
 		upper = other.upper;
 		auto size = other.Size();
-		block = new u_char[size];
+		block = Allocate(size);
 		memcpy(block, other.block, size);
 		}
 
@@ -59,11 +60,11 @@ public:
 		if ( this == &other )
 			return *this;
 
+		Release(block, Size());
 		seq = other.seq;
 		upper = other.upper;
 		auto size = other.Size();
-		delete [] block;
-		block = new u_char[size];
+		block = Allocate(size);
 		memcpy(block, other.block, size);
 		return *this;
 		}
@@ -73,16 +74,16 @@ public:
 		if ( this == &other )
 			return *this;
 
+		Release(block, Size());
 		seq = other.seq;
 		upper = other.upper;
-		delete [] block;
 		block = other.block;
 		other.block = nullptr;
 		return *this;
 		}
 
 	~DataBlock()
-		{ delete [] block; }
+		{ Release(block, Size()); }
 
 	/**
 	 * @return length of the data block
@@ -93,6 +94,15 @@ public:
 	uint64_t seq;
 	uint64_t upper;
 	u_char* block;
+
+private:
+	// Small blocks come from slabs, in a few size classes, rather than
+	// from the heap one by one, as interactive traffic creates a lot of
+	// them.  Whatever's released goes on a free list for its class for
+	// reuse.  The size passed to Release() has to be the one passed to
+	// Allocate().
+	static u_char* Allocate(uint64_t size);
+	static void Release(u_char* b, uint64_t size);
 };
 
 using DataBlockMap = std::map<uint64_t, DataBlock>;
@@ -254,7 +264,7 @@ private:
 class Reassembler : public zeek::Obj {
 public:
 	Reassembler(uint64_t init_seq, ReassemblerType reassem_type = REASSEM_UNKNOWN);
-	~Reassembler() override	{}
+	~Reassembler() override;
 
 	void NewBlock(double t, uint64_t seq, uint64_t len, const u_char* data);
 
@@ -289,13 +299,33 @@ public:
 
 	void SetMaxOldBlocks(uint32_t count)	{ max_old_blocks = count; }
 
+	// Caps the memory that all reassemblers together may buffer, with
+	// zero meaning no limit.  Whenever new data takes the total beyond
+	// that, the reassemblers that have gone longest without new data
+	// get their buffered data evicted until it's back within the budget.
+	static void SetMemoryBudget(uint64_t bytes)	{ memory_budget = bytes; }
+
+	// How often reassemblers got their data evicted, and how much of it.
+	static uint64_t NumEvictions()	{ return num_evictions; }
+	static uint64_t EvictedBytes()	{ return evicted_bytes; }
+
+	// Makes the buffered data count towards a connection's memory.
+	void SetMemoryAccount(ConnMemoryAccount* a)	{ memory_account = a; }
+
 protected:
-	Reassembler()	{ }
+	Reassembler();
 
 	friend class DataBlockList;
 
 	virtual void Undelivered(uint64_t up_to_seq);
 
+	// Throws away all buffered data to keep within the memory budget.
+	// The default treats holes in front of pending data as undelivered,
+	// like TrimToSeq() does, so that the data beyond them still gets
+	// delivered first.  Derived classes can override this to report the
+	// eviction, or to handle data that can't be delivered partially.
+	virtual void Evict();
+
 	virtual void BlockInserted(DataBlockMap::const_iterator it) = 0;
 	virtual void Overlap(const u_char* b1, const u_char* b2, uint64_t n) = 0;
 
@@ -310,7 +340,32 @@ protected:
 	uint32_t max_old_blocks;
 
 	ReassemblerType rtype;
+	ConnMemoryAccount* memory_account = nullptr;
 
 	static uint64_t total_size;
 	static uint64_t sizes[REASSEM_NUM];
+
+private:
+	// Moves this reassembler to the recently used end of lru.
+	void Touch();
+
+	// Evicts reassemblers from the least recently used end of lru
+	// until total_size is within memory_budget again.
+	static void EnforceMemoryBudget();
+
+	// Non-zero while this reassembler is inserting or trimming data,
+	// which eviction mustn't interfere with.
+	int busy = 0;
+
+	bool in_lru = false;
+	std::list<Reassembler*>::iterator lru_pos;
+
+	// Reassemblers that have buffered data since they were last evicted,
+	// least recently used first.
+	static std::list<Reassembler*> lru;
+	static bool evicting;
+
+	static uint64_t memory_budget;
+	static uint64_t num_evictions;
+	static uint64_t evicted_bytes;
 };
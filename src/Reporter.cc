@@ -83,6 +83,9 @@ void Reporter::InitOptions()
 		weird_sampling_whitelist.emplace(move(key));
 		delete k;
 		}
+
+	for ( WeirdID id = 0; id < weird_names.size(); ++id )
+		weird_whitelisted[id] = weird_sampling_whitelist.count(weird_names[id]) > 0;
 	}
 
 void Reporter::Info(const char* fmt, ...)
@@ -241,22 +244,57 @@ void Reporter::WeirdHelper(EventHandlerPtr event, val_list vl, const char* fmt_n
 	va_end(ap);
 	}
 
-void Reporter::UpdateWeirdStats(const char* name)
+WeirdID Reporter::InternWeird(const char* name)
 	{
-	++weird_count;
-	++weird_count_by_type[name];
+	auto& entry = weird_id_cache[(reinterpret_cast<uintptr_t>(name) >> 3) % weird_id_cache.size()];
+
+	// The comparison catches names built in buffers that get reused.
+	if ( entry.name == name && weird_names[entry.id] == name )
+		return entry.id;
+
+	auto it = weird_ids.find(name);
+
+	if ( it == weird_ids.end() )
+		{
+		WeirdID id = weird_names.size();
+		it = weird_ids.emplace(name, id).first;
+		weird_names.emplace_back(name);
+		weird_counts.push_back(0);
+		net_weird_counts.push_back(0);
+		weird_whitelisted.push_back(weird_sampling_whitelist.count(weird_names.back()) > 0);
+		}
+
+	entry.name = name;
+	entry.id = it->second;
+	return entry.id;
+	}
+
+const Reporter::WeirdCountMap& Reporter::GetWeirdsByType() const
+	{
+	for ( WeirdID id = 0; id < weird_names.size(); ++id )
+		weird_count_by_type[weird_names[id]] = weird_counts[id];
+
+	return weird_count_by_type;
+	}
+
+void Reporter::SetWeirdSamplingWhitelist(const WeirdSet& arg_weird_sampling_whitelist)
+	{
+	weird_sampling_whitelist = arg_weird_sampling_whitelist;
+
+	for ( WeirdID id = 0; id < weird_names.size(); ++id )
+		weird_whitelisted[id] = weird_sampling_whitelist.count(weird_names[id]) > 0;
 	}
 
 class NetWeirdTimer final : public Timer {
 public:
-	NetWeirdTimer(double t, const char* name, double timeout)
-	: Timer(t + timeout, TIMER_NET_WEIRD_EXPIRE), weird_name(name)
+	NetWeirdTimer(double t, WeirdID id, double timeout)
+	: Timer(t + timeout, TIMER_NET_WEIRD_EXPIRE), weird_id(id)
 		{}
 
 	void Dispatch(double t, bool is_expire) override
-		{ reporter->ResetNetWeird(weird_name); }
+		{ reporter->ResetNetWeird(weird_id); }
 
-	std::string weird_name;
+	WeirdID weird_id;
 };
 
 class FlowWeirdTimer final : public Timer {
@@ -290,7 +328,15 @@ public:
 
 void Reporter::ResetNetWeird(const std::string& name)
 	{
-	net_weird_state.erase(name);
+	auto it = weird_ids.find(name);
+
+	if ( it != weird_ids.end() )
+		ResetNetWeird(it->second);
+	}
+
+void Reporter::ResetNetWeird(WeirdID id)
+	{
+	net_weird_counts[id] = 0;
 	}
 
 void Reporter::ResetFlowWeird(const IPAddr& orig, const IPAddr& resp)
@@ -303,15 +349,8 @@ void Reporter::ResetExpiredConnWeird(const ConnTuple& id)
 	expired_conn_weird_state.erase(id);
 	}
 
-bool Reporter::PermitNetWeird(const char* name)
+bool Reporter::PermitSample(uint64_t count) const
 	{
-	auto& count = net_weird_state[name];
-	++count;
-
-	if ( count == 1 )
-		timer_mgr->Add(new NetWeirdTimer(network_time, name,
-		                                 weird_sampling_duration));
-
 	if ( count <= weird_sampling_threshold )
 		return true;
 
@@ -322,7 +361,19 @@ bool Reporter::PermitNetWeird(const char* name)
 		return false;
 	}
 
-bool Reporter::PermitFlowWeird(const char* name,
+bool Reporter::PermitNetWeird(WeirdID id)
+	{
+	auto& count = net_weird_counts[id];
+	++count;
+
+	if ( count == 1 )
+		timer_mgr->Add(new NetWeirdTimer(network_time, id,
+		                                 weird_sampling_duration));
+
+	return PermitSample(count);
+	}
+
+bool Reporter::PermitFlowWeird(WeirdID id,
                                const IPAddr& orig, const IPAddr& resp)
 	{
 	auto endpoints = std::make_pair(orig, resp);
@@ -332,20 +383,13 @@ bool Reporter::PermitFlowWeird(const char* name,
 		timer_mgr->Add(new FlowWeirdTimer(network_time, endpoints,
 		                                  weird_sampling_duration));
 
-	auto& count = map[name];
+	auto& count = map[id];
 	++count;
 
-	if ( count <= weird_sampling_threshold )
-		return true;
-
-	auto num_above_threshold = count - weird_sampling_threshold;
-	if ( weird_sampling_rate )
-		return num_above_threshold % weird_sampling_rate == 0;
-	else
-		return false;
+	return PermitSample(count);
 	}
 
-bool Reporter::PermitExpiredConnWeird(const char* name, const zeek::RecordVal& conn_id)
+bool Reporter::PermitExpiredConnWeird(WeirdID id, const zeek::RecordVal& conn_id)
 	{
 	auto conn_tuple = std::make_tuple(conn_id.GetField("orig_h")->AsAddr(),
 	                                  conn_id.GetField("resp_h")->AsAddr(),
@@ -360,27 +404,20 @@ bool Reporter::PermitExpiredConnWeird(const char* name, const zeek::RecordVal& c
 		                                       std::move(conn_tuple),
 		                                       weird_sampling_duration));
 
-	auto& count = map[name];
+	auto& count = map[id];
 	++count;
 
-	if ( count <= weird_sampling_threshold )
-		return true;
-
-	auto num_above_threshold = count - weird_sampling_threshold;
-
-	if ( weird_sampling_rate )
-		return num_above_threshold % weird_sampling_rate == 0;
-	else
-		return false;
+	return PermitSample(count);
 	}
 
 void Reporter::Weird(const char* name, const char* addl)
 	{
-	UpdateWeirdStats(name);
+	WeirdID id = InternWeird(name);
+	UpdateWeirdStats(id);
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+	if ( ! WeirdOnSamplingWhiteList(id) )
 		{
-		if ( ! PermitNetWeird(name) )
+		if ( ! PermitNetWeird(id) )
 			return;
 		}
 
@@ -389,11 +426,12 @@ void Reporter::Weird(const char* name, const char* addl)
 
 void Reporter::Weird(file_analysis::File* f, const char* name, const char* addl)
 	{
-	UpdateWeirdStats(name);
+	WeirdID id = InternWeird(name);
+	UpdateWeirdStats(id);
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+	if ( ! WeirdOnSamplingWhiteList(id) )
 		{
-		if ( ! f->PermitWeird(name, weird_sampling_threshold,
+		if ( ! f->PermitWeird(id, weird_sampling_threshold,
 		                      weird_sampling_rate, weird_sampling_duration) )
 			return;
 		}
@@ -404,11 +442,12 @@ void Reporter::Weird(file_analysis::File* f, const char* name, const char* addl)
 
 void Reporter::Weird(Connection* conn, const char* name, const char* addl)
 	{
-	UpdateWeirdStats(name);
+	WeirdID id = InternWeird(name);
+	UpdateWeirdStats(id);
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+	if ( ! WeirdOnSamplingWhiteList(id) )
 		{
-		if ( ! conn->PermitWeird(name, weird_sampling_threshold,
+		if ( ! conn->PermitWeird(id, weird_sampling_threshold,
 		                         weird_sampling_rate, weird_sampling_duration) )
 			return;
 		}
@@ -420,11 +459,12 @@ void Reporter::Weird(Connection* conn, const char* name, const char* addl)
 void Reporter::Weird(zeek::RecordValPtr conn_id, zeek::StringValPtr uid,
                      const char* name, const char* addl)
 	{
-	UpdateWeirdStats(name);
+	WeirdID id = InternWeird(name);
+	UpdateWeirdStats(id);
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+	if ( ! WeirdOnSamplingWhiteList(id) )
 		{
-		if ( ! PermitExpiredConnWeird(name, *conn_id) )
+		if ( ! PermitExpiredConnWeird(id, *conn_id) )
 			return;
 		}
 
@@ -435,11 +475,12 @@ void Reporter::Weird(zeek::RecordValPtr conn_id, zeek::StringValPtr uid,
 
 void Reporter::Weird(const IPAddr& orig, const IPAddr& resp, const char* name, const char* addl)
 	{
-	UpdateWeirdStats(name);
+	WeirdID id = InternWeird(name);
+	UpdateWeirdStats(id);
 
-	if ( ! WeirdOnSamplingWhiteList(name) )
+	if ( ! WeirdOnSamplingWhiteList(id) )
 		{
-		if ( ! PermitFlowWeird(name, orig, resp) )
+		if ( ! PermitFlowWeird(id, orig, resp) )
 			 return;
 		}
 
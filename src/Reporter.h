@@ -4,6 +4,7 @@
 
 #include <stdarg.h>
 
+#include <array>
 #include <list>
 #include <utility>
 #include <string>
@@ -11,9 +12,11 @@
 #include <map>
 #include <unordered_set>
 #include <unordered_map>
+#include <vector>
 
 #include "BroList.h"
 #include "net_util.h"
+#include "WeirdState.h"
 
 namespace analyzer { class Analyzer; }
 namespace file_analysis { class File; }
@@ -57,8 +60,9 @@ public:
 	using IPPair = std::pair<IPAddr, IPAddr>;
 	using ConnTuple = std::tuple<IPAddr, IPAddr, uint32_t, uint32_t, TransportProto>;
 	using WeirdCountMap = std::unordered_map<std::string, uint64_t>;
-	using WeirdFlowMap = std::map<IPPair, WeirdCountMap>;
-	using WeirdConnTupleMap = std::map<ConnTuple, WeirdCountMap>;
+	using WeirdIDCountMap = std::unordered_map<WeirdID, uint64_t>;
+	using WeirdFlowMap = std::map<IPPair, WeirdIDCountMap>;
+	using WeirdConnTupleMap = std::map<ConnTuple, WeirdIDCountMap>;
 	using WeirdSet = std::unordered_set<std::string>;
 
 	Reporter(bool abort_on_scripting_errors);
@@ -151,6 +155,7 @@ public:
 	 * Reset/cleanup state tracking for a "net" weird.
 	 */
 	void ResetNetWeird(const std::string& name);
+	void ResetNetWeird(WeirdID id);
 
 	/**
 	 * Reset/cleanup state tracking for a "flow" weird.
@@ -173,8 +178,14 @@ public:
 	 * Return number of weirds generated per weird type/name (counts weirds
 	 * before any rate-limiting occurs).
 	 */
-	const WeirdCountMap& GetWeirdsByType() const
-		{ return weird_count_by_type; }
+	const WeirdCountMap& GetWeirdsByType() const;
+
+	/**
+	 * Returns the ID for a weird name, assigning a new one on first use.
+	 * The weird methods do this themselves; IDs are stable for the
+	 * lifetime of the process.
+	 */
+	WeirdID InternWeird(const char* name);
 
 	/**
 	 * Gets the weird sampling whitelist.
@@ -189,10 +200,7 @@ public:
 	 *
 	 * @param weird_sampling_whitelist New weird sampling whitelist.
 	 */
-	void SetWeirdSamplingWhitelist(const WeirdSet& weird_sampling_whitelist)
-		{
-		this->weird_sampling_whitelist = weird_sampling_whitelist;
-		}
+	void SetWeirdSamplingWhitelist(const WeirdSet& weird_sampling_whitelist);
 
 	/**
 	 * Gets the current weird sampling threshold.
@@ -270,12 +278,14 @@ private:
 	// WeirdHelper doesn't really have to be variadic, but it calls DoLog
 	// and that takes va_list anyway.
 	void WeirdHelper(EventHandlerPtr event, val_list vl, const char* fmt_name, ...) __attribute__((format(printf, 4, 5)));;
-	void UpdateWeirdStats(const char* name);
-	inline bool WeirdOnSamplingWhiteList(const char* name)
-		{ return weird_sampling_whitelist.find(name) != weird_sampling_whitelist.end(); }
-	bool PermitNetWeird(const char* name);
-	bool PermitFlowWeird(const char* name, const IPAddr& o, const IPAddr& r);
-	bool PermitExpiredConnWeird(const char* name, const zeek::RecordVal& conn_id);
+	void UpdateWeirdStats(WeirdID id)
+		{ ++weird_count; ++weird_counts[id]; }
+	bool WeirdOnSamplingWhiteList(WeirdID id)
+		{ return weird_whitelisted[id]; }
+	bool PermitNetWeird(WeirdID id);
+	bool PermitFlowWeird(WeirdID id, const IPAddr& o, const IPAddr& r);
+	bool PermitExpiredConnWeird(WeirdID id, const zeek::RecordVal& conn_id);
+	bool PermitSample(uint64_t count) const;
 
 	bool EmitToStderr(bool flag)
 		{ return flag || ! after_zeek_init; }
@@ -292,8 +302,25 @@ private:
 	std::list<std::pair<const zeek::detail::Location*, const zeek::detail::Location*> > locations;
 
 	uint64_t weird_count;
-	WeirdCountMap weird_count_by_type;
-	WeirdCountMap net_weird_state;
+	mutable WeirdCountMap weird_count_by_type;
+
+	// Per-ID state of weirds, indexed by WeirdID.
+	std::vector<std::string> weird_names;
+	std::vector<uint64_t> weird_counts;
+	std::vector<uint64_t> net_weird_counts;
+	std::vector<bool> weird_whitelisted;
+	std::unordered_map<std::string, WeirdID> weird_ids;
+
+	// Maps the addresses of weird names passed in to their IDs. Nearly
+	// all names are string literals, so this avoids hashing the name
+	// for each weird.
+	struct WeirdIDCacheEntry {
+		const char* name = nullptr;
+		WeirdID id = 0;
+	};
+
+	std::array<WeirdIDCacheEntry, 1024> weird_id_cache;
+
 	WeirdFlowMap flow_weird_state;
 	WeirdConnTupleMap expired_conn_weird_state;
 
@@ -61,6 +61,14 @@ uint32_t SerializationFormat::EndWrite(char** data)
 	return rval;
 	}
 
+uint32_t SerializationFormat::EndWrite(std::string* data)
+	{
+	uint32_t rval = output_pos;
+	data->assign(output, output_pos);
+	output_pos = 0;
+	return rval;
+	}
+
 bool SerializationFormat::ReadData(void* b, size_t count)
 	{
 	if ( input_pos + count > input_len )
@@ -80,10 +88,13 @@ bool SerializationFormat::ReadData(void* b, size_t count)
 bool SerializationFormat::WriteData(const void* b, size_t count)
 	{
 	// Increase buffer if necessary.
-	while ( output_pos + count > output_size )
-		output_size *= GROWTH_FACTOR;
+	if ( output_pos + count > output_size )
+		{
+		while ( output_pos + count > output_size )
+			output_size *= GROWTH_FACTOR;
 
-	output = (char*)safe_realloc(output, output_size);
+		output = (char*)safe_realloc(output, output_size);
+		}
 
 	memcpy(output + output_pos, b, count);
 	output_pos += count;
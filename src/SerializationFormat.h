@@ -51,6 +51,14 @@ public:
 	 */
 	virtual uint32_t EndWrite(char** data);
 
+	/**
+	 * Retrieves serialized data by copying it. Unlike the other version,
+	 * this keeps the internal buffer for reuse by the next StartWrite().
+	 * @param data A string that receives the serialized data.
+	 * @return The number of bytes copied into \a data.
+	 */
+	uint32_t EndWrite(std::string* data);
+
 	virtual bool Write(int v, const char* tag) = 0;
 	virtual bool Write(uint16_t v, const char* tag) = 0;
 	virtual bool Write(uint32_t v, const char* tag) = 0;
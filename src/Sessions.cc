@@ -8,6 +8,8 @@
 #include <arpa/inet.h>
 
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
 #include <unistd.h>
 
 #include "Desc.h"
@@ -25,6 +27,8 @@
 #include "analyzer/protocol/arp/ARP.h"
 #include "analyzer/protocol/arp/events.bif.h"
 #include "Discard.h"
+#include "Overload.h"
+#include "ConnMemory.h"
 #include "RuleMatcher.h"
 
 #include "TunnelEncapsulation.h"
@@ -63,6 +67,160 @@ void IPTunnelTimer::Dispatch(double t, bool is_expire)
 		timer_mgr->Add(new IPTunnelTimer(t, tunnel_idx));
 	}
 
+class InactivityScanTimer final : public Timer {
+public:
+	InactivityScanTimer(InactivityScanner* arg_scanner, int64_t arg_slice)
+		: Timer(arg_slice * arg_scanner->interval, TIMER_CONN_INACTIVITY),
+		  scanner(arg_scanner), slice(arg_slice)
+		{}
+
+	void Dispatch(double t, bool is_expire) override
+		{
+		scanner->timer = nullptr;
+
+		// Like the connections' own inactivity timers, we don't
+		// time out anything when terminating.
+		if ( ! is_expire )
+			scanner->Scan(t, slice);
+		}
+
+private:
+	InactivityScanner* scanner;
+	int64_t slice;
+};
+
+InactivityScanner::InactivityScanner()
+	{
+	interval = inactivity_check_interval;
+	next_slice = 0;
+	size = 0;
+	timer = nullptr;
+	timer_slice = 0;
+
+	if ( Enabled() )
+		slots.resize(NUM_SLOTS);
+	}
+
+InactivityScanner::~InactivityScanner()
+	{
+	// Connections outliving us must not try to unlink themselves.
+	for ( auto c : slots )
+		for ( ; c; c = c->inactivity_next )
+			c->inactivity_slice = -1;
+
+	if ( timer )
+		timer_mgr->Cancel(timer);
+	}
+
+void InactivityScanner::Add(Connection* c, double t)
+	{
+	Remove(c);
+
+	auto slice = std::max(static_cast<int64_t>(ceil(t / interval)), next_slice);
+	auto& head = slots[slice & (NUM_SLOTS - 1)];
+
+	c->inactivity_slice = slice;
+	c->inactivity_prev = nullptr;
+	c->inactivity_next = head;
+
+	if ( head )
+		head->inactivity_prev = c;
+
+	head = c;
+	++size;
+
+	Schedule(slice);
+	}
+
+void InactivityScanner::Remove(Connection* c)
+	{
+	if ( c->inactivity_slice < 0 )
+		return;
+
+	if ( c->inactivity_prev )
+		c->inactivity_prev->inactivity_next = c->inactivity_next;
+	else
+		slots[c->inactivity_slice & (NUM_SLOTS - 1)] = c->inactivity_next;
+
+	if ( c->inactivity_next )
+		c->inactivity_next->inactivity_prev = c->inactivity_prev;
+
+	c->inactivity_prev = c->inactivity_next = nullptr;
+	c->inactivity_slice = -1;
+	--size;
+	}
+
+void InactivityScanner::Scan(double t, int64_t slice)
+	{
+	// The timer's slice counts as passed even if rounding says
+	// otherwise, so that we always make progress.
+	auto last = std::max(static_cast<int64_t>(floor(t / interval)), slice);
+
+	// If time jumped ahead by more than a full round, this visits
+	// every slot once.
+	auto end = std::min(last + 1, next_slice + NUM_SLOTS);
+
+	for ( auto s = next_slice; s < end; ++s )
+		for ( auto c = slots[s & (NUM_SLOTS - 1)]; c; c = c->inactivity_next )
+			if ( c->inactivity_slice <= last )
+				due.push_back(c);
+
+	next_slice = last + 1;
+
+	// Check them in the order their timeouts passed, as individual
+	// timers would have fired.
+	std::stable_sort(due.begin(), due.end(),
+	                 [](const Connection* a, const Connection* b)
+		                 {
+		                 return a->LastTime() + a->InactivityTimeout() <
+		                        b->LastTime() + b->InactivityTimeout();
+		                 });
+
+	// Timing out a connection may release the last reference to
+	// others.
+	for ( auto c : due )
+		Ref(c);
+
+	for ( auto c : due )
+		{
+		// Skip connections removed or rescheduled meanwhile.
+		if ( c->inactivity_slice >= 0 && c->inactivity_slice <= last )
+			{
+			Remove(c);
+			c->InactivityTimer(t);
+			}
+
+		Unref(c);
+		}
+
+	due.clear();
+
+	if ( size == 0 )
+		return;
+
+	for ( auto s = next_slice; s < next_slice + NUM_SLOTS; ++s )
+		if ( slots[s & (NUM_SLOTS - 1)] )
+			{
+			Schedule(s);
+			break;
+			}
+	}
+
+void InactivityScanner::Schedule(int64_t slice)
+	{
+	if ( timer )
+		{
+		if ( timer_slice <= slice )
+			return;
+
+		timer_mgr->Cancel(timer);
+		}
+
+	timer = new InactivityScanTimer(this, slice);
+	timer_slice = slice;
+	timer_mgr->Add(timer);
+	}
+
 NetSessions::NetSessions()
 	{
 	if ( stp_correlate_pair )
@@ -105,12 +263,9 @@ NetSessions::~NetSessions()
 	delete discarder;
 	delete stp_manager;
 
-	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+	tcp_conns.ForEach([](Connection* c) { Unref(c); });
+	udp_conns.ForEach([](Connection* c) { Unref(c); });
+	icmp_conns.ForEach([](Connection* c) { Unref(c); });
 	for ( const auto& entry : fragments )
 		Unref(entry.second);
 	}
@@ -620,24 +775,33 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		else
 			tunnel_idx = IPPair(ip_hdr->DstAddr(), ip_hdr->SrcAddr());
 
-		IPTunnelMap::iterator it = ip_tunnels.find(tunnel_idx);
+		hash_t tunnel_hash = ip_tunnels.Hash(tunnel_idx);
+		IPTunnelMap::iterator it = ip_tunnels.find(tunnel_idx, tunnel_hash);
+		TunnelActivity* tunnel;
 
 		if ( it == ip_tunnels.end() )
 			{
 			EncapsulatingConn ec(ip_hdr->SrcAddr(), ip_hdr->DstAddr(),
 			                     tunnel_type);
-			ip_tunnels[tunnel_idx] = TunnelActivity(ec, network_time);
+			tunnel = &ip_tunnels.insert_or_assign(tunnel_idx,
+			                                      TunnelActivity(ec, network_time),
+			                                      tunnel_hash);
 			timer_mgr->Add(new IPTunnelTimer(network_time, tunnel_idx));
 			}
 		else
-			it->second.second = network_time;
+			{
+			tunnel = &it->second;
+			tunnel->second = network_time;
+			}
 
+		// The map may change while processing the inner packet, but
+		// DoNextInnerPacket() copies the tunnel before doing that.
 		if ( gre_version == 0 )
 			DoNextInnerPacket(t, pkt, caplen, len, data, gre_link_type,
-			                  encapsulation, ip_tunnels[tunnel_idx].first);
+			                  encapsulation, tunnel->first);
 		else
 			DoNextInnerPacket(t, pkt, inner, encapsulation,
-			                  ip_tunnels[tunnel_idx].first);
+			                  tunnel->first);
 
 		return;
 		}
@@ -659,20 +823,30 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 		return;
 	}
 
-	ConnIDKey key = BuildConnIDKey(id);
-	Connection* conn = nullptr;
+	Connection* conn = LookupConnCache(d, id);
+	ConnIDKey key;
+	hash_t key_hash = 0;
+
+	if ( conn )
+		{
+		++stats.conn_cache_hits;
+		key = conn->Key();
+		}
+	else
+		{
+		++stats.conn_cache_misses;
+		key = BuildConnIDKey(id);
+		key_hash = d->Hash(key);
+		conn = d->Lookup(key, key_hash);
+		}
 
 	// FIXME: The following is getting pretty complex. Need to split up
 	// into separate functions.
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
-
 	if ( ! conn )
 		{
 		conn = NewConn(key, t, &id, data, proto, ip_hdr->FlowLabel(), pkt, encapsulation);
 		if ( conn )
-			InsertConnection(d, key, conn);
+			InsertConnection(d, key, key_hash, conn);
 		}
 	else
 		{
@@ -695,6 +869,8 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 	if ( ! conn )
 		return;
 
+	UpdateConnCache(d, id, conn);
+
 	int record_packet = 1;	// whether to record the packet at all
 	int record_content = 1;	// whether to record its data
 
@@ -719,6 +895,13 @@ void NetSessions::DoNextPacket(double t, const Packet* pkt, const IP_Hdr* ip_hdr
 	conn->NextPacket(t, is_orig, ip_hdr, len, caplen, data,
 				record_packet, record_content, pkt);
 
+	if ( overload_controller && ! conn->Bypassing() &&
+	     overload_controller->ShedPayload(conn->NumBytes()) )
+		conn->Bypass();
+
+	if ( conn_memory_limiter )
+		conn_memory_limiter->Check(conn);
+
 	if ( f )
 		{
 		// Above we already recorded the fragment in its entirety.
@@ -764,18 +947,17 @@ void NetSessions::DoNextInnerPacket(double t, const Packet* pkt,
 	else
 		data = (const u_char*) inner->IP6_Hdr();
 
-	EncapsulationStack* outer = prev ?
-			new EncapsulationStack(*prev) : new EncapsulationStack();
-	outer->Add(ec);
+	// Shares the tunnels of prev until adding the new one.
+	EncapsulationStack outer = prev ? *prev : EncapsulationStack();
+	outer.Add(ec);
 
 	// Construct fake packet for DoNextPacket
 	Packet p;
 	p.Init(DLT_RAW, &ts, caplen, len, data, false, "");
 
-	DoNextPacket(t, &p, inner, outer);
+	DoNextPacket(t, &p, inner, &outer);
 
 	delete inner;
-	delete outer;
 	}
 
 void NetSessions::DoNextInnerPacket(double t, const Packet* pkt,
@@ -795,9 +977,9 @@ void NetSessions::DoNextInnerPacket(double t, const Packet* pkt,
 		    ((network_time - (double)ts.tv_sec) * 1000000);
 		}
 
-	EncapsulationStack* outer = prev ?
-			new EncapsulationStack(*prev) : new EncapsulationStack();
-	outer->Add(ec);
+	// Shares the tunnels of prev until adding the new one.
+	EncapsulationStack outer = prev ? *prev : EncapsulationStack();
+	outer.Add(ec);
 
 	// Construct fake packet for DoNextPacket
 	Packet p;
@@ -806,10 +988,8 @@ void NetSessions::DoNextInnerPacket(double t, const Packet* pkt,
 	if ( p.Layer2Valid() && (p.l3_proto == L3_IPV4 || p.l3_proto == L3_IPV6) )
 		{
 		auto inner = p.IP();
-		DoNextPacket(t, &p, &inner, outer);
+		DoNextPacket(t, &p, &inner, &outer);
 		}
-
-	delete outer;
 	}
 
 int NetSessions::ParseIPPacket(int caplen, const u_char* const pkt, int proto,
@@ -902,24 +1082,56 @@ FragReassembler* NetSessions::NextFragment(double t, const IP_Hdr* ip,
 
 	FragReassemblerKey key = std::make_tuple(ip->SrcAddr(), ip->DstAddr(), frag_id);
 
+	hash_t key_hash = fragments.Hash(key);
+
 	FragReassembler* f = nullptr;
-	auto it = fragments.find(key);
+	auto it = fragments.find(key, key_hash);
 	if ( it != fragments.end() )
 		f = it->second;
 
 	if ( ! f )
 		{
 		f = new FragReassembler(this, ip, pkt, key, t);
-		fragments[key] = f;
+		fragments.insert_or_assign(key, f, key_hash);
+		f->age_pos = frags_by_age.insert(frags_by_age.end(), f);
 		if ( fragments.size() > stats.max_fragments )
 			stats.max_fragments = fragments.size();
-		return f;
 		}
+	else
+		f->AddFragment(t, ip, pkt);
+
+	if ( f->ReassembledPkt() && f->age_pos != frags_by_age.end() )
+		{
+		// The reassembled datagram may still be in use while its
+		// payload gets processed, so it can't be evicted anymore.
+		frags_by_age.erase(f->age_pos);
+		f->age_pos = frags_by_age.end();
+		}
+
+	if ( frag_memory_limit )
+		EnforceFragmentMemoryLimit(f);
 
-	f->AddFragment(t, ip, pkt);
 	return f;
 	}
 
+void NetSessions::EnforceFragmentMemoryLimit(FragReassembler* current)
+	{
+	auto it = frags_by_age.begin();
+
+	while ( it != frags_by_age.end() &&
+		Reassembler::MemoryAllocation(REASSEM_FRAG) > frag_memory_limit )
+		{
+		FragReassembler* f = *it++;
+
+		if ( f == current )
+			continue;
+
+		++stats.fragment_evictions;
+		stats.fragment_evicted_bytes += f->TotalSize();
+		f->Discard();
+		}
+	}
+
 Connection* NetSessions::FindConnection(zeek::Val* v)
 	{
 	const auto& vt = v->GetType();
@@ -927,7 +1139,7 @@ Connection* NetSessions::FindConnection(zeek::Val* v)
 		return nullptr;
 
 	zeek::RecordType* vr = vt->AsRecordType();
-	auto vl = v->AsRecord();
+	auto rv = v->AsRecordVal();
 
 	int orig_h, orig_p;	// indices into record's value list
 	int resp_h, resp_p;
@@ -955,11 +1167,11 @@ Connection* NetSessions::FindConnection(zeek::Val* v)
 		// types, too.
 		}
 
-	const IPAddr& orig_addr = (*vl)[orig_h]->AsAddr();
-	const IPAddr& resp_addr = (*vl)[resp_h]->AsAddr();
+	const IPAddr& orig_addr = rv->GetField(orig_h)->AsAddr();
+	const IPAddr& resp_addr = rv->GetField(resp_h)->AsAddr();
 
-	zeek::PortVal* orig_portv = (*vl)[orig_p]->AsPortVal();
-	zeek::PortVal* resp_portv = (*vl)[resp_p]->AsPortVal();
+	zeek::PortVal* orig_portv = rv->GetField(orig_p)->AsPortVal();
+	zeek::PortVal* resp_portv = rv->GetField(resp_p)->AsPortVal();
 
 	ConnID id;
 
@@ -988,18 +1200,15 @@ Connection* NetSessions::FindConnection(zeek::Val* v)
 		return nullptr;
 		}
 
-	Connection* conn = nullptr;
-	auto it = d->find(key);
-	if ( it != d->end() )
-		conn = it->second;
-
-	return conn;
+	return d->Lookup(key);
 	}
 
 void NetSessions::Remove(Connection* c)
 	{
 	if ( c->IsKeyValid() )
 		{
+		InvalidateConnCache(c);
+
 		const ConnIDKey& key = c->Key();
 		c->CancelTimers();
 
@@ -1054,6 +1263,12 @@ void NetSessions::Remove(FragReassembler* f)
 	if ( fragments.erase(f->Key()) == 0 )
 		reporter->InternalWarning("fragment reassembler not in dict");
 
+	if ( f->age_pos != frags_by_age.end() )
+		{
+		frags_by_age.erase(f->age_pos);
+		f->age_pos = frags_by_age.end();
+		}
+
 	Unref(f);
 	}
 
@@ -1095,6 +1310,7 @@ void NetSessions::Insert(Connection* c)
 		{
 		// Some clean-ups similar to those in Remove() (but invisible
 		// to the script layer).
+		InvalidateConnCache(old);
 		old->CancelTimers();
 		old->ClearKey();
 		Unref(old);
@@ -1103,23 +1319,20 @@ void NetSessions::Insert(Connection* c)
 
 void NetSessions::Drain()
 	{
-	for ( const auto& entry : tcp_conns )
+	for ( Connection* tc : OrderedConnections(tcp_conns) )
 		{
-		Connection* tc = entry.second;
 		tc->Done();
 		tc->RemovalEvent();
 		}
 
-	for ( const auto& entry : udp_conns )
+	for ( Connection* uc : OrderedConnections(udp_conns) )
 		{
-		Connection* uc = entry.second;
 		uc->Done();
 		uc->RemovalEvent();
 		}
 
-	for ( const auto& entry : icmp_conns )
+	for ( Connection* ic : OrderedConnections(icmp_conns) )
 		{
-		Connection* ic = entry.second;
 		ic->Done();
 		ic->RemovalEvent();
 		}
@@ -1127,12 +1340,9 @@ void NetSessions::Drain()
 
 void NetSessions::Clear()
 	{
-	for ( const auto& entry : tcp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : udp_conns )
-		Unref(entry.second);
-	for ( const auto& entry : icmp_conns )
-		Unref(entry.second);
+	tcp_conns.ForEach([](Connection* c) { Unref(c); });
+	udp_conns.ForEach([](Connection* c) { Unref(c); });
+	icmp_conns.ForEach([](Connection* c) { Unref(c); });
 	for ( const auto& entry : fragments )
 		Unref(entry.second);
 
@@ -1140,6 +1350,10 @@ void NetSessions::Clear()
 	udp_conns.clear();
 	icmp_conns.clear();
 	fragments.clear();
+	frags_by_age.clear();
+
+	for ( auto& entry : conn_cache )
+		entry = ConnCacheEntry();
 	}
 
 void NetSessions::GetStats(SessionStats& s) const
@@ -1157,6 +1371,11 @@ void NetSessions::GetStats(SessionStats& s) const
 	s.max_UDP_conns = stats.max_UDP_conns;
 	s.max_ICMP_conns = stats.max_ICMP_conns;
 	s.max_fragments = stats.max_fragments;
+	s.fragment_evictions = stats.fragment_evictions;
+	s.fragment_evicted_bytes = stats.fragment_evicted_bytes;
+
+	s.conn_cache_hits = stats.conn_cache_hits;
+	s.conn_cache_misses = stats.conn_cache_misses;
 	}
 
 Connection* NetSessions::NewConn(const ConnIDKey& k, double t, const ConnID* id,
@@ -1200,6 +1419,9 @@ Connection* NetSessions::NewConn(const ConnIDKey& k, double t, const ConnID* id,
 	if ( ! WantConnection(src_h, dst_h, tproto, flags, flip) )
 		return nullptr;
 
+	if ( overload_controller && overload_controller->ShedConnection(pkt) )
+		return nullptr;
+
 	Connection* conn = new Connection(this, k, t, id, flow_label, pkt, encapsulation);
 	conn->SetTransport(tproto);
 
@@ -1221,13 +1443,92 @@ Connection* NetSessions::NewConn(const ConnIDKey& k, double t, const ConnID* id,
 
 Connection* NetSessions::LookupConn(const ConnectionMap& conns, const ConnIDKey& key)
 	{
-	auto it = conns.find(key);
-	if ( it != conns.end() )
-		return it->second;
+	return conns.Lookup(key);
+	}
+
+size_t NetSessions::ConnCacheSlot(const IPAddr& addr1, uint32_t port1,
+                                  const IPAddr& addr2, uint32_t port2) const
+	{
+	static_assert((CONN_CACHE_SIZE & (CONN_CACHE_SIZE - 1)) == 0,
+	              "connection cache size must be a power of two");
+
+	auto endpoint_hash = [](const IPAddr& addr, uint32_t port)
+		{
+		const uint32_t* bytes;
+		int n = addr.GetBytes(&bytes);
+		uint32_t h = port;
+
+		for ( int i = 0; i < n; ++i )
+			h = (h ^ bytes[i]) * 0x9e3779b1;
+
+		return h;
+		};
+
+	// Combining the endpoints with xor makes the slot independent of
+	// the packet's direction.
+	uint32_t h = endpoint_hash(addr1, port1) ^ endpoint_hash(addr2, port2);
+	return (h ^ (h >> 16)) & (CONN_CACHE_SIZE - 1);
+	}
+
+Connection* NetSessions::LookupConnCache(const ConnectionMap* conns, const ConnID& id)
+	{
+	const auto& e = conn_cache[ConnCacheSlot(id.src_addr, id.src_port,
+	                                         id.dst_addr, id.dst_port)];
+
+	if ( ! e.conn || e.conns != conns || e.is_one_way != id.is_one_way )
+		return nullptr;
+
+	if ( e.port1 == id.src_port && e.port2 == id.dst_port &&
+	     e.addr1 == id.src_addr && e.addr2 == id.dst_addr )
+		return e.conn;
+
+	// One-way connections are keyed by their direction.
+	if ( ! id.is_one_way &&
+	     e.port1 == id.dst_port && e.port2 == id.src_port &&
+	     e.addr1 == id.dst_addr && e.addr2 == id.src_addr )
+		return e.conn;
 
 	return nullptr;
 	}
 
+void NetSessions::UpdateConnCache(const ConnectionMap* conns, const ConnID& id, Connection* conn)
+	{
+	auto& e = conn_cache[ConnCacheSlot(id.src_addr, id.src_port,
+	                                   id.dst_addr, id.dst_port)];
+
+	if ( e.conn == conn )
+		return;
+
+	e.addr1 = id.src_addr;
+	e.addr2 = id.dst_addr;
+	e.port1 = id.src_port;
+	e.port2 = id.dst_port;
+	e.is_one_way = id.is_one_way;
+	e.conns = conns;
+	e.conn = conn;
+	}
+
+void NetSessions::InvalidateConnCache(const Connection* conn)
+	{
+	auto& e = conn_cache[ConnCacheSlot(conn->OrigAddr(), conn->OrigPort(),
+	                                   conn->RespAddr(), conn->RespPort())];
+
+	if ( e.conn == conn )
+		e = ConnCacheEntry();
+	}
+
+std::vector<Connection*> NetSessions::OrderedConnections(const ConnectionMap& conns) const
+	{
+	std::vector<Connection*> rval;
+	rval.reserve(conns.size());
+	conns.ForEach([&rval](Connection* c) { rval.push_back(c); });
+
+	std::sort(rval.begin(), rval.end(),
+	          [](const Connection* a, const Connection* b) { return a->Key() < b->Key(); });
+
+	return rval;
+	}
+
 bool NetSessions::IsLikelyServerPort(uint32_t port, TransportProto proto) const
 	{
 	// We keep a cached in-core version of the table to speed up the lookup.
@@ -1348,14 +1649,9 @@ unsigned int NetSessions::ConnectionMemoryUsage()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocation();
-
-	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocation();
-
-	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocation();
+	tcp_conns.ForEach([&mem](Connection* c) { mem += c->MemoryAllocation(); });
+	udp_conns.ForEach([&mem](Connection* c) { mem += c->MemoryAllocation(); });
+	icmp_conns.ForEach([&mem](Connection* c) { mem += c->MemoryAllocation(); });
 
 	return mem;
 	}
@@ -1368,14 +1664,9 @@ unsigned int NetSessions::ConnectionMemoryUsageConnVals()
 		// Connections have been flushed already.
 		return 0;
 
-	for ( const auto& entry : tcp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
-
-	for ( const auto& entry : udp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
-
-	for ( const auto& entry : icmp_conns )
-		mem += entry.second->MemoryAllocationConnVal();
+	tcp_conns.ForEach([&mem](Connection* c) { mem += c->MemoryAllocationConnVal(); });
+	udp_conns.ForEach([&mem](Connection* c) { mem += c->MemoryAllocationConnVal(); });
+	icmp_conns.ForEach([&mem](Connection* c) { mem += c->MemoryAllocationConnVal(); });
 
 	return mem;
 	}
@@ -1388,17 +1679,22 @@ unsigned int NetSessions::MemoryAllocation()
 
 	return ConnectionMemoryUsage()
 		+ padded_sizeof(*this)
-		+ (tcp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (udp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (icmp_conns.size() * (sizeof(ConnectionMap::key_type) + sizeof(ConnectionMap::value_type)))
-		+ (fragments.size() * (sizeof(FragmentMap::key_type) + sizeof(FragmentMap::value_type)))
+		+ tcp_conns.MemoryAllocation()
+		+ udp_conns.MemoryAllocation()
+		+ icmp_conns.MemoryAllocation()
+		+ fragments.MemoryAllocation()
 		// FIXME: MemoryAllocation() not implemented for rest.
 		;
 	}
 
 void NetSessions::InsertConnection(ConnectionMap* m, const ConnIDKey& key, Connection* conn)
 	{
-	(*m)[key] = conn;
+	InsertConnection(m, key, m->Hash(key), conn);
+	}
+
+void NetSessions::InsertConnection(ConnectionMap* m, const ConnIDKey& key, hash_t hash, Connection* conn)
+	{
+	m->insert_or_assign(key, conn, hash);
 
 	switch ( conn->ConnTransport() )
 		{
@@ -3,12 +3,14 @@
 #pragma once
 
 #include "Frag.h"
+#include "FlatHashMap.h"
 #include "PacketFilter.h"
 #include "NetVar.h"
 #include "analyzer/protocol/tcp/Stats.h"
 
 #include <map>
 #include <utility>
+#include <vector>
 
 #include <sys/types.h> // for u_char
 
@@ -40,7 +42,61 @@ struct SessionStats {
 
 	size_t num_fragments;
 	size_t max_fragments;
+	uint64_t fragment_evictions;
+	uint64_t fragment_evicted_bytes;
 	uint64_t num_packets;
+
+	uint64_t conn_cache_hits;
+	uint64_t conn_cache_misses;
+};
+
+// Checks connections for inactivity in batches. Instead of each connection
+// having its own inactivity timer, which an active connection would keep
+// re-arming, connections wait in intrusive lists by the time slice that
+// their inactivity timeout falls into. A single timer checks them once
+// their slice has passed, so timeouts fire up to one slice late. Pushing
+// back a connection's timeout just relinks it; nothing gets allocated or
+// goes through the timer manager's queue.
+class InactivityScanner {
+public:
+	InactivityScanner();
+	~InactivityScanner();
+
+	// Returns true if inactivity_check_interval asks for batched checks.
+	// Otherwise, connections keep using their own timers.
+	bool Enabled() const	{ return interval > 0; }
+
+	// Arranges for the connection's inactivity to get checked at time t,
+	// or up to one slice later. Replaces any earlier check.
+	void Add(Connection* c, double t);
+
+	// Cancels the connection's pending check, if any.
+	void Remove(Connection* c);
+
+	size_t Size() const	{ return size; }
+
+private:
+	friend class InactivityScanTimer;
+
+	// Slices map onto the slots modulo this, so a slot can hold
+	// connections of later slices, which scans skip.
+	static constexpr int64_t NUM_SLOTS = 1024;
+
+	// Checks the connections of all slices that have passed by time t,
+	// including the given one.
+	void Scan(double t, int64_t slice);
+
+	// Makes sure there's a scan for the given slice or earlier.
+	void Schedule(int64_t slice);
+
+	std::vector<Connection*> slots;	// list heads
+	std::vector<Connection*> due;	// scratch for Scan()
+	double interval;
+	int64_t next_slice;	// first slice not scanned yet
+	size_t size;
+
+	Timer* timer;	// the pending scan, if any
+	int64_t timer_slice;
 };
 
 class NetSessions {
@@ -68,6 +124,8 @@ public:
 
 	void Insert(Connection* c);
 
+	InactivityScanner* GetInactivityScanner()	{ return &inactivity_scanner; }
+
 	// Generating connection_pending events for all connections
 	// that are still active.
 	void Drain();
@@ -172,8 +230,84 @@ protected:
 	friend class ConnCompressor;
 	friend class IPTunnelTimer;
 
-	using ConnectionMap = std::map<ConnIDKey, Connection*>;
-	using FragmentMap = std::map<FragReassemblerKey, FragReassembler*>;
+	struct ConnIDKeyHash {
+		hash_t operator()(const ConnIDKey& k) const
+			{ return KeyedHash::Hash64(&k, sizeof(k)); }
+	};
+
+	struct ConnIDKey4Hash {
+		hash_t operator()(const ConnIDKey4& k) const
+			{ return KeyedHash::Hash64(&k, sizeof(k)); }
+	};
+
+	// Maps connection keys to connections. Connections between IPv4
+	// addresses are kept in a map of their own under the packed
+	// ConnIDKey4, which saves memory and speeds up hashing and comparing
+	// their keys.
+	class ConnectionMap {
+	public:
+		hash_t Hash(const ConnIDKey& key) const
+			{ return key.IsIPv4() ? v4.Hash(key.PackIPv4()) : v6.Hash(key); }
+
+		// Returns the connection stored under the key, or nullptr. A
+		// given hash must have come from Hash().
+		Connection* Lookup(const ConnIDKey& key) const
+			{ return Lookup(key, Hash(key)); }
+
+		Connection* Lookup(const ConnIDKey& key, hash_t h) const
+			{
+			if ( key.IsIPv4() )
+				return Find(v4, key.PackIPv4(), h);
+
+			return Find(v6, key, h);
+			}
+
+		void insert_or_assign(const ConnIDKey& key, Connection* conn, hash_t h)
+			{
+			if ( key.IsIPv4() )
+				v4.insert_or_assign(key.PackIPv4(), conn, h);
+			else
+				v6.insert_or_assign(key, conn, h);
+			}
+
+		size_t erase(const ConnIDKey& key)
+			{ return key.IsIPv4() ? v4.erase(key.PackIPv4()) : v6.erase(key); }
+
+		void clear()
+			{
+			v4.clear();
+			v6.clear();
+			}
+
+		size_t size() const	{ return v4.size() + v6.size(); }
+
+		size_t MemoryAllocation() const
+			{ return v4.MemoryAllocation() + v6.MemoryAllocation(); }
+
+		// Calls f with each connection, in unspecified order.
+		template <typename F>
+		void ForEach(F f) const
+			{
+			for ( const auto& entry : v4 )
+				f(entry.second);
+
+			for ( const auto& entry : v6 )
+				f(entry.second);
+			}
+
+	private:
+		template <typename Map, typename Key>
+		static Connection* Find(const Map& m, const Key& key, hash_t h)
+			{
+			auto it = m.find(key, h);
+			return it != m.end() ? it->second : nullptr;
+			}
+
+		zeek::detail::FlatHashMap<ConnIDKey4, Connection*, ConnIDKey4Hash> v4;
+		zeek::detail::FlatHashMap<ConnIDKey, Connection*, ConnIDKeyHash> v6;
+	};
+
+	using FragmentMap = zeek::detail::FlatHashMap<FragReassemblerKey, FragReassembler*, FragReassemblerKeyHash>;
 
 	Connection* NewConn(const ConnIDKey& k, double t, const ConnID* id,
 			const u_char* data, int proto, uint32_t flow_label,
@@ -181,6 +315,26 @@ protected:
 
 	Connection* LookupConn(const ConnectionMap& conns, const ConnIDKey& key);
 
+	// Returns the connections of a map ordered by their keys. We use this
+	// wherever the order of processing is visible to scripts, so that the
+	// order does not depend on the map's hash function.
+	std::vector<Connection*> OrderedConnections(const ConnectionMap& conns) const;
+
+	// Returns the recently seen connection with the given ID from the
+	// connection cache, or nullptr if the cache doesn't have it.
+	Connection* LookupConnCache(const ConnectionMap* conns, const ConnID& id);
+
+	// Records the connection with the given ID in the connection cache.
+	void UpdateConnCache(const ConnectionMap* conns, const ConnID& id, Connection* conn);
+
+	// Removes a connection from the connection cache, if present.
+	void InvalidateConnCache(const Connection* conn);
+
+	// Returns the connection cache slot for a pair of endpoints. The slot
+	// does not depend on the order of the endpoints.
+	size_t ConnCacheSlot(const IPAddr& addr1, uint32_t port1,
+	                     const IPAddr& addr2, uint32_t port2) const;
+
 	// Returns true if the port corresonds to an application
 	// for which there's a Bro analyzer (even if it might not
 	// be used by the present policy script), or it's more
@@ -216,19 +370,60 @@ protected:
 	// cases should likely check that the key is not already in the map to
 	// avoid unnecessary incrementing of connecting counts).
 	void InsertConnection(ConnectionMap* m, const ConnIDKey& key, Connection* conn);
+	void InsertConnection(ConnectionMap* m, const ConnIDKey& key, hash_t hash, Connection* conn);
 
 	ConnectionMap tcp_conns;
 	ConnectionMap udp_conns;
 	ConnectionMap icmp_conns;
 	FragmentMap fragments;
 
+	// Reassemblers that may still get evicted to stay within
+	// frag_memory_limit, oldest first.  Ones that have reassembled their
+	// datagram are done and don't get evicted anymore.
+	std::list<FragReassembler*> frags_by_age;
+
+	// Discards the oldest reassemblers other than the current one while
+	// the buffered fragments exceed frag_memory_limit.
+	void EnforceFragmentMemoryLimit(FragReassembler* current);
+
+	// Consecutive packets often belong to the same connection, so we
+	// keep a small direct-mapped cache of recently seen connections in
+	// front of the connection maps. A hit saves building the ConnIDKey
+	// and hashing it. Entries get invalidated when their connection is
+	// removed from the maps.
+	struct ConnCacheEntry {
+		IPAddr addr1;
+		IPAddr addr2;
+		uint32_t port1 = 0;
+		uint32_t port2 = 0;
+		bool is_one_way = false;
+		const ConnectionMap* conns = nullptr;
+		Connection* conn = nullptr;
+	};
+
+	static constexpr size_t CONN_CACHE_SIZE = 256;
+	ConnCacheEntry conn_cache[CONN_CACHE_SIZE];
+
 	SessionStats stats;
 
 	using IPPair = std::pair<IPAddr, IPAddr>;
 	using TunnelActivity = std::pair<EncapsulatingConn, double>;
-	using IPTunnelMap = std::map<IPPair, TunnelActivity>;
+
+	struct IPPairHash {
+		hash_t operator()(const IPPair& p) const
+			{
+			uint32_t buf[8];
+			p.first.CopyIPv6(&buf[0]);
+			p.second.CopyIPv6(&buf[4]);
+			return KeyedHash::Hash64(buf, sizeof(buf));
+			}
+	};
+
+	using IPTunnelMap = zeek::detail::FlatHashMap<IPPair, TunnelActivity, IPPairHash>;
 	IPTunnelMap ip_tunnels;
 
+	InactivityScanner inactivity_scanner;
+
 	analyzer::arp::ARP_Analyzer* arp_analyzer;
 
 	analyzer::stepping_stone::SteppingStoneManager* stp_manager;
@@ -210,7 +210,14 @@ struct SWNode {
 class SWNodeMatrix {
 public:
 	SWNodeMatrix(const zeek::String* s1, const zeek::String* s2)
-	: _s1(s1), _s2(s2), _rows(s1->Len() + 1), _cols(s2->Len() + 1)
+	: SWNodeMatrix(s1, s2, s1->Len() + 1, s2->Len() + 1)
+		{
+		}
+
+	// A matrix covering only the first rows - 1 bytes of s1 and
+	// cols - 1 bytes of s2.
+	SWNodeMatrix(const zeek::String* s1, const zeek::String* s2, int rows, int cols)
+	: _s1(s1), _s2(s2), _rows(rows), _cols(cols)
 		{
 		_nodes = new SWNode[_cols * _rows];
 		memset(_nodes, 0, sizeof(SWNode) * _cols * _rows);
@@ -396,6 +403,61 @@ end_loop:
 		}
 	}
 
+// Computes just the scores of the Smith-Waterman matrix, keeping only two
+// rows of it at a time, and locates the first cell in row-major order that
+// has the highest score above one.  Returns that score, or zero if there's
+// no such cell.
+// @string1, @len1: the string along the rows.
+// @string2, @len2: the string along the columns.
+// @row, @col: the cell's coordinates on return.
+//
+static int sw_max_score(const u_char* string1, int len1,
+			const u_char* string2, int len2, int& row, int& col)
+	{
+	std::vector<int> score_prev(len2 + 1), score_cur(len2 + 1);
+	std::vector<u_char> match_prev(len2 + 1), match_cur(len2 + 1);
+	int matrix_max = 1;
+	int max_score = 0;
+
+	for ( int i = 1; i <= len1; ++i )
+		{
+		u_char c = string1[i-1];
+
+		// Scores from the row above, in a loop without
+		// dependencies between columns so that it vectorizes.
+		for ( int j = 1; j <= len2; ++j )
+			{
+			int score_tl = score_prev[j-1];
+			int score_match = score_tl + 1 + 99 * match_prev[j-1];
+			int score_gap = std::max(score_prev[j], score_tl);
+			u_char match = (string2[j-1] == c);
+
+			match_cur[j] = match;
+			score_cur[j] = match ? score_match : score_gap;
+			}
+
+		// Gaps also take the score from the left, which is what
+		// remains sequential.
+		for ( int j = 1; j <= len2; ++j )
+			{
+			if ( ! match_cur[j] && score_cur[j-1] > score_cur[j] )
+				score_cur[j] = score_cur[j-1];
+
+			if ( score_cur[j] > matrix_max )
+				{
+				matrix_max = max_score = score_cur[j];
+				row = i;
+				col = j;
+				}
+			}
+
+		std::swap(score_prev, score_cur);
+		std::swap(match_prev, match_cur);
+		}
+
+	return max_score;
+	}
+
 // The main Smith-Waterman algorithm.
 //
 BroSubstring::Vec* smith_waterman(const zeek::String* s1, const zeek::String* s2,
@@ -418,7 +480,24 @@ BroSubstring::Vec* smith_waterman(const zeek::String* s1, const zeek::String* s2
 	zeek::byte_vec string1 = s1->Bytes();
 	zeek::byte_vec string2 = s2->Bytes();
 
-	SWNodeMatrix matrix(s1, s2);	// dynamic programming matrix.
+	// A single alignment ends at the cell with the highest score, and
+	// backtracking from there never leaves the part of the matrix above
+	// and left of it. We locate that cell in linear memory first, and
+	// then only build that part of the full matrix.
+	//
+	if ( params._sw_variant != SW_MULTIPLE )
+		{
+		if ( ! sw_max_score(string1, len1 - 1, string2, len2 - 1, row, col) )
+			return result;
+		}
+	else
+		{
+		row = len1 - 1;
+		col = len2 - 1;
+		}
+
+	// Dynamic programming matrix.
+	SWNodeMatrix matrix(s1, s2, row + 1, col + 1);
 	SWNode* node_max = nullptr;	// pointer to the best score's node
 	SWNode* node_br_max = nullptr;	// pointer to lowest-right matching node
 
@@ -439,15 +518,15 @@ BroSubstring::Vec* smith_waterman(const zeek::String* s1, const zeek::String* s2
 
 	int counter = 1;
 
-	for ( i = 1; i < len1; ++i )
-		for ( j = 1; j < len2; ++j )
+	for ( i = 1; i <= row; ++i )
+		for ( j = 1; j <= col; ++j )
 			matrix(i, j)->id = counter++;
 
 	// Subsequence calculation --------------------------------------------
 
-	for ( i = 1; i < len1; ++i )
+	for ( i = 1; i <= row; ++i )
 		{
-		for ( j = 1; j < len2; ++j )
+		for ( j = 1; j <= col; ++j )
 			{
 			// Current node, top/left neighbours.
 			//
@@ -1,4 +1,5 @@
 #include "Stats.h"
+#include "Metrics.h"
 #include "RuleMatcher.h"
 #include "Conn.h"
 #include "File.h"
@@ -14,6 +15,21 @@
 #include "broker/Manager.h"
 #include "input.h"
 #include "Func.h"
+#include "Frame.h"
+#include "Stmt.h"
+#include "analyzer/Analyzer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" {
+#include "setsignal.h"
+}
 
 uint64_t killed_by_inactivity = 0;
 
@@ -194,7 +210,8 @@ void ProfileLogger::Log()
 	zeek::detail::trigger::Manager::Stats tstats;
 	trigger_mgr->GetStats(&tstats);
 
-	file->Write(fmt("%.06f Triggers: total=%lu pending=%lu\n", network_time, tstats.total, tstats.pending));
+	file->Write(fmt("%.06f Triggers: total=%lu pending=%lu evaluations=%lu\n", network_time,
+	                tstats.total, tstats.pending, tstats.evaluations));
 
 	unsigned int* current_timers = TimerMgr::CurrentTimers();
 	for ( int i = 0; i < NUM_TIMER_TYPES; ++i )
@@ -214,13 +231,15 @@ void ProfileLogger::Log()
 		threading::MsgThread::Stats s = i->second;
 		file->Write(fmt("%0.6f   %-25s in=%" PRIu64 " out=%" PRIu64 " pending=%" PRIu64 "/%" PRIu64
 				" (#queue r/w: in=%" PRIu64 "/%" PRIu64 " out=%" PRIu64 "/%" PRIu64 ")"
+				" (#spilled: in=%" PRIu64 " out=%" PRIu64 ")"
 			        "\n",
 			    network_time,
 			    i->first.c_str(),
 			    s.sent_in, s.sent_out,
 			    s.pending_in, s.pending_out,
 			    s.queue_in_stats.num_reads, s.queue_in_stats.num_writes,
-			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes
+			    s.queue_out_stats.num_reads, s.queue_out_stats.num_writes,
+			    s.queue_in_stats.num_spilled, s.queue_out_stats.num_spilled
 			    ));
 		}
 
@@ -272,7 +291,7 @@ void ProfileLogger::Log()
 
 				if ( v->GetType()->Tag() == zeek::TYPE_TABLE )
 					{
-					entries = v->AsTable()->Length();
+					entries = v->AsTableVal()->Size();
 					total_table_entries += entries;
 
 					// ### 100 shouldn't be hardwired
@@ -376,6 +395,551 @@ void SampleLogger::SegmentProfile(const char* /* name */,
 		);
 	}
 
+class EventProfileTimer final : public Timer {
+public:
+	EventProfileTimer(double t, EventProfiler* p, double i)
+	: Timer(t, TIMER_PROFILE), profiler(p), interval(i)
+		{
+		}
+
+	void Dispatch(double t, bool is_expire) override
+		{
+		profiler->Log();
+
+		// Reinstall timer.
+		if ( ! is_expire )
+			timer_mgr->Add(new EventProfileTimer(network_time + interval,
+			                                     profiler, interval));
+		}
+
+protected:
+	EventProfiler* profiler;
+	double interval;
+};
+
+static double clock_seconds(clockid_t clock)
+	{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+	}
+
+EventProfiler::EventProfiler(BroFile* arg_file, double interval)
+	{
+	file = arg_file;
+	current = &root;
+	timer_mgr->Add(new EventProfileTimer(1, this, interval));
+	}
+
+EventProfiler::~EventProfiler()
+	{
+	file->Close();
+	}
+
+void EventProfiler::Enter(const void* key, const char* name,
+                          const zeek::detail::Location* loc)
+	{
+	auto& child = current->children[key];
+
+	if ( ! child )
+		{
+		child = std::make_unique<Node>();
+		child->parent = current;
+		child->name = name ? name : "<unknown>";
+
+		if ( loc && loc->filename )
+			child->name += fmt("@%s:%d", loc->filename, loc->first_line);
+
+		// Semicolons separate frames in the folded output.
+		std::replace(child->name.begin(), child->name.end(), ';', ',');
+		}
+
+	current = child.get();
+	frames.push_back({current, clock_seconds(CLOCK_MONOTONIC),
+	                  clock_seconds(CLOCK_THREAD_CPUTIME_ID),
+	                  zeek::Val::NumAllocations()});
+	}
+
+void EventProfiler::Leave()
+	{
+	assert(! frames.empty());
+	const Frame& fr = frames.back();
+	Node* node = fr.node;
+
+	++node->calls;
+	node->wall += clock_seconds(CLOCK_MONOTONIC) - fr.wall_start;
+	node->cpu += clock_seconds(CLOCK_THREAD_CPUTIME_ID) - fr.cpu_start;
+	node->vals += zeek::Val::NumAllocations() - fr.vals_start;
+
+	current = node->parent;
+	frames.pop_back();
+	}
+
+void EventProfiler::Log()
+	{
+	file->Write(fmt("%.06f ------------------------\n", network_time));
+
+	// Top-level entries are mostly event handlers, their children the
+	// handlers' bodies.
+	LogNode(&root, 0, 2);
+	}
+
+void EventProfiler::LogNode(const Node* node, int depth, int max_depth)
+	{
+	if ( depth > 0 )
+		file->Write(fmt("%.06f %*s%s calls=%" PRIu64 " wall=%.6f cpu=%.6f vals=%" PRIu64 "\n",
+		                network_time, (depth - 1) * 2, "", node->name.c_str(),
+		                node->calls, node->wall, node->cpu, node->vals));
+
+	if ( depth == max_depth )
+		return;
+
+	std::vector<const Node*> sorted;
+	sorted.reserve(node->children.size());
+
+	for ( const auto& c : node->children )
+		sorted.push_back(c.second.get());
+
+	std::sort(sorted.begin(), sorted.end(),
+	          [](const Node* a, const Node* b) { return a->cpu > b->cpu; });
+
+	for ( auto c : sorted )
+		LogNode(c, depth + 1, max_depth);
+	}
+
+bool EventProfiler::WriteFoldedStacks(const char* path) const
+	{
+	FILE* f = fopen(path, "w");
+
+	if ( ! f )
+		return false;
+
+	std::string stack;
+	WriteFolded(f, &root, stack);
+	fclose(f);
+	return true;
+	}
+
+void EventProfiler::WriteFolded(FILE* f, const Node* node, std::string& stack) const
+	{
+	auto len = stack.size();
+
+	if ( node != &root )
+		{
+		if ( ! stack.empty() )
+			stack += ';';
+
+		stack += node->name;
+
+		// Attribute to the frame only the time not spent in its
+		// callees.
+		double self = node->cpu;
+
+		for ( const auto& c : node->children )
+			self -= c.second->cpu;
+
+		auto usecs = static_cast<uint64_t>(std::max(0.0, self) * 1e6);
+
+		if ( usecs > 0 )
+			fprintf(f, "%s %" PRIu64 "\n", stack.c_str(), usecs);
+		}
+
+	for ( const auto& c : node->children )
+		WriteFolded(f, c.second.get(), stack);
+
+	stack.resize(len);
+	}
+
+AnalyzerProfiler::AnalyzerProfiler(int arg_max_conns)
+	{
+	max_conns = std::max(arg_max_conns, 0);
+	}
+
+void AnalyzerProfiler::Enter(const analyzer::Analyzer* a, int len)
+	{
+	auto& at = analyzers[a->GetAnalyzerTag()];
+	Totals* ct = a->Conn() ? &conns[a->Conn()] : nullptr;
+
+	++at.calls;
+	at.bytes += len;
+
+	// The connection's bytes are only counted at the outermost frame,
+	// as its analyzers pass the same data on to each other.
+	if ( ct && frames.empty() )
+		{
+		++ct->calls;
+		ct->bytes += len;
+		}
+
+	frames.push_back({&at, ct, clock_seconds(CLOCK_THREAD_CPUTIME_ID),
+	                  zeek::Val::NumAllocations(), 0, 0});
+	}
+
+void AnalyzerProfiler::Leave()
+	{
+	assert(! frames.empty());
+	const Frame& fr = frames.back();
+
+	double cpu = clock_seconds(CLOCK_THREAD_CPUTIME_ID) - fr.cpu_start;
+	uint64_t vals = zeek::Val::NumAllocations() - fr.vals_start;
+
+	fr.analyzer->cpu += std::max(0.0, cpu - fr.child_cpu);
+	fr.analyzer->vals += vals - std::min(vals, fr.child_vals);
+
+	if ( fr.conn && frames.size() == 1 )
+		{
+		fr.conn->cpu += cpu;
+		fr.conn->vals += vals;
+		}
+
+	frames.pop_back();
+
+	if ( ! frames.empty() )
+		{
+		frames.back().child_cpu += cpu;
+		frames.back().child_vals += vals;
+		}
+	}
+
+void AnalyzerProfiler::ConnectionDone(const Connection* c)
+	{
+	auto it = conns.find(c);
+
+	if ( it == conns.end() )
+		return;
+
+	// Don't leave frames pointing to the totals, should the connection
+	// go away while its analyzers are still running.
+	for ( auto& fr : frames )
+		if ( fr.conn == &it->second )
+			fr.conn = nullptr;
+
+	auto greater_cpu = [](const HeavyConnection& a, const HeavyConnection& b)
+		{ return a.totals.cpu > b.totals.cpu; };
+
+	const Totals& t = it->second;
+
+	if ( max_conns > 0 &&
+	     (heaviest.size() < max_conns || t.cpu > heaviest.front().totals.cpu) )
+		{
+		if ( heaviest.size() == max_conns )
+			{
+			std::pop_heap(heaviest.begin(), heaviest.end(), greater_cpu);
+			heaviest.pop_back();
+			}
+
+		heaviest.push_back({t, c->GetUID().Base62("C"),
+		                    c->OrigAddr(), ntohs(c->OrigPort()),
+		                    c->RespAddr(), ntohs(c->RespPort()),
+		                    c->ConnTransport(), c->MemoryAllocation()});
+		std::push_heap(heaviest.begin(), heaviest.end(), greater_cpu);
+		}
+
+	conns.erase(it);
+	}
+
+std::vector<AnalyzerProfiler::HeavyConnection> AnalyzerProfiler::TakeHeaviestConnections()
+	{
+	std::vector<HeavyConnection> rval;
+	rval.swap(heaviest);
+
+	std::sort(rval.begin(), rval.end(),
+	          [](const HeavyConnection& a, const HeavyConnection& b)
+	          { return a.totals.cpu > b.totals.cpu; });
+
+	return rval;
+	}
+
+void PacketLatencyProfiler::Histogram::Record(double secs)
+	{
+	int bucket = 0;
+	double us = secs * 1e6;
+
+	if ( us >= 1 )
+		{
+		// us = m * 2^exp with m in [0.5, 1).
+		int exp;
+		double m = frexp(us, &exp);
+		int octave = exp - 1;
+
+		if ( octave >= OCTAVES )
+			bucket = NUM_BUCKETS - 1;
+		else
+			bucket = 1 + octave * SUB_BUCKETS +
+			         static_cast<int>((m * 2 - 1) * SUB_BUCKETS);
+		}
+
+	++buckets[bucket];
+	++count;
+
+	if ( secs > 0 )
+		sum += secs;
+
+	if ( secs > max )
+		max = secs;
+	}
+
+double PacketLatencyProfiler::Histogram::Percentile(double p) const
+	{
+	if ( count == 0 )
+		return 0;
+
+	auto rank = static_cast<uint64_t>(std::ceil(p * count));
+	uint64_t seen = 0;
+
+	for ( int i = 0; i < NUM_BUCKETS; ++i )
+		{
+		seen += buckets[i];
+
+		if ( seen >= rank && seen > 0 )
+			return std::min(BucketUpperBound(i), max);
+		}
+
+	return max;
+	}
+
+const char* PacketLatencyProfiler::StageName(int stage)
+	{
+	static const char* names[] = { "timers", "sessions", "events", "total", "lag" };
+	return names[stage];
+	}
+
+double PacketLatencyProfiler::BucketUpperBound(int bucket)
+	{
+	if ( bucket >= NUM_BUCKETS - 1 )
+		return std::numeric_limits<double>::infinity();
+
+	if ( bucket == 0 )
+		return 1e-6;
+
+	int octave = (bucket - 1) / SUB_BUCKETS;
+	int sub = (bucket - 1) % SUB_BUCKETS;
+
+	return ldexp(1 + double(sub + 1) / SUB_BUCKETS, octave) / 1e6;
+	}
+
+double PacketLatencyProfiler::Now()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+std::vector<PacketLatencyProfiler::Histogram> PacketLatencyProfiler::TakeInterval()
+	{
+	std::vector<Histogram> rval(interval, interval + NUM_STAGES);
+
+	for ( auto& h : interval )
+		h = Histogram();
+
+	return rval;
+	}
+
+void PacketLatencyProfiler::RegisterMetrics(zeek::detail::MetricsRegistry* r) const
+	{
+	for ( int i = 0; i < NUM_STAGES; ++i )
+		{
+		// Metrics get one bucket per power of two, which keeps their
+		// number of series down.
+		auto sampler = [h = &totals[i]]
+			{
+			zeek::detail::MetricsRegistry::Histogram rval;
+			rval.counts.push_back(h->buckets[0]);
+			rval.upper_bounds.push_back(BucketUpperBound(0));
+
+			for ( int octave = 0; octave < OCTAVES; ++octave )
+				{
+				uint64_t n = 0;
+
+				for ( int sub = 0; sub < SUB_BUCKETS; ++sub )
+					n += h->buckets[1 + octave * SUB_BUCKETS + sub];
+
+				rval.counts.push_back(n);
+
+				if ( octave < OCTAVES - 1 )
+					rval.upper_bounds.push_back(ldexp(1, octave + 1) / 1e6);
+				}
+
+			rval.counts.back() += h->buckets[NUM_BUCKETS - 1];
+			rval.sum = h->sum;
+			return rval;
+			};
+
+		if ( i == LAG )
+			r->AddHistogram("zeek_packet_lag_seconds",
+			                "How long after their capture live packets got processed.",
+			                "", std::move(sampler));
+		else
+			r->AddHistogram("zeek_packet_processing_seconds",
+			                "How long the stages of processing packets took.",
+			                fmt("stage=\"%s\"", StageName(i)), std::move(sampler));
+		}
+	}
+
+class ScriptSampleTimer final : public Timer {
+public:
+	ScriptSampleTimer(double t, ScriptSampler* s, double i)
+	: Timer(t, TIMER_PROFILE), sampler(s), interval(i)
+		{
+		}
+
+	void Dispatch(double t, bool is_expire) override
+		{
+		if ( ! sampler->WriteFoldedStacks() )
+			reporter->Error("failed to write script samples to %s",
+			                sampler->Path().c_str());
+
+		// Reinstall timer.
+		if ( ! is_expire )
+			timer_mgr->Add(new ScriptSampleTimer(network_time + interval,
+			                                     sampler, interval));
+		}
+
+protected:
+	ScriptSampler* sampler;
+	double interval;
+};
+
+volatile sig_atomic_t ScriptSampler::pending = 0;
+const std::string ScriptSampler::core_stack = "<core>";
+
+ScriptSampler* ScriptSampler::Create(unsigned int frequency, const std::string& path,
+                                     double write_interval)
+	{
+	auto s = new ScriptSampler();
+	s->path = path;
+
+	long nsecs = 1000000000L / std::max(std::min(frequency, 1000000000U), 1U);
+
+	setsignal(SIGPROF, Tick);
+
+	// Linux can measure the CPU time of the main thread alone. Elsewhere,
+	// the time of the logging and input threads counts as well.
+#ifdef __linux__
+	struct sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_SIGNAL;
+	sev.sigev_signo = SIGPROF;
+
+	if ( timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &s->timer) < 0 )
+		{
+		reporter->Error("can't create script sampling timer: %s", strerror(errno));
+		setsignal(SIGPROF, SIG_DFL);
+		s->path.clear();
+		delete s;
+		return nullptr;
+		}
+
+	struct itimerspec its;
+	its.it_value.tv_sec = nsecs / 1000000000L;
+	its.it_value.tv_nsec = nsecs % 1000000000L;
+	its.it_interval = its.it_value;
+
+	timer_settime(s->timer, 0, &its, nullptr);
+#else
+	struct itimerval itv;
+	itv.it_value.tv_sec = nsecs / 1000000000L;
+	itv.it_value.tv_usec = std::max((nsecs % 1000000000L) / 1000, 1L);
+	itv.it_interval = itv.it_value;
+
+	if ( setitimer(ITIMER_PROF, &itv, nullptr) < 0 )
+		{
+		reporter->Error("can't set script sampling timer: %s", strerror(errno));
+		setsignal(SIGPROF, SIG_DFL);
+		s->path.clear();
+		delete s;
+		return nullptr;
+		}
+#endif
+
+	if ( write_interval > 0 )
+		timer_mgr->Add(new ScriptSampleTimer(network_time + write_interval,
+		                                     s, write_interval));
+
+	return s;
+	}
+
+ScriptSampler::~ScriptSampler()
+	{
+	// An empty path means the timer never got set up.
+	if ( path.empty() )
+		return;
+
+#ifdef __linux__
+	timer_delete(timer);
+#else
+	struct itimerval itv;
+	memset(&itv, 0, sizeof(itv));
+	setitimer(ITIMER_PROF, &itv, nullptr);
+#endif
+
+	setsignal(SIGPROF, SIG_IGN);
+	}
+
+RETSIGTYPE ScriptSampler::Tick(int /* signo */)
+	{
+	pending = pending + 1;
+	return RETSIGVAL;
+	}
+
+void ScriptSampler::Sample()
+	{
+	current.clear();
+
+	for ( const auto* f : g_frame_stack )
+		{
+		const auto* func = f->GetFunction();
+		std::string frame = func ? func->Name() : "<global>";
+
+		if ( const auto* stmt = f->GetNextStmt() )
+			{
+			const auto* loc = stmt->GetLocationInfo();
+
+			if ( loc && loc->filename )
+				frame += fmt("@%s:%d", loc->filename, loc->first_line);
+			}
+
+		// Semicolons separate frames in the folded output.
+		std::replace(frame.begin(), frame.end(), ';', ',');
+
+		if ( ! current.empty() )
+			current += ';';
+
+		current += frame;
+		}
+
+	AddSamples(current.empty() ? core_stack : current);
+	}
+
+void ScriptSampler::AddSamples(const std::string& stack)
+	{
+	// A tick arriving in between gets lost, which doesn't skew the
+	// distribution of the samples.
+	uint64_t n = pending;
+	pending = 0;
+	stacks[stack] += n;
+	}
+
+bool ScriptSampler::WriteFoldedStacks() const
+	{
+	std::string tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		return false;
+
+	for ( const auto& s : stacks )
+		fprintf(f, "%s %" PRIu64 "\n", s.first.c_str(), s.second);
+
+	if ( fclose(f) != 0 )
+		{
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return rename(tmp.c_str(), path.c_str()) == 0;
+	}
+
 void SegmentProfiler::Init()
 	{
 	getrusage(RUSAGE_SELF, &initial_rusage);
@@ -7,13 +7,29 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <signal.h>
 #include <stdint.h>
+#include <time.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "IPAddr.h"
+#include "net_util.h"
+#include "analyzer/Tag.h"
 
 class BroFile;
+class Connection;
+
+namespace analyzer { class Analyzer; }
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(TableVal, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Location, zeek::detail);
+ZEEK_FORWARD_DECLARE_NAMESPACED(MetricsRegistry, zeek::detail);
 
 // Object called by SegmentProfiler when it is done and reports its
 // cumulative CPU/memory statistics.
@@ -105,9 +121,287 @@ protected:
 };
 
 
+// Tracks call counts, wall-clock time, CPU time and Val allocations per
+// event handler and per script body, along the full script call stack.
+// Totals get written to a file in regular intervals, and the call tree can
+// be dumped in the "folded stacks" format that flame graph tools read.
+class EventProfiler {
+public:
+	EventProfiler(BroFile* file, double interval);
+	~EventProfiler();
+
+	// Called when entering and leaving a handler or function body. The
+	// key identifies the callee; name and location are only used the
+	// first time a key is seen at a given position of the call stack.
+	void Enter(const void* key, const char* name,
+	           const zeek::detail::Location* loc = nullptr);
+	void Leave();
+
+	// Writes the current per-handler totals to the log file.
+	void Log();
+
+	// Writes the call tree in folded stacks format, weighted by CPU
+	// time in microseconds. Returns false if the file can't be written.
+	bool WriteFoldedStacks(const char* path) const;
+
+private:
+	struct Node {
+		std::string name;
+		Node* parent = nullptr;
+		std::unordered_map<const void*, std::unique_ptr<Node>> children;
+		uint64_t calls = 0;
+		double wall = 0;
+		double cpu = 0;
+		uint64_t vals = 0;
+	};
+
+	struct Frame {
+		Node* node;
+		double wall_start;
+		double cpu_start;
+		uint64_t vals_start;
+	};
+
+	void LogNode(const Node* node, int depth, int max_depth);
+	void WriteFolded(FILE* f, const Node* node, std::string& stack) const;
+
+	BroFile* file;
+	Node root;
+	Node* current;
+	std::vector<Frame> frames;
+};
+
+// Reports a handler or function body to an EventProfiler across its
+// lifetime, if profiling is enabled.
+class EventProfileScope {
+public:
+	EventProfileScope(EventProfiler* arg_profiler, const void* key,
+	                  const char* name, const zeek::detail::Location* loc = nullptr)
+	    : profiler(arg_profiler)
+		{
+		if ( profiler )
+			profiler->Enter(key, name, loc);
+		}
+
+	~EventProfileScope()
+		{
+		if ( profiler )
+			profiler->Leave();
+		}
+
+private:
+	EventProfiler* profiler;
+};
+
+
+// Attributes the work of protocol analyzers to analyzer types and to
+// connections. Every delivery of data to an analyzer is a frame that
+// counts the thread CPU time and the Val allocations spent in the
+// analyzer itself, not counting those of the child analyzers it forwards
+// to. Connections add up the costs of all their analyzers, and the
+// heaviest ones get kept when they're done.
+class AnalyzerProfiler {
+public:
+	struct Totals {
+		uint64_t calls = 0;
+		uint64_t bytes = 0;
+		double cpu = 0;
+		uint64_t vals = 0;
+	};
+
+	struct HeavyConnection {
+		Totals totals;
+		std::string uid;
+		IPAddr orig_addr;
+		uint32_t orig_port;
+		IPAddr resp_addr;
+		uint32_t resp_port;
+		TransportProto proto;
+		unsigned int memory;	// Connection::MemoryAllocation() when done
+	};
+
+	// Keeps the max_conns connections with the most CPU time.
+	explicit AnalyzerProfiler(int max_conns);
+
+	// Called around the delivery of len bytes to an analyzer.
+	void Enter(const analyzer::Analyzer* a, int len);
+	void Leave();
+
+	// Called when a connection is done, to consider it for the
+	// heaviest connections. Does nothing if none of its analyzers got
+	// data since the last call.
+	void ConnectionDone(const Connection* c);
+
+	const std::map<analyzer::Tag, Totals>& AnalyzerTotals() const
+		{ return analyzers; }
+
+	// Returns the heaviest connections done since the last call,
+	// heaviest first, and starts over.
+	std::vector<HeavyConnection> TakeHeaviestConnections();
+
+private:
+	struct Frame {
+		Totals* analyzer;
+		Totals* conn;
+		double cpu_start;
+		uint64_t vals_start;
+		double child_cpu;
+		uint64_t child_vals;
+	};
+
+	size_t max_conns;
+	std::map<analyzer::Tag, Totals> analyzers;
+	std::unordered_map<const Connection*, Totals> conns;
+	std::vector<HeavyConnection> heaviest;	// a min-heap by CPU time
+	std::vector<Frame> frames;
+};
+
+// Reports the delivery of data to an analyzer to an AnalyzerProfiler
+// across its lifetime, if profiling is enabled.
+class AnalyzerProfileScope {
+public:
+	AnalyzerProfileScope(AnalyzerProfiler* arg_profiler,
+	                     const analyzer::Analyzer* a, int len)
+	    : profiler(arg_profiler)
+		{
+		if ( profiler )
+			profiler->Enter(a, len);
+		}
+
+	~AnalyzerProfileScope()
+		{
+		if ( profiler )
+			profiler->Leave();
+		}
+
+private:
+	AnalyzerProfiler* profiler;
+};
+
+// Times the stages of the processing of each packet, and in live mode how
+// long after their capture packets get processed.
+class PacketLatencyProfiler {
+public:
+	enum Stage {
+		TIMERS,		// expiring timers
+		SESSIONS,	// NetSessions::NextPacket(), including analyzers
+		EVENTS,		// draining the events the packet raised
+		TOTAL,		// all of the above
+		LAG,		// from capture to the start of processing
+		NUM_STAGES
+	};
+
+	// Each power of two of microseconds splits into this many buckets,
+	// like in an HDR histogram, which bounds the relative error of a
+	// percentile by 1/SUB_BUCKETS.
+	static constexpr int SUB_BUCKETS = 4;
+	static constexpr int OCTAVES = 24;	// up to 2^24us, about 17s
+	static constexpr int NUM_BUCKETS = 1 + OCTAVES * SUB_BUCKETS + 1;
+
+	struct Histogram {
+		uint64_t buckets[NUM_BUCKETS] = { };
+		uint64_t count = 0;
+		double sum = 0;
+		double max = 0;
+
+		void Record(double secs);
+
+		// Returns the upper bound of the bucket holding the sample
+		// below which the fraction p of the samples falls.
+		double Percentile(double p) const;
+	};
+
+	static const char* StageName(int stage);
+
+	// Returns the upper bound of a bucket in seconds, or infinity for
+	// the last one.
+	static double BucketUpperBound(int bucket);
+
+	// Returns the current time of a monotonic clock, for timing stages.
+	static double Now();
+
+	void Record(Stage stage, double secs)
+		{
+		totals[stage].Record(secs);
+		interval[stage].Record(secs);
+		}
+
+	const Histogram& Totals(Stage stage) const	{ return totals[stage]; }
+
+	// Returns the histograms of each stage since the last call, and
+	// starts over.
+	std::vector<Histogram> TakeInterval();
+
+	// Exports the totals as metrics.
+	void RegisterMetrics(zeek::detail::MetricsRegistry* r) const;
+
+private:
+	Histogram totals[NUM_STAGES];
+	Histogram interval[NUM_STAGES];
+};
+
+
+// Samples the script call stack at a given frequency of the main
+// thread's CPU time, cheap enough to stay enabled in production. A timer
+// signal only counts pending samples, which get taken at the next script
+// statement, with each script frame's function and current statement
+// location. Samples taken while no scripts run count as the core's.
+class ScriptSampler {
+public:
+	// Starts taking frequency samples per second of CPU time, writing
+	// them to path in regular intervals. Returns nullptr if the timer
+	// can't be set up, after reporting why.
+	static ScriptSampler* Create(unsigned int frequency, const std::string& path,
+	                             double write_interval);
+	~ScriptSampler();
+
+	// Takes the pending samples with the current script call stack.
+	void Sample();
+
+	// Takes the pending samples as the core's, if no scripts run.
+	void SampleCore()
+		{
+		if ( pending )
+			AddSamples(core_stack);
+		}
+
+	// Writes the samples in folded stacks format, one line per stack
+	// with its number of samples. The file gets replaced atomically, so
+	// that readers never see a partial one. Returns false if it can't be
+	// written.
+	bool WriteFoldedStacks() const;
+
+	const std::string& Path() const	{ return path; }
+
+	// Nonzero if the signal handler added samples. Checked before every
+	// script statement.
+	static volatile sig_atomic_t pending;
+
+private:
+	ScriptSampler() = default;
+
+	void AddSamples(const std::string& stack);
+
+	static RETSIGTYPE Tick(int signo);
+
+	static const std::string core_stack;
+
+	std::string path;
+	std::unordered_map<std::string, uint64_t> stacks;
+	std::string current;
+#ifdef __linux__
+	timer_t timer;
+#endif
+};
+
+
 extern ProfileLogger* profiling_logger;
 extern ProfileLogger* segment_logger;
 extern SampleLogger* sample_logger;
+extern EventProfiler* event_profiler;
+extern AnalyzerProfiler* analyzer_profiler;
+extern PacketLatencyProfiler* packet_latency_profiler;
+extern ScriptSampler* script_sampler;
 
 // Connection statistics.
 extern uint64_t killed_by_inactivity;
@@ -5,6 +5,7 @@
 #include "Stmt.h"
 
 #include "CompHash.h"
+#include "FrozenTable.h"
 #include "Expr.h"
 #include "Event.h"
 #include "Frame.h"
@@ -12,6 +13,7 @@
 #include "Reporter.h"
 #include "NetVar.h"
 #include "Scope.h"
+#include "Stats.h"
 #include "Var.h"
 #include "Desc.h"
 #include "Debug.h"
@@ -21,6 +23,8 @@
 #include "logging/Manager.h"
 #include "logging/logging.bif.h"
 
+#include <set>
+
 const char* stmt_name(BroStmtTag t)
 	{
 	static const char* stmt_names[int(NUM_STMTS)] = {
@@ -29,7 +33,7 @@ const char* stmt_name(BroStmtTag t)
 		"for", "next", "break", "return", "add", "delete",
 		"list", "bodylist",
 		"<init>", "fallthrough", "while",
-		"null",
+		"compiled", "null",
 	};
 
 	return stmt_names[int(t)];
@@ -233,7 +237,7 @@ static void print_log(const std::vector<ValPtr>& vals)
 		vec->Assign(vec->Size(), zeek::make_intrusive<zeek::StringVal>(d.Description()));
 		}
 
-	record->Assign(0, zeek::make_intrusive<zeek::TimeVal>(network_time));
+	record->Assign(0, zeek::val_mgr->Time(network_time));
 	record->Assign(1, std::move(vec));
 	log_mgr->Write(plval.get(), record.get());
 	}
@@ -1197,28 +1201,49 @@ ValPtr ForStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
 	{
 	ValPtr ret;
 
-	if ( v->GetType()->Tag() == TYPE_TABLE )
+	if ( v->GetType()->Tag() == TYPE_TABLE && v->AsTableVal()->FrozenEntries() )
+		{
+		// Holding on to the frozen entries keeps them valid even if
+		// the body makes something turn them back into regular ones.
+		auto frozen = v->AsTableVal()->FrozenEntries();
+		ret = ExecFrozen(f, v->AsTableVal(), frozen.get(), flow);
+		}
+
+	else if ( v->GetType()->Tag() == TYPE_TABLE )
 		{
 		TableVal* tv = v->AsTableVal();
-		const PDict<zeek::TableEntryVal>* loop_vals = tv->AsTable();
+		// Holding on to the entries keeps them valid if the body
+		// modifies a table that shares them with a copy.
+		auto entries = tv->Entries();
+		auto loop_vals = const_cast<PDict<zeek::TableEntryVal>*>(entries.get());
 
 		if ( ! loop_vals->Length() )
 			return nullptr;
 
-		HashKey* k;
+		// Atomic indices come straight from the keys' bytes.
+		bool atomic = tv->HasAtomicIndex();
+		const void* key;
+		int key_size;
 		TableEntryVal* current_tev;
 		IterCookie* c = loop_vals->InitForIteration();
-		while ( (current_tev = loop_vals->NextEntry(k, c)) )
+		loop_vals->MakeRobustCookie(c);
+
+		while ( (current_tev = loop_vals->NextEntry(key, key_size, c)) )
 			{
-			auto ind_lv = tv->RecreateIndex(*k);
-			delete k;
+			if ( atomic )
+				f->SetElement((*loop_vars)[0], tv->RecreateAtomicIndex(key, key_size));
+			else
+				{
+				HashKey k(key, key_size, 0, true);
+				auto ind_lv = tv->EntryIndex(current_tev, k);
+
+				for ( int i = 0; i < ind_lv->Length(); i++ )
+					f->SetElement((*loop_vars)[i], ind_lv->Idx(i));
+				}
 
 			if ( value_var )
 				f->SetElement(value_var, current_tev->GetVal());
 
-			for ( int i = 0; i < ind_lv->Length(); i++ )
-				f->SetElement((*loop_vars)[i], ind_lv->Idx(i));
-
 			flow = FLOW_NEXT;
 
 			try
@@ -1289,6 +1314,39 @@ ValPtr ForStmt::DoExec(Frame* f, Val* v, stmt_flow_type& flow) const
 	return ret;
 	}
 
+ValPtr ForStmt::ExecFrozen(Frame* f, TableVal* tv, const FrozenTable* frozen,
+                           stmt_flow_type& flow) const
+	{
+	ValPtr ret;
+	bool atomic = tv->HasAtomicIndex();
+
+	for ( int i = 0; i < frozen->Size(); ++i )
+		{
+		if ( atomic )
+			f->SetElement((*loop_vars)[0],
+			              tv->RecreateAtomicIndex(frozen->Key(i), frozen->KeySize(i)));
+		else
+			{
+			HashKey k(frozen->Key(i), frozen->KeySize(i), 0, true);
+			auto ind_lv = tv->RecreateIndex(k);
+
+			for ( int j = 0; j < ind_lv->Length(); j++ )
+				f->SetElement((*loop_vars)[j], ind_lv->Idx(j));
+			}
+
+		if ( value_var )
+			f->SetElement(value_var, frozen->Value(i));
+
+		flow = FLOW_NEXT;
+		ret = body->Exec(f, flow);
+
+		if ( flow == FLOW_BREAK || flow == FLOW_RETURN )
+			break;
+		}
+
+	return ret;
+	}
+
 bool ForStmt::IsPure() const
 	{
 	return e->IsPure() && body->IsPure();
@@ -1524,6 +1582,9 @@ ValPtr StmtList::Exec(Frame* f, stmt_flow_type& flow) const
 		{
 		f->SetNextStmt(stmt);
 
+		if ( ScriptSampler::pending && script_sampler )
+			script_sampler->Sample();
+
 		if ( ! pre_execute_stmt(stmt, f) )
 			{ // ### Abort or something
 			}
@@ -1754,6 +1815,27 @@ TraversalCode NullStmt::Traverse(TraversalCallback* cb) const
 	HANDLE_TC_STMT_POST(tc);
 	}
 
+// Collects the frame offsets of all locals that a when statement refers
+// to, including those of lambdas within it, so that its triggers can copy
+// just those.
+class WhenCaptureFinder : public TraversalCallback {
+public:
+	TraversalCode PreExpr(const Expr* expr) override
+		{
+		if ( expr->Tag() != EXPR_NAME )
+			return TC_CONTINUE;
+
+		auto id = static_cast<const NameExpr*>(expr)->Id();
+
+		if ( ! id->IsGlobal() )
+			offsets.insert(id->Offset());
+
+		return TC_CONTINUE;
+		}
+
+	std::set<int> offsets;
+};
+
 WhenStmt::WhenStmt(ExprPtr arg_cond,
                    StmtPtr arg_s1, StmtPtr arg_s2,
                    ExprPtr arg_timeout, bool arg_is_return)
@@ -1764,6 +1846,10 @@ WhenStmt::WhenStmt(ExprPtr arg_cond,
 	assert(cond);
 	assert(s1);
 
+	WhenCaptureFinder cb;
+	Traverse(&cb);
+	captures.assign(cb.offsets.begin(), cb.offsets.end());
+
 	if ( ! cond->IsError() && ! IsBool(cond->GetType()->Tag()) )
 		cond->Error("conditional in test must be boolean");
 
@@ -1790,7 +1876,7 @@ ValPtr WhenStmt::Exec(Frame* f, stmt_flow_type& flow) const
 	                     IntrusivePtr{s1}.release(),
 	                     IntrusivePtr{s2}.release(),
 	                     IntrusivePtr{timeout}.release(),
-	                     f, is_return, location);
+	                     f, is_return, location, &captures);
 	return nullptr;
 	}
 
@@ -21,6 +21,7 @@ namespace zeek::detail {
 
 class StmtList;
 class ForStmt;
+class FrozenTable;
 class EventExpr;
 class ListExpr;
 
@@ -140,6 +141,9 @@ public:
 	const Stmt* TrueBranch() const	{ return s1.get(); }
 	const Stmt* FalseBranch() const	{ return s2.get(); }
 
+	void SetTrueBranch(StmtPtr s)	{ s1 = std::move(s); }
+	void SetFalseBranch(StmtPtr s)	{ s2 = std::move(s); }
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -259,6 +263,11 @@ public:
 
 	bool IsPure() const override;
 
+	const Expr* Condition() const	{ return loop_condition.get(); }
+	const Stmt* Body() const	{ return body.get(); }
+
+	void SetBody(StmtPtr s)	{ body = std::move(s); }
+
 	void Describe(ODesc* d) const override;
 
 	TraversalCode Traverse(TraversalCallback* cb) const override;
@@ -292,6 +301,10 @@ public:
 protected:
 	ValPtr DoExec(Frame* f, Val* v, stmt_flow_type& flow) const override;
 
+	// Iterates over the entries of a frozen table.
+	ValPtr ExecFrozen(Frame* f, TableVal* tv, const FrozenTable* frozen,
+	                  stmt_flow_type& flow) const;
+
 	id_list* loop_vars;
 	StmtPtr body;
 	// Stores the value variable being used for a key value for loop.
@@ -442,6 +455,10 @@ protected:
 	StmtPtr s2;
 	ExprPtr timeout;
 	bool is_return;
+
+	// Frame offsets of the locals that the statement refers to, which
+	// are all its trigger needs to copy.
+	std::vector<int> captures;
 };
 
 }
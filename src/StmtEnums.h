@@ -17,6 +17,7 @@ typedef enum {
 	STMT_INIT,
 	STMT_FALLTHROUGH,
 	STMT_WHILE,
+	STMT_COMPILED,
 	STMT_NULL
 #define NUM_STMTS (int(STMT_NULL) + 1)
 } BroStmtTag;
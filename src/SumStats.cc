@@ -0,0 +1,561 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "SumStats.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "broker/Data.h"
+#include "CompHash.h"
+#include "Type.h"
+#include "Var.h"
+
+namespace zeek {
+
+IMPLEMENT_OPAQUE_VALUE(SumStatsAggVal)
+
+namespace {
+
+// The SumStats types and the offsets of the fields the calculations use.
+// Plugins add fields with redefs, so these get looked up only once
+// scripts are running.
+struct Fields {
+	TypePtr key;
+	RecordTypePtr observation;
+	RecordTypePtr result_val;
+	TableTypePtr result;
+	std::unique_ptr<CompositeHash> key_hash;
+
+	int obs_num, obs_dbl, obs_str;
+	int begin, end, num;
+	int sum, min, max, average, variance, prev_avg, var_s, std_dev;
+	int unique, unique_vals, unique_max;
+
+	Fields()
+		{
+		key = id::find_type("SumStats::Key");
+		observation = id::find_type<RecordType>("SumStats::Observation");
+		result_val = id::find_type<RecordType>("SumStats::ResultVal");
+		result = id::find_type<TableType>("SumStats::Result");
+
+		auto tl = make_intrusive<TypeList>(key);
+		tl->Append(key);
+		key_hash = std::make_unique<CompositeHash>(std::move(tl));
+
+		obs_num = observation->FieldOffset("num");
+		obs_dbl = observation->FieldOffset("dbl");
+		obs_str = observation->FieldOffset("str");
+
+		begin = result_val->FieldOffset("begin");
+		end = result_val->FieldOffset("end");
+		num = result_val->FieldOffset("num");
+		sum = result_val->FieldOffset("sum");
+		min = result_val->FieldOffset("min");
+		max = result_val->FieldOffset("max");
+		average = result_val->FieldOffset("average");
+		variance = result_val->FieldOffset("variance");
+		prev_avg = result_val->FieldOffset("prev_avg");
+		var_s = result_val->FieldOffset("var_s");
+		std_dev = result_val->FieldOffset("std_dev");
+		unique = result_val->FieldOffset("unique");
+		unique_vals = result_val->FieldOffset("unique_vals");
+		unique_max = result_val->FieldOffset("unique_max");
+		}
+};
+
+const Fields& fields()
+	{
+	static const Fields f;
+	return f;
+	}
+
+void assign(RecordVal* rv, int field, ValPtr v)
+	{
+	if ( field >= 0 )
+		rv->Assign(field, std::move(v));
+	}
+
+}
+
+SumStatsAggVal::SumStatsAggVal() : OpaqueVal(sumstats_agg_type)
+	{
+	}
+
+SumStatsAggVal::~SumStatsAggVal()
+	{
+	}
+
+uint32_t SumStatsAggVal::CalcOf(bro_int_t calc)
+	{
+	static const auto& calc_type = id::find_type<EnumType>("SumStats::Calculation");
+	const char* name = calc_type->Lookup(calc);
+
+	if ( ! name )
+		return 0;
+
+	static const std::unordered_map<std::string, uint32_t> native = {
+		{"SumStats::SUM", SUM},
+		{"SumStats::MIN", MIN},
+		{"SumStats::MAX", MAX},
+		{"SumStats::AVERAGE", AVERAGE},
+		{"SumStats::VARIANCE", VARIANCE},
+		{"SumStats::STD_DEV", STD_DEV},
+		{"SumStats::UNIQUE", UNIQUE},
+	};
+
+	auto it = native.find(name);
+	return it != native.end() ? it->second : 0;
+	}
+
+bool SumStatsAggVal::IsNative(bro_int_t calc)
+	{
+	return CalcOf(calc) != 0;
+	}
+
+bool SumStatsAggVal::Init(const RecordVal* reducer, std::string* error)
+	{
+	auto rt = reducer->GetType()->AsRecordType();
+	int calc_funcs = rt->FieldOffset("calc_funcs");
+	int max_field = rt->FieldOffset("unique_max");
+
+	if ( calc_funcs < 0 || ! reducer->GetField(calc_funcs) )
+		{
+		*error = "reducer lacks its calc_funcs";
+		return false;
+		}
+
+	auto funcs = reducer->GetField(calc_funcs)->AsVectorVal();
+
+	for ( unsigned int i = 0; i < funcs->Size(); ++i )
+		{
+		auto c = CalcOf(funcs->At(i)->AsEnum());
+
+		if ( ! c )
+			{
+			*error = "reducer has calculations without a native implementation";
+			return false;
+			}
+
+		calcs |= c;
+		}
+
+	if ( max_field >= 0 && reducer->GetField(max_field) )
+		unique_max = reducer->GetField(max_field)->AsCount();
+
+	return true;
+	}
+
+const uint32_t* SumStatsAggVal::FindSlot(const Val* key) const
+	{
+	LookupHashKey lk;
+	auto hk = fields().key_hash->MakeLookupKey(*key, true, lk);
+
+	if ( ! hk )
+		return nullptr;
+
+	auto it = slots.find(std::string(static_cast<const char*>(hk->Key()), hk->Size()));
+	return it != slots.end() ? &it->second : nullptr;
+	}
+
+uint32_t SumStatsAggVal::AddSlot(const ValPtr& key, std::string hash)
+	{
+	uint32_t slot = keys.size();
+	slots.emplace(std::move(hash), slot);
+
+	// Scripts may change their key records later on.
+	keys.emplace_back(key->Clone());
+	num.push_back(0);
+	begin.push_back(network_time);
+	end.push_back(network_time);
+	sum.push_back(0.0);
+	min.push_back(0.0);
+	max.push_back(0.0);
+	average.push_back(0.0);
+	prev_avg.push_back(0.0);
+	var_s.push_back(0.0);
+	unique_vals.emplace_back();
+
+	return slot;
+	}
+
+int64_t SumStatsAggVal::Slot(const ValPtr& key)
+	{
+	LookupHashKey lk;
+	auto hk = fields().key_hash->MakeLookupKey(*key, true, lk);
+
+	if ( ! hk )
+		return -1;
+
+	std::string hash(static_cast<const char*>(hk->Key()), hk->Size());
+	auto it = slots.find(hash);
+
+	if ( it != slots.end() )
+		return it->second;
+
+	return AddSlot(key, std::move(hash));
+	}
+
+void SumStatsAggVal::Update(uint32_t slot, double val, const RecordVal* obs)
+	{
+	// The same steps, in the same order, as the scripts' calculations,
+	// so that results don't differ even in rounding.
+	auto n = ++num[slot];
+	end[slot] = network_time;
+
+	if ( calcs & SUM )
+		sum[slot] += val;
+
+	if ( calcs & MIN && (n == 1 || val < min[slot]) )
+		min[slot] = val;
+
+	if ( calcs & MAX && (n == 1 || val > max[slot]) )
+		max[slot] = val;
+
+	if ( calcs & AVERAGE )
+		{
+		if ( n == 1 )
+			average[slot] = val;
+		else
+			average[slot] += (val - average[slot]) / n;
+		}
+
+	if ( calcs & VARIANCE )
+		{
+		if ( n > 1 )
+			var_s[slot] += (val - prev_avg[slot]) * (val - average[slot]);
+
+		prev_avg[slot] = average[slot];
+		}
+
+	if ( calcs & UNIQUE &&
+	     (unique_max < 0 || unique_vals[slot].size() <= static_cast<uint64_t>(unique_max)) )
+		unique_vals[slot].insert(EncodeObservation(obs));
+	}
+
+bool SumStatsAggVal::Observe(const ValPtr& key, const RecordVal* obs)
+	{
+	const auto& f = fields();
+	auto slot = Slot(key);
+
+	if ( slot < 0 )
+		return false;
+
+	double val = 1.0;
+
+	if ( const auto& n = obs->GetField(f.obs_num) )
+		val = n->AsCount();
+	else if ( const auto& d = obs->GetField(f.obs_dbl) )
+		val = d->AsDouble();
+
+	Update(slot, val, obs);
+	return true;
+	}
+
+RecordValPtr SumStatsAggVal::Result(uint32_t slot) const
+	{
+	const auto& f = fields();
+	auto rv = make_intrusive<RecordVal>(f.result_val);
+
+	assign(rv.get(), f.begin, make_intrusive<TimeVal>(begin[slot]));
+	assign(rv.get(), f.end, make_intrusive<TimeVal>(end[slot]));
+	assign(rv.get(), f.num, val_mgr->Count(num[slot]));
+
+	if ( calcs & SUM )
+		assign(rv.get(), f.sum, make_intrusive<DoubleVal>(sum[slot]));
+
+	if ( calcs & MIN )
+		assign(rv.get(), f.min, make_intrusive<DoubleVal>(min[slot]));
+
+	if ( calcs & MAX )
+		assign(rv.get(), f.max, make_intrusive<DoubleVal>(max[slot]));
+
+	if ( calcs & AVERAGE )
+		assign(rv.get(), f.average, make_intrusive<DoubleVal>(average[slot]));
+
+	double variance = num[slot] > 1 ? var_s[slot] / (num[slot] - 1) : 0.0;
+
+	if ( calcs & VARIANCE )
+		{
+		assign(rv.get(), f.variance, make_intrusive<DoubleVal>(variance));
+		assign(rv.get(), f.prev_avg, make_intrusive<DoubleVal>(prev_avg[slot]));
+		assign(rv.get(), f.var_s, make_intrusive<DoubleVal>(var_s[slot]));
+		}
+
+	if ( calcs & STD_DEV )
+		assign(rv.get(), f.std_dev, make_intrusive<DoubleVal>(sqrt(variance)));
+
+	if ( calcs & UNIQUE )
+		{
+		auto set_type = cast_intrusive<TableType>(f.result_val->GetFieldType(f.unique_vals));
+		auto vals = make_intrusive<TableVal>(std::move(set_type));
+
+		for ( const auto& o : unique_vals[slot] )
+			vals->Assign(DecodeObservation(o), nullptr);
+
+		assign(rv.get(), f.unique, val_mgr->Count(unique_vals[slot].size()));
+		assign(rv.get(), f.unique_vals, std::move(vals));
+
+		if ( unique_max >= 0 )
+			assign(rv.get(), f.unique_max, val_mgr->Count(unique_max));
+		}
+
+	return rv;
+	}
+
+bool SumStatsAggVal::Fill(const ValPtr& key, const StringValPtr& stream, TableVal* result) const
+	{
+	auto slot = FindSlot(key.get());
+
+	if ( ! slot )
+		return false;
+
+	result->Assign(stream, Result(*slot));
+	return true;
+	}
+
+void SumStatsAggVal::FillAll(const StringValPtr& stream, TableVal* results) const
+	{
+	for ( uint32_t i = 0; i < keys.size(); ++i )
+		{
+		auto result = results->FindOrDefault(keys[i]);
+
+		if ( ! result )
+			{
+			result = make_intrusive<TableVal>(fields().result);
+			results->Assign(keys[i], result);
+			}
+
+		result->AsTableVal()->Assign(stream, Result(i));
+		}
+	}
+
+bool SumStatsAggVal::Merge(const SumStatsAggVal* other)
+	{
+	if ( calcs != other->calcs )
+		return false;
+
+	for ( uint32_t j = 0; j < other->keys.size(); ++j )
+		{
+		LookupHashKey lk;
+		auto hk = fields().key_hash->MakeLookupKey(*other->keys[j], true, lk);
+		std::string hash(static_cast<const char*>(hk->Key()), hk->Size());
+		auto it = slots.find(hash);
+
+		if ( it == slots.end() )
+			{
+			auto i = AddSlot(other->keys[j], std::move(hash));
+			num[i] = other->num[j];
+			begin[i] = other->begin[j];
+			end[i] = other->end[j];
+			sum[i] = other->sum[j];
+			min[i] = other->min[j];
+			max[i] = other->max[j];
+			average[i] = other->average[j];
+			prev_avg[i] = other->prev_avg[j];
+			var_s[i] = other->var_s[j];
+			unique_vals[i] = other->unique_vals[j];
+			continue;
+			}
+
+		// As the scripts' compose_resultvals_hook handlers do it.
+		auto i = it->second;
+		double n1 = num[i];
+		double n2 = other->num[j];
+		double avg = (average[i] * n1 + other->average[j] * n2) / (n1 + n2);
+
+		if ( calcs & VARIANCE )
+			{
+			double d1 = (average[i] - avg) * (average[i] - avg);
+			double d2 = (other->average[j] - avg) * (other->average[j] - avg);
+			var_s[i] = n1 * (var_s[i] / n1 + d1) + n2 * (other->var_s[j] / n2 + d2);
+			prev_avg[i] = (prev_avg[i] * n1 + other->prev_avg[j] * n2) / (n1 + n2);
+			}
+
+		average[i] = avg;
+		num[i] += other->num[j];
+		begin[i] = std::min(begin[i], other->begin[j]);
+		end[i] = std::max(end[i], other->end[j]);
+		sum[i] += other->sum[j];
+		min[i] = std::min(min[i], other->min[j]);
+		max[i] = std::max(max[i], other->max[j]);
+
+		for ( const auto& o : other->unique_vals[j] )
+			{
+			if ( unique_max >= 0 && unique_vals[i].size() >= static_cast<uint64_t>(unique_max) )
+				break;
+
+			unique_vals[i].insert(o);
+			}
+		}
+
+	return true;
+	}
+
+void SumStatsAggVal::Clear()
+	{
+	slots.clear();
+	keys.clear();
+	num.clear();
+	begin.clear();
+	end.clear();
+	sum.clear();
+	min.clear();
+	max.clear();
+	average.clear();
+	prev_avg.clear();
+	var_s.clear();
+	unique_vals.clear();
+	}
+
+std::string SumStatsAggVal::EncodeObservation(const RecordVal* obs)
+	{
+	// A tag for the field that's set, followed by its value.
+	const auto& f = fields();
+
+	if ( const auto& n = obs->GetField(f.obs_num) )
+		{
+		bro_uint_t c = n->AsCount();
+		return std::string("n") + std::string(reinterpret_cast<const char*>(&c), sizeof(c));
+		}
+
+	if ( const auto& d = obs->GetField(f.obs_dbl) )
+		{
+		double v = d->AsDouble();
+		return std::string("d") + std::string(reinterpret_cast<const char*>(&v), sizeof(v));
+		}
+
+	if ( const auto& s = obs->GetField(f.obs_str) )
+		return std::string("s") + s->AsStringVal()->ToStdString();
+
+	return "";
+	}
+
+RecordValPtr SumStatsAggVal::DecodeObservation(const std::string& s)
+	{
+	const auto& f = fields();
+	auto obs = make_intrusive<RecordVal>(f.observation);
+
+	if ( s.empty() )
+		return obs;
+
+	switch ( s[0] ) {
+	case 'n':
+		{
+		bro_uint_t c;
+		memcpy(&c, s.data() + 1, sizeof(c));
+		obs->Assign(f.obs_num, val_mgr->Count(c));
+		break;
+		}
+
+	case 'd':
+		{
+		double v;
+		memcpy(&v, s.data() + 1, sizeof(v));
+		obs->Assign(f.obs_dbl, make_intrusive<DoubleVal>(v));
+		break;
+		}
+
+	default:
+		obs->Assign(f.obs_str, make_intrusive<StringVal>(s.substr(1)));
+		break;
+	}
+
+	return obs;
+	}
+
+broker::expected<broker::data> SumStatsAggVal::DoSerialize() const
+	{
+	broker::vector d = {static_cast<uint64_t>(calcs), static_cast<int64_t>(unique_max)};
+
+	for ( uint32_t i = 0; i < keys.size(); ++i )
+		{
+		auto key = bro_broker::val_to_data(keys[i].get());
+
+		if ( ! key )
+			return broker::ec::invalid_data;
+
+		broker::vector uniques(unique_vals[i].begin(), unique_vals[i].end());
+
+		d.emplace_back(broker::vector{std::move(*key), static_cast<uint64_t>(num[i]),
+		                              begin[i], end[i], sum[i], min[i], max[i],
+		                              average[i], prev_avg[i], var_s[i],
+		                              std::move(uniques)});
+		}
+
+	return {std::move(d)};
+	}
+
+bool SumStatsAggVal::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+
+	if ( ! (v && v->size() >= 2) )
+		return false;
+
+	auto c = caf::get_if<uint64_t>(&(*v)[0]);
+	auto m = caf::get_if<int64_t>(&(*v)[1]);
+
+	if ( ! (c && m) )
+		return false;
+
+	calcs = *c;
+	unique_max = *m;
+
+	for ( size_t i = 2; i < v->size(); ++i )
+		{
+		auto s = caf::get_if<broker::vector>(&(*v)[i]);
+
+		if ( ! (s && s->size() == 11) )
+			return false;
+
+		auto key = bro_broker::data_to_val((*s)[0], fields().key.get());
+		auto n = caf::get_if<uint64_t>(&(*s)[1]);
+		auto uniques = caf::get_if<broker::vector>(&(*s)[10]);
+		double d[8];
+
+		for ( int k = 0; k < 8; ++k )
+			{
+			auto x = caf::get_if<double>(&(*s)[2 + k]);
+
+			if ( ! x )
+				return false;
+
+			d[k] = *x;
+			}
+
+		if ( ! (key && n && uniques) || FindSlot(key.get()) )
+			return false;
+
+		auto slot = Slot(key);
+
+		if ( slot < 0 )
+			return false;
+
+		num[slot] = *n;
+		begin[slot] = d[0];
+		end[slot] = d[1];
+		sum[slot] = d[2];
+		min[slot] = d[3];
+		max[slot] = d[4];
+		average[slot] = d[5];
+		prev_avg[slot] = d[6];
+		var_s[slot] = d[7];
+
+		for ( const auto& u : *uniques )
+			{
+			auto us = caf::get_if<std::string>(&u);
+
+			if ( ! us )
+				return false;
+
+			unique_vals[slot].insert(*us);
+			}
+		}
+
+	return true;
+	}
+
+}
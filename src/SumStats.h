@@ -0,0 +1,140 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "OpaqueVal.h"
+
+namespace zeek {
+
+/**
+ * The state of a SumStats reducer whose calculations all have a native
+ * implementation: SUM, MIN, MAX, AVERAGE, VARIANCE, STD_DEV and UNIQUE.
+ * Keys get a slot each, and the per-key state lives in one flat array per
+ * quantity, indexed by slot. Results are only turned into
+ * SumStats::ResultVal records when the scripts ask for them, with the
+ * same fields and values the script implementations of the calculations
+ * produce.
+ *
+ * The state covers a single epoch; the scripts clear it when the epoch
+ * ends.
+ */
+class SumStatsAggVal : public OpaqueVal {
+public:
+	SumStatsAggVal();
+	~SumStatsAggVal() override;
+
+	/**
+	 * Returns true if a SumStats::Calculation value has a native
+	 * implementation.
+	 */
+	static bool IsNative(bro_int_t calc);
+
+	/**
+	 * Configures the calculations to do from a SumStats::Reducer.
+	 *
+	 * @param reducer The reducer, with its calc_funcs filled in.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return False if any of the calculations isn't native.
+	 */
+	bool Init(const RecordVal* reducer, std::string* error);
+
+	/**
+	 * Adds an observation at the current network time.
+	 *
+	 * @param key The SumStats::Key the observation is for.
+	 *
+	 * @param obs The SumStats::Observation.
+	 *
+	 * @return False if the key isn't a SumStats::Key.
+	 */
+	bool Observe(const ValPtr& key, const RecordVal* obs);
+
+	/**
+	 * Sets the result of a key for a stream in a SumStats::Result
+	 * table, if there were observations for the key.
+	 *
+	 * @return True if the key has a result.
+	 */
+	bool Fill(const ValPtr& key, const StringValPtr& stream, TableVal* result) const;
+
+	/**
+	 * Sets the results of all keys for a stream in a
+	 * SumStats::ResultTable, adding tables for keys it lacks.
+	 */
+	void FillAll(const StringValPtr& stream, TableVal* results) const;
+
+	/**
+	 * Adds the state of another aggregation of the same calculations,
+	 * as composing their results would.
+	 *
+	 * @return False if the calculations differ.
+	 */
+	bool Merge(const SumStatsAggVal* other);
+
+	/**
+	 * Drops the state of all keys, for the start of a new epoch.
+	 */
+	void Clear();
+
+	/**
+	 * Returns the number of keys with observations.
+	 */
+	size_t Size() const	{ return keys.size(); }
+
+protected:
+	DECLARE_OPAQUE_VALUE(SumStatsAggVal)
+
+private:
+	enum Calc : uint32_t {
+		SUM = 1 << 0,
+		MIN = 1 << 1,
+		MAX = 1 << 2,
+		AVERAGE = 1 << 3,
+		VARIANCE = 1 << 4,
+		STD_DEV = 1 << 5,
+		UNIQUE = 1 << 6,
+	};
+
+	static uint32_t CalcOf(bro_int_t calc);
+
+	// Returns the slot of a key, adding one if it's new, or -1 if it
+	// isn't a key.
+	int64_t Slot(const ValPtr& key);
+	const uint32_t* FindSlot(const Val* key) const;
+	uint32_t AddSlot(const ValPtr& key, std::string hash);
+
+	// Adds a value to a slot's state; the observation count includes it.
+	void Update(uint32_t slot, double val, const RecordVal* obs);
+
+	RecordValPtr Result(uint32_t slot) const;
+
+	static std::string EncodeObservation(const RecordVal* obs);
+	static RecordValPtr DecodeObservation(const std::string& s);
+
+	uint32_t calcs = 0;
+	int64_t unique_max = -1;	// negative for no limit
+
+	std::unordered_map<std::string, uint32_t> slots;
+	std::vector<ValPtr> keys;
+
+	// Per-key state, indexed by slot.
+	std::vector<uint64_t> num;
+	std::vector<double> begin;
+	std::vector<double> end;
+	std::vector<double> sum;
+	std::vector<double> min;
+	std::vector<double> max;
+	std::vector<double> average;
+	std::vector<double> prev_avg;
+	std::vector<double> var_s;
+	std::vector<std::unordered_set<std::string>> unique_vals;
+};
+
+}
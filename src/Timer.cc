@@ -2,6 +2,11 @@
 
 #include "zeek-config.h"
 
+#include <algorithm>
+#include <cstring>
+
+#include "3rdparty/doctest.h"
+
 #include "util.h"
 #include "Timer.h"
 #include "Desc.h"
@@ -188,3 +193,413 @@ double PQ_TimerMgr::GetNextTimeout()
 
 	return -1;
 	}
+
+
+Wheel_TimerMgr::Wheel_TimerMgr() : TimerMgr()
+	{
+	q = new PriorityQueue;
+	slots.resize(OVERFLOW_SLOT + 1);
+	memset(occupied, 0, sizeof(occupied));
+	memset(level_size, 0, sizeof(level_size));
+	cur_tick = 0;
+	wheel_size = 0;
+	peak_size = 0;
+	cumulative_num = 0;
+	}
+
+Wheel_TimerMgr::~Wheel_TimerMgr()
+	{
+	delete q;
+	}
+
+uint64_t Wheel_TimerMgr::ToTick(double t)
+	{
+	// Clamp so that the conversion can't overflow.
+	const double max_tick = static_cast<double>(uint64_t(1) << 62);
+	double tick = t / RESOLUTION;
+
+	if ( ! (tick > 0) )
+		return 0;
+
+	if ( tick >= max_tick )
+		return uint64_t(1) << 62;
+
+	return static_cast<uint64_t>(tick);
+	}
+
+void Wheel_TimerMgr::Add(Timer* timer)
+	{
+	DBG_LOG(DBG_TM, "Adding timer %s (%p) at %.6f",
+	        timer_type_to_string(timer->Type()), timer, timer->Time());
+
+	Place(timer);
+
+	++current_timers[timer->Type()];
+	++cumulative_num;
+
+	if ( Size() > peak_size )
+		peak_size = Size();
+	}
+
+void Wheel_TimerMgr::Place(Timer* timer)
+	{
+	uint64_t tick = ToTick(timer->Time());
+
+	if ( tick <= cur_tick )
+		{
+		// Already due. Like PQ_TimerMgr, we queue the timer rather
+		// than dispatching it right away, so that timers keep
+		// executing in sorted order.
+		timer->wheel_slot = -1;
+
+		if ( ! q->Add(timer) )
+			reporter->InternalError("out of memory");
+
+		return;
+		}
+
+	// The timer goes into the level corresponding to the highest bit in
+	// which its tick differs from the current one. That guarantees that
+	// the wheel reaches its slot before the timer becomes due, and that
+	// it doesn't wrap around before that.
+	uint64_t diff = tick ^ cur_tick;
+	int level = (63 - __builtin_clzll(diff)) / LEVEL_BITS;
+	int slot;
+
+	if ( level >= NUM_LEVELS )
+		{
+		level = NUM_LEVELS;
+		slot = OVERFLOW_SLOT;
+		}
+	else
+		{
+		int idx = (tick >> (level * LEVEL_BITS)) & (SLOTS_PER_LEVEL - 1);
+		slot = level * SLOTS_PER_LEVEL + idx;
+		occupied[level][idx / 64] |= uint64_t(1) << (idx % 64);
+		}
+
+	auto& v = slots[slot];
+	timer->SetOffset(v.size());
+	timer->wheel_slot = slot;
+	v.push_back(timer);
+
+	++level_size[level];
+	++wheel_size;
+	}
+
+void Wheel_TimerMgr::Unlink(Timer* timer)
+	{
+	int slot = timer->wheel_slot;
+	auto& v = slots[slot];
+
+	// Swap the last timer of the slot into the removed one's position.
+	Timer* last = v.back();
+	v[timer->Offset()] = last;
+	last->SetOffset(timer->Offset());
+	v.pop_back();
+
+	int level = slot / SLOTS_PER_LEVEL;
+
+	if ( v.empty() && level < NUM_LEVELS )
+		{
+		int idx = slot % SLOTS_PER_LEVEL;
+		occupied[level][idx / 64] &= ~(uint64_t(1) << (idx % 64));
+		}
+
+	--level_size[level];
+	--wheel_size;
+	timer->wheel_slot = -1;
+	}
+
+void Wheel_TimerMgr::Cascade(int slot)
+	{
+	std::vector<Timer*> timers;
+	timers.swap(slots[slot]);
+
+	if ( timers.empty() )
+		return;
+
+	int level = slot / SLOTS_PER_LEVEL;
+
+	if ( level < NUM_LEVELS )
+		{
+		int idx = slot % SLOTS_PER_LEVEL;
+		occupied[level][idx / 64] &= ~(uint64_t(1) << (idx % 64));
+		}
+
+	level_size[level] -= timers.size();
+	wheel_size -= timers.size();
+
+	for ( auto timer : timers )
+		Place(timer);
+	}
+
+uint64_t Wheel_TimerMgr::NextEventTick() const
+	{
+	// All timers of a level share the current tick's bits above that
+	// level, and sit in slots beyond the current one. So the first
+	// non-empty level, from the bottom, yields the next slot to process.
+	for ( int level = 0; level < NUM_LEVELS; ++level )
+		{
+		if ( ! level_size[level] )
+			continue;
+
+		int shift = level * LEVEL_BITS;
+		int cur = (cur_tick >> shift) & (SLOTS_PER_LEVEL - 1);
+
+		for ( int idx = cur + 1; idx < SLOTS_PER_LEVEL; )
+			{
+			uint64_t bits = occupied[level][idx / 64] >> (idx % 64);
+
+			if ( bits )
+				{
+				idx += __builtin_ctzll(bits);
+				uint64_t base = (cur_tick >> (shift + LEVEL_BITS)) << LEVEL_BITS;
+				return (base + idx) << shift;
+				}
+
+			idx = (idx / 64 + 1) * 64;
+			}
+		}
+
+	if ( ! level_size[NUM_LEVELS] )
+		return UINT64_MAX;
+
+	// The overflow slot gets redistributed whenever the tick crosses
+	// a multiple of the wheel's full range. Jump to the first one at
+	// which that actually places a timer.
+	const int shift = NUM_LEVELS * LEVEL_BITS;
+	uint64_t next = UINT64_MAX;
+
+	for ( auto timer : slots[OVERFLOW_SLOT] )
+		next = std::min(next, (ToTick(timer->Time()) >> shift) << shift);
+
+	return next;
+	}
+
+void Wheel_TimerMgr::AdvanceTo(uint64_t tick)
+	{
+	while ( cur_tick < tick )
+		{
+		uint64_t next = NextEventTick();
+
+		if ( next > tick )
+			{
+			cur_tick = tick;
+			break;
+			}
+
+		cur_tick = next;
+
+		// Cascade top-down, as a coarser slot may move timers into
+		// finer slots that are due at the same tick.
+		for ( int level = NUM_LEVELS; level > 0; --level )
+			{
+			int shift = level * LEVEL_BITS;
+
+			if ( cur_tick & ((uint64_t(1) << shift) - 1) )
+				continue;
+
+			if ( level == NUM_LEVELS )
+				Cascade(OVERFLOW_SLOT);
+			else
+				{
+				int idx = (cur_tick >> shift) & (SLOTS_PER_LEVEL - 1);
+				Cascade(level * SLOTS_PER_LEVEL + idx);
+				}
+			}
+
+		// Everything in the current finest slot is due now.
+		Cascade(cur_tick & (SLOTS_PER_LEVEL - 1));
+		}
+	}
+
+void Wheel_TimerMgr::Expire()
+	{
+	for ( auto& v : slots )
+		{
+		for ( auto timer : v )
+			{
+			timer->wheel_slot = -1;
+
+			if ( ! q->Add(timer) )
+				reporter->InternalError("out of memory");
+			}
+
+		v.clear();
+		}
+
+	memset(occupied, 0, sizeof(occupied));
+	memset(level_size, 0, sizeof(level_size));
+	wheel_size = 0;
+
+	while ( Timer* timer = static_cast<Timer*>(q->Remove()) )
+		{
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(t, true);
+		--current_timers[timer->Type()];
+		delete timer;
+		}
+	}
+
+int Wheel_TimerMgr::DoAdvance(double new_t, int max_expire)
+	{
+	AdvanceTo(ToTick(new_t));
+
+	Timer* timer = static_cast<Timer*>(q->Top());
+	for ( num_expired = 0; (num_expired < max_expire || max_expire == 0) &&
+		     timer && timer->Time() <= new_t; ++num_expired )
+		{
+		last_timestamp = timer->Time();
+		--current_timers[timer->Type()];
+
+		// Remove it before dispatching, since the dispatch
+		// can otherwise delete it, and then we won't know
+		// whether we should delete it too.
+		(void) q->Remove();
+
+		DBG_LOG(DBG_TM, "Dispatching timer %s (%p)",
+		        timer_type_to_string(timer->Type()), timer);
+		timer->Dispatch(new_t, false);
+		delete timer;
+
+		timer = static_cast<Timer*>(q->Top());
+		}
+
+	return num_expired;
+	}
+
+void Wheel_TimerMgr::Remove(Timer* timer)
+	{
+	if ( timer->wheel_slot >= 0 )
+		Unlink(timer);
+
+	else if ( ! q->Remove(timer) )
+		reporter->InternalError("asked to remove a missing timer");
+
+	--current_timers[timer->Type()];
+	delete timer;
+	}
+
+double Wheel_TimerMgr::GetNextTimeout()
+	{
+	Timer* top = static_cast<Timer*>(q->Top());
+	if ( top )
+		return std::max(0.0, top->Time() - ::network_time);
+
+	// For timers still in the wheel we only know when the wheel will
+	// process their slot next, which is a lower bound for when they
+	// become due.
+	uint64_t next = NextEventTick();
+	if ( next != UINT64_MAX )
+		return std::max(0.0, next * RESOLUTION - ::network_time);
+
+	return -1;
+	}
+
+TEST_SUITE_BEGIN("Wheel_TimerMgr");
+
+namespace {
+
+class TestTimer : public Timer {
+public:
+	TestTimer(double t, std::vector<double>* arg_fired)
+		: Timer(t, TIMER_NETWORK), fired(arg_fired)	{}
+
+	void Dispatch(double t, bool is_expire) override
+		{ fired->push_back(Time()); }
+
+private:
+	std::vector<double>* fired;
+};
+
+class TestWheel : public Wheel_TimerMgr {
+public:
+	int Step(double t, int max_expire = 0)
+		{
+		this->t = t;
+		return DoAdvance(t, max_expire);
+		}
+};
+
+}
+
+TEST_CASE("wheel dispatch order")
+	{
+	TestWheel w;
+	std::vector<double> fired;
+	double start = 1600000000.0;
+	w.Step(start);
+
+	// Cover all levels, including the overflow slot.
+	std::vector<double> offsets = { 0.0005, 0.002, 0.3, 0.25, 1.0, 70.0,
+	                                3000.0, 2000.0, 86400.0 * 30,
+	                                86400.0 * 100, 0.3 };
+
+	for ( auto o : offsets )
+		w.Add(new TestTimer(start + o, &fired));
+
+	CHECK(w.Size() == (int)offsets.size());
+	CHECK(w.CumulativeNum() == offsets.size());
+
+	CHECK(w.Step(start + 0.001) == 1);
+	CHECK(w.Step(start + 0.3) == 4);
+	CHECK(w.Step(start + 86400.0) == 4);
+	CHECK(w.Step(start + 86400.0 * 200) == 2);
+	CHECK(w.Size() == 0);
+
+	std::sort(offsets.begin(), offsets.end());
+	REQUIRE(fired.size() == offsets.size());
+
+	for ( size_t i = 0; i < offsets.size(); ++i )
+		CHECK(fired[i] == start + offsets[i]);
+	}
+
+TEST_CASE("wheel max expire")
+	{
+	TestWheel w;
+	std::vector<double> fired;
+
+	for ( int i = 0; i < 10; ++i )
+		w.Add(new TestTimer(10.0 + i, &fired));
+
+	CHECK(w.Step(100.0, 3) == 3);
+	CHECK(w.Size() == 7);
+	CHECK(w.Step(100.0) == 7);
+	CHECK((fired == std::vector<double>{ 10, 11, 12, 13, 14, 15, 16, 17, 18, 19 }));
+	}
+
+TEST_CASE("wheel cancel and expire")
+	{
+	TestWheel w;
+	std::vector<double> fired;
+	std::vector<Timer*> timers;
+
+	for ( int i = 0; i < 100; ++i )
+		{
+		auto timer = new TestTimer(5.0005 + i * 0.5, &fired);
+		timers.push_back(timer);
+		w.Add(timer);
+		}
+
+	// Cancel every other timer, both ones still in the wheel and ones
+	// already queued for dispatch.
+	CHECK(w.Step(5.0001) == 0);
+
+	for ( int i = 0; i < 100; i += 2 )
+		w.Cancel(timers[i]);
+
+	CHECK(w.Size() == 50);
+	CHECK(w.Step(30.0) == 25);
+	CHECK(w.PeakSize() == 100);
+
+	w.Expire();
+	CHECK(w.Size() == 0);
+	REQUIRE(fired.size() == 50);
+
+	for ( int i = 0; i < 50; ++i )
+		CHECK(fired[i] == 5.0005 + (2 * i + 1) * 0.5);
+	}
+
+TEST_SUITE_END();
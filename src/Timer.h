@@ -5,6 +5,8 @@
 #include "PriorityQueue.h"
 #include "iosource/IOSource.h"
 
+#include <vector>
+
 #include <stdint.h>
 
 // If you add a timer here, adjust TimerNames in Timer.cc.
@@ -63,8 +65,14 @@ public:
 	void Describe(ODesc* d) const;
 
 protected:
+	friend class Wheel_TimerMgr;
+
 	Timer()	{}
 	TimerType type;
+
+	// Index of the Wheel_TimerMgr slot holding the timer, or -1 if the
+	// timer isn't held in a slot.
+	int wheel_slot = -1;
 };
 
 class TimerMgr : public iosource::IOSource {
@@ -168,4 +176,82 @@ protected:
 	PriorityQueue* q;
 };
 
+/**
+ * A timer manager based on a hierarchical timing wheel. Timers scheduled
+ * into the future go into one of several levels of slots of increasingly
+ * coarse granularity, which makes adding and canceling them O(1). Slots
+ * of the coarser levels get redistributed into the finer ones as time
+ * passes. Timers that become due move into a small priority queue, from
+ * which they are dispatched in time order, just like with PQ_TimerMgr.
+ *
+ * This pays off when there are many timers that mostly get canceled
+ * before they fire, as is the case for connection timers.
+ */
+class Wheel_TimerMgr : public TimerMgr {
+public:
+	Wheel_TimerMgr();
+	~Wheel_TimerMgr() override;
+
+	void Add(Timer* timer) override;
+	void Expire() override;
+
+	int Size() const override { return wheel_size + q->Size(); }
+	int PeakSize() const override { return peak_size; }
+	uint64_t CumulativeNum() const override { return cumulative_num; }
+	double GetNextTimeout() override;
+
+	// Time resolution of the finest level, in seconds.
+	static constexpr double RESOLUTION = 0.001;
+
+	static constexpr int LEVEL_BITS = 8;
+	static constexpr int SLOTS_PER_LEVEL = 1 << LEVEL_BITS;
+	static constexpr int NUM_LEVELS = 4;
+
+protected:
+	int DoAdvance(double t, int max_expire) override;
+	void Remove(Timer* timer) override;
+
+	// Converts a time into wheel ticks.
+	static uint64_t ToTick(double t);
+
+	// Puts a timer into the right slot, or into the queue of due timers
+	// if its tick has been reached already.
+	void Place(Timer* timer);
+
+	// Removes a timer from the slot holding it.
+	void Unlink(Timer* timer);
+
+	// Moves the wheel forward to the given tick, moving all timers that
+	// become due into the queue.
+	void AdvanceTo(uint64_t tick);
+
+	// Redistributes all timers of a slot.
+	void Cascade(int slot);
+
+	// Returns the next tick at which a non-empty slot needs to be
+	// processed, or UINT64_MAX if all slots are empty.
+	uint64_t NextEventTick() const;
+
+	// Timers too far into the future for the wheel go into a single
+	// overflow slot following the regular ones.
+	static constexpr int OVERFLOW_SLOT = NUM_LEVELS * SLOTS_PER_LEVEL;
+
+	std::vector<std::vector<Timer*>> slots;
+
+	// One bit per regular slot, set if the slot isn't empty.
+	uint64_t occupied[NUM_LEVELS][SLOTS_PER_LEVEL / 64];
+
+	// Number of timers per level, with the last entry counting the
+	// overflow slot.
+	int level_size[NUM_LEVELS + 1];
+
+	// Timers that are due but haven't been dispatched yet.
+	PriorityQueue* q;
+
+	uint64_t cur_tick;
+	int wheel_size;
+	int peak_size;
+	uint64_t cumulative_num;
+};
+
 extern TimerMgr* timer_mgr;
@@ -1,6 +1,7 @@
 #include "Trigger.h"
 
 #include <algorithm>
+#include <unordered_set>
 
 #include <assert.h>
 
@@ -34,7 +35,12 @@ public:
 	virtual TraversalCode PreExpr(const zeek::detail::Expr*) override;
 
 private:
+	void RegisterKey(const zeek::detail::Expr* table, const zeek::detail::Expr* index);
+
 	Trigger* trigger;
+
+	// Names of tables registered just for the entries looked up.
+	std::unordered_set<const zeek::detail::Expr*> keyed_names;
 };
 
 TraversalCode zeek::detail::trigger::TriggerTraversalCallback::PreExpr(const zeek::detail::Expr* expr)
@@ -49,6 +55,9 @@ TraversalCode zeek::detail::trigger::TriggerTraversalCallback::PreExpr(const zee
 		if ( e->Id()->IsGlobal() )
 			trigger->Register(e->Id());
 
+		if ( keyed_names.count(e) )
+			break;
+
 		Val* v = e->Id()->GetVal().get();
 
 		if ( v && v->Modifiable() )
@@ -59,6 +68,8 @@ TraversalCode zeek::detail::trigger::TriggerTraversalCallback::PreExpr(const zee
 	case EXPR_INDEX:
 		{
 		const auto* e = static_cast<const zeek::detail::IndexExpr*>(expr);
+		RegisterKey(e->Op1(), e->Op2());
+
 		Obj::SuppressErrors no_errors;
 
 		try
@@ -74,6 +85,13 @@ TraversalCode zeek::detail::trigger::TriggerTraversalCallback::PreExpr(const zee
 		break;
 		}
 
+	case EXPR_IN:
+		{
+		const auto* e = static_cast<const zeek::detail::InExpr*>(expr);
+		RegisterKey(e->Op2(), e->Op1());
+		break;
+		}
+
 	default:
 		// All others are uninteresting.
 		break;
@@ -82,6 +100,52 @@ TraversalCode zeek::detail::trigger::TriggerTraversalCallback::PreExpr(const zee
 	return TC_CONTINUE;
 	}
 
+// If the expression looks up an entry of a global table, registers for
+// modifications of just that entry rather than the whole table, so that
+// unrelated insertions and removals don't requeue the trigger.
+void TriggerTraversalCallback::RegisterKey(const zeek::detail::Expr* table,
+                                           const zeek::detail::Expr* index)
+	{
+	if ( table->Tag() != EXPR_NAME )
+		return;
+
+	const auto* name = static_cast<const zeek::detail::NameExpr*>(table);
+
+	if ( ! name->Id()->IsGlobal() )
+		return;
+
+	const auto& v = name->Id()->GetVal();
+
+	if ( ! v || v->GetType()->Tag() != zeek::TYPE_TABLE || ! v->Modifiable() )
+		return;
+
+	auto tv = v->AsTableVal();
+
+	// Subnet indices match by prefix, not by key.
+	if ( tv->Subnets() )
+		return;
+
+	Obj::SuppressErrors no_errors;
+
+	try
+		{
+		auto iv = index->Eval(trigger->frame);
+
+		if ( ! iv || iv->GetType()->Tag() != zeek::TYPE_LIST )
+			return;
+
+		auto k = tv->MakeHashKey(*iv);
+
+		if ( ! k )
+			return;
+
+		trigger->Register(v.get(), k->Hash());
+		keyed_names.insert(name);
+		}
+	catch ( InterpreterException& )
+		{ /* Already reported */ }
+	}
+
 class TriggerTimer final : public Timer {
 public:
 	TriggerTimer(double arg_timeout, Trigger* arg_trigger)
@@ -120,13 +184,16 @@ protected:
 Trigger::Trigger(zeek::detail::Expr* arg_cond, zeek::detail::Stmt* arg_body,
 			zeek::detail::Stmt* arg_timeout_stmts,
 			zeek::detail::Expr* arg_timeout, Frame* arg_frame,
-			bool arg_is_return, const Location* arg_location)
+			bool arg_is_return, const Location* arg_location,
+			const std::vector<int>* captures)
 	{
 	cond = arg_cond;
 	body = arg_body;
 	timeout_stmts = arg_timeout_stmts;
 	timeout = arg_timeout;
-	frame = arg_frame->Clone();
+	// Later evaluations clone this frame again, which then skips over
+	// the values left out here.
+	frame = captures ? arg_frame->CloneOffsets(*captures) : arg_frame->Clone();
 	timer = nullptr;
 	delayed = false;
 	disabled = false;
@@ -239,6 +306,8 @@ bool Trigger::Eval()
 		return false;
 		}
 
+	++trigger_mgr->total_evaluations;
+
 	// It's unfortunate that we have to copy the frame again here but
 	// otherwise changes to any of the locals would propagate to later
 	// evaluations.
@@ -406,6 +475,18 @@ void Trigger::Register(Val* val)
 	objs.emplace_back(val, val->Modifiable());
 	}
 
+void Trigger::Register(Val* val, uint64_t key)
+	{
+	if ( ! val->Modifiable() )
+		return;
+
+	assert(! disabled);
+	notifier::registry.Register(val->Modifiable(), this, key);
+
+	Ref(val);
+	keyed_objs.emplace_back(val, val->Modifiable(), key);
+	}
+
 void Trigger::UnregisterAll()
 	{
 	DBG_LOG(DBG_NOTIFIERS, "%s: unregistering all", Name());
@@ -417,6 +498,14 @@ void Trigger::UnregisterAll()
 		}
 
 	objs.clear();
+
+	for ( const auto& o : keyed_objs )
+		{
+		notifier::registry.Unregister(std::get<1>(o), this, std::get<2>(o));
+		Unref(std::get<0>(o));
+		}
+
+	keyed_objs.clear();
 	}
 
 void Trigger::Attach(Trigger *trigger)
@@ -548,6 +637,7 @@ void Manager::GetStats(Stats* stats)
 	{
 	stats->total = total_triggers;
 	stats->pending = pending->size();
+	stats->evaluations = total_evaluations;
 	}
 
 }
@@ -3,6 +3,7 @@
 #include <list>
 #include <vector>
 #include <map>
+#include <tuple>
 
 #include "Obj.h"
 #include "Notifier.h"
@@ -33,8 +34,12 @@ public:
 	// instantiation.  Note that if the condition is already true, the
 	// statements are executed immediately and the object is deleted
 	// right away.
+	//
+	// If given, *captures* holds the offsets of the frame's values that
+	// the statements and expressions use; only those get copied.
 	Trigger(zeek::detail::Expr* cond, zeek::detail::Stmt* body, zeek::detail::Stmt* timeout_stmts, zeek::detail::Expr* timeout,
-		Frame* f, bool is_return, const Location* loc);
+		Frame* f, bool is_return, const Location* loc,
+		const std::vector<int>* captures = nullptr);
 	~Trigger() override;
 
 	// Evaluates the condition. If true, executes the body and deletes
@@ -93,6 +98,7 @@ private:
 	void Init();
 	void Register(zeek::detail::ID* id);
 	void Register(Val* val);
+	void Register(Val* val, uint64_t key);
 	void UnregisterAll();
 
 	zeek::detail::Expr* cond;
@@ -112,6 +118,10 @@ private:
 
 	std::vector<std::pair<Obj *, notifier::Modifiable*>> objs;
 
+	// Tables of which the condition only looks up particular entries,
+	// with the hashes of their keys.
+	std::vector<std::tuple<Obj*, notifier::Modifiable*, uint64_t>> keyed_objs;
+
 	using ValCache = std::map<const zeek::detail::CallExpr*, Val*>;
 	ValCache cache;
 };
@@ -133,15 +143,18 @@ public:
 	struct Stats {
 		unsigned long total;
 		unsigned long pending;
+		unsigned long evaluations;
 	};
 
 	void GetStats(Stats* stats);
 
 private:
+	friend class Trigger;
 
 	using TriggerList = std::list<Trigger*>;
 	TriggerList* pending;
 	unsigned long total_triggers = 0;
+	unsigned long total_evaluations = 0;
 	};
 
 }
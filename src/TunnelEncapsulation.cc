@@ -41,6 +41,9 @@ bool operator==(const EncapsulationStack& e1, const EncapsulationStack& e2)
 	if ( ! e2.conns )
 		return false;
 
+	if ( e1.conns == e2.conns )
+		return true;
+
 	if ( e1.conns->size() != e2.conns->size() )
 		return false;
 
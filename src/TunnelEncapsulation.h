@@ -4,6 +4,7 @@
 
 #include "zeek-config.h"
 
+#include <memory>
 #include <vector>
 
 #include "NetVar.h"
@@ -129,37 +130,25 @@ protected:
 };
 
 /**
- * Abstracts an arbitrary amount of nested tunneling.
+ * Abstracts an arbitrary amount of nested tunneling.  Copies of a stack
+ * share its tunnels until one of them gets another one added.
  */
 class EncapsulationStack {
 public:
-	EncapsulationStack() : conns(nullptr)
+	EncapsulationStack()
 		{}
 
 	EncapsulationStack(const EncapsulationStack& other)
-		{
-		if ( other.conns )
-			conns = new std::vector<EncapsulatingConn>(*(other.conns));
-		else
-			conns = nullptr;
-		}
+		: conns(other.conns)
+		{}
 
 	EncapsulationStack& operator=(const EncapsulationStack& other)
 		{
-		if ( this == &other )
-			return *this;
-
-		delete conns;
-
-		if ( other.conns )
-			conns = new std::vector<EncapsulatingConn>(*(other.conns));
-		else
-			conns = nullptr;
-
+		conns = other.conns;
 		return *this;
 		}
 
-	~EncapsulationStack() { delete conns; }
+	~EncapsulationStack() {}
 
 	/**
 	 * Add a new inner-most tunnel to the EncapsulationStack.
@@ -169,7 +158,16 @@ public:
 	void Add(const EncapsulatingConn& c)
 		{
 		if ( ! conns )
-			conns = new std::vector<EncapsulatingConn>();
+			conns = std::make_shared<std::vector<EncapsulatingConn>>();
+
+		else if ( conns.use_count() > 1 )
+			{
+			// Leave the tunnels of the other copies alone.
+			auto copy = std::make_shared<std::vector<EncapsulatingConn>>();
+			copy->reserve(conns->size() + 1);
+			copy->insert(copy->end(), conns->begin(), conns->end());
+			conns = std::move(copy);
+			}
 
 		conns->push_back(c);
 		}
@@ -223,5 +221,5 @@ public:
 		}
 
 protected:
-	std::vector<EncapsulatingConn>* conns;
+	std::shared_ptr<std::vector<EncapsulatingConn>> conns;
 };
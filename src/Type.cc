@@ -19,6 +19,7 @@
 #include <string>
 #include <list>
 #include <map>
+#include <unordered_map>
 
 using namespace std;
 
@@ -790,6 +791,8 @@ TypePtr RecordType::ShallowClone()
 	return zeek::make_intrusive<RecordType>(pass);
 	}
 
+uint64_t RecordType::fields_generation = 1;
+
 RecordType::~RecordType()
 	{
 	if ( types )
@@ -817,6 +820,34 @@ ValPtr RecordType::FieldDefault(int field) const
 	return def_attr ? def_attr->GetExpr()->Eval(nullptr) : nullptr;
 	}
 
+const RecordType::Coercion& RecordType::CoercionFrom(const RecordType* other) const
+	{
+	auto& c = coercions[other];
+
+	if ( c.generation == fields_generation )
+		return c;
+
+	c.compatible = record_promotion_compatible(this, other);
+	c.identical = same_type(*this, *other);
+
+	c.offsets.resize(other->NumFields());
+
+	for ( int i = 0; i < other->NumFields(); ++i )
+		c.offsets[i] = FieldOffset(other->FieldName(i));
+
+	c.required.clear();
+
+	for ( int i = 0; i < num_fields; ++i )
+		if ( ! FieldHasAttr(i, zeek::detail::ATTR_OPTIONAL) )
+			c.required.push_back(i);
+
+	if ( other != this )
+		c.other = {zeek::NewRef{}, const_cast<RecordType*>(other)};
+
+	c.generation = fields_generation;
+	return c;
+	}
+
 int RecordType::FieldOffset(const char* field) const
 	{
 	loop_over_list(*types, i)
@@ -978,6 +1009,7 @@ const char* RecordType::AddFields(const type_decl_list& others,
 		}
 
 	num_fields = types->length();
+	++fields_generation;
 	RecordVal::ResizeParseTimeRecords(this);
 	TableVal::RebuildParseTimeTables();
 	return nullptr;
@@ -1516,6 +1548,52 @@ static bool is_init_compat(const Type& t1, const Type& t2)
 	return false;
 	}
 
+namespace {
+
+struct SameTypeKey {
+	const Type* t1;
+	const Type* t2;
+	int flags;
+
+	bool operator==(const SameTypeKey& other) const
+		{ return t1 == other.t1 && t2 == other.t2 && flags == other.flags; }
+};
+
+struct SameTypeKeyHash {
+	size_t operator()(const SameTypeKey& k) const
+		{
+		auto h = std::hash<const Type*>{}(k.t1);
+		h ^= std::hash<const Type*>{}(k.t2) + 0x9e3779b9 + (h << 6) + (h >> 2);
+		return h ^ k.flags;
+		}
+};
+
+struct SameTypeResult {
+	bool same;
+	uint64_t generation;
+
+	// Keep both types around, so that their addresses can't get reused
+	// while they identify this entry.
+	TypePtr t1;
+	TypePtr t2;
+};
+
+using SameTypeCache = std::unordered_map<SameTypeKey, SameTypeResult, SameTypeKeyHash>;
+
+} // namespace
+
+// Bounds the memory the cache below can take up, and the types it keeps
+// alive.  Exceeding it starts over with an empty cache.
+static constexpr size_t max_same_type_cache_size = 65536;
+
+// Remembers the outcome of comparing two types whose comparison walks
+// their structure, such as records with many nested fields.  Never
+// destroyed, to not unref types at exit.
+static SameTypeCache* same_type_cache = new SameTypeCache;
+
+static bool same_type_structure(const Type* t1, const Type* t2,
+                                bool is_init, bool match_record_field_names);
+
 bool same_type(const Type& arg_t1, const Type& arg_t2,
                bool is_init, bool match_record_field_names)
 	{
@@ -1538,6 +1616,42 @@ bool same_type(const Type& arg_t1, const Type& arg_t2,
 		return false;
 		}
 
+	switch ( t1->Tag() ) {
+	case TYPE_TABLE:
+	case TYPE_FUNC:
+	case TYPE_RECORD:
+	case TYPE_VECTOR:
+		break;
+
+	default:
+		// Comparing the remaining types is cheap, and type lists
+		// still grow while they get built.
+		return same_type_structure(t1, t2, is_init, match_record_field_names);
+	}
+
+	// The structure of these types can only change through redefs
+	// adding fields to records, which invalidates the entries.
+	SameTypeKey key{t1, t2, (is_init ? 1 : 0) | (match_record_field_names ? 2 : 0)};
+	auto generation = RecordType::FieldsGeneration();
+	auto it = same_type_cache->find(key);
+
+	if ( it != same_type_cache->end() && it->second.generation == generation )
+		return it->second.same;
+
+	auto same = same_type_structure(t1, t2, is_init, match_record_field_names);
+
+	if ( same_type_cache->size() >= max_same_type_cache_size )
+		same_type_cache->clear();
+
+	(*same_type_cache)[key] = {same, generation,
+	                           {zeek::NewRef{}, const_cast<Type*>(t1)},
+	                           {zeek::NewRef{}, const_cast<Type*>(t2)}};
+	return same;
+	}
+
+static bool same_type_structure(const Type* t1, const Type* t2,
+                                bool is_init, bool match_record_field_names)
+	{
 	switch ( t1->Tag() ) {
 	case TYPE_VOID:
 	case TYPE_BOOL:
@@ -636,11 +636,53 @@ public:
 
 	std::string GetFieldDeprecationWarning(int field, bool has_check) const;
 
+	// How RecordVal::CoerceTo() maps the fields of records of another
+	// type onto this one's.
+	struct Coercion {
+		// Whether the other type's records can be coerced to this type
+		// at all, see record_promotion_compatible().
+		bool compatible = false;
+
+		// Whether both types are the same per same_type(), so that
+		// records need no coercion.
+		bool identical = false;
+
+		// For each field of the other type, its offset in this type,
+		// or -1 if it has no counterpart.
+		std::vector<int> offsets;
+
+		// Offsets of this type's fields that are not &optional.
+		std::vector<int> required;
+
+		// Keeps the other type around, so that its address can't get
+		// reused while it identifies this entry.
+		TypePtr other;
+		uint64_t generation = 0;
+	};
+
+	/**
+	 * Returns how to coerce records of another type to this one. It's
+	 * worked out on first use, and again only if any record type has
+	 * gained fields since.
+	 */
+	const Coercion& CoercionFrom(const RecordType* other) const;
+
+	/**
+	 * Returns a counter that changes whenever any record type gains
+	 * fields, for invalidating what's derived from record structures.
+	 */
+	static uint64_t FieldsGeneration()	{ return fields_generation; }
+
 protected:
 	RecordType() { types = nullptr; }
 
 	int num_fields;
 	type_decl_list* types;
+
+	mutable std::unordered_map<const RecordType*, Coercion> coercions;
+
+	// Counts calls to AddFields(), which can change any coercion.
+	static uint64_t fields_generation;
 };
 
 class SubNetType final : public Type {
@@ -889,6 +931,9 @@ extern zeek::OpaqueTypePtr bloomfilter_type;
 extern zeek::OpaqueTypePtr x509_opaque_type;
 extern zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 extern zeek::OpaqueTypePtr paraglob_type;
+extern zeek::OpaqueTypePtr pattern_set_type;
+extern zeek::OpaqueTypePtr intel_store_type;
+extern zeek::OpaqueTypePtr sumstats_agg_type;
 
 using BroType [[deprecated("Remove in v4.1. Use zeek::Type instead.")]] = zeek::Type;
 using TypeList [[deprecated("Remove in v4.1. Use zeek::TypeList instead.")]] = zeek::TypeList;
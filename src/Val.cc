@@ -13,7 +13,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <set>
 
 #include "Attr.h"
@@ -35,6 +37,8 @@
 #include "Reporter.h"
 #include "IPAddr.h"
 #include "ID.h"
+#include "MemoryAccount.h"
+#include "FrozenTable.h"
 
 #include "broker/Data.h"
 #include "broker/Store.h"
@@ -116,6 +120,18 @@ CONVERTERS(zeek::TYPE_VECTOR, VectorVal*, Val::AsVectorVal)
 CONVERTERS(zeek::TYPE_ENUM, EnumVal*, Val::AsEnumVal)
 CONVERTERS(zeek::TYPE_OPAQUE, OpaqueVal*, Val::AsOpaqueVal)
 
+const PDict<TableEntryVal>* Val::AsTable() const
+	{
+	AsTableVal()->Thaw();
+	return val.table_val;
+	}
+
+PDict<TableEntryVal>* Val::AsNonConstTable()
+	{
+	AsTableVal()->Thaw();
+	return val.table_val;
+	}
+
 ValPtr Val::CloneState::NewClone(Val* src, ValPtr dst)
 	{
 	clones.insert(std::make_pair(src, dst.get()));
@@ -1085,19 +1101,19 @@ StringValPtr StringVal::Replace(
 		{
 		// Find next match offset.
 		int end_of_match;
-		while ( n > 0 &&
-		        (end_of_match = re->MatchPrefix(&s[offset], n)) <= 0 )
-			{
-			// This character is going to be copied to the result.
-			++size;
+		int skip = re->FindPrefixMatch(&s[offset], n, &end_of_match);
 
-			// Move on to next character.
-			++offset;
-			--n;
+		if ( skip < 0 )
+			{
+			// The rest is going to be copied to the result.
+			size += n;
+			break;
 			}
 
-		if ( n <= 0 )
-			break;
+		// The characters before the match are going to be copied.
+		size += skip;
+		offset += skip;
+		n -= skip;
 
 		// s[offset .. offset+end_of_match-1] matches re.
 		cut_points.push_back({offset, offset + end_of_match});
@@ -1342,6 +1358,7 @@ TableEntryVal* TableEntryVal::Clone(Val::CloneState* state)
 	{
 	auto rval = new TableEntryVal(val ? val->Clone(state) : nullptr);
 	rval->expire_access_time = expire_access_time;
+	rval->index = index;
 	return rval;
 	}
 
@@ -1364,6 +1381,30 @@ void TableValTimer::Dispatch(double t, bool is_expire)
 		}
 	}
 
+// Returns true if values of the given type can't be modified in place,
+// so that copies of containers holding them may share them.
+static bool is_immutable_type(const Type* t)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_BOOL:
+	case TYPE_INT:
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+	case TYPE_DOUBLE:
+	case TYPE_TIME:
+	case TYPE_INTERVAL:
+	case TYPE_STRING:
+	case TYPE_PORT:
+	case TYPE_ADDR:
+	case TYPE_SUBNET:
+	case TYPE_ENUM:
+		return true;
+
+	default:
+		return false;
+	}
+	}
+
 static void table_entry_val_delete_func(void* val)
 	{
 	TableEntryVal* tv = (TableEntryVal*) val;
@@ -1435,7 +1476,6 @@ void TableVal::Init(TableTypePtr t)
 	table_type = std::move(t);
 	expire_func = nullptr;
 	expire_time = nullptr;
-	expire_cookie = nullptr;
 	timer = nullptr;
 	def_val = nullptr;
 
@@ -1445,8 +1485,17 @@ void TableVal::Init(TableTypePtr t)
 		subnets = nullptr;
 
 	table_hash = new CompositeHash(table_type->GetIndices());
-	val.table_val = new PDict<zeek::TableEntryVal>;
-	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+
+	// Atomic values can't change, so their lists can be handed out
+	// repeatedly.
+	const auto& itypes = table_type->GetIndexTypes();
+	cache_indices = itypes.size() > 1 &&
+		std::all_of(itypes.begin(), itypes.end(),
+		            [](const TypePtr& t) { return is_atomic_type(t); });
+
+	entries = std::make_shared<PDict<zeek::TableEntryVal>>();
+	entries->SetDeleteFunc(table_entry_val_delete_func);
+	val.table_val = entries.get();
 	}
 
 TableVal::~TableVal()
@@ -1455,31 +1504,82 @@ TableVal::~TableVal()
 		timer_mgr->Cancel(timer);
 
 	delete table_hash;
-	delete AsTable();
 	delete subnets;
 	}
 
 void TableVal::RemoveAll()
 	{
+	if ( CheckReadOnly() )
+		return;
+
+	auto account = memory_account;
+	int64_t before = 0;
+
+	if ( account )
+		{
+		before = MemoryAllocation();
+		detail::set_memory_account(this, account, nullptr);
+		}
+
 	// Here we take the brute force approach.
-	delete AsTable();
-	val.table_val = new PDict<zeek::TableEntryVal>;
-	val.table_val->SetDeleteFunc(table_entry_val_delete_func);
+	entries = std::make_shared<PDict<zeek::TableEntryVal>>();
+	entries->SetDeleteFunc(table_entry_val_delete_func);
+	val.table_val = entries.get();
+	expire_index = nullptr;
+
+	if ( account )
+		{
+		memory_account = account;
+		account->Adjust(int64_t(MemoryAllocation()) - before);
+		}
+	}
+
+void TableVal::StartBulkUpdate(int num_entries)
+	{
+	if ( CheckReadOnly() )
+		return;
+
+	MakeUnique();
+	AsNonConstTable()->Reserve(Size() + num_entries);
+	in_bulk_update = true;
+	}
+
+void TableVal::EndBulkUpdate()
+	{
+	in_bulk_update = false;
+
+	if ( bulk_modified )
+		{
+		bulk_modified = false;
+		Modified();
+		}
 	}
 
 int TableVal::Size() const
 	{
+	if ( frozen )
+		return frozen->Size();
+
 	return AsTable()->Length();
 	}
 
 int TableVal::RecursiveSize() const
 	{
-	int n = AsTable()->Length();
+	int n = Size();
 
 	if ( GetType()->IsSet() ||
 	     GetType()->AsTableType()->Yield()->Tag() != TYPE_TABLE )
 		return n;
 
+	if ( frozen )
+		{
+		for ( int i = 0; i < frozen->Size(); ++i )
+			if ( const auto& v = frozen->Value(i) )
+				n += v->AsTableVal()->RecursiveSize();
+
+		return n;
+		}
+
 	PDict<zeek::TableEntryVal>* v = val.table_val;
 	IterCookie* c = v->InitForIteration();
 
@@ -1544,6 +1644,9 @@ void TableVal::CheckExpireAttr(detail::AttrTag at)
 		if ( timer )
 			timer_mgr->Cancel(timer);
 
+		// Expiration updates the entries' access times.
+		MakeUnique();
+
 		// As network_time is not necessarily initialized yet,
 		// we set a timer which fires immediately.
 		timer = new TableValTimer(this, 1);
@@ -1553,7 +1656,8 @@ void TableVal::CheckExpireAttr(detail::AttrTag at)
 
 bool TableVal::Assign(ValPtr index, ValPtr new_val, bool broker_forward)
 	{
-	auto k = MakeHashKey(*index);
+	LookupHashKey lk;
+	auto k = table_hash->MakeLookupKey(*index, true, lk);
 
 	if ( ! k )
 		{
@@ -1561,7 +1665,7 @@ bool TableVal::Assign(ValPtr index, ValPtr new_val, bool broker_forward)
 		return false;
 		}
 
-	return Assign(std::move(index), std::move(k), std::move(new_val), broker_forward);
+	return DoAssign(std::move(index), *k, std::move(new_val), broker_forward);
 	}
 
 bool TableVal::Assign(Val* index, Val* new_val)
@@ -1572,25 +1676,38 @@ bool TableVal::Assign(Val* index, Val* new_val)
 bool TableVal::Assign(ValPtr index, std::unique_ptr<HashKey> k,
                       ValPtr new_val, bool broker_forward)
 	{
+	return DoAssign(std::move(index), *k, std::move(new_val), broker_forward);
+	}
+
+bool TableVal::DoAssign(ValPtr index, const HashKey& k, ValPtr new_val,
+                        bool broker_forward)
+	{
 	bool is_set = table_type->IsSet();
 
 	if ( (is_set && new_val) || (! is_set && ! new_val) )
 		InternalWarning("bad set/table in TableVal::Assign");
 
+	if ( CheckReadOnly() )
+		return false;
+
+	MakeUnique();
+
 	TableEntryVal* new_entry_val = new TableEntryVal(std::move(new_val));
-	HashKey k_copy(k->Key(), k->Size(), k->Hash());
-	TableEntryVal* old_entry_val = AsNonConstTable()->Insert(k.get(), new_entry_val);
+	unsigned int table_before = memory_account ? AsTable()->TableAllocation() : 0;
 
-	// If the dictionary index already existed, the insert may free up the
-	// memory allocated to the key bytes, so have to assume k is invalid
-	// from here on out.
-	k = nullptr;
+	// The dictionary gets its own copy of the key, so that k stays
+	// valid even if it replaces an existing entry.
+	auto old_entry_val = static_cast<TableEntryVal*>(
+		AsNonConstTable()->InsertCopy(k.Key(), k.Size(), k.Hash(), new_entry_val));
+
+	if ( memory_account )
+		AccountEntries(new_entry_val, old_entry_val, k.Size(), table_before);
 
 	if ( subnets )
 		{
 		if ( ! index )
 			{
-			auto v = RecreateIndex(k_copy);
+			auto v = RecreateIndex(k);
 			subnets->Insert(v.get(), new_entry_val);
 			}
 		else
@@ -1601,12 +1718,21 @@ bool TableVal::Assign(ValPtr index, std::unique_ptr<HashKey> k,
 	if ( old_entry_val && attrs && attrs->Find(detail::ATTR_EXPIRE_CREATE) )
 		new_entry_val->SetExpireAccess(old_entry_val->ExpireAccessTime());
 
-	Modified();
+	if ( expire_index )
+		{
+		// A replacement takes over the old entry's record.
+		if ( old_entry_val )
+			new_entry_val->expire_index_time = old_entry_val->expire_index_time;
+		else
+			IndexForExpiration(new_entry_val, k.Hash());
+		}
+
+	NoteModified(k.Hash());
 
 	if ( change_func || ( broker_forward && ! broker_store.empty() ) )
 		{
 		auto change_index = index ? std::move(index)
-		                          : RecreateIndex(k_copy);
+		                          : RecreateIndex(k);
 
 		if ( broker_forward && ! broker_store.empty() )
 			SendToStore(change_index.get(), new_entry_val, old_entry_val ? ELEMENT_CHANGED : ELEMENT_NEW);
@@ -1686,6 +1812,68 @@ bool TableVal::AddTo(Val* val, bool is_first_init, bool propagate_ops) const
 	return true;
 	}
 
+bool TableVal::Freeze()
+	{
+	const char* problem = nullptr;
+
+	if ( subnets )
+		problem = "it is indexed by subnets";
+	else if ( expire_time )
+		problem = "its entries expire";
+	else if ( ! broker_store.empty() )
+		problem = "it is backed by a Broker store";
+
+	if ( problem )
+		{
+		reporter->Error("cannot freeze table: %s", problem);
+		return false;
+		}
+
+	read_only = true;
+
+	if ( frozen )
+		return true;
+
+	int64_t before = memory_account ? MemoryAllocation() : 0;
+
+	frozen = std::make_shared<detail::FrozenTable>(*entries, table_type->IsSet());
+
+	// Copies keep the entries they share.
+	entries = std::make_shared<PDict<zeek::TableEntryVal>>();
+	entries->SetDeleteFunc(table_entry_val_delete_func);
+	val.table_val = entries.get();
+
+	if ( memory_account )
+		memory_account->Adjust(int64_t(MemoryAllocation()) - before);
+
+	return true;
+	}
+
+void TableVal::RestoreEntries()
+	{
+	int64_t before = memory_account ? MemoryAllocation() : 0;
+
+	auto restored = std::make_shared<PDict<zeek::TableEntryVal>>();
+	restored->SetDeleteFunc(table_entry_val_delete_func);
+	frozen->Restore(restored.get());
+
+	entries = std::move(restored);
+	val.table_val = entries.get();
+	frozen = nullptr;
+
+	if ( memory_account )
+		memory_account->Adjust(int64_t(MemoryAllocation()) - before);
+	}
+
+bool TableVal::CheckReadOnly() const
+	{
+	if ( ! read_only )
+		return false;
+
+	reporter->Error("cannot modify a frozen table");
+	return true;
+	}
+
 bool TableVal::RemoveFrom(Val* val) const
 	{
 	if ( val->GetType()->Tag() != TYPE_TABLE )
@@ -1960,15 +2148,31 @@ const ValPtr& TableVal::Find(const ValPtr& index)
 		return Val::nil;
 		}
 
+	if ( frozen )
+		{
+		LookupHashKey lk;
+		auto k = table_hash->MakeLookupKey(*index, true, lk);
+		int i = k ? frozen->Find(*k) : -1;
+
+		if ( i < 0 )
+			return Val::nil;
+
+		if ( const auto& v = frozen->Value(i) )
+			return v;
+
+		return zeek::val_mgr->True();
+		}
+
 	const PDict<zeek::TableEntryVal>* tbl = AsTable();
 
 	if ( tbl->Length() > 0 )
 		{
-		auto k = MakeHashKey(*index);
+		LookupHashKey lk;
+		auto k = table_hash->MakeLookupKey(*index, true, lk);
 
 		if ( k )
 			{
-			TableEntryVal* v = AsTable()->Lookup(k.get());
+			TableEntryVal* v = AsTable()->Lookup(k);
 
 			if ( v )
 				{
@@ -2060,12 +2264,13 @@ bool TableVal::UpdateTimestamp(Val* index)
 		v = (TableEntryVal*) subnets->Lookup(index);
 	else
 		{
-		auto k = MakeHashKey(*index);
+		LookupHashKey lk;
+		auto k = table_hash->MakeLookupKey(*index, true, lk);
 
 		if ( ! k )
 			return false;
 
-		v = AsTable()->Lookup(k.get());
+		v = AsTable()->Lookup(k);
 		}
 
 	if ( ! v )
@@ -2081,6 +2286,29 @@ ListValPtr TableVal::RecreateIndex(const HashKey& k) const
 	return table_hash->RecoverVals(k);
 	}
 
+ListValPtr TableVal::EntryIndex(TableEntryVal* entry, const HashKey& k) const
+	{
+	if ( entry->index )
+		return entry->index;
+
+	auto lv = RecreateIndex(k);
+
+	if ( cache_indices && ! memory_account && Size() <= table_index_cache_max )
+		entry->index = lv;
+
+	return lv;
+	}
+
+bool TableVal::HasAtomicIndex() const
+	{
+	return table_hash->Atomic() != CompositeHash::AtomicIndex::NONE;
+	}
+
+ValPtr TableVal::RecreateAtomicIndex(const void* key, int key_size) const
+	{
+	return table_hash->RecoverAtomicVal(key, key_size);
+	}
+
 void TableVal::CallChangeFunc(const ValPtr& index,
                               const ValPtr& old_value,
                               OnChangeType tpe)
@@ -2219,7 +2447,7 @@ void TableVal::SendToStore(const Val* index, const TableEntryVal* new_entry_val,
 					}
 
 				if ( table_type->IsSet() )
-					handle->store.put(std::move(*broker_index), broker::data(), expiry);
+					broker_mgr->StorePut(handle, std::move(*broker_index), broker::data(), expiry);
 				else
 					{
 					if ( ! new_entry_val )
@@ -2236,13 +2464,13 @@ void TableVal::SendToStore(const Val* index, const TableEntryVal* new_entry_val,
 						return;
 						}
 
-					handle->store.put(std::move(*broker_index), std::move(*broker_val), expiry);
+					broker_mgr->StorePut(handle, std::move(*broker_index), std::move(*broker_val), expiry);
 					}
 				break;
 				}
 
 			case ELEMENT_REMOVED:
-				handle->store.erase(std::move(*broker_index));
+				broker_mgr->StoreErase(handle, std::move(*broker_index));
 				break;
 
 			case ELEMENT_EXPIRED:
@@ -2259,11 +2487,21 @@ void TableVal::SendToStore(const Val* index, const TableEntryVal* new_entry_val,
 
 ValPtr TableVal::Remove(const Val& index, bool broker_forward)
 	{
-	auto k = MakeHashKey(index);
+	LookupHashKey lk;
+	auto k = table_hash->MakeLookupKey(index, true, lk);
+
+	if ( CheckReadOnly() )
+		return nullptr;
 
-	TableEntryVal* v = k ? AsNonConstTable()->RemoveEntry(k.get()) : nullptr;
+	MakeUnique();
+
+	unsigned int table_before = memory_account ? AsTable()->TableAllocation() : 0;
+	TableEntryVal* v = k ? AsNonConstTable()->RemoveEntry(k) : nullptr;
 	ValPtr va;
 
+	if ( v && memory_account )
+		AccountEntries(nullptr, v, k->Size(), table_before);
+
 	if ( v )
 		va = v->GetVal() ? v->GetVal() : IntrusivePtr{NewRef{}, this};
 
@@ -2272,7 +2510,10 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward)
 
 	delete v;
 
-	Modified();
+	if ( k )
+		NoteModified(k->Hash());
+	else
+		NoteModified();
 
 	if ( broker_forward && ! broker_store.empty() )
 		SendToStore(&index, nullptr, ELEMENT_REMOVED);
@@ -2280,7 +2521,7 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward)
 	if ( change_func )
 		{
 		// this is totally cheating around the fact that we need a Intrusive pointer.
-		ValPtr changefunc_val = RecreateIndex(*(k.get()));
+		ValPtr changefunc_val = RecreateIndex(*k);
 		CallChangeFunc(changefunc_val, va, ELEMENT_REMOVED);
 		}
 
@@ -2289,9 +2530,18 @@ ValPtr TableVal::Remove(const Val& index, bool broker_forward)
 
 ValPtr TableVal::Remove(const HashKey& k)
 	{
+	if ( CheckReadOnly() )
+		return nullptr;
+
+	MakeUnique();
+
+	unsigned int table_before = memory_account ? AsTable()->TableAllocation() : 0;
 	TableEntryVal* v = AsNonConstTable()->RemoveEntry(k);
 	ValPtr va;
 
+	if ( v && memory_account )
+		AccountEntries(nullptr, v, k.Size(), table_before);
+
 	if ( v )
 		va = v->GetVal() ? v->GetVal() : IntrusivePtr{NewRef{}, this};
 
@@ -2305,7 +2555,7 @@ ValPtr TableVal::Remove(const HashKey& k)
 
 	delete v;
 
-	Modified();
+	NoteModified(k.Hash());
 
 	if ( va && ( change_func || ! broker_store.empty() ) )
 		{
@@ -2540,8 +2790,6 @@ void TableVal::DoExpire(double t)
 	if ( ! type )
 		return; // FIX ME ###
 
-	PDict<zeek::TableEntryVal>* tbl = AsNonConstTable();
-
 	double timeout = GetExpireTime();
 
 	if ( timeout < 0 )
@@ -2549,96 +2797,172 @@ void TableVal::DoExpire(double t)
 		// error, it has been reported already.
 		return;
 
-	if ( ! expire_cookie )
-		{
-		expire_cookie = tbl->InitForIteration();
-		tbl->MakeRobustCookie(expire_cookie);
-		}
+	if ( ! expire_index )
+		BuildExpireIndex();
 
-	HashKey* k = nullptr;
-	TableEntryVal* v = nullptr;
-	TableEntryVal* v_saved = nullptr;
 	bool modified = false;
+	int i = 0;
+	int index_time = std::numeric_limits<int>::min();
 
-	for ( int i = 0; i < table_incremental_step &&
-			 (v = tbl->NextEntry(k, expire_cookie)); ++i )
+	// We look up the next record from scratch each time, as expiring
+	// an entry runs script code that may change the index.
+	while ( expire_index && i < table_incremental_step )
 		{
-		if ( v->ExpireAccessTime() == 0 )
+		auto it = expire_index->lower_bound(index_time);
+
+		if ( it == expire_index->end() )
+			break;
+
+		index_time = it->first;
+		double access_time = bro_start_network_time + index_time;
+
+		// The records are in time order, so none of the rest is due
+		// either.
+		if ( access_time + timeout >= t )
+			break;
+
+		if ( it->second.empty() )
+			{
+			expire_index->erase(it);
+			continue;
+			}
+
+		if ( access_time == 0 )
 			{
 			// This happens when we insert val while network_time
 			// hasn't been initialized yet (e.g. in zeek_init()), and
 			// also when bro_start_network_time hasn't been initialized
 			// (e.g. before first packet).  The expire_access_time is
 			// correct, so we just need to wait.
+			++index_time;
+			continue;
 			}
 
-		else if ( v->ExpireAccessTime() + timeout < t )
+		hash_t hash = it->second.front();
+		it->second.pop_front();
+		++i;
+
+		if ( ExpireIndexed(hash, index_time, timeout, t) )
+			modified = true;
+		}
+
+	if ( modified )
+		NoteModified();
+
+	if ( i < table_incremental_step )
+		InitTimer(table_expire_interval);
+	else
+		InitTimer(table_expire_delay);
+	}
+
+void TableVal::BuildExpireIndex()
+	{
+	expire_index = std::make_unique<ExpireIndex>();
+
+	const PDict<zeek::TableEntryVal>* tbl = AsTable();
+	IterCookie* c = tbl->InitForIteration();
+
+	HashKey* k;
+	TableEntryVal* v;
+	while ( (v = tbl->NextEntry(k, c)) )
+		{
+		IndexForExpiration(v, k->Hash());
+		delete k;
+		}
+	}
+
+void TableVal::IndexForExpiration(TableEntryVal* v, hash_t hash)
+	{
+	if ( ! expire_index )
+		return;
+
+	v->expire_index_time = v->expire_access_time;
+	(*expire_index)[v->expire_index_time].push_back(hash);
+	}
+
+bool TableVal::ExpireIndexed(hash_t hash, int index_time, double timeout, double t)
+	{
+	PDict<zeek::TableEntryVal>* tbl = AsNonConstTable();
+
+	std::vector<Dictionary::HashMatch> matches;
+	tbl->LookupHash(hash, &matches);
+
+	TableEntryVal* v = nullptr;
+	std::unique_ptr<HashKey> k;
+
+	for ( const auto& m : matches )
+		{
+		auto e = static_cast<TableEntryVal*>(m.value);
+
+		if ( e->expire_index_time == index_time )
 			{
-			ListValPtr idx = nullptr;
+			v = e;
+			k = std::make_unique<HashKey>(m.key, m.key_size, hash);
+			break;
+			}
+		}
 
-			if ( expire_func )
-				{
-				idx = RecreateIndex(*k);
-				double secs = CallExpireFunc(idx);
-
-				// It's possible that the user-provided
-				// function modified or deleted the table
-				// value, so look it up again.
-				v_saved = v;
-				v = tbl->Lookup(k);
-
-				if ( ! v )
-					{ // user-provided function deleted it
-					v = v_saved;
-					delete k;
-					continue;
-					}
+	if ( ! v )
+		// The entry is gone, or listed under another time.
+		return false;
 
-				if ( secs > 0 )
-					{
-					// User doesn't want us to expire
-					// this now.
-					v->SetExpireAccess(network_time - timeout + secs);
-					delete k;
-					continue;
-					}
+	if ( v->expire_access_time > index_time )
+		{
+		// Accessed since it got listed.
+		IndexForExpiration(v, hash);
+		return false;
+		}
 
-				}
+	ListValPtr idx = nullptr;
 
-			if ( subnets )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
-				if ( ! subnets->Remove(idx.get()) )
-					reporter->InternalWarning("index not in prefix table");
-				}
+	if ( expire_func )
+		{
+		idx = RecreateIndex(*k);
+		double secs = CallExpireFunc(idx);
 
-			tbl->RemoveEntry(k);
-			if ( change_func )
-				{
-				if ( ! idx )
-					idx = RecreateIndex(*k);
+		// It's possible that the user-provided
+		// function modified or deleted the table
+		// value, so look it up again.
+		v = tbl->Lookup(k.get());
 
-				CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
-				}
+		if ( ! v )
+			// user-provided function deleted it
+			return false;
 
-			delete v;
-			modified = true;
+		if ( secs > 0 )
+			{
+			// User doesn't want us to expire
+			// this now.
+			v->SetExpireAccess(network_time - timeout + secs);
+			IndexForExpiration(v, hash);
+			return false;
 			}
+		}
 
-		delete k;
+	if ( subnets )
+		{
+		if ( ! idx )
+			idx = RecreateIndex(*k);
+		if ( ! subnets->Remove(idx.get()) )
+			reporter->InternalWarning("index not in prefix table");
 		}
 
-	if ( modified )
-		Modified();
+	unsigned int table_before = memory_account ? tbl->TableAllocation() : 0;
+	tbl->RemoveEntry(k.get());
 
-	if ( ! v )
+	if ( memory_account )
+		AccountEntries(nullptr, v, k->Size(), table_before);
+
+	if ( change_func )
 		{
-		expire_cookie = nullptr;
-		InitTimer(table_expire_interval);
+		if ( ! idx )
+			idx = RecreateIndex(*k);
+
+		CallChangeFunc(idx, v->GetVal(), ELEMENT_EXPIRED);
 		}
-	else
-		InitTimer(table_expire_delay);
+
+	delete v;
+	return true;
 	}
 
 double TableVal::GetExpireTime()
@@ -2737,23 +3061,52 @@ ValPtr TableVal::DoClone(CloneState* state)
 	auto tv = make_intrusive<zeek::TableVal>(table_type);
 	state->NewClone(this, tv);
 
-	const PDict<zeek::TableEntryVal>* tbl = AsTable();
-	IterCookie* cookie = tbl->InitForIteration();
+	if ( frozen && CanShareEntries() )
+		// The copy doesn't become read-only, but only changes its
+		// frozen entries after turning them back into regular ones.
+		tv->frozen = frozen;
 
-	HashKey* key;
-	TableEntryVal* val;
-	while ( (val = tbl->NextEntry(key, cookie)) )
+	else if ( frozen )
 		{
-		TableEntryVal* nval = val->Clone(state);
-		tv->AsNonConstTable()->Insert(key, nval);
+		PDict<zeek::TableEntryVal>* tbl = tv->AsNonConstTable();
+		tbl->Reserve(frozen->Size());
 
-		if ( subnets )
+		for ( int i = 0; i < frozen->Size(); ++i )
 			{
-			auto idx = RecreateIndex(*key);
-			tv->subnets->Insert(idx.get(), nval);
+			TableEntryVal e(frozen->Value(i));
+			tbl->InsertCopy(frozen->Key(i), frozen->KeySize(i), frozen->Hash(i),
+			                e.Clone(state));
 			}
+		}
 
-		delete key;
+	else if ( CanShareEntries() )
+		{
+		// Cloning the entries wouldn't create anything new, so
+		// instead the copy shares them until modified.
+		tv->entries = entries;
+		tv->val.table_val = entries.get();
+		}
+
+	else
+		{
+		const PDict<zeek::TableEntryVal>* tbl = AsTable();
+		IterCookie* cookie = tbl->InitForIteration();
+
+		HashKey* key;
+		TableEntryVal* val;
+		while ( (val = tbl->NextEntry(key, cookie)) )
+			{
+			TableEntryVal* nval = val->Clone(state);
+			tv->AsNonConstTable()->Insert(key, nval);
+
+			if ( subnets )
+				{
+				auto idx = RecreateIndex(*key);
+				tv->subnets->Insert(idx.get(), nval);
+				}
+
+			delete key;
+			}
 		}
 
 	tv->attrs = attrs;
@@ -2777,6 +3130,45 @@ ValPtr TableVal::DoClone(CloneState* state)
 	return tv;
 	}
 
+bool TableVal::CanShareEntries() const
+	{
+	// The prefix table points to the entries directly, and expiration
+	// updates their access times.
+	if ( subnets || expire_time )
+		return false;
+
+	if ( table_type->IsSet() )
+		return true;
+
+	return is_immutable_type(table_type->Yield().get());
+	}
+
+void TableVal::MakeUnique()
+	{
+	// Loops iterating over the entries hold a reference along with a
+	// robust cookie, see Entries(). They don't need a copy.
+	if ( entries.use_count() - entries->NumRobustCookies() <= 1 )
+		return;
+
+	auto copy = std::make_shared<PDict<zeek::TableEntryVal>>();
+	copy->SetDeleteFunc(table_entry_val_delete_func);
+
+	IterCookie* c = entries->InitForIteration();
+
+	HashKey* k;
+	TableEntryVal* v;
+	while ( (v = entries->NextEntry(k, c)) )
+		{
+		auto nv = new TableEntryVal(v->GetVal());
+		nv->SetExpireAccess(v->ExpireAccessTime());
+		copy->Insert(k, nv);
+		delete k;
+		}
+
+	entries = std::move(copy);
+	val.table_val = entries.get();
+	}
+
 unsigned int TableVal::MemoryAllocation() const
 	{
 	unsigned int size = 0;
@@ -2792,10 +3184,53 @@ unsigned int TableVal::MemoryAllocation() const
 		size += padded_sizeof(TableEntryVal);
 		}
 
+	if ( expire_index )
+		for ( const auto& b : *expire_index )
+			size += padded_sizeof(b) + pad_size(b.second.size() * sizeof(hash_t));
+
+	if ( frozen )
+		{
+		for ( int i = 0; i < frozen->Size(); ++i )
+			if ( const auto& v = frozen->Value(i) )
+				size += v->MemoryAllocation();
+
+		size += frozen->MemoryAllocation();
+		}
+
 	return size + padded_sizeof(*this) + val.table_val->MemoryAllocation()
 		+ table_hash->MemoryAllocation();
 	}
 
+static int64_t table_entry_size(const TableEntryVal* e, int key_size)
+	{
+	int64_t size = padded_sizeof(TableEntryVal) + pad_size(key_size);
+
+	if ( e->GetVal() )
+		size += e->GetVal()->MemoryAllocation();
+
+	return size;
+	}
+
+void TableVal::AccountEntries(const TableEntryVal* added, const TableEntryVal* removed,
+                              int key_size, unsigned int table_before)
+	{
+	int64_t delta = int64_t(AsTable()->TableAllocation()) - table_before;
+
+	if ( removed )
+		{
+		delta -= table_entry_size(removed, key_size);
+		detail::set_memory_account(removed->GetVal().get(), memory_account, nullptr);
+		}
+
+	if ( added )
+		{
+		delta += table_entry_size(added, key_size);
+		detail::set_memory_account(added->GetVal().get(), nullptr, memory_account);
+		}
+
+	memory_account->Adjust(delta);
+	}
+
 HashKey* TableVal::ComputeHash(const Val* index) const
 	{ return MakeHashKey(*index).release(); }
 
@@ -2909,12 +3344,19 @@ RecordVal::RecordVal(RecordTypePtr t, bool init_fields) : Val(std::move(t))
 			if ( tag == TYPE_RECORD )
 				def = make_intrusive<zeek::RecordVal>(cast_intrusive<RecordType>(type));
 
-			else if ( tag == TYPE_TABLE )
+			else if ( tag == TYPE_TABLE && a )
 				def = make_intrusive<zeek::TableVal>(IntrusivePtr{NewRef{}, type->AsTableType()},
 				                                     IntrusivePtr{NewRef{}, a});
 
-			else if ( tag == TYPE_VECTOR )
-				def = make_intrusive<zeek::VectorVal>(cast_intrusive<VectorType>(type));
+			else if ( tag == TYPE_TABLE || tag == TYPE_VECTOR )
+				{
+				// Many of these never get used, so BoxNativeField()
+				// creates them on first access.
+				if ( ! native )
+					native = std::make_unique<NativeField[]>(n);
+
+				native[i].unboxed = true;
+				}
 			}
 
 		vl->emplace_back(std::move(def));
@@ -2933,10 +3375,128 @@ ValPtr RecordVal::SizeVal() const
 
 void RecordVal::Assign(int field, ValPtr new_val)
 	{
-	(*AsNonConstRecord())[field] = std::move(new_val);
+	if ( native )
+		native[field].unboxed = false;
+
+	auto& slot = (*AsNonConstRecord())[field];
+
+	if ( memory_account && slot != new_val )
+		{
+		int64_t delta = 0;
+
+		if ( slot )
+			{
+			delta -= slot->MemoryAllocation();
+			detail::set_memory_account(slot.get(), memory_account, nullptr);
+			}
+
+		if ( new_val )
+			{
+			delta += new_val->MemoryAllocation();
+			detail::set_memory_account(new_val.get(), nullptr, memory_account);
+			}
+
+		memory_account->Adjust(delta);
+		}
+
+	slot = std::move(new_val);
 	Modified();
 	}
 
+void RecordVal::AssignAddr(int field, const IPAddr& a)
+	{
+	a.CopyIPv6(&NativeSlot(field).addr_val);
+	}
+
+void RecordVal::AssignPort(int field, uint32_t port_num, TransportProto port_type)
+	{
+	NativeSlot(field).uint_val = PortVal::Mask(port_num, port_type);
+	}
+
+RecordVal::NativeField& RecordVal::NativeSlot(int field)
+	{
+	if ( ! native )
+		native = std::make_unique<NativeField[]>(GetType()->AsRecordType()->NumFields());
+
+	auto& nf = native[field];
+	nf.unboxed = true;
+	(*AsNonConstRecord())[field] = nullptr;
+	Modified();
+
+	return nf;
+	}
+
+const ValPtr& RecordVal::BoxNativeField(int field) const
+	{
+	auto& nf = native[field];
+	auto& v = (*val.record_val)[field];
+	const auto& ft = GetType()->AsRecordType()->GetFieldType(field);
+
+	switch ( ft->Tag() ) {
+	case TYPE_BOOL:
+		v = val_mgr->Bool(nf.int_val);
+		break;
+
+	case TYPE_INT:
+		v = val_mgr->Int(nf.int_val);
+		break;
+
+	case TYPE_COUNT:
+	case TYPE_COUNTER:
+		v = val_mgr->Count(nf.uint_val);
+		break;
+
+	case TYPE_PORT:
+		v = val_mgr->Port(nf.uint_val);
+		break;
+
+	case TYPE_DOUBLE:
+		v = make_intrusive<DoubleVal>(nf.double_val);
+		break;
+
+	case TYPE_TIME:
+		v = val_mgr->Time(nf.double_val);
+		break;
+
+	case TYPE_INTERVAL:
+		v = make_intrusive<IntervalVal>(nf.double_val);
+		break;
+
+	case TYPE_ADDR:
+		v = val_mgr->Addr(IPAddr(nf.addr_val));
+		break;
+
+	// The empty default of a field without attributes, see the
+	// constructor.
+	case TYPE_TABLE:
+		v = make_intrusive<TableVal>(cast_intrusive<TableType>(ft));
+		break;
+
+	case TYPE_VECTOR:
+		v = make_intrusive<VectorVal>(cast_intrusive<VectorType>(ft));
+		break;
+
+	default:
+		reporter->InternalError("native assignment to record field of type %s",
+		                        type_name(ft->Tag()));
+	}
+
+	nf.unboxed = false;
+	return v;
+	}
+
+void RecordVal::BoxNativeFields() const
+	{
+	if ( ! native )
+		return;
+
+	auto n = AsRecord()->size();
+
+	for ( size_t i = 0; i < n; ++i )
+		if ( native[i].unboxed )
+			BoxNativeField(i);
+	}
+
 void RecordVal::Assign(int field, Val* new_val)
 	{
 	Assign(field, {AdoptRef{}, new_val});
@@ -2944,7 +3504,7 @@ void RecordVal::Assign(int field, Val* new_val)
 
 ValPtr RecordVal::GetFieldOrDefault(int field) const
 	{
-	const auto& val = (*AsRecord())[field];
+	const auto& val = GetField(field);
 
 	if ( val )
 		return val;
@@ -2963,6 +3523,10 @@ void RecordVal::ResizeParseTimeRecords(RecordType* rt)
 
 	for ( auto& rv : rvs )
 		{
+		// The native storage has the old number of fields.
+		rv->BoxNativeFields();
+		rv->native.reset();
+
 		auto vs = rv->val.record_val;
 		int current_length = vs->size();
 		auto required_length = rt->NumFields();
@@ -3006,19 +3570,21 @@ RecordValPtr RecordVal::CoerceTo(RecordTypePtr t,
                                  RecordValPtr aggr,
                                  bool allow_orphaning) const
 	{
-	if ( ! record_promotion_compatible(t.get(), GetType()->AsRecordType()) )
+	const RecordType* rv_t = GetType()->AsRecordType();
+
+	if ( ! t->CoercionFrom(rv_t).compatible )
 		return nullptr;
 
 	if ( ! aggr )
 		aggr = make_intrusive<zeek::RecordVal>(std::move(t));
 
 	RecordType* ar_t = aggr->GetType()->AsRecordType();
-	const RecordType* rv_t = GetType()->AsRecordType();
+	const auto& plan = ar_t->CoercionFrom(rv_t);
 
 	int i;
 	for ( i = 0; i < rv_t->NumFields(); ++i )
 		{
-		int t_i = ar_t->FieldOffset(rv_t->FieldName(i));
+		int t_i = plan.offsets[i];
 
 		if ( t_i < 0 )
 			{
@@ -3053,13 +3619,12 @@ RecordValPtr RecordVal::CoerceTo(RecordTypePtr t,
 		aggr->Assign(t_i, v);
 		}
 
-	for ( i = 0; i < ar_t->NumFields(); ++i )
-		if ( ! aggr->GetField(i) &&
-		     ! ar_t->FieldDecl(i)->GetAttr(detail::ATTR_OPTIONAL) )
+	for ( auto f : plan.required )
+		if ( ! aggr->GetField(f) )
 			{
 			char buf[512];
 			snprintf(buf, sizeof(buf),
-					"non-optional field \"%s\" missing in initialization", ar_t->FieldName(i));
+					"non-optional field \"%s\" missing in initialization", ar_t->FieldName(f));
 			Error(buf);
 			}
 
@@ -3068,7 +3633,8 @@ RecordValPtr RecordVal::CoerceTo(RecordTypePtr t,
 
 RecordValPtr RecordVal::CoerceTo(RecordTypePtr t, bool allow_orphaning)
 	{
-	if ( same_type(GetType(), t) )
+	if ( GetType().get() == t.get() ||
+	     t->CoercionFrom(GetType()->AsRecordType()).identical )
 		return {NewRef{}, this};
 
 	return CoerceTo(std::move(t), nullptr, allow_orphaning);
@@ -3081,6 +3647,8 @@ TableValPtr RecordVal::GetRecordFieldsVal() const
 
 void RecordVal::Describe(ODesc* d) const
 	{
+	BoxNativeFields();
+
 	auto vl = AsRecord();
 	auto n = vl->size();
 	auto record_type = GetType()->AsRecordType();
@@ -3119,6 +3687,8 @@ void RecordVal::Describe(ODesc* d) const
 
 void RecordVal::DescribeReST(ODesc* d) const
 	{
+	BoxNativeFields();
+
 	auto vl = AsRecord();
 	auto n = vl->size();
 	auto record_type = GetType()->AsRecordType();
@@ -3156,6 +3726,7 @@ ValPtr RecordVal::DoClone(CloneState* state)
 	auto rv = make_intrusive<zeek::RecordVal>(GetType<RecordType>(), false);
 	rv->origin = nullptr;
 	state->NewClone(this, rv);
+	BoxNativeFields();
 
 	for ( const auto& vlv : *val.record_val)
 		{
@@ -3179,6 +3750,10 @@ unsigned int RecordVal::MemoryAllocation() const
 
 	size += pad_size(vl.capacity() * sizeof(ValPtr));
 	size += padded_sizeof(vl);
+
+	if ( native )
+		size += pad_size(vl.size() * sizeof(NativeField));
+
 	return size + padded_sizeof(*this);
 	}
 
@@ -3203,17 +3778,33 @@ ValPtr EnumVal::DoClone(CloneState* state)
 	return {NewRef{}, this};
 	}
 
+std::vector<ValPtr>* Val::AsVector()
+	{
+	CHECK_TAG(type->Tag(), TYPE_VECTOR, "Val::AsVector", type_name)
+	static_cast<VectorVal*>(this)->MakeUnique();
+	return val.vector_val;
+	}
+
 VectorVal::VectorVal(VectorType* t) : VectorVal({NewRef{}, t})
 	{ }
 
 VectorVal::VectorVal(VectorTypePtr t) : Val(std::move(t))
 	{
-	val.vector_val = new vector<ValPtr>();
+	elements = std::make_shared<vector<ValPtr>>();
+	val.vector_val = elements.get();
 	}
 
 VectorVal::~VectorVal()
 	{
-	delete val.vector_val;
+	}
+
+void VectorVal::MakeUnique()
+	{
+	if ( elements.use_count() == 1 )
+		return;
+
+	elements = std::make_shared<vector<ValPtr>>(*elements);
+	val.vector_val = elements.get();
 	}
 
 ValPtr VectorVal::SizeVal() const
@@ -3227,10 +3818,19 @@ bool VectorVal::Assign(unsigned int index, ValPtr element)
 	     ! same_type(element->GetType(), GetType()->AsVectorType()->Yield(), false) )
 		return false;
 
+	MakeUnique();
+
+	size_t capacity_before = val.vector_val->capacity();
+
 	if ( index >= val.vector_val->size() )
 		val.vector_val->resize(index + 1);
 
-	(*val.vector_val)[index] = std::move(element);
+	auto& slot = (*val.vector_val)[index];
+
+	if ( memory_account && slot != element )
+		AccountElements(element.get(), slot.get(), capacity_before);
+
+	slot = std::move(element);
 
 	Modified();
 	return true;
@@ -3256,15 +3856,22 @@ bool VectorVal::Insert(unsigned int index, ValPtr element)
 		return false;
 		}
 
+	MakeUnique();
+
 	vector<ValPtr>::iterator it;
+	size_t capacity_before = val.vector_val->capacity();
 
 	if ( index < val.vector_val->size() )
 		it = std::next(val.vector_val->begin(), index);
 	else
 		it = val.vector_val->end();
 
+	const Val* added = element.get();
 	val.vector_val->insert(it, std::move(element));
 
+	if ( memory_account )
+		AccountElements(added, nullptr, capacity_before);
+
 	Modified();
 	return true;
 	}
@@ -3274,7 +3881,13 @@ bool VectorVal::Remove(unsigned int index)
 	if ( index >= val.vector_val->size() )
 		return false;
 
+	MakeUnique();
+
 	auto it = std::next(val.vector_val->begin(), index);
+
+	if ( memory_account )
+		AccountElements(nullptr, it->get(), val.vector_val->capacity());
+
 	val.vector_val->erase(it);
 
 	Modified();
@@ -3315,12 +3928,123 @@ const ValPtr& VectorVal::At(unsigned int index) const
 
 unsigned int VectorVal::Resize(unsigned int new_num_elements)
 	{
+	MakeUnique();
+
 	unsigned int oldsize = val.vector_val->size();
+	size_t capacity_before = val.vector_val->capacity();
+
+	if ( memory_account )
+		for ( auto i = new_num_elements; i < oldsize; ++i )
+			AccountElements(nullptr, (*val.vector_val)[i].get(), capacity_before);
+
 	val.vector_val->reserve(new_num_elements);
 	val.vector_val->resize(new_num_elements);
+
+	if ( memory_account )
+		AccountElements(nullptr, nullptr, capacity_before);
+
 	return oldsize;
 	}
 
+void VectorVal::AccountElements(const Val* added, const Val* removed, size_t capacity_before)
+	{
+	int64_t delta = int64_t(pad_size(val.vector_val->capacity() * sizeof(ValPtr))) -
+		int64_t(pad_size(capacity_before * sizeof(ValPtr)));
+
+	if ( removed )
+		{
+		delta -= removed->MemoryAllocation();
+		detail::set_memory_account(const_cast<Val*>(removed), memory_account, nullptr);
+		}
+
+	if ( added )
+		{
+		delta += added->MemoryAllocation();
+		detail::set_memory_account(const_cast<Val*>(added), nullptr, memory_account);
+		}
+
+	memory_account->Adjust(delta);
+	}
+
+unsigned int VectorVal::MemoryAllocation() const
+	{
+	unsigned int size = 0;
+
+	for ( const auto& v : *val.vector_val )
+		if ( v )
+			size += v->MemoryAllocation();
+
+	return size + padded_sizeof(*this) +
+		pad_size(val.vector_val->capacity() * sizeof(ValPtr));
+	}
+
+void detail::set_memory_account(Val* v, MemoryAccount* from, MemoryAccount* to)
+	{
+	if ( ! v || from == to )
+		return;
+
+	switch ( v->GetType()->Tag() ) {
+	case TYPE_TABLE:
+		{
+		auto t = static_cast<TableVal*>(v);
+
+		if ( t->memory_account != from )
+			return;
+
+		t->memory_account = to;
+
+		if ( const auto& frozen = t->FrozenEntries() )
+			{
+			for ( int i = 0; i < frozen->Size(); ++i )
+				set_memory_account(frozen->Value(i).get(), from, to);
+
+			break;
+			}
+
+		const PDict<TableEntryVal>* tbl = t->AsTable();
+		IterCookie* c = tbl->InitForIteration();
+
+		while ( TableEntryVal* e = tbl->NextEntry(c) )
+			set_memory_account(e->GetVal().get(), from, to);
+
+		break;
+		}
+
+	case TYPE_VECTOR:
+		{
+		auto vv = static_cast<VectorVal*>(v);
+
+		if ( vv->memory_account != from )
+			return;
+
+		vv->memory_account = to;
+
+		for ( const auto& e : *vv->val.vector_val )
+			set_memory_account(e.get(), from, to);
+
+		break;
+		}
+
+	case TYPE_RECORD:
+		{
+		auto r = static_cast<RecordVal*>(v);
+
+		if ( r->memory_account != from )
+			return;
+
+		r->memory_account = to;
+
+		for ( const auto& f : *r->AsRecord() )
+			set_memory_account(f.get(), from, to);
+
+		break;
+		}
+
+	default:
+		break;
+	}
+	}
+
 unsigned int VectorVal::ResizeAtLeast(unsigned int new_num_elements)
 	 {
 	 unsigned int old_size = val.vector_val->size();
@@ -3333,9 +4057,18 @@ unsigned int VectorVal::ResizeAtLeast(unsigned int new_num_elements)
 ValPtr VectorVal::DoClone(CloneState* state)
 	{
 	auto vv = make_intrusive<zeek::VectorVal>(GetType<VectorType>());
-	vv->val.vector_val->reserve(val.vector_val->size());
 	state->NewClone(this, vv);
 
+	if ( is_immutable_type(GetType()->AsVectorType()->Yield().get()) )
+		{
+		// The copy shares the elements until either gets modified.
+		vv->elements = elements;
+		vv->val.vector_val = elements.get();
+		return vv;
+		}
+
+	vv->val.vector_val->reserve(val.vector_val->size());
+
 	for ( unsigned int i = 0; i < val.vector_val->size(); ++i )
 		{
 		auto v = (*val.vector_val)[i]->Clone(state);
@@ -3655,6 +4388,21 @@ ValPtr Val::MakeCount(bro_uint_t u)
 	return IntrusivePtr{AdoptRef{}, new Val(u, TYPE_COUNT)};
 	}
 
+struct ValManager::AddrPool {
+	struct Hash {
+		size_t operator()(const IPAddr& a) const
+			{
+			uint32_t w[4];
+			a.CopyIPv6(w);
+			return std::hash<uint64_t>()((uint64_t(w[0] ^ w[1]) << 32) | (w[2] ^ w[3]));
+			}
+	};
+
+	PrefixTable nets;
+	size_t max_addrs;
+	std::unordered_map<IPAddr, AddrValPtr, Hash> addrs;
+};
+
 ValManager::ValManager()
 	{
 	empty_string = make_intrusive<zeek::StringVal>("");
@@ -3682,6 +4430,114 @@ StringVal* ValManager::GetEmptyString() const
 	return empty_string->Ref()->AsStringVal();
 	}
 
+ValManager::~ValManager()
+	{
+	}
+
+StringValPtr ValManager::InternedString(int length, const char* s)
+	{
+	if ( length > MAX_INTERNED_STRING_LEN )
+		{
+		++pool_stats.string_misses;
+		return make_intrusive<StringVal>(length, s);
+		}
+
+	auto it = interned_strings.find(std::string_view(s, length));
+
+	if ( it != interned_strings.end() )
+		{
+		++pool_stats.string_hits;
+		return it->second;
+		}
+
+	++pool_stats.string_misses;
+	auto rval = make_intrusive<StringVal>(length, s);
+
+	if ( interned_strings.size() < MAX_INTERNED_STRINGS )
+		{
+		const String* bs = rval->AsString();
+		std::string_view key((const char*) bs->Bytes(), bs->Len());
+		interned_strings.emplace(key, rval);
+		}
+
+	return rval;
+	}
+
+StringValPtr ValManager::InternedString(const char* s)
+	{
+	return InternedString(strlen(s), s);
+	}
+
+AddrValPtr ValManager::Addr(const IPAddr& a)
+	{
+	if ( ! addr_pool || ! addr_pool->nets.Lookup(a, 128) )
+		{
+		++pool_stats.addr_misses;
+		return make_intrusive<AddrVal>(a);
+		}
+
+	auto it = addr_pool->addrs.find(a);
+
+	if ( it != addr_pool->addrs.end() )
+		{
+		++pool_stats.addr_hits;
+		return it->second;
+		}
+
+	++pool_stats.addr_misses;
+	auto rval = make_intrusive<AddrVal>(a);
+
+	if ( addr_pool->addrs.size() < addr_pool->max_addrs )
+		addr_pool->addrs.emplace(a, rval);
+
+	return rval;
+	}
+
+TimeValPtr ValManager::Time(double t)
+	{
+	if ( t != network_time )
+		{
+		++pool_stats.time_misses;
+		return make_intrusive<TimeVal>(t);
+		}
+
+	if ( last_time_val && last_time == t )
+		{
+		++pool_stats.time_hits;
+		return last_time_val;
+		}
+
+	++pool_stats.time_misses;
+	last_time = t;
+	last_time_val = make_intrusive<TimeVal>(t);
+	return last_time_val;
+	}
+
+void ValManager::InitPools()
+	{
+	const auto& nets = id::find_val<TableVal>("val_pool_addr_nets");
+	auto max_addrs = id::find_val("val_pool_max_addrs")->AsCount();
+
+	if ( ! nets || nets->Size() == 0 || max_addrs == 0 )
+		{
+		addr_pool.reset();
+		return;
+		}
+
+	addr_pool = std::make_unique<AddrPool>();
+	addr_pool->max_addrs = max_addrs;
+
+	auto lv = nets->ToPureListVal();
+
+	for ( int i = 0; i < lv->Length(); ++i )
+		addr_pool->nets.Insert(lv->Idx(i).get());
+	}
+
+size_t ValManager::NumInternedAddrs() const
+	{
+	return addr_pool ? addr_pool->addrs.size() : 0;
+	}
+
 const PortValPtr& ValManager::Port(uint32_t port_num, TransportProto port_type) const
 	{
 	if ( port_num >= 65536 )
@@ -6,12 +6,18 @@
 #include "Type.h"
 #include "Timer.h"
 #include "Notifier.h"
+#include "Hash.h"
 #include "net_util.h"
+#include "MemoryArena.h"
 
+#include <deque>
 #include <vector>
 #include <list>
+#include <map>
 #include <array>
+#include <memory>
 #include <unordered_map>
+#include <string_view>
 
 #include <sys/types.h> // for u_char
 
@@ -36,7 +42,7 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(IterCookie, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Frame, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
 
-namespace zeek::detail { class ScriptFunc; }
+namespace zeek::detail { class ScriptFunc; class MemoryAccount; class FrozenTable; }
 using BroFunc [[deprecated("Remove in v4.1. Use zeek::detail::ScriptFunc instead.")]] = zeek::detail::ScriptFunc;
 
 class BroFile;
@@ -66,6 +72,7 @@ class TableVal;
 class RecordVal;
 class ListVal;
 class StringVal;
+class TimeVal;
 class EnumVal;
 class OpaqueVal;
 class VectorVal;
@@ -78,9 +85,21 @@ using PortValPtr = zeek::IntrusivePtr<PortVal>;
 using RecordValPtr = zeek::IntrusivePtr<RecordVal>;
 using StringValPtr = zeek::IntrusivePtr<StringVal>;
 using TableValPtr = zeek::IntrusivePtr<TableVal>;
+using TimeValPtr = zeek::IntrusivePtr<TimeVal>;
 using ValPtr = zeek::IntrusivePtr<Val>;
 using VectorValPtr = zeek::IntrusivePtr<VectorVal>;
 
+namespace detail {
+
+/**
+ * Moves a table, vector or record, and those nested within it, from one
+ * memory account to another, see MemoryAccount.h. Values belonging to
+ * other accounts, and those nested within them, are left alone.
+ */
+void set_memory_account(Val* v, MemoryAccount* from, MemoryAccount* to);
+
+}
+
 union BroValUnion {
 	// Used for bool, int, enum.
 	bro_int_t int_val;
@@ -239,11 +258,19 @@ public:
 	CONST_ACCESSOR2(zeek::TYPE_ENUM, int, int_val, AsEnum)
 	CONST_ACCESSOR(zeek::TYPE_STRING, String*, string_val, AsString)
 	CONST_ACCESSOR(zeek::TYPE_FUNC, zeek::Func*, func_val, AsFunc)
-	CONST_ACCESSOR(zeek::TYPE_TABLE, zeek::PDict<TableEntryVal>*, table_val, AsTable)
+	// Frozen tables get their regular entries back first.
+	const zeek::PDict<TableEntryVal>* AsTable() const;
 	CONST_ACCESSOR(zeek::TYPE_RECORD, std::vector<ValPtr>*, record_val, AsRecord)
 	CONST_ACCESSOR(zeek::TYPE_FILE, BroFile*, file_val, AsFile)
 	CONST_ACCESSOR(zeek::TYPE_PATTERN, RE_Matcher*, re_val, AsPattern)
-	CONST_ACCESSOR(zeek::TYPE_VECTOR, std::vector<ValPtr>*, vector_val, AsVector)
+
+	// Unlike the non-const version, this leaves the elements shared
+	// with copies of the vector, so it's what read-only code should use.
+	const std::vector<ValPtr>* AsVector() const
+		{
+		CHECK_TAG(type->Tag(), zeek::TYPE_VECTOR, "Val::AsVector", zeek::type_name)
+		return val.vector_val;
+		}
 
 	const IPPrefix& AsSubNet() const
 		{
@@ -277,7 +304,10 @@ public:
 	ACCESSOR(zeek::TYPE_FUNC, zeek::Func*, func_val, AsFunc)
 	ACCESSOR(zeek::TYPE_FILE, BroFile*, file_val, AsFile)
 	ACCESSOR(zeek::TYPE_PATTERN, RE_Matcher*, re_val, AsPattern)
-	ACCESSOR(zeek::TYPE_VECTOR, std::vector<ValPtr>*, vector_val, AsVector)
+
+	// A vector may share its elements with copies of it until one of
+	// them gets modified, so this gives the vector its own first.
+	std::vector<ValPtr>* AsVector();
 
 	zeek::FuncPtr AsFuncPtr() const;
 
@@ -353,7 +383,24 @@ public:
 
 	StringValPtr ToJSON(bool only_loggable=false, RE_Matcher* re=nullptr);
 
+	// Vals are counted as they're allocated, for profiling, and come
+	// from the script memory arena.
+	static void* operator new(size_t size)
+		{
+		++num_allocations;
+		return zeek::detail::arena_alloc(zeek::detail::MemoryArena::Script, size);
+		}
+
+	static void operator delete(void* ptr, size_t size)
+		{ zeek::detail::arena_free(zeek::detail::MemoryArena::Script, ptr, size); }
+
+	/**
+	 * Returns the total number of Vals allocated so far.
+	 */
+	static uint64_t NumAllocations()	{ return num_allocations; }
+
 protected:
+	static inline uint64_t num_allocations = 0;
 
 	friend class zeek::EnumType;
 	friend class ListVal;
@@ -383,7 +430,7 @@ protected:
 		: type(std::move(t))
 		{}
 
-	ACCESSOR(zeek::TYPE_TABLE, zeek::PDict<TableEntryVal>*, table_val, AsNonConstTable)
+	zeek::PDict<TableEntryVal>* AsNonConstTable();
 	ACCESSOR(zeek::TYPE_RECORD, std::vector<ValPtr>*, record_val, AsNonConstRecord)
 
 	// For internal use by the Val::Clone() methods.
@@ -420,7 +467,22 @@ public:
 	static constexpr bro_int_t PREALLOCATED_INT_HIGHEST =
             PREALLOCATED_INT_LOWEST + PREALLOCATED_INTS - 1;
 
+	// Limits for InternedString().
+	static constexpr int MAX_INTERNED_STRING_LEN = 32;
+	static constexpr size_t MAX_INTERNED_STRINGS = 4096;
+
+	// How often the pools of shared values could serve a request.
+	struct PoolStats {
+		uint64_t string_hits = 0;
+		uint64_t string_misses = 0;
+		uint64_t addr_hits = 0;
+		uint64_t addr_misses = 0;
+		uint64_t time_hits = 0;
+		uint64_t time_misses = 0;
+	};
+
 	ValManager();
+	~ValManager();
 
 	[[deprecated("Remove in v4.1.  Use zeek::val_mgr->True() instead.")]]
 	inline Val* GetTrue() const
@@ -473,6 +535,34 @@ public:
 	inline const StringValPtr& EmptyString() const
 		{ return empty_string; }
 
+	// Returns a StringVal for the given bytes that is shared with
+	// previous callers asking for the same ones, for short values that
+	// analyzers produce over and over, such as request methods. The
+	// result must not be modified. Once the table is full, or for longer
+	// strings, this returns a new StringVal.
+	StringValPtr InternedString(int length, const char* s);
+	StringValPtr InternedString(const char* s);
+
+	// Returns an AddrVal for the address. Addresses within
+	// val_pool_addr_nets share theirs with previous callers, up to
+	// val_pool_max_addrs of them. The result must not be modified.
+	AddrValPtr Addr(const IPAddr& a);
+
+	// Returns a TimeVal for the time. The current network time's is
+	// shared with previous callers, as the events of a packet mostly
+	// carry that one. The result must not be modified.
+	TimeValPtr Time(double t);
+
+	// Sets up the address pool from the script-level options, once they
+	// have their values.
+	void InitPools();
+
+	const PoolStats& GetPoolStats() const	{ return pool_stats; }
+
+	// The numbers of values currently held by the pools.
+	size_t NumInternedStrings() const	{ return interned_strings.size(); }
+	size_t NumInternedAddrs() const;
+
 	// Port number given in host order.
 	[[deprecated("Remove in v4.1.  Use zeek::val_mgr->Port() instead.")]]
 	PortVal* GetPort(uint32_t port_num, TransportProto port_type) const;
@@ -495,6 +585,17 @@ private:
 	StringValPtr empty_string;
 	ValPtr b_true;
 	ValPtr b_false;
+
+	// Keys refer to the bytes of their values.
+	std::unordered_map<std::string_view, StringValPtr> interned_strings;
+
+	struct AddrPool;
+	std::unique_ptr<AddrPool> addr_pool;	// if configured
+
+	double last_time = 0;
+	TimeValPtr last_time_val;
+
+	PoolStats pool_stats;
 };
 
 extern ValManager* val_mgr;
@@ -752,6 +853,14 @@ protected:
 	// to save a few bytes, as we do not need a high resolution for these
 	// anyway.
 	int expire_access_time;
+
+	// The expire_access_time under which the table's expiration index
+	// lists the entry. Records of other times are stale.
+	int expire_index_time = 0;
+
+	// The index recovered from the entry's key, if the table keeps it;
+	// see TableVal::EntryIndex().
+	ListValPtr index;
 };
 
 class TableValTimer final : public Timer {
@@ -831,6 +940,52 @@ public:
 	// Remove the entire contents.
 	void RemoveAll();
 
+	/**
+	 * Starts adding many entries at once, as an input stream does when
+	 * loading a table. Makes room for the given number of additional
+	 * entries and holds back notifications of modifications until
+	 * EndBulkUpdate(). Calling it again while a bulk update is ongoing
+	 * makes room for more.
+	 * @param num_entries  The number of entries about to be added.
+	 */
+	void StartBulkUpdate(int num_entries);
+
+	/**
+	 * Finishes a bulk update started with StartBulkUpdate(),
+	 * notifying about modifications if there were any.
+	 */
+	void EndBulkUpdate();
+
+	/**
+	 * Makes the table read-only and moves its entries into a compact
+	 * representation, see detail::FrozenTable, for reference data that
+	 * gets loaded once. Lookups, iteration and the size work on that
+	 * directly; anything else that needs the entries, such as printing
+	 * the table, turns them back into regular ones. Attempts to modify
+	 * the table fail with an error either way.
+	 *
+	 * Tables indexed by subnets, with expiration attributes or backed
+	 * by a Broker store can't be frozen.
+	 *
+	 * @return  True if the table is read-only now; otherwise, reports
+	 * an error.
+	 */
+	bool Freeze();
+
+	/**
+	 * @return  True if the table got frozen with Freeze().
+	 */
+	bool IsReadOnly() const	{ return read_only; }
+
+	/**
+	 * @return  The frozen entries of the table, or null if there are
+	 * none, either because the table isn't frozen or because something
+	 * needed the regular entries back. Holding on to the result keeps
+	 * the entries valid.
+	 */
+	const std::shared_ptr<const detail::FrozenTable>& FrozenEntries() const
+		{ return frozen; }
+
 	// Remove the entire contents of the table from the given value.
 	// which must also be a TableVal.
 	// Returns true if the addition typechecked, false if not.
@@ -922,6 +1077,35 @@ public:
 	ListVal* RecoverIndex(const HashKey* k) const
 		{ return RecreateIndex(*k).release(); }
 
+	/**
+	 * @return  True if the table's index is a single addr, subnet, count,
+	 * int, port, string or enum. The keys of such tables hold the index
+	 * as is, so that RecreateAtomicIndex() can recover it directly.
+	 */
+	bool HasAtomicIndex() const;
+
+	/**
+	 * For a table with an atomic index, returns the index corresponding
+	 * to the bytes of a key of the table. Unlike RecreateIndex(), this
+	 * returns the index itself rather than a list of it.
+	 * @param key  The key's bytes, as the table's dictionary holds them.
+	 * @param key_size  The number of bytes.
+	 * @return  The index.
+	 */
+	ValPtr RecreateAtomicIndex(const void* key, int key_size) const;
+
+	/**
+	 * Returns the index of one of the table's entries, like
+	 * RecreateIndex(). The entry keeps the index for later calls if the
+	 * table's index consists of more than one value, all atomic, and the
+	 * table has at most #table_index_cache_max entries and no memory
+	 * account.
+	 * @param entry  The entry.
+	 * @param k  The entry's key.
+	 * @return  The index.
+	 */
+	ListValPtr EntryIndex(TableEntryVal* entry, const HashKey& k) const;
+
 	/**
 	 * Remove an element from the table and return it.
 	 * @param index  The index to remove.
@@ -980,6 +1164,31 @@ public:
 	// type that the general Table API does not allow.
 	const PrefixTable* Subnets() const { return subnets; }
 
+	/**
+	 * Returns the table's entries, for iterating over them while running
+	 * code that may modify the table. Iterating with a robust cookie
+	 * sees the modifications as they happen, and holding on to the result
+	 * along with the cookie doesn't count as sharing the entries, see
+	 * MakeUnique(). Only if the table shares them with a copy does a
+	 * modification give the table entries of its own; the iteration then
+	 * continues over the shared ones, which the result keeps valid.
+	 */
+	std::shared_ptr<const zeek::PDict<TableEntryVal>> Entries() const
+		{
+		Thaw();
+		return entries;
+		}
+
+	/**
+	 * Turns the entries of a frozen table back into regular ones, if
+	 * they aren't already. The table stays read-only.
+	 */
+	void Thaw() const
+		{
+		if ( frozen )
+			const_cast<TableVal*>(this)->RestoreEntries();
+		}
+
 	void Describe(ODesc* d) const override;
 
 	void InitTimer(double delay);
@@ -1054,6 +1263,10 @@ protected:
 	bool ExpandCompoundAndInit(ListVal* lv, int k, ValPtr new_val);
 	bool CheckAndAssign(ValPtr index, ValPtr new_val);
 
+	// Does the work of Assign(), given a key that stays with the caller.
+	bool DoAssign(ValPtr index, const HashKey& k, ValPtr new_val,
+	              bool broker_forward);
+
 	// Calculates default value for index.  Returns nullptr if none.
 	ValPtr Default(const ValPtr& index);
 
@@ -1068,6 +1281,18 @@ protected:
 	// Calls &expire_func and returns its return interval;
 	double CallExpireFunc(ListValPtr idx);
 
+	// Builds the expiration index from scratch.
+	void BuildExpireIndex();
+
+	// Lists an entry in the expiration index under its current
+	// expire_access_time.
+	void IndexForExpiration(TableEntryVal* v, hash_t hash);
+
+	// Handles a record of the expiration index that has come due,
+	// expiring its entry or listing it again if it has been accessed
+	// since. Returns true if it removed the entry.
+	bool ExpireIndexed(hash_t hash, int index_time, double timeout, double t);
+
 	// Enum for the different kinds of changes an &on_change handler can see
 	enum OnChangeType { ELEMENT_NEW, ELEMENT_CHANGED, ELEMENT_REMOVED, ELEMENT_EXPIRED };
 
@@ -1080,13 +1305,33 @@ protected:
 
 	ValPtr DoClone(CloneState* state) override;
 
+	// Returns true if the entries can be shared with copies, which
+	// requires that neither the entries themselves nor the values they
+	// hold get modified in place.
+	bool CanShareEntries() const;
+
+	// Gives the table its own copy of the entries if it currently shares
+	// them. Needs to be called before any change to them.
+	void MakeUnique();
+
 	zeek::TableTypePtr table_type;
 	CompositeHash* table_hash;
+	bool cache_indices;	// whether entries may keep their recovered index
 	zeek::detail::AttributesPtr attrs;
 	zeek::detail::ExprPtr expire_time;
 	zeek::detail::ExprPtr expire_func;
 	TableValTimer* timer;
-	IterCookie* expire_cookie;
+
+	// For expiring tables, the hashes of the entries by their
+	// expire_access_time as of when they got listed, so that expiration
+	// only needs to look at entries that may have expired. Accesses
+	// don't update the index; instead, entries that turn out to have
+	// been accessed since get listed again when their time comes.
+	// Entries getting removed leave stale records behind, which get
+	// dropped then as well. Built on the first expiration.
+	using ExpireIndex = std::map<int, std::deque<hash_t>>;
+	std::unique_ptr<ExpireIndex> expire_index;
+
 	PrefixTable* subnets;
 	ValPtr def_val;
 	zeek::detail::ExprPtr change_func;
@@ -1094,6 +1339,52 @@ protected:
 	// prevent recursion of change functions
 	bool in_change_func = false;
 
+	// Signals a modification, unless a bulk update holds that back.
+	void NoteModified()
+		{
+		if ( in_bulk_update )
+			bulk_modified = true;
+		else
+			Modified();
+		}
+
+	// Same, for a modification that only affects the entry with the
+	// given hash.
+	void NoteModified(hash_t hash)
+		{
+		if ( in_bulk_update )
+			bulk_modified = true;
+		else
+			Modified(hash);
+		}
+
+	bool in_bulk_update = false;
+	bool bulk_modified = false;
+
+	// The storage behind val.table_val. Clone() lets copies share this
+	// until one of them gets modified, see MakeUnique().
+	std::shared_ptr<zeek::PDict<TableEntryVal>> entries;
+
+	// The entries of a frozen table; entries is empty while there are.
+	std::shared_ptr<const detail::FrozenTable> frozen;
+	bool read_only = false;
+
+	void RestoreEntries();
+
+	// Reports an error and returns true if the table is read-only.
+	bool CheckReadOnly() const;
+
+	// Accounts for an entry getting added, replaced or removed, given
+	// the allocation of the dictionary's slots beforehand.
+	void AccountEntries(const TableEntryVal* added, const TableEntryVal* removed,
+	                    int key_size, unsigned int table_before);
+
+	// The account of the global this belongs to, if tracked.
+	zeek::detail::MemoryAccount* memory_account = nullptr;
+	friend void zeek::detail::set_memory_account(Val* v,
+	                                             zeek::detail::MemoryAccount* from,
+	                                             zeek::detail::MemoryAccount* to);
+
 	static TableRecordDependencies parse_time_table_record_dependencies;
 	static ParseTimeTableStates parse_time_table_states;
 };
@@ -1132,9 +1423,60 @@ public:
 	void Assign(int field, std::nullptr_t)
 		{ Assign(field, ValPtr{}); }
 
+	/**
+	 * Assigns a field of type count or counter without creating a Val
+	 * for it. The field gets boxed only once GetField() asks for it,
+	 * which makes repeated updates of fields that scripts rarely look
+	 * at cheap. The same holds for the other native assignments below.
+	 * @param field  The field index to assign.
+	 * @param c  The value to assign.
+	 */
+	void AssignCount(int field, bro_uint_t c)
+		{ NativeSlot(field).uint_val = c; }
+
+	/**
+	 * Assigns a field of type int without creating a Val for it.
+	 * @param field  The field index to assign.
+	 * @param i  The value to assign.
+	 */
+	void AssignInt(int field, bro_int_t i)
+		{ NativeSlot(field).int_val = i; }
+
+	/**
+	 * Assigns a field of type bool without creating a Val for it.
+	 * @param field  The field index to assign.
+	 * @param b  The value to assign.
+	 */
+	void AssignBool(int field, bool b)
+		{ NativeSlot(field).int_val = b; }
+
+	/**
+	 * Assigns a field of type double, time, or interval without creating
+	 * a Val for it.
+	 * @param field  The field index to assign.
+	 * @param d  The value to assign.
+	 */
+	void AssignDouble(int field, double d)
+		{ NativeSlot(field).double_val = d; }
+
+	/**
+	 * Assigns a field of type addr without creating a Val for it.
+	 * @param field  The field index to assign.
+	 * @param a  The value to assign.
+	 */
+	void AssignAddr(int field, const IPAddr& a);
+
+	/**
+	 * Assigns a field of type port without creating a Val for it.
+	 * @param field  The field index to assign.
+	 * @param port_num  The port number, in host order.
+	 * @param port_type  The port's transport protocol.
+	 */
+	void AssignPort(int field, uint32_t port_num, TransportProto port_type);
+
 	[[deprecated("Remove in v4.1.  Use GetField().")]]
 	Val* Lookup(int field) const	// Does not Ref() value.
-		{ return (*AsRecord())[field].get(); }
+		{ return GetField(field).get(); }
 
 	/**
 	 * Returns the value of a given field index.
@@ -1142,7 +1484,12 @@ public:
 	 * @return  The value at the given field index.
 	 */
 	const ValPtr& GetField(int field) const
-		{ return (*AsRecord())[field]; }
+		{
+		if ( native && native[field].unboxed )
+			return BoxNativeField(field);
+
+		return (*AsRecord())[field];
+		}
 
 	/**
 	 * Returns the value of a given field index as cast to type @c T.
@@ -1263,8 +1610,44 @@ public:
 protected:
 	ValPtr DoClone(CloneState* state) override;
 
+	// A field assigned through one of the native assignment methods.
+	// While *unboxed* is set, the field's entry in the record's vector of
+	// values is null and this holds its actual value.
+	struct NativeField {
+		union {
+			bro_int_t int_val;	// bool, int
+			bro_uint_t uint_val;	// count, counter, masked port
+			double double_val;	// double, time, interval
+			in6_addr addr_val;	// addr
+		};
+
+		bool unboxed;
+	};
+
+	// Returns the native storage for a field, marking it as unboxed and
+	// dropping any previous Val.
+	NativeField& NativeSlot(int field);
+
+	// Creates the Val for an unboxed field and stores it with the
+	// record's values.
+	const ValPtr& BoxNativeField(int field) const;
+
+	// Boxes all unboxed fields, for code that iterates over the
+	// record's values directly.
+	void BoxNativeFields() const;
+
 	Obj* origin;
 
+	// The account of the global this belongs to, if tracked.
+	zeek::detail::MemoryAccount* memory_account = nullptr;
+	friend void zeek::detail::set_memory_account(Val* v,
+	                                             zeek::detail::MemoryAccount* from,
+	                                             zeek::detail::MemoryAccount* to);
+
+	// Allocated on the first native assignment, with one entry per
+	// field.
+	std::unique_ptr<NativeField[]> native;
+
 	using RecordTypeValMap = std::unordered_map<zeek::RecordType*, std::vector<RecordValPtr>>;
 	static RecordTypeValMap parse_time_records;
 };
@@ -1297,6 +1680,8 @@ public:
 
 	ValPtr SizeVal() const override;
 
+	unsigned int MemoryAllocation() const override;
+
 	/**
 	 * Assigns an element to a given vector index.
 	 * @param index  The index to assign.
@@ -1388,8 +1773,29 @@ public:
 	bool Remove(unsigned int index);
 
 protected:
+	friend class Val;
+
 	void ValDescribe(ODesc* d) const override;
 	ValPtr DoClone(CloneState* state) override;
+
+	// Gives the vector its own copy of the elements if it currently
+	// shares them. Needs to be called before any change to them.
+	void MakeUnique();
+
+	// The storage behind val.vector_val. For element types that can't
+	// be modified in place, Clone() lets copies share this until one of
+	// them gets modified.
+	std::shared_ptr<std::vector<ValPtr>> elements;
+
+	// Accounts for an element getting added or removed, given the
+	// capacity of the elements beforehand.
+	void AccountElements(const Val* added, const Val* removed, size_t capacity_before);
+
+	// The account of the global this belongs to, if tracked.
+	zeek::detail::MemoryAccount* memory_account = nullptr;
+	friend void zeek::detail::set_memory_account(Val* v,
+	                                             zeek::detail::MemoryAccount* from,
+	                                             zeek::detail::MemoryAccount* to);
 };
 
 // Checks the given value for consistency with the given type.  If an
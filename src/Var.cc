@@ -718,7 +718,8 @@ void end_func(zeek::detail::StmtPtr body)
 			ingredients->body,
 			ingredients->inits,
 			ingredients->frame_size,
-			ingredients->priority);
+			ingredients->priority,
+			ingredients->filter);
 	else
 		{
 		auto f = zeek::make_intrusive<zeek::detail::ScriptFunc>(
@@ -726,7 +727,8 @@ void end_func(zeek::detail::StmtPtr body)
 			ingredients->body,
 			ingredients->inits,
 			ingredients->frame_size,
-			ingredients->priority);
+			ingredients->priority,
+			ingredients->filter);
 
 		ingredients->id->SetVal(zeek::make_intrusive<zeek::Val>(std::move(f)));
 		ingredients->id->SetConst();
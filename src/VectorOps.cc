@@ -0,0 +1,304 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "VectorOps.h"
+
+#include <type_traits>
+#include <vector>
+
+namespace zeek::detail {
+
+namespace {
+
+// The loops below operate on plain arrays without any calls or data
+// dependencies between iterations, so that the compiler vectorizes them.
+// They're therefore kept free of checks; anything that may need an error
+// gets sorted out before.
+
+template<typename T, typename R, typename Op>
+void apply_kernel(const T* a, const T* b, R* r, size_t n, Op op)
+	{
+	for ( size_t i = 0; i < n; ++i )
+		r[i] = op(a[i], b[i]);
+	}
+
+template<typename T>
+T internal_value(const Val* v);
+
+template<>
+bro_int_t internal_value<bro_int_t>(const Val* v)
+	{ return v->InternalInt(); }
+
+template<>
+bro_uint_t internal_value<bro_uint_t>(const Val* v)
+	{ return v->InternalUnsigned(); }
+
+template<>
+double internal_value<double>(const Val* v)
+	{ return v->InternalDouble(); }
+
+// Fills out with n values from v, which is either a vector or a scalar
+// to repeat. Returns false if the vector misses an element.
+template<typename T>
+bool unbox(const Val* v, size_t n, std::vector<T>& out)
+	{
+	out.resize(n);
+
+	if ( v->GetType()->Tag() != TYPE_VECTOR )
+		{
+		T x = internal_value<T>(v);
+
+		for ( size_t i = 0; i < n; ++i )
+			out[i] = x;
+
+		return true;
+		}
+
+	const auto& elems = *v->AsVector();
+
+	for ( size_t i = 0; i < n; ++i )
+		{
+		if ( ! elems[i] )
+			return false;
+
+		out[i] = internal_value<T>(elems[i].get());
+		}
+
+	return true;
+	}
+
+// Returns a Val of the given type for a value computed the way that
+// BinaryExpr::Fold() does.
+template<typename T>
+ValPtr box(const Type* t, T x)
+	{
+	switch ( t->Tag() ) {
+	case TYPE_INTERVAL:
+		return make_intrusive<IntervalVal>(x);
+
+	case TYPE_TIME:
+		return make_intrusive<TimeVal>(x);
+
+	case TYPE_DOUBLE:
+		return make_intrusive<DoubleVal>(x);
+
+	case TYPE_BOOL:
+		return val_mgr->Bool(x);
+
+	default:
+		if ( t->InternalType() == TYPE_INTERNAL_UNSIGNED )
+			return val_mgr->Count(x);
+
+		return val_mgr->Int(x);
+	}
+	}
+
+template<typename R>
+VectorValPtr box_all(const std::vector<R>& r, const VectorTypePtr& result_type)
+	{
+	auto result = make_intrusive<VectorVal>(result_type);
+	const Type* t = result_type->Yield().get();
+	auto& elems = *result->AsVector();
+
+	elems.reserve(r.size());
+
+	for ( auto x : r )
+		elems.emplace_back(box(t, x));
+
+	return result;
+	}
+
+template<typename T>
+VectorValPtr fold(BroExprTag tag, const Val* v1, const Val* v2, size_t n,
+                  const VectorTypePtr& result_type)
+	{
+	std::vector<T> a;
+	std::vector<T> b;
+
+	if ( ! unbox(v1, n, a) || ! unbox(v2, n, b) )
+		return nullptr;
+
+	constexpr bool is_integral = ! std::is_floating_point_v<T>;
+
+	if ( tag == EXPR_DIVIDE || tag == EXPR_MOD )
+		{
+		for ( auto x : b )
+			if ( x == 0 )
+				return nullptr;
+		}
+
+	std::vector<T> r(n);
+	std::vector<bro_int_t> cmp;
+
+	switch ( tag ) {
+	case EXPR_ADD:
+		apply_kernel(a.data(), b.data(), r.data(), n, [](T x, T y) { return x + y; });
+		break;
+
+	case EXPR_SUB:
+		apply_kernel(a.data(), b.data(), r.data(), n, [](T x, T y) { return x - y; });
+		break;
+
+	case EXPR_TIMES:
+		apply_kernel(a.data(), b.data(), r.data(), n, [](T x, T y) { return x * y; });
+		break;
+
+	case EXPR_DIVIDE:
+		apply_kernel(a.data(), b.data(), r.data(), n, [](T x, T y) { return x / y; });
+		break;
+
+	case EXPR_MOD:
+		if constexpr ( is_integral )
+			{
+			apply_kernel(a.data(), b.data(), r.data(), n, [](T x, T y) { return x % y; });
+			break;
+			}
+		else
+			return nullptr;
+
+#define CMP_KERNEL(op) \
+		cmp.resize(n); \
+		apply_kernel(a.data(), b.data(), cmp.data(), n, \
+		             [](T x, T y) -> bro_int_t { return x op y; }); \
+		return box_all(cmp, result_type);
+
+	case EXPR_LT:	CMP_KERNEL(<)
+	case EXPR_LE:	CMP_KERNEL(<=)
+	case EXPR_EQ:	CMP_KERNEL(==)
+	case EXPR_NE:	CMP_KERNEL(!=)
+	case EXPR_GE:	CMP_KERNEL(>=)
+	case EXPR_GT:	CMP_KERNEL(>)
+
+#undef CMP_KERNEL
+
+	default:
+		return nullptr;
+	}
+
+	return box_all(r, result_type);
+	}
+
+// Sums using several independent accumulators, which lets the compiler
+// vectorize the loop without reordering floating-point operations itself.
+double sum_kernel(const double* x, size_t n)
+	{
+	double acc[4] = { 0.0, 0.0, 0.0, 0.0 };
+	size_t i = 0;
+
+	for ( ; i + 4 <= n; i += 4 )
+		for ( size_t j = 0; j < 4; ++j )
+			acc[j] += x[i + j];
+
+	for ( ; i < n; ++i )
+		acc[0] += x[i];
+
+	return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+	}
+
+template<typename Op>
+double extreme_kernel(const double* x, size_t n, Op better)
+	{
+	double acc[4] = { x[0], x[0], x[0], x[0] };
+	size_t i = 0;
+
+	for ( ; i + 4 <= n; i += 4 )
+		for ( size_t j = 0; j < 4; ++j )
+			acc[j] = better(x[i + j], acc[j]) ? x[i + j] : acc[j];
+
+	for ( ; i < n; ++i )
+		acc[0] = better(x[i], acc[0]) ? x[i] : acc[0];
+
+	double r = acc[0];
+
+	for ( size_t j = 1; j < 4; ++j )
+		r = better(acc[j], r) ? acc[j] : r;
+
+	return r;
+	}
+
+} // namespace
+
+VectorValPtr fold_numeric_vectors(BroExprTag tag, const Val* v1, const Val* v2,
+                                  const VectorTypePtr& result_type)
+	{
+	bool is_vec1 = v1->GetType()->Tag() == TYPE_VECTOR;
+	bool is_vec2 = v2->GetType()->Tag() == TYPE_VECTOR;
+
+	const auto& t1 = is_vec1 ? v1->GetType()->Yield() : v1->GetType();
+	const auto& t2 = is_vec2 ? v2->GetType()->Yield() : v2->GetType();
+
+	// BinaryExpr::Fold() works on the first operand's internal type,
+	// so we don't bother if they differ.
+	auto it = t1->InternalType();
+
+	if ( it != t2->InternalType() )
+		return nullptr;
+
+	// Booleans and enums share the int representation, but aren't
+	// subject to arithmetic.
+	if ( t1->Tag() == TYPE_BOOL || t1->Tag() == TYPE_ENUM ||
+	     t2->Tag() == TYPE_BOOL || t2->Tag() == TYPE_ENUM )
+		return nullptr;
+
+	size_t n = (is_vec1 ? v1 : v2)->AsVectorVal()->Size();
+
+	if ( is_vec1 && is_vec2 && v2->AsVectorVal()->Size() != n )
+		return nullptr;
+
+	switch ( it ) {
+	case TYPE_INTERNAL_INT:
+		return fold<bro_int_t>(tag, v1, v2, n, result_type);
+
+	case TYPE_INTERNAL_UNSIGNED:
+		return fold<bro_uint_t>(tag, v1, v2, n, result_type);
+
+	case TYPE_INTERNAL_DOUBLE:
+		return fold<double>(tag, v1, v2, n, result_type);
+
+	default:
+		return nullptr;
+	}
+	}
+
+int reduce_numeric_vector(const VectorVal* v, BroExprTag tag, double& result)
+	{
+	const auto& t = v->GetType()->Yield();
+	auto it = t->InternalType();
+
+	if ( t->Tag() == TYPE_BOOL || t->Tag() == TYPE_ENUM ||
+	     (it != TYPE_INTERNAL_INT && it != TYPE_INTERNAL_UNSIGNED &&
+	      it != TYPE_INTERNAL_DOUBLE) )
+		return -1;
+
+	std::vector<double> x;
+	x.reserve(v->Size());
+
+	for ( const auto& e : *v->AsVector() )
+		{
+		if ( ! e )
+			continue;
+
+		if ( it == TYPE_INTERNAL_INT )
+			x.push_back(e->InternalInt());
+		else if ( it == TYPE_INTERNAL_UNSIGNED )
+			x.push_back(e->InternalUnsigned());
+		else
+			x.push_back(e->InternalDouble());
+		}
+
+	if ( tag == EXPR_ADD )
+		result = sum_kernel(x.data(), x.size());
+
+	else if ( x.empty() )
+		return 0;
+
+	else if ( tag == EXPR_LT )
+		result = extreme_kernel(x.data(), x.size(), [](double a, double b) { return a < b; });
+
+	else
+		result = extreme_kernel(x.data(), x.size(), [](double a, double b) { return a > b; });
+
+	return x.size();
+	}
+
+} // namespace zeek::detail
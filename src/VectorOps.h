@@ -0,0 +1,52 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "Expr.h"
+#include "Val.h"
+
+namespace zeek::detail {
+
+/**
+ * Applies an arithmetic or comparison operator element-wise to vectors of
+ * a numeric type. This first unboxes the operands' elements into
+ * contiguous arrays, then runs a loop over those that the compiler turns
+ * into SIMD instructions, and finally boxes the results. A scalar operand
+ * applies to all elements of the other one.
+ *
+ * @param tag The operator, one of + - * / % and the comparisons.
+ *
+ * @param v1 The left operand.
+ *
+ * @param v2 The right operand. At least one of *v1* and *v2* must be a
+ * vector. If both are, they must have the same size.
+ *
+ * @param result_type The type of the resulting vector.
+ *
+ * @return The resulting vector, or null if the operands don't qualify.
+ * That's the case for non-numeric types, for operands of different
+ * internal types, for vectors with missing elements, and for division
+ * or modulo by zero. The caller then needs to fold the elements one by
+ * one, which also takes care of reporting errors.
+ */
+VectorValPtr fold_numeric_vectors(BroExprTag tag, const Val* v1, const Val* v2,
+                                  const VectorTypePtr& result_type);
+
+/**
+ * Reduces a vector of a numeric type to a single value. Missing elements
+ * get skipped.
+ *
+ * @param v The vector.
+ *
+ * @param tag Selects the reduction: EXPR_ADD for the sum of the elements,
+ * EXPR_LT for their minimum and EXPR_GT for their maximum.
+ *
+ * @param result Set to the result, as a double. This is 0 for the sum of
+ * an empty vector and left unchanged for its minimum or maximum.
+ *
+ * @return The number of elements that the result covers, or -1 if *v*
+ * isn't a numeric vector.
+ */
+int reduce_numeric_vector(const VectorVal* v, BroExprTag tag, double& result);
+
+} // namespace zeek::detail
@@ -2,10 +2,10 @@
 #include "Net.h"
 #include "util.h"
 
-bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold,
+bool PermitWeird(WeirdStateMap& wsm, WeirdID id, uint64_t threshold,
                  uint64_t rate, double duration)
     {
-	auto& state = wsm[name];
+	auto& state = wsm[id];
 	++state.count;
 
 	if ( state.count <= threshold )
@@ -5,13 +5,20 @@
 #include <string>
 #include <unordered_map>
 
+#include <cstdint>
+
+// Weird names get interned into small integer IDs by the reporter (see
+// Reporter::InternWeird()), so that tracking their state doesn't need to
+// hash the names.
+using WeirdID = uint32_t;
+
 struct WeirdState {
 	WeirdState() = default;
 	uint64_t count = 0;
 	double sampling_start_time = 0;
 };
 
-using WeirdStateMap = std::unordered_map<std::string, WeirdState>;
+using WeirdStateMap = std::unordered_map<WeirdID, WeirdState>;
 
-bool PermitWeird(WeirdStateMap& wsm, const char* name, uint64_t threshold,
+bool PermitWeird(WeirdStateMap& wsm, WeirdID id, uint64_t threshold,
                  uint64_t rate, double duration);
@@ -66,10 +66,13 @@ String::String()
 
 void String::Reset()
 	{
-	if ( use_free_to_delete )
-		free(b);
-	else
-		delete [] b;
+	if ( b != small )
+		{
+		if ( use_free_to_delete )
+			free(b);
+		else
+			delete [] b;
+		}
 
 	b = nullptr;
 	n = 0;
@@ -81,7 +84,7 @@ const String& String::operator=(const String &bs)
 	{
 	Reset();
 	n = bs.n;
-	b = new u_char[n+1];
+	b = Allocate(n+1);
 
 	memcpy(b, bs.b, n);
 	b[n] = '\0';
@@ -118,7 +121,7 @@ void String::Set(const u_char* str, int len, bool add_NUL)
 	Reset();
 
 	n = len;
-	b = new u_char[add_NUL ? n + 1 : n];
+	b = Allocate(add_NUL ? n + 1 : n);
 	memcpy(b, str, n);
 	final_NUL = add_NUL;
 
@@ -133,7 +136,7 @@ void String::Set(const char* str)
 	Reset();
 
 	n = strlen(str);
-	b = new u_char[n+1];
+	b = Allocate(n+1);
 	memcpy(b, str, n+1);
 	final_NUL = true;
 	use_free_to_delete = false;
@@ -144,7 +147,7 @@ void String::Set(const std::string& str)
 	Reset();
 
 	n = str.size();
-	b = new u_char[n+1];
+	b = Allocate(n+1);
 	memcpy(b, str.c_str(), n+1);
 	final_NUL = true;
 	use_free_to_delete = false;
@@ -279,6 +282,9 @@ void String::ToUpper()
 
 unsigned int String::MemoryAllocation() const
 	{
+	if ( b == small )
+		return padded_sizeof(*this);
+
 	return padded_sizeof(*this) + pad_size(n + final_NUL);
 	}
 
@@ -145,10 +145,20 @@ public:
 protected:
 	void Reset();
 
+	// Returns a buffer for size bytes: the inline one if they fit,
+	// otherwise a new one.
+	byte_vec Allocate(int size)
+		{ return size <= SMALL_SIZE ? small : new u_char[size]; }
+
+	// Strings of up to this many bytes, including any final NUL, live
+	// inside the object, saving an allocation for the many short ones.
+	static constexpr int SMALL_SIZE = 24;
+
 	byte_vec b;
 	int n;
 	bool final_NUL;	// whether we have added a final NUL
 	bool use_free_to_delete;	// free() vs. operator delete
+	u_char small[SMALL_SIZE];
 };
 
 // A comparison class that sorts pointers to String's according to
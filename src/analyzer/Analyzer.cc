@@ -9,6 +9,7 @@
 #include "analyzer/protocol/pia/PIA.h"
 #include "../ZeekString.h"
 #include "../Event.h"
+#include "../Stats.h"
 
 namespace analyzer {
 
@@ -226,6 +227,8 @@ void Analyzer::NextPacket(int len, const u_char* data, bool is_orig, uint64_t se
 
 	else
 		{
+		AnalyzerProfileScope aps(analyzer_profiler, this, len);
+
 		try
 			{
 			DeliverPacket(len, data, is_orig, seq, ip, caplen);
@@ -249,6 +252,8 @@ void Analyzer::NextStream(int len, const u_char* data, bool is_orig)
 
 	else
 		{
+		AnalyzerProfileScope aps(analyzer_profiler, this, len);
+
 		try
 			{
 			DeliverStream(len, data, is_orig);
@@ -260,6 +265,40 @@ void Analyzer::NextStream(int len, const u_char* data, bool is_orig)
 		}
 	}
 
+void Analyzer::NextStreamV(const StreamSpan* spans, int n, bool is_orig)
+	{
+	if ( skip )
+		return;
+
+	SupportAnalyzer* next_sibling = FirstSupportAnalyzer(is_orig);
+
+	if ( next_sibling )
+		{
+		for ( int i = 0; i < n && ! skip; ++i )
+			next_sibling->NextStream(spans[i].len, spans[i].data, is_orig);
+		}
+
+	else
+		{
+		int len = 0;
+
+		if ( analyzer_profiler )
+			for ( int i = 0; i < n; ++i )
+				len += spans[i].len;
+
+		AnalyzerProfileScope aps(analyzer_profiler, this, len);
+
+		try
+			{
+			DeliverStreamV(spans, n, is_orig);
+			}
+		catch ( binpac::Exception const &e )
+			{
+			ProtocolViolation(fmt("Binpac exception: %s", e.c_msg()));
+			}
+		}
+	}
+
 void Analyzer::NextUndelivered(uint64_t seq, int len, bool is_orig)
 	{
 	if ( skip )
@@ -305,18 +344,19 @@ void Analyzer::ForwardPacket(int len, const u_char* data, bool is_orig,
 
 	AppendNewChildren();
 
-	// Pass to all children.
-	analyzer_list::iterator next;
-	for ( analyzer_list::iterator i = children.begin();
-	      i != children.end(); i = next )
+	// Pass to all children. They may get added or deleted while we
+	// deliver, so this goes by position rather than by iterator.
+	for ( size_t i = 0; i < children.size(); )
 		{
-		Analyzer* current = *i;
-		next = ++i;
+		Analyzer* current = children[i];
 
 		if ( ! (current->finished || current->removing ) )
+			{
 			current->NextPacket(len, data, is_orig, seq, ip, caplen);
+			++i;
+			}
 		else
-			DeleteChild(--i);
+			DeleteChild(current);
 		}
 
 	AppendNewChildren();
@@ -329,22 +369,28 @@ void Analyzer::ForwardStream(int len, const u_char* data, bool is_orig)
 
 	AppendNewChildren();
 
-	analyzer_list::iterator next;
-	for ( analyzer_list::iterator i = children.begin();
-	      i != children.end(); i = next )
+	for ( size_t i = 0; i < children.size(); )
 		{
-		Analyzer* current = *i;
-		next = ++i;
+		Analyzer* current = children[i];
 
 		if ( ! (current->finished || current->removing ) )
+			{
 			current->NextStream(len, data, is_orig);
+			++i;
+			}
 		else
-			DeleteChild(--i);
+			DeleteChild(current);
 		}
 
 	AppendNewChildren();
 	}
 
+void Analyzer::ForwardStreamV(const StreamSpan* spans, int n, bool is_orig)
+	{
+	for ( int i = 0; i < n; ++i )
+		ForwardStream(spans[i].len, spans[i].data, is_orig);
+	}
+
 void Analyzer::ForwardUndelivered(uint64_t seq, int len, bool is_orig)
 	{
 	if ( output_handler )
@@ -352,17 +398,17 @@ void Analyzer::ForwardUndelivered(uint64_t seq, int len, bool is_orig)
 
 	AppendNewChildren();
 
-	analyzer_list::iterator next;
-	for ( analyzer_list::iterator i = children.begin();
-	      i != children.end(); i = next )
+	for ( size_t i = 0; i < children.size(); )
 		{
-		Analyzer* current = *i;
-		next = ++i;
+		Analyzer* current = children[i];
 
 		if ( ! (current->finished || current->removing ) )
+			{
 			current->NextUndelivered(seq, len, is_orig);
+			++i;
+			}
 		else
-			DeleteChild(--i);
+			DeleteChild(current);
 		}
 
 	AppendNewChildren();
@@ -372,17 +418,17 @@ void Analyzer::ForwardEndOfData(bool orig)
 	{
 	AppendNewChildren();
 
-	analyzer_list::iterator next;
-	for ( analyzer_list::iterator i = children.begin();
-	      i != children.end(); i = next )
+	for ( size_t i = 0; i < children.size(); )
 		{
-		Analyzer* current = *i;
-		next = ++i;
+		Analyzer* current = children[i];
 
 		if ( ! (current->finished || current->removing ) )
+			{
 			current->NextEndOfData(orig);
+			++i;
+			}
 		else
-			DeleteChild(--i);
+			DeleteChild(current);
 		}
 
 	AppendNewChildren();
@@ -546,10 +592,8 @@ Analyzer* Analyzer::FindChild(const char* name)
 	return tag ? FindChild(tag) : nullptr;
 	}
 
-void Analyzer::DeleteChild(analyzer_list::iterator i)
+void Analyzer::DeleteChild(Analyzer* child)
 	{
-	Analyzer* child = *i;
-
 	// Analyzer must have already been finished or marked for removal.
 	assert(child->finished || child->removing);
 
@@ -562,10 +606,25 @@ void Analyzer::DeleteChild(analyzer_list::iterator i)
 	DBG_LOG(DBG_ANALYZER, "%s deleted child %s 3",
 		fmt_analyzer(this).c_str(), fmt_analyzer(child).c_str());
 
-	children.erase(i);
+	// Done() may have changed the children, so look it up only now.
+	children.erase(std::find(children.begin(), children.end(), child));
 	delete child;
 	}
 
+void Analyzer::DeleteChildAnalyzers()
+	{
+	AppendNewChildren();
+
+	for ( auto child : children )
+		if ( ! child->finished )
+			child->removing = true;
+
+	// Children that Done() adds end up in new_children, which the
+	// destructor takes care of.
+	while ( ! children.empty() )
+		DeleteChild(children.back());
+	}
+
 void Analyzer::AddSupportAnalyzer(SupportAnalyzer* analyzer)
 	{
 	if ( HasSupportAnalyzer(analyzer->GetAnalyzerTag(), analyzer->IsOrig()) )
@@ -658,6 +717,13 @@ void Analyzer::DeliverStream(int len, const u_char* data, bool is_orig)
 			fmt_bytes((const char*) data, min(40, len)), len > 40 ? "..." : "");
 	}
 
+void Analyzer::DeliverStreamV(const StreamSpan* spans, int n, bool is_orig)
+	{
+	// Stop if one of the chunks made us skip the rest of the connection.
+	for ( int i = 0; i < n && ! skip; ++i )
+		DeliverStream(spans[i].len, spans[i].data, is_orig);
+	}
+
 void Analyzer::Undelivered(uint64_t seq, int len, bool is_orig)
 	{
 	DBG_LOG(DBG_ANALYZER, "%s Undelivered(%" PRIu64", %d, %s)",
@@ -37,10 +37,20 @@ class AnalyzerTimer;
 class SupportAnalyzer;
 class OutputHandler;
 
-using analyzer_list = std::list<Analyzer*>;
+using analyzer_list = std::vector<Analyzer*>;
 typedef uint32_t ID;
 typedef void (Analyzer::*analyzer_timer_func)(double t);
 
+/**
+ * A chunk of stream input. Analyzer::NextStreamV() takes several of these
+ * that follow each other in the stream, so that data arriving in one go
+ * gets passed on in one call.
+ */
+struct StreamSpan {
+	const u_char* data;
+	int len;
+};
+
 /**
  * Class to receive processed output from an anlyzer.
  */
@@ -174,6 +184,19 @@ public:
 	 */
 	void NextStream(int len, const u_char* data, bool is_orig);
 
+	/**
+	 * Passes several chunks of stream input to the analyzer at once, as
+	 * if by calling NextStream() for each in turn. Without support
+	 * analyzers, the chunks go to DeliverStreamV().
+	 *
+	 * @param spans The chunks, in stream order.
+	 *
+	 * @param n The number of chunks.
+	 *
+	 * @param is_orig True if this is originator-side input.
+	 */
+	void NextStreamV(const StreamSpan* spans, int n, bool is_orig);
+
 	/**
 	 * Informs the analyzer about a gap in the TCP stream, i.e., data
 	 * that can't be delivered. This method triggers Undelivered(), which
@@ -219,6 +242,16 @@ public:
 	 */
 	virtual void ForwardStream(int len, const u_char* data, bool orig);
 
+	/**
+	 * Forwards several chunks of stream input on to all child analyzers.
+	 * This passes each chunk to all children before moving on to the
+	 * next, as ForwardStream() would, so that analyzers that get added
+	 * along the way see the rest of the input.
+	 *
+	 * Parameters are the same as for NextStreamV().
+	 */
+	virtual void ForwardStreamV(const StreamSpan* spans, int n, bool orig);
+
 	/**
 	 * Forwards a sequence gap on to all child analyzers.
 	 *
@@ -248,6 +281,16 @@ public:
 	 */
 	virtual void DeliverStream(int len, const u_char* data, bool orig);
 
+	/**
+	 * Hook for accessing several chunks of stream input at once. This is
+	 * called by NextStreamV() and can be overridden by derived classes
+	 * that can parse across chunks without joining them first. The
+	 * default passes each chunk to DeliverStream().
+	 *
+	 * Parameters are the same as for NextStreamV().
+	 */
+	virtual void DeliverStreamV(const StreamSpan* spans, int n, bool orig);
+
 	/**
 	 * Hook for accessing input gap during parsing. This is called by
 	 * NextUndelivered() and can be overridden by derived classes.
@@ -711,6 +754,13 @@ protected:
 	 */
 	void AppendNewChildren();
 
+	/**
+	 * Calls Done() on all child analyzers that haven't finished yet and
+	 * deletes them. This must not be called while any of them is
+	 * processing input.
+	 */
+	void DeleteChildAnalyzers();
+
 	/**
 	 * Returns true if the child analyzer is now scheduled to be
 	 * removed (and was not before)
@@ -720,7 +770,7 @@ protected:
 private:
 	// Internal method to eventually delete a child analyzer that's
 	// already Done().
-	void DeleteChild(analyzer_list::iterator i);
+	void DeleteChild(Analyzer* child);
 
 	// Helper for the ctors.
 	void CtorInit(const Tag& tag, Connection* conn);
@@ -761,31 +811,27 @@ private:
  * Internal convenience macro to iterate over the list of child analyzers.
  */
 #define LOOP_OVER_CHILDREN(var) \
-	for ( analyzer::analyzer_list::iterator var = children.begin(); \
-	      var != children.end(); var++ )
+	for ( auto var = children.begin(); var != children.end(); var++ )
 
 /**
  * Internal convenience macro to iterate over the constant list of child
  * analyzers.
  */
 #define LOOP_OVER_CONST_CHILDREN(var) \
-	for ( analyzer::analyzer_list::const_iterator var = children.begin(); \
-	      var != children.end(); var++ )
+	for ( auto var = children.cbegin(); var != children.cend(); var++ )
 
 /**
  * Convenience macro to iterate over a given list of child analyzers.
  */
 #define LOOP_OVER_GIVEN_CHILDREN(var, the_kids) \
-	for ( analyzer::analyzer_list::iterator var = the_kids.begin(); \
-	      var != the_kids.end(); var++ )
+	for ( auto var = the_kids.begin(); var != the_kids.end(); var++ )
 
 /**
  * Convenience macro to iterate over a given constant list of child
  * analyzers.
  */
 #define LOOP_OVER_GIVEN_CONST_CHILDREN(var, the_kids) \
-	for ( analyzer::analyzer_list::const_iterator var = the_kids.begin(); \
-	      var != the_kids.end(); var++ )
+	for ( auto var = the_kids.cbegin(); var != the_kids.cend(); var++ )
 
 /**
  * Support analyzer preprocess input before it reaches an analyzer's main
@@ -3,6 +3,7 @@
 #include "Manager.h"
 
 #include "Hash.h"
+#include "Overload.h"
 #include "Val.h"
 #include "IntrusivePtr.h"
 
@@ -41,35 +42,34 @@ Manager::ConnIndex::ConnIndex()
 	proto = 0;
 	}
 
-bool Manager::ConnIndex::operator<(const ConnIndex& other) const
+bool Manager::ConnIndex::operator==(const ConnIndex& other) const
 	{
-	if ( orig != other.orig )
-		return orig < other.orig;
-
-	if ( resp != other.resp )
-		return resp < other.resp;
-
-	if ( proto != other.proto )
-		return proto < other.proto;
-
-	if ( resp_p != other.resp_p )
-		return resp_p < other.resp_p;
+	return resp_p == other.resp_p && proto == other.proto &&
+		orig == other.orig && resp == other.resp;
+	}
 
-	return false;
+hash_t Manager::ConnIndex::Hash::operator()(const ConnIndex& c) const
+	{
+	uint32_t buf[9];
+	c.orig.CopyIPv6(&buf[0]);
+	c.resp.CopyIPv6(&buf[4]);
+	buf[8] = (uint32_t(c.proto) << 16) | c.resp_p;
+	return KeyedHash::Hash64(buf, sizeof(buf));
 	}
 
 Manager::Manager()
-	: plugin::ComponentManager<analyzer::Tag, analyzer::Component>("Analyzer", "Tag")
+	: plugin::ComponentManager<analyzer::Tag, analyzer::Component>("Analyzer", "Tag"),
+	  analyzers_by_port_tcp(65536, nullptr), analyzers_by_port_udp(65536, nullptr)
 	{
 	}
 
 Manager::~Manager()
 	{
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_tcp.begin(); i != analyzers_by_port_tcp.end(); i++ )
-		delete i->second;
+	for ( auto l : analyzers_by_port_tcp )
+		delete l;
 
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_udp.begin(); i != analyzers_by_port_udp.end(); i++ )
-		delete i->second;
+	for ( auto l : analyzers_by_port_udp )
+		delete l;
 
 	// Clean up expected-connection table.
 	while ( conns_by_timeout.size() )
@@ -114,24 +114,30 @@ void Manager::DumpDebug()
 	DBG_LOG(DBG_ANALYZER, " ");
 	DBG_LOG(DBG_ANALYZER, "Analyzers by port:");
 
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_tcp.begin(); i != analyzers_by_port_tcp.end(); i++ )
+	for ( size_t i = 0; i < analyzers_by_port_tcp.size(); ++i )
 		{
+		if ( ! analyzers_by_port_tcp[i] )
+			continue;
+
 		std::string s;
 
-		for ( tag_set::const_iterator j = i->second->begin(); j != i->second->end(); j++ )
+		for ( tag_set::const_iterator j = analyzers_by_port_tcp[i]->begin(); j != analyzers_by_port_tcp[i]->end(); j++ )
 			s += std::string(GetComponentName(*j)) + " ";
 
-		DBG_LOG(DBG_ANALYZER, "    %d/tcp: %s", i->first, s.c_str());
+		DBG_LOG(DBG_ANALYZER, "    %zu/tcp: %s", i, s.c_str());
 		}
 
-	for ( analyzer_map_by_port::const_iterator i = analyzers_by_port_udp.begin(); i != analyzers_by_port_udp.end(); i++ )
+	for ( size_t i = 0; i < analyzers_by_port_udp.size(); ++i )
 		{
+		if ( ! analyzers_by_port_udp[i] )
+			continue;
+
 		std::string s;
 
-		for ( tag_set::const_iterator j = i->second->begin(); j != i->second->end(); j++ )
+		for ( tag_set::const_iterator j = analyzers_by_port_udp[i]->begin(); j != analyzers_by_port_udp[i]->end(); j++ )
 			s += std::string(GetComponentName(*j)) + " ";
 
-		DBG_LOG(DBG_ANALYZER, "    %d/udp: %s", i->first, s.c_str());
+		DBG_LOG(DBG_ANALYZER, "    %zu/udp: %s", i, s.c_str());
 		}
 
 #endif
@@ -340,16 +346,14 @@ Manager::tag_set* Manager::LookupPort(TransportProto proto, uint32_t port, bool
 		return nullptr;
 	}
 
-	analyzer_map_by_port::const_iterator i = m->find(port);
+	if ( port >= m->size() )
+		return nullptr;
 
-	if ( i != m->end() )
-		return i->second;
+	tag_set*& l = (*m)[port];
 
-	if ( ! add_if_not_found )
-		return nullptr;
+	if ( ! l && add_if_not_found )
+		l = new tag_set;
 
-	tag_set* l = new tag_set;
-	m->insert(std::make_pair(port, l));
 	return l;
 	}
 
@@ -371,14 +375,20 @@ bool Manager::BuildInitialAnalyzerTree(Connection* conn)
 
 	case TRANSPORT_TCP:
 		root = tcp = new tcp::TCP_Analyzer(conn);
-		pia = new pia::PIA_TCP(conn);
+
+		if ( ! (overload_controller && overload_controller->ShedDPD()) )
+			pia = new pia::PIA_TCP(conn);
+
 		check_port = true;
 		DBG_ANALYZER(conn, "activated TCP analyzer");
 		break;
 
 	case TRANSPORT_UDP:
 		root = udp = new udp::UDP_Analyzer(conn);
-		pia = new pia::PIA_UDP(conn);
+
+		if ( ! (overload_controller && overload_controller->ShedDPD()) )
+			pia = new pia::PIA_UDP(conn);
+
 		check_port = true;
 		DBG_ANALYZER(conn, "activated UDP analyzer");
 		break;
@@ -583,6 +593,9 @@ void Manager::ScheduleAnalyzer(const IPAddr& orig, const IPAddr& resp, zeek::Por
 
 Manager::tag_set Manager::GetScheduled(const Connection* conn)
 	{
+	if ( conns.empty() )
+		return {};
+
 	ConnIndex c(conn->OrigAddr(), conn->RespAddr(),
 		    ntohs(conn->RespPort()), conn->ConnTransport());
 
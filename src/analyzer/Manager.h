@@ -21,6 +21,7 @@
 #pragma once
 
 #include <queue>
+#include <unordered_map>
 #include <vector>
 
 #include "Analyzer.h"
@@ -29,6 +30,7 @@
 #include "plugin/ComponentManager.h"
 
 #include "../Dict.h"
+#include "../Hash.h"
 #include "../net_util.h"
 #include "../IP.h"
 
@@ -345,7 +347,10 @@ public:
 private:
 
 	using tag_set = std::set<Tag>;
-	using analyzer_map_by_port = std::map<uint32_t, tag_set*>;
+
+	// Indexed directly by port number, so that looking up the analyzers
+	// for a new connection's port doesn't need a search.
+	using analyzer_map_by_port = std::vector<tag_set*>;
 
 	tag_set* LookupPort(zeek::PortVal* val, bool add_if_not_found);
 	tag_set* LookupPort(TransportProto proto, uint32_t port, bool add_if_not_found);
@@ -373,7 +378,11 @@ private:
 			     uint16_t _resp_p, uint16_t _proto);
 		ConnIndex();
 
-		bool operator<(const ConnIndex& other) const;
+		bool operator==(const ConnIndex& other) const;
+
+		struct Hash {
+			hash_t operator()(const ConnIndex& c) const;
+		};
 	};
 
 	// Information associated with a scheduled connection.
@@ -389,7 +398,9 @@ private:
 		};
 	};
 
-	using conns_map = std::multimap<ConnIndex, ScheduledAnalyzer*>;
+	// Hashed so that checking each new connection for scheduled
+	// analyzers stays cheap with many of them pending.
+	using conns_map = std::unordered_multimap<ConnIndex, ScheduledAnalyzer*, ConnIndex::Hash>;
 	using conns_queue = std::priority_queue<ScheduledAnalyzer*,
 	                                        std::vector<ScheduledAnalyzer*>,
 	                                        ScheduledAnalyzer::Comparator>;
@@ -0,0 +1,169 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <inttypes.h>
+
+namespace analyzer { namespace asn1 {
+
+/**
+ * A BER encoded element. Its content points into the buffer it got
+ * decoded from, which needs to outlive it.
+ */
+struct BERElement {
+	uint8_t tag = 0;	// the first identifier octet
+	const u_char* content = nullptr;
+	uint64_t length = 0;
+};
+
+/**
+ * Decodes the elements of a BER buffer one after the other, without
+ * copying or allocating anything, so that analyzers can look at just the
+ * elements they need. Only definite lengths are supported, which is all
+ * that DER and the BER subsets of SNMP and Kerberos use.
+ */
+class BERReader {
+public:
+	BERReader(const u_char* data, uint64_t len)
+		: next(data), end(data + len)
+		{ }
+
+	/**
+	 * Reads the content of a constructed element.
+	 */
+	explicit BERReader(const BERElement& e)
+		: BERReader(e.content, e.length)
+		{ }
+
+	bool AtEnd() const	{ return next >= end; }
+
+	/**
+	 * Decodes the next element and moves past it.
+	 * @param e receives the element.
+	 * @return false if there are no more elements, or if the next one is
+	 * malformed or truncated, in which case the reader stops there.
+	 */
+	bool Next(BERElement* e)
+		{
+		if ( AtEnd() )
+			return false;
+
+		const u_char* p = next;
+		e->tag = *p++;
+
+		if ( (e->tag & 0x1f) == 0x1f )
+			{
+			// High tag number form, which ends with an octet
+			// lacking the top bit.
+			while ( p < end && (*p & 0x80) )
+				++p;
+
+			if ( p++ >= end )
+				return Fail();
+			}
+
+		if ( p >= end )
+			return Fail();
+
+		uint64_t len = *p++;
+
+		if ( len & 0x80 )
+			{
+			int n = len & 0x7f;
+
+			// Indefinite lengths and ones beyond 64 bits.
+			if ( n == 0 || n > 8 || n > end - p )
+				return Fail();
+
+			len = 0;
+
+			while ( n-- )
+				len = (len << 8) | *p++;
+			}
+
+		if ( len > static_cast<uint64_t>(end - p) )
+			return Fail();
+
+		e->content = p;
+		e->length = len;
+		next = p + len;
+		return true;
+		}
+
+private:
+	bool Fail()
+		{
+		next = end;
+		return false;
+		}
+
+	const u_char* next;
+	const u_char* end;
+};
+
+/**
+ * Decodes the content of an INTEGER, or of an application type based on
+ * one, as an unsigned big-endian number. Content beyond 8 octets keeps
+ * only its lowest ones.
+ */
+inline uint64_t ber_decode_unsigned(const u_char* data, uint64_t len)
+	{
+	uint64_t rval = 0;
+
+	for ( uint64_t i = 0; i < len; ++i )
+		rval = (rval << 8) | data[i];
+
+	return rval;
+	}
+
+/**
+ * Renders the content of an OBJECT IDENTIFIER in dotted notation.
+ * @param buf receives the text, null-terminated. Up to 21 octets per
+ * octet of content, plus 22, always suffice.
+ * @param size the size of *buf*.
+ * @return the length of the text, or -1 if the content ends within a
+ * subidentifier or the text doesn't fit.
+ */
+inline int ber_format_oid(const u_char* data, uint64_t len, char* buf, size_t size)
+	{
+	size_t n = 0;
+	uint64_t value = 0;
+	bool first = true;
+
+	if ( len == 0 )
+		return -1;
+
+	for ( uint64_t i = 0; i < len; ++i )
+		{
+		value = (value << 7) | (data[i] & 0x7f);
+
+		if ( data[i] & 0x80 )
+			continue;
+
+		int w;
+
+		if ( first )
+			w = snprintf(buf + n, size - n, "%" PRIu64 ".%" PRIu64,
+			             value / 40, value % 40);
+		else
+			w = snprintf(buf + n, size - n, ".%" PRIu64, value);
+
+		if ( w < 0 || static_cast<size_t>(w) >= size - n )
+			return -1;
+
+		n += w;
+		value = 0;
+		first = false;
+		}
+
+	if ( data[len - 1] & 0x80 )
+		return -1;
+
+	return n;
+	}
+
+} } // namespace analyzer::*
@@ -3,6 +3,8 @@
 // See ConnSize.h for more extensive comments.
 
 
+#include <limits>
+
 #include "ConnSize.h"
 #include "analyzer/protocol/tcp/TCP.h"
 #include "IP.h"
@@ -38,6 +40,8 @@ void ConnSize_Analyzer::Init()
 	orig_pkts_thresh = 0;
 	resp_bytes_thresh = 0;
 	resp_pkts_thresh = 0;
+
+	UpdateWatermarks();
 	}
 
 void ConnSize_Analyzer::Done()
@@ -100,24 +104,46 @@ void ConnSize_Analyzer::CheckThresholds(bool is_orig)
 			duration_thresh = 0;
 			}
 		}
+
+	UpdateWatermarks();
+	}
+
+void ConnSize_Analyzer::UpdateWatermarks()
+	{
+	constexpr auto none = std::numeric_limits<uint64_t>::max();
+
+	orig_bytes_next = orig_bytes_thresh ? orig_bytes_thresh : none;
+	resp_bytes_next = resp_bytes_thresh ? resp_bytes_thresh : none;
+	orig_pkts_next = orig_pkts_thresh ? orig_pkts_thresh : none;
+	resp_pkts_next = resp_pkts_thresh ? resp_pkts_thresh : none;
+
+	duration_next = duration_thresh ? start_time + duration_thresh
+	                                : std::numeric_limits<double>::infinity();
 	}
 
 void ConnSize_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig, uint64_t seq, const IP_Hdr* ip, int caplen)
 	{
 	Analyzer::DeliverPacket(len, data, is_orig, seq, ip, caplen);
 
+	bool check;
+
 	if ( is_orig )
 		{
 		orig_bytes += ip->TotalLen();
 		orig_pkts ++;
+		check = orig_bytes >= orig_bytes_next || orig_pkts >= orig_pkts_next;
 		}
 	else
 		{
 		resp_bytes += ip->TotalLen();
 		resp_pkts ++;
+		check = resp_bytes >= resp_bytes_next || resp_pkts >= resp_pkts_next;
 		}
 
-	CheckThresholds(is_orig);
+	// The duration check compares against the watermark with a bit of
+	// slack, so that rounding can't make it skip the exact check.
+	if ( check || network_time >= duration_next - 1e-6 )
+		CheckThresholds(is_orig);
 	}
 
 void ConnSize_Analyzer::SetByteAndPacketThreshold(uint64_t threshold, bool bytes, bool orig)
@@ -169,13 +195,15 @@ void ConnSize_Analyzer::SetDurationThreshold(double duration)
 
 void ConnSize_Analyzer::UpdateConnVal(zeek::RecordVal *conn_val)
 	{
-	// RecordType *connection_type is decleared in NetVar.h
-	zeek::RecordVal* orig_endp = conn_val->GetField("orig")->AsRecordVal();
-	zeek::RecordVal* resp_endp = conn_val->GetField("resp")->AsRecordVal();
+	// This runs whenever the connection record gets built, so look up
+	// the fields only once.
+	static int origidx = zeek::id::connection->FieldOffset("orig");
+	static int respidx = zeek::id::connection->FieldOffset("resp");
+	static int pktidx = zeek::id::endpoint->FieldOffset("num_pkts");
+	static int bytesidx = zeek::id::endpoint->FieldOffset("num_bytes_ip");
 
-	// endpoint is the RecordType from NetVar.h
-	int pktidx = zeek::id::endpoint->FieldOffset("num_pkts");
-	int bytesidx = zeek::id::endpoint->FieldOffset("num_bytes_ip");
+	zeek::RecordVal* orig_endp = conn_val->GetField(origidx)->AsRecordVal();
+	zeek::RecordVal* resp_endp = conn_val->GetField(respidx)->AsRecordVal();
 
 	if ( pktidx < 0 )
 		reporter->InternalError("'endpoint' record missing 'num_pkts' field");
@@ -183,10 +211,10 @@ void ConnSize_Analyzer::UpdateConnVal(zeek::RecordVal *conn_val)
 	if ( bytesidx < 0 )
 		reporter->InternalError("'endpoint' record missing 'num_bytes_ip' field");
 
-	orig_endp->Assign(pktidx, zeek::val_mgr->Count(orig_pkts));
-	orig_endp->Assign(bytesidx, zeek::val_mgr->Count(orig_bytes));
-	resp_endp->Assign(pktidx, zeek::val_mgr->Count(resp_pkts));
-	resp_endp->Assign(bytesidx, zeek::val_mgr->Count(resp_bytes));
+	orig_endp->AssignCount(pktidx, orig_pkts);
+	orig_endp->AssignCount(bytesidx, orig_bytes);
+	resp_endp->AssignCount(pktidx, resp_pkts);
+	resp_endp->AssignCount(bytesidx, resp_bytes);
 
 	Analyzer::UpdateConnVal(conn_val);
 	}
@@ -33,6 +33,7 @@ protected:
 	void DeliverPacket(int len, const u_char* data, bool is_orig,
 					   uint64_t seq, const IP_Hdr* ip, int caplen) override;
 	void CheckThresholds(bool is_orig);
+	void UpdateWatermarks();
 
 	void ThresholdEvent(EventHandlerPtr f, uint64_t threshold, bool is_orig);
 
@@ -48,6 +49,15 @@ protected:
 
 	double start_time;
 	double duration_thresh;
+
+	// What the counters and network_time need to reach for
+	// CheckThresholds() to have anything to do, derived from the
+	// thresholds by UpdateWatermarks().
+	uint64_t orig_bytes_next;
+	uint64_t resp_bytes_next;
+	uint64_t orig_pkts_next;
+	uint64_t resp_pkts_next;
+	double duration_next;
 };
 
 } } // namespace analyzer::*
@@ -23,6 +23,7 @@ DNS_Interpreter::DNS_Interpreter(analyzer::Analyzer* arg_analyzer)
 	{
 	analyzer = arg_analyzer;
 	first_message = true;
+	name_weirds = 0;
 	}
 
 void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
@@ -66,6 +67,8 @@ void DNS_Interpreter::ParseMessage(const u_char* data, int len, int is_query)
 		}
 
 	const u_char* msg_start = data;	// needed for interpreting compression
+	compressed_names.clear();
+	compressed_name_data.clear();
 
 	data += hdr_len;
 	len -= hdr_len;
@@ -238,7 +241,7 @@ bool DNS_Interpreter::ParseAnswer(DNS_MsgInfo* msg,
 	// Note that the exact meaning of some of these fields will be
 	// re-interpreted by other, more adventurous RR types.
 
-	msg->query_name = zeek::make_intrusive<zeek::StringVal>(new zeek::String(name, name_end - name, true));
+	msg->SetQueryName(name, name_end - name);
 	msg->atype = RR_Type(ExtractShort(data, len));
 	msg->aclass = ExtractShort(data, len);
 	msg->ttl = ExtractLong(data, len);
@@ -372,7 +375,7 @@ u_char* DNS_Interpreter::ExtractName(const u_char*& data, int& len,
 	int n = name - name_start;
 
 	if ( n >= 255 )
-		analyzer->Weird("DNS_NAME_too_long");
+		NameWeird("DNS_NAME_too_long");
 
 	if ( n >= 2 && name[-1] == '.' )
 		{
@@ -429,17 +432,46 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 			//  But actually this turns out not to be the case -
 			//  sometimes compression points to compression.)
 
-			analyzer->Weird("DNS_label_forward_compress_offset");
+			NameWeird("DNS_label_forward_compress_offset");
+			return false;
+			}
+
+		int max_end = orig_data - msg_start;
+
+		for ( const auto& cn : compressed_names )
+			{
+			// Reuse the name if decoding it again would have
+			// given the same result, i.e. if it fits.
+			if ( cn.offset != offset || cn.end > max_end ||
+			     cn.len + 1 > name_len )
+				continue;
+
+			memcpy(name, compressed_name_data.data() + cn.start, cn.len);
+			name[cn.len] = 0;
+			name_len -= cn.len;
+			name += cn.len;
 			return false;
 			}
 
 		// Recursively resolve name.
 		const u_char* recurse_data = msg_start + offset;
 		int recurse_max_len = orig_data - recurse_data;
+		int weirds = name_weirds;
 
 		u_char* name_end = ExtractName(recurse_data, recurse_max_len,
 						name, name_len, msg_start);
 
+		// Names that were malformed don't get reused, so that
+		// every pointer to them reports that again.
+		if ( name_weirds == weirds && name_end > name )
+			{
+			compressed_names.push_back({offset, int(recurse_data - msg_start),
+			                            int(compressed_name_data.size()),
+			                            int(name_end - name)});
+			compressed_name_data.append(reinterpret_cast<const char*>(name),
+			                            name_end - name);
+			}
+
 		name_len -= name_end - name;
 		name = name_end;
 
@@ -448,7 +480,7 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 
 	if ( label_len > len )
 		{
-		analyzer->Weird("DNS_label_len_gt_pkt");
+		NameWeird("DNS_label_len_gt_pkt");
 		data += len;	// consume the rest of the packet
 		len = 0;
 		return false;
@@ -458,13 +490,13 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 		// NetBIOS name service look ups can use longer labels.
 		ntohs(analyzer->Conn()->RespPort()) != 137 )
 		{
-		analyzer->Weird("DNS_label_too_long");
+		NameWeird("DNS_label_too_long");
 		return false;
 		}
 
 	if ( label_len >= name_len )
 		{
-		analyzer->Weird("DNS_label_len_gt_name_len");
+		NameWeird("DNS_label_len_gt_name_len");
 		return false;
 		}
 
@@ -480,6 +512,12 @@ bool DNS_Interpreter::ExtractLabel(const u_char*& data, int& len,
 	return true;
 	}
 
+void DNS_Interpreter::NameWeird(const char* name)
+	{
+	++name_weirds;
+	analyzer->Weird(name);
+	}
+
 uint16_t DNS_Interpreter::ExtractShort(const u_char*& data, int& len)
 	{
 	if ( len < 2 )
@@ -1541,13 +1579,30 @@ zeek::RecordValPtr DNS_MsgInfo::BuildHdrVal()
 	return r;
 	}
 
+void DNS_MsgInfo::SetQueryName(const u_char* name, int len)
+	{
+	query_name_data.assign(reinterpret_cast<const char*>(name), len);
+	have_query_name = true;
+	query_name = nullptr;
+	}
+
+const zeek::StringValPtr& DNS_MsgInfo::QueryName()
+	{
+	if ( have_query_name && ! query_name )
+		query_name = zeek::make_intrusive<zeek::StringVal>(
+			new zeek::String(reinterpret_cast<const u_char*>(query_name_data.data()),
+			                 query_name_data.size(), true));
+
+	return query_name;
+	}
+
 zeek::RecordValPtr DNS_MsgInfo::BuildAnswerVal()
 	{
 	static auto dns_answer = zeek::id::find_type<zeek::RecordType>("dns_answer");
 	auto r = zeek::make_intrusive<zeek::RecordVal>(dns_answer);
 
 	r->Assign(0, zeek::val_mgr->Count(int(answer_type)));
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 	r->Assign(2, zeek::val_mgr->Count(atype));
 	r->Assign(3, zeek::val_mgr->Count(aclass));
 	r->Assign(4, zeek::make_intrusive<zeek::IntervalVal>(double(ttl), Seconds));
@@ -1563,7 +1618,7 @@ zeek::RecordValPtr DNS_MsgInfo::BuildEDNS_Val()
 	auto r = zeek::make_intrusive<zeek::RecordVal>(dns_edns_additional);
 
 	r->Assign(0, zeek::val_mgr->Count(int(answer_type)));
-	r->Assign(1, query_name);
+	r->Assign(1, QueryName());
 
 	// type = 0x29 or 41 = EDNS
 	r->Assign(2, zeek::val_mgr->Count(atype));
@@ -1611,7 +1666,7 @@ zeek::RecordValPtr DNS_MsgInfo::BuildTSIG_Val(struct TSIG_DATA* tsig)
 	double rtime = tsig->time_s + tsig->time_ms / 1000.0;
 
 	// r->Assign(0, zeek::val_mgr->Count(int(answer_type)));
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, zeek::val_mgr->Count(int(answer_type)));
 	r->Assign(2, zeek::make_intrusive<zeek::StringVal>(tsig->alg_name));
 	r->Assign(3, zeek::make_intrusive<zeek::StringVal>(tsig->sig));
@@ -1629,7 +1684,7 @@ zeek::RecordValPtr DNS_MsgInfo::BuildRRSIG_Val(RRSIG_DATA* rrsig)
 	static auto dns_rrsig_rr = zeek::id::find_type<zeek::RecordType>("dns_rrsig_rr");
 	auto r = zeek::make_intrusive<zeek::RecordVal>(dns_rrsig_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, zeek::val_mgr->Count(int(answer_type)));
 	r->Assign(2, zeek::val_mgr->Count(rrsig->type_covered));
 	r->Assign(3, zeek::val_mgr->Count(rrsig->algorithm));
@@ -1650,7 +1705,7 @@ zeek::RecordValPtr DNS_MsgInfo::BuildDNSKEY_Val(DNSKEY_DATA* dnskey)
 	static auto dns_dnskey_rr = zeek::id::find_type<zeek::RecordType>("dns_dnskey_rr");
 	auto r = zeek::make_intrusive<zeek::RecordVal>(dns_dnskey_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, zeek::val_mgr->Count(int(answer_type)));
 	r->Assign(2, zeek::val_mgr->Count(dnskey->dflags));
 	r->Assign(3, zeek::val_mgr->Count(dnskey->dprotocol));
@@ -1666,7 +1721,7 @@ zeek::RecordValPtr DNS_MsgInfo::BuildNSEC3_Val(NSEC3_DATA* nsec3)
 	static auto dns_nsec3_rr = zeek::id::find_type<zeek::RecordType>("dns_nsec3_rr");
 	auto r = zeek::make_intrusive<zeek::RecordVal>(dns_nsec3_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, zeek::val_mgr->Count(int(answer_type)));
 	r->Assign(2, zeek::val_mgr->Count(nsec3->nsec_flags));
 	r->Assign(3, zeek::val_mgr->Count(nsec3->nsec_hash_algo));
@@ -1686,7 +1741,7 @@ zeek::RecordValPtr DNS_MsgInfo::BuildDS_Val(DS_DATA* ds)
 	static auto dns_ds_rr = zeek::id::find_type<zeek::RecordType>("dns_ds_rr");
 	auto r = zeek::make_intrusive<zeek::RecordVal>(dns_ds_rr);
 
-	r->Assign(0, query_name);
+	r->Assign(0, QueryName());
 	r->Assign(1, zeek::val_mgr->Count(int(answer_type)));
 	r->Assign(2, zeek::val_mgr->Count(ds->key_tag));
 	r->Assign(3, zeek::val_mgr->Count(ds->algorithm));
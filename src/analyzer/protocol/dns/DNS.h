@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "analyzer/protocol/tcp/TCP.h"
 #include "binpac_bro.h"
 
@@ -217,6 +220,11 @@ public:
 	zeek::RecordValPtr BuildNSEC3_Val(struct NSEC3_DATA*);
 	zeek::RecordValPtr BuildDS_Val(struct DS_DATA*);
 
+	// Sets the name of the current answer. Its value only gets built
+	// once a handler needs it.
+	void SetQueryName(const u_char* name, int len);
+	const zeek::StringValPtr& QueryName();
+
 	int id;
 	int opcode;	///< query type, see DNS_Opcode
 	int rcode;	///< return code, see DNS_Code
@@ -232,6 +240,8 @@ public:
 	int arcount;	///< number of additional RRs
 	int is_query;	///< whether it came from the session initiator
 
+	std::string query_name_data;
+	bool have_query_name = false;
 	zeek::StringValPtr query_name;
 	RR_Type atype;
 	int aclass;	///< normally = 1, inet
@@ -343,8 +353,26 @@ protected:
 					zeek::String* question_name,
 					zeek::String* original_name);
 
+	// A name that a compression pointer of the current message led to.
+	struct CompressedName {
+		int offset;	// of the name in the message
+		int end;	// of the name's encoding in the message
+		int start;	// of the decoded name in compressed_name_data
+		int len;
+	};
+
+	// Reports a weird about a malformed name.
+	void NameWeird(const char* name);
+
 	analyzer::Analyzer* analyzer;
 	bool first_message;
+
+	// Names that compression pointers led to in the current message,
+	// so that each gets decoded only once however many records point
+	// to it.
+	std::vector<CompressedName> compressed_names;
+	std::string compressed_name_data;
+	int name_weirds;
 };
 
 
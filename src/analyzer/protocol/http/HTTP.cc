@@ -13,6 +13,7 @@
 #include "Event.h"
 #include "analyzer/protocol/mime/MIME.h"
 #include "file_analysis/Manager.h"
+#include "RuleMatcher.h"
 
 #include "events.bif.h"
 
@@ -36,6 +37,63 @@ enum {
 	EXPECT_REPLY_NOTHING,
 };
 
+// The headers that the analyzer interprets itself.
+enum class KnownHeader {
+	OTHER,
+	CONNECTION,
+	CONTENT_ENCODING,
+	CONTENT_LENGTH,
+	CONTENT_RANGE,
+	TRANSFER_ENCODING,
+	UPGRADE,
+};
+
+// Recognizes the headers that the analyzer interprets. Their names all
+// differ in length, so every header costs at most one comparison.
+static KnownHeader known_header(zeek::data_chunk_t name)
+	{
+	const char* candidate;
+	KnownHeader rval;
+
+	switch ( name.length ) {
+	case 7:
+		candidate = "upgrade";
+		rval = KnownHeader::UPGRADE;
+		break;
+
+	case 10:
+		candidate = "connection";
+		rval = KnownHeader::CONNECTION;
+		break;
+
+	case 13:
+		candidate = "content-range";
+		rval = KnownHeader::CONTENT_RANGE;
+		break;
+
+	case 14:
+		candidate = "content-length";
+		rval = KnownHeader::CONTENT_LENGTH;
+		break;
+
+	case 16:
+		candidate = "content-encoding";
+		rval = KnownHeader::CONTENT_ENCODING;
+		break;
+
+	case 17:
+		candidate = "transfer-encoding";
+		rval = KnownHeader::TRANSFER_ENCODING;
+		break;
+
+	default:
+		return KnownHeader::OTHER;
+	}
+
+	return strncasecmp(name.data, candidate, name.length) == 0 ?
+		rval : KnownHeader::OTHER;
+	}
+
 HTTP_Entity::HTTP_Entity(HTTP_Message *arg_message, MIME_Entity* parent_entity, int arg_expect_body)
 :MIME_Entity(arg_message, parent_entity)
 	{
@@ -199,6 +257,18 @@ void HTTP_Entity::DeliverBody(int len, const char* data, bool trailing_CRLF)
 				http_message->MyHTTP_Analyzer()->Conn(),
 						false, method);
 			zip->SetOutputHandler(new UncompressedOutput(this));
+			zip->SetMaxRatio(http_max_decompression_ratio);
+			}
+
+		// Decompressing is wasted effort if nothing looks at the
+		// output. That's for good once the body gets skipped.
+		if ( ! deliver_body && ! WantsClearBody() )
+			zip->Stop();
+
+		if ( zip->Stopped() )
+			{
+			body_length += len;
+			return;
 			}
 
 		zip->NextStream(len, (const u_char*) data, false);
@@ -207,6 +277,14 @@ void HTTP_Entity::DeliverBody(int len, const char* data, bool trailing_CRLF)
 		DeliverBodyClear(len, data, trailing_CRLF);
 	}
 
+bool HTTP_Entity::WantsClearBody() const
+	{
+	if ( rule_matcher && rule_matcher->HasNonFileMagicRule() )
+		return true;
+
+	return ! http_message->MyHTTP_Analyzer()->GetChildren().empty();
+	}
+
 void HTTP_Entity::DeliverBodyClear(int len, const char* data, bool trailing_CRLF)
 	{
 	bool new_data = (body_length == 0);
@@ -359,7 +437,9 @@ void HTTP_Entity::SetPlainDelivery(int64_t length)
 
 void HTTP_Entity::SubmitHeader(mime::MIME_Header* h)
 	{
-	if ( mime::istrequal(h->get_name(), "content-length") )
+	KnownHeader name = known_header(h->get_name());
+
+	if ( name == KnownHeader::CONTENT_LENGTH )
 		{
 		zeek::data_chunk_t vt = h->get_value_token();
 		if ( ! mime::is_null_data_chunk(vt) )
@@ -385,7 +465,7 @@ void HTTP_Entity::SubmitHeader(mime::MIME_Header* h)
 		}
 
 	// Figure out content-length for HTTP 206 Partial Content response
-	else if ( mime::istrequal(h->get_name(), "content-range") &&
+	else if ( name == KnownHeader::CONTENT_RANGE &&
 		      http_message->MyHTTP_Analyzer()->HTTP_ReplyCode() == 206 )
 		{
 		zeek::data_chunk_t vt = h->get_value_token();
@@ -470,7 +550,7 @@ void HTTP_Entity::SubmitHeader(mime::MIME_Header* h)
 			}
 		}
 
-	else if ( mime::istrequal(h->get_name(), "transfer-encoding") )
+	else if ( name == KnownHeader::TRANSFER_ENCODING )
 		{
 		HTTP_Analyzer::HTTP_VersionNumber http_version;
 
@@ -485,7 +565,7 @@ void HTTP_Entity::SubmitHeader(mime::MIME_Header* h)
 			chunked_transfer_state = BEFORE_CHUNK;
 		}
 
-	else if ( mime::istrequal(h->get_name(), "content-encoding") )
+	else if ( name == KnownHeader::CONTENT_ENCODING )
 		{
 		zeek::data_chunk_t vt = h->get_value_token();
 		if ( mime::istrequal(vt, "gzip") || mime::istrequal(vt, "x-gzip") )
@@ -1242,7 +1322,7 @@ int HTTP_Analyzer::HTTP_RequestLine(const char* line, const char* end_of_line)
 		return -1;
 		}
 
-	request_method = zeek::make_intrusive<zeek::StringVal>(end_of_method - line, line);
+	request_method = zeek::val_mgr->InternedString(end_of_method - line, line);
 
 	Conn()->Match(Rule::HTTP_REQUEST,
 			(const u_char*) unescaped_URI->AsString()->Bytes(),
@@ -1398,7 +1478,7 @@ void HTTP_Analyzer::HTTP_Request()
 			request_method,
 			TruncateURI(request_URI),
 			TruncateURI(unescaped_URI),
-			zeek::make_intrusive<zeek::StringVal>(fmt("%.1f", request_version.ToDouble()))
+			zeek::val_mgr->InternedString(fmt("%.1f", request_version.ToDouble()))
 		);
 	}
 
@@ -1407,11 +1487,11 @@ void HTTP_Analyzer::HTTP_Reply()
 	if ( http_reply )
 		EnqueueConnEvent(http_reply,
 			ConnVal(),
-			zeek::make_intrusive<zeek::StringVal>(fmt("%.1f", reply_version.ToDouble())),
+			zeek::val_mgr->InternedString(fmt("%.1f", reply_version.ToDouble())),
 			zeek::val_mgr->Count(reply_code),
 			reply_reason_phrase ?
 				reply_reason_phrase :
-				zeek::make_intrusive<zeek::StringVal>("<empty>")
+				zeek::val_mgr->InternedString("<empty>")
 		);
 	else
 		reply_reason_phrase = nullptr;
@@ -1551,7 +1631,7 @@ int HTTP_Analyzer::HTTP_ReplyLine(const char* line, const char* end_of_line)
 
 	rest = skip_whitespace(rest, end_of_line);
 	reply_reason_phrase =
-	    zeek::make_intrusive<zeek::StringVal>(end_of_line - rest, (const char *) rest);
+	    zeek::val_mgr->InternedString(end_of_line - rest, (const char *) rest);
 
 	return 1;
 	}
@@ -1597,14 +1677,15 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, mime::MIME_Header* h)
 	// side, and if seen assume the connection to be persistent.
 	// This seems fairly safe - at worst, the client does indeed
 	// send additional requests, and the server ignores them.
-	if ( is_orig && mime::istrequal(h->get_name(), "connection") )
+	KnownHeader name = known_header(h->get_name());
+
+	if ( is_orig && name == KnownHeader::CONNECTION )
 		{
 		if ( mime::istrequal(h->get_value_token(), "keep-alive") )
 			keep_alive = 1;
 		}
 
-	if ( ! is_orig &&
-	     mime::istrequal(h->get_name(), "connection") )
+	if ( ! is_orig && name == KnownHeader::CONNECTION )
 		{
 		if ( mime::istrequal(h->get_value_token(), "close") )
 			connection_close = 1;
@@ -1612,8 +1693,7 @@ void HTTP_Analyzer::HTTP_Header(bool is_orig, mime::MIME_Header* h)
 			upgrade_connection = true;
 		}
 
-	if ( ! is_orig &&
-	     mime::istrequal(h->get_name(), "upgrade") )
+	if ( ! is_orig && name == KnownHeader::UPGRADE )
 	     upgrade_protocol.assign(h->get_value_token().data, h->get_value_token().length);
 
 	if ( http_header )
@@ -71,6 +71,10 @@ protected:
 	void DeliverBody(int len, const char* data, bool trailing_CRLF);
 	void DeliverBodyClear(int len, const char* data, bool trailing_CRLF);
 
+	// Returns true if signatures or child analyzers consume the body
+	// beyond what gets delivered to the entity.
+	bool WantsClearBody() const;
+
 	void SubmitData(int len, const char* buf) override;
 
 	void SetPlainDelivery(int64_t length);
@@ -114,6 +118,7 @@ public:
 	void SubmitAllHeaders(mime::MIME_HeaderList& /* hlist */) override;
 	void SubmitData(int len, const char* buf) override;
 	bool RequestBuffer(int* plen, char** pbuf) override;
+	bool AcceptsUnbufferedData() const override	{ return true; }
 	void SubmitAllData();
 	void SubmitEvent(int event_type, const char* detail) override;
 
@@ -229,8 +229,8 @@ zeek::RecordValPtr ICMP_Analyzer::BuildICMPVal(const struct icmp* icmpp, int len
 		static auto icmp_conn = zeek::id::find_type<zeek::RecordType>("icmp_conn");
 		icmp_conn_val = zeek::make_intrusive<zeek::RecordVal>(icmp_conn);
 
-		icmp_conn_val->Assign(0, zeek::make_intrusive<zeek::AddrVal>(Conn()->OrigAddr()));
-		icmp_conn_val->Assign(1, zeek::make_intrusive<zeek::AddrVal>(Conn()->RespAddr()));
+		icmp_conn_val->Assign(0, zeek::val_mgr->Addr(Conn()->OrigAddr()));
+		icmp_conn_val->Assign(1, zeek::val_mgr->Addr(Conn()->RespAddr()));
 		icmp_conn_val->Assign(2, zeek::val_mgr->Count(icmpp->icmp_type));
 		icmp_conn_val->Assign(3, zeek::val_mgr->Count(icmpp->icmp_code));
 		icmp_conn_val->Assign(4, zeek::val_mgr->Count(len));
@@ -369,9 +369,9 @@ zeek::RecordValPtr ICMP_Analyzer::ExtractICMP4Context(int len, const u_char*& da
 	auto iprec = zeek::make_intrusive<zeek::RecordVal>(icmp_context);
 	auto id_val = zeek::make_intrusive<zeek::RecordVal>(zeek::id::conn_id);
 
-	id_val->Assign(0, zeek::make_intrusive<zeek::AddrVal>(src_addr));
+	id_val->Assign(0, zeek::val_mgr->Addr(src_addr));
 	id_val->Assign(1, zeek::val_mgr->Port(src_port, proto));
-	id_val->Assign(2, zeek::make_intrusive<zeek::AddrVal>(dst_addr));
+	id_val->Assign(2, zeek::val_mgr->Addr(dst_addr));
 	id_val->Assign(3, zeek::val_mgr->Port(dst_port, proto));
 
 	iprec->Assign(0, std::move(id_val));
@@ -429,9 +429,9 @@ zeek::RecordValPtr ICMP_Analyzer::ExtractICMP6Context(int len, const u_char*& da
 	auto iprec = zeek::make_intrusive<zeek::RecordVal>(icmp_context);
 	auto id_val = zeek::make_intrusive<zeek::RecordVal>(zeek::id::conn_id);
 
-	id_val->Assign(0, zeek::make_intrusive<zeek::AddrVal>(src_addr));
+	id_val->Assign(0, zeek::val_mgr->Addr(src_addr));
 	id_val->Assign(1, zeek::val_mgr->Port(src_port, proto));
-	id_val->Assign(2, zeek::make_intrusive<zeek::AddrVal>(dst_addr));
+	id_val->Assign(2, zeek::val_mgr->Addr(dst_addr));
 	id_val->Assign(3, zeek::val_mgr->Port(dst_port, proto));
 
 	iprec->Assign(0, std::move(id_val));
@@ -492,14 +492,14 @@ void ICMP_Analyzer::UpdateEndpointVal(const zeek::ValPtr& endp_arg, bool is_orig
 
 	if ( size < 0 )
 		{
-		endp->Assign(0, zeek::val_mgr->Count(0));
-		endp->Assign(1, zeek::val_mgr->Count(int(ICMP_INACTIVE)));
+		endp->AssignCount(0, 0);
+		endp->AssignCount(1, int(ICMP_INACTIVE));
 		}
 
 	else
 		{
-		endp->Assign(0, zeek::val_mgr->Count(size));
-		endp->Assign(1, zeek::val_mgr->Count(int(ICMP_ACTIVE)));
+		endp->AssignCount(0, size);
+		endp->AssignCount(1, int(ICMP_ACTIVE));
 		}
 	}
 
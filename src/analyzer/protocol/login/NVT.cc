@@ -5,6 +5,10 @@
 
 #include <stdlib.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "ZeekString.h"
 #include "NetVar.h"
 #include "Event.h"
@@ -28,6 +32,37 @@
 
 #define TELNET_IAC 255
 
+// Returns the first CR, LF, NUL or IAC in [p, end), or end if there's none.
+static const u_char* find_special(const u_char* p, const u_char* end)
+	{
+#ifdef __SSE2__
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+	const __m128i iac = _mm_set1_epi8(static_cast<char>(TELNET_IAC));
+
+	for ( ; end - p >= 16; p += 16 )
+		{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i hits = _mm_cmpeq_epi8(block, cr);
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, lf));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, nul));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, iac));
+
+		if ( int mask = _mm_movemask_epi8(hits) )
+			return p + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; p < end; ++p )
+		{
+		if ( *p == '\r' || *p == '\n' || *p == '\0' || *p == TELNET_IAC )
+			return p;
+		}
+
+	return end;
+	}
+
 using namespace analyzer::login;
 
 TelnetOption::TelnetOption(NVT_Analyzer* arg_endp, unsigned int arg_code)
@@ -495,6 +530,26 @@ void NVT_Analyzer::DeliverChunk(int& len, const u_char*& data)
 	// Add data up to IAC or end.
 	for ( ; len > 0; --len, ++data )
 		{
+		// Bytes other than CR, LF, NUL and IAC just get copied, so
+		// we do that in bulk, except for the last that we process as
+		// usual below. In binary mode, stripping the high bit can turn
+		// any byte into one of those, so that goes byte by byte.
+		if ( ! binary_mode && last_char != '\r' )
+			{
+			int n = find_special(data, data + len) - data;
+
+			if ( n > 1 )
+				{
+				while ( offset + n > buf_len )
+					InitBuffer(buf_len * 2);
+
+				memcpy(buf + offset, data, n - 1);
+				offset += n - 1;
+				data += n - 1;
+				len -= n - 1;
+				}
+			}
+
 		if ( offset >= buf_len )
 			InitBuffer(buf_len * 2);
 
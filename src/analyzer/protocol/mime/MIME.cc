@@ -633,6 +633,65 @@ void MIME_Entity::Deliver(int len, const char* data, bool trailing_CRLF)
 		}
 	}
 
+// Delivers the line at data, returning the start of the next one.
+static const char* deliver_line(MIME_Entity* e, const char* data, const char* end)
+	{
+	auto eol = static_cast<const char*>(memchr(data, '\n', end - data));
+	e->Deliver(eol - 1 - data, data, true);
+	return eol + 1;
+	}
+
+void MIME_Entity::DeliverLines(int len, const char* data)
+	{
+	const char* end = data + len;
+
+	while ( data < end )
+		{
+		if ( in_header )
+			{
+			data = deliver_line(this, data, end);
+			continue;
+			}
+
+		if ( mime_header_only )
+			return;
+
+		if ( content_type == CONTENT_TYPE_MULTIPART )
+			{
+			const char* delim = FindBoundaryDelimiter(data, end);
+
+			if ( ! delim )
+				{
+				data = deliver_line(this, data, end);
+				continue;
+				}
+
+			// Data before the first or after the last boundary
+			// delimiter is ignored.
+			if ( current_child_entity != nullptr && delim > data )
+				current_child_entity->DeliverLines(delim - data, data);
+
+			data = delim < end ? deliver_line(this, delim, end) : end;
+			}
+
+		else if ( content_type == CONTENT_TYPE_MESSAGE )
+			{
+			if ( current_child_entity != nullptr )
+				current_child_entity->DeliverLines(end - data, data);
+
+			return;
+			}
+
+		else
+			{
+			if ( mime_decode_data )
+				DecodeDataLines(end - data, data);
+
+			return;
+			}
+		}
+	}
+
 void MIME_Entity::BeginBody()
 	{
 	if ( content_encoding == CONTENT_ENCODING_BASE64 )
@@ -1006,6 +1065,36 @@ int MIME_Entity::CheckBoundaryDelimiter(int len, const char* data)
 	}
 
 
+// Returns the start of the first line in [data, end) that begins with the
+// boundary delimiter, end if there's none, or nil if the entity has no
+// boundary to look for.
+const char* MIME_Entity::FindBoundaryDelimiter(const char* data, const char* end) const
+	{
+	if ( ! multipart_boundary || multipart_boundary->Len() == 0 )
+		return nullptr;
+
+	zeek::data_chunk_t delim = get_data_chunk(multipart_boundary);
+
+	for ( const char* p = data; end - p >= delim.length + 2; )
+		{
+		auto m = static_cast<const char*>(memmem(p + 2, end - p - 2,
+		                                         delim.data, delim.length));
+
+		if ( ! m )
+			break;
+
+		const char* line = m - 2;
+
+		if ( line[0] == '-' && line[1] == '-' &&
+		     (line == data || line[-1] == '\n') )
+			return line;
+
+		p = m - 1;
+		}
+
+	return end;
+	}
+
 // trailing_CRLF indicates whether an implicit CRLF sequence follows data
 // (the CRLF sequence is not included in data).
 
@@ -1033,6 +1122,74 @@ void MIME_Entity::DecodeDataLine(int len, const char* data, bool trailing_CRLF)
 	FlushData();
 	}
 
+// Decodes a run of lines that each end in CRLF like DecodeDataLine() does
+// for each of them, but flushes the data only at the end.
+void MIME_Entity::DecodeDataLines(int len, const char* data)
+	{
+	if ( ! mime_submit_data )
+		return;
+
+	const char* end = data + len;
+
+	if ( mime_segment_data )
+		{
+		// Keeps the segments to a line each, as with line-wise
+		// delivery.
+		while ( data < end )
+			{
+			auto eol = static_cast<const char*>(memchr(data, '\n', end - data));
+			DecodeDataLine(eol - 1 - data, data, true);
+			data = eol + 1;
+			}
+
+		return;
+		}
+
+	switch ( content_encoding ) {
+		case CONTENT_ENCODING_QUOTED_PRINTABLE:
+		case CONTENT_ENCODING_BASE64:
+			while ( data < end )
+				{
+				auto eol = static_cast<const char*>(memchr(data, '\n', end - data));
+
+				if ( content_encoding == CONTENT_ENCODING_BASE64 )
+					DecodeBase64(eol - 1 - data, data);
+				else
+					DecodeQuotedPrintable(eol - 1 - data, data);
+
+				data = eol + 1;
+				}
+			break;
+
+		case CONTENT_ENCODING_7BIT:
+		case CONTENT_ENCODING_8BIT:
+		case CONTENT_ENCODING_BINARY:
+		case CONTENT_ENCODING_OTHER:
+			DecodeBinaryLines(len, data);
+			break;
+	}
+	FlushData();
+	}
+
+// The CRLFs between the lines are part of the data, and the last one gets
+// added or delayed as DecodeBinary() does for every line.
+void MIME_Entity::DecodeBinaryLines(int len, const char* data)
+	{
+	if ( delay_adding_implicit_CRLF )
+		{
+		delay_adding_implicit_CRLF = false;
+		DataOctet(CR);
+		DataOctet(LF);
+		}
+
+	if ( message->AcceptsUnbufferedData() )
+		// Lets the lines go out straight from the input.
+		FlushData();
+
+	DecodeBinary(len - 2, data, false);
+	DecodeBinary(0, data + len - 2, true);
+	}
+
 void MIME_Entity::DecodeBinary(int len, const char* data, bool trailing_CRLF)
 	{
 	if ( delay_adding_implicit_CRLF )
@@ -1042,6 +1199,25 @@ void MIME_Entity::DecodeBinary(int len, const char* data, bool trailing_CRLF)
 		DataOctet(LF);
 		}
 
+	if ( ! trailing_CRLF && data_buf_offset <= 0 &&
+	     message->AcceptsUnbufferedData() )
+		{
+		// The caller flushes the buffer right after, so copying the
+		// data into it would only split it into the same segments.
+		while ( len > 0 )
+			{
+			if ( data_buf_offset < 0 && ! GetDataBuffer() )
+				return;
+
+			int n = std::min(data_buf_length, len);
+			SubmitData(n, data);
+			data += n;
+			len -= n;
+			}
+
+		return;
+		}
+
 	DataOctets(len, data);
 
 	if ( trailing_CRLF )
@@ -1065,6 +1241,15 @@ void MIME_Entity::DecodeBinary(int len, const char* data, bool trailing_CRLF)
 		}
 	}
 
+// Whether a character stands for itself in quoted-printable encoding.
+static inline bool is_qp_literal(char ch)
+	{
+	return (ch >= 33 && ch <= 60) ||
+		// except controls, whitespace and '='
+		(ch >= 62 && ch <= 126) ||
+		ch == HT || ch == SP;
+	}
+
 void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 	{
 	// Ignore trailing HT and SP.
@@ -1078,6 +1263,18 @@ void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 
 	for ( i = 0; i <= end_of_line; ++i )
 		{
+		// Pass on runs of literal characters at once.
+		int j = i;
+		while ( j <= end_of_line && is_qp_literal(data[j]) )
+			++j;
+
+		if ( j > i )
+			{
+			DataOctets(j - i, data + i);
+			i = j - 1;
+			continue;
+			}
+
 		if ( data[i] == '=' )
 			{
 			if ( i == end_of_line )
@@ -1109,14 +1306,6 @@ void MIME_Entity::DecodeQuotedPrintable(int len, const char* data)
 				}
 			}
 
-		else if ( (data[i] >= 33 && data[i] <= 60) ||
-			   // except controls, whitespace and '='
-			  (data[i] >= 62 && data[i] <= 126) )
-			DataOctet(data[i]);
-
-		else if ( data[i] == HT || data[i] == SP )
-			DataOctet(data[i]);
-
 		else
 			{
 			IllegalEncoding(fmt("control characters in quoted-printable encoding: %d", (int) (data[i])));
@@ -1459,7 +1648,9 @@ void MIME_Mail::SubmitAllHeaders(MIME_HeaderList& hlist)
 
 void MIME_Mail::SubmitData(int len, const char* buf)
 	{
-	if ( buf != (char*) data_buffer->Bytes() + buffer_start )
+	bool buffered = (buf == (char*) data_buffer->Bytes() + buffer_start);
+
+	if ( ! buffered && ! AcceptsUnbufferedData() )
 		{
 		reporter->AnalyzerError(GetAnalyzer(),
 		                                "MIME buffer misalignment");
@@ -1499,7 +1690,16 @@ void MIME_Mail::SubmitData(int len, const char* buf)
 	                 cur_entity_id);
 
 	cur_entity_len += len;
-	buffer_start = (buf + len) - (char*)data_buffer->Bytes();
+
+	if ( buffered )
+		buffer_start = (buf + len) - (char*)data_buffer->Bytes();
+	}
+
+bool MIME_Mail::AcceptsUnbufferedData() const
+	{
+	// Segments overlap in the buffer, but only get used by
+	// mime_segment_data.
+	return ! mime_segment_data;
 	}
 
 bool MIME_Mail::RequestBuffer(int* plen, char** pbuf)
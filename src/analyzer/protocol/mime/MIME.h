@@ -101,6 +101,12 @@ public:
 	virtual void Deliver(int len, const char* data, bool trailing_CRLF);
 	virtual void EndOfData();
 
+	// Delivers a run of lines that each end in CRLF. Headers and
+	// boundary delimiters get processed a line at a time as with
+	// Deliver(), but the body data in between goes to the entity it
+	// belongs to, and gets decoded, in one go.
+	void DeliverLines(int len, const char* data);
+
 	MIME_Entity* Parent() const { return parent; }
 	int MIMEContentType() const { return content_type; }
 	[[deprecated("Remove in v4.1.  Use GetContentType().")]]
@@ -132,8 +138,11 @@ protected:
 	void NewDataLine(int len, const char* data, bool trailing_CRLF);
 
 	int CheckBoundaryDelimiter(int len, const char* data);
+	const char* FindBoundaryDelimiter(const char* data, const char* end) const;
 	void DecodeDataLine(int len, const char* data, bool trailing_CRLF);
+	void DecodeDataLines(int len, const char* data);
 	void DecodeBinary(int len, const char* data, bool trailing_CRLF);
+	void DecodeBinaryLines(int len, const char* data);
 	void DecodeQuotedPrintable(int len, const char* data);
 	void DecodeBase64(int len, const char* data);
 	void StartDecodeBase64();
@@ -218,6 +227,11 @@ public:
 		top_level->Deliver(len, data, trailing_CRLF);
 		}
 
+	void DeliverLines(int len, const char* data)
+		{
+		top_level->DeliverLines(len, data);
+		}
+
 	analyzer::Analyzer* GetAnalyzer() const	{ return analyzer; }
 
 	// Events generated by MIME_Entity
@@ -229,6 +243,11 @@ public:
 	virtual bool RequestBuffer(int* plen, char** pbuf) = 0;
 	virtual void SubmitEvent(int event_type, const char* detail) = 0;
 
+	// Returns true if SubmitData() may be passed data that's not in
+	// the message's own buffer. This lets entities submit undecoded
+	// body data straight from their input rather than copying it.
+	virtual bool AcceptsUnbufferedData() const	{ return false; }
+
 protected:
 	analyzer::Analyzer* analyzer;
 
@@ -256,6 +275,7 @@ public:
 	void SubmitAllHeaders(MIME_HeaderList& hlist) override;
 	void SubmitData(int len, const char* buf) override;
 	bool RequestBuffer(int* plen, char** pbuf) override;
+	bool AcceptsUnbufferedData() const override;
 	void SubmitAllData();
 	void SubmitEvent(int event_type, const char* detail) override;
 	void Undelivered(int len);
@@ -1,15 +1,21 @@
 #include "PIA.h"
+
+#include <algorithm>
+
 #include "RuleMatcher.h"
 #include "Event.h"
 #include "NetVar.h"
 #include "IP.h"
 #include "DebugLogger.h"
 #include "Reporter.h"
+#include "ConnMemory.h"
 #include "analyzer/protocol/tcp/TCP_Flags.h"
 #include "analyzer/protocol/tcp/TCP_Reassembler.h"
 
 using namespace analyzer::pia;
 
+uint64_t PIA::buffered_bytes = 0;
+
 PIA::PIA(analyzer::Analyzer* arg_as_analyzer)
 	: state(INIT), as_analyzer(arg_as_analyzer), conn(), current_packet()
 	{
@@ -22,46 +28,46 @@ PIA::~PIA()
 
 void PIA::ClearBuffer(Buffer* buffer)
 	{
-	DataBlock* next = nullptr;
-	for ( DataBlock* b = buffer->head; b; b = next )
-		{
-		next = b->next;
-		delete b->ip;
-		delete [] b->data;
-		delete b;
-		}
+	buffered_bytes -= buffer->data.size();
 
-	buffer->head = buffer->tail = nullptr;
+	if ( conn && conn->MemoryAccount() )
+		conn->MemoryAccount()->Adjust(CONN_MEM_PIA, -int64_t(buffer->data.size()));
+
+	// Keeps the memory for the next use of the buffer.
+	buffer->data.clear();
+	buffer->chunks.clear();
 	buffer->size = 0;
 	}
 
 void PIA::AddToBuffer(Buffer* buffer, uint64_t seq, int len, const u_char* data,
 			bool is_orig, const IP_Hdr* ip)
 	{
-	u_char* tmp = nullptr;
+	Buffer::Chunk c;
+	c.ip.reset(ip ? ip->Copy() : nullptr);
+	c.offset = buffer->data.size();
+	c.is_orig = is_orig;
+	c.undelivered = ! data;
+	c.len = len;
+	c.seq = seq;
 
 	if ( data )
 		{
-		tmp = new u_char[len];
-		memcpy(tmp, data, len);
-		}
-
-	DataBlock* b = new DataBlock;
-	b->ip = ip ? ip->Copy() : nullptr;
-	b->data = tmp;
-	b->is_orig = is_orig;
-	b->len = len;
-	b->seq = seq;
-	b->next = nullptr;
-
-	if ( buffer->tail )
-		{
-		buffer->tail->next = b;
-		buffer->tail = b;
+		// Buffering stops once more than dpd_buffer_size bytes are
+		// in, so that's usually all a TCP connection needs. UDP and
+		// ICMP flows are mostly a datagram or two, like DNS, and
+		// reserving the whole buffer would dominate their footprint.
+		if ( buffer->data.empty() && dpd_buffer_size > 0 &&
+		     conn && conn->ConnTransport() == TRANSPORT_TCP )
+			buffer->data.reserve(std::max(dpd_buffer_size, len));
+
+		buffer->data.insert(buffer->data.end(), data, data + len);
+		buffered_bytes += len;
+
+		if ( conn && conn->MemoryAccount() )
+			conn->MemoryAccount()->Adjust(CONN_MEM_PIA, len);
 		}
-	else
-		buffer->head = buffer->tail = b;
 
+	buffer->chunks.emplace_back(std::move(c));
 	buffer->size += len;
 	}
 
@@ -75,8 +81,8 @@ void PIA::ReplayPacketBuffer(analyzer::Analyzer* analyzer)
 	{
 	DBG_LOG(DBG_ANALYZER, "PIA replaying %d total packet bytes", pkt_buffer.size);
 
-	for ( DataBlock* b = pkt_buffer.head; b; b = b->next )
-		analyzer->DeliverPacket(b->len, b->data, b->is_orig, -1, b->ip, 0);
+	for ( const auto& c : pkt_buffer.chunks )
+		analyzer->DeliverPacket(c.len, pkt_buffer.Data(c), c.is_orig, -1, c.ip.get(), 0);
 	}
 
 void PIA::PIA_Done()
@@ -360,8 +366,8 @@ void PIA_TCP::ActivateAnalyzer(analyzer::Tag tag, const Rule* rule)
 		// we have been inserted somewhere further down in the
 		// analyzer tree.  In this case, we will never have seen
 		// any input at this point (because we don't get packets).
-		assert(!pkt_buffer.head);
-		assert(!stream_buffer.head);
+		assert(pkt_buffer.chunks.empty());
+		assert(stream_buffer.chunks.empty());
 		return;
 		}
 
@@ -378,18 +384,18 @@ void PIA_TCP::ActivateAnalyzer(analyzer::Tag tag, const Rule* rule)
 	uint64_t orig_seq = 0;
 	uint64_t resp_seq = 0;
 
-	for ( DataBlock* b = pkt_buffer.head; b; b = b->next )
+	for ( const auto& c : pkt_buffer.chunks )
 		{
 		// We don't have the TCP flags here during replay. We could
 		// funnel them through, but it's non-trivial and doesn't seem
 		// worth the effort.
 
-		if ( b->is_orig )
-			reass_orig->DataSent(network_time, orig_seq = b->seq,
-					     b->len, b->data, tcp::TCP_Flags(), true);
+		if ( c.is_orig )
+			reass_orig->DataSent(network_time, orig_seq = c.seq,
+					     c.len, pkt_buffer.Data(c), tcp::TCP_Flags(), true);
 		else
-			reass_resp->DataSent(network_time, resp_seq = b->seq,
-					     b->len, b->data, tcp::TCP_Flags(), true);
+			reass_resp->DataSent(network_time, resp_seq = c.seq,
+					     c.len, pkt_buffer.Data(c), tcp::TCP_Flags(), true);
 		}
 
 	// We also need to pass the current packet on.
@@ -427,11 +433,11 @@ void PIA_TCP::ReplayStreamBuffer(analyzer::Analyzer* analyzer)
 	{
 	DBG_LOG(DBG_ANALYZER, "PIA_TCP replaying %d total stream bytes", stream_buffer.size);
 
-	for ( DataBlock* b = stream_buffer.head; b; b = b->next )
+	for ( const auto& c : stream_buffer.chunks )
 		{
-		if ( b->data )
-			analyzer->NextStream(b->len, b->data, b->is_orig);
+		if ( ! c.undelivered )
+			analyzer->NextStream(c.len, stream_buffer.Data(c), c.is_orig);
 		else
-			analyzer->NextUndelivered(b->seq, b->len, b->is_orig);
+			analyzer->NextUndelivered(c.seq, c.len, c.is_orig);
 		}
 	}
@@ -2,6 +2,9 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "analyzer/Analyzer.h"
 #include "analyzer/protocol/tcp/TCP.h"
 #include "RuleMatcher.h"
@@ -35,6 +38,14 @@ public:
 
 	void ReplayPacketBuffer(analyzer::Analyzer* analyzer);
 
+	// Returns the number of payload bytes that all PIAs currently
+	// buffer for protocol detection.
+	static uint64_t BufferedBytes()	{ return buffered_bytes; }
+
+	// Returns true if packet-level protocol detection has stopped
+	// looking at further input.
+	bool GaveUp() const	{ return pkt_buffer.state == SKIPPING; }
+
 	// Children are also derived from Analyzer. Return this object
 	// as pointer to an Analyzer.
 	analyzer::Analyzer* AsAnalyzer()	{ return as_analyzer; }
@@ -46,24 +57,36 @@ protected:
 
 	enum State { INIT, BUFFERING, MATCHING_ONLY, SKIPPING } state;
 
-	// Buffers one chunk of data.  Used both for packet payload (incl.
-	// sequence numbers for TCP) and chunks of a reassembled stream.
+	// Describes the packet currently being delivered.
 	struct DataBlock {
-		IP_Hdr* ip;
 		const u_char* data;
 		bool is_orig;
 		int len;
 		uint64_t seq;
-		DataBlock* next;
 	};
 
+	// Buffers chunks of data until protocol detection has decided.
+	// Used both for packet payload (incl. sequence numbers for TCP) and
+	// chunks of a reassembled stream. The chunks' payload is stored back
+	// to back in a single block of memory, which gets reused once the
+	// buffer is cleared, instead of being allocated chunk by chunk.
 	struct Buffer {
-		Buffer() { head = tail = nullptr; size = 0; state = INIT; }
-
-		DataBlock* head;
-		DataBlock* tail;
-		int size;
-		State state;
+		struct Chunk {
+			std::unique_ptr<IP_Hdr> ip;
+			size_t offset;	// of the chunk's payload in data
+			bool is_orig;
+			bool undelivered;	// no payload, marks a gap
+			int len;
+			uint64_t seq;
+		};
+
+		const u_char* Data(const Chunk& c) const
+			{ return c.undelivered ? nullptr : data.data() + c.offset; }
+
+		std::vector<u_char> data;
+		std::vector<Chunk> chunks;
+		int size = 0;
+		State state = INIT;
 	};
 
 	void AddToBuffer(Buffer* buffer, uint64_t seq, int len,
@@ -85,6 +108,8 @@ private:
 	analyzer::Analyzer* as_analyzer;
 	Connection* conn;
 	DataBlock current_packet;
+
+	static uint64_t buffered_bytes;
 };
 
 // PIA for UDP.
@@ -165,8 +190,10 @@ protected:
 	void DeactivateAnalyzer(analyzer::Tag tag) override;
 
 private:
-	// FIXME: Not sure yet whether we need both pkt_buffer and stream_buffer.
-	// In any case, it's easier this way...
+	// Buffers the reassembled stream, in addition to pkt_buffer that
+	// keeps buffering packets for the packet-level matching. The two
+	// can't be merged: when switching from packet-mode to stream-mode,
+	// the packet buffer is fed through new reassemblers into this one.
 	Buffer stream_buffer;
 
 	bool stream_mode;
@@ -3,7 +3,10 @@
 #include "zeek-config.h"
 #include "RPC.h"
 
+#include <algorithm>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "NetVar.h"
 #include "XDR.h"
@@ -25,20 +28,37 @@ namespace { // local namespace
 // TODO: make this configurable
 #define MAX_RPC_LEN 65536
 
+// Number of unused call-infos that we keep around for reuse.
+#define MAX_POOLED_CALL_INFOS 4096
+
+static std::vector<std::unique_ptr<RPC_CallInfo>> call_info_pool;
+
 
 RPC_CallInfo::RPC_CallInfo(uint32_t arg_xid, const u_char*& buf, int& n, double arg_start_time, double arg_last_time, int arg_rpc_len)
+	{
+	Init(arg_xid, buf, n, arg_start_time, arg_last_time, arg_rpc_len);
+	}
+
+void RPC_CallInfo::Init(uint32_t arg_xid, const u_char*& buf, int& n, double arg_start_time, double arg_last_time, int arg_rpc_len)
 	{
 	xid = arg_xid;
 	stamp = 0;
 	uid = 0;
 	gid = 0;
+	auxgids.clear();
+	machinename.clear();
+	header_len = 0;
+	valid_call = false;
+	v = nullptr;
 
 	start_time = arg_start_time;
 	last_time = arg_last_time;
 	rpc_len = arg_rpc_len;
 	call_n = n;
-	call_buf = new u_char[call_n];
-	memcpy((void*) call_buf, (const void*) buf, call_n);
+
+	// For recognizing retransmissions, a hash of the call suffices,
+	// so we don't need to keep the call's data, which may be large.
+	call_hash = HashKey::HashBytes(buf, call_n);
 
 	rpc_version = extract_XDR_uint32(buf, n);
 	prog = extract_XDR_uint32(buf, n);
@@ -90,13 +110,10 @@ RPC_CallInfo::RPC_CallInfo(uint32_t arg_xid, const u_char*& buf, int& n, double
 		}
 
 	header_len = call_n - n;
-
-	valid_call = false;
 	}
 
 RPC_CallInfo::~RPC_CallInfo()
 	{
-	delete [] call_buf;
 	}
 
 bool RPC_CallInfo::CompareRexmit(const u_char* buf, int n) const
@@ -104,19 +121,116 @@ bool RPC_CallInfo::CompareRexmit(const u_char* buf, int n) const
 	if ( n != call_n )
 		return false;
 
-	return memcmp((const void*) call_buf, (const void*) buf, call_n) == 0;
+	return HashKey::HashBytes(buf, n) == call_hash;
 	}
 
 
 RPC_Interpreter::RPC_Interpreter(analyzer::Analyzer* arg_analyzer)
 	{
 	analyzer = arg_analyzer;
+	oldest_call = newest_call = nullptr;
 	}
 
 RPC_Interpreter::~RPC_Interpreter()
 	{
-	for ( const auto& call : calls )
-		delete call.second;
+	while ( oldest_call )
+		{
+		RPC_CallInfo* c = oldest_call;
+		RemoveCall(c);
+		ReleaseCall(c);
+		}
+	}
+
+RPC_CallInfo* RPC_Interpreter::NewCall(uint32_t xid, const u_char*& buf, int& n,
+				       double start_time, double last_time, int rpc_len)
+	{
+	if ( call_info_pool.empty() )
+		return new RPC_CallInfo(xid, buf, n, start_time, last_time, rpc_len);
+
+	RPC_CallInfo* c = call_info_pool.back().release();
+	call_info_pool.pop_back();
+	c->Init(xid, buf, n, start_time, last_time, rpc_len);
+	return c;
+	}
+
+void RPC_Interpreter::ReleaseCall(RPC_CallInfo* c)
+	{
+	if ( call_info_pool.size() >= MAX_POOLED_CALL_INFOS )
+		{
+		delete c;
+		return;
+		}
+
+	// Don't hold on to the call's value while pooled.
+	c->v = nullptr;
+	call_info_pool.emplace_back(c);
+	}
+
+void RPC_Interpreter::AddCall(RPC_CallInfo* c)
+	{
+	calls.insert_or_assign(c->XID(), c);
+
+	c->prev_call = newest_call;
+	c->next_call = nullptr;
+
+	if ( newest_call )
+		newest_call->next_call = c;
+	else
+		oldest_call = c;
+
+	newest_call = c;
+	}
+
+void RPC_Interpreter::RemoveCall(RPC_CallInfo* c)
+	{
+	calls.erase(c->XID());
+
+	if ( c->prev_call )
+		c->prev_call->next_call = c->next_call;
+	else
+		oldest_call = c->next_call;
+
+	if ( c->next_call )
+		c->next_call->prev_call = c->prev_call;
+	else
+		newest_call = c->prev_call;
+
+	c->prev_call = c->next_call = nullptr;
+	}
+
+void RPC_Interpreter::ExpireCall(RPC_CallInfo* c)
+	{
+	Event_RPC_Dialogue(c, BifEnum::RPC_TIMEOUT, 0);
+
+	if ( c->IsValidCall() )
+		{
+		const u_char* buf = nullptr;
+		int n = 0;
+
+		if ( ! RPC_BuildReply(c, BifEnum::RPC_TIMEOUT, buf, n, network_time, network_time, 0) )
+			Weird("bad_RPC");
+		}
+
+	RemoveCall(c);
+	ReleaseCall(c);
+	}
+
+void RPC_Interpreter::ExpireCalls(double t)
+	{
+	if ( rpc_call_timeout > 0 )
+		{
+		while ( oldest_call && oldest_call->LastTime() + rpc_call_timeout < t )
+			ExpireCall(oldest_call);
+		}
+
+	if ( rpc_max_outstanding_calls )
+		{
+		while ( oldest_call && calls.size() >= rpc_max_outstanding_calls )
+			{
+			Weird("RPC_too_many_outstanding_calls");
+			ExpireCall(oldest_call);
+			}
+		}
 	}
 
 int RPC_Interpreter::DeliverRPC(const u_char* buf, int n, int rpclen,
@@ -149,6 +263,10 @@ int RPC_Interpreter::DeliverRPC(const u_char* buf, int n, int rpclen,
 			call->SetStartTime(start_time);
 			call->SetLastTime(last_time);
 
+			// Keep the list of calls ordered by activity.
+			RemoveCall(call);
+			AddCall(call);
+
 			// TODO: Not sure whether the handling if rexmit
 			// inconsistencies are correct. Maybe we should use
 			// the info in the new call for further processing.
@@ -164,15 +282,16 @@ int RPC_Interpreter::DeliverRPC(const u_char* buf, int n, int rpclen,
 
 		else
 			{
-			call = new RPC_CallInfo(xid, buf, n, start_time, last_time, rpc_len);
+			call = NewCall(xid, buf, n, start_time, last_time, rpc_len);
 			if ( ! buf )
 				{
 				Weird("bad_RPC");
-				delete call;
+				ReleaseCall(call);
 				return 0;
 				}
 
-			calls[xid] = call;
+			ExpireCalls(last_time);
+			AddCall(call);
 			}
 
 		// We now have a valid RPC_CallInfo (either the previous one
@@ -282,8 +401,8 @@ int RPC_Interpreter::DeliverRPC(const u_char* buf, int n, int rpclen,
 
 			Event_RPC_Dialogue(call, status, n);
 
-			calls.erase(xid);
-			delete call;
+			RemoveCall(call);
+			ReleaseCall(call);
 			}
 		else
 			{
@@ -317,9 +436,20 @@ int RPC_Interpreter::DeliverRPC(const u_char* buf, int n, int rpclen,
 
 void RPC_Interpreter::Timeout()
 	{
+	// Report the calls ordered by XID, independent of the hash map's
+	// order.
+	std::vector<RPC_CallInfo*> pending;
+	pending.reserve(calls.size());
+
 	for ( const auto& entry : calls )
+		pending.push_back(entry.second);
+
+	std::sort(pending.begin(), pending.end(),
+	          [](const RPC_CallInfo* a, const RPC_CallInfo* b)
+	          { return a->XID() < b->XID(); });
+
+	for ( RPC_CallInfo* c : pending )
 		{
-		RPC_CallInfo* c = entry.second;
 		Event_RPC_Dialogue(c, BifEnum::RPC_TIMEOUT, 0);
 
 		if ( c->IsValidCall() )
@@ -379,12 +509,9 @@ void RPC_Interpreter::Weird(const char* msg, const char* addl)
 
 
 void RPC_Reasm_Buffer::Init(int64_t arg_maxsize, int64_t arg_expected) {
-	if ( buf )
-		delete [] buf;
 	expected = arg_expected;
 	maxsize = arg_maxsize;
 	fill = processed = 0;
-	buf = new u_char[maxsize];
 };
 
 bool RPC_Reasm_Buffer::ConsumeChunk(const u_char*& data, int& len)
@@ -400,6 +527,21 @@ bool RPC_Reasm_Buffer::ConsumeChunk(const u_char*& data, int& len)
 		// into the buff. Either all of the bytes we want to process
 		// or the number of bytes until we reach maxsize.
 		int64_t to_copy = std::min( to_process, (maxsize-fill) );
+
+		if ( fill + to_copy > capacity )
+			{
+			// Grow geometrically, but not beyond what we need.
+			int64_t new_capacity = std::min(std::max(fill + to_copy, 2 * capacity), maxsize);
+			u_char* new_buf = new u_char[new_capacity];
+
+			if ( fill )
+				memcpy(new_buf, buf, fill);
+
+			delete [] buf;
+			buf = new_buf;
+			capacity = new_capacity;
+			}
+
 		if ( to_copy )
 			memcpy(buf+fill, data, to_copy);
 
@@ -691,6 +833,24 @@ void Contents_RPC::DeliverStream(int len, const u_char* data, bool orig)
 		case WAIT_FOR_DATA:
 		case WAIT_FOR_LAST_DATA:
 			{
+			int64_t msg_len = msg_buf.GetExpected();
+
+			if ( state == WAIT_FOR_LAST_DATA && msg_buf.GetProcessed() == 0 &&
+			     msg_len <= len )
+				{
+				// The whole message is in this chunk, so parse it
+				// in place rather than copying it first.
+				int msg_fill = (int) std::min(msg_len, int64_t(MAX_RPC_LEN));
+
+				if ( ! interp->DeliverRPC(data, msg_fill, (int) msg_len, IsOrig(), start_time, last_time) )
+					Conn()->Weird("partial_RPC");
+
+				data += msg_len;
+				len -= msg_len;
+				state = WAIT_FOR_MESSAGE;
+				break;
+				}
+
 			bool got_all_data = msg_buf.ConsumeChunk(data, len);
 
 			if ( got_all_data )
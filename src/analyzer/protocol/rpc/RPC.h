@@ -4,6 +4,7 @@
 
 #include "analyzer/protocol/tcp/TCP.h"
 #include "NetVar.h"
+#include "FlatHashMap.h"
 
 namespace analyzer { namespace rpc {
 
@@ -52,6 +53,11 @@ public:
 		     double last_time, int rpc_len);
 	~RPC_CallInfo();
 
+	// Parses a new call into this one, resetting all previous state.
+	// Sets buf to null if the call is malformed.
+	void Init(uint32_t xid, const u_char*& buf, int& n, double start_time,
+		  double last_time, int rpc_len);
+
 	void AddVal(zeek::ValPtr arg_v)		{ v = std::move(arg_v); }
 	const zeek::ValPtr& RequestVal() const		{ return v; }
 	zeek::ValPtr TakeRequestVal()		{ auto rv = std::move(v); return rv; }
@@ -86,7 +92,7 @@ protected:
 	uint32_t uid, gid;
 	std::vector<int> auxgids;
 	uint32_t verf_flavor;
-	u_char* call_buf;	// copy of original call buffer
+	hash_t call_hash;	// hash of original call buffer
 	std::string machinename;
 	double start_time;
 	double last_time;
@@ -96,6 +102,13 @@ protected:
 	bool valid_call;	// whether call was well-formed
 
 	zeek::ValPtr v;		// single (perhaps compound) value corresponding to call
+
+	friend class RPC_Interpreter;
+
+	// Neighbours in the interpreter's list of outstanding calls, which
+	// is ordered by last activity.
+	RPC_CallInfo* prev_call = nullptr;
+	RPC_CallInfo* next_call = nullptr;
 };
 
 class RPC_Interpreter {
@@ -122,7 +135,33 @@ protected:
 
 	void Weird(const char* name, const char* addl = "");
 
-	std::map<uint32_t, RPC_CallInfo*> calls;
+	// Returns a call-info from a pool shared by all interpreters,
+	// initialized with the given call, and gives it back.
+	RPC_CallInfo* NewCall(uint32_t xid, const u_char*& buf, int& n,
+			      double start_time, double last_time, int rpc_len);
+	void ReleaseCall(RPC_CallInfo* c);
+
+	// Tracks an outstanding call, or stops doing so.
+	void AddCall(RPC_CallInfo* c);
+	void RemoveCall(RPC_CallInfo* c);
+
+	// Reports a call as timed out and releases it.
+	void ExpireCall(RPC_CallInfo* c);
+
+	// Makes room for a new call according to rpc_call_timeout and
+	// rpc_max_outstanding_calls.
+	void ExpireCalls(double t);
+
+	struct XIDHash {
+		hash_t operator()(uint32_t xid) const
+			{ return KeyedHash::Hash64(&xid, sizeof(xid)); }
+	};
+
+	using CallMap = zeek::detail::FlatHashMap<uint32_t, RPC_CallInfo*, XIDHash>;
+
+	CallMap calls;
+	RPC_CallInfo* oldest_call;
+	RPC_CallInfo* newest_call;
 	analyzer::Analyzer* analyzer;
 };
 
@@ -142,13 +181,15 @@ protected:
  * We can extend "expected" (by calling AddToExpected()), but maxsize is
  * fixed.
  *
- * TODO: grow buffer dynamically
+ * The buffer only grows as far as messages actually fill it, and gets
+ * reused across Init() calls.
  */
 class RPC_Reasm_Buffer {
 public:
 	RPC_Reasm_Buffer() {
 		maxsize = expected = 0;
 		fill = processed = 0;
+		capacity = 0;
 		buf = nullptr;
 	};
 
@@ -179,6 +220,7 @@ protected:
 	int64_t maxsize;	// maximum buffer size we want to allocate
 	int64_t processed;	// number of bytes we have processed so far
 	int64_t expected;	// number of input bytes we expect
+	int64_t capacity;	// number of bytes allocated for buf
 	u_char *buf;
 
 };
@@ -3,6 +3,7 @@
 #include "zeek-config.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "NetVar.h"
 #include "SMTP.h"
@@ -49,11 +50,13 @@ SMTP_Analyzer::SMTP_Analyzer(Connection* conn)
 	cl_orig = new tcp::ContentLine_Analyzer(conn, true);
 	cl_orig->SetIsNULSensitive(true);
 	cl_orig->SetSkipPartial(true);
+	cl_orig->SetBulkDelivery(true);
 	AddSupportAnalyzer(cl_orig);
 
 	cl_resp = new tcp::ContentLine_Analyzer(conn, false);
 	cl_resp->SetIsNULSensitive(true);
 	cl_resp->SetSkipPartial(true);
+	cl_resp->SetBulkDelivery(true);
 	AddSupportAnalyzer(cl_resp);
 	}
 
@@ -127,6 +130,53 @@ void SMTP_Analyzer::DeliverStream(int length, const u_char* line, bool orig)
 		return;
 		}
 
+	if ( (orig ? cl_orig : cl_resp)->IsBulkDelivery() )
+		DeliverLines(length, line, orig);
+	else
+		DeliverLine(length, line, orig);
+	}
+
+void SMTP_Analyzer::DeliverLines(int length, const u_char* data, bool orig)
+	{
+	const u_char* end = data + length;
+
+	while ( data < end )
+		{
+		if ( state == SMTP_IN_TLS )
+			{
+			ForwardStream(end - data, data, orig);
+			return;
+			}
+
+		bool is_sender = orig_is_sender ? orig : ! orig;
+
+		if ( is_sender && state == SMTP_IN_DATA && *data != '.' &&
+		     ! (smtp_data && ! skip_data) )
+			{
+			// Pass the mail data up to the next line that starts
+			// with a '.', which may end it, to MIME in one go.
+			auto dot = static_cast<const u_char*>(memmem(data, end - data, "\n.", 2));
+			const u_char* data_end = dot ? dot + 1 : end;
+
+			expect_recver = false;
+
+			if ( ! mail )
+				BeginData(orig);
+
+			mail->DeliverLines(data_end - data, (const char*) data);
+			data = data_end;
+			continue;
+			}
+
+		// Every line ends in CRLF.
+		auto eol = static_cast<const u_char*>(memchr(data, '\n', end - data));
+		DeliverLine(eol - 1 - data, data, orig);
+		data = eol + 1;
+		}
+	}
+
+void SMTP_Analyzer::DeliverLine(int length, const u_char* line, bool orig)
+	{
 	// NOTE: do not use IsOrig() here, because of TURN command.
 	bool is_sender = orig_is_sender ? orig : ! orig;
 
@@ -54,6 +54,8 @@ public:
 
 protected:
 
+	void DeliverLines(int length, const u_char* data, bool orig);
+	void DeliverLine(int length, const u_char* line, bool orig);
 	void ProcessLine(int length, const char* line, bool orig);
 	void NewCmd(int cmd_code);
 	void NewReply(int reply_code, bool orig);
@@ -8,6 +8,7 @@
 
 #include "types.bif.h"
 #include "events.bif.h"
+#include "consts.bif.h"
 
 using namespace analyzer::SSH;
 
@@ -97,6 +98,29 @@ void SSH_Analyzer::ProcessEncryptedSegment(int len, bool orig)
 
 	if ( ! auth_decision_made )
 		ProcessEncrypted(len, orig);
+
+	DetachIfDone();
+	}
+
+void SSH_Analyzer::DetachIfDone()
+	{
+	if ( ! zeek::BifConst::SSH::detach_encrypted || ssh_encrypted_packet )
+		return;
+
+	if ( interp->get_state(true) != binpac::SSH::ENCRYPTED ||
+	     interp->get_state(false) != binpac::SSH::ENCRYPTED )
+		return;
+
+	// The authentication heuristics only apply to SSH2.
+	if ( ! auth_decision_made && interp->get_version() == binpac::SSH::SSH2 )
+		return;
+
+	SetSkip(true);
+
+	// Nothing else needs the payload of a typical SSH connection, so
+	// let its reassembly stop as well. This takes effect with the next
+	// packet.
+	Conn()->Bypass();
 	}
 
 void SSH_Analyzer::ProcessEncrypted(int len, bool orig)
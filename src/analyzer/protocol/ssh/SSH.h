@@ -32,6 +32,11 @@ namespace analyzer {
 			void ProcessEncrypted(int len, bool orig);
 			void ProcessEncryptedSegment(int len, bool orig);
 
+			// Stops analyzing the connection once the encrypted
+			// data can't lead to any more events, if
+			// SSH::detach_encrypted is set.
+			void DetachIfDone();
+
 			bool had_gap;
 
 			// Packet analysis stuff
@@ -1,10 +1,13 @@
 
+#include <algorithm>
+
 #include "SSL.h"
 #include "analyzer/protocol/tcp/TCP_Reassembler.h"
 #include "Reporter.h"
 #include "util.h"
 
 #include "events.bif.h"
+#include "consts.bif.h"
 #include "ssl_pac.h"
 #include "tls-handshake_pac.h"
 
@@ -16,6 +19,8 @@ SSL_Analyzer::SSL_Analyzer(Connection* c)
 	interp = new binpac::SSL::SSL_Conn(this);
 	handshake_interp = new binpac::TLSHandshake::Handshake_Conn(this);
 	had_gap = false;
+	records_in_sync = true;
+	skipping_encrypted = false;
 	}
 
 SSL_Analyzer::~SSL_Analyzer()
@@ -48,6 +53,66 @@ void SSL_Analyzer::StartEncryption()
 	interp->setEstablished();
 	}
 
+void SSL_Analyzer::SkipEncryptedRecords()
+	{
+	if ( skipping_encrypted || ! records_in_sync ||
+	     ! zeek::BifConst::SSL::skip_encrypted_records )
+		return;
+
+	// The interpreter may have buffered part of a record, which we drop
+	// along with it; the record trackers know where that record ends.
+	skipping_encrypted = true;
+	}
+
+bool SSL_Analyzer::TrackRecords(int len, const u_char* data, bool orig)
+	{
+	RecordTracker& t = orig ? orig_records : resp_records;
+
+	while ( len > 0 )
+		{
+		if ( t.remaining > 0 )
+			{
+			int n = std::min(static_cast<uint32_t>(len), t.remaining);
+			t.remaining -= n;
+			data += n;
+			len -= n;
+			continue;
+			}
+
+		int n = std::min(len, static_cast<int>(sizeof(t.header)) - t.header_len);
+		memcpy(t.header + t.header_len, data, n);
+		t.header_len += n;
+		data += n;
+		len -= n;
+
+		if ( t.header_len < static_cast<int>(sizeof(t.header)) )
+			break;
+
+		t.header_len = 0;
+
+		// Same check as the interpreter's: SSLv3 up to TLS 1.2.
+		if ( t.header[1] != 3 || t.header[2] > 3 )
+			{
+			if ( skipping_encrypted )
+				{
+				ProtocolViolation(fmt("Invalid version late in TLS connection. Packet reported version: %d",
+				                      (t.header[1] << 8) | t.header[2]));
+				SetSkip(true);
+				return false;
+				}
+
+			// Not a plain TLS record layer (e.g., SSLv2); leave
+			// everything to the interpreter.
+			records_in_sync = false;
+			return true;
+			}
+
+		t.remaining = (t.header[3] << 8) | t.header[4];
+		}
+
+	return true;
+	}
+
 void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 	{
 	tcp::TCP_ApplicationAnalyzer::DeliverStream(len, data, orig);
@@ -61,6 +126,12 @@ void SSL_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 		// deliver data to the other side if the script layer can handle this.
 		return;
 
+	if ( records_in_sync && ! TrackRecords(len, data, orig) )
+		return;
+
+	if ( skipping_encrypted )
+		return;
+
 	try
 		{
 		interp->NewData(orig, data, data + len);
@@ -25,6 +25,11 @@ public:
 	// Tell the analyzer that encryption has started.
 	void StartEncryption();
 
+	// Tell the analyzer that the remaining encrypted records need no
+	// parsing. Unless SSL::skip_encrypted_records is off or the record
+	// boundaries could not be followed, it then only keeps track of these.
+	void SkipEncryptedRecords();
+
 	// Overriden from tcp::TCP_ApplicationAnalyzer.
 	void EndpointEOF(bool is_orig) override;
 
@@ -32,10 +37,28 @@ public:
 		{ return new SSL_Analyzer(conn); }
 
 protected:
+	// Follows the record boundaries of one direction, independent of
+	// how much of the data the interpreter has consumed so far.
+	struct RecordTracker {
+		u_char header[5];
+		int header_len = 0;
+		uint32_t remaining = 0;
+	};
+
+	// Advances the record tracker of the given direction. Returns false
+	// if a record header was invalid while skipping encrypted records,
+	// in which case the analyzer has stopped.
+	bool TrackRecords(int len, const u_char* data, bool orig);
+
 	binpac::SSL::SSL_Conn* interp;
 	binpac::TLSHandshake::Handshake_Conn* handshake_interp;
 	bool had_gap;
 
+	RecordTracker orig_records;
+	RecordTracker resp_records;
+	bool records_in_sync;
+	bool skipping_encrypted;
+
 };
 
 } } // namespace analyzer::*
@@ -71,20 +71,7 @@ bool SteppingStoneEndpoint::DataSent(double t, uint64_t seq, int len, int caplen
 		return false;
 
 	double tmin = t - stp_delta;
-
-	while ( stp_manager->OrderedEndpoints().length() > 0 )
-		{
-	    auto e = stp_manager->OrderedEndpoints().front();
-
-		if ( e->stp_resume_time < tmin )
-			{
-			stp_manager->OrderedEndpoints().pop_front();
-			e->Done();
-			Unref(e);
-			}
-		else
-			break;
-		}
+	stp_manager->Expire(tmin);
 
 	uint64_t ack = endp->ToRelativeSeqSpace(endp->AckSeq(), endp->AckWraps());
 	uint64_t top_seq = seq + len;
@@ -102,33 +89,62 @@ bool SteppingStoneEndpoint::DataSent(double t, uint64_t seq, int len, int caplen
 		}
 
 	// Either just starts, or resumes from an idle period.
+	double prev_resume_time = stp_resume_time;
 	stp_last_time = stp_resume_time = t;
 
 	Event(stp_resume_endp, stp_id);
-	for ( auto ep : stp_manager->OrderedEndpoints() )
+
+	for ( auto it = stp_manager->ActiveSince(tmin); it != stp_manager->ActiveEnd(); ++it )
 		{
-		if ( ep->endp->TCP() != endp->TCP() )
-			{
-			Ref(ep);
-			Ref(this);
+		SteppingStoneEndpoint* ep = it->second;
 
-			stp_inbound_endps[ep->stp_id] = ep;
-			ep->stp_outbound_endps[stp_id] = this;
+		if ( ep->endp->TCP() == endp->TCP() )
+			// ep and this belong to same connection
+			continue;
 
-			Event(stp_correlate_pair, ep->stp_id, stp_id);
-			}
+		// Pairs that are correlated already stay so until one of
+		// the endpoints is done.
+		if ( ! stp_inbound_endps.emplace(ep->stp_id, ep).second )
+			continue;
 
-		else
-			{ // ep and this belong to same connection
-			}
+		Ref(ep);
+		Ref(this);
+
+		ep->stp_outbound_endps[stp_id] = this;
+
+		Event(stp_correlate_pair, ep->stp_id, stp_id);
 		}
 
-	stp_manager->OrderedEndpoints().push_back(this);
-	Ref(this);
+	stp_manager->Resumed(this, prev_resume_time);
 
 	return true;
 	}
 
+void SteppingStoneManager::Expire(double tmin)
+	{
+	while ( ! active_endps.empty() )
+		{
+		auto it = active_endps.begin();
+
+		if ( it->first.first >= tmin )
+			break;
+
+		SteppingStoneEndpoint* e = it->second;
+		active_endps.erase(it);
+		e->Done();
+		Unref(e);
+		}
+	}
+
+void SteppingStoneManager::Resumed(SteppingStoneEndpoint* e, double prev_time)
+	{
+	// The index holds a reference to each endpoint in it.
+	if ( ! active_endps.erase({prev_time, e->stp_id}) )
+		Ref(e);
+
+	active_endps.emplace(std::make_pair(e->stp_resume_time, e->stp_id), e);
+	}
+
 void SteppingStoneEndpoint::Event(EventHandlerPtr f, int id1, int id2)
 	{
 	if ( ! f )
@@ -2,7 +2,10 @@
 
 #pragma once
 
-#include "Queue.h"
+#include <climits>
+#include <map>
+#include <utility>
+
 #include "analyzer/protocol/tcp/TCP.h"
 
 class NetSessions;
@@ -14,6 +17,8 @@ class SteppingStoneManager;
 
 class SteppingStoneEndpoint : public zeek::Obj {
 public:
+	friend class SteppingStoneManager;
+
 	SteppingStoneEndpoint(tcp::TCP_Endpoint* e, SteppingStoneManager* m);
 	~SteppingStoneEndpoint() override;
 	void Done();
@@ -66,18 +71,32 @@ protected:
 	SteppingStoneEndpoint* resp_endp;
 };
 
-// Manages ids for the possible stepping stone connections.
+// Manages ids for the possible stepping stone connections, and indexes
+// the endpoints by the time they last resumed sending, so that finding
+// the ones to correlate with doesn't need to look at any others.
 class SteppingStoneManager {
 public:
+	// Ordered by resume time, with the ID to tell endpoints apart.
+	using EndpointIndex = std::map<std::pair<double, int>, SteppingStoneEndpoint*>;
+
+	// Removes the endpoints that have not resumed since tmin.
+	void Expire(double tmin);
+
+	// Moves an endpoint to its new resume time, adding it if it isn't
+	// indexed yet.
+	void Resumed(SteppingStoneEndpoint* e, double prev_time);
 
-	zeek::PQueue<SteppingStoneEndpoint>& OrderedEndpoints()
-		{ return ordered_endps; }
+	// The endpoints that resumed at tmin or later.
+	EndpointIndex::const_iterator ActiveSince(double tmin) const
+		{ return active_endps.lower_bound({tmin, INT_MIN}); }
+	EndpointIndex::const_iterator ActiveEnd() const
+		{ return active_endps.end(); }
 
 	// Use postfix ++, since the first ID needs to be even.
 	int NextID()			{ return endp_cnt++; }
 
 protected:
-	zeek::PQueue<SteppingStoneEndpoint> ordered_endps;
+	EndpointIndex active_endps;
 	int endp_cnt = 0;
 };
 
@@ -1,11 +1,48 @@
 #include "ContentLine.h"
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "TCP.h"
 #include "Reporter.h"
+#include "ConnMemory.h"
 
 #include "events.bif.h"
 
 using namespace analyzer::tcp;
 
+// Returns the first CR, LF or NUL in [p, end), or end if there's none.
+static const u_char* find_special(const u_char* p, const u_char* end)
+	{
+#ifdef __SSE2__
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i nul = _mm_setzero_si128();
+
+	for ( ; end - p >= 16; p += 16 )
+		{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+		__m128i hits = _mm_cmpeq_epi8(block, cr);
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, lf));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, nul));
+
+		if ( int mask = _mm_movemask_epi8(hits) )
+			return p + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; p < end; ++p )
+		{
+		if ( *p == '\r' || *p == '\n' || *p == '\0' )
+			return p;
+		}
+
+	return end;
+	}
+
 ContentLine_Analyzer::ContentLine_Analyzer(Connection* conn, bool orig, int max_line_length)
 : TCP_SupportAnalyzer("CONTENTLINE", conn, orig), max_line_length(max_line_length)
 	{
@@ -31,6 +68,8 @@ void ContentLine_Analyzer::InitState()
 	seq_to_skip = 0;
 	plain_delivery_length = 0;
 	is_plain = false;
+	bulk_delivery = false;
+	is_bulk = false;
 	suppress_weirds = false;
 
 	InitBuffer(0);
@@ -48,6 +87,9 @@ void ContentLine_Analyzer::InitBuffer(int size)
 
 	u_char* b = new u_char[size];
 
+	if ( auto a = Conn()->MemoryAccount() )
+		a->Adjust(CONN_MEM_ANALYZER, size - (buf ? buf_len : 0));
+
 	if ( buf )
 		{
 		if ( offset > 0 )
@@ -66,6 +108,9 @@ void ContentLine_Analyzer::InitBuffer(int size)
 
 ContentLine_Analyzer::~ContentLine_Analyzer()
 	{
+	if ( auto a = Conn()->MemoryAccount(); a && buf )
+		a->Adjust(CONN_MEM_ANALYZER, -buf_len);
+
 	delete [] buf;
 	}
 
@@ -190,6 +235,25 @@ void ContentLine_Analyzer::DoDeliver(int len, const u_char* data)
 		}
 	}
 
+int ContentLine_Analyzer::BulkLinesLength(int len, const u_char* data) const
+	{
+	const u_char* end = data + len;
+	const u_char* line = data;
+
+	while ( line < end )
+		{
+		const u_char* p = find_special(line, end);
+
+		if ( end - p < 2 || p[0] != '\r' || p[1] != '\n' ||
+		     p - line >= max_line_length )
+			break;
+
+		line = p + 2;
+		}
+
+	return line - data;
+	}
+
 int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 	{
 	const u_char* data_start = data;
@@ -197,11 +261,45 @@ int ContentLine_Analyzer::DoDeliverOnce(int len, const u_char* data)
 	if ( len <= 0 )
 		return 0;
 
+	if ( bulk_delivery && offset == 0 && last_char != '\r' )
+		{
+		int n = BulkLinesLength(len, data);
+
+		if ( n > 0 )
+			{
+			seq_delivered_in_lines = seq + n;
+			last_char = '\n';
+			is_bulk = true;
+			ForwardStream(n, data, IsOrig());
+			is_bulk = false;
+			return n;
+			}
+		}
+
 	for ( ; len > 0; --len, ++data )
 		{
 		if ( offset >= buf_len )
 			InitBuffer(buf_len * 2);
 
+		// Copy the bytes before the next one needing special treatment
+		// in bulk, except for the last that we process as usual below.
+		if ( last_char != '\r' && offset < max_line_length )
+			{
+			int n = find_special(data, data + len) - data;
+			n = std::min(n, max_line_length - offset);
+
+			if ( n > 1 )
+				{
+				while ( offset + n > buf_len )
+					InitBuffer(buf_len * 2);
+
+				memcpy(buf + offset, data, n - 1);
+				offset += n - 1;
+				data += n - 1;
+				len -= n - 1;
+				}
+			}
+
 		int c = data[0];
 
 #define EMIT_LINE \
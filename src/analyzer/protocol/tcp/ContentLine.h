@@ -53,6 +53,14 @@ public:
 	int64_t GetPlainDeliveryLength() const	{ return plain_delivery_length; }
 	bool IsPlainDelivery()			{ return is_plain; }
 
+	// With bulk delivery, a run of complete lines that each end in CRLF
+	// and contain no other CR, LF or NUL gets passed via DeliverStream()
+	// at once, CRLFs included, rather than line by line. Delivering
+	// such lines one by one wouldn't do anything but split them up.
+	// Bulk deliveries can be differentiated by calling IsBulkDelivery().
+	void SetBulkDelivery(bool enable)	{ bulk_delivery = enable; }
+	bool IsBulkDelivery() const		{ return is_bulk; }
+
 	// Skip <length> bytes after this line.
 	// Can be used to skip HTTP data for performance considerations.
 	void SkipBytesAfterThisLine(int64_t length);
@@ -73,6 +81,7 @@ protected:
 	void InitBuffer(int size);
 	virtual void DoDeliver(int len, const u_char* data);
 	int DoDeliverOnce(int len, const u_char* data);
+	int BulkLinesLength(int len, const u_char* data) const;
 	void CheckNUL();
 
 	// Returns the sequence number delivered so far.
@@ -99,6 +108,9 @@ protected:
 	int64_t plain_delivery_length;
 	bool is_plain;
 
+	bool bulk_delivery;
+	bool is_bulk;
+
 	// Don't deliver further data.
 	bool skip_deliveries;
 
@@ -124,7 +124,8 @@ static zeek::RecordVal* build_syn_packet_val(bool is_orig, const IP_Hdr* ip,
 
 
 TCP_Analyzer::TCP_Analyzer(Connection* conn)
-: TransportLayerAnalyzer("TCP", conn)
+: TransportLayerAnalyzer("TCP", conn),
+  orig_endp(this, true), resp_endp(this, false)
 	{
 	// Set a timer to eventually time out this connection.
 	ADD_ANALYZER_TIMER(&TCP_Analyzer::ExpireTimer,
@@ -137,11 +138,12 @@ TCP_Analyzer::TCP_Analyzer(Connection* conn)
 	is_active = 1;
 	finished = 0;
 	reassembling = 0;
+	bypassed = 0;
 	first_packet_seen = 0;
 	is_partial = 0;
 
-	orig = new TCP_Endpoint(this, true);
-	resp = new TCP_Endpoint(this, false);
+	orig = &orig_endp;
+	resp = &resp_endp;
 
 	orig->SetPeer(resp);
 	resp->SetPeer(orig);
@@ -151,9 +153,6 @@ TCP_Analyzer::~TCP_Analyzer()
 	{
 	LOOP_OVER_GIVEN_CHILDREN(i, packet_children)
 		delete *i;
-
-	delete orig;
-	delete resp;
 	}
 
 void TCP_Analyzer::Init()
@@ -225,10 +224,9 @@ bool TCP_Analyzer::RemoveChildAnalyzer(ID id)
 
 void TCP_Analyzer::EnableReassembly()
 	{
-	SetReassembler(new TCP_Reassembler(this, this,
-	                                   TCP_Reassembler::Forward, orig),
-	               new TCP_Reassembler(this, this,
-	                                   TCP_Reassembler::Forward, resp));
+	orig->DeferReassembler();
+	resp->DeferReassembler();
+	StartReassembling();
 	}
 
 void TCP_Analyzer::SetReassembler(TCP_Reassembler* rorig,
@@ -238,7 +236,11 @@ void TCP_Analyzer::SetReassembler(TCP_Reassembler* rorig,
 	rorig->SetDstAnalyzer(this);
 	resp->AddReassembler(rresp);
 	rresp->SetDstAnalyzer(this);
+	StartReassembling();
+	}
 
+void TCP_Analyzer::StartReassembling()
+	{
 	if ( new_connection_contents && reassembling == 0 )
 		Event(new_connection_contents);
 
@@ -818,6 +820,22 @@ void TCP_Analyzer::CheckRecording(bool need_contents, TCP_Flags flags)
 	Conn()->SetRecordCurrentPacket(record_current_packet);
 	}
 
+void TCP_Analyzer::StartBypass()
+	{
+	bypassed = 1;
+
+	// The packet analyzers keep seeing the connection, so that its
+	// sizes stay accurate.
+	DeleteChildAnalyzers();
+	Conn()->SetRootAnalyzer(this, nullptr);
+
+	if ( orig->contents_processor )
+		orig->contents_processor->ClearBlocks();
+
+	if ( resp->contents_processor )
+		resp->contents_processor->ClearBlocks();
+	}
+
 void TCP_Analyzer::CheckPIA_FirstPacket(bool is_orig, const IP_Hdr* ip)
 	{
 	if ( is_orig && ! (first_packet_seen & ORIG) )
@@ -1216,9 +1234,12 @@ void TCP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 
 	uint64_t rel_data_seq = flags.SYN() ? rel_seq + 1 : rel_seq;
 
+	if ( Conn()->Bypassing() && ! bypassed )
+		StartBypass();
+
 	int need_contents = 0;
 	if ( len > 0 && (caplen >= len || packet_children.size()) &&
-	     ! flags.RST() && ! Skipping() && ! seq_underflow )
+	     ! flags.RST() && ! Skipping() && ! bypassed && ! seq_underflow )
 		need_contents = DeliverData(current_timestamp, data, len, caplen, ip,
 		                            tp, endpoint, rel_data_seq, is_orig, flags);
 
@@ -1290,10 +1311,10 @@ void TCP_Analyzer::UpdateConnVal(zeek::RecordVal *conn_val)
 	zeek::RecordVal* orig_endp_val = conn_val->GetField("orig")->AsRecordVal();
 	zeek::RecordVal* resp_endp_val = conn_val->GetField("resp")->AsRecordVal();
 
-	orig_endp_val->Assign(0, zeek::val_mgr->Count(orig->Size()));
-	orig_endp_val->Assign(1, zeek::val_mgr->Count(int(orig->state)));
-	resp_endp_val->Assign(0, zeek::val_mgr->Count(resp->Size()));
-	resp_endp_val->Assign(1, zeek::val_mgr->Count(int(resp->state)));
+	orig_endp_val->AssignCount(0, orig->Size());
+	orig_endp_val->AssignCount(1, int(orig->state));
+	resp_endp_val->AssignCount(0, resp->Size());
+	resp_endp_val->AssignCount(1, int(resp->state));
 
 	// Call children's UpdateConnVal
 	Analyzer::UpdateConnVal(conn_val);
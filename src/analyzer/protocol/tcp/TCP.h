@@ -158,6 +158,14 @@ protected:
 
 	void SetReassembler(tcp::TCP_Reassembler* rorig, tcp::TCP_Reassembler* rresp);
 
+	// Marks the connection as reassembling, raising
+	// new_connection_contents the first time.
+	void StartReassembling();
+
+	// Drops the analyzers above us and any data buffered for them, once
+	// the connection has been bypassed.
+	void StartBypass();
+
 	// A couple utility functions that may also be useful to derived analyzers.
 	static uint64_t get_relative_seq(const TCP_Endpoint* endpoint,
 	                               uint32_t cur_base, uint32_t last,
@@ -166,14 +174,16 @@ protected:
 	static int get_segment_len(int payload_len, TCP_Flags flags);
 
 private:
+	TCP_Endpoint orig_endp;
+	TCP_Endpoint resp_endp;
 	TCP_Endpoint* orig;
 	TCP_Endpoint* resp;
 
-	using analyzer_list = std::list<analyzer::Analyzer*>;
 	analyzer_list packet_children;
 
 	unsigned int first_packet_seen: 2;
 	unsigned int reassembling: 1;
+	unsigned int bypassed: 1;
 	unsigned int is_partial: 1;
 	unsigned int is_active: 1;
 	unsigned int finished: 1;
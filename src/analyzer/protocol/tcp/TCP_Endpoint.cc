@@ -31,6 +31,7 @@ TCP_Endpoint::TCP_Endpoint(TCP_Analyzer* arg_analyzer, bool arg_is_orig)
 	FIN_seq = 0;
 	SYN_cnt = FIN_cnt = RST_cnt = 0;
 	did_close = false;
+	reassembler_deferred = false;
 	tcp_analyzer = arg_analyzer;
 	is_orig = arg_is_orig;
 
@@ -39,8 +40,8 @@ TCP_Endpoint::TCP_Endpoint(TCP_Analyzer* arg_analyzer, bool arg_is_orig)
 
 	hist_last_SYN = hist_last_FIN = hist_last_RST = 0;
 
-	src_addr = is_orig ? Conn()->RespAddr() : Conn()->OrigAddr();
-	dst_addr = is_orig ? Conn()->OrigAddr() : Conn()->RespAddr();
+	const IPAddr& src_addr = is_orig ? Conn()->RespAddr() : Conn()->OrigAddr();
+	const IPAddr& dst_addr = is_orig ? Conn()->OrigAddr() : Conn()->RespAddr();
 
 	checksum_base = ones_complement_checksum(src_addr, 0);
 	checksum_base = ones_complement_checksum(dst_addr, checksum_base);
@@ -85,11 +86,24 @@ void TCP_Endpoint::AddReassembler(TCP_Reassembler* arg_contents_processor)
 	if ( contents_processor != arg_contents_processor )
 		delete contents_processor;
 	contents_processor = arg_contents_processor;
+	reassembler_deferred = false;
 
 	if ( contents_file )
 		contents_processor->SetContentsFile(contents_file);
 	}
 
+void TCP_Endpoint::DeferReassembler()
+	{
+	if ( ! contents_processor )
+		reassembler_deferred = true;
+	}
+
+void TCP_Endpoint::CreateDeferredReassembler()
+	{
+	AddReassembler(new TCP_Reassembler(tcp_analyzer, tcp_analyzer,
+	                                   TCP_Reassembler::Forward, this));
+	}
+
 bool TCP_Endpoint::DataPending() const
 	{
 	if ( contents_processor )
@@ -108,6 +122,12 @@ bool TCP_Endpoint::HasUndeliveredData() const
 
 void TCP_Endpoint::CheckEOF()
 	{
+	// A fresh reassembler would report the EOF.
+	if ( reassembler_deferred &&
+	     (FIN_cnt > 0 || state == TCP_ENDPOINT_CLOSED ||
+	      state == TCP_ENDPOINT_RESET) )
+		CreateDeferredReassembler();
+
 	if ( contents_processor )
 		contents_processor->CheckEOF();
 	}
@@ -205,6 +225,9 @@ bool TCP_Endpoint::DataSent(double t, uint64_t seq, int len, int caplen,
 	{
 	bool status = false;
 
+	if ( reassembler_deferred )
+		CreateDeferredReassembler();
+
 	if ( contents_processor )
 		{
 		if ( caplen >= len )
@@ -250,12 +273,19 @@ bool TCP_Endpoint::DataSent(double t, uint64_t seq, int len, int caplen,
 
 void TCP_Endpoint::AckReceived(uint64_t seq)
 	{
+	// A fresh reassembler ignores acks up to the SYN.
+	if ( reassembler_deferred && seq > 1 )
+		CreateDeferredReassembler();
+
 	if ( contents_processor )
 		contents_processor->AckReceived(seq);
 	}
 
 void TCP_Endpoint::SetContentsFile(BroFilePtr f)
 	{
+	if ( reassembler_deferred )
+		CreateDeferredReassembler();
+
 	contents_file = std::move(f);
 	contents_start_seq = ToRelativeSeqSpace(last_seq, seq_wraps);
 
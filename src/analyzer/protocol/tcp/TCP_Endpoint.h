@@ -141,7 +141,10 @@ public:
 
 	Connection* Conn() const;
 
-	bool HasContents() const		{ return contents_processor != nullptr; }
+	// True if the endpoint's payload gets reassembled, even if its
+	// reassembler has not been created yet.
+	bool HasContents() const
+		{ return contents_processor != nullptr || reassembler_deferred; }
 	bool HadGap() const;
 
 	inline bool IsOrig() const		{ return is_orig; }
@@ -150,6 +153,12 @@ public:
 
 	void AddReassembler(TCP_Reassembler* contents_processor);
 
+	// Turns on reassembly like AddReassembler() with a Forward
+	// reassembler, but creates that only once the endpoint has
+	// something for it to do. Connections without payload, such as
+	// most scans, then never need one.
+	void DeferReassembler();
+
 	bool DataPending() const;
 	bool HasUndeliveredData() const;
 	void CheckEOF();
@@ -215,8 +224,6 @@ public:
 	uint32_t checksum_base;
 
 	double start_time, last_time;
-	IPAddr src_addr; // the other endpoint
-	IPAddr dst_addr; // this endpoint
 	uint32_t window; // current advertised window (*scaled*, not pre-scaling)
 	int window_scale;  // from the TCP option
 	uint32_t window_ack_seq; // at which ack_seq number did we record 'window'
@@ -226,6 +233,7 @@ public:
 	int SYN_cnt, FIN_cnt, RST_cnt;
 	bool did_close;		// whether we've reported it closing
 	bool is_orig;
+	bool reassembler_deferred;	// see DeferReassembler()
 
 	// Relative sequence numbers associated with last control packets.
 	// Used to determine whether ones seen again are interesting,
@@ -246,6 +254,10 @@ protected:
 	uint32_t rxmt_cnt, rxmt_thresh;
 	uint32_t win0_cnt, win0_thresh;
 	uint32_t gap_cnt, gap_thresh;
+
+private:
+	// Creates the reassembler promised by DeferReassembler().
+	void CreateDeferredReassembler();
 };
 
 #define ENDIAN_UNKNOWN 0
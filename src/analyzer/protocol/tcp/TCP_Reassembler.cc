@@ -39,6 +39,8 @@ TCP_Reassembler::TCP_Reassembler(analyzer::Analyzer* arg_dst_analyzer,
 	if ( tcp_max_old_segments )
 		SetMaxOldBlocks(tcp_max_old_segments);
 
+	SetMemoryAccount(tcp_analyzer->Conn()->MemoryAccount());
+
 	if ( ::tcp_contents )
 		{
 		static auto tcp_content_delivery_ports_orig = zeek::id::find_val<zeek::TableVal>("tcp_content_delivery_ports_orig");
@@ -280,6 +282,12 @@ void TCP_Reassembler::Undelivered(uint64_t up_to_seq)
 		last_reassem_seq = up_to_seq;	// we've done our best ...
 	}
 
+void TCP_Reassembler::Evict()
+	{
+	tcp_analyzer->Weird("tcp_reassembly_evicted");
+	Reassembler::Evict();
+	}
+
 void TCP_Reassembler::MatchUndelivered(uint64_t up_to_seq, bool use_last_upper)
 	{
 	if ( block_list.Empty() || ! rule_matcher )
@@ -391,7 +399,10 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 	// and some new stuff.  AddAndCheck() will have split the
 	// new stuff off into its own block(s), but in the following
 	// loop we have to take care not to deliver already-delivered
-	// data.
+	// data.  Contiguous new blocks get delivered together.
+	uint64_t seq = last_reassem_seq;
+	pending_spans.clear();
+
 	while ( it != block_list.End() )
 		{
 		const auto& b = it->second;
@@ -402,18 +413,22 @@ void TCP_Reassembler::BlockInserted(DataBlockMap::const_iterator it)
 		if ( b.seq == last_reassem_seq )
 			{ // New stuff.
 			uint64_t len = b.Size();
-			uint64_t seq = last_reassem_seq;
 			last_reassem_seq += len;
 
 			if ( record_contents_file )
 				RecordBlock(b, record_contents_file);
 
-			DeliverBlock(seq, len, b.block);
+			pending_spans.push_back({b.block, static_cast<int>(len)});
 			}
 
 		++it;
 		}
 
+	if ( pending_spans.size() == 1 )
+		DeliverBlock(seq, pending_spans[0].len, pending_spans[0].data);
+	else
+		DeliverBlocks(seq, pending_spans.data(), pending_spans.size());
+
 	TCP_Endpoint* e = endp;
 
 	if ( ! e->peer->HasContents() )
@@ -468,6 +483,14 @@ void TCP_Reassembler::Deliver(uint64_t seq, int len, const u_char* data)
 		dst_analyzer->ForwardStream(len, data, IsOrig());
 	}
 
+void TCP_Reassembler::Deliver(uint64_t seq, const StreamSpan* spans, int n)
+	{
+	if ( type == Direct )
+		dst_analyzer->NextStreamV(spans, n, IsOrig());
+	else
+		dst_analyzer->ForwardStreamV(spans, n, IsOrig());
+	}
+
 bool TCP_Reassembler::DataSent(double t, uint64_t seq, int len,
 				const u_char* data, TCP_Flags arg_flags, bool replaying)
 	{
@@ -632,6 +655,54 @@ void TCP_Reassembler::DeliverBlock(uint64_t seq, int len, const u_char* data)
 
 	}
 
+void TCP_Reassembler::DeliverBlocks(uint64_t seq, StreamSpan* spans, int n)
+	{
+	// As the blocks are contiguous, only a prefix of them can be below
+	// seq_to_skip.
+	while ( n > 0 && seq + spans[0].len <= seq_to_skip )
+		{
+		seq += spans[0].len;
+		++spans;
+		--n;
+		}
+
+	if ( n == 0 )
+		return;
+
+	if ( seq < seq_to_skip )
+		{
+		uint64_t to_skip = seq_to_skip - seq;
+		spans[0].len -= to_skip;
+		spans[0].data += to_skip;
+		seq = seq_to_skip;
+		}
+
+	uint64_t upper = seq;
+
+	for ( int i = 0; i < n; ++i )
+		{
+		if ( deliver_tcp_contents )
+			tcp_analyzer->EnqueueConnEvent(tcp_contents,
+				tcp_analyzer->ConnVal(),
+				zeek::val_mgr->Bool(IsOrig()),
+				zeek::val_mgr->Count(upper),
+				zeek::make_intrusive<zeek::StringVal>(spans[i].len, (const char*) spans[i].data)
+			);
+
+		upper += spans[i].len;
+		}
+
+	if ( skip_deliveries )
+		return;
+
+	in_delivery = true;
+	Deliver(seq, spans, n);
+	in_delivery = false;
+
+	if ( upper < seq_to_skip )
+		SkipToSeq(seq_to_skip);
+	}
+
 void TCP_Reassembler::SkipToSeq(uint64_t seq)
 	{
 	if ( seq > seq_to_skip )
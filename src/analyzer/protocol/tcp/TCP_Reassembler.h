@@ -4,6 +4,9 @@
 #include "TCP_Endpoint.h"
 #include "TCP_Flags.h"
 #include "File.h"
+#include "analyzer/Analyzer.h"
+
+#include <vector>
 
 class Connection;
 
@@ -73,7 +76,14 @@ public:
 	uint64_t DataSeq() const		{ return LastReassemSeq(); }
 
 	void DeliverBlock(uint64_t seq, int len, const u_char* data);
-	virtual void Deliver(uint64_t seq, int len, const u_char* data);
+	void Deliver(uint64_t seq, int len, const u_char* data);
+
+	// Like DeliverBlock() and Deliver(), for a run of contiguous blocks
+	// starting at *seq*, passed on with a single NextStreamV() or
+	// ForwardStreamV().  DeliverBlocks() trims the spans in place to
+	// what's beyond seq_to_skip.
+	void DeliverBlocks(uint64_t seq, StreamSpan* spans, int n);
+	void Deliver(uint64_t seq, const StreamSpan* spans, int n);
 
 	TCP_Endpoint* Endpoint()		{ return endp; }
 	const TCP_Endpoint* Endpoint() const	{ return endp; }
@@ -87,6 +97,7 @@ private:
 	TCP_Reassembler()	{ }
 
 	void Undelivered(uint64_t up_to_seq) override;
+	void Evict() override;
 	void Gap(uint64_t seq, uint64_t len);
 
 	void RecordToSeq(uint64_t start_seq, uint64_t stop_seq, const BroFilePtr& f);
@@ -106,6 +117,10 @@ private:
 	uint64_t seq_to_skip;
 
 	bool in_delivery;
+
+	// The blocks BlockInserted() is about to deliver, kept around to
+	// save reallocating it.
+	std::vector<StreamSpan> pending_spans;
 	analyzer::tcp::TCP_Flags flags;
 
 	BroFilePtr record_contents_file;	// file on which to reassemble contents
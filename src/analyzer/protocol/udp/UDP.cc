@@ -7,6 +7,8 @@
 #include "Net.h"
 #include "NetVar.h"
 #include "analyzer/protocol/udp/UDP.h"
+#include "analyzer/protocol/conn-size/ConnSize.h"
+#include "analyzer/protocol/pia/PIA.h"
 #include "analyzer/Manager.h"
 #include "Reporter.h"
 #include "Conn.h"
@@ -24,6 +26,9 @@ UDP_Analyzer::UDP_Analyzer(Connection* conn)
 
 	req_chk_cnt = rep_chk_cnt = 0;
 	req_chk_thresh = rep_chk_thresh = 1;
+
+	counting_only = false;
+	counting_only_children = 0;
 	}
 
 UDP_Analyzer::~UDP_Analyzer()
@@ -50,15 +55,101 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 
 	const struct udphdr* up = (const struct udphdr*) data;
 
-	// Increment data before checksum check so that data will
-	// point to UDP payload even if checksum fails. Particularly,
-	// it allows event packet_contents to get to the data.
-	data += sizeof(struct udphdr);
+	if ( counting_only && GetChildren().size() == counting_only_children )
+		{
+		if ( ! CheckDatagram(len, data, is_orig, ip, caplen) )
+			return;
+
+		Conn()->SetLastTime(current_timestamp);
+		CountDatagram(is_orig, ntohs(up->uh_ulen));
+
+		// Only the children counting packets still look at them.
+		if ( caplen >= len )
+			ForwardPacket(len - sizeof(struct udphdr),
+			              data + sizeof(struct udphdr), is_orig, seq, ip,
+			              caplen - sizeof(struct udphdr));
+		return;
+		}
 
 	// We need the min() here because Ethernet frame padding can lead to
 	// caplen > len.
 	if ( packet_contents )
-		PacketContents(data, std::min(len, caplen) - sizeof(struct udphdr));
+		PacketContents(data + sizeof(struct udphdr),
+		               std::min(len, caplen) - sizeof(struct udphdr));
+
+	if ( ! CheckDatagram(len, data, is_orig, ip, caplen) )
+		return;
+
+	int ulen = ntohs(up->uh_ulen);
+	data += sizeof(struct udphdr);
+	len -= sizeof(struct udphdr);
+	caplen -= sizeof(struct udphdr);
+
+	Conn()->SetLastTime(current_timestamp);
+
+	if ( udp_contents )
+		{
+		static auto udp_content_ports = zeek::id::find_val<zeek::TableVal>("udp_content_ports");
+		static auto udp_content_delivery_ports_orig = zeek::id::find_val<zeek::TableVal>("udp_content_delivery_ports_orig");
+		static auto udp_content_delivery_ports_resp = zeek::id::find_val<zeek::TableVal>("udp_content_delivery_ports_resp");
+		bool do_udp_contents = false;
+		const auto& sport_val = zeek::val_mgr->Port(ntohs(up->uh_sport), TRANSPORT_UDP);
+		const auto& dport_val = zeek::val_mgr->Port(ntohs(up->uh_dport), TRANSPORT_UDP);
+
+		if ( udp_content_ports->FindOrDefault(dport_val) ||
+		     udp_content_ports->FindOrDefault(sport_val) )
+			do_udp_contents = true;
+		else
+			{
+			uint16_t p = udp_content_delivery_ports_use_resp ? Conn()->RespPort()
+			                                                 : up->uh_dport;
+			const auto& port_val = zeek::val_mgr->Port(ntohs(p), TRANSPORT_UDP);
+
+			if ( is_orig )
+				{
+				auto result = udp_content_delivery_ports_orig->FindOrDefault(port_val);
+
+				if ( udp_content_deliver_all_orig || (result && result->AsBool()) )
+					do_udp_contents = true;
+				}
+			else
+				{
+				auto result = udp_content_delivery_ports_resp->FindOrDefault(port_val);
+
+				if ( udp_content_deliver_all_resp || (result && result->AsBool()) )
+					do_udp_contents = true;
+				}
+			}
+
+		if ( do_udp_contents )
+			EnqueueConnEvent(udp_contents,
+			                 ConnVal(),
+			                 zeek::val_mgr->Bool(is_orig),
+			                 zeek::make_intrusive<zeek::StringVal>(len, (const char*) data));
+		}
+
+	CountDatagram(is_orig, ulen);
+
+	if ( is_orig )
+		Event(udp_request);
+	else
+		Event(udp_reply);
+
+	if ( caplen >= len )
+		ForwardPacket(len, data, is_orig, seq, ip, caplen);
+
+	if ( udp_counting_only_flows )
+		{
+		counting_only = CountingOnly();
+		counting_only_children = GetChildren().size();
+		}
+	}
+
+bool UDP_Analyzer::CheckDatagram(int len, const u_char* data, bool is_orig,
+                                 const IP_Hdr* ip, int caplen)
+	{
+	const struct udphdr* up = (const struct udphdr*) data;
+	const u_char* payload = data + sizeof(struct udphdr);
 
 	int chksum = up->uh_sum;
 
@@ -68,7 +159,7 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 
 	if ( validate_checksum &&
 	     len > ((int)sizeof(struct udphdr) + vxlan_len + eth_len) &&
-	     (data[0] & 0x08) == 0x08 )
+	     (payload[0] & 0x08) == 0x08 )
 		{
 		auto& vxlan_ports = analyzer_mgr->GetVxlanPorts();
 
@@ -118,7 +209,7 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 					ChecksumEvent(is_orig, t);
 				}
 
-			return;
+			return false;
 			}
 		}
 
@@ -126,52 +217,13 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 	if ( ulen != len )
 		Weird("UDP_datagram_length_mismatch", fmt("%d != %d", ulen, len));
 
-	len -= sizeof(struct udphdr);
-	ulen -= sizeof(struct udphdr);
-	caplen -= sizeof(struct udphdr);
-
-	Conn()->SetLastTime(current_timestamp);
-
-	if ( udp_contents )
-		{
-		static auto udp_content_ports = zeek::id::find_val<zeek::TableVal>("udp_content_ports");
-		static auto udp_content_delivery_ports_orig = zeek::id::find_val<zeek::TableVal>("udp_content_delivery_ports_orig");
-		static auto udp_content_delivery_ports_resp = zeek::id::find_val<zeek::TableVal>("udp_content_delivery_ports_resp");
-		bool do_udp_contents = false;
-		const auto& sport_val = zeek::val_mgr->Port(ntohs(up->uh_sport), TRANSPORT_UDP);
-		const auto& dport_val = zeek::val_mgr->Port(ntohs(up->uh_dport), TRANSPORT_UDP);
-
-		if ( udp_content_ports->FindOrDefault(dport_val) ||
-		     udp_content_ports->FindOrDefault(sport_val) )
-			do_udp_contents = true;
-		else
-			{
-			uint16_t p = udp_content_delivery_ports_use_resp ? Conn()->RespPort()
-			                                                 : up->uh_dport;
-			const auto& port_val = zeek::val_mgr->Port(ntohs(p), TRANSPORT_UDP);
-
-			if ( is_orig )
-				{
-				auto result = udp_content_delivery_ports_orig->FindOrDefault(port_val);
-
-				if ( udp_content_deliver_all_orig || (result && result->AsBool()) )
-					do_udp_contents = true;
-				}
-			else
-				{
-				auto result = udp_content_delivery_ports_resp->FindOrDefault(port_val);
-
-				if ( udp_content_deliver_all_resp || (result && result->AsBool()) )
-					do_udp_contents = true;
-				}
-			}
+	return true;
+	}
 
-		if ( do_udp_contents )
-			EnqueueConnEvent(udp_contents,
-			                 ConnVal(),
-			                 zeek::val_mgr->Bool(is_orig),
-			                 zeek::make_intrusive<zeek::StringVal>(len, (const char*) data));
-		}
+void UDP_Analyzer::CountDatagram(bool is_orig, int ulen)
+	{
+	// A bogus UDP length may not even cover the header.
+	ulen = std::max(ulen - static_cast<int>(sizeof(struct udphdr)), 0);
 
 	if ( is_orig )
 		{
@@ -187,8 +239,6 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 				reporter->Warning("wrapping around for UDP request length");
 #endif
 			}
-
-		Event(udp_request);
 		}
 
 	else
@@ -205,12 +255,31 @@ void UDP_Analyzer::DeliverPacket(int len, const u_char* data, bool is_orig,
 				reporter->Warning("wrapping around for UDP reply length");
 #endif
 			}
+		}
+	}
 
-		Event(udp_reply);
+bool UDP_Analyzer::CountingOnly()
+	{
+	if ( packet_contents || udp_contents || udp_request || udp_reply )
+		return false;
+
+	bool gave_up = false;
+
+	for ( const auto& child : GetChildren() )
+		{
+		if ( auto pia = dynamic_cast<analyzer::pia::PIA_UDP*>(child) )
+			{
+			if ( ! pia->GaveUp() )
+				return false;
+
+			gave_up = true;
+			}
+
+		else if ( ! dynamic_cast<analyzer::conn_size::ConnSize_Analyzer*>(child) )
+			return false;
 		}
 
-	if ( caplen >= len )
-		ForwardPacket(len, data, is_orig, seq, ip, caplen);
+	return gave_up;
 	}
 
 void UDP_Analyzer::UpdateConnVal(zeek::RecordVal* conn_val)
@@ -230,14 +299,14 @@ void UDP_Analyzer::UpdateEndpointVal(zeek::RecordVal* endp, bool is_orig)
 	bro_int_t size = is_orig ? request_len : reply_len;
 	if ( size < 0 )
 		{
-		endp->Assign(0, zeek::val_mgr->Count(0));
-		endp->Assign(1, zeek::val_mgr->Count(int(UDP_INACTIVE)));
+		endp->AssignCount(0, 0);
+		endp->AssignCount(1, int(UDP_INACTIVE));
 		}
 
 	else
 		{
-		endp->Assign(0, zeek::val_mgr->Count(size));
-		endp->Assign(1, zeek::val_mgr->Count(int(UDP_ACTIVE)));
+		endp->AssignCount(0, size);
+		endp->AssignCount(1, int(UDP_ACTIVE));
 		}
 	}
 
@@ -41,6 +41,21 @@ protected:
 private:
 	void UpdateEndpointVal(zeek::RecordVal* endp, bool is_orig);
 
+	// Validates the datagram's checksum and length, raising the weirds
+	// for what's wrong. Returns false if the datagram has a bad checksum
+	// and shouldn't be processed any further.
+	bool CheckDatagram(int len, const u_char* data, bool is_orig,
+	                   const IP_Hdr* ip, int caplen);
+
+	// Records a datagram with the given UDP length, header included, in
+	// the history and the endpoint's size.
+	void CountDatagram(bool is_orig, int ulen);
+
+	// Returns true if nothing beyond CountDatagram() and the children
+	// counting packets needs to see further datagrams, i.e. protocol
+	// detection gave up and no per-packet UDP events are handled.
+	bool CountingOnly();
+
 #define HIST_ORIG_DATA_PKT 0x1
 #define HIST_RESP_DATA_PKT 0x2
 #define HIST_ORIG_CORRUPT_PKT 0x4
@@ -49,6 +64,11 @@ private:
 	// For tracking checksum history.
 	uint32_t req_chk_cnt, req_chk_thresh;
 	uint32_t rep_chk_cnt, rep_chk_thresh;
+
+	// Set once CountingOnly() holds, along with the number of children
+	// at that point. Gaining a child reverts to full processing.
+	bool counting_only;
+	size_t counting_only_children;
 };
 
 } } // namespace analyzer::*
@@ -4,12 +4,20 @@
 
 using namespace analyzer::zip;
 
+static constexpr unsigned int unzip_size = 4096;
+
+// The ratio limit applies only beyond this much output, as small inputs
+// can legitimately expand by a lot.
+static constexpr uint64_t min_ratio_output = 1024 * 1024;
+
 ZIP_Analyzer::ZIP_Analyzer(Connection* conn, bool orig, Method arg_method)
 : tcp::TCP_SupportAnalyzer("ZIP", conn, orig)
 	{
 	zip = nullptr;
 	zip_status = Z_OK;
 	method = arg_method;
+	max_ratio = 0;
+	total_in = total_out = 0;
 
 	zip = new z_stream;
 	zip->zalloc = 0;
@@ -43,18 +51,29 @@ void ZIP_Analyzer::Done()
 		inflateEnd(zip);
 	}
 
+void ZIP_Analyzer::Stop()
+	{
+	if ( ! zip || zip_status != Z_OK )
+		return;
+
+	inflateEnd(zip);
+	zip_status = Z_STREAM_END;
+	}
+
 void ZIP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 	{
 	tcp::TCP_SupportAnalyzer::DeliverStream(len, data, orig);
 
-	if ( ! len || zip_status != Z_OK )
+	if ( ! len || Stopped() )
 		return;
 
-	static unsigned int unzip_size = 4096;
-	auto unzipbuf = std::make_unique<Bytef[]>(unzip_size);
+	if ( ! unzipbuf )
+		unzipbuf = std::make_unique<Bytef[]>(unzip_size);
 
 	int allow_restart = 1;
 
+	total_in += len;
+
 	zip->next_in = (Bytef*) data;
 	zip->avail_in = len;
 
@@ -77,6 +96,16 @@ void ZIP_Analyzer::DeliverStream(int len, const u_char* data, bool orig)
 			if ( have )
 				ForwardStream(have, unzipbuf.get(), IsOrig());
 
+			total_out += have;
+
+			if ( max_ratio && total_out > min_ratio_output &&
+			     total_out / total_in > max_ratio )
+				{
+				Weird("inflate_ratio_exceeded");
+				Stop();
+				return;
+				}
+
 			if ( zip_status == Z_STREAM_END )
 				{
 				inflateEnd(zip);
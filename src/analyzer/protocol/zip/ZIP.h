@@ -4,6 +4,8 @@
 
 #include "zeek-config.h"
 
+#include <memory>
+
 #include "zlib.h"
 #include "analyzer/protocol/tcp/TCP.h"
 
@@ -20,11 +22,37 @@ public:
 
 	void DeliverStream(int len, const u_char* data, bool orig) override;
 
+	/**
+	 * Limits how much output the analyzer produces per byte of input.
+	 * Once the output exceeds a megabyte and the ratio is larger than
+	 * this, the analyzer reports an "inflate_ratio_exceeded" weird and
+	 * stops decompressing.
+	 *
+	 * @param ratio The maximum ratio, or zero for no limit.
+	 */
+	void SetMaxRatio(uint64_t ratio)	{ max_ratio = ratio; }
+
+	/**
+	 * Stops decompressing for good, for example because nothing needs
+	 * the output anymore. Later input is ignored.
+	 */
+	void Stop();
+
+	/**
+	 * Returns true if the analyzer won't produce further output.
+	 */
+	bool Stopped() const	{ return ! zip || zip_status != Z_OK; }
+
 protected:
 	enum { NONE, ZIP_OK, ZIP_FAIL };
 	z_stream* zip;
 	int zip_status;
 	Method method;
+
+	uint64_t max_ratio;
+	uint64_t total_in;
+	uint64_t total_out;
+	std::unique_ptr<Bytef[]> unzipbuf;	// allocated on first use
 };
 
 } } // namespace analyzer::*
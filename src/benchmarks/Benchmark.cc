@@ -0,0 +1,341 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "Benchmark.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <regex>
+#include <thread>
+
+#include "zeek-setup.h"
+#include "Options.h"
+#include "Reporter.h"
+
+namespace zeek::benchmark {
+
+namespace {
+
+struct Benchmark {
+	std::string name;
+	Function func;
+	std::vector<int64_t> args;
+};
+
+struct Result {
+	std::string name;
+	uint64_t iterations;
+	double real_time;	// per iteration, in nanoseconds
+	double cpu_time;
+	double items_per_second;
+	double bytes_per_second;
+};
+
+// Function-local, as benchmarks register during static initialization.
+std::vector<Benchmark>& benchmarks()
+	{
+	static std::vector<Benchmark> b;
+	return b;
+	}
+
+double clock_seconds(clockid_t clock)
+	{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return double(ts.tv_sec) + double(ts.tv_nsec) / 1e9;
+	}
+
+std::string json_escape(const std::string& s)
+	{
+	std::string rval;
+
+	for ( char c : s )
+		{
+		if ( c == '"' || c == '\\' )
+			rval += '\\';
+
+		rval += c;
+		}
+
+	return rval;
+	}
+
+}
+
+void State::Start()
+	{
+	running = true;
+	real_start = clock_seconds(CLOCK_MONOTONIC);
+	cpu_start = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+	}
+
+void State::PauseTiming()
+	{
+	if ( ! running )
+		return;
+
+	real_time += clock_seconds(CLOCK_MONOTONIC) - real_start;
+	cpu_time += clock_seconds(CLOCK_PROCESS_CPUTIME_ID) - cpu_start;
+	running = false;
+	}
+
+void State::ResumeTiming()
+	{
+	if ( ! running )
+		Start();
+	}
+
+void State::Finish()
+	{
+	PauseTiming();
+	}
+
+int Register(const char* name, Function f, std::vector<std::vector<int64_t>> arg_sets)
+	{
+	if ( arg_sets.empty() )
+		{
+		benchmarks().push_back({name, f, {}});
+		return 0;
+		}
+
+	for ( auto& args : arg_sets )
+		{
+		std::string full_name = name;
+
+		for ( auto a : args )
+			full_name += "/" + std::to_string(a);
+
+		benchmarks().push_back({std::move(full_name), f, std::move(args)});
+		}
+
+	return 0;
+	}
+
+// Runs each benchmark with growing iteration counts until a run takes at
+// least the minimum time, the way Google Benchmark does.
+class Runner {
+public:
+	explicit Runner(double arg_min_time) : min_time(arg_min_time)	{}
+
+	Result Run(const Benchmark& b) const
+		{
+		uint64_t iterations = 1;
+
+		for ( ; ; )
+			{
+			State state(iterations, b.args);
+			b.func(state);
+
+			if ( state.real_time >= min_time || iterations >= max_iterations )
+				return MakeResult(b, state);
+
+			double multiplier = min_time * 1.4 / std::max(state.real_time, 1e-9);
+			multiplier = std::min(multiplier, 10.0);
+
+			auto next = static_cast<uint64_t>(iterations * multiplier);
+			iterations = std::min(std::max(next, iterations + 1), max_iterations);
+			}
+		}
+
+private:
+	static Result MakeResult(const Benchmark& b, const State& state)
+		{
+		Result r;
+		r.name = b.name;
+		r.iterations = state.max_iterations;
+		r.real_time = state.real_time * 1e9 / state.max_iterations;
+		r.cpu_time = state.cpu_time * 1e9 / state.max_iterations;
+		r.items_per_second = state.cpu_time > 0 ?
+			state.items_processed / state.cpu_time : 0;
+		r.bytes_per_second = state.cpu_time > 0 ?
+			state.bytes_processed / state.cpu_time : 0;
+		return r;
+		}
+
+	static constexpr uint64_t max_iterations = 1000000000;
+	double min_time;
+};
+
+static void print_console(const std::vector<Result>& results)
+	{
+	printf("%-48s %15s %15s %12s %s\n", "Benchmark", "Time", "CPU",
+	       "Iterations", "UserCounters...");
+
+	for ( const auto& r : results )
+		{
+		printf("%-48s %12.1f ns %12.1f ns %12" PRIu64, r.name.c_str(),
+		       r.real_time, r.cpu_time, r.iterations);
+
+		if ( r.items_per_second > 0 )
+			printf(" items_per_second=%.4g/s", r.items_per_second);
+
+		if ( r.bytes_per_second > 0 )
+			printf(" bytes_per_second=%.4g/s", r.bytes_per_second);
+
+		printf("\n");
+		}
+	}
+
+// Writes results in Google Benchmark's JSON format, which its comparison
+// tooling reads.
+static void print_json(FILE* f, const std::vector<Result>& results, const char* exe)
+	{
+	char date[64];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%FT%T%z", localtime(&now));
+
+	char host[256] = "";
+	gethostname(host, sizeof(host) - 1);
+
+	fprintf(f, "{\n  \"context\": {\n");
+	fprintf(f, "    \"date\": \"%s\",\n", date);
+	fprintf(f, "    \"host_name\": \"%s\",\n", json_escape(host).c_str());
+	fprintf(f, "    \"executable\": \"%s\",\n", json_escape(exe).c_str());
+	fprintf(f, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+	fprintf(f, "    \"zeek_version\": \"%s\",\n", VERSION);
+#ifdef NDEBUG
+	fprintf(f, "    \"library_build_type\": \"release\"\n");
+#else
+	fprintf(f, "    \"library_build_type\": \"debug\"\n");
+#endif
+	fprintf(f, "  },\n  \"benchmarks\": [\n");
+
+	for ( size_t i = 0; i < results.size(); ++i )
+		{
+		const auto& r = results[i];
+		fprintf(f, "    {\n");
+		fprintf(f, "      \"name\": \"%s\",\n", json_escape(r.name).c_str());
+		fprintf(f, "      \"run_name\": \"%s\",\n", json_escape(r.name).c_str());
+		fprintf(f, "      \"run_type\": \"iteration\",\n");
+		fprintf(f, "      \"repetitions\": 1,\n");
+		fprintf(f, "      \"repetition_index\": 0,\n");
+		fprintf(f, "      \"threads\": 1,\n");
+		fprintf(f, "      \"iterations\": %" PRIu64 ",\n", r.iterations);
+		fprintf(f, "      \"real_time\": %.6e,\n", r.real_time);
+		fprintf(f, "      \"cpu_time\": %.6e,\n", r.cpu_time);
+		fprintf(f, "      \"time_unit\": \"ns\"");
+
+		if ( r.items_per_second > 0 )
+			fprintf(f, ",\n      \"items_per_second\": %.6e", r.items_per_second);
+
+		if ( r.bytes_per_second > 0 )
+			fprintf(f, ",\n      \"bytes_per_second\": %.6e", r.bytes_per_second);
+
+		fprintf(f, "\n    }%s\n", i + 1 < results.size() ? "," : "");
+		}
+
+	fprintf(f, "  ]\n}\n");
+	}
+
+static void usage(const char* prog)
+	{
+	fprintf(stderr, "usage: %s [--benchmark_filter=<regex>] [--benchmark_min_time=<secs>]\n"
+	                "       [--benchmark_format=console|json] [--benchmark_out=<file>]\n"
+	                "       [--benchmark_list_tests]\n", prog);
+	exit(1);
+	}
+
+} // namespace zeek::benchmark
+
+int main(int argc, char** argv)
+	{
+	using namespace zeek::benchmark;
+
+	std::string filter = ".";
+	double min_time = 0.5;
+	bool json = false;
+	bool list = false;
+	const char* out = nullptr;
+
+	for ( int i = 1; i < argc; ++i )
+		{
+		const char* a = argv[i];
+
+		if ( strncmp(a, "--benchmark_filter=", 19) == 0 )
+			filter = a + 19;
+		else if ( strncmp(a, "--benchmark_min_time=", 21) == 0 )
+			min_time = atof(a + 21);
+		else if ( strcmp(a, "--benchmark_format=json") == 0 )
+			json = true;
+		else if ( strcmp(a, "--benchmark_format=console") == 0 )
+			json = false;
+		else if ( strncmp(a, "--benchmark_out=", 16) == 0 )
+			out = a + 16;
+		else if ( strcmp(a, "--benchmark_list_tests") == 0 )
+			list = true;
+		else
+			usage(argv[0]);
+		}
+
+	std::regex re;
+
+	try
+		{
+		re = std::regex(filter);
+		}
+	catch ( const std::regex_error& e )
+		{
+		fprintf(stderr, "invalid benchmark filter '%s': %s\n", filter.c_str(), e.what());
+		return 1;
+		}
+
+	std::vector<const Benchmark*> selected;
+
+	for ( const auto& b : benchmarks() )
+		if ( std::regex_search(b.name, re) )
+			selected.push_back(&b);
+
+	if ( list )
+		{
+		for ( auto b : selected )
+			printf("%s\n", b->name.c_str());
+
+		return 0;
+		}
+
+	// Many of the benchmarked structures need the core's globals, like
+	// the types from init-bare.zeek. Scripts beyond that aren't needed.
+	zeek::Options options;
+	options.bare_mode = true;
+	options.deterministic_mode = true;
+	options.script_options_to_set.emplace_back("Reporter::info_to_stderr=F");
+
+	int zeek_argc = 1;
+
+	if ( zeek::detail::setup(zeek_argc, argv, &options).code )
+		return 1;
+
+	Runner runner(min_time);
+	std::vector<Result> results;
+
+	for ( auto b : selected )
+		results.push_back(runner.Run(*b));
+
+	if ( json )
+		print_json(stdout, results, argv[0]);
+	else
+		print_console(results);
+
+	if ( out )
+		{
+		FILE* f = fopen(out, "w");
+
+		if ( ! f )
+			{
+			fprintf(stderr, "can't write %s: %s\n", out, strerror(errno));
+			return 1;
+			}
+
+		print_json(f, results, argv[0]);
+		fclose(f);
+		}
+
+	return 0;
+	}
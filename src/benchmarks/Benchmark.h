@@ -0,0 +1,143 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zeek::benchmark {
+
+/**
+ * The state of a running benchmark, modeled after Google Benchmark's so
+ * that benchmarks read the same. The loop ``for ( auto _ : state )`` runs
+ * the body as many times as the harness decides and times it.
+ */
+class State {
+public:
+	State(uint64_t iterations, std::vector<int64_t> args)
+		: max_iterations(iterations), args(std::move(args))
+		{}
+
+	/**
+	 * Returns the benchmark's n-th argument.
+	 */
+	int64_t range(size_t n = 0) const	{ return args.at(n); }
+
+	/**
+	 * Stops timing, for setup work within the loop.
+	 */
+	void PauseTiming();
+
+	/**
+	 * Resumes timing after PauseTiming().
+	 */
+	void ResumeTiming();
+
+	/**
+	 * Sets the number of items processed by the whole run, for
+	 * reporting a rate.
+	 */
+	void SetItemsProcessed(int64_t n)	{ items_processed = n; }
+
+	/**
+	 * Sets the number of bytes processed by the whole run, for
+	 * reporting a rate.
+	 */
+	void SetBytesProcessed(int64_t n)	{ bytes_processed = n; }
+
+	uint64_t iterations() const	{ return max_iterations; }
+
+	class Iterator {
+	public:
+		Iterator(State* s, uint64_t n) : state(s), remaining(n)	{}
+
+		int operator*() const	{ return 0; }
+		Iterator& operator++()	{ --remaining; return *this; }
+
+		bool operator!=(const Iterator& other) const
+			{
+			if ( remaining != 0 )
+				return true;
+
+			state->Finish();
+			return false;
+			}
+
+	private:
+		State* state;
+		uint64_t remaining;
+	};
+
+	Iterator begin()
+		{
+		Start();
+		return Iterator(this, max_iterations);
+		}
+
+	Iterator end()	{ return Iterator(this, 0); }
+
+private:
+	friend class Runner;
+
+	void Start();
+	void Finish();
+
+	uint64_t max_iterations;
+	std::vector<int64_t> args;
+
+	bool running = false;
+	double real_start = 0;
+	double cpu_start = 0;
+	double real_time = 0;
+	double cpu_time = 0;
+
+	int64_t items_processed = 0;
+	int64_t bytes_processed = 0;
+};
+
+using Function = void (*)(State&);
+
+/**
+ * Registers a benchmark, once for each set of arguments, or once without
+ * any if none are given. Use through the ZEEK_BENCHMARK macros.
+ */
+int Register(const char* name, Function f,
+             std::vector<std::vector<int64_t>> arg_sets = {});
+
+/**
+ * Keeps the compiler from optimizing away the computation of a value.
+ */
+template <typename T>
+inline void DoNotOptimize(const T& value)
+	{
+	asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+/**
+ * Keeps the compiler from optimizing away writes to memory.
+ */
+inline void ClobberMemory()
+	{
+	asm volatile("" : : : "memory");
+	}
+
+} // namespace zeek::benchmark
+
+#define ZEEK_BENCHMARK_CONCAT2(a, b) a##b
+#define ZEEK_BENCHMARK_CONCAT(a, b) ZEEK_BENCHMARK_CONCAT2(a, b)
+
+/**
+ * Registers a function taking a State& as a benchmark.
+ */
+#define ZEEK_BENCHMARK(func) \
+	static int ZEEK_BENCHMARK_CONCAT(zeek_benchmark_, __LINE__) = \
+		zeek::benchmark::Register(#func, func)
+
+/**
+ * Registers a function taking a State& as a benchmark that runs once for
+ * each of the given arguments, e.g. ZEEK_BENCHMARK_ARGS(f, {16}, {4096}).
+ */
+#define ZEEK_BENCHMARK_ARGS(func, ...) \
+	static int ZEEK_BENCHMARK_CONCAT(zeek_benchmark_, __LINE__) = \
+		zeek::benchmark::Register(#func, func, {__VA_ARGS__})
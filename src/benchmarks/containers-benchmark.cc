@@ -0,0 +1,128 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Benchmark.h"
+
+#include "CompHash.h"
+#include "Dict.h"
+#include "Type.h"
+#include "Val.h"
+
+using namespace zeek::benchmark;
+
+static void DictInsert(State& state)
+	{
+	auto n = state.range(0);
+	std::vector<int> vals(n);
+
+	for ( auto _ : state )
+		{
+		PDict<int> d;
+
+		for ( int64_t i = 0; i < n; ++i )
+			{
+			HashKey k(bro_int_t(i));
+			d.Insert(&k, &vals[i]);
+			}
+
+		DoNotOptimize(d.Length());
+		}
+
+	state.SetItemsProcessed(state.iterations() * n);
+	}
+
+ZEEK_BENCHMARK_ARGS(DictInsert, {64}, {4096}, {262144});
+
+static void DictLookup(State& state)
+	{
+	auto n = state.range(0);
+	std::vector<int> vals(n);
+	PDict<int> d;
+	std::vector<std::unique_ptr<HashKey>> keys;
+
+	for ( int64_t i = 0; i < n; ++i )
+		{
+		keys.emplace_back(new HashKey(bro_int_t(i)));
+		HashKey k(bro_int_t(i));
+		d.Insert(&k, &vals[i]);
+		}
+
+	int64_t i = 0;
+
+	for ( auto _ : state )
+		{
+		DoNotOptimize(d.Lookup(keys[i].get()));
+
+		if ( ++i == n )
+			i = 0;
+		}
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK_ARGS(DictLookup, {64}, {4096}, {262144});
+
+// A conn_id-like index of two addresses and ports.
+static zeek::ListValPtr make_conn_index(uint32_t i)
+	{
+	auto lv = zeek::make_intrusive<zeek::ListVal>(zeek::TYPE_ANY);
+	lv->Append(zeek::make_intrusive<zeek::AddrVal>(htonl(0x0a000000 + i)));
+	lv->Append(zeek::val_mgr->Port(1024 + i % 60000, TRANSPORT_TCP));
+	lv->Append(zeek::make_intrusive<zeek::AddrVal>("192.168.1.1"));
+	lv->Append(zeek::val_mgr->Port(80, TRANSPORT_TCP));
+	return lv;
+	}
+
+static zeek::TypeListPtr make_conn_index_type()
+	{
+	auto tl = zeek::make_intrusive<zeek::TypeList>();
+	tl->Append(zeek::base_type(zeek::TYPE_ADDR));
+	tl->Append(zeek::base_type(zeek::TYPE_PORT));
+	tl->Append(zeek::base_type(zeek::TYPE_ADDR));
+	tl->Append(zeek::base_type(zeek::TYPE_PORT));
+	return tl;
+	}
+
+static void CompositeHashMakeHashKey(State& state)
+	{
+	CompositeHash ch(make_conn_index_type());
+	auto index = make_conn_index(1);
+
+	for ( auto _ : state )
+		DoNotOptimize(ch.MakeHashKey(*index, true));
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(CompositeHashMakeHashKey);
+
+static void CompositeHashMakeLookupKey(State& state)
+	{
+	CompositeHash ch(make_conn_index_type());
+	auto index = make_conn_index(1);
+
+	for ( auto _ : state )
+		{
+		LookupHashKey lk;
+		DoNotOptimize(ch.MakeLookupKey(*index, true, lk));
+		}
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(CompositeHashMakeLookupKey);
+
+static void CompositeHashSingleton(State& state)
+	{
+	auto tl = zeek::make_intrusive<zeek::TypeList>(zeek::base_type(zeek::TYPE_STRING));
+	tl->Append(zeek::base_type(zeek::TYPE_STRING));
+	CompositeHash ch(std::move(tl));
+	zeek::ListVal index(zeek::TYPE_ANY);
+	index.Append(zeek::make_intrusive<zeek::StringVal>("www.example.com"));
+
+	for ( auto _ : state )
+		DoNotOptimize(ch.MakeHashKey(index, true));
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(CompositeHashSingleton);
@@ -0,0 +1,96 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Benchmark.h"
+
+#include "Expr.h"
+#include "ID.h"
+#include "Type.h"
+#include "Val.h"
+
+using namespace zeek::benchmark;
+using namespace zeek::detail;
+
+static ExprPtr make_const(zeek::ValPtr v)
+	{
+	return zeek::make_intrusive<ConstExpr>(std::move(v));
+	}
+
+// Evaluates "x = 42" with a global x, as for an assignment statement.
+static void InterpreterAssign(State& state)
+	{
+	auto id = zeek::make_intrusive<ID>("benchmark_x", zeek::detail::SCOPE_GLOBAL, false);
+	id->SetType(zeek::base_type(zeek::TYPE_COUNT));
+
+	auto e = zeek::make_intrusive<AssignExpr>(zeek::make_intrusive<NameExpr>(id),
+	                                          make_const(zeek::val_mgr->Count(42)),
+	                                          false);
+
+	for ( auto _ : state )
+		DoNotOptimize(e->Eval(nullptr));
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(InterpreterAssign);
+
+// Evaluates a conn_id-like record constructor.
+static void InterpreterRecordConstructor(State& state)
+	{
+	auto fields = zeek::make_intrusive<ListExpr>();
+	fields->Append(zeek::make_intrusive<FieldAssignExpr>(
+		"orig_h", make_const(zeek::make_intrusive<zeek::AddrVal>("10.0.0.1"))));
+	fields->Append(zeek::make_intrusive<FieldAssignExpr>(
+		"orig_p", make_const(zeek::val_mgr->Port(1024, TRANSPORT_TCP))));
+	fields->Append(zeek::make_intrusive<FieldAssignExpr>(
+		"resp_h", make_const(zeek::make_intrusive<zeek::AddrVal>("192.168.1.1"))));
+	fields->Append(zeek::make_intrusive<FieldAssignExpr>(
+		"resp_p", make_const(zeek::val_mgr->Port(80, TRANSPORT_TCP))));
+
+	auto e = zeek::make_intrusive<RecordConstructorExpr>(std::move(fields));
+
+	for ( auto _ : state )
+		DoNotOptimize(e->Eval(nullptr));
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(InterpreterRecordConstructor);
+
+// Evaluates "t[i]" for a table[count] of count with 1024 entries.
+static void InterpreterTableIndex(State& state)
+	{
+	auto tl = zeek::make_intrusive<zeek::TypeList>(zeek::base_type(zeek::TYPE_COUNT));
+	tl->Append(zeek::base_type(zeek::TYPE_COUNT));
+	auto tt = zeek::make_intrusive<zeek::TableType>(std::move(tl),
+	                                                zeek::base_type(zeek::TYPE_COUNT));
+	auto t = zeek::make_intrusive<zeek::TableVal>(std::move(tt));
+
+	for ( int i = 0; i < 1024; ++i )
+		t->Assign(zeek::val_mgr->Count(i), zeek::val_mgr->Count(i));
+
+	auto index = zeek::make_intrusive<ListExpr>(make_const(zeek::val_mgr->Count(17)));
+	auto e = zeek::make_intrusive<IndexExpr>(make_const(std::move(t)), std::move(index));
+
+	for ( auto _ : state )
+		DoNotOptimize(e->Eval(nullptr));
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(InterpreterTableIndex);
+
+// Evaluates "sqrt(2.0)", covering argument evaluation and the call.
+static void InterpreterCall(State& state)
+	{
+	auto args = zeek::make_intrusive<ListExpr>(
+		make_const(zeek::make_intrusive<zeek::DoubleVal>(2.0)));
+	auto e = zeek::make_intrusive<CallExpr>(make_const(zeek::id::find_val("sqrt")),
+	                                        std::move(args));
+
+	for ( auto _ : state )
+		DoNotOptimize(e->Eval(nullptr));
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(InterpreterCall);
@@ -0,0 +1,54 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Benchmark.h"
+
+#include <cstdlib>
+
+#include "RE.h"
+#include "ZeekString.h"
+
+using namespace zeek::benchmark;
+
+// Searches a typical HTTP request line for a pattern, with a warm DFA.
+static void SpecificREMatcherMatch(State& state)
+	{
+	static const char* patterns[] = {
+		"/admin/",
+		"(GET|POST|PUT) [^ ]+\\.(php|asp|cgi)",
+		"[a-z0-9]+\\.(exe|dll|scr|zip|rar|7z)[^a-z]",
+	};
+
+	Specific_RE_Matcher m(MATCH_ANYWHERE);
+	m.SetPat(patterns[state.range(0)]);
+
+	if ( ! m.Compile() )
+		abort();
+
+	zeek::String s("GET /downloads/files/2020/release-notes/index.html?lang=en&ref=home HTTP/1.1");
+
+	for ( auto _ : state )
+		DoNotOptimize(m.Match(&s));
+
+	state.SetBytesProcessed(state.iterations() * s.Len());
+	}
+
+ZEEK_BENCHMARK_ARGS(SpecificREMatcherMatch, {0}, {1}, {2});
+
+// Matches a whole value exactly, as for pattern equality in scripts.
+static void SpecificREMatcherMatchExactly(State& state)
+	{
+	Specific_RE_Matcher m(MATCH_EXACTLY);
+	m.SetPat("[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}\\.[0-9]{1,3}");
+
+	if ( ! m.Compile() )
+		abort();
+
+	zeek::String s("192.168.100.254");
+
+	for ( auto _ : state )
+		DoNotOptimize(m.Match(&s));
+
+	state.SetBytesProcessed(state.iterations() * s.Len());
+	}
+
+ZEEK_BENCHMARK(SpecificREMatcherMatchExactly);
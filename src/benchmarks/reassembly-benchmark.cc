@@ -0,0 +1,120 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Benchmark.h"
+
+#include "Reassem.h"
+#include "analyzer/protocol/tcp/ContentLine.h"
+
+using namespace zeek::benchmark;
+
+namespace {
+
+// Delivers in-sequence data right away, like the file and TCP
+// reassemblers do.
+class BenchReassembler final : public Reassembler {
+public:
+	BenchReassembler() : Reassembler(0, REASSEM_TCP)	{}
+
+	uint64_t delivered = 0;
+
+protected:
+	void BlockInserted(DataBlockMap::const_iterator it) override
+		{
+		const auto& start_block = it->second;
+
+		if ( start_block.seq > last_reassem_seq ||
+		     start_block.upper <= last_reassem_seq )
+			return;
+
+		for ( ; it != block_list.End(); ++it )
+			{
+			const auto& b = it->second;
+
+			if ( b.seq > last_reassem_seq )
+				break;
+
+			if ( b.seq == last_reassem_seq )
+				{
+				last_reassem_seq += b.Size();
+				delivered += b.Size();
+				}
+			}
+
+		TrimToSeq(last_reassem_seq);
+		}
+
+	void Overlap(const u_char* b1, const u_char* b2, uint64_t n) override	{}
+};
+
+class LineCounter final : public analyzer::OutputHandler {
+public:
+	void DeliverStream(int len, const u_char* data, bool orig) override
+		{ ++lines; }
+
+	uint64_t lines = 0;
+};
+
+}
+
+static constexpr int segment_size = 1460;
+
+// Delivers segments in order, or with every pair of segments swapped so
+// that each first one gets buffered.
+static void ReassemblerNewBlock(State& state)
+	{
+	bool swapped = state.range(0);
+	std::vector<u_char> data(segment_size, 'x');
+	BenchReassembler r;
+	uint64_t seq = 0;
+
+	for ( auto _ : state )
+		{
+		if ( swapped )
+			{
+			r.NewBlock(0, seq + segment_size, segment_size, data.data());
+			r.NewBlock(0, seq, segment_size, data.data());
+			}
+		else
+			{
+			r.NewBlock(0, seq, segment_size, data.data());
+			r.NewBlock(0, seq + segment_size, segment_size, data.data());
+			}
+
+		seq += 2 * segment_size;
+		}
+
+	DoNotOptimize(r.delivered);
+	state.SetBytesProcessed(state.iterations() * 2 * segment_size);
+	}
+
+ZEEK_BENCHMARK_ARGS(ReassemblerNewBlock, {0}, {1});
+
+// Splits a stream of CRLF-terminated lines of the given length.
+static void ContentLineDeliverStream(State& state)
+	{
+	auto line_len = state.range(0);
+	std::string line(line_len - 2, 'a');
+	line += "\r\n";
+
+	std::string chunk;
+
+	while ( chunk.size() + line.size() <= segment_size )
+		chunk += line;
+
+	// The analyzer needs no connection as long as there's nothing to
+	// report as weird.
+	auto cl = new analyzer::tcp::ContentLine_Analyzer(nullptr, true);
+	auto counter = new LineCounter();
+	cl->SetOutputHandler(counter);
+
+	for ( auto _ : state )
+		cl->NextStream(chunk.size(), reinterpret_cast<const u_char*>(chunk.data()), true);
+
+	DoNotOptimize(counter->lines);
+	state.SetBytesProcessed(state.iterations() * chunk.size());
+
+	cl->Done();
+	delete cl;
+	}
+
+ZEEK_BENCHMARK_ARGS(ContentLineDeliverStream, {16}, {80}, {1024});
@@ -0,0 +1,174 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Benchmark.h"
+
+#include <cstring>
+#include <thread>
+
+#include "Desc.h"
+#include "threading/Queue.h"
+#include "threading/SerialTypes.h"
+#include "threading/formatters/Ascii.h"
+#include "threading/formatters/JSON.h"
+
+using namespace zeek::benchmark;
+
+static void QueuePutGet(State& state)
+	{
+	threading::Queue<int*> q(nullptr, nullptr);
+	int x = 0;
+
+	for ( auto _ : state )
+		{
+		q.Put(&x);
+		DoNotOptimize(q.Get());
+		}
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(QueuePutGet);
+
+// Hands elements from a writer thread over to the reader, in batches of
+// the given size.
+static void QueueHandoff(State& state)
+	{
+	auto batch = state.range(0);
+	threading::Queue<int*> q(nullptr, nullptr);
+	int x = 0;
+
+	for ( auto _ : state )
+		{
+		std::thread writer([&]()
+			{
+			for ( int64_t i = 0; i < batch; ++i )
+				q.Put(&x);
+			});
+
+		for ( int64_t i = 0; i < batch; )
+			if ( q.Get() )
+				++i;
+
+		writer.join();
+		}
+
+	state.SetItemsProcessed(state.iterations() * batch);
+	}
+
+ZEEK_BENCHMARK_ARGS(QueueHandoff, {1024}, {65536});
+
+namespace {
+
+char* copy(const char* s)
+	{
+	auto n = strlen(s);
+	auto rval = new char[n + 1];
+	memcpy(rval, s, n + 1);
+	return rval;
+	}
+
+// A log record like those of conn.log.
+class ConnRecord {
+public:
+	ConnRecord()
+		{
+		Add("ts", zeek::TYPE_TIME)->val.double_val = 1600000000.123456;
+		AddString("uid", "CHhAvVGS1DHFjwGM9");
+		AddAddr("id.orig_h", 0x0a000001);
+		AddPort("id.orig_p", 49152);
+		AddAddr("id.resp_h", 0xc0a80101);
+		AddPort("id.resp_p", 443);
+		AddString("proto", "tcp", zeek::TYPE_ENUM);
+		AddString("service", "ssl");
+		Add("duration", zeek::TYPE_INTERVAL)->val.double_val = 12.345678;
+		Add("orig_bytes", zeek::TYPE_COUNT)->val.uint_val = 4711;
+		Add("resp_bytes", zeek::TYPE_COUNT)->val.uint_val = 1234567;
+		AddString("conn_state", "SF");
+		Add("local_orig", zeek::TYPE_BOOL)->val.int_val = 1;
+		AddString("history", "ShADadFf");
+		}
+
+	~ConnRecord()
+		{
+		for ( auto f : fields )
+			delete f;
+
+		for ( auto v : vals )
+			delete v;
+		}
+
+	int NumFields() const	{ return fields.size(); }
+	const threading::Field* const* Fields() const	{ return fields.data(); }
+	threading::Value** Vals()	{ return vals.data(); }
+
+private:
+	threading::Value* Add(const char* name, zeek::TypeTag type)
+		{
+		fields.push_back(new threading::Field(name, nullptr, type, zeek::TYPE_VOID, false));
+		vals.push_back(new threading::Value(type));
+		return vals.back();
+		}
+
+	void AddString(const char* name, const char* s, zeek::TypeTag type = zeek::TYPE_STRING)
+		{
+		auto v = Add(name, type);
+		v->val.string_val.data = copy(s);
+		v->val.string_val.length = strlen(s);
+		}
+
+	void AddAddr(const char* name, uint32_t addr)
+		{
+		auto v = Add(name, zeek::TYPE_ADDR);
+		v->val.addr_val.family = IPv4;
+		v->val.addr_val.in.in4.s_addr = htonl(addr);
+		}
+
+	void AddPort(const char* name, uint32_t port)
+		{
+		auto v = Add(name, zeek::TYPE_PORT);
+		v->val.port_val.port = port;
+		v->val.port_val.proto = TRANSPORT_TCP;
+		}
+
+	std::vector<threading::Field*> fields;
+	std::vector<threading::Value*> vals;
+};
+
+}
+
+static void AsciiFormatterDescribe(State& state)
+	{
+	threading::formatter::Ascii::SeparatorInfo info("\t", ",", "-", "(empty)");
+	threading::formatter::Ascii f(nullptr, info);
+	ConnRecord r;
+	ODesc desc;
+	desc.EnableEscaping();
+	desc.AddEscapeSequence("\t");
+
+	for ( auto _ : state )
+		{
+		desc.Clear();
+		f.Describe(&desc, r.NumFields(), r.Fields(), r.Vals());
+		}
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(AsciiFormatterDescribe);
+
+static void JSONFormatterDescribe(State& state)
+	{
+	threading::formatter::JSON f(nullptr, threading::formatter::JSON::TS_EPOCH);
+	ConnRecord r;
+	ODesc desc;
+
+	for ( auto _ : state )
+		{
+		desc.Clear();
+		f.Describe(&desc, r.NumFields(), r.Fields(), r.Vals());
+		}
+
+	state.SetItemsProcessed(state.iterations());
+	}
+
+ZEEK_BENCHMARK(JSONFormatterDescribe);
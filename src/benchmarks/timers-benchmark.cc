@@ -0,0 +1,115 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Benchmark.h"
+
+#include <random>
+
+#include "PriorityQueue.h"
+#include "Timer.h"
+
+using namespace zeek::benchmark;
+
+namespace {
+
+class NullTimer final : public Timer {
+public:
+	explicit NullTimer(double t) : Timer(t, TIMER_NETWORK)	{}
+
+	void Dispatch(double t, bool is_expire) override	{}
+};
+
+// Advances without the side effects of TimerMgr::Advance() on other
+// managers.
+template <typename Mgr>
+class BenchTimerMgr : public Mgr {
+public:
+	int Step(double t)
+		{
+		this->t = t;
+		return this->DoAdvance(t, 0);
+		}
+};
+
+// Offsets like those of connection timers, from milliseconds to hours.
+std::vector<double> timer_offsets(size_t n)
+	{
+	std::mt19937 rng(42);
+	std::exponential_distribution<double> dist(1.0 / 30.0);
+	std::vector<double> offsets(n);
+
+	for ( auto& o : offsets )
+		o = std::min(dist(rng), 3600.0);
+
+	return offsets;
+	}
+
+}
+
+static void PriorityQueueAddRemove(State& state)
+	{
+	auto n = state.range(0);
+	auto offsets = timer_offsets(n);
+	std::vector<PQ_Element> elems;
+
+	for ( auto o : offsets )
+		elems.emplace_back(o);
+
+	for ( auto _ : state )
+		{
+		PriorityQueue q;
+
+		for ( auto& e : elems )
+			q.Add(&e);
+
+		while ( q.Remove() )
+			;
+		}
+
+	state.SetItemsProcessed(state.iterations() * n);
+	}
+
+ZEEK_BENCHMARK_ARGS(PriorityQueueAddRemove, {1024}, {65536});
+
+// Adds timers ahead of the current time while advancing in steps of
+// 0.1ms, like a busy packet stream would, then expires the rest.
+template <typename Mgr>
+static void TimerMgrAddAdvance(State& state)
+	{
+	auto n = state.range(0);
+	auto offsets = timer_offsets(n);
+
+	// Timer managers register with the IOSource manager, which takes
+	// care of deleting them.
+	auto mgr = new BenchTimerMgr<Mgr>();
+	double t = 1600000000.0;
+	mgr->Step(t);
+
+	for ( auto _ : state )
+		{
+		for ( auto o : offsets )
+			{
+			mgr->Add(new NullTimer(t + o));
+			t += 0.0001;
+			mgr->Step(t);
+			}
+
+		t += 3600.0 + 1.0;
+		mgr->Step(t);
+		}
+
+	state.SetItemsProcessed(state.iterations() * n);
+	}
+
+static void PQTimerMgrAddAdvance(State& state)
+	{
+	TimerMgrAddAdvance<PQ_TimerMgr>(state);
+	}
+
+ZEEK_BENCHMARK_ARGS(PQTimerMgrAddAdvance, {1024}, {65536});
+
+static void WheelTimerMgrAddAdvance(State& state)
+	{
+	TimerMgrAddAdvance<Wheel_TimerMgr>(state);
+	}
+
+ZEEK_BENCHMARK_ARGS(WheelTimerMgrAddAdvance, {1024}, {65536});
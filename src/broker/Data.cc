@@ -12,6 +12,9 @@
 #include "Func.h"
 #include "module_util.h"
 
+#include <memory>
+#include <unordered_map>
+
 using namespace std;
 
 zeek::OpaqueTypePtr bro_broker::opaque_of_data_type;
@@ -22,6 +25,40 @@ zeek::OpaqueTypePtr bro_broker::opaque_of_record_iterator;
 
 static bool data_type_check(const broker::data& d, zeek::Type* t);
 
+static broker::timestamp to_broker_time(double t)
+	{
+	auto secs = broker::fractional_seconds{t};
+	auto since_epoch = std::chrono::duration_cast<broker::timespan>(secs);
+	return broker::timestamp{since_epoch};
+	}
+
+static broker::timespan to_broker_interval(double t)
+	{
+	auto secs = broker::fractional_seconds{t};
+	return std::chrono::duration_cast<broker::timespan>(secs);
+	}
+
+static double from_broker_time(const broker::timestamp& t)
+	{
+	using namespace std::chrono;
+	return duration_cast<broker::fractional_seconds>(t.time_since_epoch()).count();
+	}
+
+static double from_broker_interval(const broker::timespan& t)
+	{
+	using namespace std::chrono;
+	return duration_cast<broker::fractional_seconds>(t).count();
+	}
+
+static broker::address to_broker_address(const IPAddr& a)
+	{
+	in6_addr tmp;
+	a.CopyIPv6(&tmp);
+	return broker::address(reinterpret_cast<const uint32_t*>(&tmp),
+	                       broker::address::family::ipv6,
+	                       broker::address::byte_order::network);
+	}
+
 static broker::port::protocol to_broker_port_proto(TransportProto tp)
 	{
 	switch ( tp ) {
@@ -72,6 +109,297 @@ TEST_CASE("converting Broker to Zeek protocol constants")
 	         TRANSPORT_UNKNOWN);
 	}
 
+namespace {
+
+// Converts records of a given type to and from Broker data. The functions
+// converting each field get picked once, from the field's type, so that
+// converting a record doesn't need to dispatch on the types of its fields
+// or their Broker data. Atomic fields, the common case, convert directly;
+// others go through val_to_data() and data_to_val().
+class RecordConverter {
+public:
+	explicit RecordConverter(zeek::RecordTypePtr type);
+
+	bool ToData(const zeek::RecordVal* rec, broker::vector* rval) const;
+	zeek::RecordValPtr FromData(broker::vector& v) const;
+
+	size_t NumFields() const	{ return fields.size(); }
+
+private:
+	using to_data_func = bool (*)(const zeek::Val* v, broker::vector* rval);
+	using from_data_func = zeek::ValPtr (*)(broker::data& d, zeek::Type* t);
+
+	struct Field {
+		to_data_func to_data;
+		from_data_func from_data;
+		zeek::Type* type;
+	};
+
+	// Keeps the type, and with it its address, alive while it's cached.
+	zeek::RecordTypePtr type;
+	std::vector<Field> fields;
+};
+
+}
+
+static bool bool_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(v->AsBool());
+	return true;
+	}
+
+static bool int_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(v->AsInt());
+	return true;
+	}
+
+static bool count_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(v->AsCount());
+	return true;
+	}
+
+static bool double_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(v->AsDouble());
+	return true;
+	}
+
+static bool time_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(to_broker_time(v->AsTime()));
+	return true;
+	}
+
+static bool interval_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(to_broker_interval(v->AsInterval()));
+	return true;
+	}
+
+static bool string_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	auto s = v->AsString();
+	rval->emplace_back(std::string(reinterpret_cast<const char*>(s->Bytes()), s->Len()));
+	return true;
+	}
+
+static bool addr_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	rval->emplace_back(to_broker_address(v->AsAddr()));
+	return true;
+	}
+
+static bool port_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	auto p = v->AsPortVal();
+	rval->emplace_back(broker::port(p->Port(), to_broker_port_proto(p->PortType())));
+	return true;
+	}
+
+static bool any_to_data(const zeek::Val* v, broker::vector* rval)
+	{
+	auto d = bro_broker::val_to_data(v);
+
+	if ( ! d )
+		return false;
+
+	rval->emplace_back(std::move(*d));
+	return true;
+	}
+
+static zeek::ValPtr data_to_bool(broker::data& d, zeek::Type* t)
+	{
+	auto b = caf::get_if<bool>(&d);
+	return b ? zeek::val_mgr->Bool(*b) : nullptr;
+	}
+
+static zeek::ValPtr data_to_int(broker::data& d, zeek::Type* t)
+	{
+	auto i = caf::get_if<broker::integer>(&d);
+	return i ? zeek::val_mgr->Int(*i) : nullptr;
+	}
+
+static zeek::ValPtr data_to_count(broker::data& d, zeek::Type* t)
+	{
+	auto c = caf::get_if<broker::count>(&d);
+	return c ? zeek::val_mgr->Count(*c) : nullptr;
+	}
+
+static zeek::ValPtr data_to_double(broker::data& d, zeek::Type* t)
+	{
+	auto r = caf::get_if<broker::real>(&d);
+	return r ? zeek::make_intrusive<zeek::DoubleVal>(*r) : nullptr;
+	}
+
+static zeek::ValPtr data_to_time(broker::data& d, zeek::Type* t)
+	{
+	auto ts = caf::get_if<broker::timestamp>(&d);
+	return ts ? zeek::make_intrusive<zeek::TimeVal>(from_broker_time(*ts)) : nullptr;
+	}
+
+static zeek::ValPtr data_to_interval(broker::data& d, zeek::Type* t)
+	{
+	auto ts = caf::get_if<broker::timespan>(&d);
+	return ts ? zeek::make_intrusive<zeek::IntervalVal>(from_broker_interval(*ts)) : nullptr;
+	}
+
+static zeek::ValPtr data_to_string(broker::data& d, zeek::Type* t)
+	{
+	auto s = caf::get_if<std::string>(&d);
+	return s ? zeek::make_intrusive<zeek::StringVal>(s->size(), s->data()) : nullptr;
+	}
+
+static zeek::ValPtr data_to_addr(broker::data& d, zeek::Type* t)
+	{
+	auto a = caf::get_if<broker::address>(&d);
+
+	if ( ! a )
+		return nullptr;
+
+	auto bits = reinterpret_cast<const in6_addr*>(&a->bytes());
+	return zeek::make_intrusive<zeek::AddrVal>(IPAddr(*bits));
+	}
+
+static zeek::ValPtr data_to_port(broker::data& d, zeek::Type* t)
+	{
+	auto p = caf::get_if<broker::port>(&d);
+
+	if ( ! p )
+		return nullptr;
+
+	return zeek::val_mgr->Port(p->number(), bro_broker::to_bro_port_proto(p->type()));
+	}
+
+static zeek::ValPtr data_to_any(broker::data& d, zeek::Type* t)
+	{
+	return bro_broker::data_to_val(std::move(d), t);
+	}
+
+RecordConverter::RecordConverter(zeek::RecordTypePtr arg_type)
+	: type(std::move(arg_type))
+	{
+	fields.reserve(type->NumFields());
+
+	for ( int i = 0; i < type->NumFields(); ++i )
+		{
+		auto t = type->GetFieldType(i).get();
+		Field f{any_to_data, data_to_any, t};
+
+		switch ( t->Tag() ) {
+		case zeek::TYPE_BOOL:
+			f.to_data = bool_to_data;
+			f.from_data = data_to_bool;
+			break;
+		case zeek::TYPE_INT:
+			f.to_data = int_to_data;
+			f.from_data = data_to_int;
+			break;
+		case zeek::TYPE_COUNT:
+			f.to_data = count_to_data;
+			f.from_data = data_to_count;
+			break;
+		case zeek::TYPE_DOUBLE:
+			f.to_data = double_to_data;
+			f.from_data = data_to_double;
+			break;
+		case zeek::TYPE_TIME:
+			f.to_data = time_to_data;
+			f.from_data = data_to_time;
+			break;
+		case zeek::TYPE_INTERVAL:
+			f.to_data = interval_to_data;
+			f.from_data = data_to_interval;
+			break;
+		case zeek::TYPE_STRING:
+			f.to_data = string_to_data;
+			f.from_data = data_to_string;
+			break;
+		case zeek::TYPE_ADDR:
+			f.to_data = addr_to_data;
+			f.from_data = data_to_addr;
+			break;
+		case zeek::TYPE_PORT:
+			f.to_data = port_to_data;
+			f.from_data = data_to_port;
+			break;
+		default:
+			break;
+		}
+
+		fields.push_back(f);
+		}
+	}
+
+bool RecordConverter::ToData(const zeek::RecordVal* rec, broker::vector* rval) const
+	{
+	rval->clear();
+	rval->reserve(fields.size());
+
+	for ( size_t i = 0; i < fields.size(); ++i )
+		{
+		if ( const auto& v = rec->GetField(i) )
+			{
+			if ( ! fields[i].to_data(v.get(), rval) )
+				return false;
+
+			continue;
+			}
+
+		// Unset fields may still have a &default.
+		auto v = rec->GetFieldOrDefault(i);
+
+		if ( ! v )
+			rval->emplace_back(broker::nil);
+
+		else if ( ! fields[i].to_data(v.get(), rval) )
+			return false;
+		}
+
+	return true;
+	}
+
+zeek::RecordValPtr RecordConverter::FromData(broker::vector& v) const
+	{
+	if ( v.size() < fields.size() )
+		return nullptr;
+
+	auto rval = zeek::make_intrusive<zeek::RecordVal>(type);
+
+	for ( size_t i = 0; i < fields.size(); ++i )
+		{
+		if ( caf::get_if<broker::none>(&v[i]) )
+			continue;
+
+		auto item_val = fields[i].from_data(v[i], fields[i].type);
+
+		if ( ! item_val )
+			return nullptr;
+
+		rval->Assign(i, std::move(item_val));
+		}
+
+	return rval;
+	}
+
+static RecordConverter* get_record_converter(const zeek::RecordType* rt)
+	{
+	// Never destroyed, so that the types it holds aren't released during
+	// shutdown.
+	static auto converters =
+		new std::unordered_map<const zeek::RecordType*, std::unique_ptr<RecordConverter>>;
+
+	auto& c = (*converters)[rt];
+
+	// Redefs may still add fields while scripts get parsed.
+	if ( ! c || c->NumFields() != static_cast<size_t>(rt->NumFields()) )
+		c = std::make_unique<RecordConverter>(
+			zeek::IntrusivePtr{zeek::NewRef{}, const_cast<zeek::RecordType*>(rt)});
+
+	return c.get();
+	}
+
 struct val_converter {
 	using result_type = zeek::ValPtr;
 
@@ -166,9 +494,7 @@ struct val_converter {
 		if ( type->Tag() != zeek::TYPE_TIME )
 			return nullptr;
 
-		using namespace std::chrono;
-		auto s = duration_cast<broker::fractional_seconds>(a.time_since_epoch());
-		return zeek::make_intrusive<zeek::TimeVal>(s.count());
+		return zeek::make_intrusive<zeek::TimeVal>(from_broker_time(a));
 		}
 
 	result_type operator()(broker::timespan& a)
@@ -176,9 +502,7 @@ struct val_converter {
 		if ( type->Tag() != zeek::TYPE_INTERVAL )
 			return nullptr;
 
-		using namespace std::chrono;
-		auto s = duration_cast<broker::fractional_seconds>(a);
-		return zeek::make_intrusive<zeek::IntervalVal>(s.count());
+		return zeek::make_intrusive<zeek::IntervalVal>(from_broker_interval(a));
 		}
 
 	result_type operator()(broker::enum_value& a)
@@ -381,35 +705,7 @@ struct val_converter {
 			return rval;
 			}
 		else if ( type->Tag() == zeek::TYPE_RECORD )
-			{
-			auto rt = type->AsRecordType();
-			auto rval = zeek::make_intrusive<zeek::RecordVal>(zeek::IntrusivePtr{zeek::NewRef{}, rt});
-			auto idx = 0u;
-
-			for ( auto i = 0u; i < static_cast<size_t>(rt->NumFields()); ++i )
-				{
-				if ( idx >= a.size() )
-					return nullptr;
-
-				if ( caf::get_if<broker::none>(&a[idx]) != nullptr )
-					{
-					rval->Assign(i, nullptr);
-					++idx;
-					continue;
-					}
-
-				auto item_val = bro_broker::data_to_val(move(a[idx]),
-				                                        rt->GetFieldType(i).get());
-
-				if ( ! item_val )
-					return nullptr;
-
-				rval->Assign(i, std::move(item_val));
-				++idx;
-				}
-
-			return rval;
-			}
+			return get_record_converter(type->AsRecordType())->FromData(a);
 		else if ( type->Tag() == zeek::TYPE_PATTERN )
 			{
 			if ( a.size() != 2 )
@@ -804,39 +1100,18 @@ broker::expected<broker::data> bro_broker::val_to_data(const zeek::Val* v)
 		return {broker::port(p->Port(), to_broker_port_proto(p->PortType()))};
 		}
 	case zeek::TYPE_ADDR:
-		{
-		auto a = v->AsAddr();
-		in6_addr tmp;
-		a.CopyIPv6(&tmp);
-		return {broker::address(reinterpret_cast<const uint32_t*>(&tmp),
-			                    broker::address::family::ipv6,
-			                    broker::address::byte_order::network)};
-		}
-		break;
+		return {to_broker_address(v->AsAddr())};
 	case zeek::TYPE_SUBNET:
 		{
 		auto s = v->AsSubNet();
-		in6_addr tmp;
-		s.Prefix().CopyIPv6(&tmp);
-		auto a = broker::address(reinterpret_cast<const uint32_t*>(&tmp),
-		                         broker::address::family::ipv6,
-		                         broker::address::byte_order::network);
-		return {broker::subnet(std::move(a), s.Length())};
+		return {broker::subnet(to_broker_address(s.Prefix()), s.Length())};
 		}
-		break;
 	case zeek::TYPE_DOUBLE:
 		return {v->AsDouble()};
 	case zeek::TYPE_TIME:
-		{
-		auto secs = broker::fractional_seconds{v->AsTime()};
-		auto since_epoch = std::chrono::duration_cast<broker::timespan>(secs);
-		return {broker::timestamp{since_epoch}};
-		}
+		return {to_broker_time(v->AsTime())};
 	case zeek::TYPE_INTERVAL:
-		{
-		auto secs = broker::fractional_seconds{v->AsInterval()};
-		return {std::chrono::duration_cast<broker::timespan>(secs)};
-		}
+		return {to_broker_interval(v->AsInterval())};
 	case zeek::TYPE_ENUM:
 		{
 		auto enum_type = v->GetType()->AsEnumType();
@@ -959,28 +1234,10 @@ broker::expected<broker::data> bro_broker::val_to_data(const zeek::Val* v)
 		}
 	case zeek::TYPE_RECORD:
 		{
-		auto rec = v->AsRecordVal();
 		broker::vector rval;
-		size_t num_fields = v->GetType()->AsRecordType()->NumFields();
-		rval.reserve(num_fields);
-
-		for ( auto i = 0u; i < num_fields; ++i )
-			{
-			auto item_val = rec->GetFieldOrDefault(i);
-
-			if ( ! item_val )
-				{
-				rval.emplace_back(broker::nil);
-				continue;
-				}
 
-			auto item = val_to_data(item_val.get());
-
-			if ( ! item )
-				return broker::ec::invalid_data;
-
-			rval.emplace_back(move(*item));
-			}
+		if ( ! record_to_data(v->AsRecordVal(), &rval) )
+			return broker::ec::invalid_data;
 
 		return {std::move(rval)};
 		}
@@ -1010,6 +1267,11 @@ broker::expected<broker::data> bro_broker::val_to_data(const zeek::Val* v)
 	return broker::ec::invalid_data;
 	}
 
+bool bro_broker::record_to_data(const zeek::RecordVal* rec, broker::vector* rval)
+	{
+	return get_record_converter(rec->GetType()->AsRecordType())->ToData(rec, rval);
+	}
+
 zeek::RecordValPtr bro_broker::make_data_val(zeek::Val* v)
 	{
 	auto rval = zeek::make_intrusive<zeek::RecordVal>(zeek::BifType::Record::Broker::Data);
@@ -55,6 +55,17 @@ zeek::EnumValPtr get_data_type(zeek::RecordVal* v, zeek::detail::Frame* frame);
  */
 broker::expected<broker::data> val_to_data(const zeek::Val* v);
 
+/**
+ * Convert a record value to Broker data the same way val_to_data() does,
+ * through a converter that gets built once per record type and then
+ * converts each field without dispatching on its type.
+ * @param rec the record to convert.
+ * @param rval receives the record's fields. It gets cleared first, so a
+ * caller converting many records may reuse the same vector.
+ * @return whether all fields could be converted.
+ */
+bool record_to_data(const zeek::RecordVal* rec, broker::vector* rval);
+
 /**
  * Convert a Broker data value to a Bro value.
  * @param d a Broker data value.
@@ -0,0 +1,236 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "LogBatch.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "threading/SerialTypes.h"
+
+using threading::Value;
+
+namespace bro_broker {
+
+// A single serialized record starts with its number of fields in network
+// byte order, so its first byte is never this one.
+static constexpr char batch_magic = '\xff';
+static constexpr char batch_version = 1;
+
+// How a value is stored within its column.
+enum ValueEncoding : char {
+	VALUE_INLINE = 0,	// Serialized by Value::Write().
+	VALUE_DICT = 1,	// The type and dictionary index of a string value.
+};
+
+static bool is_string_type(zeek::TypeTag t)
+	{
+	return t == zeek::TYPE_STRING || t == zeek::TYPE_ENUM ||
+	       t == zeek::TYPE_FILE || t == zeek::TYPE_FUNC;
+	}
+
+LogBatchEncoder::LogBatchEncoder(int arg_num_fields)
+	: num_fields(arg_num_fields), columns(arg_num_fields)
+	{
+	}
+
+bool LogBatchEncoder::WriteValue(BinarySerializationFormat* fmt, const Value* v)
+	{
+	if ( ! (v->present && is_string_type(v->type) && v->subtype == zeek::TYPE_VOID) )
+		return fmt->Write((char)VALUE_INLINE, "encoding") && v->Write(fmt);
+
+	std::string s(v->val.string_val.data, v->val.string_val.length);
+	auto it = dict_index.find(s);
+
+	if ( it == dict_index.end() )
+		{
+		it = dict_index.emplace(std::move(s), dict.size()).first;
+		dict.push_back(&it->first);
+		}
+
+	return fmt->Write((char)VALUE_DICT, "encoding") &&
+	       fmt->Write((int)v->type, "type") &&
+	       fmt->Write(it->second, "index");
+	}
+
+bool LogBatchEncoder::Add(const Value* const* vals)
+	{
+	// Shared by all encoders to save each its own buffer.
+	static BinarySerializationFormat scratch;
+
+	// The record only gets added once all of its values serialized, so
+	// that the columns keep lining up.
+	std::vector<std::string> record(num_fields);
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		scratch.StartWrite();
+
+		if ( ! WriteValue(&scratch, vals[i]) )
+			return false;
+
+		scratch.EndWrite(&record[i]);
+		}
+
+	for ( int i = 0; i < num_fields; ++i )
+		columns[i].append(record[i]);
+
+	++num_records;
+	return true;
+	}
+
+void LogBatchEncoder::Finish(std::string* rval)
+	{
+	BinarySerializationFormat fmt;
+	fmt.StartWrite();
+	fmt.Write(batch_magic, "magic");
+	fmt.Write(batch_version, "version");
+	fmt.Write(num_fields, "num_fields");
+	fmt.Write(static_cast<uint32_t>(num_records), "num_records");
+	fmt.Write(static_cast<uint32_t>(dict.size()), "dict_size");
+
+	for ( const auto* s : dict )
+		fmt.Write(*s, "string");
+
+	for ( auto& c : columns )
+		{
+		fmt.Write(c, "column");
+		c.clear();
+		}
+
+	fmt.EndWrite(rval);
+
+	num_records = 0;
+	dict.clear();
+	dict_index.clear();
+	}
+
+bool is_log_batch(const std::string& data)
+	{
+	return ! data.empty() && data[0] == batch_magic;
+	}
+
+static Value* read_value(BinarySerializationFormat* fmt,
+                         const std::vector<std::string>& dict)
+	{
+	char encoding;
+
+	if ( ! fmt->Read(&encoding, "encoding") )
+		return nullptr;
+
+	if ( encoding == VALUE_INLINE )
+		{
+		auto v = new Value;
+
+		if ( v->Read(fmt) )
+			return v;
+
+		delete v;
+		return nullptr;
+		}
+
+	if ( encoding != VALUE_DICT )
+		return nullptr;
+
+	int type;
+	uint32_t index;
+
+	if ( ! (fmt->Read(&type, "type") && fmt->Read(&index, "index")) )
+		return nullptr;
+
+	auto tag = static_cast<zeek::TypeTag>(type);
+
+	if ( ! is_string_type(tag) || index >= dict.size() )
+		return nullptr;
+
+	const auto& s = dict[index];
+	auto v = new Value(tag);
+	v->val.string_val.data = new char[s.size() + 1];
+	v->val.string_val.length = s.size();
+	memcpy(v->val.string_val.data, s.data(), s.size());
+	v->val.string_val.data[s.size()] = '\0';
+	return v;
+	}
+
+static void delete_records(int num_fields, std::vector<Value**>* records)
+	{
+	for ( auto vals : *records )
+		{
+		for ( int i = 0; i < num_fields; ++i )
+			delete vals[i];
+
+		delete [] vals;
+		}
+
+	records->clear();
+	}
+
+bool decode_log_batch(const std::string& data, int* num_fields,
+                      std::vector<Value**>* records)
+	{
+	BinarySerializationFormat fmt;
+	fmt.StartRead(data.data(), data.size());
+
+	char magic, version;
+	int n;
+	uint32_t num_records, dict_size;
+
+	if ( ! (fmt.Read(&magic, "magic") && magic == batch_magic &&
+	        fmt.Read(&version, "version") && version == batch_version &&
+	        fmt.Read(&n, "num_fields") &&
+	        fmt.Read(&num_records, "num_records") &&
+	        fmt.Read(&dict_size, "dict_size")) )
+		return false;
+
+	// Every value takes at least a byte, which bounds what a batch of
+	// this size can claim to hold.
+	if ( n <= 0 || num_records > data.size() / n || dict_size > data.size() )
+		return false;
+
+	std::vector<std::string> dict(dict_size);
+
+	for ( auto& s : dict )
+		if ( ! fmt.Read(&s, "string") )
+			return false;
+
+	records->reserve(num_records);
+
+	for ( uint32_t i = 0; i < num_records; ++i )
+		{
+		auto vals = new Value*[n];
+		std::fill(vals, vals + n, nullptr);
+		records->push_back(vals);
+		}
+
+	std::string column;
+
+	for ( int f = 0; f < n; ++f )
+		{
+		if ( ! fmt.Read(&column, "column") )
+			{
+			delete_records(n, records);
+			return false;
+			}
+
+		BinarySerializationFormat cfmt;
+		cfmt.StartRead(column.data(), column.size());
+
+		for ( auto vals : *records )
+			{
+			vals[f] = read_value(&cfmt, dict);
+
+			if ( ! vals[f] )
+				{
+				delete_records(n, records);
+				return false;
+				}
+			}
+
+		cfmt.EndRead();
+		}
+
+	fmt.EndRead();
+	*num_fields = n;
+	return true;
+	}
+
+} // namespace bro_broker
@@ -0,0 +1,75 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SerializationFormat.h"
+
+namespace threading { struct Value; }
+
+namespace bro_broker {
+
+/**
+ * Collects the log records of one writer and path for sending them to a
+ * remote logger as a single columnar batch. Each field's values get
+ * serialized next to each other, and every distinct string value is sent
+ * only once, in a dictionary the values refer to by index.
+ */
+class LogBatchEncoder {
+public:
+	/**
+	 * Constructor.
+	 * @param num_fields the number of fields of each record.
+	 */
+	explicit LogBatchEncoder(int num_fields);
+
+	/**
+	 * Appends a record to the batch.
+	 * @param vals the record's *num_fields* values.
+	 * @return false if a value failed to serialize.
+	 */
+	bool Add(const threading::Value* const* vals);
+
+	/**
+	 * @return the number of records in the batch.
+	 */
+	size_t Size() const	{ return num_records; }
+
+	/**
+	 * Serializes the batch and resets it to empty.
+	 * @param rval receives the serialized batch.
+	 */
+	void Finish(std::string* rval);
+
+private:
+	bool WriteValue(BinarySerializationFormat* fmt, const threading::Value* v);
+
+	int num_fields;
+	size_t num_records = 0;
+	std::vector<std::string> columns;
+	std::unordered_map<std::string, uint32_t> dict_index;
+	std::vector<const std::string*> dict;
+};
+
+/**
+ * @return true if the serialized data of a remote log write holds a batch
+ * created by LogBatchEncoder rather than a single record.
+ */
+bool is_log_batch(const std::string& data);
+
+/**
+ * Unpacks a batch created by LogBatchEncoder.
+ * @param data the serialized batch.
+ * @param num_fields receives the number of fields of each record.
+ * @param records receives the records. The caller takes ownership of
+ * them and their values.
+ * @return false if the batch is corrupt, in which case *records* is left
+ * empty.
+ */
+bool decode_log_batch(const std::string& data, int* num_fields,
+                      std::vector<threading::Value**>* records);
+
+} // namespace bro_broker
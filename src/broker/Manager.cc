@@ -1,11 +1,19 @@
+#include "zeek-config.h"
 #include "Manager.h"
 
 #include <broker/broker.hh>
 #include <broker/zeek.hh>
+#include <caf/binary_deserializer.hpp>
+#include <caf/binary_serializer.hpp>
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
 #include <unistd.h>
 
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+
 #include "Func.h"
 #include "Data.h"
 #include "Store.h"
@@ -38,6 +46,89 @@ static inline zeek::Val* get_option(const char* option)
 	return id->GetVal().get();
 	}
 
+// Compressed event batches travel as a vector of the protocol version, a
+// message type that Broker's own ones don't use, the size of the serialized
+// batch, and its LZ4 frame.
+static constexpr broker::count compressed_batch_type = 1000;
+
+// Guards against absurd claims about the size a batch decompresses to.
+static constexpr broker::count max_decompressed_batch_size = 1 << 30;
+
+static bool is_compressed_batch(const broker::data& msg)
+	{
+	auto v = caf::get_if<broker::vector>(&msg);
+
+	if ( ! v || v->size() != 4 )
+		return false;
+
+	auto version = caf::get_if<broker::count>(&(*v)[0]);
+	auto type = caf::get_if<broker::count>(&(*v)[1]);
+
+	return version && type && *version == broker::zeek::ProtocolVersion &&
+	       *type == compressed_batch_type;
+	}
+
+#ifdef USE_LZ4
+static bool compress_batch(const broker::vector& batch, broker::data* rval,
+                           size_t* serialized_size, size_t* compressed_size)
+	{
+	std::vector<char> buf;
+	caf::binary_serializer sink{nullptr, buf};
+
+	if ( sink(batch) )
+		return false;
+
+	LZ4F_preferences_t prefs;
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.frameInfo.contentSize = buf.size();
+
+	std::string frame(LZ4F_compressFrameBound(buf.size(), &prefs), '\0');
+	size_t n = LZ4F_compressFrame(&frame[0], frame.size(), buf.data(), buf.size(), &prefs);
+
+	if ( LZ4F_isError(n) )
+		return false;
+
+	frame.resize(n);
+	*serialized_size = buf.size();
+	*compressed_size = n;
+	*rval = broker::vector{broker::zeek::ProtocolVersion, compressed_batch_type,
+	                       static_cast<broker::count>(buf.size()), std::move(frame)};
+	return true;
+	}
+#endif
+
+static bool decompress_batch(const broker::data& msg, broker::vector* rval)
+	{
+#ifdef USE_LZ4
+	const auto& v = *caf::get_if<broker::vector>(&msg);
+	auto size = caf::get_if<broker::count>(&v[2]);
+	auto frame = caf::get_if<std::string>(&v[3]);
+
+	if ( ! size || ! frame || *size > max_decompressed_batch_size )
+		return false;
+
+	LZ4F_dctx* dctx;
+
+	if ( LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)) )
+		return false;
+
+	std::vector<char> buf(*size);
+	size_t dst_len = buf.size();
+	size_t src_len = frame->size();
+	size_t n = LZ4F_decompress(dctx, buf.data(), &dst_len, frame->data(), &src_len, nullptr);
+	LZ4F_freeDecompressionContext(dctx);
+
+	// Anything but a single complete frame of the announced size is corrupt.
+	if ( n != 0 || dst_len != buf.size() || src_len != frame->size() )
+		return false;
+
+	caf::binary_deserializer source{nullptr, buf.data(), buf.size()};
+	return ! source(*rval);
+#else
+	return false;
+#endif
+	}
+
 class BrokerConfig : public broker::configuration {
 public:
 	BrokerConfig(broker::broker_options options)
@@ -132,6 +223,11 @@ Manager::Manager(bool arg_use_real_time)
 	after_zeek_init = false;
 	peer_count = 0;
 	log_batch_size = 0;
+	event_batch_size = 0;
+	compress_event_batches = false;
+	columnar_log_batches = false;
+	compress_log_batches = false;
+	coalesce_store_updates = false;
 	log_topic_func = nullptr;
 	log_id_type = nullptr;
 	writer_id_type = nullptr;
@@ -146,6 +242,32 @@ void Manager::InitPostScript()
 	DBG_LOG(DBG_BROKER, "Initializing");
 
 	log_batch_size = get_option("Broker::log_batch_size")->AsCount();
+	event_batch_size = get_option("Broker::event_batch_size")->AsCount();
+	compress_event_batches = get_option("Broker::compress_event_batches")->AsBool();
+
+#ifndef USE_LZ4
+	if ( compress_event_batches )
+		{
+		reporter->Warning("Broker::compress_event_batches requires LZ4 support, "
+		                  "sending event batches uncompressed");
+		compress_event_batches = false;
+		}
+#endif
+
+	columnar_log_batches = get_option("Broker::columnar_log_batches")->AsBool();
+	compress_log_batches = get_option("Broker::compress_log_batches")->AsBool();
+
+#ifndef USE_LZ4
+	if ( compress_log_batches )
+		{
+		reporter->Warning("Broker::compress_log_batches requires LZ4 support, "
+		                  "sending log batches uncompressed");
+		compress_log_batches = false;
+		}
+#endif
+
+	coalesce_store_updates = get_option("Broker::table_store_flush_interval")->AsInterval() > 0;
+
 	default_log_topic_prefix =
 	    get_option("Broker::default_log_topic_prefix")->AsString()->CheckString();
 	log_topic_func = get_option("Broker::log_topic")->AsFunc();
@@ -266,6 +388,8 @@ void Manager::InitializeBrokerStoreForwarding()
 
 void Manager::Terminate()
 	{
+	FlushEventBuffers();
+	FlushStoreUpdates();
 	FlushLogBuffers();
 
 	iosource_mgr->UnregisterFd(bstate->subscriber.fd(), this);
@@ -338,7 +462,10 @@ void Manager::ClearStores()
 	FlushPendingQueries();
 
 	for ( const auto& [name, handle] : data_stores )
+		{
+		DiscardStoreUpdates(handle);
 		handle->store.clear();
+		}
 	}
 
 uint16_t Manager::Listen(const string& addr, uint16_t port)
@@ -396,6 +523,7 @@ void Manager::Unpeer(const string& addr, uint16_t port)
 	DBG_LOG(DBG_BROKER, "Stopping to peer with %s:%" PRIu16,
 		addr.c_str(), port);
 
+	FlushEventBuffers();
 	FlushLogBuffers();
 	bstate->endpoint.unpeer_nosync(addr, port);
 	}
@@ -424,11 +552,208 @@ bool Manager::PublishEvent(string topic, std::string name, broker::vector args)
 	DBG_LOG(DBG_BROKER, "Publishing event: %s",
 		RenderEvent(topic, name, args).c_str());
 	broker::zeek::Event ev(std::move(name), std::move(args));
+
+	if ( event_batch_size > 1 )
+		{
+		auto& pending_batch = event_buffers[topic];
+		pending_batch.emplace_back(ev.move_data());
+		++statistics.num_events_queued;
+
+		if ( pending_batch.size() >= event_batch_size )
+			{
+			broker::vector batch;
+			batch.reserve(event_batch_size);
+			pending_batch.swap(batch);
+			PublishEventBatch(topic, std::move(batch));
+			}
+
+		return true;
+		}
+
 	bstate->endpoint.publish(move(topic), ev.move_data());
 	++statistics.num_events_outgoing;
 	return true;
 	}
 
+void Manager::PublishEventBatch(const std::string& topic, broker::vector batch)
+	{
+	statistics.num_events_queued -= batch.size();
+
+	if ( bstate->endpoint.is_shutdown() )
+		return;
+
+	DBG_LOG(DBG_BROKER, "Publishing batch of %zu events to %s",
+	        batch.size(), topic.c_str());
+	statistics.num_events_outgoing += batch.size();
+	++statistics.num_event_batches_outgoing;
+
+#ifdef USE_LZ4
+	if ( compress_event_batches )
+		{
+		broker::data msg;
+		size_t serialized_size, compressed_size;
+
+		if ( compress_batch(batch, &msg, &serialized_size, &compressed_size) )
+			{
+			statistics.num_batch_bytes_outgoing += serialized_size;
+			statistics.num_compressed_bytes_outgoing += compressed_size;
+			bstate->endpoint.publish(topic, std::move(msg));
+			return;
+			}
+
+		reporter->Warning("failed to compress batch of events to %s, "
+		                  "sending it uncompressed", topic.c_str());
+		}
+#endif
+
+	broker::zeek::Batch msg(std::move(batch));
+	bstate->endpoint.publish(topic, msg.move_data());
+	}
+
+size_t Manager::FlushEventBuffers()
+	{
+	size_t rval = 0;
+
+	for ( auto& kv : event_buffers )
+		{
+		auto& pending_batch = kv.second;
+
+		if ( pending_batch.empty() )
+			continue;
+
+		broker::vector batch;
+		batch.reserve(event_batch_size);
+		pending_batch.swap(batch);
+		rval += batch.size();
+		PublishEventBatch(kv.first, std::move(batch));
+		}
+
+	return rval;
+	}
+
+void Manager::StorePut(StoreHandleVal* handle, broker::data key, broker::data value,
+                       broker::optional<broker::timespan> expiry)
+	{
+	bool batch = handle->BatchesWrites();
+
+	if ( ! (coalesce_store_updates || batch) )
+		{
+		handle->store.put(std::move(key), std::move(value), expiry);
+		return;
+		}
+
+	auto& updates = store_updates[handle->store.name()];
+	auto& u = updates[std::move(key)];
+	u.erase = false;
+	u.value = std::move(value);
+	u.expiry = expiry;
+
+	if ( batch )
+		CheckStoreWriteBatch(handle, updates.size());
+	}
+
+void Manager::StoreErase(StoreHandleVal* handle, broker::data key)
+	{
+	bool batch = handle->BatchesWrites();
+
+	if ( ! (coalesce_store_updates || batch) )
+		{
+		handle->store.erase(std::move(key));
+		return;
+		}
+
+	auto& updates = store_updates[handle->store.name()];
+	auto& u = updates[std::move(key)];
+	u.erase = true;
+	u.value = broker::data();
+	u.expiry = {};
+
+	if ( batch )
+		CheckStoreWriteBatch(handle, updates.size());
+	}
+
+void Manager::CheckStoreWriteBatch(StoreHandleVal* handle, size_t pending)
+	{
+	if ( handle->write_batch_ops && pending >= handle->write_batch_ops )
+		{
+		FlushStoreUpdates(handle);
+		return;
+		}
+
+	if ( handle->write_batch_delay && ! handle->write_batch_deadline )
+		{
+		handle->write_batch_deadline = network_time + handle->write_batch_delay;
+		++pending_write_batches;
+		}
+	}
+
+void Manager::SetStoreWriteBatching(StoreHandleVal* handle, size_t max_ops, double max_delay)
+	{
+	// Whatever is held back goes out under the old settings.
+	FlushStoreUpdates(handle);
+
+	handle->write_batch_ops = max_ops;
+	handle->write_batch_delay = max_delay;
+	}
+
+void Manager::FlushStoreUpdates(StoreHandleVal* handle, const broker::data& key)
+	{
+	auto it = store_updates.find(handle->store.name());
+
+	if ( it != store_updates.end() && it->second.count(key) )
+		FlushStoreUpdates(handle);
+	}
+
+void Manager::DiscardStoreUpdates(StoreHandleVal* handle)
+	{
+	store_updates.erase(handle->store.name());
+
+	if ( handle->write_batch_deadline )
+		{
+		handle->write_batch_deadline = 0;
+		--pending_write_batches;
+		}
+	}
+
+size_t Manager::FlushStoreUpdates(StoreHandleVal* handle)
+	{
+	if ( handle->write_batch_deadline )
+		{
+		handle->write_batch_deadline = 0;
+		--pending_write_batches;
+		}
+
+	auto it = store_updates.find(handle->store.name());
+
+	if ( it == store_updates.end() )
+		return 0;
+
+	// Updates of different keys are independent, so they may go out in
+	// any order.
+	auto updates = std::move(it->second);
+	store_updates.erase(it);
+
+	for ( auto& [key, u] : updates )
+		{
+		if ( u.erase )
+			handle->store.erase(key);
+		else
+			handle->store.put(key, std::move(u.value), u.expiry);
+		}
+
+	return updates.size();
+	}
+
+size_t Manager::FlushStoreUpdates()
+	{
+	size_t rval = 0;
+
+	for ( auto& s : data_stores )
+		rval += FlushStoreUpdates(s.second);
+
+	return rval;
+	}
+
 bool Manager::PublishEvent(string topic, zeek::RecordVal* args)
 	{
 	if ( bstate->endpoint.is_shutdown() )
@@ -577,32 +902,35 @@ bool Manager::PublishLogWrite(zeek::EnumVal* stream, zeek::EnumVal* writer, stri
 		return false;
 		}
 
-	BinarySerializationFormat fmt;
-	char* data;
-	int len;
-
-	fmt.StartWrite();
+	std::string serial_data;
 
-	bool success = fmt.Write(num_fields, "num_fields");
-
-	if ( ! success )
+	// Columnar batches serialize their records when they get added.
+	if ( ! columnar_log_batches )
 		{
-		reporter->Error("Failed to remotely log stream %s: num_fields serialization failed", stream_id);
-		return false;
-		}
+		// The format's buffer gets reused across writes, saving an
+		// allocation of its initial size for each one.
+		auto& fmt = log_write_fmt;
+		fmt.StartWrite();
 
-	for ( int i = 0; i < num_fields; ++i )
-		{
-		if ( ! vals[i]->Write(&fmt) )
+		bool success = fmt.Write(num_fields, "num_fields");
+
+		if ( ! success )
 			{
-			reporter->Error("Failed to remotely log stream %s: field %d serialization failed", stream_id, i);
+			reporter->Error("Failed to remotely log stream %s: num_fields serialization failed", stream_id);
 			return false;
 			}
-		}
 
-	len = fmt.EndWrite(&data);
-	std::string serial_data(data, len);
-	free(data);
+		for ( int i = 0; i < num_fields; ++i )
+			{
+			if ( ! vals[i]->Write(&fmt) )
+				{
+				reporter->Error("Failed to remotely log stream %s: field %d serialization failed", stream_id, i);
+				return false;
+				}
+			}
+
+		fmt.EndWrite(&serial_data);
+		}
 
 	auto v = log_topic_func->Invoke(zeek::IntrusivePtr{zeek::NewRef{}, stream},
 	                                zeek::make_intrusive<zeek::StringVal>(path));
@@ -617,28 +945,57 @@ bool Manager::PublishLogWrite(zeek::EnumVal* stream, zeek::EnumVal* writer, stri
 
 	std::string topic = v->AsString()->CheckString();
 
-	auto bstream_id = broker::enum_value(move(stream_id));
-	auto bwriter_id = broker::enum_value(move(writer_id));
-	broker::zeek::LogWrite msg(move(bstream_id), move(bwriter_id), move(path),
-	                          move(serial_data));
-
-	DBG_LOG(DBG_BROKER, "Buffering log record: %s", RenderMessage(topic, msg.as_data()).c_str());
-
 	if ( log_buffers.size() <= (unsigned int)stream_id_num )
 		log_buffers.resize(stream_id_num + 1);
 
 	auto& lb = log_buffers[stream_id_num];
+
+	if ( columnar_log_batches )
+		{
+		auto key = std::make_tuple(topic, std::string(writer_id), path);
+		auto it = lb.columns.find(key);
+
+		if ( it == lb.columns.end() )
+			{
+			LogColumns columns{broker::enum_value(stream_id),
+			                   broker::enum_value(writer_id),
+			                   path, LogBatchEncoder(num_fields)};
+			it = lb.columns.emplace(std::move(key), std::move(columns)).first;
+			}
+
+		if ( ! it->second.encoder.Add(vals) )
+			{
+			reporter->Error("Failed to remotely log stream %s: field serialization failed", stream_id);
+			return false;
+			}
+
+		DBG_LOG(DBG_BROKER, "Buffering log record for %s at %s in columns",
+		        stream_id, path.data());
+		}
+	else
+		{
+		auto bstream_id = broker::enum_value(move(stream_id));
+		auto bwriter_id = broker::enum_value(move(writer_id));
+		broker::zeek::LogWrite msg(move(bstream_id), move(bwriter_id), move(path),
+		                          move(serial_data));
+
+		DBG_LOG(DBG_BROKER, "Buffering log record: %s", RenderMessage(topic, msg.as_data()).c_str());
+
+		auto& pending_batch = lb.msgs[topic];
+		pending_batch.emplace_back(msg.move_data());
+		}
+
 	++lb.message_count;
-	auto& pending_batch = lb.msgs[topic];
-	pending_batch.emplace_back(msg.move_data());
 
 	if ( lb.message_count >= log_batch_size )
-		statistics.num_logs_outgoing += lb.Flush(bstate->endpoint, log_batch_size);
+		statistics.num_logs_outgoing += lb.Flush(bstate->endpoint, log_batch_size,
+		                                         compress_log_batches);
 
 	return true;
 	}
 
-size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_size)
+size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_size,
+                                 bool compress)
 	{
 	if ( endpoint.is_shutdown() )
 		return 0;
@@ -647,6 +1004,20 @@ size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_si
 		// No logs buffered for this stream.
 		return 0;
 
+	for ( auto& kv : columns )
+		{
+		auto& c = kv.second;
+
+		if ( ! c.encoder.Size() )
+			continue;
+
+		std::string serial_data;
+		c.encoder.Finish(&serial_data);
+		broker::zeek::LogWrite msg(c.stream_id, c.writer_id, c.path,
+		                           std::move(serial_data));
+		msgs[std::get<0>(kv.first)].emplace_back(msg.move_data());
+		}
+
 	for ( auto& kv : msgs )
 		{
 		auto& topic = kv.first;
@@ -654,6 +1025,24 @@ size_t Manager::LogBuffer::Flush(broker::endpoint& endpoint, size_t log_batch_si
 		broker::vector batch;
 		batch.reserve(log_batch_size + 1);
 		pending_batch.swap(batch);
+
+#ifdef USE_LZ4
+		if ( compress )
+			{
+			broker::data msg;
+			size_t serialized_size, compressed_size;
+
+			if ( compress_batch(batch, &msg, &serialized_size, &compressed_size) )
+				{
+				endpoint.publish(topic, std::move(msg));
+				continue;
+				}
+
+			reporter->Warning("failed to compress batch of logs to %s, "
+			                  "sending it uncompressed", topic.c_str());
+			}
+#endif
+
 		broker::zeek::Batch msg(std::move(batch));
 		endpoint.publish(topic, msg.move_data());
 		}
@@ -669,7 +1058,7 @@ size_t Manager::FlushLogBuffers()
 	auto rval = 0u;
 
 	for ( auto& lb : log_buffers )
-		rval += lb.Flush(bstate->endpoint, log_batch_size);
+		rval += lb.Flush(bstate->endpoint, log_batch_size, compress_log_batches);
 
 	statistics.num_logs_outgoing += rval;
 	return rval;
@@ -870,6 +1259,23 @@ bool Manager::Unsubscribe(const string& topic_prefix)
 
 void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 	{
+	if ( is_compressed_batch(msg) )
+		{
+		broker::vector batch;
+
+		if ( ! decompress_batch(msg, &batch) )
+			{
+			// Always the case if built without LZ4 support.
+			reporter->Warning("received compressed broker Batch that can't be decompressed");
+			return;
+			}
+
+		for ( auto& i : batch )
+			DispatchMessage(topic, std::move(i));
+
+		return;
+		}
+
 	switch ( broker::zeek::Message::type(msg) ) {
 	case broker::zeek::Message::Type::Invalid:
 		reporter->Warning("received invalid broker message: %s",
@@ -918,6 +1324,24 @@ void Manager::DispatchMessage(const broker::topic& topic, broker::data msg)
 	}
 	}
 
+double Manager::GetNextTimeout()
+	{
+	if ( ! pending_write_batches )
+		return -1;
+
+	double next = -1;
+
+	for ( const auto& s : data_stores )
+		{
+		double deadline = s.second->write_batch_deadline;
+
+		if ( deadline && (next < 0 || deadline < next) )
+			next = deadline;
+		}
+
+	return std::max(next - network_time, 0.0);
+	}
+
 void Manager::Process()
 	{
 	// Ensure that time gets update before processing broker messages, or events
@@ -925,6 +1349,17 @@ void Manager::Process()
 	if ( use_real_time )
 		net_update_time(current_time());
 
+	if ( pending_write_batches )
+		{
+		for ( auto& s : data_stores )
+			{
+			double deadline = s.second->write_batch_deadline;
+
+			if ( deadline && deadline <= network_time )
+				FlushStoreUpdates(s.second);
+			}
+		}
+
 	bool had_input = false;
 
 	auto status_msgs = bstate->status_subscriber.poll();
@@ -1147,9 +1582,9 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 	DBG_LOG(DBG_BROKER, "Process event: %s %s",
 			name.data(), RenderMessage(args).data());
 	++statistics.num_events_incoming;
-	auto handler = event_registry->Lookup(name);
+	auto remote_handler = LookupRemoteEventHandler(name);
 
-	if ( ! handler )
+	if ( ! remote_handler )
 		return;
 
 	auto& topic_string = topic.string();
@@ -1169,7 +1604,7 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 		return;
 		}
 
-	const auto& arg_types = handler->GetType(false)->ParamList()->GetTypes();
+	const auto& arg_types = *remote_handler->arg_types;
 
 	if ( arg_types.size() != args.size() )
 		{
@@ -1211,7 +1646,27 @@ void Manager::ProcessEvent(const broker::topic& topic, broker::zeek::Event ev)
 		}
 
 	if ( vl.size() == args.size() )
-		mgr.Enqueue(handler, std::move(vl), SOURCE_BROKER);
+		mgr.Enqueue(remote_handler->handler, std::move(vl), SOURCE_BROKER);
+	}
+
+const Manager::RemoteEventHandler* Manager::LookupRemoteEventHandler(const std::string& name)
+	{
+	auto it = remote_event_handlers.find(name);
+
+	if ( it != remote_event_handlers.end() )
+		return &it->second;
+
+	// Names without a handler aren't cached, as one may still be
+	// registered later.
+	auto handler = event_registry->Lookup(name);
+
+	if ( ! handler )
+		return nullptr;
+
+	const auto& arg_types = handler->GetType(false)->ParamList()->GetTypes();
+	auto& rval = remote_event_handlers[name];
+	rval = {handler, &arg_types};
+	return &rval;
 	}
 
 bool bro_broker::Manager::ProcessLogCreate(broker::zeek::LogCreate lc)
@@ -1327,6 +1782,28 @@ bool bro_broker::Manager::ProcessLogWrite(broker::zeek::LogWrite lw)
 		return false;
 		}
 
+	if ( is_log_batch(*serial_data) )
+		{
+		int num_fields;
+		std::vector<threading::Value**> records;
+
+		if ( ! decode_log_batch(*serial_data, &num_fields, &records) )
+			{
+			reporter->Warning("failed to unserialize remote log batch for stream: %s", stream_id_name.data());
+			return false;
+			}
+
+		// Each record counts like a single remote write.
+		if ( ! records.empty() )
+			statistics.num_logs_incoming += records.size() - 1;
+
+		for ( auto vals : records )
+			log_mgr->WriteFromRemote(stream_id->AsEnumVal(), writer_id->AsEnumVal(),
+			                         *path, num_fields, vals);
+
+		return true;
+		}
+
 	BinarySerializationFormat fmt;
 	fmt.StartRead(serial_data->data(), serial_data->size());
 
@@ -1710,6 +2187,7 @@ bool Manager::CloseStore(const string& name)
 	if ( s == data_stores.end() )
 		return false;
 
+	FlushStoreUpdates(s->second);
 	iosource_mgr->UnregisterFd(s->second->proxy.mailbox().descriptor(), this);
 
 	for ( auto i = pending_queries.begin(); i != pending_queries.end(); )
@@ -14,11 +14,15 @@
 #include <broker/detail/hash.hh>
 #include <broker/zeek.hh>
 
+#include <map>
 #include <memory>
 #include <string>
+#include <tuple>
 #include <unordered_map>
 
 #include "IntrusivePtr.h"
+#include "SerializationFormat.h"
+#include "broker/LogBatch.h"
 #include "iosource/IOSource.h"
 #include "logging/WriterBackend.h"
 
@@ -26,10 +30,14 @@ ZEEK_FORWARD_DECLARE_NAMESPACED(Func, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(Frame, zeek::detail);
 ZEEK_FORWARD_DECLARE_NAMESPACED(VectorType, zeek);
 ZEEK_FORWARD_DECLARE_NAMESPACED(TableVal, zeek);
+ZEEK_FORWARD_DECLARE_NAMESPACED(Type, zeek);
+
+class EventHandler;
 
 namespace zeek {
 using VectorTypePtr = zeek::IntrusivePtr<zeek::VectorType>;
 using TableValPtr = zeek::IntrusivePtr<zeek::TableVal>;
+using TypePtr = zeek::IntrusivePtr<zeek::Type>;
 }
 
 namespace bro_broker {
@@ -60,6 +68,15 @@ struct Stats {
 	size_t num_ids_incoming = 0;
 	// Number of total identifiers sent.
 	size_t num_ids_outgoing = 0;
+	// Number of events currently waiting to be sent in a batch.
+	size_t num_events_queued = 0;
+	// Number of total event batches sent.
+	size_t num_event_batches_outgoing = 0;
+	// Number of total serialized bytes of event batches that got
+	// compressed before sending.
+	size_t num_batch_bytes_outgoing = 0;
+	// Number of total bytes these compressed to.
+	size_t num_compressed_bytes_outgoing = 0;
 };
 
 /**
@@ -315,6 +332,26 @@ public:
 	 */
 	bool AddForwardedStore(const std::string& name, zeek::TableValPtr table);
 
+	/**
+	 * Puts a key into a data store on behalf of a table backed by it. If
+	 * Broker::table_store_flush_interval is set, the update gets held back
+	 * until the next flush, replacing any earlier one of the same key.
+	 * @param handle the data store.
+	 * @param key the key to put.
+	 * @param value the value to associate with the key.
+	 * @param expiry the time after which the key expires, if any.
+	 */
+	void StorePut(StoreHandleVal* handle, broker::data key, broker::data value,
+	              broker::optional<broker::timespan> expiry);
+
+	/**
+	 * Erases a key from a data store on behalf of a table backed by it.
+	 * Like StorePut(), this may get held back until the next flush.
+	 * @param handle the data store.
+	 * @param key the key to erase.
+	 */
+	void StoreErase(StoreHandleVal* handle, broker::data key);
+
 	/**
 	 * Close and unregister a data store.  Any existing references to the
 	 * store handle will not be able to be used for any data store operations.
@@ -337,6 +374,54 @@ public:
 	 */
 	size_t FlushLogBuffers();
 
+	/**
+	 * Send all pending event batches.
+	 * @return the number of events sent.
+	 */
+	size_t FlushEventBuffers();
+
+	/**
+	 * Send all held back updates of data stores backing tables.
+	 * @return the number of updates sent.
+	 */
+	size_t FlushStoreUpdates();
+
+	/**
+	 * Send a data store's held back updates, whether they're from a
+	 * table backed by it or write batching.
+	 * @param handle the store.
+	 * @return the number of updates sent.
+	 */
+	size_t FlushStoreUpdates(StoreHandleVal* handle);
+
+	/**
+	 * Send a data store's held back updates if one of them is for the
+	 * given key, so that an operation on the key sees it.
+	 * @param handle the store.
+	 * @param key the key about to be operated on.
+	 */
+	void FlushStoreUpdates(StoreHandleVal* handle, const broker::data& key);
+
+	/**
+	 * Drop a data store's held back updates, for when it's about to be
+	 * cleared anyway.
+	 * @param handle the store.
+	 */
+	void DiscardStoreUpdates(StoreHandleVal* handle);
+
+	/**
+	 * Hold back puts and erases of a data store, to send only the latest
+	 * one per key once enough have accumulated or the first has waited
+	 * long enough. Other operations on a key with a held back update,
+	 * and queries of all keys, send the updates first.
+	 * @param handle the store.
+	 * @param max_ops the number of keys with held back updates at which
+	 * they get sent. Zero means no limit.
+	 * @param max_delay the most time an update may be held back. Zero
+	 * means no limit.
+	 */
+	void SetStoreWriteBatching(StoreHandleVal* handle, size_t max_ops, double max_delay);
+
 	/**
 	 * Flushes all pending data store queries and also clears all contents.
 	 */
@@ -365,9 +450,22 @@ private:
 	// Common functionality for processing insert and update events.
 	void ProcessStoreEventInsertUpdate(const zeek::TableValPtr& table, const std::string& store_id, const broker::data& key, const broker::data& data, const broker::data& old_value, bool insert);
 	void ProcessEvent(const broker::topic& topic, broker::zeek::Event ev);
+
+	// A local handler of remote events, along with the types their
+	// arguments convert to.
+	struct RemoteEventHandler {
+		EventHandler* handler;
+		const std::vector<zeek::TypePtr>* arg_types;
+	};
+
+	// Returns the handler of an incoming event, or nullptr if there is
+	// none. Caches what it finds.
+	const RemoteEventHandler* LookupRemoteEventHandler(const std::string& name);
 	bool ProcessLogCreate(broker::zeek::LogCreate lc);
 	bool ProcessLogWrite(broker::zeek::LogWrite lw);
 	bool ProcessIdentifierUpdate(broker::zeek::IdentifierUpdate iu);
+	// Sends a batch of event messages, compressing it if configured.
+	void PublishEventBatch(const std::string& topic, broker::vector batch);
 	void ProcessStatus(broker::status stat);
 	void ProcessError(broker::error err);
 	void ProcessStoreResponse(StoreHandleVal*, broker::store::response response);
@@ -386,14 +484,25 @@ private:
 	// IOSource interface overrides:
 	void Process() override;
 	const char* Tag() override	{ return "Broker::Manager"; }
-	double GetNextTimeout() override	{ return -1; }
+	double GetNextTimeout() override;
+
+	// The records of one writer and path, collected column by column.
+	struct LogColumns {
+		broker::enum_value stream_id;
+		broker::enum_value writer_id;
+		std::string path;
+		LogBatchEncoder encoder;
+	};
 
 	struct LogBuffer {
 		// Indexed by topic string.
 		std::unordered_map<std::string, broker::vector> msgs;
+		// Indexed by topic string, writer and path.
+		std::map<std::tuple<std::string, std::string, std::string>, LogColumns> columns;
 		size_t message_count;
 
-		size_t Flush(broker::endpoint& endpoint, size_t batch_size);
+		size_t Flush(broker::endpoint& endpoint, size_t batch_size,
+		             bool compress);
 	};
 
 	// Data stores
@@ -409,14 +518,29 @@ private:
 			}
 	};
 
+	// A held back update of a key in a data store backing a table.
+	struct StoreUpdate {
+		bool erase;
+		broker::data value;
+		broker::optional<broker::timespan> expiry;
+	};
+
+	// Sends a store's held back updates if it batches writes and now has
+	// enough of them, else makes sure they'll go out in time.
+	void CheckStoreWriteBatch(StoreHandleVal* handle, size_t pending);
+
 	std::vector<LogBuffer> log_buffers; // Indexed by stream ID enum.
+	BinarySerializationFormat log_write_fmt;
+	std::unordered_map<std::string, broker::vector> event_buffers; // Indexed by topic string.
 	std::string default_log_topic_prefix;
 	std::shared_ptr<BrokerState> bstate;
 	std::unordered_map<std::string, StoreHandleVal*> data_stores;
+	std::unordered_map<std::string, std::map<broker::data, StoreUpdate>> store_updates; // Indexed by store name.
 	std::unordered_map<std::string, zeek::TableValPtr> forwarded_stores;
 	std::unordered_map<query_id, StoreQueryCallback*,
 	                   query_id_hasher> pending_queries;
 	std::vector<std::string> forwarded_prefixes;
+	std::unordered_map<std::string, RemoteEventHandler> remote_event_handlers; // Indexed by event name.
 
 	Stats statistics;
 
@@ -426,6 +550,12 @@ private:
 	int peer_count;
 
 	size_t log_batch_size;
+	size_t event_batch_size;
+	bool compress_event_batches;
+	bool columnar_log_batches;
+	bool compress_log_batches;
+	bool coalesce_store_updates;
+	int pending_write_batches = 0; // Stores with a write batch deadline.
 	zeek::Func* log_topic_func;
 	zeek::VectorTypePtr vector_of_data_type;
 	zeek::EnumType* log_id_type;
@@ -0,0 +1,336 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "Snapshot.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <caf/binary_deserializer.hpp>
+#include <caf/binary_serializer.hpp>
+
+#include "Data.h"
+#include "Desc.h"
+#include "Dict.h"
+#include "Net.h"
+#include "Val.h"
+
+namespace bro_broker {
+
+// Written at the start of the file, followed by the format version, the
+// table's type, and the number of entries. Each entry then follows as a
+// length and a serialized broker::vector of the index, the value (none
+// for sets), and the seconds since the entry's last expiration relevant
+// access. Integers are stored in host byte order; snapshots aren't meant
+// to move between architectures.
+static constexpr char snapshot_magic[8] = { 'Z', 'E', 'E', 'K', 'T', 'B', 'L', 'S' };
+static constexpr uint32_t snapshot_version = 1;
+
+static std::string type_description(zeek::TableVal* table)
+	{
+	ODesc d;
+	table->GetType()->Describe(&d);
+	return d.Description();
+	}
+
+static bool entry_to_data(zeek::TableVal* table, const HashKey& k,
+                          const zeek::TableEntryVal* entry, broker::vector* rval)
+	{
+	auto lv = table->RecreateIndex(k);
+	broker::vector index;
+	index.reserve(lv->Length());
+
+	for ( const auto& part : lv->Vals() )
+		{
+		auto d = val_to_data(part.get());
+
+		if ( ! d )
+			return false;
+
+		index.emplace_back(std::move(*d));
+		}
+
+	broker::data value;
+
+	if ( entry->GetVal() )
+		{
+		auto d = val_to_data(entry->GetVal().get());
+
+		if ( ! d )
+			return false;
+
+		value = std::move(*d);
+		}
+
+	double age = std::max(network_time - entry->ExpireAccessTime(), 0.0);
+
+	rval->clear();
+	rval->emplace_back(std::move(index));
+	rval->emplace_back(std::move(value));
+	rval->emplace_back(age);
+	return true;
+	}
+
+bool save_table_snapshot(zeek::TableVal* table, const std::string& path,
+                         std::string* error)
+	{
+	// Write to a temporary file first, so that processes starting up
+	// meanwhile never see a partial one.
+	auto tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		{
+		*error = fmt("can't open %s: %s", tmp.c_str(), strerror(errno));
+		return false;
+		}
+
+	auto type = type_description(table);
+	uint32_t type_len = type.size();
+	uint32_t n = table->Size();
+
+	std::string header(snapshot_magic, sizeof(snapshot_magic));
+	header.append(reinterpret_cast<const char*>(&snapshot_version), sizeof(snapshot_version));
+	header.append(reinterpret_cast<const char*>(&type_len), sizeof(type_len));
+	header.append(type);
+	header.append(reinterpret_cast<const char*>(&n), sizeof(n));
+
+	bool ok = fwrite(header.data(), header.size(), 1, f) == 1;
+	bool convertible = true;
+
+	// Entries get serialized one at a time, so the whole snapshot never
+	// needs to be held in memory.
+	std::vector<char> buf;
+	broker::vector entry_data;
+
+	const zeek::PDict<zeek::TableEntryVal>* tbl = table->AsTable();
+	zeek::IterCookie* c = tbl->InitForIteration();
+
+	HashKey* k;
+	zeek::TableEntryVal* entry;
+
+	while ( (entry = tbl->NextEntry(k, c)) )
+		{
+		std::unique_ptr<HashKey> hk{k};
+
+		if ( ! ok || ! convertible )
+			continue;
+
+		if ( ! entry_to_data(table, *hk, entry, &entry_data) )
+			{
+			convertible = false;
+			continue;
+			}
+
+		buf.clear();
+		caf::binary_serializer sink{nullptr, buf};
+
+		if ( sink(entry_data) )
+			{
+			convertible = false;
+			continue;
+			}
+
+		uint32_t len = buf.size();
+		ok = fwrite(&len, sizeof(len), 1, f) == 1 && fwrite(buf.data(), len, 1, f) == 1;
+		}
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! convertible )
+		{
+		*error = fmt("can't convert entries of type %s", type.c_str());
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	if ( ! ok || rename(tmp.c_str(), path.c_str()) < 0 )
+		{
+		*error = fmt("can't write %s: %s", path.c_str(), strerror(errno));
+		unlink(tmp.c_str());
+		return false;
+		}
+
+	return true;
+	}
+
+static zeek::ValPtr data_to_index(zeek::TableVal* table, broker::data& d)
+	{
+	auto index = caf::get_if<broker::vector>(&d);
+	const auto& types = table->GetType()->AsTableType()->GetIndices()->GetTypes();
+
+	if ( ! index || index->size() != types.size() )
+		return nullptr;
+
+	auto lv = zeek::make_intrusive<zeek::ListVal>(zeek::TYPE_ANY);
+
+	for ( size_t i = 0; i < types.size(); ++i )
+		{
+		auto part = data_to_val(std::move((*index)[i]), types[i].get());
+
+		if ( ! part )
+			return nullptr;
+
+		lv->Append(std::move(part));
+		}
+
+	return lv;
+	}
+
+static bool get_uint32(const char** p, const char* end, uint32_t* v)
+	{
+	if ( static_cast<size_t>(end - *p) < sizeof(*v) )
+		return false;
+
+	memcpy(v, *p, sizeof(*v));
+	*p += sizeof(*v);
+	return true;
+	}
+
+static bool load_entries(zeek::TableVal* table, const char* p, const char* end,
+                         uint32_t num_entries)
+	{
+	bool is_set = table->GetType()->IsSet();
+	const auto& yield = table->GetType()->Yield();
+
+	for ( uint32_t i = 0; i < num_entries; ++i )
+		{
+		uint32_t len;
+
+		if ( ! get_uint32(&p, end, &len) || static_cast<size_t>(end - p) < len )
+			return false;
+
+		broker::vector entry_data;
+		caf::binary_deserializer source{nullptr, p, len};
+		p += len;
+
+		if ( source(entry_data) || entry_data.size() != 3 )
+			return false;
+
+		auto age = caf::get_if<double>(&entry_data[2]);
+		auto index = data_to_index(table, entry_data[0]);
+		zeek::ValPtr value;
+
+		if ( ! is_set )
+			value = data_to_val(std::move(entry_data[1]), yield.get());
+
+		if ( ! age || ! index || (! is_set && ! value) )
+			return false;
+
+		auto k = table->MakeHashKey(*index);
+
+		if ( ! k )
+			return false;
+
+		HashKey lookup_key(k->Key(), k->Size(), k->Hash());
+
+		// Entries aren't forwarded to attached Broker stores, these
+		// persist themselves.
+		table->Assign(std::move(index), std::move(k), std::move(value), false);
+
+		// The assignment may have run a &on_change handler deleting
+		// the entry again.
+		if ( auto entry = table->AsTable()->Lookup(&lookup_key) )
+			entry->SetExpireAccess(network_time - *age);
+		}
+
+	return true;
+	}
+
+static bool load_snapshot(zeek::TableVal* table, const std::string& path,
+                          const char* p, const char* end, std::string* error)
+	{
+	uint32_t version, type_len, num_entries;
+
+	if ( static_cast<size_t>(end - p) < sizeof(snapshot_magic) ||
+	     memcmp(p, snapshot_magic, sizeof(snapshot_magic)) != 0 )
+		{
+		*error = fmt("%s is not a table snapshot", path.c_str());
+		return false;
+		}
+
+	p += sizeof(snapshot_magic);
+
+	if ( ! get_uint32(&p, end, &version) || version != snapshot_version ||
+	     ! get_uint32(&p, end, &type_len) || static_cast<size_t>(end - p) < type_len )
+		{
+		*error = fmt("table snapshot %s has an unsupported format", path.c_str());
+		return false;
+		}
+
+	std::string type(p, type_len);
+	p += type_len;
+
+	if ( type != type_description(table) )
+		{
+		*error = fmt("table snapshot %s is of type %s, not %s", path.c_str(),
+		             type.c_str(), type_description(table).c_str());
+		return false;
+		}
+
+	if ( ! get_uint32(&p, end, &num_entries) )
+		{
+		*error = fmt("table snapshot %s is truncated", path.c_str());
+		return false;
+		}
+
+	table->StartBulkUpdate(num_entries);
+	bool ok = load_entries(table, p, end, num_entries);
+	table->EndBulkUpdate();
+
+	if ( ! ok )
+		*error = fmt("table snapshot %s is truncated or corrupt", path.c_str());
+
+	return ok;
+	}
+
+bool load_table_snapshot(zeek::TableVal* table, const std::string& path,
+                         std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if ( fd < 0 )
+		{
+		*error = fmt("can't open %s: %s", path.c_str(), strerror(errno));
+		return false;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || st.st_size == 0 )
+		{
+		*error = fmt("can't read %s", path.c_str());
+		close(fd);
+		return false;
+		}
+
+	size_t mapping_len = st.st_size;
+	void* mapping = mmap(nullptr, mapping_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if ( mapping == MAP_FAILED )
+		{
+		*error = fmt("can't map %s: %s", path.c_str(), strerror(errno));
+		return false;
+		}
+
+	// The entries get read in order, let the kernel read ahead.
+	madvise(mapping, mapping_len, MADV_SEQUENTIAL);
+
+	auto p = static_cast<const char*>(mapping);
+	bool ok = load_snapshot(table, path, p, p + mapping_len, error);
+
+	munmap(mapping, mapping_len);
+	return ok;
+	}
+
+} // namespace bro_broker
@@ -0,0 +1,39 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(TableVal, zeek);
+
+namespace bro_broker {
+
+/**
+ * Writes all entries of a table, including how long ago each entry was
+ * last accessed for expiration purposes, into a binary snapshot file.
+ * Entries are converted with val_to_data() and serialized in Broker's
+ * binary format. The file gets written to a temporary name first and
+ * then renamed, so an existing snapshot is replaced atomically.
+ * @param table the table to save.
+ * @param path the snapshot file to write.
+ * @param error receives a description of what went wrong on failure.
+ * @return true if the snapshot was written.
+ */
+bool save_table_snapshot(zeek::TableVal* table, const std::string& path,
+                         std::string* error);
+
+/**
+ * Loads the entries of a snapshot written by save_table_snapshot() into
+ * a table, restoring their expiration state relative to the current
+ * network time. The file gets mapped into memory rather than read.
+ * Existing entries with the same index are overwritten.
+ * @param table the table to load the entries into. Its type must match
+ * the one of the table the snapshot was taken from.
+ * @param path the snapshot file to read.
+ * @param error receives a description of what went wrong on failure.
+ * @return true if the snapshot was loaded.
+ */
+bool load_table_snapshot(zeek::TableVal* table, const std::string& path,
+                         std::string* error);
+
+} // namespace bro_broker
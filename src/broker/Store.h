@@ -119,11 +119,18 @@ public:
 
 	void ValDescribe(ODesc* d) const override;
 
+	bool BatchesWrites() const
+		{ return write_batch_ops || write_batch_delay; }
+
 	broker::store store;
 	broker::store::proxy proxy;
 	broker::publisher_id store_pid;
 	// Zeek table that events are forwarded to.
 	zeek::TableValPtr forward_to;
+	// Write batching, see Manager::SetStoreWriteBatching().
+	size_t write_batch_ops = 0;
+	double write_batch_delay = 0;
+	double write_batch_deadline = 0; // When held back updates must go out, if any.
 
 protected:
 
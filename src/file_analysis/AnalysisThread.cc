@@ -0,0 +1,123 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "AnalysisThread.h"
+
+#include <string.h>
+
+#include "util.h"
+#include "file_analysis/Manager.h"
+#include "threading/Manager.h"
+
+namespace file_analysis {
+
+// Messages sent from the main thread to an analysis thread.
+
+class FeedMessage final : public threading::InputMessage<AnalysisThread>
+{
+public:
+	FeedMessage(AnalysisThread* thread, Offload* offload, const u_char* arg_data, uint64_t len)
+		: threading::InputMessage<AnalysisThread>("Feed", thread),
+		offload(offload), data(new u_char[len]), len(len)
+		{
+		memcpy(data, arg_data, len);
+		}
+
+	~FeedMessage() override	{ delete [] data; }
+
+	bool Process() override
+		{
+		offload->Feed(data, len);
+		return true;
+		}
+
+private:
+	Offload* offload;
+	u_char* data;
+	uint64_t len;
+};
+
+class GapMessage final : public threading::InputMessage<AnalysisThread>
+{
+public:
+	GapMessage(AnalysisThread* thread, Offload* offload, uint64_t len)
+		: threading::InputMessage<AnalysisThread>("Gap", thread),
+		offload(offload), len(len)
+		{}
+
+	bool Process() override
+		{
+		offload->Gap(len);
+		return true;
+		}
+
+private:
+	Offload* offload;
+	uint64_t len;
+};
+
+class DoneMessage final : public threading::InputMessage<AnalysisThread>
+{
+public:
+	DoneMessage(AnalysisThread* thread, Offload* offload, bool deliver)
+		: threading::InputMessage<AnalysisThread>("Done", thread),
+		offload(offload), deliver(deliver)
+		{}
+
+	bool Process() override;
+
+private:
+	Offload* offload;
+	bool deliver;
+};
+
+// Messages sent from an analysis thread to the main thread.
+
+class DeliverMessage final : public threading::OutputMessage<AnalysisThread>
+{
+public:
+	DeliverMessage(AnalysisThread* thread, Offload* offload, bool deliver)
+		: threading::OutputMessage<AnalysisThread>("Deliver", thread),
+		offload(offload), deliver(deliver)
+		{}
+
+	bool Process() override
+		{
+		file_mgr->OffloadDone(offload, deliver);
+		return true;
+		}
+
+private:
+	Offload* offload;
+	bool deliver;
+};
+
+bool DoneMessage::Process()
+	{
+	offload->Done();
+	Object()->SendOut(new DeliverMessage(Object(), offload, deliver));
+	return true;
+	}
+
+AnalysisThread::AnalysisThread(int num)
+	{
+	SetName(fmt("file-analysis/%d", num));
+
+	SetCPUs(thread_mgr->ThreadCPUs("Threading::file_analysis_cpus"));
+	}
+
+void AnalysisThread::Feed(Offload* o, const u_char* data, uint64_t len)
+	{
+	SendIn(new FeedMessage(this, o, data, len));
+	}
+
+void AnalysisThread::Gap(Offload* o, uint64_t len)
+	{
+	SendIn(new GapMessage(this, o, len));
+	}
+
+void AnalysisThread::Finish(Offload* o, bool deliver)
+	{
+	SendIn(new DoneMessage(this, o, deliver));
+	}
+
+} // namespace file_analysis
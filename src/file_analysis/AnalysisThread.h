@@ -0,0 +1,113 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+
+#include <sys/types.h> // for u_char
+
+#include "threading/MsgThread.h"
+
+namespace file_analysis {
+
+/**
+ * The part of a file analyzer's work that can run outside of the main
+ * thread: consuming the file's data. Analyzers feed and finish it through
+ * the file analysis manager, which runs it in an analysis thread if these
+ * are enabled (see \c Files::analysis_threads), else right away.
+ */
+class Offload {
+public:
+	/**
+	 * Constructor.
+	 * @param file_id the ID of the file that the computation belongs to.
+	 */
+	explicit Offload(std::string file_id) : file_id(std::move(file_id))	{ }
+
+	/**
+	 * Destructor. Runs in the main thread.
+	 */
+	virtual ~Offload() = default;
+
+	/**
+	 * Consumes the next chunk of the file's data. This may run in an
+	 * analysis thread, so it must not touch any state that's shared with
+	 * the main thread, including reference counts of values.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 */
+	virtual void Feed(const u_char* data, uint64_t len) = 0;
+
+	/**
+	 * Consumes a gap in the file's data. Like Feed(), this may run in an
+	 * analysis thread. The default implementation ignores it.
+	 * @param len number of bytes missing.
+	 */
+	virtual void Gap(uint64_t len)	{ }
+
+	/**
+	 * Called after all data has been fed, in the same thread as Feed(),
+	 * whether or not the results get delivered. The default
+	 * implementation does nothing.
+	 */
+	virtual void Done()	{ }
+
+	/**
+	 * Reports the results, for example by raising events. Runs in the
+	 * main thread, once all data has been fed.
+	 */
+	virtual void Deliver() = 0;
+
+	/**
+	 * @return the ID of the file that the computation belongs to.
+	 */
+	const std::string& FileID() const	{ return file_id; }
+
+private:
+	std::string file_id;
+};
+
+/**
+ * A thread running offloaded file analysis. Each file's computations go
+ * to the same thread, so that they see its data and deliver their results
+ * in order.
+ */
+class AnalysisThread final : public threading::MsgThread {
+public:
+	/**
+	 * Constructor.
+	 * @param num the thread's number, used for its name.
+	 */
+	explicit AnalysisThread(int num);
+
+	/**
+	 * Queues a chunk of data for a computation, copying it.
+	 * @param o the computation to feed.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 */
+	void Feed(Offload* o, const u_char* data, uint64_t len);
+
+	/**
+	 * Queues a gap in the data for a computation.
+	 * @param o the computation to feed.
+	 * @param len number of bytes missing.
+	 */
+	void Gap(Offload* o, uint64_t len);
+
+	/**
+	 * Queues the end of a computation. The thread sends it back to the
+	 * file analysis manager once all data queued before has been fed.
+	 * @param o the computation to finish.
+	 * @param deliver whether to deliver its results.
+	 */
+	void Finish(Offload* o, bool deliver);
+
+protected:
+	bool OnHeartbeat(double network_time, double current_time) override
+		{ return true; }
+	bool OnFinish(double network_time) override
+		{ return true; }
+};
+
+} // namespace file_analysis
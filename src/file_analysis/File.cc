@@ -13,6 +13,8 @@
 #include "Type.h"
 #include "Event.h"
 #include "RuleMatcher.h"
+#include "ConnMemory.h"
+#include "const.bif.h"
 
 #include "analyzer/Analyzer.h"
 #include "analyzer/Manager.h"
@@ -50,6 +52,7 @@ int File::seen_bytes_idx = -1;
 int File::total_bytes_idx = -1;
 int File::missing_bytes_idx = -1;
 int File::overflow_bytes_idx = -1;
+int File::reassembly_buffer_peak_idx = -1;
 int File::timeout_interval_idx = -1;
 int File::bof_buffer_size_idx = -1;
 int File::bof_buffer_idx = -1;
@@ -72,6 +75,7 @@ void File::StaticInit()
 	total_bytes_idx = Idx("total_bytes", zeek::id::fa_file);
 	missing_bytes_idx = Idx("missing_bytes", zeek::id::fa_file);
 	overflow_bytes_idx = Idx("overflow_bytes", zeek::id::fa_file);
+	reassembly_buffer_peak_idx = Idx("reassembly_buffer_peak", zeek::id::fa_file);
 	timeout_interval_idx = Idx("timeout_interval", zeek::id::fa_file);
 	bof_buffer_size_idx = Idx("bof_buffer_size", zeek::id::fa_file);
 	bof_buffer_idx = Idx("bof_buffer", zeek::id::fa_file);
@@ -83,8 +87,10 @@ void File::StaticInit()
 File::File(const std::string& file_id, const std::string& source_name, Connection* conn,
            analyzer::Tag tag, bool is_orig)
 	: id(file_id), val(nullptr), file_reassembler(nullptr), stream_offset(0),
-	  reassembly_max_buffer(0), did_metadata_inference(false),
+	  reassembly_max_buffer(0), reassembly_peak(0), did_metadata_inference(false),
 	  reassembly_enabled(false), postpone_timeout(false), done(false),
+	  delivery_limit(UINT64_MAX), limit_disables_reassembly(false),
+	  analysis_stopped(false), memory_account(nullptr), accounted_bytes(0),
 	  analyzers(this)
 	{
 	StaticInit();
@@ -111,11 +117,17 @@ File::~File()
 
 	for ( auto a : done_analyzers )
 		delete a;
+
+	if ( memory_account )
+		{
+		memory_account->Adjust(CONN_MEM_FILES, -accounted_bytes);
+		Unref(memory_account);
+		}
 	}
 
 void File::UpdateLastActivityTime()
 	{
-	val->Assign(last_active_idx, zeek::make_intrusive<zeek::TimeVal>(network_time));
+	val->Assign(last_active_idx, zeek::val_mgr->Time(network_time));
 	}
 
 double File::GetLastActivityTime() const
@@ -128,6 +140,12 @@ bool File::UpdateConnectionFields(Connection* conn, bool is_orig)
 	if ( ! conn )
 		return false;
 
+	if ( ! memory_account && conn->MemoryAccount() )
+		{
+		memory_account = conn->MemoryAccount();
+		Ref(memory_account);
+		}
+
 	zeek::Val* conns = val->GetField(conns_idx).get();
 
 	if ( ! conns )
@@ -302,6 +320,7 @@ bool File::SetMime(const std::string& mime_type)
 
 	did_metadata_inference = true;
 	bof_buffer.full = true;
+	ApplyDeliveryLimit(mime_type);
 
 	if ( ! FileEventAvailable(file_sniff) )
 		return false;
@@ -330,7 +349,8 @@ void File::InferMetadata()
 		bof_buffer_val = val->GetField(bof_buffer_idx).get();
 		}
 
-	if ( ! FileEventAvailable(file_sniff) )
+	// Delivery limits need the MIME type even if no script wants it.
+	if ( ! FileEventAvailable(file_sniff) && ! file_mgr->HaveDeliveryLimits() )
 		return;
 
 	RuleMatcher::MIME_Matches matches;
@@ -347,9 +367,49 @@ void File::InferMetadata()
 		                        *(matches.begin()->second.begin()));
 		meta->Assign(meta_mime_types_idx,
 		             file_analysis::GenMIMEMatchesVal(matches));
+		ApplyDeliveryLimit(*(matches.begin()->second.begin()));
 		}
 
-	FileEvent(file_sniff, {val, std::move(meta)});
+	if ( FileEventAvailable(file_sniff) )
+		FileEvent(file_sniff, {val, std::move(meta)});
+	}
+
+void File::ApplyDeliveryLimit(const std::string& mime_type)
+	{
+	auto limit = file_mgr->LookupDeliveryLimit(mime_type);
+
+	if ( ! limit )
+		return;
+
+	delivery_limit = limit->GetFieldOrDefault("max_bytes")->AsCount();
+	limit_disables_reassembly = limit->GetFieldOrDefault("disable_reassembly")->AsBool();
+
+	DBG_LOG(DBG_FILE_ANALYSIS, "[%s] Limiting analysis of %s file to %" PRIu64 " bytes",
+	        id.c_str(), mime_type.c_str(), delivery_limit);
+	}
+
+uint64_t File::DeliverableBytes(uint64_t offset, uint64_t len) const
+	{
+	if ( offset >= delivery_limit )
+		return 0;
+
+	return std::min(len, delivery_limit - offset);
+	}
+
+void File::StopAnalysis()
+	{
+	DBG_LOG(DBG_FILE_ANALYSIS, "[%s] Delivery limit reached, ending analysis", id.c_str());
+
+	analysis_stopped = true;
+
+	file_analysis::Analyzer* a = nullptr;
+	zeek::IterCookie* c = analyzers.InitForIteration();
+
+	while ( (a = analyzers.NextEntry(c)) )
+		{
+		if ( ! a->EndOfFile() )
+			analyzers.QueueRemove(a->Tag(), a->GetArgs());
+		}
 	}
 
 bool File::BufferBOF(const u_char* data, uint64_t len)
@@ -394,9 +454,10 @@ void File::DeliverStream(const u_char* data, uint64_t len)
 	        len > 40 ? "..." : "");
 
 	file_analysis::Analyzer* a = nullptr;
-	zeek::IterCookie* c = analyzers.InitForIteration();
+	zeek::IterCookie* c = analysis_stopped ? nullptr : analyzers.InitForIteration();
+	uint64_t deliverable = DeliverableBytes(stream_offset, len);
 
-	while ( (a = analyzers.NextEntry(c)) )
+	while ( c && (a = analyzers.NextEntry(c)) )
 		{
 		DBG_LOG(DBG_FILE_ANALYSIS, "stream delivery to analyzer %s", file_mgr->GetComponentName(a->Tag()).c_str());
 		if ( ! a->GotStreamDelivery() )
@@ -414,10 +475,12 @@ void File::DeliverStream(const u_char* data, uint64_t len)
 			// Catch this analyzer up with the BOF buffer.
 			for ( int i = 0; i < num_bof_chunks_behind; ++i )
 				{
-				if ( ! a->Skipping() )
+				uint64_t n = DeliverableBytes(bytes_delivered,
+				                              bof_buffer.chunks[i]->Len());
+
+				if ( n > 0 && ! a->Skipping() )
 					{
-					if ( ! a->DeliverStream(bof_buffer.chunks[i]->Bytes(),
-								bof_buffer.chunks[i]->Len()) )
+					if ( ! a->DeliverStream(bof_buffer.chunks[i]->Bytes(), n) )
 						{
 						a->SetSkip(true);
 						analyzers.QueueRemove(a->Tag(), a->GetArgs());
@@ -432,9 +495,9 @@ void File::DeliverStream(const u_char* data, uint64_t len)
 			// Analyzer should be fully caught up to stream_offset now.
 			}
 
-		if ( ! a->Skipping() )
+		if ( (deliverable > 0 || len == 0) && ! a->Skipping() )
 			{
-			if ( ! a->DeliverStream(data, len) )
+			if ( ! a->DeliverStream(data, deliverable) )
 				{
 				a->SetSkip(true);
 				analyzers.QueueRemove(a->Tag(), a->GetArgs());
@@ -442,6 +505,9 @@ void File::DeliverStream(const u_char* data, uint64_t len)
 			}
 		}
 
+	if ( ! analysis_stopped && stream_offset + len >= delivery_limit )
+		StopAnalysis();
+
 	stream_offset += len;
 	IncrementByteCount(len, seen_bytes_idx);
 	}
@@ -451,25 +517,17 @@ void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 	// Potentially handle reassembly and deliver to the stream analyzers.
 	if ( file_reassembler )
 		{
-		if ( reassembly_max_buffer > 0 &&
-		     reassembly_max_buffer < file_reassembler->TotalSize() )
-			{
-			uint64_t current_offset = stream_offset;
-			uint64_t gap_bytes = file_reassembler->Flush();
-			IncrementByteCount(gap_bytes, overflow_bytes_idx);
-
-			if ( FileEventAvailable(file_reassembly_overflow) )
-				{
-				FileEvent(file_reassembly_overflow, {
-					val,
-					zeek::val_mgr->Count(current_offset),
-					zeek::val_mgr->Count(gap_bytes)
-				});
-				}
-			}
+		CheckReassemblyBuffer();
 
 		// Forward data to the reassembler.
 		file_reassembler->NewBlock(network_time, offset, len, data);
+		UpdateReassemblyPeak();
+
+		// Once analysis is over there's no point in buffering out of
+		// order data anymore.  This can't happen from within the
+		// reassembler's own delivery.
+		if ( analysis_stopped && limit_disables_reassembly )
+			DisableReassembly();
 		}
 	else if ( stream_offset == offset )
 		{
@@ -483,6 +541,7 @@ void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 		// needs to be enabled.
 		file_reassembler = new FileReassembler(this, stream_offset);
 		file_reassembler->NewBlock(network_time, offset, len, data);
+		UpdateReassemblyPeak();
 		}
 	else
 		{
@@ -498,14 +557,15 @@ void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 	        len > 40 ? "..." : "");
 
 	file_analysis::Analyzer* a = nullptr;
-	zeek::IterCookie* c = analyzers.InitForIteration();
+	zeek::IterCookie* c = analysis_stopped ? nullptr : analyzers.InitForIteration();
+	uint64_t deliverable = DeliverableBytes(offset, len);
 
-	while ( (a = analyzers.NextEntry(c)) )
+	while ( c && (a = analyzers.NextEntry(c)) )
 		{
 		DBG_LOG(DBG_FILE_ANALYSIS, "chunk delivery to analyzer %s", file_mgr->GetComponentName(a->Tag()).c_str());
-		if ( ! a->Skipping() )
+		if ( (deliverable > 0 || len == 0) && ! a->Skipping() )
 			{
-			if ( ! a->DeliverChunk(data, len, offset) )
+			if ( ! a->DeliverChunk(data, deliverable, offset) )
 				{
 				a->SetSkip(true);
 				analyzers.QueueRemove(a->Tag(), a->GetArgs());
@@ -517,6 +577,62 @@ void File::DeliverChunk(const u_char* data, uint64_t len, uint64_t offset)
 		EndOfFile();
 	}
 
+void File::CheckReassemblyBuffer()
+	{
+	uint64_t size = file_reassembler->TotalSize();
+	uint64_t total_max = zeek::BifConst::Files::total_reassembly_buffer_size;
+
+	bool file_full = reassembly_max_buffer > 0 && reassembly_max_buffer < size;
+
+	// With all buffers together over the limit, the file getting more
+	// data is the one that gives way.
+	bool all_full = total_max > 0 && size > 0 &&
+	                total_max < Reassembler::MemoryAllocation(REASSEM_FILE);
+
+	if ( ! (file_full || all_full) )
+		return;
+
+	// This delivers what's buffered in order, with gaps wherever data is
+	// missing in between.
+	uint64_t current_offset = stream_offset;
+	uint64_t gap_bytes = file_reassembler->Flush();
+	IncrementByteCount(gap_bytes, overflow_bytes_idx);
+
+	if ( FileEventAvailable(file_reassembly_overflow) )
+		{
+		FileEvent(file_reassembly_overflow, {
+			val,
+			zeek::val_mgr->Count(current_offset),
+			zeek::val_mgr->Count(gap_bytes)
+		});
+		}
+	}
+
+void File::UpdateMemoryAccount()
+	{
+	if ( ! memory_account )
+		return;
+
+	int64_t bytes = bof_buffer.size;
+
+	if ( file_reassembler )
+		bytes += file_reassembler->TotalSize();
+
+	memory_account->Adjust(CONN_MEM_FILES, bytes - accounted_bytes);
+	accounted_bytes = bytes;
+	}
+
+void File::UpdateReassemblyPeak()
+	{
+	uint64_t size = file_reassembler->TotalSize();
+
+	if ( size <= reassembly_peak )
+		return;
+
+	reassembly_peak = size;
+	val->Assign(reassembly_buffer_peak_idx, zeek::val_mgr->Count(size));
+	}
+
 void File::DoneWithAnalyzer(Analyzer* analyzer)
 	{
 	done_analyzers.push_back(analyzer);
@@ -527,6 +643,7 @@ void File::DataIn(const u_char* data, uint64_t len, uint64_t offset)
 	analyzers.DrainModifications();
 	DeliverChunk(data, len, offset);
 	analyzers.DrainModifications();
+	UpdateMemoryAccount();
 	}
 
 void File::DataIn(const u_char* data, uint64_t len)
@@ -534,6 +651,7 @@ void File::DataIn(const u_char* data, uint64_t len)
 	analyzers.DrainModifications();
 	DeliverChunk(data, len, stream_offset);
 	analyzers.DrainModifications();
+	UpdateMemoryAccount();
 	}
 
 void File::EndOfFile()
@@ -562,17 +680,22 @@ void File::EndOfFile()
 	done = true;
 
 	file_analysis::Analyzer* a = nullptr;
-	zeek::IterCookie* c = analyzers.InitForIteration();
+	// Analyzers already saw their end of file at the delivery limit.
+	zeek::IterCookie* c = analysis_stopped ? nullptr : analyzers.InitForIteration();
 
-	while ( (a = analyzers.NextEntry(c)) )
+	while ( c && (a = analyzers.NextEntry(c)) )
 		{
 		if ( ! a->EndOfFile() )
 			analyzers.QueueRemove(a->Tag(), a->GetArgs());
 		}
 
-	FileEvent(file_state_remove);
+	// Analyzers running in analysis threads may have results outstanding,
+	// these come first.
+	if ( FileEventAvailable(file_state_remove) )
+		file_mgr->FileEventAfterOffloads(id, file_state_remove, {val});
 
 	analyzers.DrainModifications();
+	UpdateMemoryAccount();
 	}
 
 void File::Gap(uint64_t offset, uint64_t len)
@@ -595,9 +718,9 @@ void File::Gap(uint64_t offset, uint64_t len)
 		}
 
 	file_analysis::Analyzer* a = nullptr;
-	zeek::IterCookie* c = analyzers.InitForIteration();
+	zeek::IterCookie* c = analysis_stopped ? nullptr : analyzers.InitForIteration();
 
-	while ( (a = analyzers.NextEntry(c)) )
+	while ( c && (a = analyzers.NextEntry(c)) )
 		{
 		if ( ! a->Undelivered(offset, len) )
 			analyzers.QueueRemove(a->Tag(), a->GetArgs());
@@ -650,8 +773,8 @@ void File::FileEvent(EventHandlerPtr h, zeek::Args args)
 		}
 	}
 
-bool File::PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
+bool File::PermitWeird(WeirdID id, uint64_t threshold, uint64_t rate,
                        double duration)
 	{
-	return ::PermitWeird(weird_state, name, threshold, rate, duration);
+	return ::PermitWeird(weird_state, id, threshold, rate, duration);
 	}
@@ -14,6 +14,7 @@
 #include "WeirdState.h"
 
 class Connection;
+class ConnMemoryAccount;
 class EventHandlerPtr;
 
 ZEEK_FORWARD_DECLARE_NAMESPACED(RecordVal, zeek);
@@ -235,7 +236,7 @@ public:
 	 * Whether to permit a weird to carry on through the full reporter/weird
 	 * framework.
 	 */
-	bool PermitWeird(const char* name, uint64_t threshold, uint64_t rate,
+	bool PermitWeird(WeirdID id, uint64_t threshold, uint64_t rate,
 	                 double duration);
 
 protected:
@@ -277,6 +278,25 @@ protected:
 	 */
 	void IncrementByteCount(uint64_t size, int field_idx);
 
+	/**
+	 * Flushes the reassembly buffer if it has grown beyond the file's own
+	 * limit, or if the buffers of all files together have grown beyond
+	 * Files::total_reassembly_buffer_size.
+	 */
+	void CheckReassemblyBuffer();
+
+	/**
+	 * Brings what #memory_account has for the file in line with its
+	 * buffers.
+	 */
+	void UpdateMemoryAccount();
+
+	/**
+	 * Records the current size of the reassembly buffer in the
+	 * \c reassembly_buffer_peak field of #val if it's a new maximum.
+	 */
+	void UpdateReassemblyPeak();
+
 	/**
 	 * Wrapper to RecordVal::GetFieldOrDefault for the field in #val at index
 	 * \a idx which automatically unrefs the Val and returns a converted value.
@@ -308,6 +328,26 @@ protected:
 	 */
 	void InferMetadata();
 
+	/**
+	 * Looks up the \c Files::delivery_limits entry for the file's MIME
+	 * type and, if there's one, limits analyzer delivery accordingly.
+	 * @param mime_type the file's MIME type.
+	 */
+	void ApplyDeliveryLimit(const std::string& mime_type);
+
+	/**
+	 * @return how many of \a len bytes at \a offset analyzers get to
+	 *         see given the file's delivery limit.
+	 */
+	uint64_t DeliverableBytes(uint64_t offset, uint64_t len) const;
+
+	/**
+	 * Ends analysis of the file once the delivery limit has been reached
+	 * by signaling the end of the file to all analyzers.  The file itself
+	 * remains tracked until it's actually over.
+	 */
+	void StopAnalysis();
+
 	/**
 	 * Enables reassembly on the file.
 	 */
@@ -356,10 +396,16 @@ protected:
 	FileReassembler* file_reassembler; /**< A reassembler for the file if it's needed. */
 	uint64_t stream_offset;      /**< The offset of the file which has been forwarded. */
 	uint64_t reassembly_max_buffer;      /**< Maximum allowed buffer for reassembly. */
+	uint64_t reassembly_peak;      /**< Largest size the reassembly buffer had. */
 	bool did_metadata_inference;        /**< Whether the metadata inference has already been attempted. */
 	bool reassembly_enabled;           /**< Whether file stream reassembly is needed. */
 	bool postpone_timeout;     /**< Whether postponing timeout is requested. */
 	bool done;                 /**< If this object is about to be deleted. */
+	uint64_t delivery_limit;   /**< Number of bytes that analyzers get to see. */
+	bool limit_disables_reassembly; /**< Whether to disable reassembly once the delivery limit is reached. */
+	bool analysis_stopped;     /**< Whether analyzers were ended at the delivery limit. */
+	ConnMemoryAccount* memory_account; /**< Account of the first connection the file came over, if any. */
+	int64_t accounted_bytes;   /**< What the file's buffers count in #memory_account. */
 	AnalyzerSet analyzers;     /**< A set of attached file analyzers. */
 	std::list<Analyzer *> done_analyzers; /**< Analyzers we're done with, remembered here until they can be safely deleted. */
 
@@ -385,6 +431,7 @@ protected:
 	static int total_bytes_idx;
 	static int missing_bytes_idx;
 	static int overflow_bytes_idx;
+	static int reassembly_buffer_peak_idx;
 	static int timeout_interval_idx;
 	static int bof_buffer_size_idx;
 	static int bof_buffer_idx;
@@ -1,6 +1,7 @@
 
 #include "FileReassembler.h"
 #include "File.h"
+#include "Reporter.h"
 
 
 namespace file_analysis {
@@ -116,6 +117,14 @@ void FileReassembler::Undelivered(uint64_t up_to_seq)
 		}
 	}
 
+void FileReassembler::Evict()
+	{
+	if ( the_file )
+		reporter->Weird(the_file, "file_reassembly_evicted");
+
+	Flush();
+	}
+
 void FileReassembler::Overlap(const u_char* b1, const u_char* b2, uint64_t n)
 	{
 	// Not doing anything here yet.
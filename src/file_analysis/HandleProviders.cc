@@ -0,0 +1,347 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "HandleProviders.h"
+#include "Manager.h"
+
+#include "Conn.h"
+#include "Desc.h"
+#include "Func.h"
+#include "ID.h"
+#include "Val.h"
+#include "analyzer/Manager.h"
+
+using namespace file_analysis;
+
+namespace {
+
+// The handles are what the scripts' cat() and fmt() calls produced, so
+// the values are described the same way they do.
+void add(ODesc* d, const zeek::ValPtr& v)
+	{
+	v->Describe(d);
+	}
+
+// Returns the offset of a record field of a record type, or -1.
+int record_field(const zeek::RecordType* rt, const char* field, const zeek::RecordType** field_type)
+	{
+	auto off = rt->FieldOffset(field);
+
+	if ( off < 0 )
+		return -1;
+
+	const auto& ft = rt->GetFieldType(off);
+
+	if ( ft->Tag() != zeek::TYPE_RECORD )
+		return -1;
+
+	*field_type = ft->AsRecordType();
+	return off;
+	}
+
+// Offsets of the conn_id fields.
+struct ConnIDFields {
+	int orig_h = zeek::id::conn_id->FieldOffset("orig_h");
+	int orig_p = zeek::id::conn_id->FieldOffset("orig_p");
+	int resp_h = zeek::id::conn_id->FieldOffset("resp_h");
+	int resp_p = zeek::id::conn_id->FieldOffset("resp_p");
+
+	// Same as id_string().
+	void Describe(ODesc* d, const zeek::RecordVal* id) const
+		{
+		add(d, id->GetField(orig_h));
+		d->Add(":");
+		d->Add(id->GetField(orig_p)->AsPortVal()->Port());
+		d->Add(" > ");
+		add(d, id->GetField(resp_h));
+		d->Add(":");
+		d->Add(id->GetField(resp_p)->AsPortVal()->Port());
+		}
+};
+
+void register_http(Manager* mgr, const analyzer::Tag& tag)
+	{
+	const zeek::RecordType* info;
+	auto conn_id = zeek::id::connection->FieldOffset("id");
+	auto start_time = zeek::id::connection->FieldOffset("start_time");
+	auto http = record_field(zeek::id::connection.get(), "http", &info);
+
+	if ( http < 0 )
+		return;
+
+	auto info_id = info->FieldOffset("id");
+	auto trans_depth = info->FieldOffset("trans_depth");
+	auto host = info->FieldOffset("host");
+	auto uri = info->FieldOffset("uri");
+	auto range_request = info->FieldOffset("range_request");
+	auto orig_mime_depth = info->FieldOffset("orig_mime_depth");
+	auto resp_mime_depth = info->FieldOffset("resp_mime_depth");
+
+	if ( info_id < 0 || trans_depth < 0 || host < 0 || uri < 0 ||
+	     range_request < 0 || orig_mime_depth < 0 || resp_mime_depth < 0 )
+		return;
+
+	auto tag_val = tag.AsVal();
+
+	auto provider = [=, ids = ConnIDFields{}](Connection* c, bool is_orig) -> std::optional<std::string>
+		{
+		const auto& cv = c->ConnVal();
+		const auto& rv = cv->GetField(http);
+
+		if ( ! rv )
+			return std::string();
+
+		auto rec = rv->AsRecordVal();
+		ODesc d;
+		d.SetStyle(RAW_STYLE);
+		add(&d, tag_val);
+
+		if ( rec->GetFieldOrDefault(range_request)->AsBool() && ! is_orig )
+			{
+			// Any multipart responses from the server are pieces of
+			// the same file, identified by the URL as build_url()
+			// has it.
+			auto id = rec->GetField(info_id)->AsRecordVal();
+			add(&d, zeek::val_mgr->Bool(is_orig));
+			add(&d, cv->GetField(conn_id)->AsRecordVal()->GetField(ids.orig_h));
+
+			std::string u = "/<missed_request>";
+
+			if ( const auto& uv = rec->GetField(uri) )
+				u = uv->AsStringVal()->ToStdString();
+
+			// Like strstr(), which doesn't see into strings with
+			// NULs.
+			if ( u.find('\0') != std::string::npos || u.find("://") == std::string::npos )
+				{
+				if ( const auto& hv = rec->GetField(host) )
+					add(&d, hv);
+				else
+					{
+					const auto& a = id->GetField(ids.resp_h)->AsAddr();
+
+					if ( a.GetFamily() == IPv4 )
+						d.Add(a.AsString());
+					else
+						{
+						d.Add("[");
+						d.Add(a.AsString());
+						d.Add("]");
+						}
+					}
+
+				auto port = id->GetField(ids.resp_p)->AsPortVal()->Port();
+
+				if ( port != 80 )
+					{
+					d.Add(":");
+					d.Add(port);
+					}
+				}
+
+			d.Add(u);
+			}
+		else
+			{
+			const auto& depth = rec->GetField(trans_depth);
+
+			if ( ! depth )
+				return std::nullopt;
+
+			add(&d, cv->GetField(start_time));
+			add(&d, zeek::val_mgr->Bool(is_orig));
+			add(&d, depth);
+			add(&d, rec->GetFieldOrDefault(is_orig ? orig_mime_depth : resp_mime_depth));
+			ids.Describe(&d, cv->GetField(conn_id)->AsRecordVal());
+			}
+
+		return std::string(reinterpret_cast<const char*>(d.Bytes()), d.Len());
+		};
+
+	mgr->RegisterHandleProvider(tag, std::move(provider));
+	}
+
+void register_smtp(Manager* mgr, const analyzer::Tag& tag)
+	{
+	const zeek::RecordType* info;
+	const zeek::RecordType* state;
+	auto start_time = zeek::id::connection->FieldOffset("start_time");
+	auto smtp = record_field(zeek::id::connection.get(), "smtp", &info);
+	auto smtp_state = record_field(zeek::id::connection.get(), "smtp_state", &state);
+
+	if ( smtp < 0 || smtp_state < 0 )
+		return;
+
+	auto trans_depth = info->FieldOffset("trans_depth");
+	auto mime_depth = state->FieldOffset("mime_depth");
+
+	if ( trans_depth < 0 || mime_depth < 0 )
+		return;
+
+	auto tag_val = tag.AsVal();
+
+	auto provider = [=](Connection* c, bool is_orig) -> std::optional<std::string>
+		{
+		const auto& cv = c->ConnVal();
+		const auto& rv = cv->GetField(smtp);
+		const auto& sv = cv->GetField(smtp_state);
+
+		if ( ! (rv && sv) )
+			return std::nullopt;
+
+		const auto& depth = rv->AsRecordVal()->GetField(trans_depth);
+
+		if ( ! depth )
+			return std::nullopt;
+
+		ODesc d;
+		d.SetStyle(RAW_STYLE);
+		add(&d, tag_val);
+		add(&d, cv->GetField(start_time));
+		add(&d, depth);
+		add(&d, sv->AsRecordVal()->GetFieldOrDefault(mime_depth));
+		return std::string(reinterpret_cast<const char*>(d.Bytes()), d.Len());
+		};
+
+	mgr->RegisterHandleProvider(tag, std::move(provider));
+	}
+
+void register_ftp_data(Manager* mgr, const analyzer::Tag& tag)
+	{
+	auto expected = zeek::id::find("FTP::ftp_data_expected");
+
+	if ( ! (expected && expected->GetType()->Tag() == zeek::TYPE_TABLE) )
+		return;
+
+	auto conn_id = zeek::id::connection->FieldOffset("id");
+	auto start_time = zeek::id::connection->FieldOffset("start_time");
+	auto tag_val = tag.AsVal();
+
+	auto provider = [=, ids = ConnIDFields{}](Connection* c, bool is_orig) -> std::optional<std::string>
+		{
+		const auto& table = expected->GetVal();
+
+		if ( ! table )
+			return std::nullopt;
+
+		const auto& cv = c->ConnVal();
+		const auto& id = cv->GetField(conn_id);
+		auto index = zeek::make_intrusive<zeek::ListVal>(zeek::TYPE_ANY);
+		index->Append(id->AsRecordVal()->GetField(ids.resp_h));
+		index->Append(id->AsRecordVal()->GetField(ids.resp_p));
+
+		if ( ! table->AsTableVal()->Find(index) )
+			return std::string();
+
+		ODesc d;
+		d.SetStyle(RAW_STYLE);
+		add(&d, tag_val);
+		add(&d, cv->GetField(start_time));
+		add(&d, id);
+		add(&d, zeek::val_mgr->Bool(is_orig));
+		return std::string(reinterpret_cast<const char*>(d.Bytes()), d.Len());
+		};
+
+	mgr->RegisterHandleProvider(tag, std::move(provider));
+	}
+
+void register_smb(Manager* mgr, const analyzer::Tag& tag)
+	{
+	const zeek::RecordType* state;
+	const zeek::RecordType* file_info;
+	const zeek::RecordType* mac_times;
+	auto smb_state = record_field(zeek::id::connection.get(), "smb_state", &state);
+
+	if ( smb_state < 0 )
+		return;
+
+	auto current_file = record_field(state, "current_file", &file_info);
+
+	if ( current_file < 0 )
+		return;
+
+	auto path = file_info->FieldOffset("path");
+	auto name = file_info->FieldOffset("name");
+	auto times = record_field(file_info, "times", &mac_times);
+
+	if ( path < 0 || name < 0 || times < 0 )
+		return;
+
+	auto modified = mac_times->FieldOffset("modified");
+	const auto& hexdump_id = zeek::id::find("hexdump");
+
+	if ( modified < 0 || ! (hexdump_id && hexdump_id->GetVal()) )
+		return;
+
+	// The handles are hexdumps, as the script had them to avoid NULs.
+	auto hexdump = hexdump_id->GetVal()->AsFuncPtr();
+	auto conn_id = zeek::id::connection->FieldOffset("id");
+	auto tag_val = tag.AsVal();
+	auto epoch = zeek::make_intrusive<zeek::TimeVal>(0.0);
+
+	auto provider = [=, ids = ConnIDFields{}](Connection* c, bool is_orig) -> std::optional<std::string>
+		{
+		const auto& cv = c->ConnVal();
+		const auto& sv = cv->GetField(smb_state);
+
+		if ( ! sv )
+			return std::string();
+
+		const auto& fv = sv->AsRecordVal()->GetField(current_file);
+
+		if ( ! fv )
+			return std::string();
+
+		auto file = fv->AsRecordVal();
+		const auto& pv = file->GetField(path);
+		const auto& nv = file->GetField(name);
+
+		if ( ! (pv || nv) )
+			return std::string();
+
+		const auto& tv = file->GetField(times);
+		auto id = cv->GetField(conn_id)->AsRecordVal();
+
+		ODesc d;
+		d.SetStyle(RAW_STYLE);
+		add(&d, tag_val);
+		add(&d, id->GetField(ids.orig_h));
+		add(&d, id->GetField(ids.resp_h));
+
+		if ( pv )
+			add(&d, pv);
+
+		if ( nv )
+			add(&d, nv);
+
+		add(&d, tv ? tv->AsRecordVal()->GetField(modified) : epoch);
+
+		auto rval = hexdump->Invoke(zeek::make_intrusive<zeek::StringVal>(d.Len(), reinterpret_cast<const char*>(d.Bytes())));
+
+		if ( ! rval )
+			return std::nullopt;
+
+		return rval->AsStringVal()->ToStdString();
+		};
+
+	mgr->RegisterHandleProvider(tag, std::move(provider));
+	}
+
+}
+
+void file_analysis::register_handle_providers(Manager* mgr)
+	{
+	static const std::pair<const char*, void (*)(Manager*, const analyzer::Tag&)> providers[] = {
+		{"HTTP", register_http},
+		{"SMTP", register_smtp},
+		{"FTP_DATA", register_ftp_data},
+		{"SMB", register_smb},
+	};
+
+	for ( const auto& [name, reg] : providers )
+		{
+		auto tag = analyzer_mgr->GetComponentTag(name);
+
+		if ( tag )
+			reg(mgr, tag);
+		}
+	}
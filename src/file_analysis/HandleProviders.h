@@ -0,0 +1,22 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+namespace file_analysis {
+
+class Manager;
+
+/**
+ * Registers the native file handle computations of the HTTP, SMTP,
+ * FTP_DATA and SMB analyzers with a file analysis manager. They produce
+ * the same handles, and hence file IDs, as the \c get_file_handle
+ * callbacks of the base protocol scripts did, without the round-trip
+ * through the event engine.
+ *
+ * A protocol's provider is only registered if the script-level state it
+ * reads is there, that is, if the protocol's base scripts are loaded.
+ * Must be called after the scripts have been parsed.
+ */
+void register_handle_providers(Manager* mgr);
+
+}
@@ -3,15 +3,22 @@
 #include "Manager.h"
 #include "File.h"
 #include "Analyzer.h"
+#include "AnalysisThread.h"
+#include "HandleProviders.h"
 #include "Event.h"
 #include "UID.h"
+#include "Overload.h"
 #include "digest.h"
 
 #include "plugin/Manager.h"
 #include "analyzer/Manager.h"
 #include "file_analysis/file_analysis.bif.h"
+#include "const.bif.h"
+
+#include <functional>
 
 #include <openssl/md5.h>
+#include <unistd.h>
 
 using namespace file_analysis;
 using namespace std;
@@ -42,6 +49,15 @@ void Manager::InitPreScript()
 
 void Manager::InitPostScript()
 	{
+	// The threads are owned by the threading manager.
+	for ( bro_uint_t i = 0; i < zeek::BifConst::Files::analysis_threads; ++i )
+		{
+		auto t = new AnalysisThread(i);
+		t->Start();
+		analysis_threads.push_back(t);
+		}
+
+	register_handle_providers(this);
 	}
 
 void Manager::InitMagic()
@@ -61,9 +77,101 @@ void Manager::Terminate()
 	for ( const string& key : keys )
 		Timeout(key, true);
 
+	// Wait for the analysis threads to deliver all outstanding results.
+	while ( ! pending_offloads.empty() )
+		{
+		bool alive = false;
+
+		for ( auto t : analysis_threads )
+			{
+			t->Process();
+			alive = alive || ! t->Killed();
+			}
+
+		if ( ! alive )
+			break;
+
+		usleep(1000);
+		}
+
 	mgr.Drain();
 	}
 
+void Manager::FeedOffload(Offload* o, const u_char* data, uint64_t len)
+	{
+	if ( analysis_threads.empty() )
+		{
+		o->Feed(data, len);
+		return;
+		}
+
+	auto t = std::hash<string>{}(o->FileID()) % analysis_threads.size();
+	analysis_threads[t]->Feed(o, data, len);
+	}
+
+void Manager::GapOffload(Offload* o, uint64_t len)
+	{
+	if ( analysis_threads.empty() )
+		{
+		o->Gap(len);
+		return;
+		}
+
+	auto t = std::hash<string>{}(o->FileID()) % analysis_threads.size();
+	analysis_threads[t]->Gap(o, len);
+	}
+
+void Manager::FinishOffload(Offload* o, bool deliver)
+	{
+	if ( analysis_threads.empty() )
+		{
+		o->Done();
+
+		if ( deliver )
+			o->Deliver();
+
+		delete o;
+		return;
+		}
+
+	++pending_offloads[o->FileID()].num;
+
+	auto t = std::hash<string>{}(o->FileID()) % analysis_threads.size();
+	analysis_threads[t]->Finish(o, deliver);
+	}
+
+void Manager::OffloadDone(Offload* o, bool deliver)
+	{
+	auto it = pending_offloads.find(o->FileID());
+
+	if ( deliver )
+		o->Deliver();
+
+	delete o;
+
+	if ( it == pending_offloads.end() )
+		return;
+
+	if ( --it->second.num > 0 )
+		return;
+
+	for ( auto& [h, args] : it->second.events )
+		mgr.Enqueue(h, std::move(args));
+
+	pending_offloads.erase(it);
+	}
+
+void Manager::FileEventAfterOffloads(const string& file_id, EventHandlerPtr h,
+                                     zeek::Args args)
+	{
+	auto it = pending_offloads.find(file_id);
+
+	if ( it == pending_offloads.end() )
+		mgr.Enqueue(h, std::move(args));
+	else
+		it->second.events.emplace_back(h, std::move(args));
+	}
+
 string Manager::HashHandle(const string& handle) const
 	{
 	hash128_t hash;
@@ -317,6 +425,9 @@ File* Manager::GetFile(const string& file_id, Connection* conn,
 
 	if ( ! rval )
 		{
+		if ( overload_controller && overload_controller->ShedFile() )
+			return nullptr;
+
 		rval = new File(file_id,
 		                source_name ? source_name
 		                            : analyzer_mgr->GetComponentName(tag),
@@ -420,6 +531,11 @@ bool Manager::IsIgnored(const string& file_id)
 	return ignored.find(file_id) != ignored.end();
 	}
 
+void Manager::RegisterHandleProvider(const analyzer::Tag& tag, HandleProvider provider)
+	{
+	handle_providers[tag] = std::move(provider);
+	}
+
 string Manager::GetFileID(const analyzer::Tag& tag, Connection* c, bool is_orig)
 	{
 	current_file_id.clear();
@@ -427,6 +543,21 @@ string Manager::GetFileID(const analyzer::Tag& tag, Connection* c, bool is_orig)
 	if ( IsDisabled(tag) )
 		return "";
 
+	auto it = handle_providers.find(tag);
+
+	if ( it != handle_providers.end() && ! HasScriptHandle(tag) )
+		{
+		// The handles derive from script state that handlers of already
+		// queued events update, as they did for the event.
+		mgr.Drain();
+
+		if ( auto handle = it->second(c, is_orig) )
+			{
+			SetHandle(*handle);
+			return current_file_id;
+			}
+		}
+
 	if ( ! get_file_handle )
 		return "";
 
@@ -440,6 +571,22 @@ string Manager::GetFileID(const analyzer::Tag& tag, Connection* c, bool is_orig)
 	return current_file_id;
 	}
 
+bool Manager::HasScriptHandle(const analyzer::Tag& tag)
+	{
+	if ( ! registered_protocols )
+		{
+		const auto& id = zeek::id::find("Files::registered_protocols");
+
+		if ( ! (id && id->GetVal()) )
+			return false;
+
+		registered_protocols = id->GetVal()->AsTableVal();
+		}
+
+	const auto& reg = registered_protocols->Find(tag.AsVal());
+	return reg && reg->AsRecordVal()->GetField("get_file_handle");
+	}
+
 bool Manager::IsDisabled(const analyzer::Tag& tag)
 	{
 	if ( ! disabled )
@@ -454,6 +601,47 @@ bool Manager::IsDisabled(const analyzer::Tag& tag)
 	return yield->AsBool();
 	}
 
+bool Manager::HaveDeliveryLimits() const
+	{
+	if ( ! delivery_limits )
+		{
+		// Scripts running bare don't have the table.
+		const auto& id = zeek::id::find("Files::delivery_limits");
+
+		if ( ! id || ! id->GetVal() )
+			return false;
+
+		delivery_limits = id->GetVal()->AsTableVal();
+		}
+
+	return delivery_limits->Size() > 0;
+	}
+
+zeek::RecordValPtr Manager::LookupDeliveryLimit(const std::string& mime_type) const
+	{
+	if ( mime_type.empty() || ! HaveDeliveryLimits() )
+		return nullptr;
+
+	auto key = zeek::make_intrusive<zeek::StringVal>(mime_type);
+	auto limit = delivery_limits->FindOrDefault(key);
+
+	if ( ! limit )
+		{
+		auto slash = mime_type.find('/');
+
+		if ( slash == std::string::npos )
+			return nullptr;
+
+		key = zeek::make_intrusive<zeek::StringVal>(mime_type.substr(0, slash + 1) + "*");
+		limit = delivery_limits->FindOrDefault(key);
+		}
+
+	if ( ! limit )
+		return nullptr;
+
+	return zeek::cast_intrusive<zeek::RecordVal>(std::move(limit));
+	}
+
 Analyzer* Manager::InstantiateAnalyzer(const Tag& tag, zeek::RecordVal* args, File* f) const
 	{ return InstantiateAnalyzer(tag, {zeek::NewRef{}, args}, f); }
 
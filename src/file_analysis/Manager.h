@@ -2,13 +2,18 @@
 
 #pragma once
 
+#include <functional>
+#include <optional>
 #include <string>
 #include <set>
 #include <map>
+#include <vector>
 
 #include "Component.h"
 #include "Net.h"
 #include "RuleMatcher.h"
+#include "EventHandler.h"
+#include "ZeekArgs.h"
 
 #include "plugin/ComponentManager.h"
 
@@ -26,6 +31,8 @@ namespace file_analysis {
 
 class File;
 class Tag;
+class Offload;
+class AnalysisThread;
 
 /**
  * Main entry point for interacting with file analysis.
@@ -82,6 +89,24 @@ public:
 	 */
 	void SetHandle(const std::string& handle);
 
+	/**
+	 * A function computing the file handle of a protocol analyzer's
+	 * current file from its connection, without raising the
+	 * \c get_file_handle event. It returns std::nullopt to leave the
+	 * handle to the event after all.
+	 */
+	using HandleProvider = std::function<std::optional<std::string>(Connection* c, bool is_orig)>;
+
+	/**
+	 * Registers the native file handle computation of a protocol
+	 * analyzer, replacing any previous one. It's used unless the scripts
+	 * register their own \c get_file_handle callback for the analyzer
+	 * with \c Files::register_protocol.
+	 * @param tag the protocol analyzer.
+	 * @param provider the function computing the handles.
+	 */
+	void RegisterHandleProvider(const analyzer::Tag& tag, HandleProvider provider);
+
 	/**
 	 * Pass in non-sequential file data.
 	 * @param data pointer to start of a chunk of file data.
@@ -341,6 +366,61 @@ public:
 	 */
 	std::string DetectMIME(const u_char* data, uint64_t len) const;
 
+	/**
+	 * Looks up how much of a file of a given MIME type analyzers get to
+	 * see, per \c Files::delivery_limits.  An entry for the exact type
+	 * takes precedence over one for its "type/*" wildcard.
+	 * @param mime_type the file's MIME type.
+	 * @return the matching \c Files::DeliveryLimit record, or a null
+	 *         pointer if the type's files aren't limited.
+	 */
+	zeek::RecordValPtr LookupDeliveryLimit(const std::string& mime_type) const;
+
+	/**
+	 * @return whether any delivery limits are configured, in which case
+	 *         files' MIME types need to be detected even if nothing
+	 *         handles \c file_sniff.
+	 */
+	bool HaveDeliveryLimits() const;
+
+	/**
+	 * Feeds a chunk of file data to an analyzer's offloaded computation.
+	 * With analysis threads, this copies the data and queues it for the
+	 * thread handling the computation's file, else it feeds it right away.
+	 * @param o the computation.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 */
+	void FeedOffload(Offload* o, const u_char* data, uint64_t len);
+
+	/**
+	 * Passes a gap in a file's data on to an analyzer's offloaded
+	 * computation, in order with the data fed to it.
+	 * @param o the computation.
+	 * @param len number of bytes missing.
+	 */
+	void GapOffload(Offload* o, uint64_t len);
+
+	/**
+	 * Ends an analyzer's offloaded computation, taking ownership of it.
+	 * Once all data queued for it has been fed, the computation gets its
+	 * results delivered, if requested, and gets deleted.
+	 * @param o the computation.
+	 * @param deliver whether to deliver its results.
+	 */
+	void FinishOffload(Offload* o, bool deliver = true);
+
+	/**
+	 * Raises a file's event once all offloaded computations that have
+	 * been finished for the file delivered their results, or right away
+	 * if there are none outstanding.
+	 * @param file_id the file identifier/hash.
+	 * @param h the event to raise.
+	 * @param args the event's arguments.
+	 */
+	void FileEventAfterOffloads(const std::string& file_id, EventHandlerPtr h,
+	                            zeek::Args args);
+
 	uint64_t CurrentFiles()
 		{ return id_map.size(); }
 
@@ -352,6 +432,11 @@ public:
 
 protected:
 	friend class FileTimer;
+	friend class DeliverMessage;
+
+	// Called in the main thread when an analysis thread is done with
+	// an offloaded computation.
+	void OffloadDone(Offload* o, bool deliver);
 
 	/**
 	 * Create a new file to be analyzed or retrieve an existing one.
@@ -394,17 +479,25 @@ protected:
 
 	/**
 	 * Sets #current_file_id to a hash of a unique file handle string based on
-	 * what the \c get_file_handle event derives from the connection params.
-	 * Event queue is flushed so that we can get the handle value immediately.
+	 * what the analyzer's handle provider or else the \c get_file_handle
+	 * event derives from the connection params. For the event, the queue is
+	 * flushed so that we can get the handle value immediately.
 	 * @param tag network protocol over which the file is transferred.
 	 * @param conn network connection over which the file is transferred.
 	 * @param is_orig true if the file is being sent from connection originator
 	 *        or false if is being sent in the opposite direction.
 	 * @return #current_file_id, which is a hash of a unique file handle string
-	 *         set by a \c get_file_handle event handler.
+	 *         set by a handle provider or \c get_file_handle event handler.
 	 */
 	std::string GetFileID(const analyzer::Tag& tag, Connection* c, bool is_orig);
 
+	/**
+	 * Checks whether the scripts registered a \c get_file_handle callback
+	 * for a protocol analyzer, which then takes precedence over its handle
+	 * provider.
+	 */
+	static bool HasScriptHandle(const analyzer::Tag& tag);
+
 	/**
 	 * Check if analysis is available for files transferred over a given
 	 * network protocol.
@@ -426,12 +519,23 @@ private:
 	std::string current_file_id;	/**< Hash of what get_file_handle event sets. */
 	RuleFileMagicState* magic_state;	/**< File magic signature match state. */
 	MIMEMap mime_types;/**< Mapping of MIME types to analyzers. */
+	std::map<analyzer::Tag, HandleProvider> handle_providers;	/**< Native file handles by analyzer. */
 
 	inline static zeek::TableVal* disabled = nullptr;	/**< Table of disabled analyzers. */
+	inline static zeek::TableVal* registered_protocols = nullptr;	/**< Script callbacks by analyzer. */
 	inline static zeek::TableType* tag_set_type = nullptr;	/**< Type for set[tag]. */
+	inline static zeek::TableVal* delivery_limits = nullptr;	/**< Table of per-MIME-type delivery limits. */
 
 	size_t cumulative_files;
 	size_t max_files;
+
+	struct PendingOffloads {
+		int num = 0;	/**< Finished computations not delivered yet. */
+		std::vector<std::pair<EventHandlerPtr, zeek::Args>> events;	/**< Deferred events. */
+	};
+
+	std::vector<AnalysisThread*> analysis_threads;	/**< Empty if analysis isn't offloaded. */
+	std::map<std::string, PendingOffloads> pending_offloads;	/**< Keyed by file ID. */
 };
 
 /**
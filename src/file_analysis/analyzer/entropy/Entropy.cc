@@ -9,49 +9,27 @@
 
 using namespace file_analysis;
 
-Entropy::Entropy(zeek::RecordValPtr args, File* file)
-    : file_analysis::Analyzer(file_mgr->GetComponentTag("ENTROPY"),
-                              std::move(args), file)
+detail::EntropyTest::EntropyTest(File* file)
+	: Offload(file->GetID()), file_val(file->ToVal()),
+	  entropy(new zeek::EntropyVal), fed(false)
 	{
-	//entropy->Init();
-	entropy = new zeek::EntropyVal;
-	fed = false;
 	}
 
-Entropy::~Entropy()
+detail::EntropyTest::~EntropyTest()
 	{
 	Unref(entropy);
 	}
 
-file_analysis::Analyzer* Entropy::Instantiate(zeek::RecordValPtr args,
-                                              File* file)
-	{
-	return new Entropy(std::move(args), file);
-	}
-
-bool Entropy::DeliverStream(const u_char* data, uint64_t len)
+void detail::EntropyTest::Feed(const u_char* data, uint64_t len)
 	{
 	if ( ! fed )
 		fed = len > 0;
 
 	entropy->Feed(data, len);
-	return true;
-	}
-
-bool Entropy::EndOfFile()
-	{
-	Finalize();
-	return false;
-	}
-
-bool Entropy::Undelivered(uint64_t offset, uint64_t len)
-	{
-	return false;
 	}
 
-void Entropy::Finalize()
+void detail::EntropyTest::Deliver()
 	{
-	//if ( ! entropy->IsValid() || ! fed )
 	if ( ! fed )
 		return;
 
@@ -71,7 +49,53 @@ void Entropy::Finalize()
 	ent_result->Assign<zeek::DoubleVal>(4, scc);
 
 	mgr.Enqueue(file_entropy,
-		GetFile()->ToVal(),
+		file_val,
 		std::move(ent_result)
 	);
 	}
+
+Entropy::Entropy(zeek::RecordValPtr args, File* file)
+    : file_analysis::Analyzer(file_mgr->GetComponentTag("ENTROPY"),
+                              std::move(args), file),
+	test(new detail::EntropyTest(file))
+	{
+	}
+
+Entropy::~Entropy()
+	{
+	// Without having seen the end of the file, there's nothing to report.
+	if ( test )
+		file_mgr->FinishOffload(test, false);
+	}
+
+file_analysis::Analyzer* Entropy::Instantiate(zeek::RecordValPtr args,
+                                              File* file)
+	{
+	return new Entropy(std::move(args), file);
+	}
+
+bool Entropy::DeliverStream(const u_char* data, uint64_t len)
+	{
+	file_mgr->FeedOffload(test, data, len);
+	return true;
+	}
+
+bool Entropy::EndOfFile()
+	{
+	Finalize();
+	return false;
+	}
+
+bool Entropy::Undelivered(uint64_t offset, uint64_t len)
+	{
+	return false;
+	}
+
+void Entropy::Finalize()
+	{
+	if ( ! test )
+		return;
+
+	file_mgr->FinishOffload(test);
+	test = nullptr;
+	}
@@ -8,11 +8,52 @@
 #include "OpaqueVal.h"
 #include "File.h"
 #include "Analyzer.h"
+#include "AnalysisThread.h"
 
 #include "events.bif.h"
 
 namespace file_analysis {
 
+namespace detail {
+
+/**
+ * The entropy calculation over a file's contents, which may run in an
+ * analysis thread.
+ */
+class EntropyTest final : public file_analysis::Offload {
+public:
+	/**
+	 * Constructor.
+	 * @param file the file whose contents get tested.
+	 */
+	explicit EntropyTest(File* file);
+
+	/**
+	 * Destructor.
+	 */
+	~EntropyTest() override;
+
+	/**
+	 * Adds the next chunk of file contents to the calculation.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 */
+	void Feed(const u_char* data, uint64_t len) override;
+
+	/**
+	 * If some file contents have been seen, finalizes the entropy of them
+	 * and raises the "file_entropy" event with the results.
+	 */
+	void Deliver() override;
+
+private:
+	zeek::RecordValPtr file_val;
+	zeek::EntropyVal* entropy;
+	bool fed;
+};
+
+} // namespace detail
+
 /**
  * An analyzer to produce entropy of file contents.
  */
@@ -75,8 +116,7 @@ protected:
 	void Finalize();
 
 private:
-	zeek::EntropyVal* entropy;
-	bool fed;
+	detail::EntropyTest* test;
 };
 
 } // namespace file_analysis
@@ -1,6 +1,7 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
 #include <string>
+#include <algorithm>
 #include <fcntl.h>
 
 #include "Extract.h"
@@ -8,29 +9,84 @@
 #include "Event.h"
 #include "file_analysis/Manager.h"
 
+#include "analyzer/extract/consts.bif.h"
+
 using namespace file_analysis;
 
+detail::ExtractWriter::ExtractWriter(std::string file_id, int fd, uint64_t block_size)
+	: Offload(std::move(file_id)), fd(fd), block_size(std::max(block_size, uint64_t(1))),
+	  queued(0)
+	{
+	buffer.reserve(this->block_size);
+	}
+
+detail::ExtractWriter::~ExtractWriter()
+	{
+	if ( fd >= 0 )
+		safe_close(fd);
+	}
+
+void detail::ExtractWriter::Flush(bool all)
+	{
+	uint64_t n = all ? buffer.size() : buffer.size() - buffer.size() % block_size;
+
+	if ( n == 0 )
+		return;
+
+	safe_write(fd, reinterpret_cast<const char*>(buffer.data()), n);
+	buffer.erase(buffer.begin(), buffer.begin() + n);
+	}
+
+void detail::ExtractWriter::Feed(const u_char* data, uint64_t len)
+	{
+	buffer.insert(buffer.end(), data, data + len);
+	Flush(false);
+	queued -= len;
+	}
+
+void detail::ExtractWriter::Gap(uint64_t len)
+	{
+	// Missing data gets written as zeros, a block at a time.
+	while ( len > 0 )
+		{
+		uint64_t n = std::min(len, block_size - buffer.size());
+		buffer.insert(buffer.end(), n, 0);
+		Flush(false);
+		len -= n;
+		}
+	}
+
+void detail::ExtractWriter::Done()
+	{
+	Flush(true);
+	safe_close(fd);
+	fd = -1;
+	}
+
 Extract::Extract(zeek::RecordValPtr args, File* file,
                  const std::string& arg_filename, uint64_t arg_limit)
     : file_analysis::Analyzer(file_mgr->GetComponentTag("EXTRACT"),
                               std::move(args), file),
-      filename(arg_filename), limit(arg_limit), depth(0)
+      filename(arg_filename), writer(nullptr), limit(arg_limit), depth(0)
 	{
-	fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
+	int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0666);
 
 	if ( fd < 0 )
 		{
-		fd = 0;
 		char buf[128];
 		bro_strerror_r(errno, buf, sizeof(buf));
 		reporter->Error("cannot open %s: %s", filename.c_str(), buf);
+		return;
 		}
+
+	writer = new detail::ExtractWriter(file->GetID(), fd,
+	                                   zeek::BifConst::FileExtract::write_block_size);
 	}
 
 Extract::~Extract()
 	{
-	if ( fd )
-		safe_close(fd);
+	if ( writer )
+		file_mgr->FinishOffload(writer, false);
 	}
 
 static const zeek::ValPtr& get_extract_field_val(const zeek::RecordValPtr& args,
@@ -84,7 +140,7 @@ static bool check_limit_exceeded(uint64_t lim, uint64_t depth, uint64_t len, uin
 
 bool Extract::DeliverStream(const u_char* data, uint64_t len)
 	{
-	if ( ! fd )
+	if ( ! writer )
 		return false;
 
 	uint64_t towrite = 0;
@@ -106,7 +162,31 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len)
 
 	if ( towrite > 0 )
 		{
-		safe_write(fd, reinterpret_cast<const char*>(data), towrite);
+		auto max_queued = zeek::BifConst::FileExtract::max_queued_bytes;
+
+		if ( max_queued > 0 && writer->Queued() + towrite > max_queued )
+			{
+			// The writer can't keep up.  Drop the data, but keep the
+			// rest of the file at its offsets.
+			file_mgr->GapOffload(writer, towrite);
+
+			if ( file_extraction_dropped )
+				{
+				File* f = GetFile();
+				f->FileEvent(file_extraction_dropped, {
+					f->ToVal(),
+					GetArgs(),
+					zeek::val_mgr->Count(depth),
+					zeek::val_mgr->Count(towrite)
+				});
+				}
+			}
+		else
+			{
+			writer->Queue(towrite);
+			file_mgr->FeedOffload(writer, data, towrite);
+			}
+
 		depth += towrite;
 		}
 
@@ -115,13 +195,22 @@ bool Extract::DeliverStream(const u_char* data, uint64_t len)
 
 bool Extract::Undelivered(uint64_t offset, uint64_t len)
 	{
-	if ( depth == offset )
+	if ( writer && depth == offset )
 		{
-		char* tmp = new char[len]();
-		safe_write(fd, tmp, len);
-		delete [] tmp;
+		file_mgr->GapOffload(writer, len);
 		depth += len;
 		}
 
 	return true;
 	}
+
+bool Extract::EndOfFile()
+	{
+	if ( writer )
+		{
+		file_mgr->FinishOffload(writer, false);
+		writer = nullptr;
+		}
+
+	return true;
+	}
@@ -2,16 +2,69 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "Val.h"
 #include "File.h"
 #include "Analyzer.h"
+#include "AnalysisThread.h"
 
 #include "analyzer/extract/events.bif.h"
 
 namespace file_analysis {
 
+namespace detail {
+
+/**
+ * Writes an extracted file to disk, in an analysis thread if these are
+ * enabled. Data gets collected into blocks of
+ * \c FileExtract::write_block_size bytes, which get written as a whole.
+ */
+class ExtractWriter final : public Offload {
+public:
+	/**
+	 * Constructor.
+	 * @param file_id the ID of the file being extracted.
+	 * @param fd the file descriptor to write to, which the writer closes
+	 *        once done.
+	 * @param block_size the size of the blocks to write.
+	 */
+	ExtractWriter(std::string file_id, int fd, uint64_t block_size);
+
+	~ExtractWriter() override;
+
+	void Feed(const u_char* data, uint64_t len) override;
+	void Gap(uint64_t len) override;
+	void Done() override;
+	void Deliver() override	{ }
+
+	/**
+	 * Accounts for data that's about to be fed to the writer. Called in
+	 * the main thread.
+	 * @param len number of bytes.
+	 */
+	void Queue(uint64_t len)	{ queued += len; }
+
+	/**
+	 * @return the number of bytes queued for the writer that it hasn't
+	 *         consumed yet.
+	 */
+	uint64_t Queued() const	{ return queued; }
+
+private:
+	// Writes out all full blocks, or everything if *all* is set.
+	void Flush(bool all);
+
+	int fd;
+	uint64_t block_size;
+	std::vector<u_char> buffer;
+	std::atomic<uint64_t> queued;
+};
+
+} // namespace detail
+
 /**
  * An analyzer to extract content of files to local disk.
  */
@@ -19,7 +72,8 @@ class Extract : public file_analysis::Analyzer {
 public:
 
 	/**
-	 * Destructor.  Will close the file that was used for data extraction.
+	 * Destructor.  Will close the file that was used for data extraction,
+	 * once everything queued for it has been written.
 	 */
 	~Extract() override;
 
@@ -40,6 +94,12 @@ public:
 	 */
 	bool Undelivered(uint64_t offset, uint64_t len) override;
 
+	/**
+	 * Finishes writing the extraction file.
+	 * @return true
+	 */
+	bool EndOfFile() override;
+
 	/**
 	 * Create a new instance of an Extract analyzer.
 	 * @param args the \c AnalyzerArgs value which represents the analyzer.
@@ -72,7 +132,7 @@ protected:
 
 private:
 	std::string filename;
-	int fd;
+	detail::ExtractWriter* writer;
 	uint64_t limit;
 	uint64_t depth;
 };
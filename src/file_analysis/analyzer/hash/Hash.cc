@@ -1,5 +1,6 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
 #include <string>
 
 #include "Hash.h"
@@ -9,28 +10,88 @@
 
 using namespace file_analysis;
 
+// Chunks larger than this get fed to the digests one block at a time, so
+// that each block is still in cache when the next digest gets to it.
+static constexpr uint64_t digests_block_size = 16 * 1024;
+
+detail::Digests::Digests(File* file, std::vector<Digest> arg_digests)
+	: Offload(file->GetID()), file_val(file->ToVal()),
+	  digests(std::move(arg_digests)), fed(false)
+	{
+	for ( auto& d : digests )
+		d.hash->Init();
+	}
+
+detail::Digests::~Digests()
+	{
+	for ( auto& d : digests )
+		Unref(d.hash);
+	}
+
+bool detail::Digests::IsValid() const
+	{
+	for ( const auto& d : digests )
+		if ( ! d.hash->IsValid() )
+			return false;
+
+	return true;
+	}
+
+void detail::Digests::Feed(const u_char* data, uint64_t len)
+	{
+	if ( ! fed )
+		fed = len > 0;
+
+	while ( len > 0 )
+		{
+		auto n = std::min(len, digests_block_size);
+
+		for ( const auto& d : digests )
+			d.hash->Feed(data, n);
+
+		data += n;
+		len -= n;
+		}
+	}
+
+void detail::Digests::Deliver()
+	{
+	if ( ! fed || ! file_hash )
+		return;
+
+	for ( const auto& d : digests )
+		{
+		if ( ! d.hash->IsValid() )
+			continue;
+
+		mgr.Enqueue(file_hash,
+		            file_val,
+		            zeek::make_intrusive<zeek::StringVal>(d.kind),
+		            d.hash->Get()
+		);
+		}
+	}
+
 Hash::Hash(zeek::RecordValPtr args, File* file, zeek::HashVal* hv, const char* arg_kind)
 	: file_analysis::Analyzer(file_mgr->GetComponentTag(to_upper(arg_kind).c_str()),
 	                          std::move(args), file),
-	  hash(hv), fed(false), kind(arg_kind)
+	  digests(new detail::Digests(file, {{hv, arg_kind}}))
 	{
-	hash->Init();
 	}
 
 Hash::~Hash()
 	{
-	Unref(hash);
+	// Without having seen the end of the file, there's nothing to report.
+	if ( digests )
+		file_mgr->FinishOffload(digests, false);
 	}
 
 bool Hash::DeliverStream(const u_char* data, uint64_t len)
 	{
-	if ( ! hash->IsValid() )
+	if ( ! digests->IsValid() )
 		return false;
 
-	if ( ! fed )
-		fed = len > 0;
-
-	hash->Feed(data, len);
+	file_mgr->FeedOffload(digests, data, len);
 	return true;
 	}
 
@@ -47,15 +108,84 @@ bool Hash::Undelivered(uint64_t offset, uint64_t len)
 
 void Hash::Finalize()
 	{
-	if ( ! hash->IsValid() || ! fed )
+	if ( ! digests )
 		return;
 
+	file_mgr->FinishOffload(digests);
+	digests = nullptr;
+	}
+
+Hashes::Hashes(zeek::RecordValPtr args, File* file,
+               std::vector<detail::Digests::Digest> arg_digests)
+	: file_analysis::Analyzer(file_mgr->GetComponentTag("HASHES"), std::move(args), file),
+	  digests(new detail::Digests(file, std::move(arg_digests)))
+	{
+	}
+
+Hashes::~Hashes()
+	{
+	if ( digests )
+		file_mgr->FinishOffload(digests, false);
+	}
+
+file_analysis::Analyzer* Hashes::Instantiate(zeek::RecordValPtr args, File* file)
+	{
 	if ( ! file_hash )
+		return nullptr;
+
+	const auto& selected = args->GetField("hashes");
+
+	auto want = [&selected](const char* kind)
+		{
+		if ( ! selected )
+			return true;
+
+		auto k = zeek::make_intrusive<zeek::StringVal>(kind);
+		return selected->AsTableVal()->Find(k) != nullptr;
+		};
+
+	std::vector<detail::Digests::Digest> digests;
+
+	if ( want("md5") )
+		digests.push_back({new zeek::MD5Val(), "md5"});
+
+	if ( want("sha1") )
+		digests.push_back({new zeek::SHA1Val(), "sha1"});
+
+	if ( want("sha256") )
+		digests.push_back({new zeek::SHA256Val(), "sha256"});
+
+	if ( digests.empty() )
+		return nullptr;
+
+	return new Hashes(std::move(args), file, std::move(digests));
+	}
+
+bool Hashes::DeliverStream(const u_char* data, uint64_t len)
+	{
+	if ( ! digests->IsValid() )
+		return false;
+
+	file_mgr->FeedOffload(digests, data, len);
+	return true;
+	}
+
+bool Hashes::EndOfFile()
+	{
+	Finalize();
+	return false;
+	}
+
+bool Hashes::Undelivered(uint64_t offset, uint64_t len)
+	{
+	return false;
+	}
+
+void Hashes::Finalize()
+	{
+	if ( ! digests )
 		return;
 
-	mgr.Enqueue(file_hash,
-	            GetFile()->ToVal(),
-	            zeek::make_intrusive<zeek::StringVal>(kind),
-	            hash->Get()
-	);
+	file_mgr->FinishOffload(digests);
+	digests = nullptr;
 	}
@@ -3,16 +3,70 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "Val.h"
 #include "OpaqueVal.h"
 #include "File.h"
 #include "Analyzer.h"
+#include "AnalysisThread.h"
 
 #include "events.bif.h"
 
 namespace file_analysis {
 
+namespace detail {
+
+/**
+ * The digests that a hash analyzer computes over a file's contents. Their
+ * calculation may run in an analysis thread.
+ */
+class Digests final : public file_analysis::Offload {
+public:
+	struct Digest {
+		zeek::HashVal* hash;
+		const char* kind;
+	};
+
+	/**
+	 * Constructor.
+	 * @param file the file whose contents get hashed.
+	 * @param digests the hash calculators to feed, which the object
+	 * takes ownership of.
+	 */
+	Digests(File* file, std::vector<Digest> digests);
+
+	/**
+	 * Destructor.
+	 */
+	~Digests() override;
+
+	/**
+	 * @return false if a digest is in an invalid state, else true.
+	 */
+	bool IsValid() const;
+
+	/**
+	 * Hashes the next chunk of file contents with all digests.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 */
+	void Feed(const u_char* data, uint64_t len) override;
+
+	/**
+	 * If some file contents have been seen, finalizes the hashes of them
+	 * and raises the "file_hash" event with each result.
+	 */
+	void Deliver() override;
+
+private:
+	zeek::RecordValPtr file_val;
+	std::vector<Digest> digests;
+	bool fed;
+};
+
+} // namespace detail
+
 /**
  * An analyzer to produce a hash of file contents.
  */
@@ -65,9 +119,7 @@ protected:
 	void Finalize();
 
 private:
-	zeek::HashVal* hash;
-	bool fed;
-	const char* kind;
+	detail::Digests* digests;
 };
 
 /**
@@ -157,4 +209,76 @@ protected:
 		{}
 };
 
+/**
+ * An analyzer to produce several hashes of file contents in a single pass
+ * over the data, as opposed to attaching the separate MD5, SHA1 and SHA256
+ * analyzers, which each walk all of it on their own.
+ */
+class Hashes : public file_analysis::Analyzer {
+public:
+
+	/**
+	 * Destructor.
+	 */
+	~Hashes() override;
+
+	/**
+	 * Create a new instance of the combined hashing file analyzer.
+	 * @param args the \c AnalyzerArgs value which represents the analyzer.
+	 * Its \c hashes field selects the digests to compute, all of them if
+	 * it's not set.
+	 * @param file the file to which the analyzer will be attached.
+	 * @return the new analyzer instance or a null pointer if there's no
+	 *         handler for the "file_hash" event or no known digest is
+	 *         selected.
+	 */
+	static file_analysis::Analyzer* Instantiate(zeek::RecordValPtr args,
+	                                            File* file);
+
+	/**
+	 * Incrementally hash next chunk of file contents with all selected
+	 * digests.
+	 * @param data pointer to start of a chunk of a file data.
+	 * @param len number of bytes in the data chunk.
+	 * @return false if a digest is in an invalid state, else true.
+	 */
+	bool DeliverStream(const u_char* data, uint64_t len) override;
+
+	/**
+	 * Finalizes the hashes and raises a "file_hash" event for each.
+	 * @return always false so analyze will be deteched from file.
+	 */
+	bool EndOfFile() override;
+
+	/**
+	 * Missing data can't be handled, so just indicate the this analyzer should
+	 * be removed from receiving further data.  The hashes will not be finalized.
+	 * @param offset byte offset in file at which missing chunk starts.
+	 * @param len number of missing bytes.
+	 * @return always false so analyzer will detach from file.
+	 */
+	bool Undelivered(uint64_t offset, uint64_t len) override;
+
+protected:
+
+	/**
+	 * Constructor.
+	 * @param args the \c AnalyzerArgs value which represents the analyzer.
+	 * @param file the file to which the analyzer will be attached.
+	 * @param digests the hash calculators to feed, which the analyzer
+	 * takes ownership of.
+	 */
+	Hashes(zeek::RecordValPtr args, File* file,
+	       std::vector<detail::Digests::Digest> digests);
+
+	/**
+	 * If some file contents have been seen, finalizes the hashes of them
+	 * and raises the "file_hash" event with each result.
+	 */
+	void Finalize();
+
+private:
+	detail::Digests* digests;
+};
+
 } // namespace file_analysis
@@ -1,8 +1,15 @@
+#include <algorithm>
+
 #include "PE.h"
 #include "file_analysis/Manager.h"
 
 using namespace file_analysis;
 
+// The headers normally end within the first kilobyte or so. Feeding the
+// interpreter pieces of this size lets the analyzer stop shortly after
+// them, rather than having it go through the rest of a large chunk.
+static const uint64_t delivery_slice = 512;
+
 PE::PE(zeek::RecordValPtr args, File* file)
     : file_analysis::Analyzer(file_mgr->GetComponentTag("PE"), std::move(args),
                               file)
@@ -20,19 +27,27 @@ PE::~PE()
 
 bool PE::DeliverStream(const u_char* data, uint64_t len)
 	{
-	if ( conn->is_done() )
+	if ( done )
 		return false;
 
 	try
 		{
-		interp->NewData(data, data + len);
+		while ( len > 0 && ! conn->is_done() )
+			{
+			uint64_t n = std::min(len, delivery_slice);
+			interp->NewData(data, data + n);
+			data += n;
+			len -= n;
+			}
 		}
 	catch ( const binpac::Exception& e )
 		{
 		return false;
 		}
 
-	return ! conn->is_done();
+	// Returning false gets the analyzer removed from the file.
+	done = conn->is_done();
+	return ! done;
 	}
 
 bool PE::EndOfFile()
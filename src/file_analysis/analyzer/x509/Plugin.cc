@@ -26,6 +26,8 @@ public:
 		{
 		zeek::plugin::Plugin::Done();
 		::file_analysis::X509::FreeRootStore();
+		::file_analysis::X509::FlushNativeCache();
+		::file_analysis::X509::FlushVerifyCache();
 		}
 } plugin;
 
@@ -7,6 +7,7 @@
 
 #include "events.bif.h"
 #include "types.bif.h"
+#include "consts.bif.h"
 
 #include "file_analysis/File.h"
 #include "file_analysis/Manager.h"
@@ -45,13 +46,19 @@ bool file_analysis::X509::Undelivered(uint64_t offset, uint64_t len)
 bool file_analysis::X509::EndOfFile()
 	{
 	const unsigned char* cert_char = reinterpret_cast<const unsigned char*>(cert_data.data());
-	if ( certificate_cache )
+	bool use_native_cache = zeek::BifConst::X509::native_cache_size > 0;
+	unsigned char buf[SHA256_DIGEST_LENGTH];
+
+	if ( certificate_cache || use_native_cache )
 		{
-		// first step - let's see if the certificate has been cached.
-		unsigned char buf[SHA256_DIGEST_LENGTH];
 		auto ctx = hash_init(Hash_SHA256);
 		hash_update(ctx, cert_char, cert_data.size());
 		hash_final(ctx, buf);
+		}
+
+	if ( certificate_cache )
+		{
+		// first step - let's see if the certificate has been cached.
 		std::string cert_sha256 = sha256_digest_print(buf);
 		auto index = zeek::make_intrusive<zeek::StringVal>(cert_sha256);
 		const auto& entry = certificate_cache->Find(index);
@@ -70,25 +77,55 @@ bool file_analysis::X509::EndOfFile()
 			}
 		}
 
-	// ok, now we can try to parse the certificate with openssl. Should
-	// be rather straightforward...
-	::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
-	if ( ! ssl_cert )
+	zeek::IntrusivePtr<X509Val> cert_val;
+	zeek::RecordValPtr cert_record;
+	std::string digest;
+
+	if ( use_native_cache )
 		{
-		reporter->Weird(GetFile(), "x509_cert_parse_error");
-		return false;
+		digest.assign(reinterpret_cast<const char*>(buf), sizeof(buf));
+		auto it = native_cache_index.find(digest);
+
+		if ( it != native_cache_index.end() )
+			{
+			// Seen recently - reuse the certificate OpenSSL parsed back
+			// then. Hand out a copy of the record, so scripts modifying
+			// theirs don't alter later hits.
+			native_cache.splice(native_cache.begin(), native_cache, it->second);
+			cert_val = it->second->cert_val;
+			cert_record = zeek::cast_intrusive<zeek::RecordVal>(it->second->cert_record->Clone());
+			}
 		}
 
-	X509Val* cert_val = new X509Val(ssl_cert); // cert_val takes ownership of ssl_cert
+	if ( ! cert_val )
+		{
+		// ok, now we can try to parse the certificate with openssl. Should
+		// be rather straightforward...
+		::X509* ssl_cert = d2i_X509(NULL, &cert_char, cert_data.size());
+		if ( ! ssl_cert )
+			{
+			reporter->Weird(GetFile(), "x509_cert_parse_error");
+			return false;
+			}
+
+		// cert_val takes ownership of ssl_cert
+		cert_val = zeek::make_intrusive<X509Val>(ssl_cert);
 
-	// parse basic information into record.
-	auto cert_record = ParseCertificate(cert_val, GetFile());
+		// parse basic information into record.
+		cert_record = ParseCertificate(cert_val.get(), GetFile());
+
+		if ( use_native_cache )
+			AddToNativeCache(std::move(digest), cert_val,
+			                 zeek::cast_intrusive<zeek::RecordVal>(cert_record->Clone()));
+		}
+
+	::X509* ssl_cert = cert_val->GetCertificate();
 
 	// and send the record on to scriptland
 	if ( x509_certificate )
 		mgr.Enqueue(x509_certificate,
 		            GetFile()->ToVal(),
-		            zeek::IntrusivePtr{zeek::NewRef{}, cert_val},
+		            cert_val,
 		            cert_record);
 
 	// after parsing the certificate - parse the extensions...
@@ -108,11 +145,110 @@ bool file_analysis::X509::EndOfFile()
 	//
 	// The certificate will be freed when the last X509Val is Unref'd.
 
-	Unref(cert_val); // Same for cert_val
-
 	return false;
 	}
 
+void file_analysis::X509::AddToNativeCache(std::string digest,
+                                           zeek::IntrusivePtr<X509Val> cert_val,
+                                           zeek::RecordValPtr cert_record)
+	{
+	native_cache.push_front({digest, std::move(cert_val), std::move(cert_record)});
+	native_cache_index[std::move(digest)] = native_cache.begin();
+
+	while ( native_cache.size() > zeek::BifConst::X509::native_cache_size )
+		{
+		native_cache_index.erase(native_cache.back().digest);
+		native_cache.pop_back();
+		}
+	}
+
+void file_analysis::X509::FlushNativeCache()
+	{
+	native_cache_index.clear();
+	native_cache.clear();
+	}
+
+bool file_analysis::X509::LookupVerifyResult(const std::string& key, int* result,
+                                             zeek::VectorValPtr* chain)
+	{
+	auto it = verify_cache_index.find(key);
+
+	if ( it == verify_cache_index.end() )
+		{
+		++verify_cache_misses;
+		return false;
+		}
+
+	if ( it->second->expires < network_time )
+		{
+		verify_cache.erase(it->second);
+		verify_cache_index.erase(it);
+		++verify_cache_misses;
+		return false;
+		}
+
+	verify_cache.splice(verify_cache.begin(), verify_cache, it->second);
+	++verify_cache_hits;
+
+	const auto& entry = *it->second;
+	*result = entry.result;
+
+	if ( entry.chain )
+		{
+		// The certificates are shared, the vector holding them is not.
+		auto copy = zeek::make_intrusive<zeek::VectorVal>(entry.chain->GetType<zeek::VectorType>());
+
+		for ( unsigned int i = 0; i < entry.chain->Size(); ++i )
+			copy->Assign(i, entry.chain->At(i));
+
+		*chain = std::move(copy);
+		}
+	else
+		*chain = nullptr;
+
+	return true;
+	}
+
+void file_analysis::X509::StoreVerifyResult(std::string key, int result,
+                                            zeek::VectorValPtr chain)
+	{
+	auto it = verify_cache_index.find(key);
+
+	if ( it != verify_cache_index.end() )
+		{
+		verify_cache.erase(it->second);
+		verify_cache_index.erase(it);
+		}
+
+	double expires = network_time + zeek::BifConst::X509::verify_cache_ttl;
+	verify_cache.push_front({key, result, std::move(chain), expires});
+	verify_cache_index[std::move(key)] = verify_cache.begin();
+
+	while ( verify_cache.size() > zeek::BifConst::X509::verify_cache_size )
+		{
+		verify_cache_index.erase(verify_cache.back().key);
+		verify_cache.pop_back();
+		}
+	}
+
+zeek::RecordValPtr file_analysis::X509::GetVerifyCacheStats()
+	{
+	auto r = zeek::make_intrusive<zeek::RecordVal>(zeek::BifType::Record::X509::VerifyCacheStats);
+	int n = 0;
+
+	r->Assign(n++, zeek::val_mgr->Count(verify_cache_hits));
+	r->Assign(n++, zeek::val_mgr->Count(verify_cache_misses));
+	r->Assign(n++, zeek::val_mgr->Count(verify_cache.size()));
+
+	return r;
+	}
+
+void file_analysis::X509::FlushVerifyCache()
+	{
+	verify_cache_index.clear();
+	verify_cache.clear();
+	}
+
 zeek::RecordValPtr file_analysis::X509::ParseCertificate(X509Val* cert_val, File* f)
 	{
 	::X509* ssl_cert = cert_val->GetCertificate();
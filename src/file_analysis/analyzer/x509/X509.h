@@ -4,6 +4,8 @@
 
 #include <string>
 #include <map>
+#include <list>
+#include <unordered_map>
 
 #include "OpaqueVal.h"
 #include "X509Common.h"
@@ -126,6 +128,56 @@ public:
 	static void SetCertificateCacheHitCallback(zeek::FuncPtr func)
 		{ cache_hit_callback = std::move(func); }
 
+	/**
+	 * Drops all entries of the in-core certificate cache (see
+	 * \c X509::native_cache_size).  Like FreeRootStore(), this mainly
+	 * exists so leak checkers don't report the cached values.
+	 */
+	static void FlushNativeCache();
+
+	/**
+	 * Looks up the outcome of an earlier certificate chain verification
+	 * in the verification cache (see \c X509::verify_cache_size).
+	 * Entries older than \c X509::verify_cache_ttl count as misses.
+	 *
+	 * @param key Identifies the chain, root store and verification time;
+	 * built by the caller.
+	 *
+	 * @param result Set to the cached OpenSSL result code on a hit.
+	 *
+	 * @param chain Set to a copy of the cached validated chain on a hit;
+	 * null if the verification failed.
+	 *
+	 * @return True on a cache hit.
+	 */
+	static bool LookupVerifyResult(const std::string& key, int* result,
+	                               zeek::VectorValPtr* chain);
+
+	/**
+	 * Records the outcome of a certificate chain verification in the
+	 * verification cache, evicting the least recently used entry if the
+	 * cache is full.
+	 *
+	 * @param key Identifies the chain, as passed to LookupVerifyResult().
+	 *
+	 * @param result The OpenSSL result code.
+	 *
+	 * @param chain The validated chain, if any.
+	 */
+	static void StoreVerifyResult(std::string key, int result,
+	                              zeek::VectorValPtr chain);
+
+	/**
+	 * Returns the usage statistics of the verification cache as a
+	 * \c X509::VerifyCacheStats record.
+	 */
+	static zeek::RecordValPtr GetVerifyCacheStats();
+
+	/**
+	 * Drops all entries of the verification cache.
+	 */
+	static void FlushVerifyCache();
+
 protected:
 	X509(zeek::RecordValPtr args, File* file);
 
@@ -134,6 +186,30 @@ private:
 	void ParseSAN(X509_EXTENSION* ex);
 	void ParseExtensionsSpecific(X509_EXTENSION* ex, bool, ASN1_OBJECT*, const char*) override;
 
+	// An entry of the in-core certificate cache: the certificate parsed
+	// by OpenSSL along with the record ParseCertificate() built from it.
+	struct NativeCacheEntry {
+		std::string digest;
+		zeek::IntrusivePtr<X509Val> cert_val;
+		zeek::RecordValPtr cert_record;
+	};
+
+	using NativeCacheList = std::list<NativeCacheEntry>;
+
+	static void AddToNativeCache(std::string digest,
+	                             zeek::IntrusivePtr<X509Val> cert_val,
+	                             zeek::RecordValPtr cert_record);
+
+	// An entry of the verification cache.
+	struct VerifyCacheEntry {
+		std::string key;
+		int result;
+		zeek::VectorValPtr chain;
+		double expires;
+	};
+
+	using VerifyCacheList = std::list<VerifyCacheEntry>;
+
 	std::string cert_data;
 
 	// Helpers for ParseCertificate.
@@ -143,6 +219,16 @@ private:
 	inline static std::map<zeek::Val*, X509_STORE*> x509_stores = std::map<zeek::Val*, X509_STORE*>();
 	inline static zeek::TableValPtr certificate_cache = nullptr;
 	inline static zeek::FuncPtr cache_hit_callback = nullptr;
+	/** In-core LRU cache of parsed certificates, most recent first */
+	inline static NativeCacheList native_cache = NativeCacheList();
+	inline static std::unordered_map<std::string, NativeCacheList::iterator> native_cache_index =
+		std::unordered_map<std::string, NativeCacheList::iterator>();
+	/** LRU cache of chain verification results, most recent first */
+	inline static VerifyCacheList verify_cache = VerifyCacheList();
+	inline static std::unordered_map<std::string, VerifyCacheList::iterator> verify_cache_index =
+		std::unordered_map<std::string, VerifyCacheList::iterator>();
+	inline static uint64_t verify_cache_hits = 0;
+	inline static uint64_t verify_cache_misses = 0;
 };
 
 /**
@@ -0,0 +1,179 @@
+// Replays fuzzer inputs like the standalone driver, but records the CPU
+// time and heap allocations each input takes and flags those exceeding a
+// time budget proportional to their size. That catches inputs that
+// trigger algorithmic-complexity issues in analyzers.
+
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv);
+
+// Counts allocations through operator new. That covers anything allocated
+// by C++ code, but not direct malloc() calls.
+static std::atomic<uint64_t> num_allocs{0};
+static std::atomic<uint64_t> alloc_bytes{0};
+
+static void* counted_alloc(size_t size)
+	{
+	num_allocs.fetch_add(1, std::memory_order_relaxed);
+	alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	if ( auto p = malloc(size ? size : 1) )
+		return p;
+
+	throw std::bad_alloc();
+	}
+
+void* operator new(size_t size)
+	{ return counted_alloc(size); }
+
+void* operator new[](size_t size)
+	{ return counted_alloc(size); }
+
+void operator delete(void* p) noexcept
+	{ free(p); }
+
+void operator delete[](void* p) noexcept
+	{ free(p); }
+
+void operator delete(void* p, size_t) noexcept
+	{ free(p); }
+
+void operator delete[](void* p, size_t) noexcept
+	{ free(p); }
+
+static double cpu_time()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+	}
+
+static void usage(const char* prog)
+	{
+	fprintf(stderr, "usage: %s [options] <input files>\n\n", prog);
+	fprintf(stderr, "    -budget_per_byte=<usecs>  CPU time allowed per input byte [10]\n");
+	fprintf(stderr, "    -budget_base=<secs>       CPU time allowed for any input [0.01]\n");
+	fprintf(stderr, "    -runs=<n>                 runs per input, keeping the fastest [1]\n");
+	exit(2);
+	}
+
+static bool parse_option(const char* arg, const char* name, double* value)
+	{
+	auto len = strlen(name);
+
+	if ( strncmp(arg, name, len) != 0 || arg[len] != '=' )
+		return false;
+
+	char* end;
+	*value = strtod(arg + len + 1, &end);
+	return *end == '\0' && *value >= 0;
+	}
+
+int main(int argc, char** argv)
+	{
+	double budget_per_byte = 10e-6;
+	double budget_base = 0.01;
+	double runs = 1;
+	std::vector<const char*> inputs;
+
+	for ( auto i = 1; i < argc; ++i )
+		{
+		auto arg = argv[i];
+
+		if ( arg[0] != '-' )
+			inputs.emplace_back(arg);
+		else if ( parse_option(arg, "-budget_per_byte", &budget_per_byte) )
+			budget_per_byte /= 1e6;
+		else if ( ! parse_option(arg, "-budget_base", &budget_base) &&
+		          ! parse_option(arg, "-runs", &runs) )
+			usage(argv[0]);
+		}
+
+	if ( inputs.empty() || runs < 1 )
+		usage(argv[0]);
+
+	int init_argc = 1;
+	LLVMFuzzerInitialize(&init_argc, &argv);
+
+	printf("%-40s %8s %12s %10s %10s %12s\n", "input", "bytes", "seconds",
+	       "us/byte", "allocs", "alloc-bytes");
+
+	int num_flagged = 0;
+	double total_dt = 0;
+
+	for ( auto input_file_name : inputs )
+		{
+		auto f = fopen(input_file_name, "r");
+
+		if ( ! f )
+			{
+			fprintf(stderr, "%s: failed to open file: %s\n", input_file_name,
+			        strerror(errno));
+			abort();
+			}
+
+		fseek(f, 0, SEEK_END);
+		auto input_length = ftell(f);
+		fseek(f, 0, SEEK_SET);
+
+		auto input_buffer = std::make_unique<uint8_t[]>(input_length);
+		auto bytes_read = fread(input_buffer.get(), 1, input_length, f);
+		fclose(f);
+
+		if ( bytes_read != static_cast<size_t>(input_length) )
+			{
+			fprintf(stderr, "%s: failed to read full file: %zu/%ld\n",
+			        input_file_name, bytes_read, input_length);
+			abort();
+			}
+
+		double dt = 0;
+		uint64_t allocs = 0;
+		uint64_t bytes = 0;
+
+		for ( auto run = 0; run < static_cast<int>(runs); ++run )
+			{
+			auto allocs_start = num_allocs.load();
+			auto bytes_start = alloc_bytes.load();
+			auto start = cpu_time();
+			LLVMFuzzerTestOneInput(input_buffer.get(), input_length);
+			auto run_dt = cpu_time() - start;
+
+			if ( run == 0 || run_dt < dt )
+				dt = run_dt;
+
+			// Allocations don't vary between runs, save for caches
+			// warming up during the first.
+			allocs = num_allocs.load() - allocs_start;
+			bytes = alloc_bytes.load() - bytes_start;
+			}
+
+		total_dt += dt;
+		double per_byte = input_length ? dt / input_length : 0;
+		bool flagged = dt > budget_base + budget_per_byte * input_length;
+
+		if ( flagged )
+			++num_flagged;
+
+		printf("%-40s %8ld %12.6f %10.3f %10lu %12lu%s\n", input_file_name,
+		       input_length, dt, per_byte * 1e6, static_cast<unsigned long>(allocs),
+		       static_cast<unsigned long>(bytes), flagged ? "  OVER BUDGET" : "");
+		fflush(stdout);
+		}
+
+	printf("Processed %zu inputs in %fs, %d over budget\n", inputs.size(),
+	       total_dt, num_flagged);
+
+	return num_flagged ? 1 : 0;
+	}
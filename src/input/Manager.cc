@@ -106,6 +106,13 @@ public:
 
 	EventHandlerPtr event;
 
+	// True while entries are coming in for the table, which holds back
+	// change notifications until the end.
+	bool bulk_update;
+
+	// Whether to freeze the table once it's loaded.
+	bool freeze;
+
 	TableStream();
 	~TableStream() override;
 };
@@ -133,7 +140,8 @@ public:
 Manager::TableStream::TableStream()
 	: Manager::Stream::Stream(TABLE_STREAM),
 	  num_idx_fields(), num_val_fields(), want_record(), tab(), rtype(),
-	  itype(), currDict(), lastDict(), pred(), event()
+	  itype(), currDict(), lastDict(), pred(), event(), bulk_update(),
+	  freeze()
 	{
 	}
 
@@ -151,6 +159,9 @@ Manager::EventStream::~EventStream()
 
 Manager::TableStream::~TableStream()
 	{
+	if ( tab && bulk_update )
+		tab->EndBulkUpdate();
+
 	if ( tab )
 		Unref(tab);
 
@@ -640,6 +651,15 @@ bool Manager::CreateTableStream(zeek::RecordVal* fval)
 	if ( ! CheckErrorEventTypes(stream_name, error_event, true) )
 		return false;
 
+	auto freeze = fval->GetFieldOrDefault("freeze")->AsBool();
+
+	if ( freeze && fval->GetFieldOrDefault("mode")->AsEnumVal()->InternalInt() != 0 )
+		{
+		reporter->Error("Input stream %s: Only tables read in MANUAL mode can be frozen",
+		                stream_name.c_str());
+		return false;
+		}
+
 	vector<Field*> fieldsV; // vector, because we don't know the length beforehands
 
 	bool status = (! UnrollRecordType(&fieldsV, idx, "", false));
@@ -696,9 +716,12 @@ bool Manager::CreateTableStream(zeek::RecordVal* fval)
 	stream->lastDict = new zeek::PDict<InputHash>;
 	stream->lastDict->SetDeleteFunc(input_hash_delete_func);
 	stream->want_record = ( want_record->InternalInt() == 1 );
+	stream->freeze = freeze;
 
 	assert(stream->reader);
-	stream->reader->Init(fieldsV.size(), fields );
+	// Without a predicate, whose decisions can change from one read to
+	// the next, the reader can spare us the entries that stay the same.
+	stream->reader->Init(fieldsV.size(), fields, stream->pred ? 0 : idxfields);
 
 	readers[stream->reader] = stream;
 
@@ -996,6 +1019,12 @@ bool Manager::ForceUpdate(const string &name)
 		return false;
 		}
 
+	if ( i->stream_type == TABLE_STREAM && ((TableStream*) i)->tab->IsReadOnly() )
+		{
+		reporter->Error("Stream %s has frozen its table. Ignoring force update.", name.c_str());
+		return false;
+		}
+
 	i->reader->Update();
 
 #ifdef DEBUG
@@ -1065,6 +1094,25 @@ zeek::Val* Manager::ValueToIndexVal(const Stream* i, int num_fields, const zeek:
 	}
 
 
+void Manager::SendEntry(ReaderFrontend* reader, int num_vals, Value** *vals)
+	{
+	Stream *i = FindStream(reader);
+
+	if ( i && i->stream_type == TABLE_STREAM )
+		{
+		// Coalesced until EndCurrentSend().
+		TableStream* stream = (TableStream*) i;
+		stream->tab->StartBulkUpdate(num_vals);
+		stream->currDict->Reserve(stream->currDict->Length() + num_vals);
+		stream->bulk_update = true;
+		}
+
+	for ( int j = 0; j < num_vals; ++j )
+		SendEntry(reader, vals[j]);
+
+	delete [] vals;
+	}
+
 void Manager::SendEntry(ReaderFrontend* reader, Value* *vals)
 	{
 	Stream *i = FindStream(reader);
@@ -1304,7 +1352,7 @@ int Manager::SendEntryTable(Stream* i, const Value* const *vals)
 	return stream->num_val_fields + stream->num_idx_fields;
 	}
 
-void Manager::EndCurrentSend(ReaderFrontend* reader)
+void Manager::EndCurrentSend(ReaderFrontend* reader, vector<string>* removed)
 	{
 	Stream *i = FindStream(reader);
 
@@ -1332,57 +1380,61 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	assert(i->stream_type == TABLE_STREAM);
 	TableStream* stream = (TableStream*) i;
 
-	// lastdict contains all deleted entries and should be empty apart from that
-	zeek::IterCookie *c = stream->lastDict->InitForIteration();
-	stream->lastDict->MakeRobustCookie(c);
-	InputHash* ih;
-	HashKey *lastDictIdxKey;
-
-	while ( ( ih = stream->lastDict->NextEntry(lastDictIdxKey, c) ) )
+	if ( removed )
 		{
-		zeek::ValPtr val;
-		zeek::ValPtr predidx;
-		zeek::EnumValPtr ev;
-		int startpos = 0;
-
-		if ( stream->pred || stream->event )
+		// The reader only sent us what changed and tells us what's
+		// gone, so everything else in lastDict stays as it is.
+		for ( const auto& key : *removed )
 			{
-			auto idx = stream->tab->RecreateIndex(*ih->idxkey);
-			assert(idx != nullptr);
-			val = stream->tab->FindOrDefault(idx);
-			assert(val != nullptr);
-			predidx = {zeek::AdoptRef{}, ListValToRecordVal(idx.get(), stream->itype, &startpos)};
-			ev = zeek::BifType::Enum::Input::Event->GetEnumVal(BifEnum::Input::EVENT_REMOVED);
+			HashKey lastDictIdxKey(key.data(), key.size());
+			InputHash* ih = stream->lastDict->Lookup(&lastDictIdxKey);
+
+			if ( ih && ExpireTableEntry(stream, *ih->idxkey) )
+				delete stream->lastDict->RemoveEntry(&lastDictIdxKey);
 			}
 
-		if ( stream->pred )
+		// Merge in the new and changed entries.
+		zeek::IterCookie *c = stream->currDict->InitForIteration();
+		stream->currDict->MakeRobustCookie(c);
+		InputHash* ih;
+		HashKey *currDictIdxKey;
+
+		while ( ( ih = stream->currDict->NextEntry(currDictIdxKey, c) ) )
 			{
-			// ask predicate, if we want to expire this element...
+			stream->currDict->RemoveEntry(currDictIdxKey);
+			delete stream->lastDict->Insert(currDictIdxKey, ih);
+			delete currDictIdxKey;
+			}
 
-			bool result = CallPred(stream->pred, 3, ev->Ref(), predidx->Ref(),
-			                       val->Ref());
+		EndBulkUpdate(stream);
+		FreezeTable(stream);
 
-			if ( result == false )
-				{
-				// Keep it. Hence - we quit and simply go to the next entry of lastDict
-				// ah well - and we have to add the entry to currDict...
-				stream->currDict->Insert(lastDictIdxKey, stream->lastDict->RemoveEntry(lastDictIdxKey));
-				delete lastDictIdxKey;
-				continue;
-				}
-			}
+#ifdef DEBUG
+		DBG_LOG(DBG_INPUT, "EndCurrentSend complete for stream %s, %zu removed",
+			i->name.c_str(), removed->size());
+#endif
 
-		if ( stream->event )
+		SendEndOfData(i);
+		return;
+		}
+
+	// lastdict contains all deleted entries and should be empty apart from that
+	zeek::IterCookie *c = stream->lastDict->InitForIteration();
+	stream->lastDict->MakeRobustCookie(c);
+	InputHash* ih;
+	HashKey *lastDictIdxKey;
+
+	while ( ( ih = stream->lastDict->NextEntry(lastDictIdxKey, c) ) )
+		{
+		if ( ! ExpireTableEntry(stream, *ih->idxkey) )
 			{
-			if ( stream->num_val_fields == 0 )
-				SendEvent(stream->event, 3, stream->description->Ref(), ev->Ref(),
-				          predidx->Ref());
-			else
-				SendEvent(stream->event, 4, stream->description->Ref(), ev->Ref(),
-				          predidx->Ref(), val->Ref());
+			// Keep it. Hence - we quit and simply go to the next entry of lastDict
+			// ah well - and we have to add the entry to currDict...
+			stream->currDict->Insert(lastDictIdxKey, stream->lastDict->RemoveEntry(lastDictIdxKey));
+			delete lastDictIdxKey;
+			continue;
 			}
 
-		stream->tab->Remove(*ih->idxkey);
 		stream->lastDict->Remove(lastDictIdxKey); // delete in next line
 		delete lastDictIdxKey;
 		delete(ih);
@@ -1395,6 +1447,9 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	stream->currDict = new zeek::PDict<InputHash>;
 	stream->currDict->SetDeleteFunc(input_hash_delete_func);
 
+	EndBulkUpdate(stream);
+	FreezeTable(stream);
+
 #ifdef DEBUG
 	DBG_LOG(DBG_INPUT, "EndCurrentSend complete for stream %s",
 		i->name.c_str());
@@ -1403,6 +1458,67 @@ void Manager::EndCurrentSend(ReaderFrontend* reader)
 	SendEndOfData(i);
 	}
 
+void Manager::EndBulkUpdate(TableStream* stream)
+	{
+	if ( ! stream->bulk_update )
+		return;
+
+	stream->bulk_update = false;
+	stream->tab->EndBulkUpdate();
+	}
+
+void Manager::FreezeTable(TableStream* stream)
+	{
+	if ( ! stream->freeze || ! stream->tab->Freeze() )
+		return;
+
+	// The table can't change anymore, so there's nothing left to
+	// compare the next read against.
+	stream->lastDict->Clear();
+	}
+
+bool Manager::ExpireTableEntry(TableStream* stream, const HashKey& idxkey)
+	{
+	zeek::ValPtr val;
+	zeek::ValPtr predidx;
+	zeek::EnumValPtr ev;
+	int startpos = 0;
+
+	if ( stream->pred || stream->event )
+		{
+		auto idx = stream->tab->RecreateIndex(idxkey);
+		assert(idx != nullptr);
+		val = stream->tab->FindOrDefault(idx);
+		assert(val != nullptr);
+		predidx = {zeek::AdoptRef{}, ListValToRecordVal(idx.get(), stream->itype, &startpos)};
+		ev = zeek::BifType::Enum::Input::Event->GetEnumVal(BifEnum::Input::EVENT_REMOVED);
+		}
+
+	if ( stream->pred )
+		{
+		// ask predicate, if we want to expire this element...
+
+		bool result = CallPred(stream->pred, 3, ev->Ref(), predidx->Ref(),
+		                       val->Ref());
+
+		if ( result == false )
+			return false;
+		}
+
+	if ( stream->event )
+		{
+		if ( stream->num_val_fields == 0 )
+			SendEvent(stream->event, 3, stream->description->Ref(), ev->Ref(),
+			          predidx->Ref());
+		else
+			SendEvent(stream->event, 4, stream->description->Ref(), ev->Ref(),
+			          predidx->Ref(), val->Ref());
+		}
+
+	stream->tab->Remove(idxkey);
+	return true;
+	}
+
 void Manager::SendEndOfData(ReaderFrontend* reader)
 	{
 	Stream *i = FindStream(reader);
@@ -1431,6 +1547,28 @@ void Manager::SendEndOfData(const Stream *i)
 		file_mgr->EndOfFile(static_cast<const AnalysisStream*>(i)->file_id);
 	}
 
+void Manager::Put(ReaderFrontend* reader, int num_vals, Value** *vals)
+	{
+	Stream *i = FindStream(reader);
+	zeek::TableValPtr bulk_tab;
+
+	if ( i && i->stream_type == TABLE_STREAM && ! ((TableStream*) i)->bulk_update )
+		{
+		// Without an EndCurrentSend() in this mode, changes get
+		// coalesced per batch.
+		bulk_tab = {zeek::NewRef{}, ((TableStream*) i)->tab};
+		bulk_tab->StartBulkUpdate(num_vals);
+		}
+
+	for ( int j = 0; j < num_vals; ++j )
+		Put(reader, vals[j]);
+
+	if ( bulk_tab )
+		bulk_tab->EndBulkUpdate();
+
+	delete [] vals;
+	}
+
 void Manager::Put(ReaderFrontend* reader, Value* *vals)
 	{
 	Stream *i = FindStream(reader);
@@ -1907,7 +2045,7 @@ zeek::RecordVal* Manager::ValueToRecordVal(const Stream* stream, const Value* co
 
 // Count the length of the values used to create a correct length buffer for
 // hashing later
-int Manager::GetValueLength(const Value* val) const
+int Manager::GetValueLength(const Value* val)
 	{
 	assert( val->present ); // presence has to be checked elsewhere
 	int length = 0;
@@ -2004,7 +2142,7 @@ int Manager::GetValueLength(const Value* val) const
 
 // Given a threading::value, copy the raw data bytes into *data and return how many bytes were copied.
 // Used for hashing the values for lookup in the bro table
-int Manager::CopyValue(char *data, const int startpos, const Value* val) const
+int Manager::CopyValue(char *data, const int startpos, const Value* val)
 	{
 	assert( val->present ); // presence has to be checked elsewhere
 
@@ -2136,7 +2274,7 @@ int Manager::CopyValue(char *data, const int startpos, const Value* val) const
 	}
 
 // Hash num_elements threading values and return the HashKey for them. At least one of the vals has to be ->present.
-HashKey* Manager::HashValues(const int num_elements, const Value* const *vals) const
+bool Manager::SerializeValues(int num_elements, const Value* const* vals, string* data)
 	{
 	int length = 0;
 
@@ -2153,29 +2291,36 @@ HashKey* Manager::HashValues(const int num_elements, const Value* const *vals) c
 	assert ( length >= num_elements );
 
 	if ( length == num_elements )
-		return nullptr;
+		return false;
 
 	int position = 0;
-	char *data = new char[length];
+	data->resize(length);
 
 	for ( int i = 0; i < num_elements; i++ )
 		{
 		const Value* val = vals[i];
 		if ( val->present )
-			position += CopyValue(data, position, val);
+			position += CopyValue(&(*data)[0], position, val);
 
-		memset(data + position, 1, 1); // Add end-of-field-marker. Does not really matter which value it is,
-		                               // it just has to be... something.
+		(*data)[position] = 1; // Add end-of-field-marker. Does not really matter which value it is,
+		                       // it just has to be... something.
 
 		position++;
 
 		}
 
-	HashKey *key = new HashKey(data, length);
-	delete [] data;
-
 	assert(position == length);
-	return key;
+	return true;
+	}
+
+HashKey* Manager::HashValues(const int num_elements, const Value* const *vals) const
+	{
+	string data;
+
+	if ( ! SerializeValues(num_elements, vals, &data) )
+		return nullptr;
+
+	return new HashKey(data.data(), data.size());
 	}
 
 // convert threading value to Bro value
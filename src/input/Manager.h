@@ -5,6 +5,8 @@
 #pragma once
 
 #include <map>
+#include <string>
+#include <vector>
 
 #include "Component.h"
 #include "EventHandler.h"
@@ -113,12 +115,30 @@ public:
 	 */
 	static bool IsCompatibleType(zeek::Type* t, bool atomic_only=false);
 
+	/**
+	 * Serializes a set of values the way the manager hashes table
+	 * indices and values. This may be called from reader threads.
+	 *
+	 * @param num_elements The number of values in *vals*.
+	 *
+	 * @param vals The values.
+	 *
+	 * @param data Receives the serialized values.
+	 *
+	 * @return False if there's nothing to serialize because none
+	 * of the values is set.
+	 */
+	static bool SerializeValues(int num_elements, const threading::Value* const* vals,
+	                            std::string* data);
+
 protected:
 	friend class ReaderFrontend;
 	friend class PutMessage;
+	friend class PutBatchMessage;
 	friend class DeleteMessage;
 	friend class ClearMessage;
 	friend class SendEntryMessage;
+	friend class SendEntryBatchMessage;
 	friend class EndCurrentSendMessage;
 	friend class ReaderClosedMessage;
 	friend class DisableMessage;
@@ -129,6 +149,7 @@ protected:
 	// new/deleted values directly). Functions take ownership of
 	// threading::Value fields.
 	void Put(ReaderFrontend* reader, threading::Value* *vals);
+	void Put(ReaderFrontend* reader, int num_vals, threading::Value** *vals);
 	void Clear(ReaderFrontend* reader);
 	bool Delete(ReaderFrontend* reader, threading::Value* *vals);
 	// Trigger sending the End-of-Data event when the input source has
@@ -139,7 +160,8 @@ protected:
 	// monitoring new/deleted values) Functions take ownership of
 	// threading::Value fields.
 	void SendEntry(ReaderFrontend* reader, threading::Value* *vals);
-	void EndCurrentSend(ReaderFrontend* reader);
+	void SendEntry(ReaderFrontend* reader, int num_vals, threading::Value** *vals);
+	void EndCurrentSend(ReaderFrontend* reader, std::vector<std::string>* removed = nullptr);
 
 	// Instantiates a new ReaderBackend of the given type (note that
 	// doing so creates a new thread!).
@@ -214,12 +236,23 @@ private:
 	// Get a hashkey for a set of threading::Values.
 	HashKey* HashValues(const int num_elements, const threading::Value* const *vals) const;
 
+	// Removes an entry that's gone from the input source from a table,
+	// unless the predicate says to keep it. Returns false in that case.
+	bool ExpireTableEntry(TableStream* stream, const HashKey& idxkey);
+
+	// Ends holding back a table's change notifications while its
+	// entries come in.
+	void EndBulkUpdate(TableStream* stream);
+
+	// Freezes a table once it's loaded, if the stream asks for that.
+	void FreezeTable(TableStream* stream);
+
 	// Get the memory used by a specific value.
-	int GetValueLength(const threading::Value* val) const;
+	static int GetValueLength(const threading::Value* val);
 
 	// Copies the raw data in a specific threading::Value to position
 	// startpos.
-	int CopyValue(char *data, const int startpos, const threading::Value* val) const;
+	static int CopyValue(char *data, const int startpos, const threading::Value* val);
 
 	// Convert Threading::Value to an internal Bro Type (works with Records).
 	zeek::Val* ValueToVal(const Stream* i, const threading::Value* val, zeek::Type* request_type, bool& have_error) const;
@@ -3,6 +3,7 @@
 #include "ReaderBackend.h"
 #include "ReaderFrontend.h"
 #include "Manager.h"
+#include "threading/Manager.h"
 
 using threading::Value;
 using threading::Field;
@@ -25,6 +26,23 @@ private:
 	Value* *val;
 };
 
+class PutBatchMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	PutBatchMessage(ReaderFrontend* reader, int num_vals, Value** *vals)
+		: threading::OutputMessage<ReaderFrontend>("PutBatch", reader),
+		num_vals(num_vals), vals(vals) {}
+
+	bool Process() override
+		{
+		input_mgr->Put(Object(), num_vals, vals);
+		return true;
+		}
+
+private:
+	int num_vals;
+	Value** *vals;
+};
+
 class DeleteMessage final : public threading::OutputMessage<ReaderFrontend> {
 public:
 	DeleteMessage(ReaderFrontend* reader, Value* *val)
@@ -90,18 +108,39 @@ private:
 	Value* *val;
 };
 
+class SendEntryBatchMessage final : public threading::OutputMessage<ReaderFrontend> {
+public:
+	SendEntryBatchMessage(ReaderFrontend* reader, int num_vals, Value** *vals)
+		: threading::OutputMessage<ReaderFrontend>("SendEntryBatch", reader),
+		num_vals(num_vals), vals(vals) { }
+
+	bool Process() override
+		{
+		input_mgr->SendEntry(Object(), num_vals, vals);
+		return true;
+		}
+
+private:
+	int num_vals;
+	Value** *vals;
+};
+
 class EndCurrentSendMessage final : public threading::OutputMessage<ReaderFrontend> {
 public:
-	EndCurrentSendMessage(ReaderFrontend* reader)
-		: threading::OutputMessage<ReaderFrontend>("EndCurrentSend", reader) {}
+	EndCurrentSendMessage(ReaderFrontend* reader, std::vector<std::string>* removed)
+		: threading::OutputMessage<ReaderFrontend>("EndCurrentSend", reader),
+		removed(removed) {}
+
+	~EndCurrentSendMessage() override	{ delete removed; }
 
 	bool Process() override
 		{
-		input_mgr->EndCurrentSend(Object());
+		input_mgr->EndCurrentSend(Object(), removed);
 		return true;
 		}
 
 private:
+	std::vector<std::string>* removed;
 };
 
 class EndOfDataMessage final : public threading::OutputMessage<ReaderFrontend> {
@@ -181,8 +220,11 @@ ReaderBackend::ReaderBackend(ReaderFrontend* arg_frontend) : MsgThread()
 	info = new ReaderInfo(frontend->Info());
 	num_fields = 0;
 	fields = nullptr;
+	num_key_fields = 0;
 
 	SetName(frontend->Name());
+
+	SetCPUs(thread_mgr->ThreadCPUs("Threading::input_reader_cpus"));
 	}
 
 ReaderBackend::~ReaderBackend()
@@ -195,6 +237,11 @@ void ReaderBackend::Put(Value* *val)
 	SendOut(new PutMessage(frontend, val));
 	}
 
+void ReaderBackend::Put(int num_vals, Value** *vals)
+	{
+	SendOut(new PutBatchMessage(frontend, num_vals, vals));
+	}
+
 void ReaderBackend::Delete(Value* *val)
 	{
 	SendOut(new DeleteMessage(frontend, val));
@@ -202,12 +249,30 @@ void ReaderBackend::Delete(Value* *val)
 
 void ReaderBackend::Clear()
 	{
+	prev_entries.clear();
+	curr_entries.clear();
 	SendOut(new ClearMessage(frontend));
 	}
 
 void ReaderBackend::EndCurrentSend()
 	{
-	SendOut(new EndCurrentSendMessage(frontend));
+	std::vector<std::string>* removed = nullptr;
+
+	if ( num_key_fields )
+		{
+		removed = new std::vector<std::string>;
+
+		for ( const auto& e : prev_entries )
+			{
+			if ( curr_entries.find(e.first) == curr_entries.end() )
+				removed->push_back(e.first);
+			}
+
+		prev_entries.swap(curr_entries);
+		curr_entries.clear();
+		}
+
+	SendOut(new EndCurrentSendMessage(frontend, removed));
 	}
 
 void ReaderBackend::EndOfData()
@@ -217,11 +282,65 @@ void ReaderBackend::EndOfData()
 
 void ReaderBackend::SendEntry(Value* *vals)
 	{
+	if ( num_key_fields && ! EntryChanged(vals) )
+		{
+		Value::delete_value_ptr_array(vals, num_fields);
+		return;
+		}
+
 	SendOut(new SendEntryMessage(frontend, vals));
 	}
 
+void ReaderBackend::SendEntry(int num_vals, Value** *vals)
+	{
+	if ( num_key_fields )
+		{
+		int n = 0;
+
+		for ( int i = 0; i < num_vals; ++i )
+			{
+			if ( EntryChanged(vals[i]) )
+				vals[n++] = vals[i];
+			else
+				Value::delete_value_ptr_array(vals[i], num_fields);
+			}
+
+		num_vals = n;
+		}
+
+	if ( ! num_vals )
+		{
+		delete [] vals;
+		return;
+		}
+
+	SendOut(new SendEntryBatchMessage(frontend, num_vals, vals));
+	}
+
+bool ReaderBackend::EntryChanged(Value** vals)
+	{
+	std::string key;
+	std::string data;
+
+	if ( ! Manager::SerializeValues(num_key_fields, vals, &key) )
+		// Let the manager complain.
+		return true;
+
+	hash_t valhash = 0;
+
+	if ( Manager::SerializeValues(num_fields - num_key_fields, vals + num_key_fields, &data) )
+		valhash = HashKey::HashBytes(data.data(), data.size());
+
+	auto prev = prev_entries.find(key);
+	bool changed = prev == prev_entries.end() || prev->second != valhash;
+
+	curr_entries[std::move(key)] = valhash;
+	return changed;
+	}
+
 bool ReaderBackend::Init(const int arg_num_fields,
-		         const threading::Field* const* arg_fields)
+		         const threading::Field* const* arg_fields,
+		         int arg_num_key_fields)
 	{
 	if ( Failed() )
 		return true;
@@ -232,6 +351,7 @@ bool ReaderBackend::Init(const int arg_num_fields,
 
 	num_fields = arg_num_fields;
 	fields = arg_fields;
+	num_key_fields = arg_num_key_fields;
 
 	// disable if DoInit returns error.
 	int success = DoInit(*info, arg_num_fields, arg_fields);
@@ -2,7 +2,11 @@
 
 #pragma once
 
+#include <string>
+#include <unordered_map>
+
 #include "ZeekString.h"
+#include "Hash.h"
 
 #include "threading/SerialTypes.h"
 #include "threading/MsgThread.h"
@@ -148,9 +152,17 @@ public:
 	 * @param config A string map containing additional configuration options
 	 * for the reader.
 	 *
+	 * @param num_key_fields If non-zero, the number of leading fields
+	 * that make up a table index. Entries sent through SendEntry() then
+	 * only go to the manager if they are new or have changed since the
+	 * previous EndCurrentSend(), and EndCurrentSend() tells the manager
+	 * which ones went away, so that it doesn't need to compare the
+	 * whole table.
+	 *
 	 * @return False if an error occured.
 	 */
-	bool Init(int num_fields, const threading::Field* const* fields);
+	bool Init(int num_fields, const threading::Field* const* fields,
+	          int num_key_fields = 0);
 
 	/**
 	 * Force trigger an update of the input stream. The action that will
@@ -184,6 +196,12 @@ public:
 	 */
 	int NumFields() const	{ return num_fields; }
 
+	/**
+	 * Returns the number of index fields as passed into Init(), if
+	 * SendEntry() filters out unchanged entries.
+	 */
+	int NumKeyFields() const	{ return num_key_fields; }
+
 	/**
 	 * Convenience function that calls Warning or Error, depending on the
 	 * is_error parameter. In case of a warning, setting suppress_future to
@@ -205,6 +223,7 @@ public:
 	// Overridden from MsgThread.
 	bool OnHeartbeat(double network_time, double current_time) override;
 	bool OnFinish(double network_time) override;
+	bool CanRunOnPool() const override	{ return true; }
 
 	void Info(const char* msg) override;
 
@@ -295,6 +314,18 @@ protected:
 	 */
 	void Put(threading::Value** val);
 
+	/**
+	 * Method sending a batch of values in simple mode, with a single
+	 * message to the main thread. The effect is the same as calling
+	 * Put() for each element in turn.
+	 *
+	 * @param num_vals The number of elements in *vals*.
+	 *
+	 * @param vals Array of arrays as Put() expects them. The method
+	 * takes ownership of the outer array as well as of the values.
+	 */
+	void Put(int num_vals, threading::Value*** vals);
+
 	/**
 	 * Method allowing a reader to delete a specific value from a Bro
 	 * table.
@@ -339,6 +370,19 @@ protected:
 	 */
 	void SendEntry(threading::Value** vals);
 
+	/**
+	 * Method sending a batch of values in tracking mode, with a single
+	 * message to the main thread. The effect is the same as calling
+	 * SendEntry() for each element in turn.
+	 *
+	 * @param num_vals The number of elements in *vals*.
+	 *
+	 * @param vals Array of arrays as SendEntry() expects them. The
+	 * method takes ownership of the outer array as well as of the
+	 * values.
+	 */
+	void SendEntry(int num_vals, threading::Value*** vals);
+
 	/**
 	 * Method telling the manager, that the current list of entries sent
 	 * by SendEntry is finished.
@@ -350,6 +394,10 @@ protected:
 	void EndCurrentSend();
 
 private:
+	// Records an entry of the current generation when tracking
+	// changes. Returns false if it's the same as in the previous one.
+	bool EntryChanged(threading::Value** vals);
+
 	// Frontend that instantiated us. This object must not be accessed
 	// from this class, it's running in a different thread!
 	ReaderFrontend* frontend;
@@ -358,6 +406,13 @@ private:
 	unsigned int num_fields;
 	const threading::Field* const * fields; // raw mapping
 
+	// With num_key_fields set, the entries by their serialized index
+	// as sent until the previous EndCurrentSend() and since then,
+	// along with a hash of their values.
+	int num_key_fields;
+	std::unordered_map<std::string, hash_t> prev_entries;
+	std::unordered_map<std::string, hash_t> curr_entries;
+
 	bool disabled;
 	// this is an internal indicator in case the read is currently in a failed state
 	// it's used to suppress duplicate error messages.
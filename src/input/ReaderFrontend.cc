@@ -10,18 +10,20 @@ class InitMessage final : public threading::InputMessage<ReaderBackend>
 {
 public:
 	InitMessage(ReaderBackend* backend,
-		    const int num_fields, const threading::Field* const* fields)
+		    const int num_fields, const threading::Field* const* fields,
+		    int num_key_fields)
 		: threading::InputMessage<ReaderBackend>("Init", backend),
-		num_fields(num_fields), fields(fields) { }
+		num_fields(num_fields), fields(fields), num_key_fields(num_key_fields) { }
 
 	bool Process() override
 		{
-		return Object()->Init(num_fields, fields);
+		return Object()->Init(num_fields, fields, num_key_fields);
 		}
 
 private:
 	const int num_fields;
 	const threading::Field* const* fields;
+	const int num_key_fields;
 };
 
 class UpdateMessage final : public threading::InputMessage<ReaderBackend>
@@ -63,7 +65,8 @@ ReaderFrontend::~ReaderFrontend()
 	}
 
 void ReaderFrontend::Init(const int arg_num_fields,
-		          const threading::Field* const* arg_fields)
+		          const threading::Field* const* arg_fields,
+		          int num_key_fields)
 	{
 	if ( disabled )
 		return;
@@ -75,7 +78,7 @@ void ReaderFrontend::Init(const int arg_num_fields,
 	fields = arg_fields;
 	initialized = true;
 
-	backend->SendIn(new InitMessage(backend, num_fields, fields));
+	backend->SendIn(new InitMessage(backend, num_fields, fields, num_key_fields));
 	}
 
 void ReaderFrontend::Update()
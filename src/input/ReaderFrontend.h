@@ -53,7 +53,8 @@ public:
 	 *
 	 * This method must only be called from the main thread.
 	 */
-	void Init(const int arg_num_fields, const threading::Field* const* fields);
+	void Init(const int arg_num_fields, const threading::Field* const* fields,
+	          int num_key_fields = 0);
 
 	/**
 	 * Force an update of the current input source. Actual action depends
@@ -1,11 +1,14 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
-#include <sstream>
+#include <algorithm>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #include "Ascii.h"
 #include "ascii.bif.h"
@@ -18,6 +21,12 @@ using namespace std;
 using threading::Value;
 using threading::Field;
 
+// The number of entries that go to the main thread in one message.
+static const size_t MAX_BATCH_SIZE = 1000;
+
+// How much to read at a time from files that can't be mapped.
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+
 FieldMapping::FieldMapping(const string& arg_name, const zeek::TypeTag& arg_type, int arg_position)
 	: name(arg_name), type(arg_type), subtype(zeek::TYPE_ERROR)
 	{
@@ -49,18 +58,26 @@ FieldMapping FieldMapping::subType()
 
 Ascii::Ascii(ReaderFrontend *frontend) : ReaderBackend(frontend)
 	{
+	fd = -1;
 	mtime = 0;
 	ino = 0;
+	data = nullptr;
+	data_len = data_pos = 0;
+	mapping = nullptr;
+	map_offset = 0;
+	use_map = false;
 	fail_on_file_problem = false;
 	fail_on_invalid_lines = false;
 	}
 
 Ascii::~Ascii()
 	{
+	CloseFile();
 	}
 
 void Ascii::DoClose()
 	{
+	CloseFile();
 	}
 
 bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fields)
@@ -122,7 +139,7 @@ bool Ascii::DoInit(const ReaderInfo& info, int num_fields, const Field* const* f
 
 bool Ascii::OpenFile()
 	{
-	if ( file.is_open() )
+	if ( fd >= 0 )
 		return true;
 
 	// Handle path-prefixing. See similar logic in Binary::DoInit().
@@ -141,20 +158,26 @@ bool Ascii::OpenFile()
 		fname = path + "/" + fname;
 		}
 
-	file.open(fname);
+	fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
 
-	if ( ! file.is_open() )
+	if ( fd < 0 )
 		{
 		FailWarn(fail_on_file_problem, Fmt("Init: cannot open %s", fname.c_str()), true);
 
 		return ! fail_on_file_problem;
 		}
 
+	struct stat sb;
+	use_map = fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode);
+	data = nullptr;
+	data_len = data_pos = 0;
+	map_offset = 0;
+
 	if ( ReadHeader(false) == false )
 		{
 		FailWarn(fail_on_file_problem, Fmt("Init: cannot open %s; problem reading file header", fname.c_str()), true);
 
-		file.close();
+		CloseFile();
 		return ! fail_on_file_problem;
 		}
 
@@ -162,15 +185,124 @@ bool Ascii::OpenFile()
 	return true;
 	}
 
+void Ascii::CloseFile()
+	{
+	if ( mapping )
+		munmap(mapping, data_len);
+
+	if ( fd >= 0 )
+		close(fd);
+
+	fd = -1;
+	mapping = nullptr;
+	data = nullptr;
+	data_len = data_pos = 0;
+	string().swap(buffer);
+	}
+
+bool Ascii::FillData()
+	{
+	if ( fd < 0 )
+		return false;
+
+	if ( use_map )
+		{
+		// Map whatever the file has gained since the last time,
+		// starting over at the page holding the unread data.
+		struct stat sb;
+		off_t unread = map_offset + data_pos;
+
+		if ( fstat(fd, &sb) < 0 || sb.st_size <= off_t(map_offset + data_len) )
+			return false;
+
+		off_t offset = unread - unread % sysconf(_SC_PAGESIZE);
+		size_t len = sb.st_size - offset;
+		void* m = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, offset);
+
+		if ( m == MAP_FAILED )
+			{
+			Warning(Fmt("Could not map %s: %s", fname.c_str(), Strerror(errno)));
+			return false;
+			}
+
+		madvise(m, len, MADV_SEQUENTIAL);
+
+		if ( mapping )
+			munmap(mapping, data_len);
+
+		mapping = m;
+		map_offset = offset;
+		data = static_cast<const char*>(mapping);
+		data_len = len;
+		data_pos = unread - offset;
+		return true;
+		}
+
+	buffer.erase(0, data_pos);
+	size_t have = buffer.size();
+	buffer.resize(have + READ_CHUNK_SIZE);
+
+	ssize_t n;
+
+	do
+		n = read(fd, &buffer[have], READ_CHUNK_SIZE);
+	while ( n < 0 && errno == EINTR );
+
+	buffer.resize(have + (n > 0 ? n : 0));
+	data = buffer.data();
+	data_len = buffer.size();
+	data_pos = 0;
+
+	return n > 0;
+	}
+
+void Ascii::SplitLine(string_view line, vector<string_view>* parts) const
+	{
+	parts->clear();
+
+	const char* p = line.data();
+	const char* end = p + line.size();
+
+	// As with getline(), a separator at the very end doesn't start
+	// another, empty field.
+	while ( p < end )
+		{
+		auto sep = static_cast<const char*>(memchr(p, separator[0], end - p));
+
+		if ( ! sep )
+			sep = end;
+
+		parts->emplace_back(p, sep - p);
+		p = sep + 1;
+		}
+	}
+
+void Ascii::SendBatch()
+	{
+	if ( batch.empty() )
+		return;
+
+	Value*** vals = new Value**[batch.size()];
+	std::copy(batch.begin(), batch.end(), vals);
+
+	if ( Info().mode == MODE_STREAM )
+		Put(batch.size(), vals);
+	else
+		SendEntry(batch.size(), vals);
+
+	batch.clear();
+	}
+
 bool Ascii::ReadHeader(bool useCached)
 	{
 	// try to read the header line...
-	string line;
 	map<string, uint32_t> ifields;
 
 	if ( ! useCached )
 		{
-		if ( ! GetLine(line) )
+		string_view line;
+
+		if ( ! GetLine(&line) )
 			{
 			FailWarn(fail_on_file_problem, Fmt("Could not read input data file %s; first line could not be read",
 							   fname.c_str()), true);
@@ -180,21 +312,11 @@ bool Ascii::ReadHeader(bool useCached)
 		headerline = line;
 		}
 
-	else
-		line = headerline;
-
 	// construct list of field names.
-	istringstream splitstream(line);
-	int pos=0;
-	while ( splitstream )
-		{
-		string s;
-		if ( ! getline(splitstream, s, separator[0]))
-			break;
+	SplitLine(headerline, &line_fields);
 
-		ifields[s] = pos;
-		pos++;
-		}
+	for ( size_t pos = 0; pos < line_fields.size(); pos++ )
+		ifields[string(line_fields[pos])] = pos;
 
 	// printf("Updating fields from description %s\n", line.c_str());
 	columnMap.clear();
@@ -244,27 +366,59 @@ bool Ascii::ReadHeader(bool useCached)
 	return true;
 	}
 
-bool Ascii::GetLine(string& str)
+bool Ascii::GetLine(string_view* line)
 	{
-	while ( getline(file, str) )
+	while ( true )
 		{
-		if ( ! str.size() )
+		const char* start = data + data_pos;
+		size_t avail = data_len - data_pos;
+		auto nl = avail ? static_cast<const char*>(memchr(start, '\n', avail)) : nullptr;
+		string_view str;
+
+		if ( nl )
+			{
+			str = string_view(start, nl - start);
+			data_pos += str.size() + 1;
+			}
+
+		else if ( FillData() )
+			continue;
+
+		else
+			{
+			// Without more data, what's left is the last line -- unless
+			// the file is still being written to and just doesn't have
+			// the line's end yet.
+			avail = data_len - data_pos;
+
+			if ( ! avail || Info().mode == MODE_STREAM )
+				return false;
+
+			str = string_view(data + data_pos, avail);
+			data_pos += avail;
+			}
+
+		if ( str.empty() )
 			continue;
 
 		if ( str.back() == '\r' ) // deal with \r\n by removing \r
-			str.pop_back();
+			str.remove_suffix(1);
+
+		if ( str.empty() )
+			continue;
 
 		if ( str[0] != '#' )
+			{
+			*line = str;
 			return true;
+			}
 
 		if ( ( str.length() > 8 ) && ( str.compare(0,7, "#fields") == 0 ) && ( str[7] == separator[0] ) )
 			{
-			str = str.substr(8);
+			*line = str.substr(8);
 			return true;
 			}
 		}
-
-	return false;
 	}
 
 // read the entire file and send appropriate thingies back to InputMgr
@@ -282,7 +436,7 @@ bool Ascii::DoUpdate()
 				{
 				FailWarn(fail_on_file_problem, Fmt("Could not get stat for %s", fname.c_str()), true);
 
-				file.close();
+				CloseFile();
 				return ! fail_on_file_problem;
 				}
 
@@ -306,11 +460,10 @@ bool Ascii::DoUpdate()
 			{
 			// dirty, fix me. (well, apparently after trying seeking, etc
 			// - this is not that bad)
-			if ( file.is_open() )
+			if ( fd >= 0 )
 				{
 				if ( Info().mode == MODE_STREAM )
 					{
-					file.clear(); // remove end of file evil bits
 					if ( ! ReadHeader(true) )
 						{
 						return ! fail_on_file_problem; // header reading failed
@@ -319,7 +472,7 @@ bool Ascii::DoUpdate()
 					break;
 					}
 
-				file.close();
+				CloseFile();
 				}
 
 			OpenFile();
@@ -332,29 +485,16 @@ bool Ascii::DoUpdate()
 
 		}
 
-	string line;
+	string_view line;
+	string field;
 
-	file.sync();
-
-	while ( GetLine(line) )
+	while ( GetLine(&line) )
 		{
 		// split on tabs
 		bool error = false;
-		istringstream splitstream(line);
+		SplitLine(line, &line_fields);
 
-		map<int, string> stringfields;
-		int pos = 0;
-		while ( splitstream )
-			{
-			string s;
-			if ( ! getline(splitstream, s, separator[0]) )
-				break;
-
-			stringfields[pos] = s;
-			pos++;
-			}
-
-		pos--; // for easy comparisons of max element.
+		int pos = int(line_fields.size()) - 1; // for easy comparisons of max element.
 
 		Value** fields = new Value*[NumFields()];
 
@@ -377,7 +517,7 @@ bool Ascii::DoUpdate()
 			if ( (*fit).position > pos || (*fit).secondary_position > pos )
 				{
 				FailWarn(fail_on_invalid_lines, Fmt("Not enough fields in line '%s' of %s. Found %d fields, want positions %d and %d",
-				                                    line.c_str(), fname.c_str(), pos, (*fit).position, (*fit).secondary_position));
+				                                    string(line).c_str(), fname.c_str(), pos, (*fit).position, (*fit).secondary_position));
 
 				if ( fail_on_invalid_lines )
 					{
@@ -386,6 +526,7 @@ bool Ascii::DoUpdate()
 
 					delete [] fields;
 
+					SendBatch();
 					return false;
 					}
 				else
@@ -395,11 +536,12 @@ bool Ascii::DoUpdate()
 					}
 				}
 
-			Value* val = formatter->ParseValue(stringfields[(*fit).position], (*fit).name, (*fit).type, (*fit).subtype);
+			field.assign(line_fields[(*fit).position]);
+			Value* val = formatter->ParseValue(field, (*fit).name, (*fit).type, (*fit).subtype);
 
 			if ( ! val )
 				{
-				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.", line.c_str(), fname.c_str()));
+				Warning(Fmt("Could not convert line '%s' of %s to Val. Ignoring line.", string(line).c_str(), fname.c_str()));
 				error = true;
 				break;
 				}
@@ -410,7 +552,8 @@ bool Ascii::DoUpdate()
 				assert(val->type == zeek::TYPE_PORT );
 				//	Error(Fmt("Got type %d != PORT with secondary position!", val->type));
 
-				val->val.port_val.proto = formatter->ParseProto(stringfields[(*fit).secondary_position]);
+				field.assign(line_fields[(*fit).secondary_position]);
+				val->val.port_val.proto = formatter->ParseProto(field);
 				}
 
 			fields[fpos] = val;
@@ -434,12 +577,14 @@ bool Ascii::DoUpdate()
 		//printf("fpos: %d, second.num_fields: %d\n", fpos, (*it).second.num_fields);
 		assert ( fpos == NumFields() );
 
-		if ( Info().mode == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+		batch.push_back(fields);
+
+		if ( batch.size() >= MAX_BATCH_SIZE )
+			SendBatch();
 		}
 
+	SendBatch();
+
 	if ( Info().mode != MODE_STREAM )
 		EndCurrentSend();
 
@@ -2,10 +2,10 @@
 
 #pragma once
 
-#include <iostream>
 #include <vector>
-#include <fstream>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <sys/types.h>
 
 #include "input/ReaderBackend.h"
@@ -33,6 +33,10 @@ struct FieldMapping {
 
 /**
  * Reader for structured ASCII files.
+ *
+ * Regular files get memory-mapped and split into lines and fields in
+ * place; other files get read in chunks. Entries go to the main thread
+ * in batches.
  */
 class Ascii : public ReaderBackend {
 public:
@@ -55,13 +59,32 @@ protected:
 
 private:
 	bool ReadHeader(bool useCached);
-	bool GetLine(std::string& str);
+	bool GetLine(std::string_view* line);
 	bool OpenFile();
+	void CloseFile();
+	bool FillData();
+	void SplitLine(std::string_view line, std::vector<std::string_view>* parts) const;
+	void SendBatch();
 
-	std::ifstream file;
+	int fd;
 	time_t mtime;
 	ino_t ino;
 
+	// The file's data as far as we have it, with the unread part
+	// starting at data_pos. That's either a mapping of the file from
+	// map_offset on, or, if the file can't be mapped, the buffer.
+	const char* data;
+	size_t data_len;
+	size_t data_pos;
+	void* mapping;
+	off_t map_offset;
+	bool use_map;
+	std::string buffer;
+
+	// Fields split from the current line, and entries not yet sent.
+	std::vector<std::string_view> line_fields;
+	std::vector<threading::Value**> batch;
+
 	// The name using which we actually load the file -- compared
 	// to the input source name, this one may have a path_prefix
 	// attached to it.
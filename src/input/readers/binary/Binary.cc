@@ -2,6 +2,9 @@
 
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "Binary.h"
 #include "binary.bif.h"
 
@@ -14,6 +17,9 @@ using threading::Field;
 
 streamsize Binary::chunk_size = 0;
 
+// The number of chunks that go to the main thread in one message.
+static const size_t MAX_BATCH_SIZE = 100;
+
 Binary::Binary(ReaderFrontend *frontend)
 	: ReaderBackend(frontend), in(nullptr), mtime(0), ino(0), firstrun(true)
 	{
@@ -189,6 +195,22 @@ int Binary::UpdateModificationTime()
 	}
 
 // read the entire file and send appropriate thingies back to InputMgr
+void Binary::SendBatch(std::vector<Value**>* batch)
+	{
+	if ( batch->empty() )
+		return;
+
+	Value*** vals = new Value**[batch->size()];
+	std::copy(batch->begin(), batch->end(), vals);
+
+	if ( Info().mode == MODE_STREAM )
+		Put(batch->size(), vals);
+	else
+		SendEntry(batch->size(), vals);
+
+	batch->clear();
+	}
+
 bool Binary::DoUpdate()
 	{
 	if ( firstrun )
@@ -232,6 +254,9 @@ bool Binary::DoUpdate()
 		}
 		}
 
+	// Chunks go to the main thread in batches.
+	std::vector<Value**> batch;
+
 	char* chunk = nullptr;
 	streamsize size = 0;
 	while ( (size = GetChunk(&chunk)) )
@@ -246,12 +271,14 @@ bool Binary::DoUpdate()
 		val->val.string_val.length = size;
 		fields[0] = val;
 
-		if ( Info().mode == MODE_STREAM )
-			Put(fields);
-		else
-			SendEntry(fields);
+		batch.push_back(fields);
+
+		if ( batch.size() >= MAX_BATCH_SIZE )
+			SendBatch(&batch);
 		}
 
+	SendBatch(&batch);
+
 	if ( Info().mode != MODE_STREAM )
 		EndCurrentSend();
 
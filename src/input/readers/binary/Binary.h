@@ -3,6 +3,7 @@
 #pragma once
 
 #include <fstream>
+#include <vector>
 #include <sys/types.h>
 
 #include "input/ReaderBackend.h"
@@ -32,6 +33,7 @@ private:
 	bool CloseInput();
 	std::streamsize GetChunk(char** chunk);
 	int UpdateModificationTime();
+	void SendBatch(std::vector<threading::Value**>* batch);
 
 	std::string fname;
 	std::ifstream* in;
@@ -1,5 +1,6 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include <algorithm>
 #include <sstream>
 #include <unordered_set>
 
@@ -188,6 +189,11 @@ bool Config::DoUpdate()
 		return true;
 		}
 
+	// The changes get collected and then sent as one batch of entries and
+	// one batch of events, so that they take effect together.
+	std::vector<Value**> entries;
+	std::vector<Value**> events;
+
 	while ( GetLine(line) )
 		{
 		regmatch_t match[3];
@@ -235,14 +241,11 @@ bool Config::DoUpdate()
 		// (Yes, this means we keep all configuration options in memory twice - once here in
 		// the reader and once in memory in Bro; that is difficult to change.
 		auto search = option_values.find(key);
-		if ( search != option_values.end() && search->second == value )
-			{
-			delete eventval;
-			continue;
-			}
-
-		option_values[key] = value;
+		bool changed = (search == option_values.end() || search->second != value);
 
+		// When SendEntry() filters out unchanged entries itself, it needs
+		// to see them all to not expire them.
+		if ( changed || (Info().mode != MODE_STREAM && NumKeyFields()) )
 			{
 			Value** fields = new Value*[2];
 			Value* keyval = new threading::Value(zeek::TYPE_STRING, true);
@@ -253,13 +256,17 @@ bool Config::DoUpdate()
 			val->val.string_val.length = value.size();
 			val->val.string_val.data = copy_string(value.c_str());
 			fields[1] = val;
+			entries.push_back(fields);
+			}
 
-			if ( Info().mode  == MODE_STREAM )
-				Put(fields);
-			else
-				SendEntry(fields);
+		if ( ! changed )
+			{
+			delete eventval;
+			continue;
 			}
 
+		option_values[key] = value;
+
 			{
 			Value** vals = new Value*[4];
 			vals[0] = new Value(zeek::TYPE_STRING, true);
@@ -272,13 +279,25 @@ bool Config::DoUpdate()
 			vals[2]->val.string_val.data = copy_string(key.c_str());
 			vals[2]->val.string_val.length = key.size();
 			vals[3] = eventval;
-
-			SendEvent("InputConfig::new_value", 4, vals);
+			events.push_back(vals);
 			}
 		}
 
 	regfree(&re);
 
+	if ( ! entries.empty() )
+		{
+		Value*** vals = new Value**[entries.size()];
+		std::copy(entries.begin(), entries.end(), vals);
+
+		if ( Info().mode  == MODE_STREAM )
+			Put(entries.size(), vals);
+		else
+			SendEntry(entries.size(), vals);
+		}
+
+	SendEvents("InputConfig::new_value", 4, std::move(events));
+
 	if ( Info().mode != MODE_STREAM )
 		EndCurrentSend();
 
@@ -10,6 +10,8 @@
 #include <signal.h>
 #include <stdlib.h>
 
+#include <algorithm>
+
 #include "Raw.h"
 #include "Plugin.h"
 #include "raw.bif.h"
@@ -24,7 +26,10 @@ using namespace input::reader;
 using threading::Value;
 using threading::Field;
 
-const int Raw::block_size = 4096; // how big do we expect our chunks of data to be.
+const int Raw::block_size = 64 * 1024; // how much we read at a time, at least.
+
+// The number of records that go to the main thread in one message.
+static const size_t MAX_BATCH_SIZE = 1000;
 
 Raw::Raw(ReaderFrontend *frontend) : ReaderBackend(frontend), file(nullptr, fclose), stderrfile(nullptr, fclose)
 	{
@@ -39,8 +44,6 @@ Raw::Raw(ReaderFrontend *frontend) : ReaderBackend(frontend), file(nullptr, fclo
 
 	sep_length = zeek::BifConst::InputRaw::record_separator->Len();
 
-	bufpos = 0;
-
 	stdin_fileno = fileno(stdin);
 	stdout_fileno = fileno(stdout);
 	stderr_fileno = fileno(stderr);
@@ -315,9 +318,13 @@ bool Raw::CloseInput()
 #endif
 
 	file.reset(nullptr);
+	stdout_buf.Reset();
 
 	if ( use_stderr )
+		{
 		stderrfile.reset(nullptr);
+		stderr_buf.Reset();
+		}
 
 	if ( execute )
 		{
@@ -433,82 +440,101 @@ bool Raw::DoInit(const ReaderInfo& info, int num_fields, const Field* const* fie
 	return true;
 	}
 
-int64_t Raw::GetLine(FILE* arg_file)
+int64_t Raw::GetLine(FILE* arg_file, ReadBuffer* rb, char** line)
 	{
-	errno = 0;
-	int pos = 0; // strstr_n only works on ints - so no use to use something different here
-	int offset = 0;
-
-	if ( ! buf )
-		buf = std::unique_ptr<char[]>(new char[block_size]);
-
-	int repeats = 1;
+	// We read from the descriptor directly, into a buffer holding many
+	// records at once, rather than going through stdio.
+	int fd = fileno(arg_file);
 
 	for ( ;; )
 		{
-		size_t readbytes = fread(buf.get()+bufpos+offset, 1, block_size-bufpos, arg_file);
-		pos += bufpos + readbytes;
-		//printf("Pos: %d\n", pos);
-		bufpos = offset = 0; // read full block size in next read...
+		// A separator may have been split across reads, so look at
+		// everything after the last position it could have started.
+		int found = strstr_n(rb->end - rb->scanned, (const u_char*) rb->data.get() + rb->scanned,
+		                     sep_length, (const u_char*) separator.data());
 
-		if ( pos == 0 && errno != 0 )
-			break;
+		if ( found >= 0 )
+			{
+			size_t length = rb->scanned + found - rb->start;
+			*line = new char[length];
+			memcpy(*line, rb->data.get() + rb->start, length);
+			rb->start += length + sep_length;
+			rb->scanned = rb->start;
+			return length;
+			}
 
-		// researching everything each time is a bit... cpu-intensive. But otherwhise we have
-		// to deal with situations where the separator is multi-character and split over multiple
-		// reads...
-		int found = strstr_n(pos, (unsigned char*) buf.get(), separator.size(), (unsigned char*) separator.c_str());
+		if ( rb->end - rb->start >= sep_length )
+			rb->scanned = rb->end - sep_length + 1;
 
-		if ( found == -1 )
+		if ( rb->eof )
 			{
-			// we did not find it and have to search again in the next try. resize buffer....
-			// but first check if we encountered the file end - because if we did this was it.
-			if ( feof(arg_file) != 0 )
-				{
-				if ( pos == 0 )
-					return -1; // signal EOF - and that we had no more data.
-				else
-					{
-					outbuf = std::move(buf); // buf is null after this
-					return pos;
-					}
-				}
+			if ( rb->start == rb->end )
+				return -1; // signal EOF - and that we had no more data.
+
+			// Return what's left as the last record.
+			size_t length = rb->end - rb->start;
+			*line = new char[length];
+			memcpy(*line, rb->data.get() + rb->start, length);
+			rb->start = rb->scanned = rb->end;
+			return length;
+			}
 
-			repeats++;
-			// bah, we cannot use realloc because we would have to change the delete in the manager to a free.
-			std::unique_ptr<char[]> newbuf = std::unique_ptr<char[]>(new char[block_size*repeats]);
-			memcpy(newbuf.get(), buf.get(), block_size*(repeats-1));
-			buf = std::move(newbuf);
-			offset = block_size*(repeats-1);
+		// Make room for more data. Move what we have got to the front,
+		// and grow the buffer if a single record fills it.
+		if ( rb->start > 0 )
+			{
+			memmove(rb->data.get(), rb->data.get() + rb->start, rb->end - rb->start);
+			rb->end -= rb->start;
+			rb->scanned -= rb->start;
+			rb->start = 0;
 			}
-		else
+
+		if ( rb->end == rb->size )
 			{
-			outbuf = std::move(buf);
+			size_t new_size = rb->size ? rb->size * 2 : block_size;
+			std::unique_ptr<char[]> new_data(new char[new_size]);
 
-			if ( found < pos )
-				{
-				// we have leftovers. copy them into the buffer for the next line
-				buf = std::unique_ptr<char[]>(new char[block_size]);
-				memcpy(buf.get(), outbuf.get() + found + sep_length, pos - found - sep_length);
-				bufpos = pos - found - sep_length;
-				}
+			if ( rb->end )
+				memcpy(new_data.get(), rb->data.get(), rb->end);
 
-			return found;
+			rb->data = std::move(new_data);
+			rb->size = new_size;
 			}
 
-		}
+		ssize_t n = read(fd, rb->data.get() + rb->end, rb->size - rb->end);
 
-	if ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR )
-		return -2;
+		if ( n > 0 )
+			rb->end += n;
 
-	else
-		{
-		// an error code we did no expect. This probably is bad.
-		Error(Fmt("Reader encountered unexpected error code %d", errno));
-		return -3;
+		else if ( n == 0 )
+			rb->eof = true;
+
+		else if ( errno == EINTR )
+			continue;
+
+		else if ( errno == EAGAIN || errno == EWOULDBLOCK )
+			return -2;
+
+		else
+			{
+			// an error code we did no expect. This probably is bad.
+			Error(Fmt("Reader encountered unexpected error code %d", errno));
+			return -3;
+			}
 		}
 	}
 
+void Raw::SendBatch()
+	{
+	if ( batch.empty() )
+		return;
+
+	Value*** vals = new Value**[batch.size()];
+	std::copy(batch.begin(), batch.end(), vals);
+	Put(batch.size(), vals);
+	batch.clear();
+	}
+
 // write to the stdin of the child process
 void Raw::WriteToStdin()
 	{
@@ -570,7 +596,8 @@ bool Raw::DoUpdate()
 		case MODE_STREAM:
 			if ( Info().mode == MODE_STREAM && file )
 				{
-				clearerr(file.get());  // remove end of file evil bits
+				// Look for data appended since we hit the end.
+				stdout_buf.eof = false;
 				break;
 				}
 
@@ -592,11 +619,15 @@ bool Raw::DoUpdate()
 		if ( stdin_towrite > 0 )
 			WriteToStdin();
 
-		int64_t length = GetLine(file.get());
+		char* line;
+		int64_t length = GetLine(file.get(), &stdout_buf, &line);
 		//printf("Read %lld bytes\n", length);
 
 		if ( length == -3 )
+			{
+			SendBatch();
 			return false;
+			}
 
 		else if ( length == -2 || length == -1 )
 			// no data ready or eof
@@ -606,7 +637,7 @@ bool Raw::DoUpdate()
 
 		// filter has exactly one text field. convert to it.
 		Value* val = new Value(zeek::TYPE_STRING, true);
-		val->val.string_val.data = outbuf.release();
+		val->val.string_val.data = line;
 		val->val.string_val.length = length;
 		fields[0] = val;
 
@@ -617,34 +648,46 @@ bool Raw::DoUpdate()
 			fields[1] = bval;
 			}
 
-		Put(fields);
+		batch.push_back(fields);
+
+		if ( batch.size() >= MAX_BATCH_SIZE )
+			SendBatch();
 		}
 
 	if ( use_stderr )
 		{
 		for ( ;; )
 			{
-			int64_t length = GetLine(stderrfile.get());
+			char* line;
+			int64_t length = GetLine(stderrfile.get(), &stderr_buf, &line);
 			//printf("Read stderr %lld bytes\n", length);
 			if ( length == -3 )
+				{
+				SendBatch();
 				return false;
+				}
 
 			else if ( length == -2 || length == -1 )
 				break;
 
 			Value** fields = new Value*[2];
 			Value* val = new Value(zeek::TYPE_STRING, true);
-			val->val.string_val.data = outbuf.release();
+			val->val.string_val.data = line;
 			val->val.string_val.length = length;
 			fields[0] = val;
 			Value* bval = new Value(zeek::TYPE_BOOL, true);
 			bval->val.int_val = 1; // yes, we are stderr
 			fields[1] = bval;
 
-			Put(fields);
+			batch.push_back(fields);
+
+			if ( batch.size() >= MAX_BATCH_SIZE )
+				SendBatch();
 			}
 		}
 
+	SendBatch();
+
 	if ( ( Info().mode == MODE_MANUAL ) || ( Info().mode == MODE_REREAD ) )
 		// done with the current data source
 		EndCurrentSend();
@@ -14,6 +14,9 @@ namespace input { namespace reader {
 /**
  * A reader that returns a file (or the output of a command) as a single
  * blob.
+ *
+ * Data gets read in large blocks and split into records in place; records
+ * go to the main thread in batches.
  */
 class Raw : public ReaderBackend {
 public:
@@ -39,11 +42,24 @@ private:
 	bool SetFDFlags(int fd, int cmd, int flags);
 	std::unique_lock<std::mutex> AcquireForkMutex();
 
+	// Data read from a file or pipe but not yet returned as records.
+	struct ReadBuffer {
+		std::unique_ptr<char[]> data;
+		size_t size = 0;	// allocated size of data
+		size_t start = 0;	// start of the next record
+		size_t scanned = 0;	// no separator starts before this
+		size_t end = 0;	// end of the data read so far
+		bool eof = false;
+
+		void Reset()	{ start = scanned = end = 0; eof = false; }
+	};
+
 	bool OpenInput();
 	bool CloseInput();
-	int64_t GetLine(FILE* file);
+	int64_t GetLine(FILE* file, ReadBuffer* rb, char** line);
 	bool Execute();
 	void WriteToStdin();
+	void SendBatch();
 
 	std::string fname; // Source with a potential "|" removed.
 	std::unique_ptr<FILE, int(*)(FILE*)> file;
@@ -57,9 +73,11 @@ private:
 	std::string separator;
 	unsigned int sep_length; // length of the separator
 
-	int bufpos;
-	std::unique_ptr<char[]> buf;
-	std::unique_ptr<char[]> outbuf;
+	ReadBuffer stdout_buf;
+	ReadBuffer stderr_buf;
+
+	// Records not yet sent to the main thread.
+	std::vector<threading::Value**> batch;
 
 	int stdin_fileno;
 	int stdout_fileno;
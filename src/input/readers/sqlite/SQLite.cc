@@ -2,6 +2,7 @@
 
 #include "zeek-config.h"
 
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <sys/types.h>
@@ -19,6 +20,9 @@ using namespace input::reader;
 using threading::Value;
 using threading::Field;
 
+// The number of entries that go to the main thread in one message.
+static const size_t MAX_BATCH_SIZE = 1000;
+
 SQLite::SQLite(ReaderFrontend *frontend)
 	: ReaderBackend(frontend),
 	  fields(), num_fields(), mode(), started(), query(), db(), st()
@@ -52,6 +56,12 @@ void SQLite::DoClose()
 	sqlite3_finalize(st);
 	st = nullptr;
 
+	sqlite3_finalize(incremental_st);
+	incremental_st = nullptr;
+
+	sqlite3_value_free(watermark);
+	watermark = nullptr;
+
 	if ( db != 0 )
 		{
 		sqlite3_close(db);
@@ -82,12 +92,6 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	// allows simultaneous writes to one file.
 	sqlite3_enable_shared_cache(1);
 
-	if ( Info().mode != MODE_MANUAL )
-		{
-		Error("SQLite only supports manual reading mode.");
-		return false;
-		}
-
 	started = false;
 
 	std::string fullpath(info.source);
@@ -103,6 +107,17 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	else
 		query = it->second;
 
+	std::string watermark_name;
+	it = info.config.find("watermark");
+	if ( it != info.config.end() )
+		watermark_name = it->second;
+
+	if ( Info().mode != MODE_MANUAL && ! (Info().mode == MODE_STREAM && ! watermark_name.empty()) )
+		{
+		Error("SQLite only supports manual reading mode, or streaming mode with a watermark column.");
+		return false;
+		}
+
 	if ( checkError(sqlite3_open_v2(
 					fullpath.c_str(),
 					&db,
@@ -115,12 +130,53 @@ bool SQLite::DoInit(const ReaderInfo& info, int arg_num_fields, const threading:
 	num_fields = arg_num_fields;
 	fields = arg_fields;
 
+	if ( ! watermark_name.empty() )
+		{
+		// Wrap the query so that we can order its results by the
+		// watermark and, for later reads, restrict them to the rows
+		// past it. That requires dropping any trailing semicolon.
+		std::string::size_type end = query.find_last_not_of("; \t\r\n");
+		query.erase(end == std::string::npos ? 0 : end + 1);
+
+		char* column = sqlite3_mprintf("\"%w\"", watermark_name.c_str());
+		if ( column == 0 )
+			{
+			InternalError("Could not malloc memory");
+			return false;
+			}
+
+		std::string incremental = "SELECT * FROM (" + query + ") WHERE " + column + " > ?1 ORDER BY " + column + ";";
+		query = "SELECT * FROM (" + query + ") ORDER BY " + column + ";";
+		sqlite3_free(column);
+
+		if ( checkError(sqlite3_prepare_v2(db, incremental.c_str(), incremental.size()+1, &incremental_st, NULL)) )
+			return false;
+		}
+
 	// create the prepared select statement that we will re-use forever...
 	if ( checkError(sqlite3_prepare_v2( db, query.c_str(), query.size()+1, &st, NULL )) )
 		{
 		return false;
 		}
 
+	if ( ! watermark_name.empty() )
+		{
+		for ( int i = 0; i < sqlite3_column_count(st); ++i )
+			{
+			if ( watermark_name == sqlite3_column_name(st, i) )
+				{
+				watermark_column = i;
+				break;
+				}
+			}
+
+		if ( watermark_column == -1 )
+			{
+			Error(Fmt("Watermark column %s not found after SQLite statement", watermark_name.c_str()));
+			return false;
+			}
+		}
+
 	DoUpdate();
 
 	return true;
@@ -247,22 +303,17 @@ Value* SQLite::EntryToVal(sqlite3_stmt *st, const threading::Field *field, int p
 
 	}
 
-bool SQLite::DoUpdate()
+bool SQLite::MapColumns(sqlite3_stmt* stmt)
 	{
-	int numcolumns = sqlite3_column_count(st);
-	int *mapping = new int [num_fields];
-	int *submapping = new int [num_fields];
+	int numcolumns = sqlite3_column_count(stmt);
 
 	// first set them all to -1
-	for ( unsigned int i = 0; i < num_fields; ++i )
-		{
-		mapping[i] = -1;
-		submapping[i] = -1;
-		}
+	mapping.assign(num_fields, -1);
+	submapping.assign(num_fields, -1);
 
 	for ( int i = 0; i < numcolumns; ++i )
 		{
-		const char *name = sqlite3_column_name(st, i);
+		const char *name = sqlite3_column_name(stmt, i);
 
 		for ( unsigned j = 0; j < num_fields; j++ )
 			{
@@ -271,8 +322,6 @@ bool SQLite::DoUpdate()
 				if ( mapping[j] != -1 )
 					{
 					Error(Fmt("SQLite statement returns several columns with name %s! Cannot decide which to choose, aborting", name));
-					delete [] mapping;
-					delete [] submapping;
 					return false;
 					}
 
@@ -285,8 +334,6 @@ bool SQLite::DoUpdate()
 				if ( submapping[j] != -1 )
 					{
 					Error(Fmt("SQLite statement returns several columns with name %s! Cannot decide which to choose, aborting", name));
-					delete [] mapping;
-					delete [] submapping;
 					return false;
 					}
 
@@ -300,45 +347,117 @@ bool SQLite::DoUpdate()
 		if ( mapping[i] == -1 )
 			{
 			Error(Fmt("Required field %s not found after SQLite statement", fields[i]->name));
-			delete [] mapping;
-			delete [] submapping;
 			return false;
 			}
 		}
 
+	return true;
+	}
+
+void SQLite::SendBatch()
+	{
+	if ( batch.empty() )
+		return;
+
+	Value*** vals = new Value**[batch.size()];
+	std::copy(batch.begin(), batch.end(), vals);
+
+	// Incremental reads only see new rows, so entries must not get
+	// expired for missing from them.
+	if ( incremental_st )
+		Put(batch.size(), vals);
+	else
+		SendEntry(batch.size(), vals);
+
+	batch.clear();
+	}
+
+bool SQLite::DoUpdate()
+	{
+	if ( ! MapColumns(st) )
+		return false;
+
+	// Once we have seen rows, only fetch the ones past the watermark.
+	sqlite3_stmt* stmt = st;
+
+	if ( watermark )
+		{
+		stmt = incremental_st;
+
+		if ( checkError(sqlite3_bind_value(stmt, 1, watermark)) )
+			return false;
+		}
+
+	// The watermark column's value in the last row; the rows come
+	// ordered by it.
+	sqlite3_value* last = nullptr;
+
 	int errorcode;
-	while ( ( errorcode = sqlite3_step(st)) == SQLITE_ROW )
+	while ( ( errorcode = sqlite3_step(stmt)) == SQLITE_ROW )
 		{
 		Value** ofields = new Value*[num_fields];
 
 		for ( unsigned int j = 0; j < num_fields; ++j)
 			{
-			ofields[j] = EntryToVal(st, fields[j], mapping[j], submapping[j]);
+			ofields[j] = EntryToVal(stmt, fields[j], mapping[j], submapping[j]);
 			if ( ! ofields[j] )
 				{
 				for ( unsigned int k = 0; k < j; ++k )
 					delete ofields[k];
 
 				delete [] ofields;
-				delete [] mapping;
-				delete [] submapping;
+				sqlite3_value_free(last);
+				SendBatch();
+				sqlite3_reset(stmt);
 				return false;
 				}
 			}
 
-		SendEntry(ofields);
+		if ( watermark_column != -1 )
+			{
+			sqlite3_value_free(last);
+			last = sqlite3_value_dup(sqlite3_column_value(stmt, watermark_column));
+			}
+
+		batch.push_back(ofields);
+
+		if ( batch.size() >= MAX_BATCH_SIZE )
+			SendBatch();
 		}
 
-	delete [] mapping;
-	delete [] submapping;
+	SendBatch();
 
 	if ( checkError(errorcode) ) // check the last error code returned by sqlite
+		{
+		sqlite3_value_free(last);
 		return false;
+		}
 
-	EndCurrentSend();
+	// All rows having NULL there would stop any further rows from
+	// qualifying, so keep the previous watermark in that case.
+	if ( last && sqlite3_value_type(last) != SQLITE_NULL )
+		{
+		sqlite3_value_free(watermark);
+		watermark = last;
+		}
+	else
+		sqlite3_value_free(last);
 
-	if ( checkError(sqlite3_reset(st)) )
+	if ( ! incremental_st )
+		EndCurrentSend();
+	else if ( Info().mode == MODE_MANUAL )
+		EndOfData();
+
+	if ( checkError(sqlite3_reset(stmt)) )
 		return false;
 
 	return true;
 	}
+
+bool SQLite::DoHeartbeat(double network_time, double current_time)
+	{
+	if ( Info().mode == MODE_STREAM )
+		return DoUpdate();
+
+	return true;
+	}
@@ -13,6 +13,13 @@
 
 namespace input { namespace reader {
 
+/**
+ * Reader for SQLite databases, running a query from the stream's config.
+ *
+ * With a watermark column configured, only the first read runs the full
+ * query; later ones fetch only rows with a larger value in that column.
+ * Entries go to the main thread in batches.
+ */
 class SQLite : public ReaderBackend {
 public:
 	explicit SQLite(ReaderFrontend* frontend);
@@ -24,10 +31,12 @@ protected:
 	bool DoInit(const ReaderInfo& info, int arg_num_fields, const threading::Field* const* arg_fields) override;
 	void DoClose() override;
 	bool DoUpdate() override;
-	bool DoHeartbeat(double network_time, double current_time) override { return true; }
+	bool DoHeartbeat(double network_time, double current_time) override;
 
 private:
 	bool checkError(int code);
+	bool MapColumns(sqlite3_stmt* stmt);
+	void SendBatch();
 
 	threading::Value* EntryToVal(sqlite3_stmt *st, const threading::Field *field, int pos, int subpos);
 
@@ -38,6 +47,20 @@ private:
 	std::string query;
 	sqlite3 *db;
 	sqlite3_stmt *st;
+
+	// For incremental reads, the statement fetching rows past the
+	// watermark, the watermark column's position in the results and the
+	// largest value seen in it so far.
+	sqlite3_stmt* incremental_st = nullptr;
+	int watermark_column = -1;
+	sqlite3_value* watermark = nullptr;
+
+	// Result columns for the fields, and for the ports' protocols.
+	std::vector<int> mapping;
+	std::vector<int> submapping;
+
+	// Entries not yet sent to the main thread.
+	std::vector<threading::Value**> batch;
 	threading::formatter::Ascii* io;
 
 	std::string set_separator;
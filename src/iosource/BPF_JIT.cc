@@ -0,0 +1,828 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "BPF_JIT.h"
+
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "3rdparty/doctest.h"
+
+#if defined(__x86_64__) && defined(MAP_ANONYMOUS)
+#define HAVE_BPF_JIT
+#endif
+
+#ifdef HAVE_BPF_JIT
+
+namespace {
+
+// Number of scratch memory words, as with BPF_MEMWORDS.
+constexpr int MEM_WORDS = 16;
+
+// Upper bound of the code a single BPF instruction translates into.
+constexpr size_t MAX_INSN_CODE = 64;
+
+// Size of the prologue and epilogue together.
+constexpr size_t FRAME_CODE = 32 + 4 * MEM_WORDS;
+
+// Register usage: A lives in eax, X in ebx. The arguments come in as
+// rdi (the packet), esi (its wire length) and edx (its captured length),
+// with the latter moved to ebp since division clobbers edx. ecx and edx
+// serve as temporaries, and the scratch memory lives on the stack.
+class Emitter {
+public:
+	Emitter(const struct bpf_insn* arg_insns, size_t arg_num_insns)
+		: insns(arg_insns), num_insns(arg_num_insns),
+		  insn_offsets(arg_num_insns)
+		{ }
+
+	// Translates the program into buf, which needs room for Bound()
+	// bytes. Returns the size of the code, or zero if the program
+	// uses anything unsupported.
+	size_t Translate(uint8_t* buf);
+
+	size_t Bound() const
+		{ return num_insns * MAX_INSN_CODE + FRAME_CODE; }
+
+private:
+	// Targets of jumps besides instructions.
+	enum Label : size_t {
+		FAIL = static_cast<size_t>(-1),	// returns zero
+		EPILOGUE = static_cast<size_t>(-2),	// returns A
+	};
+
+	struct Fixup {
+		size_t pos;	// of the rel32 to patch
+		size_t target;	// instruction index or Label
+	};
+
+	bool TranslateInsn(size_t pc, const struct bpf_insn& insn);
+
+	// Emits a conditional jump for a comparison that has been emitted
+	// already; cc is the condition's opcode byte following 0x0f.
+	void CondJump(size_t pc, const struct bpf_insn& insn, uint8_t cc);
+
+	// Emits the check that a load of size bytes at constant offset k
+	// stays within the captured data.
+	void CheckAbs(uint32_t k, uint32_t size);
+
+	// Computes X + k into rcx and emits the check that a load of size
+	// bytes there stays within the captured data.
+	void CheckInd(uint32_t k, uint32_t size);
+
+	void Byte(uint8_t b)	{ buf[len++] = b; }
+
+	void Bytes(std::initializer_list<uint8_t> bytes)
+		{
+		for ( auto b : bytes )
+			Byte(b);
+		}
+
+	void Imm32(uint32_t v)
+		{
+		memcpy(buf + len, &v, sizeof(v));
+		len += sizeof(v);
+		}
+
+	// Emits a jump with a 32-bit displacement to be patched once all
+	// targets are known. Pass 0xe9 for an unconditional jump, or a
+	// condition's opcode byte following 0x0f.
+	void Jump(uint8_t op, size_t target)
+		{
+		if ( op == 0xe9 )
+			Byte(0xe9);
+		else
+			Bytes({0x0f, op});
+
+		fixups.push_back({len, target});
+		Imm32(0);
+		}
+
+	const struct bpf_insn* insns;
+	size_t num_insns;
+
+	uint8_t* buf = nullptr;
+	size_t len = 0;
+
+	std::vector<size_t> insn_offsets;
+	std::vector<Fixup> fixups;
+	size_t fail_offset = 0;
+	size_t epilogue_offset = 0;
+};
+
+// Condition opcodes following 0x0f for the jumps we use.
+enum : uint8_t {
+	JB = 0x82, JAE = 0x83, JE = 0x84, JNE = 0x85, JBE = 0x86, JA = 0x87,
+};
+
+uint8_t negate(uint8_t cc)
+	{
+	// The x86 condition codes come in pairs differing in the lowest bit.
+	return cc ^ 1;
+	}
+
+size_t Emitter::Translate(uint8_t* arg_buf)
+	{
+	buf = arg_buf;
+	len = 0;
+
+	// push rbx; push rbp; sub rsp, 4 * MEM_WORDS; mov ebp, edx;
+	// xor eax, eax; xor ebx, ebx
+	Bytes({0x53, 0x55, 0x48, 0x83, 0xec, 4 * MEM_WORDS, 0x89, 0xd5,
+	       0x31, 0xc0, 0x31, 0xdb});
+
+	// Scratch memory that gets read starts out as zero, so that the
+	// result never depends on what's on the stack.
+	bool read[MEM_WORDS] = { false };
+
+	for ( size_t pc = 0; pc < num_insns; ++pc )
+		if ( insns[pc].code == (BPF_LD|BPF_MEM) ||
+		     insns[pc].code == (BPF_LDX|BPF_MEM) )
+			read[insns[pc].k] = true;
+
+	for ( int i = 0; i < MEM_WORDS; ++i )
+		if ( read[i] )
+			// mov [rsp + 4i], eax
+			Bytes({0x89, 0x44, 0x24, static_cast<uint8_t>(4 * i)});
+
+	for ( size_t pc = 0; pc < num_insns; ++pc )
+		{
+		insn_offsets[pc] = len;
+
+		if ( ! TranslateInsn(pc, insns[pc]) )
+			return 0;
+		}
+
+	// xor eax, eax
+	fail_offset = len;
+	Bytes({0x31, 0xc0});
+
+	// add rsp, 4 * MEM_WORDS; pop rbp; pop rbx; ret
+	epilogue_offset = len;
+	Bytes({0x48, 0x83, 0xc4, 4 * MEM_WORDS, 0x5d, 0x5b, 0xc3});
+
+	for ( const auto& f : fixups )
+		{
+		size_t target;
+
+		if ( f.target == FAIL )
+			target = fail_offset;
+		else if ( f.target == EPILOGUE )
+			target = epilogue_offset;
+		else
+			target = insn_offsets[f.target];
+
+		int32_t rel = static_cast<int32_t>(target - (f.pos + 4));
+		memcpy(buf + f.pos, &rel, sizeof(rel));
+		}
+
+	return len;
+	}
+
+void Emitter::CheckAbs(uint32_t k, uint32_t size)
+	{
+	// Offsets beyond what fits a signed displacement are beyond any
+	// captured data, too.
+	if ( k > 0x7fffffff - size )
+		{
+		Jump(0xe9, FAIL);
+		return;
+		}
+
+	// cmp ebp, k + size; jb FAIL
+	Bytes({0x81, 0xfd});
+	Imm32(k + size);
+	Jump(JB, FAIL);
+	}
+
+void Emitter::CheckInd(uint32_t k, uint32_t size)
+	{
+	if ( k > 0x7fffffff )
+		{
+		Jump(0xe9, FAIL);
+		return;
+		}
+
+	// mov ecx, ebx; add rcx, k; lea rdx, [rcx + size]; cmp rdx, rbp;
+	// ja FAIL. Writing ecx clears the upper half of rcx, and ebp's was
+	// cleared by the prologue's mov, so this can't overflow.
+	Bytes({0x89, 0xd9, 0x48, 0x81, 0xc1});
+	Imm32(k);
+	Bytes({0x48, 0x8d, 0x51, static_cast<uint8_t>(size), 0x48, 0x39, 0xea});
+	Jump(JA, FAIL);
+	}
+
+void Emitter::CondJump(size_t pc, const struct bpf_insn& insn, uint8_t cc)
+	{
+	size_t jt = pc + 1 + insn.jt;
+	size_t jf = pc + 1 + insn.jf;
+
+	if ( jt == jf )
+		{
+		if ( jt != pc + 1 )
+			Jump(0xe9, jt);
+		}
+
+	else if ( jt == pc + 1 )
+		Jump(negate(cc), jf);
+
+	else
+		{
+		Jump(cc, jt);
+
+		if ( jf != pc + 1 )
+			Jump(0xe9, jf);
+		}
+	}
+
+bool Emitter::TranslateInsn(size_t pc, const struct bpf_insn& insn)
+	{
+	uint32_t k = insn.k;
+
+	switch ( insn.code ) {
+	case BPF_RET|BPF_K:
+		// mov eax, k; jmp EPILOGUE
+		Byte(0xb8);
+		Imm32(k);
+		Jump(0xe9, EPILOGUE);
+		break;
+
+	case BPF_RET|BPF_A:
+		Jump(0xe9, EPILOGUE);
+		break;
+
+	case BPF_LD|BPF_W|BPF_ABS:
+		// mov eax, [rdi + k]; bswap eax
+		CheckAbs(k, 4);
+		Bytes({0x8b, 0x87});
+		Imm32(k);
+		Bytes({0x0f, 0xc8});
+		break;
+
+	case BPF_LD|BPF_H|BPF_ABS:
+		// movzx eax, word [rdi + k]; rol ax, 8
+		CheckAbs(k, 2);
+		Bytes({0x0f, 0xb7, 0x87});
+		Imm32(k);
+		Bytes({0x66, 0xc1, 0xc0, 0x08});
+		break;
+
+	case BPF_LD|BPF_B|BPF_ABS:
+		// movzx eax, byte [rdi + k]
+		CheckAbs(k, 1);
+		Bytes({0x0f, 0xb6, 0x87});
+		Imm32(k);
+		break;
+
+	case BPF_LD|BPF_W|BPF_IND:
+		// mov eax, [rdi + rcx]; bswap eax
+		CheckInd(k, 4);
+		Bytes({0x8b, 0x04, 0x0f, 0x0f, 0xc8});
+		break;
+
+	case BPF_LD|BPF_H|BPF_IND:
+		// movzx eax, word [rdi + rcx]; rol ax, 8
+		CheckInd(k, 2);
+		Bytes({0x0f, 0xb7, 0x04, 0x0f, 0x66, 0xc1, 0xc0, 0x08});
+		break;
+
+	case BPF_LD|BPF_B|BPF_IND:
+		// movzx eax, byte [rdi + rcx]
+		CheckInd(k, 1);
+		Bytes({0x0f, 0xb6, 0x04, 0x0f});
+		break;
+
+	case BPF_LDX|BPF_MSH|BPF_B:
+		// movzx ebx, byte [rdi + k]; and ebx, 0xf; shl ebx, 2
+		CheckAbs(k, 1);
+		Bytes({0x0f, 0xb6, 0x9f});
+		Imm32(k);
+		Bytes({0x83, 0xe3, 0x0f, 0xc1, 0xe3, 0x02});
+		break;
+
+	case BPF_LD|BPF_W|BPF_LEN:
+		// mov eax, esi
+		Bytes({0x89, 0xf0});
+		break;
+
+	case BPF_LDX|BPF_W|BPF_LEN:
+		// mov ebx, esi
+		Bytes({0x89, 0xf3});
+		break;
+
+	case BPF_LD|BPF_IMM:
+		// mov eax, k
+		Byte(0xb8);
+		Imm32(k);
+		break;
+
+	case BPF_LDX|BPF_IMM:
+		// mov ebx, k
+		Byte(0xbb);
+		Imm32(k);
+		break;
+
+	case BPF_LD|BPF_MEM:
+		// mov eax, [rsp + 4k]
+		Bytes({0x8b, 0x44, 0x24, static_cast<uint8_t>(4 * k)});
+		break;
+
+	case BPF_LDX|BPF_MEM:
+		// mov ebx, [rsp + 4k]
+		Bytes({0x8b, 0x5c, 0x24, static_cast<uint8_t>(4 * k)});
+		break;
+
+	case BPF_ST:
+		// mov [rsp + 4k], eax
+		Bytes({0x89, 0x44, 0x24, static_cast<uint8_t>(4 * k)});
+		break;
+
+	case BPF_STX:
+		// mov [rsp + 4k], ebx
+		Bytes({0x89, 0x5c, 0x24, static_cast<uint8_t>(4 * k)});
+		break;
+
+	case BPF_JMP|BPF_JA:
+		Jump(0xe9, pc + 1 + k);
+		break;
+
+	case BPF_JMP|BPF_JEQ|BPF_K:
+	case BPF_JMP|BPF_JGT|BPF_K:
+	case BPF_JMP|BPF_JGE|BPF_K:
+		// cmp eax, k
+		Byte(0x3d);
+		Imm32(k);
+		CondJump(pc, insn, BPF_OP(insn.code) == BPF_JEQ ? JE :
+		                   BPF_OP(insn.code) == BPF_JGT ? JA : JAE);
+		break;
+
+	case BPF_JMP|BPF_JSET|BPF_K:
+		// test eax, k
+		Byte(0xa9);
+		Imm32(k);
+		CondJump(pc, insn, JNE);
+		break;
+
+	case BPF_JMP|BPF_JEQ|BPF_X:
+	case BPF_JMP|BPF_JGT|BPF_X:
+	case BPF_JMP|BPF_JGE|BPF_X:
+		// cmp eax, ebx
+		Bytes({0x39, 0xd8});
+		CondJump(pc, insn, BPF_OP(insn.code) == BPF_JEQ ? JE :
+		                   BPF_OP(insn.code) == BPF_JGT ? JA : JAE);
+		break;
+
+	case BPF_JMP|BPF_JSET|BPF_X:
+		// test eax, ebx
+		Bytes({0x85, 0xd8});
+		CondJump(pc, insn, JNE);
+		break;
+
+	case BPF_ALU|BPF_ADD|BPF_K:
+		Byte(0x05);
+		Imm32(k);
+		break;
+
+	case BPF_ALU|BPF_SUB|BPF_K:
+		Byte(0x2d);
+		Imm32(k);
+		break;
+
+	case BPF_ALU|BPF_AND|BPF_K:
+		Byte(0x25);
+		Imm32(k);
+		break;
+
+	case BPF_ALU|BPF_OR|BPF_K:
+		Byte(0x0d);
+		Imm32(k);
+		break;
+
+#ifdef BPF_XOR
+	case BPF_ALU|BPF_XOR|BPF_K:
+		Byte(0x35);
+		Imm32(k);
+		break;
+#endif
+
+	case BPF_ALU|BPF_MUL|BPF_K:
+		// imul eax, eax, k
+		Bytes({0x69, 0xc0});
+		Imm32(k);
+		break;
+
+	case BPF_ALU|BPF_DIV|BPF_K:
+#ifdef BPF_MOD
+	case BPF_ALU|BPF_MOD|BPF_K:
+#endif
+		// Rejected by the validator.
+		if ( k == 0 )
+			return false;
+
+		// mov ecx, k; xor edx, edx; div ecx
+		Byte(0xb9);
+		Imm32(k);
+		Bytes({0x31, 0xd2, 0xf7, 0xf1});
+
+		if ( BPF_OP(insn.code) != BPF_DIV )
+			// mov eax, edx
+			Bytes({0x89, 0xd0});
+		break;
+
+	case BPF_ALU|BPF_LSH|BPF_K:
+	case BPF_ALU|BPF_RSH|BPF_K:
+		if ( k >= 32 )
+			// xor eax, eax
+			Bytes({0x31, 0xc0});
+		else
+			// shl/shr eax, k
+			Bytes({0xc1, static_cast<uint8_t>(BPF_OP(insn.code) == BPF_LSH ? 0xe0 : 0xe8),
+			       static_cast<uint8_t>(k)});
+		break;
+
+	case BPF_ALU|BPF_ADD|BPF_X:
+		Bytes({0x01, 0xd8});
+		break;
+
+	case BPF_ALU|BPF_SUB|BPF_X:
+		Bytes({0x29, 0xd8});
+		break;
+
+	case BPF_ALU|BPF_AND|BPF_X:
+		Bytes({0x21, 0xd8});
+		break;
+
+	case BPF_ALU|BPF_OR|BPF_X:
+		Bytes({0x09, 0xd8});
+		break;
+
+#ifdef BPF_XOR
+	case BPF_ALU|BPF_XOR|BPF_X:
+		Bytes({0x31, 0xd8});
+		break;
+#endif
+
+	case BPF_ALU|BPF_MUL|BPF_X:
+		// imul eax, ebx
+		Bytes({0x0f, 0xaf, 0xc3});
+		break;
+
+	case BPF_ALU|BPF_DIV|BPF_X:
+#ifdef BPF_MOD
+	case BPF_ALU|BPF_MOD|BPF_X:
+#endif
+		// test ebx, ebx; jz FAIL; xor edx, edx; div ebx
+		Bytes({0x85, 0xdb});
+		Jump(JE, FAIL);
+		Bytes({0x31, 0xd2, 0xf7, 0xf3});
+
+		if ( BPF_OP(insn.code) != BPF_DIV )
+			// mov eax, edx
+			Bytes({0x89, 0xd0});
+		break;
+
+	case BPF_ALU|BPF_LSH|BPF_X:
+	case BPF_ALU|BPF_RSH|BPF_X:
+		// mov ecx, ebx; shl/shr eax, cl; cmp ebx, 32; jb +2;
+		// xor eax, eax. Like libpcap, shifting by 32 or more
+		// yields zero.
+		Bytes({0x89, 0xd9, 0xd3,
+		       static_cast<uint8_t>(BPF_OP(insn.code) == BPF_LSH ? 0xe0 : 0xe8),
+		       0x83, 0xfb, 0x20, 0x72, 0x02, 0x31, 0xc0});
+		break;
+
+	case BPF_ALU|BPF_NEG:
+		// neg eax
+		Bytes({0xf7, 0xd8});
+		break;
+
+	case BPF_MISC|BPF_TAX:
+		// mov ebx, eax
+		Bytes({0x89, 0xc3});
+		break;
+
+	case BPF_MISC|BPF_TXA:
+		// mov eax, ebx
+		Bytes({0x89, 0xd8});
+		break;
+
+	default:
+		return false;
+	}
+
+	return true;
+	}
+
+// Checks what the translation relies on: that jumps stay within the
+// program, which ends in a return, and that scratch memory accesses stay
+// within bounds.
+bool valid_program(const struct bpf_insn* insns, size_t n)
+	{
+	if ( n == 0 || n > BPF_MAXINSNS )
+		return false;
+
+	for ( size_t pc = 0; pc < n; ++pc )
+		{
+		const auto& insn = insns[pc];
+
+		switch ( BPF_CLASS(insn.code) ) {
+		case BPF_JMP:
+			if ( BPF_OP(insn.code) == BPF_JA )
+				{
+				if ( insn.k >= n - pc - 1 )
+					return false;
+				}
+
+			else if ( insn.jt >= n - pc - 1 || insn.jf >= n - pc - 1 )
+				return false;
+
+			break;
+
+		case BPF_LD:
+		case BPF_LDX:
+			if ( BPF_MODE(insn.code) == BPF_MEM && insn.k >= MEM_WORDS )
+				return false;
+
+			break;
+
+		case BPF_ST:
+		case BPF_STX:
+			if ( insn.k >= MEM_WORDS )
+				return false;
+
+			break;
+		}
+		}
+
+	return BPF_CLASS(insns[n - 1].code) == BPF_RET;
+	}
+
+} // namespace
+
+#endif
+
+BPF_JIT::~BPF_JIT()
+	{
+	Free();
+	}
+
+void BPF_JIT::Free()
+	{
+#ifdef HAVE_BPF_JIT
+	if ( code )
+		munmap(code, code_size);
+#endif
+
+	func = nullptr;
+	code = nullptr;
+	code_size = 0;
+	}
+
+bool BPF_JIT::Compile(const struct bpf_program* program)
+	{
+	Free();
+
+#ifdef HAVE_BPF_JIT
+	if ( ! program || ! valid_program(program->bf_insns, program->bf_len) )
+		return false;
+
+	Emitter e(program->bf_insns, program->bf_len);
+	std::vector<uint8_t> buf(e.Bound());
+	size_t len = e.Translate(buf.data());
+
+	if ( len == 0 )
+		return false;
+
+	void* mem = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+	                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if ( mem == MAP_FAILED )
+		return false;
+
+	memcpy(mem, buf.data(), len);
+
+	if ( mprotect(mem, len, PROT_READ | PROT_EXEC) < 0 )
+		{
+		munmap(mem, len);
+		return false;
+		}
+
+	code = mem;
+	code_size = len;
+	func = reinterpret_cast<Func>(mem);
+	return true;
+#else
+	return false;
+#endif
+	}
+
+TEST_SUITE_BEGIN("BPF_JIT");
+
+namespace {
+
+// Builds an Ethernet frame, optionally VLAN-tagged, carrying the given
+// network layer.
+std::vector<u_char> ether(uint16_t type, const std::vector<u_char>& payload,
+                          int vlan = -1)
+	{
+	std::vector<u_char> pkt(12, 0x02);
+
+	if ( vlan >= 0 )
+		pkt.insert(pkt.end(), {0x81, 0x00, u_char(vlan >> 8), u_char(vlan)});
+
+	pkt.insert(pkt.end(), {u_char(type >> 8), u_char(type)});
+	pkt.insert(pkt.end(), payload.begin(), payload.end());
+	return pkt;
+	}
+
+// A TCP or UDP header, followed by some payload.
+std::vector<u_char> transport(uint8_t proto, uint16_t sport, uint16_t dport)
+	{
+	std::vector<u_char> l4 = {u_char(sport >> 8), u_char(sport),
+	                          u_char(dport >> 8), u_char(dport)};
+
+	if ( proto == IPPROTO_TCP )
+		l4.insert(l4.end(), {0, 0, 0, 1, 0, 0, 0, 0, 0x50, 0x02, 0xff, 0xff,
+		                     0, 0, 0, 0});
+	else
+		l4.insert(l4.end(), {0, 28, 0, 0});
+
+	l4.insert(l4.end(), 20, 0xab);
+	return l4;
+	}
+
+std::vector<u_char> ipv4(uint8_t proto, uint16_t sport, uint16_t dport,
+                         uint16_t frag = 0, int options = 0)
+	{
+	auto l4 = transport(proto, sport, dport);
+	int hdr_len = 20 + 4 * options;
+	int len = hdr_len + l4.size();
+
+	std::vector<u_char> ip = {u_char(0x45 + options), 0, u_char(len >> 8), u_char(len),
+	                          0, 1, u_char(frag >> 8), u_char(frag), 64, proto, 0, 0,
+	                          10, 0, 0, 1, 192, 168, 1, 2};
+	ip.insert(ip.end(), 4 * options, 0x01);
+	ip.insert(ip.end(), l4.begin(), l4.end());
+	return ether(0x0800, ip);
+	}
+
+std::vector<u_char> ipv6(uint8_t proto, uint16_t sport, uint16_t dport)
+	{
+	auto l4 = transport(proto, sport, dport);
+	std::vector<u_char> ip = {0x60, 0, 0, 0, 0, u_char(l4.size()), proto, 64};
+	ip.insert(ip.end(), {0x20, 0x01, 0x0d, 0xb8});
+	ip.insert(ip.end(), 11, 0);
+	ip.push_back(1);
+	ip.insert(ip.end(), {0x20, 0x01, 0x0d, 0xb8});
+	ip.insert(ip.end(), 11, 0);
+	ip.push_back(2);
+	ip.insert(ip.end(), l4.begin(), l4.end());
+	return ether(0x86dd, ip);
+	}
+
+std::vector<std::vector<u_char>> test_packets()
+	{
+	auto vlan_udp = ipv4(IPPROTO_UDP, 1500, 53);
+	vlan_udp = ether(0x0800, std::vector<u_char>(vlan_udp.begin() + 14, vlan_udp.end()), 10);
+
+	return {
+		ipv4(IPPROTO_TCP, 1234, 80),
+		ipv4(IPPROTO_TCP, 512, 1500),
+		ipv4(IPPROTO_TCP, 2000, 2001, 0, 2),
+		ipv4(IPPROTO_UDP, 53, 1000),
+		ipv4(IPPROTO_UDP, 5353, 53, 0x0010),
+		ipv6(IPPROTO_TCP, 443, 1500),
+		ipv6(IPPROTO_UDP, 1999, 53),
+		vlan_udp,
+		ether(0x0806, std::vector<u_char>(28, 0)),
+	};
+	}
+
+// Runs the program both natively and through libpcap's interpreter on
+// each packet, with every possible captured length.
+void check_program(const struct bpf_program* prog, const char* what)
+	{
+	BPF_JIT jit;
+
+#ifdef HAVE_BPF_JIT
+	REQUIRE_MESSAGE(jit.Compile(prog), what);
+#else
+	CHECK_FALSE(jit.Compile(prog));
+	return;
+#endif
+
+	for ( const auto& pkt : test_packets() )
+		{
+		for ( size_t caplen = 0; caplen <= pkt.size(); ++caplen )
+			{
+			unsigned int expected = bpf_filter(prog->bf_insns, pkt.data(),
+			                                   pkt.size(), caplen);
+			unsigned int result = jit.Run(pkt.data(), pkt.size(), caplen);
+			CHECK_MESSAGE(result == expected, what << " with caplen " << caplen
+			              << " of " << pkt.size());
+			}
+		}
+	}
+
+}
+
+TEST_CASE("bpf jit matches libpcap on compiled filters")
+	{
+	const char* filters[] = {
+		"tcp",
+		"udp",
+		"ip6",
+		"ip6 and tcp",
+		"tcp port 80",
+		"udp portrange 1000-2000",
+		"portrange 1000-2000",
+		"vlan and udp",
+		"vlan 10 and port 53",
+		"len > 80",
+		"len <= 70",
+		"greater 100",
+		"tcp[tcpflags] & tcp-syn != 0",
+		"ip[6:2] & 0x1fff != 0",
+		"host 10.0.0.1 and not port 53",
+		"net 192.168.0.0/16",
+		"tcp[0] + tcp[1] * 2 - tcp[3] > 10",
+	};
+
+	pcap_t* p = pcap_open_dead(DLT_EN10MB, 65535);
+	REQUIRE(p);
+
+	for ( auto filter : filters )
+		{
+		struct bpf_program prog;
+		REQUIRE_MESSAGE(pcap_compile(p, &prog, (char*) filter, 1, PCAP_NETMASK_UNKNOWN) == 0,
+		                filter);
+		check_program(&prog, filter);
+		pcap_freecode(&prog);
+		}
+
+	pcap_close(p);
+	}
+
+TEST_CASE("bpf jit matches libpcap on arithmetic by X")
+	{
+	// The translation can't know X, so it checks for division and modulo
+	// by zero at run time. Both reject the packet.
+	const uint16_t ops[] = {
+		BPF_DIV, BPF_LSH, BPF_RSH, BPF_MUL, BPF_SUB,
+#ifdef BPF_MOD
+		BPF_MOD,
+#endif
+	};
+
+	for ( auto op : ops )
+		{
+		for ( uint8_t x : {0, 2, 31} )
+			{
+			struct bpf_insn insns[] = {
+				BPF_STMT(BPF_LDX|BPF_IMM, x),
+				BPF_STMT(BPF_LD|BPF_H|BPF_ABS, 12),
+				BPF_STMT(BPF_ALU|op|BPF_X, 0),
+				BPF_STMT(BPF_RET|BPF_A, 0),
+			};
+
+			struct bpf_program prog;
+			prog.bf_len = sizeof(insns) / sizeof(insns[0]);
+			prog.bf_insns = insns;
+
+			std::string what = "op " + std::to_string(op) + " by " + std::to_string(x);
+			check_program(&prog, what.c_str());
+			}
+		}
+	}
+
+TEST_CASE("bpf jit shifts by 32 or more yield zero")
+	{
+	for ( uint16_t op : {BPF_LSH, BPF_RSH} )
+		{
+		struct bpf_insn insns[] = {
+			BPF_STMT(BPF_LDX|BPF_IMM, 40),
+			BPF_STMT(BPF_LD|BPF_IMM, 0x12345678),
+			BPF_STMT(BPF_ALU|op|BPF_X, 0),
+			BPF_STMT(BPF_RET|BPF_A, 0),
+		};
+
+		struct bpf_program prog;
+		prog.bf_len = sizeof(insns) / sizeof(insns[0]);
+		prog.bf_insns = insns;
+
+		BPF_JIT jit;
+
+		if ( ! jit.Compile(&prog) )
+			continue;
+
+		auto pkt = ipv4(IPPROTO_TCP, 1, 2);
+		CHECK(jit.Run(pkt.data(), pkt.size(), pkt.size()) == 0);
+		}
+	}
+
+TEST_SUITE_END();
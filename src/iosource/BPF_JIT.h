@@ -0,0 +1,51 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Translates a classic BPF program into native code, so that filtering
+// packets in user space doesn't need to interpret the program for each of
+// them. This is only available on x86-64. On other platforms, and for
+// programs using anything it does not support, Compile() fails and the
+// caller is expected to fall back to pcap_offline_filter().
+
+class BPF_JIT {
+public:
+	BPF_JIT() = default;
+	~BPF_JIT();
+
+	BPF_JIT(const BPF_JIT&) = delete;
+	BPF_JIT& operator=(const BPF_JIT&) = delete;
+
+	// Translates the given program, replacing any previous one. Returns
+	// true on success.
+	bool Compile(const struct bpf_program* program);
+
+	// Releases the native code.
+	void Free();
+
+	bool IsCompiled() const	{ return func != nullptr; }
+
+	// Runs the program on a packet of wirelen bytes, of which caplen
+	// got captured, with the same result as bpf_filter(): zero if the
+	// packet gets rejected, the number of bytes to keep otherwise.
+	// Requires IsCompiled().
+	unsigned int Run(const u_char* pkt, unsigned int wirelen,
+	                 unsigned int caplen) const
+		{ return func(pkt, wirelen, caplen); }
+
+private:
+	using Func = unsigned int (*)(const u_char* pkt, unsigned int wirelen,
+	                              unsigned int caplen);
+
+	Func func = nullptr;
+	void* code = nullptr;
+	size_t code_size = 0;
+};
@@ -141,6 +141,11 @@ bool BPF_Program::Compile(int snaplen, int linktype, const char* filter,
 	return err == 0;
 	}
 
+bool BPF_Program::CompileNative()
+	{
+	return m_compiled && m_program.bf_insns && m_jit.Compile(&m_program);
+	}
+
 bpf_program* BPF_Program::GetProgram()
 	{
 	return m_compiled ? &m_program : nullptr;
@@ -148,6 +153,8 @@ bpf_program* BPF_Program::GetProgram()
 
 void BPF_Program::FreeCode()
 	{
+	m_jit.Free();
+
 	if ( m_compiled )
 		{
 #ifdef DONT_HAVE_LIBPCAP_PCAP_FREECODE
@@ -8,6 +8,8 @@ extern "C" {
 
 #include <stdint.h>
 
+#include "BPF_JIT.h"
+
 // BPF_Programs are an abstraction around struct bpf_program,
 // to create a clean facility for creating, compiling, and
 // freeing such programs.
@@ -32,6 +34,11 @@ public:
 		uint32_t netmask, char* errbuf = nullptr, unsigned int errbuf_len = 0,
 		bool optimize = true);
 
+	// Translates the compiled program into native code for Matches()
+	// to run. Returns false if BPF_JIT doesn't support the program or
+	// the platform, in which case Matches() keeps interpreting it.
+	bool CompileNative();
+
 	// Returns true if this program currently contains compiled
 	// code, false otherwise.
 	bool IsCompiled()	{ return m_compiled; }
@@ -44,6 +51,17 @@ public:
 	// no program is currently compiled.
 	bpf_program* GetProgram();
 
+	// Returns true if the compiled program accepts the given packet.
+	// Runs the program as native code after a successful
+	// CompileNative(), and interprets it otherwise.
+	bool Matches(const struct pcap_pkthdr* hdr, const u_char* pkt)
+		{
+		if ( m_jit.IsCompiled() )
+			return m_jit.Run(pkt, hdr->len, hdr->caplen) != 0;
+
+		return pcap_offline_filter(&m_program, hdr, pkt) != 0;
+		}
+
 protected:
 	void FreeCode();
 
@@ -52,4 +70,5 @@ protected:
 	bool m_compiled;
 	bool m_matches_anything;
 	struct bpf_program m_program;
+	BPF_JIT m_jit;
 };
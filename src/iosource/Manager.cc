@@ -1,11 +1,20 @@
 // See the file "COPYING" in the main distribution directory for copyright.
 
+#include "zeek-config.h"
+
 #include <sys/types.h>
+#ifdef HAVE_EPOLL
+#include <sys/epoll.h>
+#else
 #include <sys/event.h>
+#endif
 #include <sys/time.h>
 #include <unistd.h>
 #include <assert.h>
 
+#include <algorithm>
+#include <cmath>
+
 #include "Manager.h"
 #include "Component.h"
 #include "IOSource.h"
@@ -46,9 +55,18 @@ void Manager::WakeupHandler::Ping(const std::string& where)
 
 Manager::Manager()
 	{
+#ifdef HAVE_EPOLL
+	event_queue = epoll_create1(EPOLL_CLOEXEC);
+	if ( event_queue == -1 )
+		reporter->FatalError("Failed to initialize epoll: %s", strerror(errno));
+
+	// epoll_wait() needs room for at least one event.
+	events.resize(1);
+#else
 	event_queue = kqueue();
 	if ( event_queue == -1 )
 		reporter->FatalError("Failed to initialize kqueue: %s", strerror(errno));
+#endif
 	}
 
 Manager::~Manager()
@@ -120,6 +138,13 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 
 	double timeout = -1;
 	IOSource* timeout_src = nullptr;
+
+#ifdef HAVE_EPOLL
+	// Asking epoll for the ready file descriptors takes a single system
+	// call, so we do so on every iteration and only ever process sources
+	// that actually have data.
+	bool time_to_poll = true;
+#else
 	bool time_to_poll = false;
 
 	++poll_counter;
@@ -128,6 +153,7 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 		poll_counter = 0;
 		time_to_poll = true;
 		}
+#endif
 
 	// Find the source with the next timeout value.
 	for ( auto src : sources )
@@ -144,10 +170,9 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 				timeout_src = iosource;
 
 				// If a source has a zero timeout then it's ready. Just add it to the
-				// list already. Only do this if it's not time to poll though, since
-				// we don't want things in the vector passed into Poll() or it'll end
-				// up inserting duplicates.
-				if ( timeout == 0 && ! time_to_poll )
+				// list already. Poll() doesn't add it a second time, even
+				// if its fd is ready, too.
+				if ( timeout == 0 )
 					{
 					added = true;
 					ready->push_back(timeout_src);
@@ -181,9 +206,114 @@ void Manager::FindReadySources(std::vector<IOSource*>* ready)
 	// force a poll, do that and return. Otherwise return the set of ready
 	// sources that we have.
 	if ( ready->empty() || time_to_poll )
-		Poll(ready, timeout, timeout_src);
+		// Don't block if there's something to process already.
+		Poll(ready, ready->empty() ? timeout : 0, timeout_src);
+	}
+
+#ifdef HAVE_EPOLL
+
+void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src)
+	{
+	int ret = epoll_wait(event_queue, events.data(), events.size(), ConvertTimeout(timeout));
+	if ( ret == -1 )
+		{
+		// Ignore interrupts since we may catch one during shutdown and we don't want the
+		// error to get printed.
+		if ( errno != EINTR )
+			reporter->InternalWarning("Error calling epoll_wait: %s", strerror(errno));
+		}
+	else if ( ret == 0 )
+		{
+		if ( timeout_src &&
+		     std::find(ready->begin(), ready->end(), timeout_src) == ready->end() )
+			ready->push_back(timeout_src);
+		}
+	else
+		{
+		// epoll_wait returns all ready descriptors at once, up to the
+		// number of registered ones, so we only need to loop over those.
+		// Sources with a zero timeout may be in the list already.
+		for ( int i = 0; i < ret; i++ )
+			{
+			std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].data.fd);
+			if ( it != fd_map.end() &&
+			     std::find(ready->begin(), ready->end(), it->second) == ready->end() )
+				ready->push_back(it->second);
+			}
+		}
+	}
+
+int Manager::ConvertTimeout(double timeout)
+	{
+	// If timeout ended up -1, set it to some nominal value just to keep the loop
+	// from blocking forever. This is the case of exit_only_after_terminate when
+	// there isn't anything else going on.
+	if ( timeout < 0 )
+		return 100;
+
+	// Round up so that we don't spin in the last millisecond before a timeout.
+	return static_cast<int>(std::ceil(timeout * 1e3));
+	}
+
+bool Manager::RegisterFd(int fd, IOSource* src)
+	{
+	struct epoll_event event = {};
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+
+	int ret = epoll_ctl(event_queue, EPOLL_CTL_ADD, fd, &event);
+	bool added = (ret != -1);
+
+	if ( ret == -1 && errno == EEXIST )
+		// Already registered, possibly for another source. Like kqueue's
+		// EV_ADD, just update the registration.
+		ret = epoll_ctl(event_queue, EPOLL_CTL_MOD, fd, &event);
+
+	if ( ret != -1 )
+		{
+		if ( added )
+			events.push_back({});
+
+		DBG_LOG(DBG_MAINLOOP, "Registered fd %d from %s", fd, src->Tag());
+		fd_map[fd] = src;
+
+		Wakeup("RegisterFd");
+		return true;
+		}
+	else
+		{
+		reporter->Error("Failed to register fd %d from %s: %s", fd, src->Tag(), strerror(errno));
+		return false;
+		}
 	}
 
+bool Manager::UnregisterFd(int fd, IOSource* src)
+	{
+	if ( fd_map.find(fd) != fd_map.end() )
+		{
+		// This fails if the fd has been closed already, in which case
+		// epoll has dropped it by itself.
+		int ret = epoll_ctl(event_queue, EPOLL_CTL_DEL, fd, nullptr);
+		if ( ret != -1 )
+			{
+			DBG_LOG(DBG_MAINLOOP, "Unregistered fd %d from %s", fd, src->Tag());
+			events.pop_back();
+			}
+
+		fd_map.erase(fd);
+
+		Wakeup("UnregisterFd");
+		return true;
+		}
+	else
+		{
+		reporter->Error("Attempted to unregister an unknown file descriptor %d from %s", fd, src->Tag());
+		return false;
+		}
+	}
+
+#else
+
 void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src)
 	{
 	struct timespec kqueue_timeout;
@@ -199,19 +329,22 @@ void Manager::Poll(std::vector<IOSource*>* ready, double timeout, IOSource* time
 		}
 	else if ( ret == 0 )
 		{
-		if ( timeout_src )
+		if ( timeout_src &&
+		     std::find(ready->begin(), ready->end(), timeout_src) == ready->end() )
 			ready->push_back(timeout_src);
 		}
 	else
 		{
 		// kevent returns the number of events that are ready, so we only need to loop
-		// over that many of them.
+		// over that many of them. Sources with a zero timeout may be in
+		// the list already.
 		for ( int i = 0; i < ret; i++ )
 			{
 			if ( events[i].filter == EVFILT_READ )
 				{
 				std::map<int, IOSource*>::const_iterator it = fd_map.find(events[i].ident);
-				if ( it != fd_map.end() )
+				if ( it != fd_map.end() &&
+				     std::find(ready->begin(), ready->end(), it->second) == ready->end() )
 					ready->push_back(it->second);
 				}
 			}
@@ -278,6 +411,8 @@ bool Manager::UnregisterFd(int fd, IOSource* src)
 		}
 	}
 
+#endif
+
 void Manager::Register(IOSource* src, bool dont_count, bool manage_lifetime)
 	{
 	// First see if we already have registered that source. If so, just
@@ -309,6 +444,7 @@ void Manager::Register(PktSrc* src)
 	{
 	pkt_src = src;
 
+#ifndef HAVE_EPOLL
 	// The poll interval gets defaulted to 100 which is good for cases like reading
 	// from pcap files and when there isn't a packet source, but is a little too
 	// infrequent for live sources (especially fast live sources). Set it down a
@@ -317,6 +453,7 @@ void Manager::Register(PktSrc* src)
 		poll_interval = 10;
 	else if ( pseudo_realtime )
 		poll_interval = 1;
+#endif
 
 	Register(src, false);
 	}
@@ -11,8 +11,12 @@
 #include "IOSource.h"
 #include "Flare.h"
 
+#ifdef HAVE_EPOLL
+struct epoll_event;
+#else
 struct timespec;
 struct kevent;
+#endif
 
 namespace iosource {
 
@@ -146,11 +150,19 @@ private:
 	 */
 	void Poll(std::vector<IOSource*>* ready, double timeout, IOSource* timeout_src);
 
+#ifdef HAVE_EPOLL
+	/**
+	 * Converts a double timeout value into the milliseconds used for calls
+	 * to epoll_wait().
+	 */
+	int ConvertTimeout(double timeout);
+#else
 	/**
 	 * Converts a double timeout value into a timespec struct used for calls
 	 * to kevent().
 	 */
 	void ConvertTimeout(double timeout, struct timespec& spec);
+#endif
 
 	/**
 	 * Specialized registration method for packet sources.
@@ -198,15 +210,22 @@ private:
 	int dont_counts = 0;
 	int zero_timeout_count = 0;
 	WakeupHandler* wakeup = nullptr;
-	int poll_counter = 0;
-	int poll_interval = 100;
 
 	int event_queue = -1;
 	std::map<int, IOSource*> fd_map;
 
+#ifdef HAVE_EPOLL
+	// This is only used for the output of the call to epoll_wait() in
+	// FindReadySources(), with room for all registered file descriptors.
+	std::vector<struct epoll_event> events;
+#else
+	int poll_counter = 0;
+	int poll_interval = 100;
+
 	// This is only used for the output of the call to kqueue in FindReadySources().
 	// The actual events are stored as part of the queue.
 	std::vector<struct kevent> events;
+#endif
 };
 
 }
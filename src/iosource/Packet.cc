@@ -77,519 +77,567 @@ void Packet::Weird(const char* name)
 	l2_valid = false;
 	}
 
-int Packet::GetLinkHeaderSize(int link_type)
+std::unordered_map<int, Packet::LinkTypeEntry>& Packet::LinkTypeDecoders()
 	{
-	switch ( link_type ) {
-	case DLT_NULL:
-		return 4;
-
-	case DLT_EN10MB:
-		return 14;
-
-	case DLT_FDDI:
-		return 13 + 8;	// fddi_header + LLC
-
+	static std::unordered_map<int, LinkTypeEntry> decoders = {
+		{DLT_NULL, {4, DecodeNull}},
+		{DLT_EN10MB, {14, DecodeEthernet}},
+		{DLT_FDDI, {13 + 8, DecodeRawIP}},	// fddi_header + LLC
 #ifdef DLT_LINUX_SLL
-	case DLT_LINUX_SLL:
-		return 16;
+		{DLT_LINUX_SLL, {16, DecodeRawIP}},
 #endif
-
-	case DLT_PPP_SERIAL:	// PPP_SERIAL
-		return 4;
-
-	case DLT_IEEE802_11:  // 802.11 monitor
-		return 34;
-
-	case DLT_IEEE802_11_RADIO:	// 802.11 plus RadioTap
-		return 59;
-
-	case DLT_NFLOG:
+		{DLT_PPP_SERIAL, {4, DecodePPPSerial}},
+		{DLT_IEEE802_11, {34, DecodeIEEE802_11}},	// 802.11 monitor
+		{DLT_IEEE802_11_RADIO, {59, DecodeRadiotap}},	// 802.11 plus RadioTap
 		// Linux netlink NETLINK NFLOG socket log messages
-		// The actual header size is variable, but we return the minimum
+		// The actual header size is variable, but we use the minimum
 		// expected size here, which is 4 bytes for the main header plus at
 		// least 2 bytes each for the type and length values assoicated with
 		// the final TLV carrying the packet payload.
-		return 8;
+		{DLT_NFLOG, {8, DecodeNFLog}},
+		{DLT_RAW, {0, DecodeRawIP}},
+	};
 
-	case DLT_RAW:
-		return 0;
+	return decoders;
 	}
 
-	return -1;
+std::unordered_map<int, Packet::L2Decoder>& Packet::EtherTypeDecoders()
+	{
+	static std::unordered_map<int, L2Decoder> decoders = {
+		// 802.1q / 802.1ad
+		{0x8100, DecodeVLAN},
+		{0x9100, DecodeVLAN},
+		{0x8864, DecodePPPoE},
+		{0x8847, DecodeMPLS},
+	};
+
+	return decoders;
+	}
+
+int Packet::GetLinkHeaderSize(int link_type)
+	{
+	const auto& decoders = LinkTypeDecoders();
+	auto it = decoders.find(link_type);
+	return it != decoders.end() ? it->second.hdr_size : -1;
+	}
+
+void Packet::RegisterLinkTypeDecoder(int link_type, int hdr_size,
+                                     L2Decoder decoder)
+	{
+	LinkTypeDecoders()[link_type] = {hdr_size, decoder};
+	}
+
+void Packet::RegisterEtherTypeDecoder(int ethertype, L2Decoder decoder)
+	{
+	EtherTypeDecoders()[ethertype] = decoder;
 	}
 
 void Packet::ProcessLayer2()
 	{
 	l2_valid = true;
-
-	// Unfortunately some packets on the link might have MPLS labels
-	// while others don't. That means we need to ask the link-layer if
-	// labels are in place.
-	bool have_mpls = false;
+	saw_vlan = false;
 
 	const u_char* pdata = data;
 	const u_char* end_of_data = data + cap_len;
+	int protocol = -1;
+	L2Result result;
 
-	switch ( link_type ) {
-	case DLT_NULL:
+	// Ethernet is by far the most common link type, so it skips the
+	// table.
+	if ( link_type == DLT_EN10MB )
+		result = DecodeEthernet(this, pdata, end_of_data, protocol);
+	else
 		{
-		int protocol = (pdata[3] << 24) + (pdata[2] << 16) + (pdata[1] << 8) + pdata[0];
-		pdata += GetLinkHeaderSize(link_type);
-
-		// From the Wireshark Wiki: "AF_INET6, unfortunately, has
-		// different values in {NetBSD,OpenBSD,BSD/OS},
-		// {FreeBSD,DragonFlyBSD}, and {Darwin/Mac OS X}, so an IPv6
-		// packet might have a link-layer header with 24, 28, or 30
-		// as the AF_ value." As we may be reading traces captured on
-		// platforms other than what we're running on, we accept them
-		// all here.
-
-		if ( protocol == AF_INET )
-			l3_proto = L3_IPV4;
-		else if ( protocol == 24 || protocol == 28 || protocol == 30 )
-			l3_proto = L3_IPV6;
-		else
-			{
-			Weird("non_ip_packet_in_null_transport");
-			return;
-			}
-
-		break;
+		const auto& decoders = LinkTypeDecoders();
+		auto it = decoders.find(link_type);
+		auto decoder = it != decoders.end() ? it->second.decoder : DecodeRawIP;
+		result = decoder(this, pdata, end_of_data, protocol);
+
+		if ( result == L2Result::Next )
+			result = DecodeEtherType(protocol, pdata, end_of_data,
+			                         "non_ip_packet");
 		}
 
-	case DLT_EN10MB:
+	if ( result == L2Result::Stop )
+		return;
+
+	// Unfortunately some packets on the link might have MPLS labels
+	// while others don't. That means we need to ask the link-layer if
+	// labels are in place.
+	if ( result == L2Result::MPLS )
 		{
-		// Skip past Cisco FabricPath to encapsulated ethernet frame.
-		if ( pdata[12] == 0x89 && pdata[13] == 0x03 )
-			{
-			auto constexpr cfplen = 16;
+		// Skip the MPLS label stack.
+		bool end_of_stack = false;
 
-			if ( pdata + cfplen + GetLinkHeaderSize(link_type) >= end_of_data )
+		while ( ! end_of_stack )
+			{
+			if ( pdata + 4 >= end_of_data )
 				{
-				Weird("truncated_link_header_cfp");
+				Weird("truncated_link_header");
 				return;
 				}
 
-			pdata += cfplen;
-			}
-
-		// Get protocol being carried from the ethernet frame.
-		int protocol = (pdata[12] << 8) + pdata[13];
-
-		eth_type = protocol;
-		l2_dst = pdata;
-		l2_src = pdata + 6;
-
-		pdata += GetLinkHeaderSize(link_type);
-
-		bool saw_vlan = false;
-
-		while ( protocol == 0x8100 || protocol == 0x9100 ||
-				protocol == 0x8864 )
-			{
-			switch ( protocol )
-				{
-				// VLAN carried over the ethernet frame.
-				// 802.1q / 802.1ad
-				case 0x8100:
-				case 0x9100:
-					{
-					if ( pdata + 4 >= end_of_data )
-						{
-						Weird("truncated_link_header");
-						return;
-						}
-
-					auto& vlan_ref = saw_vlan ? inner_vlan : vlan;
-					vlan_ref = ((pdata[0] << 8) + pdata[1]) & 0xfff;
-					protocol = ((pdata[2] << 8) + pdata[3]);
-					pdata += 4; // Skip the vlan header
-					saw_vlan = true;
-					eth_type = protocol;
-					}
-					break;
-
-				// PPPoE carried over the ethernet frame.
-				case 0x8864:
-					{
-					if ( pdata + 8 >= end_of_data )
-						{
-						Weird("truncated_link_header");
-						return;
-						}
-
-					protocol = (pdata[6] << 8) + pdata[7];
-					pdata += 8; // Skip the PPPoE session and PPP header
-
-					if ( protocol == 0x0021 )
-						l3_proto = L3_IPV4;
-					else if ( protocol == 0x0057 )
-						l3_proto = L3_IPV6;
-					else
-						{
-						// Neither IPv4 nor IPv6.
-						Weird("non_ip_packet_in_pppoe_encapsulation");
-						return;
-						}
-					}
-					break;
-				}
+			end_of_stack = *(pdata + 2) & 0x01;
+			pdata += 4;
 			}
 
-		// Check for MPLS in VLAN.
-		if ( protocol == 0x8847 )
-			have_mpls = true;
-
-		// Normal path to determine Layer 3 protocol.
-		if ( ! have_mpls && l3_proto == L3_UNKNOWN )
+		// We assume that what remains is IP
+		if ( pdata + sizeof(struct ip) >= end_of_data )
 			{
-			if ( protocol == 0x800 )
-				l3_proto = L3_IPV4;
-			else if ( protocol == 0x86dd )
-				l3_proto = L3_IPV6;
-			else if ( protocol == 0x0806 || protocol == 0x8035 )
-				l3_proto = L3_ARP;
-			else
-				{
-				// Neither IPv4 nor IPv6.
-				Weird("non_ip_packet_in_ethernet");
-				return;
-				}
+			Weird("no_ip_in_mpls_payload");
+			return;
 			}
 
-		break;
-		}
-
-	case DLT_PPP_SERIAL:
-		{
-		// Get PPP protocol.
-		int protocol = (pdata[2] << 8) + pdata[3];
-		pdata += GetLinkHeaderSize(link_type);
+		const struct ip* ip = (const struct ip *)pdata;
 
-		if ( protocol == 0x0281 )
-			{
-			// MPLS Unicast. Remove the pdata link layer and
-			// denote a header size of zero before the IP header.
-			have_mpls = true;
-			}
-		else if ( protocol == 0x0021 )
+		if ( ip->ip_v == 4 )
 			l3_proto = L3_IPV4;
-		else if ( protocol == 0x0057 )
+		else if ( ip->ip_v == 6 )
 			l3_proto = L3_IPV6;
 		else
 			{
 			// Neither IPv4 nor IPv6.
-			Weird("non_ip_packet_in_ppp_encapsulation");
+			Weird("no_ip_in_mpls_payload");
 			return;
 			}
-		break;
 		}
 
-	case DLT_IEEE802_11_RADIO:
+	else if ( encap_hdr_size )
 		{
-		if ( pdata + 3 >= end_of_data )
+		// Blanket encapsulation. We assume that what remains is IP.
+		if ( pdata + encap_hdr_size + sizeof(struct ip) >= end_of_data )
 			{
-			Weird("truncated_radiotap_header");
+			Weird("no_ip_left_after_encap");
 			return;
 			}
 
-		// Skip over the RadioTap header
-		int rtheader_len = (pdata[3] << 8) + pdata[2];
+		pdata += encap_hdr_size;
+
+		const struct ip* ip = (const struct ip *)pdata;
 
-		if ( pdata + rtheader_len >= end_of_data )
+		if ( ip->ip_v == 4 )
+			l3_proto = L3_IPV4;
+		else if ( ip->ip_v == 6 )
+			l3_proto = L3_IPV6;
+		else
 			{
-			Weird("truncated_radiotap_header");
+			// Neither IPv4 nor IPv6.
+			Weird("no_ip_in_encap");
 			return;
 			}
 
-		pdata += rtheader_len;
-		// fallthrough
 		}
 
-	case DLT_IEEE802_11:
-		{
-		u_char len_80211 = 24; // minimal length of data frames
-
-		if ( pdata + len_80211 >= end_of_data )
-			{
-			Weird("truncated_802_11_header");
-			return;
-			}
+	// We've now determined (a) L3_IPV4 vs (b) L3_IPV6 vs (c) L3_ARP vs
+	// (d) L3_UNKNOWN.
 
-		u_char fc_80211 = pdata[0]; // Frame Control field
+	// Calculate how much header we've used up.
+	hdr_size = (pdata - data);
+}
 
-		// Skip non-data frame types (management & control).
-		if ( ! ((fc_80211 >> 2) & 0x02) )
-			return;
+Packet::L2Result Packet::DecodeEtherType(int protocol, const u_char*& pdata,
+                                         const u_char* end_of_data,
+                                         const char* non_ip_weird)
+	{
+	const auto& decoders = EtherTypeDecoders();
 
-		// Skip subtypes without data.
-		if ( (fc_80211 >> 4) & 0x04 )
-			return;
+	while ( true )
+		{
+		switch ( protocol ) {
+		case 0x0800:
+			l3_proto = L3_IPV4;
+			return L2Result::Done;
 
-		// 'To DS' and 'From DS' flags set indicate use of the 4th
-		// address field.
-		if ( (pdata[1] & 0x03) == 0x03 )
-			len_80211 += l2_addr_len;
+		case 0x86dd:
+			l3_proto = L3_IPV6;
+			return L2Result::Done;
 
-		// Look for the QoS indicator bit.
-		if ( (fc_80211 >> 4) & 0x08 )
-			{
-			// Skip in case of A-MSDU subframes indicated by QoS
-			// control field.
-			if ( pdata[len_80211] & 0x80)
-				return;
+		case 0x0806:
+		case 0x8035:
+			l3_proto = L3_ARP;
+			return L2Result::Done;
+		}
 
-			len_80211 += 2;
-			}
+		auto it = decoders.find(protocol);
 
-		if ( pdata + len_80211 >= end_of_data )
+		if ( it == decoders.end() )
 			{
-			Weird("truncated_802_11_header");
-			return;
+			// Neither IPv4 nor IPv6.
+			Weird(non_ip_weird);
+			return L2Result::Stop;
 			}
 
-		// Determine link-layer addresses based
-		// on 'To DS' and 'From DS' flags
-		switch ( pdata[1] & 0x03 ) {
-			case 0x00:
-				l2_src = pdata + 10;
-				l2_dst = pdata + 4;
-				break;
-
-			case 0x01:
-				l2_src = pdata + 10;
-				l2_dst = pdata + 16;
-				break;
-
-			case 0x02:
-				l2_src = pdata + 16;
-				l2_dst = pdata + 4;
-				break;
-
-			case 0x03:
-				l2_src = pdata + 24;
-				l2_dst = pdata + 16;
-				break;
+		auto result = it->second(this, pdata, end_of_data, protocol);
+
+		if ( result != L2Result::Next )
+			return result;
 		}
+	}
 
-		// skip 802.11 data header
-		pdata += len_80211;
+Packet::L2Result Packet::DecodeNull(Packet* pkt, const u_char*& pdata,
+                                    const u_char* end_of_data, int& protocol)
+	{
+	protocol = (pdata[3] << 24) + (pdata[2] << 16) + (pdata[1] << 8) + pdata[0];
+	pdata += pkt->hdr_size;
+
+	// From the Wireshark Wiki: "AF_INET6, unfortunately, has
+	// different values in {NetBSD,OpenBSD,BSD/OS},
+	// {FreeBSD,DragonFlyBSD}, and {Darwin/Mac OS X}, so an IPv6
+	// packet might have a link-layer header with 24, 28, or 30
+	// as the AF_ value." As we may be reading traces captured on
+	// platforms other than what we're running on, we accept them
+	// all here.
+
+	if ( protocol == AF_INET )
+		pkt->l3_proto = L3_IPV4;
+	else if ( protocol == 24 || protocol == 28 || protocol == 30 )
+		pkt->l3_proto = L3_IPV6;
+	else
+		{
+		pkt->Weird("non_ip_packet_in_null_transport");
+		return L2Result::Stop;
+		}
 
-		if ( pdata + 8 >= end_of_data )
-			{
-			Weird("truncated_802_11_header");
-			return;
-			}
-		// Check that the DSAP and SSAP are both SNAP and that the control
-		// field indicates that this is an unnumbered frame.
-		// The organization code (24bits) needs to also be zero to
-		// indicate that this is encapsulated ethernet.
-		if ( pdata[0] == 0xAA && pdata[1] == 0xAA && pdata[2] == 0x03 &&
-		     pdata[3] == 0 && pdata[4] == 0 && pdata[5] == 0 )
-			{
-			pdata += 6;
-			}
-		else
-			{
-			// If this is a logical link control frame without the
-			// possibility of having a protocol we care about, we'll
-			// just skip it for now.
-			return;
-			}
+	return L2Result::Done;
+	}
 
-		int protocol = (pdata[0] << 8) + pdata[1];
-		if ( protocol == 0x0800 )
-			l3_proto = L3_IPV4;
-		else if ( protocol == 0x86DD )
-			l3_proto = L3_IPV6;
-		else if ( protocol == 0x0806 || protocol == 0x8035 )
-			l3_proto = L3_ARP;
-		else
+Packet::L2Result Packet::DecodeEthernet(Packet* pkt, const u_char*& pdata,
+                                        const u_char* end_of_data, int& protocol)
+	{
+	// Skip past Cisco FabricPath to encapsulated ethernet frame.
+	if ( pdata[12] == 0x89 && pdata[13] == 0x03 )
+		{
+		auto constexpr cfplen = 16;
+
+		if ( pdata + cfplen + pkt->hdr_size >= end_of_data )
 			{
-			Weird("non_ip_packet_in_ieee802_11");
-			return;
+			pkt->Weird("truncated_link_header_cfp");
+			return L2Result::Stop;
 			}
-		pdata += 2;
 
-		break;
+		pdata += cfplen;
 		}
 
-	case DLT_NFLOG:
+	// Get protocol being carried from the ethernet frame.
+	protocol = (pdata[12] << 8) + pdata[13];
+
+	pkt->eth_type = protocol;
+	pkt->l2_dst = pdata;
+	pkt->l2_src = pdata + 6;
+
+	pdata += pkt->hdr_size;
+
+	// The normal path to the layer 3 protocol stays within
+	// DecodeEtherType().
+	return pkt->DecodeEtherType(protocol, pdata, end_of_data,
+	                            "non_ip_packet_in_ethernet");
+	}
+
+Packet::L2Result Packet::DecodePPPSerial(Packet* pkt, const u_char*& pdata,
+                                         const u_char* end_of_data, int& protocol)
+	{
+	// Get PPP protocol.
+	protocol = (pdata[2] << 8) + pdata[3];
+	pdata += pkt->hdr_size;
+
+	if ( protocol == 0x0281 )
+		// MPLS Unicast. Remove the pdata link layer and
+		// denote a header size of zero before the IP header.
+		return L2Result::MPLS;
+	else if ( protocol == 0x0021 )
+		pkt->l3_proto = L3_IPV4;
+	else if ( protocol == 0x0057 )
+		pkt->l3_proto = L3_IPV6;
+	else
 		{
-		// See https://www.tcpdump.org/linktypes/LINKTYPE_NFLOG.html
+		// Neither IPv4 nor IPv6.
+		pkt->Weird("non_ip_packet_in_ppp_encapsulation");
+		return L2Result::Stop;
+		}
 
-		uint8_t protocol = pdata[0];
+	return L2Result::Done;
+	}
 
-		if ( protocol == AF_INET )
-			l3_proto = L3_IPV4;
-		else if ( protocol == AF_INET6 )
-			l3_proto = L3_IPV6;
-		else
-			{
-			Weird("non_ip_in_nflog");
-			return;
-			}
+Packet::L2Result Packet::DecodeRadiotap(Packet* pkt, const u_char*& pdata,
+                                        const u_char* end_of_data, int& protocol)
+	{
+	if ( pdata + 3 >= end_of_data )
+		{
+		pkt->Weird("truncated_radiotap_header");
+		return L2Result::Stop;
+		}
 
-		uint8_t version = pdata[1];
+	// Skip over the RadioTap header
+	int rtheader_len = (pdata[3] << 8) + pdata[2];
 
-		if ( version != 0 )
-			{
-			Weird("unknown_nflog_version");
-			return;
-			}
+	if ( pdata + rtheader_len >= end_of_data )
+		{
+		pkt->Weird("truncated_radiotap_header");
+		return L2Result::Stop;
+		}
 
-		// Skip to TLVs.
-		pdata += 4;
+	pdata += rtheader_len;
+	return DecodeIEEE802_11(pkt, pdata, end_of_data, protocol);
+	}
 
-		uint16_t tlv_len;
-		uint16_t tlv_type;
+Packet::L2Result Packet::DecodeIEEE802_11(Packet* pkt, const u_char*& pdata,
+                                          const u_char* end_of_data, int& protocol)
+	{
+	u_char len_80211 = 24; // minimal length of data frames
 
-		while ( true )
-			{
-			if ( pdata + 4 >= end_of_data )
-				{
-				Weird("nflog_no_pcap_payload");
-				return;
-				}
+	if ( pdata + len_80211 >= end_of_data )
+		{
+		pkt->Weird("truncated_802_11_header");
+		return L2Result::Stop;
+		}
 
-			// TLV Type and Length values are specified in host byte order
-			// (libpcap should have done any needed byteswapping already).
+	u_char fc_80211 = pdata[0]; // Frame Control field
 
-			tlv_len = *(reinterpret_cast<const uint16_t*>(pdata));
-			tlv_type = *(reinterpret_cast<const uint16_t*>(pdata + 2));
+	// Skip non-data frame types (management & control).
+	if ( ! ((fc_80211 >> 2) & 0x02) )
+		return L2Result::Stop;
 
-			auto constexpr nflog_type_payload = 9;
+	// Skip subtypes without data.
+	if ( (fc_80211 >> 4) & 0x04 )
+		return L2Result::Stop;
 
-			if ( tlv_type == nflog_type_payload )
-				{
-				// The raw packet payload follows this TLV.
-				pdata += 4;
-				break;
-				}
-			else
-				{
-				// The Length value includes the 4 octets for the Type and
-				// Length values, but TLVs are also implicitly padded to
-				// 32-bit alignments (that padding may not be included in
-				// the Length value).
-
-				if ( tlv_len < 4 )
-					{
-					Weird("nflog_bad_tlv_len");
-					return;
-					}
-				else
-					{
-					auto rem = tlv_len % 4;
-
-					if ( rem != 0 )
-						tlv_len += 4 - rem;
-					}
-
-				pdata += tlv_len;
-				}
-			}
+	// 'To DS' and 'From DS' flags set indicate use of the 4th
+	// address field.
+	if ( (pdata[1] & 0x03) == 0x03 )
+		len_80211 += l2_addr_len;
+
+	// Look for the QoS indicator bit.
+	if ( (fc_80211 >> 4) & 0x08 )
+		{
+		// Skip in case of A-MSDU subframes indicated by QoS
+		// control field.
+		if ( pdata[len_80211] & 0x80)
+			return L2Result::Stop;
 
-		break;
+		len_80211 += 2;
 		}
 
-	default:
+	if ( pdata + len_80211 >= end_of_data )
 		{
-		// Assume we're pointing at IP. Just figure out which version.
-		pdata += GetLinkHeaderSize(link_type);
-		if ( pdata + sizeof(struct ip) >= end_of_data )
-			{
-			Weird("truncated_link_header");
-			return;
-			}
+		pkt->Weird("truncated_802_11_header");
+		return L2Result::Stop;
+		}
 
-		const struct ip* ip = (const struct ip *)pdata;
+	// Determine link-layer addresses based
+	// on 'To DS' and 'From DS' flags
+	switch ( pdata[1] & 0x03 ) {
+		case 0x00:
+			pkt->l2_src = pdata + 10;
+			pkt->l2_dst = pdata + 4;
+			break;
+
+		case 0x01:
+			pkt->l2_src = pdata + 10;
+			pkt->l2_dst = pdata + 16;
+			break;
+
+		case 0x02:
+			pkt->l2_src = pdata + 16;
+			pkt->l2_dst = pdata + 4;
+			break;
+
+		case 0x03:
+			pkt->l2_src = pdata + 24;
+			pkt->l2_dst = pdata + 16;
+			break;
+	}
 
-		if ( ip->ip_v == 4 )
-			l3_proto = L3_IPV4;
-		else if ( ip->ip_v == 6 )
-			l3_proto = L3_IPV6;
-		else
-			{
-			// Neither IPv4 nor IPv6.
-			Weird("non_ip_packet");
-			return;
-			}
+	// skip 802.11 data header
+	pdata += len_80211;
 
-		break;
+	if ( pdata + 8 >= end_of_data )
+		{
+		pkt->Weird("truncated_802_11_header");
+		return L2Result::Stop;
+		}
+	// Check that the DSAP and SSAP are both SNAP and that the control
+	// field indicates that this is an unnumbered frame.
+	// The organization code (24bits) needs to also be zero to
+	// indicate that this is encapsulated ethernet.
+	if ( pdata[0] == 0xAA && pdata[1] == 0xAA && pdata[2] == 0x03 &&
+	     pdata[3] == 0 && pdata[4] == 0 && pdata[5] == 0 )
+		{
+		pdata += 6;
 		}
+	else
+		{
+		// If this is a logical link control frame without the
+		// possibility of having a protocol we care about, we'll
+		// just skip it for now.
+		return L2Result::Stop;
+		}
+
+	protocol = (pdata[0] << 8) + pdata[1];
+	pdata += 2;
+
+	return pkt->DecodeEtherType(protocol, pdata, end_of_data,
+	                            "non_ip_packet_in_ieee802_11");
 	}
 
-	if ( have_mpls )
+Packet::L2Result Packet::DecodeNFLog(Packet* pkt, const u_char*& pdata,
+                                     const u_char* end_of_data, int& protocol)
+	{
+	// See https://www.tcpdump.org/linktypes/LINKTYPE_NFLOG.html
+
+	protocol = pdata[0];
+
+	if ( protocol == AF_INET )
+		pkt->l3_proto = L3_IPV4;
+	else if ( protocol == AF_INET6 )
+		pkt->l3_proto = L3_IPV6;
+	else
 		{
-		// Skip the MPLS label stack.
-		bool end_of_stack = false;
+		pkt->Weird("non_ip_in_nflog");
+		return L2Result::Stop;
+		}
 
-		while ( ! end_of_stack )
-			{
-			if ( pdata + 4 >= end_of_data )
-				{
-				Weird("truncated_link_header");
-				return;
-				}
+	uint8_t version = pdata[1];
 
-			end_of_stack = *(pdata + 2) & 0x01;
-			pdata += 4;
-			}
+	if ( version != 0 )
+		{
+		pkt->Weird("unknown_nflog_version");
+		return L2Result::Stop;
+		}
 
-		// We assume that what remains is IP
-		if ( pdata + sizeof(struct ip) >= end_of_data )
+	// Skip to TLVs.
+	pdata += 4;
+
+	uint16_t tlv_len;
+	uint16_t tlv_type;
+
+	while ( true )
+		{
+		if ( pdata + 4 >= end_of_data )
 			{
-			Weird("no_ip_in_mpls_payload");
-			return;
+			pkt->Weird("nflog_no_pcap_payload");
+			return L2Result::Stop;
 			}
 
-		const struct ip* ip = (const struct ip *)pdata;
+		// TLV Type and Length values are specified in host byte order
+		// (libpcap should have done any needed byteswapping already).
 
-		if ( ip->ip_v == 4 )
-			l3_proto = L3_IPV4;
-		else if ( ip->ip_v == 6 )
-			l3_proto = L3_IPV6;
+		tlv_len = *(reinterpret_cast<const uint16_t*>(pdata));
+		tlv_type = *(reinterpret_cast<const uint16_t*>(pdata + 2));
+
+		auto constexpr nflog_type_payload = 9;
+
+		if ( tlv_type == nflog_type_payload )
+			{
+			// The raw packet payload follows this TLV.
+			pdata += 4;
+			break;
+			}
 		else
 			{
-			// Neither IPv4 nor IPv6.
-			Weird("no_ip_in_mpls_payload");
-			return;
+			// The Length value includes the 4 octets for the Type and
+			// Length values, but TLVs are also implicitly padded to
+			// 32-bit alignments (that padding may not be included in
+			// the Length value).
+
+			if ( tlv_len < 4 )
+				{
+				pkt->Weird("nflog_bad_tlv_len");
+				return L2Result::Stop;
+				}
+			else
+				{
+				auto rem = tlv_len % 4;
+
+				if ( rem != 0 )
+					tlv_len += 4 - rem;
+				}
+
+			pdata += tlv_len;
 			}
 		}
 
-	else if ( encap_hdr_size )
+	return L2Result::Done;
+	}
+
+Packet::L2Result Packet::DecodeRawIP(Packet* pkt, const u_char*& pdata,
+                                     const u_char* end_of_data, int& protocol)
+	{
+	// Assume we're pointing at IP. Just figure out which version.
+	pdata += pkt->hdr_size;
+	if ( pdata + sizeof(struct ip) >= end_of_data )
 		{
-		// Blanket encapsulation. We assume that what remains is IP.
-		if ( pdata + encap_hdr_size + sizeof(struct ip) >= end_of_data )
-			{
-			Weird("no_ip_left_after_encap");
-			return;
-			}
+		pkt->Weird("truncated_link_header");
+		return L2Result::Stop;
+		}
 
-		pdata += encap_hdr_size;
+	const struct ip* ip = (const struct ip *)pdata;
 
-		const struct ip* ip = (const struct ip *)pdata;
+	if ( ip->ip_v == 4 )
+		pkt->l3_proto = L3_IPV4;
+	else if ( ip->ip_v == 6 )
+		pkt->l3_proto = L3_IPV6;
+	else
+		{
+		// Neither IPv4 nor IPv6.
+		pkt->Weird("non_ip_packet");
+		return L2Result::Stop;
+		}
 
-		if ( ip->ip_v == 4 )
-			l3_proto = L3_IPV4;
-		else if ( ip->ip_v == 6 )
-			l3_proto = L3_IPV6;
-		else
-			{
-			// Neither IPv4 nor IPv6.
-			Weird("no_ip_in_encap");
-			return;
-			}
+	return L2Result::Done;
+	}
 
+Packet::L2Result Packet::DecodeVLAN(Packet* pkt, const u_char*& pdata,
+                                    const u_char* end_of_data, int& protocol)
+	{
+	// VLAN carried over the ethernet frame.
+	if ( pdata + 4 >= end_of_data )
+		{
+		pkt->Weird("truncated_link_header");
+		return L2Result::Stop;
 		}
 
-	// We've now determined (a) L3_IPV4 vs (b) L3_IPV6 vs (c) L3_ARP vs
-	// (d) L3_UNKNOWN.
+	auto& vlan_ref = pkt->saw_vlan ? pkt->inner_vlan : pkt->vlan;
+	vlan_ref = ((pdata[0] << 8) + pdata[1]) & 0xfff;
+	protocol = ((pdata[2] << 8) + pdata[3]);
+	pdata += 4; // Skip the vlan header
+	pkt->saw_vlan = true;
+	pkt->eth_type = protocol;
+	return L2Result::Next;
+	}
 
-	// Calculate how much header we've used up.
-	hdr_size = (pdata - data);
-}
+Packet::L2Result Packet::DecodePPPoE(Packet* pkt, const u_char*& pdata,
+                                     const u_char* end_of_data, int& protocol)
+	{
+	// PPPoE carried over the ethernet frame.
+	if ( pdata + 8 >= end_of_data )
+		{
+		pkt->Weird("truncated_link_header");
+		return L2Result::Stop;
+		}
+
+	protocol = (pdata[6] << 8) + pdata[7];
+	pdata += 8; // Skip the PPPoE session and PPP header
+
+	if ( protocol == 0x0021 )
+		pkt->l3_proto = L3_IPV4;
+	else if ( protocol == 0x0057 )
+		pkt->l3_proto = L3_IPV6;
+	else
+		{
+		// Neither IPv4 nor IPv6.
+		pkt->Weird("non_ip_packet_in_pppoe_encapsulation");
+		return L2Result::Stop;
+		}
+
+	return L2Result::Done;
+	}
+
+Packet::L2Result Packet::DecodeMPLS(Packet* pkt, const u_char*& pdata,
+                                    const u_char* end_of_data, int& protocol)
+	{
+	// The label stack itself is skipped by ProcessLayer2().
+	return L2Result::MPLS;
+	}
 
 zeek::RecordValPtr Packet::ToRawPktHdrVal() const
 	{
@@ -3,6 +3,7 @@
 #include "zeek-config.h"
 
 #include <string>
+#include <unordered_map>
 
 #include <stdint.h>
 #include <sys/types.h> // for u_char
@@ -43,6 +44,28 @@ enum Layer3Proto : int32_t {
  */
 class Packet {
 public:
+	/**
+	 * The outcome of a layer 2 decoder.
+	 */
+	enum class L2Result {
+		Next,	/// Continue with the ethertype the decoder left in *protocol*.
+		MPLS,	/// An MPLS label stack follows.
+		Done,	/// The layer 3 protocol has been determined.
+		Stop,	/// Stop decoding; any weird has been reported already.
+	};
+
+	/**
+	 * A decoder for one link-layer or encapsulation header. It advances
+	 * *pdata* past the header, never reading beyond *end_of_data*.
+	 * Decoders of link types start at the beginning of the frame;
+	 * decoders of ethertypes start right after the ethertype field and
+	 * receive its value in *protocol*. To hand on to the decoder of
+	 * another ethertype, a decoder stores it in *protocol* and returns
+	 * L2Result::Next.
+	 */
+	using L2Decoder = L2Result (*)(Packet* pkt, const u_char*& pdata,
+	                               const u_char* end_of_data, int& protocol);
+
 	/**
 	 * Construct and initialize from packet data.
 	 *
@@ -151,6 +174,59 @@ public:
 	 */
 	static int GetLinkHeaderSize(int link_type);
 
+	/**
+	 * Registers the decoder of a link type, replacing any previous one.
+	 * Plugins can use this to support additional \c DLT_* types.
+	 *
+	 * @param link_type The link type.
+	 *
+	 * @param hdr_size The minimal size of its link-layer header, which
+	 * GetLinkHeaderSize() will return.
+	 *
+	 * @param decoder The decoder of the link-layer header.
+	 */
+	static void RegisterLinkTypeDecoder(int link_type, int hdr_size,
+	                                    L2Decoder decoder);
+
+	/**
+	 * Registers the decoder of an ethertype, replacing any previous one.
+	 * Plugins can use this to decode additional encapsulations carried
+	 * over Ethernet. IPv4, IPv6 and ARP always end decoding and cannot be
+	 * overridden.
+	 *
+	 * @param ethertype The ethertype.
+	 *
+	 * @param decoder The decoder of the header following the ethertype.
+	 */
+	static void RegisterEtherTypeDecoder(int ethertype, L2Decoder decoder);
+
+	/**
+	 * Decodes what follows an ethertype field through the registered
+	 * ethertype decoders, until the layer 3 protocol is known. For use
+	 * by link type decoders.
+	 *
+	 * @param protocol The ethertype.
+	 *
+	 * @param pdata Points right after the ethertype field; advanced past
+	 * all decoded headers.
+	 *
+	 * @param end_of_data The end of the captured data.
+	 *
+	 * @param non_ip_weird The weird to report for an ethertype without
+	 * decoder.
+	 *
+	 * @return The result of the last decoder.
+	 */
+	L2Result DecodeEtherType(int protocol, const u_char*& pdata,
+	                         const u_char* end_of_data,
+	                         const char* non_ip_weird);
+
+	/**
+	 * Reports a packet-level weird and marks layer 2 as invalid. For use
+	 * by decoders.
+	 */
+	void Weird(const char* name);
+
 	/**
 	 * Describes the packet, with standard signature.
 	 */
@@ -229,8 +305,38 @@ private:
 	// Calculate layer 2 attributes.
 	void ProcessLayer2();
 
-	// Wrapper to generate a packet-level weird.
-	void Weird(const char* name);
+	struct LinkTypeEntry {
+		int hdr_size;
+		L2Decoder decoder;
+	};
+
+	// The registered decoders, initialized with the built-in ones.
+	static std::unordered_map<int, LinkTypeEntry>& LinkTypeDecoders();
+	static std::unordered_map<int, L2Decoder>& EtherTypeDecoders();
+
+	// The built-in decoders of link types.
+	static L2Result DecodeNull(Packet* pkt, const u_char*& pdata,
+	                           const u_char* end_of_data, int& protocol);
+	static L2Result DecodeEthernet(Packet* pkt, const u_char*& pdata,
+	                               const u_char* end_of_data, int& protocol);
+	static L2Result DecodePPPSerial(Packet* pkt, const u_char*& pdata,
+	                                const u_char* end_of_data, int& protocol);
+	static L2Result DecodeRadiotap(Packet* pkt, const u_char*& pdata,
+	                               const u_char* end_of_data, int& protocol);
+	static L2Result DecodeIEEE802_11(Packet* pkt, const u_char*& pdata,
+	                                 const u_char* end_of_data, int& protocol);
+	static L2Result DecodeNFLog(Packet* pkt, const u_char*& pdata,
+	                            const u_char* end_of_data, int& protocol);
+	static L2Result DecodeRawIP(Packet* pkt, const u_char*& pdata,
+	                            const u_char* end_of_data, int& protocol);
+
+	// The built-in decoders of ethertypes.
+	static L2Result DecodeVLAN(Packet* pkt, const u_char*& pdata,
+	                           const u_char* end_of_data, int& protocol);
+	static L2Result DecodePPPoE(Packet* pkt, const u_char*& pdata,
+	                            const u_char* end_of_data, int& protocol);
+	static L2Result DecodeMPLS(Packet* pkt, const u_char*& pdata,
+	                           const u_char* end_of_data, int& protocol);
 
 	// Renders an MAC address into its ASCII representation.
 	zeek::ValPtr FmtEUI48(const u_char* mac) const;
@@ -241,4 +347,8 @@ private:
 
 	// True if L2 processing succeeded.
 	bool l2_valid;
+
+	// True once a VLAN tag has been decoded, so that the next one
+	// is the inner tag.
+	bool saw_vlan;
 };
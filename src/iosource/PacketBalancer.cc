@@ -0,0 +1,195 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "PacketBalancer.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+#include "Packet.h"
+#include "ShmRing.h"
+#include "Conn.h"
+#include "Hash.h"
+#include "Reporter.h"
+
+using namespace iosource;
+
+iosource::PacketBalancer* packet_balancer = nullptr;
+
+// How long to wait for workers to create their rings, in seconds, and
+// how long to sleep between checks, in microseconds.
+static constexpr int balancer_attach_timeout = 60;
+static constexpr useconds_t balancer_poll_interval = 100000;
+
+// How long to sleep while waiting for room in a ring, in microseconds.
+static constexpr useconds_t balancer_full_interval = 50;
+
+PacketBalancer* PacketBalancer::Open(const std::string& spec, std::string* error)
+	{
+	auto colon = spec.rfind(':');
+	char* end = nullptr;
+	long n = colon == std::string::npos ? 0 : strtol(spec.c_str() + colon + 1, &end, 10);
+
+	if ( n <= 0 || *end )
+		{
+		*error = "expected <prefix>:<number of workers>";
+		return nullptr;
+		}
+
+	auto b = new PacketBalancer();
+	auto prefix = spec.substr(0, colon);
+
+	for ( long i = 0; i < n; ++i )
+		{
+		auto path = prefix + "." + std::to_string(i);
+		ShmRing* r = nullptr;
+		std::string attach_error;
+
+		for ( int waited = 0; ! r; ++waited )
+			{
+			r = ShmRing::Attach(path, &attach_error);
+
+			if ( r )
+				break;
+
+			if ( waited * balancer_poll_interval >= balancer_attach_timeout * 1000000 )
+				{
+				*error = "no worker reading " + path + ": " + attach_error;
+				delete b;
+				return nullptr;
+				}
+
+			if ( waited == 0 )
+				reporter->Info("waiting for a worker to read %s", path.c_str());
+
+			usleep(balancer_poll_interval);
+			}
+
+		b->rings.push_back(r);
+		}
+
+	b->gone.resize(b->rings.size());
+	return b;
+	}
+
+PacketBalancer::~PacketBalancer()
+	{
+	for ( auto r : rings )
+		delete r;
+	}
+
+uint64_t PacketBalancer::FlowHash(const Packet* pkt)
+	{
+	if ( ! pkt->Layer2Valid() )
+		return 0;
+
+	const u_char* l3 = pkt->data + pkt->hdr_size;
+	uint32_t l3_len = pkt->cap_len - pkt->hdr_size;
+
+	ConnID id;
+	id.src_port = id.dst_port = 0;
+	id.is_one_way = false;
+
+	const u_char* l4 = nullptr;
+	int proto = 0;
+
+	if ( pkt->l3_proto == L3_IPV4 && l3_len >= sizeof(struct ip) )
+		{
+		auto ip4 = reinterpret_cast<const struct ip*>(l3);
+		id.src_addr = IPAddr(ip4->ip_src);
+		id.dst_addr = IPAddr(ip4->ip_dst);
+
+		// Only first fragments carry ports, so fragments go by their
+		// addresses alone.
+		uint32_t hdr_len = ip4->ip_hl * 4;
+
+		if ( (ntohs(ip4->ip_off) & (IP_MF | IP_OFFMASK)) == 0 && hdr_len <= l3_len )
+			{
+			l4 = l3 + hdr_len;
+			l3_len -= hdr_len;
+			proto = ip4->ip_p;
+			}
+		}
+
+	else if ( pkt->l3_proto == L3_IPV6 && l3_len >= sizeof(struct ip6_hdr) )
+		{
+		// Ports only get used if there are no extension headers in front
+		// of them, which would include fragment headers.
+		auto ip6 = reinterpret_cast<const struct ip6_hdr*>(l3);
+		id.src_addr = IPAddr(ip6->ip6_src);
+		id.dst_addr = IPAddr(ip6->ip6_dst);
+		l4 = l3 + sizeof(struct ip6_hdr);
+		l3_len -= sizeof(struct ip6_hdr);
+		proto = ip6->ip6_nxt;
+		}
+
+	else
+		return 0;
+
+	if ( l4 && l3_len >= 4 &&
+	     (proto == IPPROTO_TCP || proto == IPPROTO_UDP || proto == IPPROTO_SCTP) )
+		{
+		id.src_port = reinterpret_cast<const uint16_t*>(l4)[0];
+		id.dst_port = reinterpret_cast<const uint16_t*>(l4)[1];
+		}
+
+	// The key is the same for both directions.
+	auto key = BuildConnIDKey(id);
+
+	if ( key.IsIPv4() )
+		{
+		auto key4 = key.PackIPv4();
+		return KeyedHash::StaticHash64(&key4, sizeof(key4));
+		}
+
+	return KeyedHash::StaticHash64(&key, sizeof(key));
+	}
+
+void PacketBalancer::Dispatch(const Packet* pkt, bool wait)
+	{
+	size_t i = rings.size() == 1 ? 0 : FlowHash(pkt) % rings.size();
+	auto r = rings[i];
+
+	if ( ! r->Fits(pkt) )
+		{
+		++num_dropped;
+		return;
+		}
+
+	while ( ! gone[i] )
+		{
+		if ( r->Push(pkt) )
+			{
+			++num_dispatched;
+			return;
+			}
+
+		// Poking the worker tells whether it's still there.
+		if ( ! r->Notify() )
+			{
+			reporter->Warning("the worker for ring %zu has gone away", i);
+			gone[i] = true;
+			}
+
+		else if ( ! wait )
+			break;
+
+		else
+			usleep(balancer_full_interval);
+		}
+
+	++num_dropped;
+	}
+
+void PacketBalancer::Finish()
+	{
+	for ( auto r : rings )
+		r->Finish();
+
+	reporter->Info("balanced %" PRIu64 " packets across %zu workers, dropped %" PRIu64,
+	               num_dispatched, rings.size(), num_dropped);
+	}
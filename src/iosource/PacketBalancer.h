@@ -0,0 +1,75 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstdint>
+
+class Packet;
+
+namespace iosource {
+
+class ShmRing;
+
+/**
+ * Spreads the packets of a packet source across local worker processes,
+ * in place of analyzing them. It hashes each packet's addresses and ports
+ * symmetrically, the same way connections get keyed, so that both
+ * directions of a flow reach the same worker. "zeek --balance-packets
+ * <prefix>:<n>" sets one up, feeding rings <prefix>.0 to <prefix>.<n-1>,
+ * which workers read with "-i shmring::<prefix>.<i>".
+ */
+class PacketBalancer {
+public:
+	/**
+	 * Attaches to the rings for a spec, waiting for workers to create
+	 * them.
+	 *
+	 * @param spec The path prefix of the rings and their number,
+	 * separated by a colon.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return The balancer, or null on error.
+	 */
+	static PacketBalancer* Open(const std::string& spec, std::string* error);
+
+	~PacketBalancer();
+
+	/**
+	 * Passes a packet on to its worker.
+	 *
+	 * @param wait If true, waits for room if the worker's ring is full.
+	 * Otherwise, such packets get dropped, as for live input they can't
+	 * be held back.
+	 */
+	void Dispatch(const Packet* pkt, bool wait);
+
+	/**
+	 * Tells the workers that no more packets will come and reports what
+	 * got passed on.
+	 */
+	void Finish();
+
+	/**
+	 * Returns a packet's flow hash, which is the same for both directions
+	 * of a connection. Packets that aren't IP all hash to zero.
+	 */
+	static uint64_t FlowHash(const Packet* pkt);
+
+private:
+	PacketBalancer()	{ }
+
+	std::vector<ShmRing*> rings;
+	std::vector<bool> gone;	// per ring, whether its worker went away
+
+	uint64_t num_dispatched = 0;
+	uint64_t num_dropped = 0;
+};
+
+}
+
+// Only set when running with --balance-packets.
+extern iosource::PacketBalancer* packet_balancer;
@@ -4,6 +4,7 @@
 #include "PktSrc.h"
 
 #include <sys/stat.h>
+#include <algorithm>
 
 #include "util.h"
 #include "Hash.h"
@@ -31,6 +32,9 @@ PktSrc::PktSrc()
 	errbuf = "";
 	SetClosed(true);
 
+	batch_count = batch_index = 0;
+	batch_packet = nullptr;
+
 	next_sync_point = 0;
 	first_timestamp = 0.0;
 	current_pseudo = 0.0;
@@ -196,6 +200,12 @@ void PktSrc::Process()
 	if ( ! IsOpen() )
 		return;
 
+	if ( ! pseudo_realtime && zeek::BifConst::Pcap::batch_size > 1 )
+		{
+		ProcessBatch();
+		return;
+		}
+
 	if ( ! ExtractNextPacketInternal() )
 		return;
 
@@ -217,6 +227,82 @@ void PktSrc::Process()
 	DoneWithPacket();
 	}
 
+void PktSrc::ProcessBatch()
+	{
+	// Process up to batch_size packets before returning to the main
+	// loop. A source may hand them out in several smaller rounds; the
+	// default just provides one packet per round, which lets sources
+	// without a stable capture buffer avoid copying packet data.
+	size_t budget = zeek::BifConst::Pcap::batch_size;
+
+	while ( budget > 0 )
+		{
+		if ( batch_index >= batch_count )
+			{
+			// Don't return any packets if processing is suspended
+			// (except for the very first packet which we need to
+			// set up times).
+			if ( net_is_processing_suspended() && first_timestamp )
+				return;
+
+			if ( batch.empty() )
+				batch.resize(zeek::BifConst::Pcap::batch_size);
+
+			batch_index = 0;
+			batch_count = ExtractNextBatch(batch.data(),
+			                               std::min(budget, batch.size()));
+
+			if ( batch_count == 0 )
+				return;
+			}
+
+		while ( batch_index < batch_count )
+			{
+			// Processing may get suspended from inside the batch;
+			// we then continue with the remaining packets once it
+			// resumes.
+			if ( net_is_processing_suspended() && first_timestamp )
+				return;
+
+			Packet* pkt = &batch[batch_index++];
+
+			--budget;
+
+			if ( pkt->time < 0 )
+				{
+				Weird("negative_packet_timestamp", pkt);
+				continue;
+				}
+
+			if ( ! first_timestamp )
+				first_timestamp = pkt->time;
+
+			if ( pkt->Layer2Valid() )
+				{
+				batch_packet = pkt;
+				net_packet_dispatch(pkt->time, pkt, this);
+				batch_packet = nullptr;
+				}
+			}
+
+		batch_index = batch_count = 0;
+		DoneWithBatch();
+		}
+	}
+
+size_t PktSrc::ExtractNextBatch(Packet* pkts, size_t max)
+	{
+	if ( max == 0 )
+		return 0;
+
+	return ExtractNextPacket(pkts) ? 1 : 0;
+	}
+
+void PktSrc::DoneWithBatch()
+	{
+	DoneWithPacket();
+	}
+
 const char* PktSrc::Tag()
 	{
 	return "PktSrc";
@@ -284,6 +370,9 @@ bool PktSrc::PrecompileBPFFilter(int index, const std::string& filter)
 		return false;
 		}
 
+	if ( zeek::BifConst::Pcap::bpf_jit )
+		code->CompileNative();
+
 	// Store it in vector.
 	if ( index >= static_cast<int>(filters.size()) )
 		filters.resize(index + 1);
@@ -318,11 +407,17 @@ bool PktSrc::ApplyBPFFilter(int index, const struct pcap_pkthdr *hdr, const u_ch
 	if ( code->MatchesAnything() )
 		return true;
 
-	return pcap_offline_filter(code->GetProgram(), hdr, pkt);
+	return code->Matches(hdr, pkt);
 	}
 
 bool PktSrc::GetCurrentPacket(const Packet** pkt)
 	{
+	if ( batch_packet )
+		{
+		*pkt = batch_packet;
+		return true;
+		}
+
 	if ( ! have_packet )
 		return false;
 
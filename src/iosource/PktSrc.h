@@ -11,6 +11,7 @@
 
 struct pcap_pkthdr;
 class BPF_Program;
+struct ConnID;
 
 namespace iosource {
 
@@ -198,6 +199,31 @@ public:
 	 */
 	virtual bool SetFilter(int index) = 0;
 
+	/**
+	 * Asks the source to stop capturing the packets of a connection,
+	 * e.g. through a rule in the capture hardware or an XDP program
+	 * dropping them in the kernel. Zeek calls this for connections that
+	 * it bypasses. Packets of the connection may still arrive afterwards,
+	 * shunting is only a hint.
+	 *
+	 * Derived classes may override this if they support shunting. The
+	 * default implementation doesn't.
+	 *
+	 * @param id The connection's endpoints, oriented from originator to
+	 * responder, with ports in network order.
+	 *
+	 * @param proto The IP protocol number of the connection's transport
+	 * layer.
+	 *
+	 * @param timeout The time in seconds after which the source should
+	 * remove the rule again once no more packets of the connection match
+	 * it, letting them reach Zeek again. Zero leaves this to the source.
+	 *
+	 * @return True if the source will stop capturing the connection.
+	 */
+	virtual bool ShuntFlow(const ConnID& id, uint8_t proto, double timeout)
+		{ return false; }
+
 	/**
 	 * Returns current statistics about the source.
 	 *
@@ -348,6 +374,43 @@ protected:
 	 */
 	virtual void DoneWithPacket() = 0;
 
+	/**
+	 * Provides a batch of packets from the source. This is used instead
+	 * of \a ExtractNextPacket() when not running in pseudo-realtime mode
+	 * and \c Pcap::batch_size is larger than one, so that all packets of
+	 * a batch get processed before the main loop polls again.
+	 *
+	 * Derived classes can override this to hand out packets that they
+	 * retrieve in bulk from a buffer that keeps all of them valid at the
+	 * same time, such as a memory-mapped ring. The default
+	 * implementation extracts one packet through \a ExtractNextPacket(),
+	 * which suits sources that can only keep the most recent packet
+	 * around. Either way packets reference the source's buffer directly
+	 * and should not be copied; consumers that need the data for longer
+	 * use Packet::Retain(). If a call returns fewer than *max* packets,
+	 * it will be called again after \a DoneWithBatch() until a total of
+	 * \c Pcap::batch_size packets have been processed.
+	 *
+	 * @param pkts An array of at least *max* packet structures to fill
+	 * in. The callee keeps ownership of the data but must guarantee that
+	 * it stays available at least until \a DoneWithBatch() is called. It
+	 * is guaranteed that no two calls to this method will happen without
+	 * \a DoneWithBatch() in between.
+	 *
+	 * @param max The maximum number of packets to return.
+	 *
+	 * @return The number of packets filled in. Zero if no packet is
+	 * available or an error occured (which must be flagged via Error()).
+	 */
+	virtual size_t ExtractNextBatch(Packet* pkts, size_t max);
+
+	/**
+	 * Signals that the data of all packets of the batch previously
+	 * returned by \a ExtractNextBatch() will no longer be needed. The
+	 * default implementation calls \a DoneWithPacket().
+	 */
+	virtual void DoneWithBatch();
+
 private:
 	// Checks if the current packet has a pseudo-time <= current_time. If
 	// yes, returns pseudo-time, otherwise 0.
@@ -356,6 +419,9 @@ private:
 	// Internal helper for ExtractNextPacket().
 	bool ExtractNextPacketInternal();
 
+	// Internal helper for Process() when extracting packets in batches.
+	void ProcessBatch();
+
 	// IOSource interface implementation.
 	void InitSource() override;
 	void Done() override;
@@ -367,6 +433,12 @@ private:
 	bool have_packet;
 	Packet current_packet;
 
+	// For batched packet extraction.
+	std::vector<Packet> batch;
+	size_t batch_count;
+	size_t batch_index;
+	const Packet* batch_packet;
+
 	// For BPF filtering support.
 	std::vector<BPF_Program *> filters;
 
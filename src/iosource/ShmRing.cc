@@ -0,0 +1,355 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "ShmRing.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+#include "HugePages.h"
+#include "Packet.h"
+
+using namespace iosource;
+
+static constexpr uint32_t shm_ring_magic = 0x5a524e47; // "ZRNG"
+static constexpr uint32_t shm_ring_version = 1;
+static constexpr uint64_t min_shm_ring_size = 64 * 1024;
+
+namespace iosource {
+
+struct ShmRingHeader {
+	// Written last when creating the ring, so that a producer never
+	// attaches to a partially set up one.
+	std::atomic<uint32_t> magic;
+	uint32_t version;
+	uint64_t size;
+	std::atomic<uint32_t> finished;
+
+	// In separate cache lines, as each side writes only one of them.
+	alignas(64) std::atomic<uint64_t> head;	// where the producer writes next
+	alignas(64) std::atomic<uint64_t> tail;	// where the consumer reads next
+};
+
+// Records are 8-byte aligned. One with a size of zero marks that the
+// next record starts over at the beginning of the ring.
+struct ShmRingRecord {
+	uint32_t size;	// including this header and padding
+	uint32_t link_type;
+	uint32_t cap_len;
+	uint32_t len;
+	int64_t sec;
+	int64_t usec;
+};
+
+}
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "shared memory rings need lock-free 64-bit atomics");
+
+static constexpr uint64_t header_len = (sizeof(ShmRingHeader) + 63) & ~uint64_t(63);
+
+static std::string fifo_path(const std::string& path)
+	{
+	return path + ".fifo";
+	}
+
+ShmRing::~ShmRing()
+	{
+	if ( hdr )
+		munmap(hdr, map_len);
+
+	if ( fifo_fd >= 0 )
+		close(fifo_fd);
+
+	if ( fifo_keepalive_fd >= 0 )
+		close(fifo_keepalive_fd);
+
+	if ( owner )
+		{
+		unlink(path.c_str());
+		unlink(fifo_path(path).c_str());
+		}
+	}
+
+bool ShmRing::Map(ShmRing* r, int fd, uint64_t len, std::string* error)
+	{
+	void* m = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if ( m == MAP_FAILED )
+		{
+		*error = strerror(errno);
+		return false;
+		}
+
+#if defined(MADV_HUGEPAGE)
+	// Rings in tmpfs, like /dev/shm, can be backed by transparent huge
+	// pages if the kernel allows it for shared memory. Failing that is
+	// fine.
+	if ( len >= zeek::detail::HUGE_PAGE_MIN_REGION )
+		madvise(m, len, MADV_HUGEPAGE);
+#endif
+
+	r->hdr = static_cast<ShmRingHeader*>(m);
+	r->data = static_cast<u_char*>(m) + header_len;
+	r->map_len = len;
+	return true;
+	}
+
+ShmRing* ShmRing::Create(const std::string& path, uint64_t size, std::string* error)
+	{
+	uint64_t ring_size = min_shm_ring_size;
+
+	while ( ring_size < size )
+		ring_size *= 2;
+
+	auto fifo = fifo_path(path);
+
+	// Leftovers from an earlier run get replaced, rather than reused,
+	// as a producer may still have them mapped.
+	unlink(path.c_str());
+	unlink(fifo.c_str());
+
+	if ( mkfifo(fifo.c_str(), 0600) < 0 )
+		{
+		*error = "can't create " + fifo + ": " + strerror(errno);
+		return nullptr;
+		}
+
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+	if ( fd < 0 )
+		{
+		*error = "can't create " + path + ": " + strerror(errno);
+		unlink(fifo.c_str());
+		return nullptr;
+		}
+
+	auto r = new ShmRing();
+	r->path = path;
+	r->owner = true;
+
+	uint64_t len = header_len + ring_size;
+
+#ifdef __linux__
+	// Files in hugetlbfs need to be a multiple of its page size, with
+	// the remainder past the ring going unused.
+	struct statfs fs;
+
+	if ( fstatfs(fd, &fs) == 0 && fs.f_type == 0x958458f6 /* HUGETLBFS_MAGIC */ )
+		len = (len + fs.f_bsize - 1) / fs.f_bsize * fs.f_bsize;
+#endif
+
+	bool ok = ftruncate(fd, len) == 0 && Map(r, fd, len, error);
+
+	if ( ! ok && error->empty() )
+		*error = strerror(errno);
+
+	close(fd);
+
+	if ( ok )
+		{
+		r->fifo_fd = open(fifo.c_str(), O_RDONLY | O_NONBLOCK);
+		r->fifo_keepalive_fd = open(fifo.c_str(), O_WRONLY | O_NONBLOCK);
+		ok = r->fifo_fd >= 0 && r->fifo_keepalive_fd >= 0;
+
+		if ( ! ok )
+			*error = "can't open " + fifo + ": " + strerror(errno);
+		}
+
+	if ( ! ok )
+		{
+		delete r;
+		return nullptr;
+		}
+
+	r->mask = ring_size - 1;
+	r->hdr->version = shm_ring_version;
+	r->hdr->size = ring_size;
+	r->hdr->finished.store(0);
+	r->hdr->head.store(0);
+	r->hdr->tail.store(0);
+	r->hdr->magic.store(shm_ring_magic, std::memory_order_release);
+
+	return r;
+	}
+
+ShmRing* ShmRing::Attach(const std::string& path, std::string* error)
+	{
+	int fd = open(path.c_str(), O_RDWR);
+
+	if ( fd < 0 )
+		{
+		*error = strerror(errno);
+		return nullptr;
+		}
+
+	struct stat st;
+
+	if ( fstat(fd, &st) < 0 || static_cast<uint64_t>(st.st_size) <= header_len )
+		{
+		*error = "not a packet ring";
+		close(fd);
+		return nullptr;
+		}
+
+	auto r = new ShmRing();
+	bool ok = Map(r, fd, st.st_size, error);
+	close(fd);
+
+	if ( ok && (r->hdr->magic.load(std::memory_order_acquire) != shm_ring_magic ||
+	            r->hdr->version != shm_ring_version ||
+	            header_len + r->hdr->size > r->map_len) )
+		{
+		*error = "not a packet ring";
+		ok = false;
+		}
+
+	if ( ok )
+		{
+		// This fails with ENXIO if there's no consumer reading.
+		r->fifo_fd = open(fifo_path(path).c_str(), O_WRONLY | O_NONBLOCK);
+
+		if ( r->fifo_fd < 0 )
+			{
+			*error = strerror(errno);
+			ok = false;
+			}
+		}
+
+	if ( ! ok )
+		{
+		delete r;
+		return nullptr;
+		}
+
+	r->mask = r->hdr->size - 1;
+	return r;
+	}
+
+static uint64_t record_size(const Packet* pkt)
+	{
+	return (sizeof(ShmRingRecord) + pkt->cap_len + 7) & ~uint64_t(7);
+	}
+
+bool ShmRing::Fits(const Packet* pkt) const
+	{
+	return record_size(pkt) <= hdr->size;
+	}
+
+bool ShmRing::Push(const Packet* pkt)
+	{
+	uint64_t need = record_size(pkt);
+	uint64_t head = hdr->head.load(std::memory_order_relaxed);
+	uint64_t tail = hdr->tail.load(std::memory_order_acquire);
+	uint64_t old_head = head;
+	uint64_t offset = head & mask;
+	uint64_t contiguous = hdr->size - offset;
+
+	// Records don't wrap around, so the rest of the ring gets skipped if
+	// the packet doesn't fit there.
+	uint64_t skip = contiguous < need ? contiguous : 0;
+
+	if ( head + skip + need - tail > hdr->size )
+		return false;
+
+	if ( skip )
+		{
+		reinterpret_cast<ShmRingRecord*>(data + offset)->size = 0;
+		head += skip;
+		offset = 0;
+		}
+
+	auto rec = reinterpret_cast<ShmRingRecord*>(data + offset);
+	rec->size = need;
+	rec->link_type = pkt->link_type;
+	rec->cap_len = pkt->cap_len;
+	rec->len = pkt->len;
+	rec->sec = pkt->ts.tv_sec;
+	rec->usec = pkt->ts.tv_usec;
+	memcpy(rec + 1, pkt->data, pkt->cap_len);
+
+	hdr->head.store(head + need, std::memory_order_release);
+
+	// If the consumer has taken everything that came before, it may be
+	// about to wait for more.  Pairs with the fence in
+	// DrainNotifications(): either the consumer sees the new head when
+	// checking again, or we see that it caught up and wake it.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( hdr->tail.load(std::memory_order_relaxed) == old_head )
+		Notify();
+
+	return true;
+	}
+
+bool ShmRing::Notify()
+	{
+	char c = 0;
+
+	// A full FIFO means the consumer has wakeups pending already.
+	return write(fifo_fd, &c, 1) == 1 || errno == EAGAIN;
+	}
+
+void ShmRing::Finish()
+	{
+	hdr->finished.store(1, std::memory_order_release);
+	Notify();
+	}
+
+bool ShmRing::Finished() const
+	{
+	return hdr->finished.load(std::memory_order_acquire);
+	}
+
+bool ShmRing::Peek(Packet* pkt)
+	{
+	uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+	uint64_t head = hdr->head.load(std::memory_order_acquire);
+
+	if ( tail == head )
+		return false;
+
+	uint64_t offset = tail & mask;
+	auto rec = reinterpret_cast<const ShmRingRecord*>(data + offset);
+	peeked = 0;
+
+	if ( rec->size == 0 )
+		{
+		peeked = hdr->size - offset;
+		rec = reinterpret_cast<const ShmRingRecord*>(data);
+		}
+
+	peeked += rec->size;
+
+	pkt_timeval ts = { static_cast<time_t>(rec->sec),
+	                   static_cast<suseconds_t>(rec->usec) };
+	pkt->Init(rec->link_type, &ts, rec->cap_len, rec->len,
+	          reinterpret_cast<const u_char*>(rec + 1));
+
+	return true;
+	}
+
+void ShmRing::Pop()
+	{
+	uint64_t tail = hdr->tail.load(std::memory_order_relaxed);
+	hdr->tail.store(tail + peeked, std::memory_order_release);
+	peeked = 0;
+	}
+
+void ShmRing::DrainNotifications()
+	{
+	char buf[256];
+
+	while ( read(fifo_fd, buf, sizeof(buf)) > 0 )
+		;
+
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
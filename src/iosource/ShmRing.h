@@ -0,0 +1,135 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include <sys/types.h> // for u_char
+#include <cstdint>
+
+class Packet;
+
+namespace iosource {
+
+struct ShmRingHeader;
+
+/**
+ * A ring of packets in a memory-mapped file, passing them from one
+ * process to another. The consumer creates the ring, along with a FIFO
+ * next to it that the producer writes a byte to after adding packets, so
+ * that the consumer can wait for them with poll(). There's one producer
+ * and one consumer per ring, which need no locking between them.
+ */
+class ShmRing {
+public:
+	/**
+	 * Creates a new, empty ring at a path, replacing any existing one,
+	 * and opens it for consuming.
+	 *
+	 * @param path The file to map. The FIFO goes next to it, with a
+	 * ".fifo" suffix.
+	 *
+	 * @param size The room for packets, in bytes. Gets rounded up to a
+	 * power of two.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return The ring, or null on error.
+	 */
+	static ShmRing* Create(const std::string& path, uint64_t size, std::string* error);
+
+	/**
+	 * Opens an existing ring for producing.
+	 *
+	 * @return The ring, or null if the path isn't a ring that a consumer
+	 * is waiting on, with *error* set to why.
+	 */
+	static ShmRing* Attach(const std::string& path, std::string* error);
+
+	~ShmRing();
+
+	/**
+	 * Returns whether a packet fits into the ring at all.
+	 */
+	bool Fits(const Packet* pkt) const;
+
+	/**
+	 * Adds a packet, for the producer. This wakes up the consumer if it
+	 * may have run out of packets.
+	 *
+	 * @return False if the ring has no room for it right now.
+	 */
+	bool Push(const Packet* pkt);
+
+	/**
+	 * Wakes up the consumer, for the producer.
+	 *
+	 * @return False if the consumer has gone away.
+	 */
+	bool Notify();
+
+	/**
+	 * Marks that no more packets will come, for the producer.
+	 */
+	void Finish();
+
+	/**
+	 * Returns the next packet, without removing it, for the consumer.
+	 * The packet's data points into the ring and stays valid until
+	 * Pop().
+	 *
+	 * @return False if the ring is empty.
+	 */
+	bool Peek(Packet* pkt);
+
+	/**
+	 * Removes the packet that Peek() returned, for the consumer.
+	 */
+	void Pop();
+
+	/**
+	 * Returns true once the producer has called Finish(). Packets may
+	 * still be waiting in the ring.
+	 */
+	bool Finished() const;
+
+	/**
+	 * Reads all pending wakeup bytes, for the consumer. Call this after
+	 * Peek() finds the ring empty, and then check again before waiting
+	 * for the FIFO, so that no packets get missed.
+	 */
+	void DrainNotifications();
+
+	/**
+	 * Returns the file descriptor that becomes readable when the
+	 * producer has added packets, or for the producer, the one to write
+	 * to.
+	 */
+	int NotifyFD() const	{ return fifo_fd; }
+
+private:
+	ShmRing()	{ }
+
+	static bool Map(ShmRing* r, int fd, uint64_t len, std::string* error);
+
+	ShmRingHeader* hdr = nullptr;
+	u_char* data = nullptr;
+	uint64_t mask = 0;
+	uint64_t map_len = 0;
+	int fifo_fd = -1;
+
+	// For the consumer, which removes the files again when done.
+	std::string path;
+	bool owner = false;
+
+	// The consumer holds the FIFO open for writing as well, so that
+	// it doesn't poll as hung up when there's no producer.
+	int fifo_keepalive_fd = -1;
+
+	// The size of the packet that Peek() returned, including what it
+	// skipped to get there.
+	uint64_t peeked = 0;
+};
+
+}
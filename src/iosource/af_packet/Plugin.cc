@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Source.h"
+#include "plugin/Plugin.h"
+#include "iosource/Component.h"
+
+namespace plugin {
+namespace Zeek_AF_Packet {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new ::iosource::PktSrcComponent("AF_PacketReader", "af_packet", ::iosource::PktSrcComponent::LIVE, ::iosource::af_packet::AF_PacketSource::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::AF_Packet";
+		config.description = "Packet acquisition via AF_PACKET TPACKET_V3 rings";
+		return config;
+		}
+} plugin;
+
+}
+}
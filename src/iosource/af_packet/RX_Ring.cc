@@ -0,0 +1,147 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "RX_Ring.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "util.h"
+
+using namespace iosource::af_packet;
+
+RX_Ring::RX_Ring()
+	{
+	ring = nullptr;
+	ring_size = 0;
+	block_size = block_count = block_num = 0;
+	current_block = nullptr;
+	next_packet = nullptr;
+	packets_left = 0;
+	}
+
+RX_Ring::~RX_Ring()
+	{
+	if ( ring )
+		munmap(ring, ring_size);
+	}
+
+bool RX_Ring::Init(int sock, uint64_t buffer_size, uint64_t arg_block_size,
+                   int block_timeout_msec, std::string* error)
+	{
+	long page_size = sysconf(_SC_PAGESIZE);
+
+	if ( arg_block_size == 0 || arg_block_size % page_size != 0 ||
+	     arg_block_size > UINT32_MAX )
+		{
+		*error = fmt("block size %" PRIu64 " is not a multiple of the page size", arg_block_size);
+		return false;
+		}
+
+	if ( buffer_size < arg_block_size )
+		{
+		*error = fmt("buffer size %" PRIu64 " is smaller than block size", buffer_size);
+		return false;
+		}
+
+	// The frame size is irrelevant for TPACKET_V3 since packets get
+	// packed into blocks, but the kernel still checks it.
+	uint32_t frame_size = TPACKET_ALIGNMENT << 7;
+
+	tpacket_req3 req;
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = arg_block_size;
+	req.tp_block_nr = buffer_size / arg_block_size;
+	req.tp_frame_size = frame_size;
+	req.tp_frame_nr = (req.tp_block_size / frame_size) * req.tp_block_nr;
+	req.tp_retire_blk_tov = block_timeout_msec;
+	req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+
+	if ( setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0 )
+		{
+		*error = fmt("failed to set up RX ring: %s", strerror(errno));
+		return false;
+		}
+
+	ring_size = static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+	void* mem = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, sock, 0);
+
+	if ( mem == MAP_FAILED )
+		{
+		ring_size = 0;
+		*error = fmt("failed to map RX ring: %s", strerror(errno));
+		return false;
+		}
+
+	ring = static_cast<uint8_t*>(mem);
+	block_size = req.tp_block_size;
+	block_count = req.tp_block_nr;
+	block_num = 0;
+
+	return true;
+	}
+
+bool RX_Ring::NextBlock()
+	{
+	auto block = reinterpret_cast<tpacket_block_desc*>(ring + block_num * block_size);
+
+	if ( (block->hdr.bh1.block_status & TP_STATUS_USER) == 0 )
+		return false;
+
+	// Make sure we don't read the block's content before its status.
+	__sync_synchronize();
+
+	current_block = block;
+	packets_left = block->hdr.bh1.num_pkts;
+	next_packet = reinterpret_cast<tpacket3_hdr*>(
+		reinterpret_cast<uint8_t*>(block) + block->hdr.bh1.offset_to_first_pkt);
+
+	if ( packets_left == 0 )
+		{
+		ReleaseBlock();
+		return false;
+		}
+
+	return true;
+	}
+
+void RX_Ring::ReleaseBlock()
+	{
+	// Make sure we're done with the block's content before the kernel
+	// gets to see the status change.
+	__sync_synchronize();
+	current_block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+
+	current_block = nullptr;
+	next_packet = nullptr;
+	packets_left = 0;
+	block_num = (block_num + 1) % block_count;
+	}
+
+void RX_Ring::ReleaseBlockIfDone()
+	{
+	if ( current_block && packets_left == 0 )
+		ReleaseBlock();
+	}
+
+bool RX_Ring::GetNextPacket(tpacket3_hdr** hdr)
+	{
+	if ( ! ring )
+		return false;
+
+	ReleaseBlockIfDone();
+
+	if ( ! current_block && ! NextBlock() )
+		return false;
+
+	*hdr = next_packet;
+	--packets_left;
+
+	if ( packets_left > 0 )
+		next_packet = reinterpret_cast<tpacket3_hdr*>(
+			reinterpret_cast<uint8_t*>(next_packet) + next_packet->tp_next_offset);
+
+	return true;
+	}
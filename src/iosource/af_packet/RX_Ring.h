@@ -0,0 +1,92 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+
+#include <stdint.h>
+
+extern "C" {
+#include <linux/if_packet.h>
+}
+
+namespace iosource {
+namespace af_packet {
+
+/**
+ * A memory-mapped TPACKET_V3 receive ring attached to an AF_PACKET
+ * socket. The kernel fills whole blocks of packets; a block is handed
+ * back to the kernel only once all its packets have been consumed, so
+ * packet data can be passed on without copying.
+ */
+class RX_Ring {
+public:
+	/**
+	 * Constructor. Init() must be called before the ring can be used.
+	 */
+	RX_Ring();
+
+	/**
+	 * Destructor. Unmaps the ring.
+	 */
+	~RX_Ring();
+
+	/**
+	 * Sets up the ring on a socket that has been switched to
+	 * TPACKET_V3.
+	 *
+	 * @param sock The AF_PACKET socket.
+	 *
+	 * @param buffer_size The total size of the ring in bytes.
+	 *
+	 * @param block_size The size of a single block in bytes. Must be a
+	 * multiple of the page size.
+	 *
+	 * @param block_timeout_msec The time after which the kernel hands
+	 * out a block even if it isn't full yet.
+	 *
+	 * @param error Will receive an error message on failure.
+	 *
+	 * @return True on success.
+	 */
+	bool Init(int sock, uint64_t buffer_size, uint64_t block_size,
+	          int block_timeout_msec, std::string* error);
+
+	/**
+	 * Returns the next packet from the ring, or false if none is
+	 * available. The packet's data remains valid until the block it
+	 * belongs to is released through ReleaseBlockIfDone().
+	 */
+	bool GetNextPacket(tpacket3_hdr** hdr);
+
+	/**
+	 * Returns true if all packets of the current block have been handed
+	 * out (or if there's no current block).
+	 */
+	bool BlockDone() const
+		{ return packets_left == 0; }
+
+	/**
+	 * Returns the current block to the kernel if all its packets have
+	 * been handed out.
+	 */
+	void ReleaseBlockIfDone();
+
+private:
+	bool NextBlock();
+	void ReleaseBlock();
+
+	uint8_t* ring;
+	size_t ring_size;
+
+	uint32_t block_size;
+	uint32_t block_count;
+	uint32_t block_num;
+
+	tpacket_block_desc* current_block;
+	tpacket3_hdr* next_packet;
+	uint32_t packets_left;
+};
+
+}
+}
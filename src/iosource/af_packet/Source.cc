@@ -0,0 +1,498 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "Source.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <utility>
+
+extern "C" {
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+}
+
+#include "iosource/Packet.h"
+#include "iosource/BPF_Program.h"
+#include "Conn.h"
+#include "ID.h"
+#include "Net.h"
+#include "Val.h"
+
+using namespace iosource::af_packet;
+
+AF_PacketSource::~AF_PacketSource()
+	{
+	Close();
+	}
+
+AF_PacketSource::AF_PacketSource(const std::string& path, bool is_live)
+	{
+	if ( ! is_live )
+		Error("AF_Packet source does not support offline input");
+
+	props.path = path;
+	props.is_live = is_live;
+
+	socket_fd = -1;
+	if_index = -1;
+	rx_ring = nullptr;
+	kernel_received = kernel_dropped = 0;
+	shunt_timeout = 0;
+	next_shunt_sweep = 0;
+	}
+
+void AF_PacketSource::Open()
+	{
+	uint64_t buffer_size = zeek::id::find_val("AF_Packet::buffer_size")->AsCount();
+	uint64_t block_size = zeek::id::find_val("AF_Packet::block_size")->AsCount();
+	double block_timeout = zeek::id::find_val("AF_Packet::block_timeout")->AsInterval();
+	shunt_timeout = zeek::id::find_val("AF_Packet::shunt_timeout")->AsInterval();
+
+	socket_fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+
+	if ( socket_fd < 0 )
+		{
+		Error(fmt("AF_Packet: failed to create socket: %s", strerror(errno)));
+		return;
+		}
+
+	int version = TPACKET_V3;
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0 )
+		{
+		SocketError("failed to enable TPACKET_V3");
+		return;
+		}
+
+	rx_ring = new RX_Ring();
+	std::string ring_error;
+
+	if ( ! rx_ring->Init(socket_fd, buffer_size, block_size,
+	                     static_cast<int>(block_timeout * 1000), &ring_error) )
+		{
+		Error(fmt("AF_Packet: %s", ring_error.c_str()));
+		Close();
+		return;
+		}
+
+	if ( ! BindInterface() || ! EnablePromiscMode() || ! ConfigureFanout() )
+		return;
+
+	props.selectable_fd = socket_fd;
+	props.link_type = zeek::id::find_val("AF_Packet::link_type")->AsCount();
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	Opened(props);
+	}
+
+bool AF_PacketSource::BindInterface()
+	{
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+
+	if ( props.path.size() >= sizeof(ifr.ifr_name) )
+		{
+		Error(fmt("AF_Packet: interface name too long: %s", props.path.c_str()));
+		Close();
+		return false;
+		}
+
+	strncpy(ifr.ifr_name, props.path.c_str(), sizeof(ifr.ifr_name) - 1);
+
+	if ( ioctl(socket_fd, SIOCGIFINDEX, &ifr) < 0 )
+		{
+		SocketError("failed to look up interface");
+		return false;
+		}
+
+	if_index = ifr.ifr_ifindex;
+
+	struct sockaddr_ll saddr;
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sll_family = AF_PACKET;
+	saddr.sll_protocol = htons(ETH_P_ALL);
+	saddr.sll_ifindex = if_index;
+
+	if ( bind(socket_fd, reinterpret_cast<struct sockaddr*>(&saddr), sizeof(saddr)) < 0 )
+		{
+		SocketError("failed to bind to interface");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::EnablePromiscMode()
+	{
+	struct packet_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = if_index;
+	mreq.mr_type = PACKET_MR_PROMISC;
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0 )
+		{
+		SocketError("failed to enable promiscuous mode");
+		return false;
+		}
+
+	return true;
+	}
+
+bool AF_PacketSource::ConfigureFanout()
+	{
+	if ( ! zeek::id::find_val("AF_Packet::enable_fanout")->AsBool() )
+		return true;
+
+	// Order needs to match AF_Packet::FanoutMode.
+	static const int fanout_modes[] = {
+		PACKET_FANOUT_HASH,
+		PACKET_FANOUT_CPU,
+		PACKET_FANOUT_QM,
+	};
+
+	auto mode = zeek::id::find_val("AF_Packet::fanout_mode")->AsEnum();
+	auto id = zeek::id::find_val("AF_Packet::fanout_id")->AsCount();
+
+	if ( mode < 0 || mode >= static_cast<int>(sizeof(fanout_modes) / sizeof(fanout_modes[0])) )
+		{
+		Error(fmt("AF_Packet: unsupported fanout mode %d", mode));
+		Close();
+		return false;
+		}
+
+	int fanout_type = fanout_modes[mode];
+
+	if ( zeek::id::find_val("AF_Packet::enable_defrag")->AsBool() )
+		fanout_type |= PACKET_FANOUT_FLAG_DEFRAG;
+
+	uint32_t fanout_arg = (id & 0xffff) | (static_cast<uint32_t>(fanout_type) << 16);
+
+	if ( setsockopt(socket_fd, SOL_PACKET, PACKET_FANOUT, &fanout_arg, sizeof(fanout_arg)) < 0 )
+		{
+		SocketError("failed to join fanout group");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Close()
+	{
+	if ( socket_fd < 0 )
+		return;
+
+	delete rx_ring;
+	rx_ring = nullptr;
+	shunts.clear();
+
+	close(socket_fd);
+	socket_fd = -1;
+
+	Closed();
+	}
+
+void AF_PacketSource::FillPacket(Packet* pkt, tpacket3_hdr* hdr)
+	{
+	pkt_timeval ts = { static_cast<time_t>(hdr->tp_sec),
+	                   static_cast<suseconds_t>(hdr->tp_nsec / 1000) };
+
+	const u_char* data = reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac;
+	pkt->Init(props.link_type, &ts, hdr->tp_snaplen, hdr->tp_len, data);
+
+	// The kernel strips the outer VLAN tag and passes it on separately.
+	if ( (hdr->tp_status & TP_STATUS_VLAN_VALID) && pkt->vlan == 0 )
+		pkt->vlan = hdr->hv1.tp_vlan_tci & 0x0fff;
+
+	// Packets with offloaded checksums haven't been checksummed yet
+	// when they are captured, so their checksums cannot be trusted.
+	if ( hdr->tp_status & TP_STATUS_CSUMNOTREADY )
+		pkt->l3_checksummed = true;
+
+#ifdef TP_STATUS_CSUM_VALID
+	// The NIC or the kernel already verified the transport checksum.
+	if ( hdr->tp_status & TP_STATUS_CSUM_VALID )
+		pkt->l3_checksummed = true;
+#endif
+
+	++stats.received;
+	stats.bytes_received += hdr->tp_len;
+	}
+
+bool AF_PacketSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( ! rx_ring )
+		return false;
+
+	tpacket3_hdr* hdr;
+
+	while ( rx_ring->GetNextPacket(&hdr) )
+		{
+		if ( Shunted(hdr) )
+			continue;
+
+		FillPacket(pkt, hdr);
+		return true;
+		}
+
+	return false;
+	}
+
+void AF_PacketSource::DoneWithPacket()
+	{
+	if ( rx_ring )
+		rx_ring->ReleaseBlockIfDone();
+	}
+
+size_t AF_PacketSource::ExtractNextBatch(Packet* pkts, size_t max)
+	{
+	if ( ! rx_ring )
+		return 0;
+
+	size_t n = 0;
+	tpacket3_hdr* hdr;
+
+	// All packets of a batch come from the same block, as the block
+	// cannot get released before the whole batch is done.
+	while ( n < max && rx_ring->GetNextPacket(&hdr) )
+		{
+		if ( ! Shunted(hdr) )
+			FillPacket(&pkts[n++], hdr);
+
+		// With only shunted packets so far, nothing holds on to the
+		// block and we can move on to the next one.
+		if ( n > 0 && rx_ring->BlockDone() )
+			break;
+		}
+
+	return n;
+	}
+
+void AF_PacketSource::DoneWithBatch()
+	{
+	if ( rx_ring )
+		rx_ring->ReleaseBlockIfDone();
+	}
+
+bool AF_PacketSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool AF_PacketSource::SetFilter(int index)
+	{
+	if ( socket_fd < 0 )
+		return true; // Prevent error message
+
+	BPF_Program* code = GetBPFFilter(index);
+
+	if ( ! code )
+		{
+		Error(fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	// Filtering happens in the kernel, so that packets we're not
+	// interested in don't take up space in the ring.
+	struct bpf_program* program = code->GetProgram();
+
+	struct sock_fprog fprog;
+	fprog.len = program->bf_len;
+	fprog.filter = reinterpret_cast<struct sock_filter*>(program->bf_insns);
+
+	if ( setsockopt(socket_fd, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog)) < 0 )
+		{
+		SocketError("failed to attach filter");
+		return false;
+		}
+
+	return true;
+	}
+
+void AF_PacketSource::Statistics(Stats* s)
+	{
+	if ( socket_fd >= 0 )
+		{
+		struct tpacket_stats_v3 tp_stats;
+		socklen_t len = sizeof(tp_stats);
+
+		if ( getsockopt(socket_fd, SOL_PACKET, PACKET_STATISTICS, &tp_stats, &len) == 0 )
+			{
+			kernel_received += tp_stats.tp_packets;
+			kernel_dropped += tp_stats.tp_drops;
+			}
+		}
+
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->link = kernel_received;
+	s->dropped = kernel_dropped;
+	}
+
+bool AF_PacketSource::ShuntFlow(const ConnID& id, uint8_t proto, double timeout)
+	{
+	if ( ! rx_ring || props.link_type != DLT_EN10MB )
+		return false;
+
+	if ( proto != IPPROTO_TCP && proto != IPPROTO_UDP )
+		return false;
+
+	FlowKey key;
+	id.src_addr.CopyIPv6(key.addr1);
+	id.dst_addr.CopyIPv6(key.addr2);
+	key.port1 = static_cast<uint16_t>(id.src_port);
+	key.port2 = static_cast<uint16_t>(id.dst_port);
+	key.proto = proto;
+	key.Canonicalize();
+
+	if ( shunts.empty() )
+		next_shunt_sweep = network_time + shunt_timeout;
+
+	shunts[key] = {network_time, timeout > 0 ? timeout : shunt_timeout};
+	return true;
+	}
+
+bool AF_PacketSource::Shunted(const tpacket3_hdr* hdr)
+	{
+	if ( shunts.empty() )
+		return false;
+
+	double t = hdr->tp_sec + hdr->tp_nsec / 1e9;
+
+	if ( t >= next_shunt_sweep )
+		ExpireShunts(t);
+
+	FlowKey key;
+	auto data = reinterpret_cast<const u_char*>(hdr) + hdr->tp_mac;
+
+	if ( ! ExtractFlowKey(data, hdr->tp_snaplen, &key) )
+		return false;
+
+	auto it = shunts.find(key);
+
+	if ( it == shunts.end() )
+		return false;
+
+	// Once a flow has been quiet for long enough, Zeek gets to see it
+	// again.
+	if ( t - it->second.last_seen > it->second.timeout )
+		{
+		shunts.erase(it);
+		return false;
+		}
+
+	it->second.last_seen = t;
+	return true;
+	}
+
+void AF_PacketSource::ExpireShunts(double t)
+	{
+	for ( auto it = shunts.begin(); it != shunts.end(); )
+		{
+		if ( t - it->second.last_seen > it->second.timeout )
+			it = shunts.erase(it);
+		else
+			++it;
+		}
+
+	next_shunt_sweep = t + shunt_timeout;
+	}
+
+bool AF_PacketSource::ExtractFlowKey(const u_char* data, uint32_t len, FlowKey* key)
+	{
+	if ( len < ETH_HLEN )
+		return false;
+
+	uint32_t off = ETH_HLEN;
+	uint16_t type = (data[12] << 8) | data[13];
+
+	// The kernel strips the outer VLAN tag, but QinQ leaves more.
+	for ( int i = 0; i < 2 && (type == ETH_P_8021Q || type == ETH_P_8021AD); ++i )
+		{
+		if ( len < off + 4 )
+			return false;
+
+		type = (data[off + 2] << 8) | data[off + 3];
+		off += 4;
+		}
+
+	const u_char* ip = data + off;
+	uint32_t hdr_len;
+
+	if ( type == ETH_P_IP )
+		{
+		if ( len < off + 20 )
+			return false;
+
+		// Only the first fragment carries the ports.
+		if ( ((ip[6] & 0x1f) << 8 | ip[7]) != 0 )
+			return false;
+
+		hdr_len = (ip[0] & 0x0f) * 4;
+		key->proto = ip[9];
+		key->addr1[2] = key->addr2[2] = htonl(0xffff);
+		memcpy(&key->addr1[3], ip + 12, 4);
+		memcpy(&key->addr2[3], ip + 16, 4);
+		}
+
+	else if ( type == ETH_P_IPV6 )
+		{
+		if ( len < off + 40 )
+			return false;
+
+		// Flows with extension headers don't get shunted here; the
+		// transport header needs to come right after the fixed one.
+		hdr_len = 40;
+		key->proto = ip[6];
+		memcpy(key->addr1, ip + 8, 16);
+		memcpy(key->addr2, ip + 24, 16);
+		}
+
+	else
+		return false;
+
+	if ( key->proto != IPPROTO_TCP && key->proto != IPPROTO_UDP )
+		return false;
+
+	if ( hdr_len < 20 || len < off + hdr_len + 4 )
+		return false;
+
+	memcpy(&key->port1, ip + hdr_len, 2);
+	memcpy(&key->port2, ip + hdr_len + 2, 2);
+	key->Canonicalize();
+	return true;
+	}
+
+void AF_PacketSource::FlowKey::Canonicalize()
+	{
+	int c = memcmp(addr1, addr2, sizeof(addr1));
+
+	if ( c < 0 || (c == 0 && ntohs(port1) <= ntohs(port2)) )
+		return;
+
+	uint32_t a[4];
+	memcpy(a, addr1, sizeof(a));
+	memcpy(addr1, addr2, sizeof(a));
+	memcpy(addr2, a, sizeof(a));
+	std::swap(port1, port2);
+	}
+
+void AF_PacketSource::SocketError(const char* where)
+	{
+	Error(fmt("AF_Packet: %s: %s", where, strerror(errno)));
+	Close();
+	}
+
+iosource::PktSrc* AF_PacketSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new AF_PacketSource(path, is_live);
+	}
@@ -0,0 +1,107 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string.h>
+
+#include <string_view>
+#include <unordered_map>
+
+#include "../PktSrc.h"
+#include "RX_Ring.h"
+
+namespace iosource {
+namespace af_packet {
+
+/**
+ * Packet source reading from a memory-mapped AF_PACKET TPACKET_V3 ring.
+ * Packets are handed out directly from the ring without copying. With
+ * fanout enabled, several Zeek processes can attach to the same
+ * interface and the kernel balances flows across them.
+ *
+ * Flows that Zeek shunts get dropped while reading the ring, before Zeek
+ * looks at their packets. That doesn't save the kernel any work, but it
+ * does save Zeek's.
+ */
+class AF_PacketSource : public iosource::PktSrc {
+public:
+	AF_PacketSource(const std::string& path, bool is_live);
+	~AF_PacketSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+	bool ShuntFlow(const ConnID& id, uint8_t proto, double timeout) override;
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	size_t ExtractNextBatch(Packet* pkts, size_t max) override;
+	void DoneWithBatch() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	bool BindInterface();
+	bool EnablePromiscMode();
+	bool ConfigureFanout();
+	void FillPacket(Packet* pkt, tpacket3_hdr* hdr);
+	bool Shunted(const tpacket3_hdr* hdr);
+	void ExpireShunts(double t);
+	void SocketError(const char* where);
+
+	Properties props;
+	Stats stats;
+
+	int socket_fd;
+	int if_index;
+	RX_Ring* rx_ring;
+
+	// Counters reported by the kernel; reading them resets them, so we
+	// accumulate.
+	uint64_t kernel_received;
+	uint64_t kernel_dropped;
+
+	// A TCP or UDP flow, with the endpoints ordered so that both
+	// directions have the same key. Addresses are IPv6 or IPv4-mapped,
+	// ports are in network order.
+	struct FlowKey {
+		uint32_t addr1[4];
+		uint32_t addr2[4];
+		uint16_t port1;
+		uint16_t port2;
+		uint8_t proto;
+
+		FlowKey()	{ memset(this, 0, sizeof(*this)); }
+
+		void Canonicalize();
+
+		bool operator==(const FlowKey& other) const
+			{ return memcmp(this, &other, sizeof(*this)) == 0; }
+	};
+
+	struct FlowKeyHash {
+		size_t operator()(const FlowKey& k) const
+			{
+			auto data = reinterpret_cast<const char*>(&k);
+			return std::hash<std::string_view>()(std::string_view(data, sizeof(k)));
+			}
+	};
+
+	struct Shunt {
+		double last_seen;
+		double timeout;
+	};
+
+	static bool ExtractFlowKey(const u_char* data, uint32_t len, FlowKey* key);
+
+	std::unordered_map<FlowKey, Shunt, FlowKeyHash> shunts;
+	double shunt_timeout;
+	double next_shunt_sweep;
+};
+
+}
+}
@@ -2,21 +2,71 @@
 
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
 
 #include "Dumper.h"
 #include "../PktSrc.h"
 #include "../../Net.h"
+#include "ID.h"
+#include "ZeekString.h"
+#include "Func.h"
+#include "Reporter.h"
+#include "logging/Manager.h"
 
 #include "pcap.bif.h"
 
 using namespace iosource::pcap;
 
+// The writer thread stops taking over buffers once this many are queued
+// up, at which point the main thread waits for it.
+static const size_t MAX_QUEUED_BUFFERS = 64;
+
+// The per-packet record header of the pcap format, which uses 32-bit
+// timestamps even where struct timeval is larger.
+struct pcap_record_header {
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t caplen;
+	uint32_t len;
+};
+
+static bool write_all(int fd, const char* data, size_t len, std::string* error)
+	{
+	while ( len > 0 )
+		{
+		ssize_t n = write(fd, data, len);
+
+		if ( n < 0 )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			*error = strerror(errno);
+			return false;
+			}
+
+		data += n;
+		len -= n;
+		}
+
+	return true;
+	}
+
 PcapDumper::PcapDumper(const std::string& path, bool arg_append)
 	{
 	append = arg_append;
 	props.path = path;
-	dumper = nullptr;
 	pd = nullptr;
+	fd = -1;
+	buffer_size = std::max(zeek::BifConst::Pcap::dump_buffer_size, static_cast<bro_uint_t>(1));
+	file_size = 0;
+	next_rotate = 0;
+	compress = false;
+	codec = BlockCompressor::GZIP;
+	done = false;
 	}
 
 PcapDumper::~PcapDumper()
@@ -25,8 +75,6 @@ PcapDumper::~PcapDumper()
 
 void PcapDumper::Open()
 	{
-	int linktype = -1;
-
 	pd = pcap_open_dead(DLT_EN10MB, zeek::BifConst::Pcap::snaplen);
 
 	if ( ! pd )
@@ -41,78 +89,323 @@ void PcapDumper::Open()
 		return;
 		}
 
+	std::string compression((const char*) zeek::BifConst::Pcap::dump_compression->Bytes(),
+	                        zeek::BifConst::Pcap::dump_compression->Len());
+
+	if ( ! compression.empty() )
+		{
+		std::string error;
+
+		if ( ! BlockCompressor::ParseCodec(compression, &codec, &error) )
+			{
+			Error(fmt("invalid Pcap::dump_compression: %s", error.c_str()));
+			return;
+			}
+
+		compress = true;
+		}
+
+	if ( ! OpenFile(append) )
+		return;
+
+	props.open_time = network_time;
+	props.hdr_size = Packet::GetLinkHeaderSize(pcap_datalink(pd));
+	Opened(props);
+	}
+
+bool PcapDumper::OpenFile(bool arg_append)
+	{
 	struct stat s;
-	int exists = 0;
+	int exists = -1;
 
-	if ( append )
+	if ( arg_append )
 		{
 		// See if output file already exists (and is non-empty).
-		exists = stat(props.path.c_str(), &s); ;
+		exists = stat(props.path.c_str(), &s);
 
 		if ( exists < 0 && errno != ENOENT )
 			{
 			Error(fmt("can't stat file %s: %s", props.path.c_str(), strerror(errno)));
-			return;
+			return false;
 			}
 		}
 
-	if ( ! append || exists < 0 || s.st_size == 0 )
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (arg_append ? O_APPEND : O_TRUNC);
+	fd = open(props.path.c_str(), flags, 0666);
+
+	if ( fd < 0 )
 		{
-		// Open new file.
-		dumper = pcap_dump_open(pd, props.path.c_str());
-		if ( ! dumper )
-			{
-			Error(pcap_geterr(pd));
-			return;
-			}
+		Error(fmt("can't open dump %s: %s", props.path.c_str(), strerror(errno)));
+		return false;
 		}
 
-	else
+	if ( compress )
+		compressor = std::make_unique<BlockCompressor>(fd, codec,
+		                                               zeek::BifConst::Pcap::dump_compression_level,
+		                                               buffer_size, 0);
+
+	buffer.clear();
+	buffer.reserve(buffer_size);
+	file_size = 0;
+
+	if ( exists < 0 || s.st_size == 0 )
 		{
-		// Old file and we need to append, which, unfortunately,
-		// is not supported by libpcap. So, we have to hack a
-		// little bit, knowing that pcap_dumpter_t is, in fact,
-		// a FILE ... :-(
-		dumper = (pcap_dumper_t*) fopen(props.path.c_str(), "a");
-		if ( ! dumper )
-			{
-			Error(fmt("can't open dump %s: %s", props.path.c_str(), strerror(errno)));
-			return;
-			}
+		// New file, which starts with the file header. Appending
+		// continues the existing one.
+		struct pcap_file_header hdr;
+		hdr.magic = 0xa1b2c3d4;
+		hdr.version_major = PCAP_VERSION_MAJOR;
+		hdr.version_minor = PCAP_VERSION_MINOR;
+		hdr.thiszone = 0;
+		hdr.sigfigs = 0;
+		hdr.snaplen = pcap_snapshot(pd);
+		hdr.linktype = pcap_datalink(pd);
+		buffer.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+		file_size = sizeof(hdr);
 		}
 
-	props.open_time = network_time;
-	props.hdr_size = Packet::GetLinkHeaderSize(pcap_datalink(pd));
-	Opened(props);
+	done = false;
+	thread_error.clear();
+	writer = std::thread(&PcapDumper::Run, this);
+	return true;
+	}
+
+bool PcapDumper::CloseFile()
+	{
+	if ( fd < 0 )
+		return true;
+
+	Submit();
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		done = true;
+		}
+
+	cond.notify_all();
+	writer.join();
+
+	bool ok = CheckThreadError();
+	compressor.reset();
+
+	if ( close(fd) < 0 && ok )
+		{
+		Error(fmt("can't close dump %s: %s", props.path.c_str(), strerror(errno)));
+		ok = false;
+		}
+
+	fd = -1;
+	return ok;
 	}
 
 void PcapDumper::Close()
 	{
-	if ( ! dumper )
+	if ( ! pd )
 		return;
 
-	pcap_dump_close(dumper);
+	if ( next_rotate || zeek::BifConst::Pcap::dump_rotation_size )
+		Rotate(true);
+	else
+		CloseFile();
+
 	pcap_close(pd);
-	dumper = nullptr;
 	pd = nullptr;
 
 	Closed();
 	}
 
+void PcapDumper::Rotate(bool terminating)
+	{
+	double close_time = network_time;
+
+	if ( ! CloseFile() )
+		return;
+
+	static auto writer_type = zeek::id::find_type<zeek::EnumType>("Log::Writer");
+	static auto writer_val = writer_type->GetEnumVal(writer_type->Lookup("Log", "WRITER_NONE"));
+	static auto default_ppf = zeek::id::find_func("Log::__default_rotation_postprocessor");
+	static auto pp_cmd = zeek::id::find_func("Log::run_rotation_postprocessor_cmd");
+
+	std::string ext = ".pcap";
+
+	if ( compress )
+		ext += std::string(".") + BlockCompressor::Extension(codec);
+
+	auto rotation_path = log_mgr->FormatRotationPath(writer_val, props.path, props.open_time,
+	                                                 close_time, terminating, default_ppf);
+	rotation_path += ext;
+
+	if ( rename(props.path.c_str(), rotation_path.c_str()) != 0 )
+		reporter->Error("failed to rotate trace file %s to %s: %s", props.path.c_str(),
+		                rotation_path.c_str(), strerror(errno));
+
+	else if ( pp_cmd )
+		{
+		static auto rot_info_type = zeek::id::find_type<zeek::RecordType>("Log::RotationInfo");
+		auto rot_info = zeek::make_intrusive<zeek::RecordVal>(rot_info_type);
+		rot_info->Assign(0, writer_val);
+		rot_info->Assign<zeek::StringVal>(1, rotation_path);
+		rot_info->Assign<zeek::StringVal>(2, props.path);
+		rot_info->Assign<zeek::TimeVal>(3, props.open_time);
+		rot_info->Assign<zeek::TimeVal>(4, close_time);
+		rot_info->Assign(5, zeek::val_mgr->Bool(terminating));
+
+		try
+			{
+			pp_cmd->Invoke(std::move(rot_info),
+			               zeek::make_intrusive<zeek::StringVal>(rotation_path));
+			}
+		catch ( InterpreterException& e )
+			{
+			reporter->Warning("rotation post-processor failed for trace file %s",
+			                  rotation_path.c_str());
+			}
+		}
+
+	if ( terminating )
+		return;
+
+	// The rotated file is complete, the new one starts from scratch.
+	if ( ! OpenFile(false) )
+		return;
+
+	props.open_time = network_time;
+	next_rotate = 0;
+	}
+
 bool PcapDumper::Dump(const Packet* pkt)
 	{
-	if ( ! dumper )
+	if ( fd < 0 || ! CheckThreadError() )
 		return false;
 
-	// Reconstitute the pcap_pkthdr.
-	const struct pcap_pkthdr phdr = {
-		.ts = pkt->ts, .caplen = pkt->cap_len, .len = pkt->len
-	};
+	double interval = zeek::BifConst::Pcap::dump_rotation_interval;
+
+	if ( interval > 0 && network_time )
+		{
+		if ( ! next_rotate )
+			{
+			// Like log rotation, aligned to log_rotate_base_time.
+			static auto log_rotate_base_time = zeek::id::find_val<zeek::StringVal>("log_rotate_base_time");
+			static auto base = parse_rotate_base_time(log_rotate_base_time->AsString()->CheckString());
+
+			if ( ! props.open_time )
+				props.open_time = network_time;
+
+			next_rotate = network_time + calc_next_rotate(network_time, interval, base);
+			}
+
+		else if ( network_time >= next_rotate )
+			{
+			Rotate(false);
+
+			if ( fd < 0 )
+				return false;
+			}
+		}
+
+	pcap_record_header hdr;
+	hdr.ts_sec = pkt->ts.tv_sec;
+	hdr.ts_usec = pkt->ts.tv_usec;
+	hdr.caplen = pkt->cap_len;
+	hdr.len = pkt->len;
+
+	buffer.append(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+	buffer.append(reinterpret_cast<const char*>(pkt->data), pkt->cap_len);
+	file_size += sizeof(hdr) + pkt->cap_len;
+
+	if ( buffer.size() >= buffer_size && ! Submit() )
+		return false;
+
+	if ( zeek::BifConst::Pcap::dump_rotation_size &&
+	     file_size >= zeek::BifConst::Pcap::dump_rotation_size )
+		Rotate(false);
 
-	pcap_dump((u_char*) dumper, &phdr, pkt->data);
 	return true;
 	}
 
+bool PcapDumper::Submit()
+	{
+	if ( buffer.empty() )
+		return CheckThreadError();
+
+	std::string data;
+	data.reserve(buffer_size);
+	std::swap(data, buffer);
+
+		{
+		std::unique_lock<std::mutex> lock(mutex);
+		cond.wait(lock, [this] { return queue.size() < MAX_QUEUED_BUFFERS; });
+		queue.push_back(std::move(data));
+		}
+
+	cond.notify_all();
+	return CheckThreadError();
+	}
+
+bool PcapDumper::CheckThreadError()
+	{
+	std::string error;
+
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		error = thread_error;
+		}
+
+	if ( error.empty() )
+		return true;
+
+	if ( ! IsError() )
+		Error(fmt("can't write dump %s: %s", props.path.c_str(), error.c_str()));
+
+	return false;
+	}
+
+void PcapDumper::Run()
+	{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while ( true )
+		{
+		cond.wait(lock, [this] { return done || ! queue.empty(); });
+
+		if ( queue.empty() )
+			break;
+
+		std::string data = std::move(queue.front());
+		queue.pop_front();
+		lock.unlock();
+		cond.notify_all();
+
+		std::string error;
+		bool ok;
+
+		if ( compressor )
+			{
+			ok = compressor->Write(data.data(), data.size()) && compressor->Flush();
+
+			if ( ! ok )
+				error = compressor->Error();
+			}
+		else
+			ok = write_all(fd, data.data(), data.size(), &error);
+
+		lock.lock();
+
+		if ( ! ok && thread_error.empty() )
+			thread_error = error;
+		}
+
+	if ( compressor && thread_error.empty() )
+		{
+		lock.unlock();
+		bool ok = compressor->Close();
+		lock.lock();
+
+		if ( ! ok )
+			thread_error = compressor->Error();
+		}
+	}
+
 iosource::PktDumper* PcapDumper::Instantiate(const std::string& path, bool append)
 	{
 	return new PcapDumper(path, append);
@@ -6,11 +6,26 @@ extern "C" {
 #include <pcap.h>
 }
 
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include "../PktDumper.h"
+#include "logging/writers/ascii/BlockCompressor.h"
 
 namespace iosource {
 namespace pcap {
 
+/**
+ * Writes packets in pcap format. Packets get copied into a buffer of
+ * Pcap::dump_buffer_size bytes that is handed to a writer thread once
+ * full, so that slow disks don't hold up the main thread. The writer
+ * thread can compress the output and the dumper can rotate its file
+ * like a log.
+ */
 class PcapDumper : public PktDumper {
 public:
 	PcapDumper(const std::string& path, bool append);
@@ -25,11 +40,51 @@ protected:
 	bool Dump(const Packet* pkt) override;
 
 private:
+	using BlockCompressor = logging::writer::detail::BlockCompressor;
+
+	// Opens props.path and starts the writer thread.
+	bool OpenFile(bool append);
+
+	// Writes out all pending data, stops the writer thread, and closes
+	// the file.
+	bool CloseFile();
+
+	// Moves the current file out of the way, passes it on to the log
+	// rotation post-processor, and opens a new one.
+	void Rotate(bool terminating);
+
+	// Hands the current buffer to the writer thread, waiting if it is
+	// too far behind already.
+	bool Submit();
+
+	// Main function of the writer thread.
+	void Run();
+
+	// Reports an error that the writer thread has encountered.
+	bool CheckThreadError();
+
 	Properties props;
 
 	bool append;
-	pcap_dumper_t* dumper;
 	pcap_t* pd;
+	int fd;
+
+	uint64_t buffer_size;
+	std::string buffer;
+	uint64_t file_size;
+	double next_rotate;
+
+	bool compress;
+	BlockCompressor::Codec codec;
+	std::unique_ptr<BlockCompressor> compressor;
+
+	// State shared with the writer thread.
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::string> queue;
+	bool done;
+	std::string thread_error;
 };
 
 }
@@ -0,0 +1,182 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "Index.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+extern "C" {
+#include <pcap.h>
+}
+
+using namespace iosource::pcap;
+
+// Written at the start of the sidecar file, followed by the format
+// version, the size and modification time of the trace it was built
+// from, and the number of entries. Integers and times are stored in host
+// byte order; indexes aren't meant to move between architectures.
+static constexpr char index_magic[8] = { 'Z', 'E', 'E', 'K', 'P', 'I', 'D', 'X' };
+static constexpr uint32_t index_version = 1;
+
+bool PcapIndex::Open(const std::string& path, double interval, std::string* error)
+	{
+	struct stat st;
+
+	if ( stat(path.c_str(), &st) < 0 )
+		{
+		*error = strerror(errno);
+		return false;
+		}
+
+	auto file = path + ".zidx";
+	uint64_t size = st.st_size;
+	int64_t mtime = st.st_mtime;
+
+	if ( Load(file, size, mtime) )
+		return true;
+
+	if ( ! Build(path, interval, error) )
+		return false;
+
+	Save(file, size, mtime);
+	return true;
+	}
+
+uint64_t PcapIndex::Seek(double t) const
+	{
+	// The entries' preceding timestamps never decrease, so the last
+	// entry with all packets before it earlier than t is where to start.
+	auto it = std::lower_bound(entries.begin(), entries.end(), t,
+	                           [](const Entry& e, double t)
+	                           { return e.preceding_ts < t; });
+
+	// The first entry precedes everything, so it's only found for an
+	// empty index.
+	if ( it == entries.begin() )
+		return 0;
+
+	return std::prev(it)->offset;
+	}
+
+bool PcapIndex::Load(const std::string& file, uint64_t trace_size, int64_t trace_mtime)
+	{
+	FILE* f = fopen(file.c_str(), "r");
+
+	if ( ! f )
+		return false;
+
+	char magic[sizeof(index_magic)];
+	uint32_t version, n;
+	uint64_t size;
+	int64_t mtime;
+
+	bool ok = fread(magic, sizeof(magic), 1, f) == 1 &&
+	          memcmp(magic, index_magic, sizeof(magic)) == 0 &&
+	          fread(&version, sizeof(version), 1, f) == 1 &&
+	          version == index_version &&
+	          fread(&size, sizeof(size), 1, f) == 1 &&
+	          fread(&mtime, sizeof(mtime), 1, f) == 1 &&
+	          fread(&n, sizeof(n), 1, f) == 1;
+
+	// An index of what the trace was before gets rebuilt.
+	if ( ok && size == trace_size && mtime == trace_mtime )
+		{
+		entries.resize(n);
+		ok = n == 0 || fread(entries.data(), sizeof(Entry), n, f) == n;
+		}
+	else
+		ok = false;
+
+	fclose(f);
+
+	if ( ! ok )
+		entries.clear();
+
+	return ok;
+	}
+
+bool PcapIndex::Build(const std::string& path, double interval, std::string* error)
+	{
+	char errbuf[PCAP_ERRBUF_SIZE];
+	pcap_t* pd = pcap_open_offline(path.c_str(), errbuf);
+
+	if ( ! pd )
+		{
+		*error = errbuf;
+		return false;
+		}
+
+	FILE* f = pcap_file(pd);
+	double preceding_ts = std::numeric_limits<double>::lowest();
+	double next_entry_ts = preceding_ts;
+
+	entries.clear();
+
+	while ( true )
+		{
+		off_t offset = ftello(f);
+		pcap_pkthdr* header;
+		const u_char* data;
+		int res = pcap_next_ex(pd, &header, &data);
+
+		if ( res == PCAP_ERROR_BREAK )
+			break;
+
+		if ( res != 1 || offset < 0 )
+			{
+			*error = res == PCAP_ERROR ? pcap_geterr(pd) : strerror(errno);
+			pcap_close(pd);
+			entries.clear();
+			return false;
+			}
+
+		double ts = header->ts.tv_sec + header->ts.tv_usec / 1e6;
+
+		if ( ts >= next_entry_ts )
+			{
+			entries.push_back({preceding_ts, static_cast<uint64_t>(offset)});
+			next_entry_ts = ts + interval;
+			}
+
+		preceding_ts = std::max(preceding_ts, ts);
+		}
+
+	pcap_close(pd);
+	return true;
+	}
+
+void PcapIndex::Save(const std::string& file, uint64_t trace_size, int64_t trace_mtime) const
+	{
+	// Write to a temporary file first, so that others reading the same
+	// trace meanwhile never see a partial index. If the trace's
+	// directory isn't writable, the index just doesn't get kept.
+	auto tmp = file + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w");
+
+	if ( ! f )
+		return;
+
+	uint32_t n = entries.size();
+
+	bool ok = fwrite(index_magic, sizeof(index_magic), 1, f) == 1 &&
+	          fwrite(&index_version, sizeof(index_version), 1, f) == 1 &&
+	          fwrite(&trace_size, sizeof(trace_size), 1, f) == 1 &&
+	          fwrite(&trace_mtime, sizeof(trace_mtime), 1, f) == 1 &&
+	          fwrite(&n, sizeof(n), 1, f) == 1 &&
+	          (n == 0 || fwrite(entries.data(), sizeof(Entry), n, f) == n);
+
+	if ( fclose(f) != 0 )
+		ok = false;
+
+	if ( ! ok || rename(tmp.c_str(), file.c_str()) < 0 )
+		unlink(tmp.c_str());
+	}
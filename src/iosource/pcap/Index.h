@@ -0,0 +1,62 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace iosource {
+namespace pcap {
+
+/**
+ * An index of a trace file mapping packet timestamps to the offsets of
+ * their records, so that reading a time range can seek right to its
+ * start. It's kept in a sidecar file next to the trace, named like the
+ * trace with ".zidx" appended, and rebuilt when the trace changes.
+ */
+class PcapIndex {
+public:
+	/**
+	 * Returns the index of a trace, loading it from its sidecar file or
+	 * building it by reading through the trace once. A newly built index
+	 * gets saved for next time, if the sidecar file can be written.
+	 *
+	 * @param path The trace file.
+	 *
+	 * @param interval The seconds of trace time between entries of a
+	 * newly built index.
+	 *
+	 * @param error Set to what went wrong, if anything.
+	 *
+	 * @return True if the index is available.
+	 */
+	bool Open(const std::string& path, double interval, std::string* error);
+
+	/**
+	 * Returns the offset to start reading from for packets from a given
+	 * time on. Packets before it may follow, but none at or after it
+	 * come earlier.
+	 */
+	uint64_t Seek(double t) const;
+
+	/**
+	 * Returns the number of entries.
+	 */
+	size_t Size() const	{ return entries.size(); }
+
+private:
+	struct Entry {
+		double preceding_ts;	// largest timestamp before the offset
+		uint64_t offset;
+	};
+
+	bool Load(const std::string& file, uint64_t trace_size, int64_t trace_mtime);
+	bool Build(const std::string& path, double interval, std::string* error);
+	void Save(const std::string& file, uint64_t trace_size, int64_t trace_mtime) const;
+
+	std::vector<Entry> entries;
+};
+
+}
+}
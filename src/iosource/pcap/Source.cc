@@ -3,6 +3,7 @@
 #include "zeek-config.h"
 
 #include "Source.h"
+#include "Index.h"
 #include "iosource/Packet.h"
 #include "iosource/BPF_Program.h"
 
@@ -14,8 +15,18 @@
 #include <pcap-int.h>
 #endif
 
+#include <errno.h>
+#include <fcntl.h>
+
 using namespace iosource::pcap;
 
+// The size of the stdio buffer of traces read in a time range, making
+// for fewer and larger reads.
+static constexpr size_t RANGE_READ_BUFFER_SIZE = 1024 * 1024;
+
+// The size of a packet record's header in a pcap file.
+static constexpr size_t PCAP_RECORD_HEADER_SIZE = 16;
+
 PcapSource::~PcapSource()
 	{
 	Close();
@@ -172,7 +183,47 @@ void PcapSource::OpenOffline()
 	{
 	char errbuf[PCAP_ERRBUF_SIZE];
 
-	pd = pcap_open_offline(props.path.c_str(), errbuf);
+	read_start = zeek::BifConst::Pcap::read_start;
+	read_end = zeek::BifConst::Pcap::read_end;
+
+	// Standard input can't seek, so its packets are just skipped until
+	// the range starts.
+	if ( (read_start > 0 || read_end > 0) && props.path != "-" )
+		{
+		FILE* f = fopen(props.path.c_str(), "r");
+
+		if ( ! f )
+			{
+			Error(fmt("%s: %s", props.path.c_str(), strerror(errno)));
+			return;
+			}
+
+		setvbuf(f, nullptr, _IOFBF, RANGE_READ_BUFFER_SIZE);
+		pd = pcap_fopen_offline(f, errbuf);
+
+		if ( ! pd )
+			{
+			fclose(f);
+			Error(errbuf);
+			return;
+			}
+
+		read_offset = IndexedStart();
+
+		if ( read_offset && fseeko(f, read_offset, SEEK_SET) < 0 )
+			{
+			Error(fmt("can't seek in %s: %s", props.path.c_str(), strerror(errno)));
+			pcap_close(pd);
+			pd = nullptr;
+			return;
+			}
+
+		prefetch_fd = fileno(f);
+		prefetched_to = read_offset;
+		Prefetch();
+		}
+	else
+		pd = pcap_open_offline(props.path.c_str(), errbuf);
 
 	if ( ! pd )
 		{
@@ -191,15 +242,12 @@ void PcapSource::OpenOffline()
 	Opened(props);
 	}
 
-bool PcapSource::ExtractNextPacket(Packet* pkt)
+bool PcapSource::ReadPacket(pcap_pkthdr** header, const u_char** data)
 	{
 	if ( ! pd )
 		return false;
 
-	const u_char* data;
-	pcap_pkthdr* header;
-
-	int res = pcap_next_ex(pd, &header, &data);
+	int res = pcap_next_ex(pd, header, data);
 
 	switch ( res ) {
 	case PCAP_ERROR_BREAK: // -2
@@ -221,11 +269,75 @@ bool PcapSource::ExtractNextPacket(Packet* pkt)
 		return false;
 	case 1:
 		// Read a packet without problem.
-		break;
+		return true;
 	default:
 		reporter->InternalError("unhandled pcap_next_ex return value: %d", res);
 		return false;
 	}
+	}
+
+uint64_t PcapSource::IndexedStart()
+	{
+	if ( read_start <= 0 )
+		return 0;
+
+	PcapIndex index;
+	std::string error;
+
+	if ( ! index.Open(props.path, zeek::BifConst::Pcap::index_interval, &error) )
+		{
+		reporter->Warning("can't index %s, reading it from the start: %s",
+		                  props.path.c_str(), error.c_str());
+		return 0;
+		}
+
+	return index.Seek(read_start);
+	}
+
+void PcapSource::Prefetch()
+	{
+#ifdef POSIX_FADV_WILLNEED
+	uint64_t size = zeek::BifConst::Pcap::prefetch_size;
+
+	if ( prefetch_fd < 0 || ! size || read_offset + size / 2 < prefetched_to )
+		return;
+
+	// Asks the kernel to read the next chunk in the background, while
+	// the current one gets processed.
+	posix_fadvise(prefetch_fd, prefetched_to, size, POSIX_FADV_WILLNEED);
+	prefetched_to += size;
+#endif
+	}
+
+bool PcapSource::ExtractNextPacket(Packet* pkt)
+	{
+	const u_char* data;
+	pcap_pkthdr* header;
+
+	while ( true )
+		{
+		if ( ! ReadPacket(&header, &data) )
+			return false;
+
+		if ( read_start <= 0 && read_end <= 0 )
+			break;
+
+		// Offsets are estimated from pcap records; pcapng ones take a
+		// bit more, which only makes the prefetching run a bit early.
+		read_offset += PCAP_RECORD_HEADER_SIZE + header->caplen;
+		Prefetch();
+
+		double ts = header->ts.tv_sec + header->ts.tv_usec / 1e6;
+
+		if ( read_end > 0 && ts >= read_end )
+			{
+			Close();
+			return false;
+			}
+
+		if ( ts >= read_start )
+			break;
+		}
 
 	pkt->Init(props.link_type, &header->ts, header->caplen, header->len, data);
 
@@ -34,11 +34,25 @@ private:
 	void OpenLive();
 	void OpenOffline();
 	void PcapError(const char* where = nullptr);
+	bool ReadPacket(pcap_pkthdr** header, const u_char** data);
+	uint64_t IndexedStart();
+	void Prefetch();
 
 	Properties props;
 	Stats stats;
 
 	pcap_t *pd;
+
+	// The time range of packets to read from a trace, if restricted
+	// through Pcap::read_start and Pcap::read_end.
+	double read_start = 0;
+	double read_end = 0;
+
+	// When reading a range, the trace gets read ahead of the offset
+	// where packets currently come from.
+	int prefetch_fd = -1;
+	uint64_t read_offset = 0;
+	uint64_t prefetched_to = 0;
 };
 
 }
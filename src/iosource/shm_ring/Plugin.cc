@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Source.h"
+#include "plugin/Plugin.h"
+#include "iosource/Component.h"
+
+namespace plugin {
+namespace Zeek_ShmRing {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new ::iosource::PktSrcComponent("ShmRingReader", "shmring", ::iosource::PktSrcComponent::LIVE, ::iosource::shm_ring::ShmRingSource::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::ShmRing";
+		config.description = "Packet acquisition from a local packet balancer's shared-memory ring";
+		return config;
+		}
+} plugin;
+
+}
+}
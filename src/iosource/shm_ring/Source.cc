@@ -0,0 +1,147 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "Source.h"
+
+#include "iosource/Packet.h"
+#include "iosource/BPF_Program.h"
+#include "iosource/ShmRing.h"
+#include "ID.h"
+#include "Val.h"
+
+using namespace iosource::shm_ring;
+
+ShmRingSource::~ShmRingSource()
+	{
+	Close();
+	}
+
+ShmRingSource::ShmRingSource(const std::string& path, bool is_live)
+	{
+	if ( ! is_live )
+		Error("ShmRing source does not support offline input");
+
+	props.path = path;
+	props.is_live = is_live;
+
+	ring = nullptr;
+	current_filter = -1;
+	}
+
+void ShmRingSource::Open()
+	{
+	uint64_t buffer_size = zeek::id::find_val("ShmRing::buffer_size")->AsCount();
+	std::string error;
+
+	ring = ShmRing::Create(props.path, buffer_size, &error);
+
+	if ( ! ring )
+		{
+		Error(fmt("ShmRing: %s", error.c_str()));
+		return;
+		}
+
+	props.selectable_fd = ring->NotifyFD();
+	props.link_type = zeek::id::find_val("ShmRing::link_type")->AsCount();
+	props.netmask = NETMASK_UNKNOWN;
+	props.is_live = true;
+
+	Opened(props);
+	}
+
+void ShmRingSource::Close()
+	{
+	if ( ! ring )
+		return;
+
+	delete ring;
+	ring = nullptr;
+
+	Closed();
+	}
+
+bool ShmRingSource::NextPacket(Packet* pkt)
+	{
+	while ( ring && ring->Peek(pkt) )
+		{
+		struct pcap_pkthdr hdr;
+		hdr.ts = pkt->ts;
+		hdr.caplen = pkt->cap_len;
+		hdr.len = pkt->len;
+
+		if ( current_filter < 0 || ApplyBPFFilter(current_filter, &hdr, pkt->data) )
+			return true;
+
+		ring->Pop();
+		}
+
+	return false;
+	}
+
+bool ShmRingSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( ! ring )
+		return false;
+
+	if ( ! NextPacket(pkt) )
+		{
+		if ( ! ring )
+			return false;
+
+		// Clear the wakeups before checking again, so that the ones for
+		// packets arriving in between stay pending. Once the balancer
+		// has finished, this last check sees everything it pushed.
+		ring->DrainNotifications();
+		bool finished = ring->Finished();
+
+		if ( ! NextPacket(pkt) )
+			{
+			if ( finished )
+				Close();
+
+			return false;
+			}
+		}
+
+	++stats.received;
+	stats.bytes_received += pkt->len;
+	return true;
+	}
+
+void ShmRingSource::DoneWithPacket()
+	{
+	if ( ring )
+		ring->Pop();
+	}
+
+bool ShmRingSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool ShmRingSource::SetFilter(int index)
+	{
+	// The balancer passes on everything, so filtering happens here.
+	if ( ! GetBPFFilter(index) )
+		{
+		Error(fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	current_filter = index;
+	return true;
+	}
+
+void ShmRingSource::Statistics(Stats* s)
+	{
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->link = stats.received;
+	s->dropped = 0;
+	}
+
+iosource::PktSrc* ShmRingSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new ShmRingSource(path, is_live);
+	}
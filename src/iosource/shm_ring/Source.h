@@ -0,0 +1,48 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include "../PktSrc.h"
+
+namespace iosource {
+
+class ShmRing;
+
+namespace shm_ring {
+
+/**
+ * Packet source reading the packets that a "zeek --balance-packets"
+ * process passes on to this worker. The path names the ring, which the
+ * source creates for the balancer to attach to. Packets are handed out
+ * directly from the ring without copying.
+ */
+class ShmRingSource : public iosource::PktSrc {
+public:
+	ShmRingSource(const std::string& path, bool is_live);
+	~ShmRingSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	// Returns the next packet passing the filter, if any.
+	bool NextPacket(Packet* pkt);
+
+	Properties props;
+	Stats stats;
+
+	ShmRing* ring;
+	int current_filter;
+};
+
+}
+}
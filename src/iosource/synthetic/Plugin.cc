@@ -0,0 +1,32 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "Source.h"
+#include "plugin/Plugin.h"
+#include "iosource/Component.h"
+
+namespace plugin {
+namespace Zeek_Synthetic {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new ::iosource::PktSrcComponent("SyntheticReader", "synthetic", ::iosource::PktSrcComponent::BOTH, ::iosource::synthetic::SyntheticSource::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::Synthetic";
+		config.description = "Synthetic traffic generation for throughput benchmarking";
+		return config;
+		}
+
+	void Done() override
+		{
+		// Runs once processing has finished, so the report can
+		// include the shutdown.
+		::iosource::synthetic::SyntheticSource::Report();
+		zeek::plugin::Plugin::Done();
+		}
+} plugin;
+
+}
+}
@@ -0,0 +1,596 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include "Source.h"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <time.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include <pcap.h>
+}
+
+#include "iosource/Packet.h"
+#include "iosource/BPF_Program.h"
+#include "Event.h"
+#include "Net.h"
+#include "ID.h"
+#include "Val.h"
+
+using namespace iosource::synthetic;
+
+SyntheticSource::Summary SyntheticSource::summary;
+
+// Largest TCP or UDP payload that fits into an Ethernet frame.
+static const size_t max_payload = 1460;
+
+static std::string u16(uint16_t v)
+	{
+	return std::string{char(v >> 8), char(v & 0xff)};
+	}
+
+static std::string u24(uint32_t v)
+	{
+	return std::string{char(v >> 16), char((v >> 8) & 0xff), char(v & 0xff)};
+	}
+
+static std::string tls_record(uint8_t type, const std::string& body)
+	{
+	return std::string(1, char(type)) + u16(0x0303) + u16(body.size()) + body;
+	}
+
+static std::string tls_handshake(uint8_t type, const std::string& body)
+	{
+	return std::string(1, char(type)) + u24(body.size()) + body;
+	}
+
+static void put16(u_char* p, uint16_t v)
+	{
+	p[0] = v >> 8;
+	p[1] = v & 0xff;
+	}
+
+static void put32(u_char* p, uint32_t v)
+	{
+	put16(p, v >> 16);
+	put16(p + 2, v & 0xffff);
+	}
+
+// Ones-complement sum over big-endian 16-bit words.
+static uint32_t sum_words(const u_char* p, size_t len, uint32_t sum)
+	{
+	for ( size_t i = 0; i + 1 < len; i += 2 )
+		sum += (p[i] << 8) | p[i + 1];
+
+	if ( len % 2 )
+		sum += p[len - 1] << 8;
+
+	return sum;
+	}
+
+static uint16_t fold(uint32_t sum)
+	{
+	while ( sum >> 16 )
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return ~sum & 0xffff;
+	}
+
+static uint16_t l4_checksum(uint32_t src, uint32_t dst, uint8_t proto,
+                            const u_char* p, size_t len)
+	{
+	uint32_t sum = (src >> 16) + (src & 0xffff) + (dst >> 16) + (dst & 0xffff);
+	sum += proto + len;
+	return fold(sum_words(p, len, sum));
+	}
+
+void SyntheticSource::AddTCPSteps(std::vector<Step>* steps,
+                                  const std::vector<std::pair<bool, int>>& segments,
+                                  size_t ack_every)
+	{
+	steps->push_back({true, TH_SYN, -1, 0, 0, false});
+	steps->push_back({false, TH_SYN | TH_ACK, -1, 0, 0, false});
+	steps->push_back({true, TH_ACK, -1, 0, 0, false});
+
+	for ( size_t i = 0; i < segments.size(); ++i )
+		{
+		bool from_orig = segments[i].first;
+		steps->push_back({from_orig, TH_PUSH | TH_ACK, segments[i].second, 0, 0, false});
+
+		bool last_in_row = i + 1 == segments.size() || segments[i + 1].first != from_orig;
+
+		if ( (i + 1) % ack_every == 0 || last_in_row )
+			steps->push_back({! from_orig, TH_ACK, -1, 0, 0, false});
+		}
+
+	steps->push_back({true, TH_FIN | TH_ACK, -1, 0, 0, false});
+	steps->push_back({false, TH_FIN | TH_ACK, -1, 0, 0, false});
+	steps->push_back({true, TH_ACK, -1, 0, 0, false});
+	}
+
+SyntheticSource::~SyntheticSource()
+	{
+	Close();
+	}
+
+SyntheticSource::SyntheticSource(const std::string& path, bool is_live)
+	{
+	props.path = path;
+	props.is_live = is_live;
+
+	next_flow = 0;
+	num_flows = 0;
+	total_weight = 0;
+	max_packets = 0;
+	packet_interval = 0;
+	start_ts = 0;
+	current_filter = -1;
+	open = false;
+	}
+
+void SyntheticSource::InitTemplates()
+	{
+	templates.clear();
+
+	Template http{"http", TCP, 80, false};
+	std::string body(1024, 'x');
+	http.payloads.push_back("GET /index.html HTTP/1.1\r\n"
+	                        "Host: www.example.com\r\n"
+	                        "User-Agent: zeek-synthetic\r\n"
+	                        "Accept: */*\r\n\r\n");
+	http.payloads.push_back("HTTP/1.1 200 OK\r\n"
+	                        "Content-Type: text/plain\r\n"
+	                        "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+	AddTCPSteps(&http.steps, {{true, 0}, {false, 1}});
+	templates.push_back(std::move(http));
+
+	Template dns{"dns", UDP, 53, true};
+	std::string question = std::string("\x03www\x07" "example\x03" "com", 17) + u16(1) + u16(1);
+	dns.payloads.push_back(u16(0) + u16(0x0100) + u16(1) + u16(0) + u16(0) + u16(0) + question);
+	dns.payloads.push_back(u16(0) + u16(0x8180) + u16(1) + u16(1) + u16(0) + u16(0) + question +
+	                       u16(0xc00c) + u16(1) + u16(1) + u16(0) + u16(3600) + u16(4) +
+	                       std::string("\x5d\xb8\xd8\x22", 4));
+	dns.steps.push_back({true, 0, 0, 0, 0, false});
+	dns.steps.push_back({false, 0, 1, 0, 0, false});
+	templates.push_back(std::move(dns));
+
+	// A TLS 1.2 handshake without certificates, followed by a bit of
+	// application data in each direction.
+	Template tls{"tls", TCP, 443, false};
+	std::string sni = "www.example.com";
+	std::string sni_ext = u16(0) + u16(sni.size() + 5) + u16(sni.size() + 3) +
+	                      std::string(1, '\0') + u16(sni.size()) + sni;
+	std::string client_hello = u16(0x0303) + std::string(32, '\x11') + std::string(1, '\0') +
+	                           u16(6) + u16(0xc02f) + u16(0xc030) + u16(0x009c) +
+	                           std::string("\x01\x00", 2) + u16(sni_ext.size()) + sni_ext;
+	std::string server_hello = u16(0x0303) + std::string(32, '\x22') + std::string(1, '\0') +
+	                           u16(0xc02f) + std::string(1, '\0') + u16(0);
+	std::string ccs = tls_record(20, std::string(1, '\x01'));
+	tls.payloads.push_back(tls_record(22, tls_handshake(1, client_hello)));
+	tls.payloads.push_back(tls_record(22, tls_handshake(2, server_hello) + tls_handshake(14, "")));
+	tls.payloads.push_back(tls_record(22, tls_handshake(16, std::string(1, '\x41') + std::string(65, '\x04'))) +
+	                       ccs + tls_record(22, std::string(40, '\x5a')));
+	tls.payloads.push_back(ccs + tls_record(22, std::string(40, '\x6b')));
+	tls.payloads.push_back(tls_record(23, std::string(256, '\x7c')));
+	tls.payloads.push_back(tls_record(23, std::string(1200, '\x8d')));
+	AddTCPSteps(&tls.steps, {{true, 0}, {false, 1}, {true, 2}, {false, 3}, {true, 4}, {false, 5}});
+	templates.push_back(std::move(tls));
+
+	Template bulk{"bulk", TCP, 5001, false};
+	auto bulk_bytes = zeek::id::find_val("Synthetic::bulk_bytes")->AsCount();
+	bulk.payloads.push_back("SEND\r\n");
+	bulk.payloads.push_back(std::string(max_payload, '\x5b'));
+	std::vector<std::pair<bool, int>> segments{{true, 0}};
+
+	for ( size_t i = 0; i < std::max<uint64_t>(1, bulk_bytes / max_payload); ++i )
+		segments.push_back({false, 1});
+
+	AddTCPSteps(&bulk.steps, segments, 2);
+	templates.push_back(std::move(bulk));
+
+	// One large UDP datagram, in fragments whose payload is a multiple of
+	// eight bytes as the fragment offset requires.
+	Template fragments{"fragments", FRAGMENTED_UDP, 9999, false};
+	fragments.payloads.push_back(std::string(4000, '\x3c'));
+	size_t datagram_len = 8 + fragments.payloads[0].size();
+	size_t frag_size = (20 + max_payload) / 8 * 8;
+
+	for ( size_t off = 0; off < datagram_len; off += frag_size )
+		{
+		auto len = std::min(frag_size, datagram_len - off);
+		fragments.steps.push_back({true, 0, 0, uint16_t(off), uint16_t(len),
+		                           off + len < datagram_len});
+		}
+
+	templates.push_back(std::move(fragments));
+
+	for ( auto& t : templates )
+		t.weight = t.flows = t.packets = 0;
+	}
+
+bool SyntheticSource::ParseMix(const std::string& mix)
+	{
+	total_weight = 0;
+	size_t start = 0;
+
+	while ( start <= mix.size() )
+		{
+		auto end = mix.find(',', start);
+
+		if ( end == std::string::npos )
+			end = mix.size();
+
+		auto entry = mix.substr(start, end - start);
+		start = end + 1;
+
+		if ( entry.empty() )
+			continue;
+
+		auto eq = entry.find('=');
+		auto name = entry.substr(0, eq);
+		uint32_t weight = 1;
+
+		if ( eq != std::string::npos )
+			{
+			char* e;
+			weight = strtoul(entry.c_str() + eq + 1, &e, 10);
+
+			if ( *e || eq + 1 == entry.size() )
+				{
+				Error(fmt("invalid weight in synthetic traffic mix entry '%s'", entry.c_str()));
+				return false;
+				}
+			}
+
+		auto t = std::find_if(templates.begin(), templates.end(),
+		                      [&name](const Template& t) { return t.name == name; });
+
+		if ( t == templates.end() )
+			{
+			Error(fmt("unknown synthetic traffic template '%s'", name.c_str()));
+			return false;
+			}
+
+		t->weight = weight;
+		total_weight += weight;
+		}
+
+	if ( total_weight == 0 )
+		{
+		Error("synthetic traffic mix selects no templates");
+		return false;
+		}
+
+	return true;
+	}
+
+void SyntheticSource::Open()
+	{
+	InitTemplates();
+
+	auto mix = props.path;
+
+	if ( mix.empty() )
+		mix = zeek::id::find_val("Synthetic::mix")->AsStringVal()->ToStdString();
+
+	if ( ! ParseMix(mix) )
+		return;
+
+	auto concurrent = zeek::id::find_val("Synthetic::concurrent_flows")->AsCount();
+
+	if ( concurrent == 0 )
+		{
+		Error("Synthetic::concurrent_flows must be positive");
+		return;
+		}
+
+	max_packets = zeek::id::find_val("Synthetic::packets")->AsCount();
+	packet_interval = zeek::id::find_val("Synthetic::packet_interval")->AsInterval();
+	start_ts = zeek::id::find_val("Synthetic::start_time")->AsDouble();
+
+	rng.seed(1);
+	flows.resize(concurrent);
+
+	for ( auto& f : flows )
+		StartFlow(&f);
+
+	next_flow = 0;
+
+	props.selectable_fd = -1;
+	props.link_type = DLT_EN10MB;
+	props.netmask = NETMASK_UNKNOWN;
+
+	summary = Summary();
+	summary.ran = true;
+	summary.report = zeek::id::find_val("Synthetic::report")->AsBool();
+	summary.open = Now();
+
+	open = true;
+	Opened(props);
+	}
+
+void SyntheticSource::Close()
+	{
+	if ( ! open )
+		return;
+
+	open = false;
+
+	summary.close = Now();
+	summary.packets = stats.received;
+	summary.bytes = stats.bytes_received;
+
+	for ( const auto& t : templates )
+		if ( t.weight )
+			summary.templates.push_back({t.name, {t.flows, t.packets}});
+
+	flows.clear();
+	Closed();
+	}
+
+void SyntheticSource::StartFlow(Flow* f)
+	{
+	auto r = rng() % total_weight;
+	size_t i = 0;
+
+	while ( r >= templates[i].weight )
+		r -= templates[i++].weight;
+
+	++num_flows;
+
+	f->tmpl = &templates[i];
+	f->orig_addr = 0x0a000000 | (num_flows % 0xfffffe + 1);	// 10/8
+	f->resp_addr = 0xc0a80000 | (i << 8) | (num_flows % 254 + 1);	// 192.168/16
+	f->orig_port = 1024 + num_flows % 64000;
+	f->id = num_flows & 0xffff;
+	f->seq[0] = rng();
+	f->seq[1] = rng();
+	f->step = 0;
+
+	++f->tmpl->flows;
+	}
+
+uint32_t SyntheticSource::BuildPacket(Flow* f)
+	{
+	static const u_char orig_mac[6] = {0x02, 0, 0, 0, 0, 0x01};
+	static const u_char resp_mac[6] = {0x02, 0, 0, 0, 0, 0x02};
+
+	const Template* t = f->tmpl;
+	const Step& s = t->steps[f->step];
+
+	uint32_t src = s.from_orig ? f->orig_addr : f->resp_addr;
+	uint32_t dst = s.from_orig ? f->resp_addr : f->orig_addr;
+	uint16_t sport = s.from_orig ? f->orig_port : t->resp_port;
+	uint16_t dport = s.from_orig ? t->resp_port : f->orig_port;
+
+	const std::string* payload = s.payload >= 0 ? &t->payloads[s.payload] : nullptr;
+	size_t plen = payload ? payload->size() : 0;
+
+	memcpy(buffer, s.from_orig ? resp_mac : orig_mac, 6);
+	memcpy(buffer + 6, s.from_orig ? orig_mac : resp_mac, 6);
+	put16(buffer + 12, 0x0800);
+
+	u_char* ip = buffer + 14;
+	u_char* l4 = ip + 20;
+	size_t l4_len = 0;
+	uint8_t proto = IPPROTO_UDP;
+	uint16_t frag = 0x4000;	// don't fragment
+
+	switch ( t->proto ) {
+	case TCP:
+		{
+		int dir = s.from_orig ? 0 : 1;
+		proto = IPPROTO_TCP;
+		put16(l4, sport);
+		put16(l4 + 2, dport);
+		put32(l4 + 4, f->seq[dir]);
+		put32(l4 + 8, (s.tcp_flags & TH_ACK) ? f->seq[1 - dir] : 0);
+		l4[12] = 5 << 4;
+		l4[13] = s.tcp_flags;
+		put16(l4 + 14, 65535);
+		put16(l4 + 16, 0);
+		put16(l4 + 18, 0);
+
+		if ( plen )
+			memcpy(l4 + 20, payload->data(), plen);
+
+		l4_len = 20 + plen;
+		f->seq[dir] += plen + ((s.tcp_flags & (TH_SYN | TH_FIN)) ? 1 : 0);
+		put16(l4 + 16, l4_checksum(src, dst, proto, l4, l4_len));
+		break;
+		}
+
+	case UDP:
+		{
+		put16(l4, sport);
+		put16(l4 + 2, dport);
+		put16(l4 + 4, 8 + plen);
+		put16(l4 + 6, 0);
+		memcpy(l4 + 8, payload->data(), plen);
+
+		if ( t->patch_id )
+			put16(l4 + 8, f->id);
+
+		l4_len = 8 + plen;
+		uint16_t sum = l4_checksum(src, dst, proto, l4, l4_len);
+		put16(l4 + 6, sum ? sum : 0xffff);
+		break;
+		}
+
+	case FRAGMENTED_UDP:
+		{
+		// Build the complete datagram to checksum it, then copy out
+		// this step's part.
+		datagram.resize(8 + plen);
+		u_char* d = datagram.data();
+		put16(d, sport);
+		put16(d + 2, dport);
+		put16(d + 4, 8 + plen);
+		put16(d + 6, 0);
+		memcpy(d + 8, payload->data(), plen);
+		uint16_t sum = l4_checksum(src, dst, proto, d, datagram.size());
+		put16(d + 6, sum ? sum : 0xffff);
+
+		memcpy(l4, d + s.frag_offset, s.frag_len);
+		l4_len = s.frag_len;
+		frag = (s.more_frags ? 0x2000 : 0) | (s.frag_offset / 8);
+		break;
+		}
+	}
+
+	ip[0] = 0x45;
+	ip[1] = 0;
+	put16(ip + 2, 20 + l4_len);
+	put16(ip + 4, f->id);
+	put16(ip + 6, frag);
+	ip[8] = 64;
+	ip[9] = proto;
+	put16(ip + 10, 0);
+	put32(ip + 12, src);
+	put32(ip + 16, dst);
+	put16(ip + 10, fold(sum_words(ip, 20, 0)));
+
+	return 14 + 20 + l4_len;
+	}
+
+bool SyntheticSource::ExtractNextPacket(Packet* pkt)
+	{
+	if ( ! open )
+		return false;
+
+	if ( max_packets && stats.received >= max_packets )
+		{
+		Close();
+		return false;
+		}
+
+	for ( ; ; )
+		{
+		Flow* f = &flows[next_flow];
+		next_flow = (next_flow + 1) % flows.size();
+
+		if ( f->step >= f->tmpl->steps.size() )
+			StartFlow(f);
+
+		uint32_t len = BuildPacket(f);
+		++f->step;
+		++f->tmpl->packets;
+
+		double t = props.is_live ? current_time(true) :
+		                           start_ts + stats.received * packet_interval;
+
+		struct pcap_pkthdr hdr;
+		hdr.ts.tv_sec = static_cast<time_t>(t);
+		hdr.ts.tv_usec = static_cast<suseconds_t>((t - hdr.ts.tv_sec) * 1e6);
+		hdr.caplen = hdr.len = len;
+
+		++stats.received;
+		stats.bytes_received += len;
+
+		// Packets that the filter rejects still count against the
+		// budget, so that it always terminates.
+		if ( current_filter < 0 || ApplyBPFFilter(current_filter, &hdr, buffer) )
+			{
+			pkt->Init(props.link_type, &hdr.ts, len, len, buffer);
+			return true;
+			}
+
+		if ( max_packets && stats.received >= max_packets )
+			{
+			Close();
+			return false;
+			}
+		}
+	}
+
+void SyntheticSource::DoneWithPacket()
+	{
+	// Nothing to do, the next packet reuses the buffer.
+	}
+
+bool SyntheticSource::PrecompileFilter(int index, const std::string& filter)
+	{
+	return PktSrc::PrecompileBPFFilter(index, filter);
+	}
+
+bool SyntheticSource::SetFilter(int index)
+	{
+	if ( ! GetBPFFilter(index) )
+		{
+		Error(fmt("No precompiled filter for index %d", index));
+		return false;
+		}
+
+	current_filter = index;
+	return true;
+	}
+
+void SyntheticSource::Statistics(Stats* s)
+	{
+	s->received = stats.received;
+	s->bytes_received = stats.bytes_received;
+	s->link = stats.received;
+	s->dropped = 0;
+	}
+
+SyntheticSource::Mark SyntheticSource::Now()
+	{
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return {current_time(true), double(ts.tv_sec) + double(ts.tv_nsec) / 1e9,
+	        num_events_dispatched};
+	}
+
+void SyntheticSource::Report()
+	{
+	if ( ! summary.ran || ! summary.report )
+		return;
+
+	Mark done = Now();
+	Mark start{bro_start_time, 0, 0};
+
+	fprintf(stderr, "synthetic traffic summary\n");
+	fprintf(stderr, "  %-10s %12s %12s\n", "template", "flows", "packets");
+
+	for ( const auto& t : summary.templates )
+		fprintf(stderr, "  %-10s %12" PRIu64 " %12" PRIu64 "\n", t.first.c_str(),
+		        t.second.first, t.second.second);
+
+	fprintf(stderr, "  %-10s %10s %10s %12s %12s\n", "phase", "wall (s)", "cpu (s)",
+	        "events", "events/s");
+
+	auto phase = [](const char* name, const Mark& from, const Mark& to)
+		{
+		double wall = to.wall - from.wall;
+		uint64_t events = to.events - from.events;
+		fprintf(stderr, "  %-10s %10.3f %10.3f %12" PRIu64 " %12.0f\n", name, wall,
+		        to.cpu - from.cpu, events, wall > 0 ? events / wall : 0.0);
+		};
+
+	phase("startup", start, summary.open);
+	phase("packets", summary.open, summary.close);
+	phase("shutdown", summary.close, done);
+	phase("total", start, done);
+
+	double wall = summary.close.wall - summary.open.wall;
+	double cpu = summary.close.cpu - summary.open.cpu;
+	uint64_t events = summary.close.events - summary.open.events;
+	uint64_t packets = std::max<uint64_t>(summary.packets, 1);
+
+	fprintf(stderr, "  %" PRIu64 " packets: %.0f packets/s, %.1f Mbit/s, "
+	        "%.2f usec CPU/packet, %.2f events/packet\n",
+	        summary.packets, wall > 0 ? summary.packets / wall : 0.0,
+	        wall > 0 ? summary.bytes * 8 / wall / 1e6 : 0.0,
+	        cpu * 1e6 / packets, double(events) / packets);
+	}
+
+iosource::PktSrc* SyntheticSource::Instantiate(const std::string& path, bool is_live)
+	{
+	return new SyntheticSource(path, is_live);
+	}
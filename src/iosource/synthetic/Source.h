@@ -0,0 +1,139 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../PktSrc.h"
+
+namespace iosource {
+namespace synthetic {
+
+/**
+ * Packet source generating a mix of synthetic traffic as fast as Zeek
+ * consumes it, for measuring end-to-end throughput without a trace. The
+ * path selects the mix as comma-separated template weights, such as
+ * "http=4,dns=2,tls=1", falling back to Synthetic::mix if empty. The
+ * templates are "http", "dns", "tls", "bulk" and "fragments".
+ *
+ * The source interleaves Synthetic::concurrent_flows flows at a time,
+ * starting a new one whenever one completes, until it has generated
+ * Synthetic::packets packets. Offline, timestamps advance by
+ * Synthetic::packet_interval per packet so that runs are reproducible;
+ * live, they are the current time.
+ */
+class SyntheticSource : public iosource::PktSrc {
+public:
+	SyntheticSource(const std::string& path, bool is_live);
+	~SyntheticSource() override;
+
+	static PktSrc* Instantiate(const std::string& path, bool is_live);
+
+	/**
+	 * Prints a summary of the run to stderr, if a synthetic source ran
+	 * and Synthetic::report is set. Called once Zeek has finished
+	 * processing, so that the shutdown phase is included.
+	 */
+	static void Report();
+
+protected:
+	// PktSrc interface.
+	void Open() override;
+	void Close() override;
+	bool ExtractNextPacket(Packet* pkt) override;
+	void DoneWithPacket() override;
+	bool PrecompileFilter(int index, const std::string& filter) override;
+	bool SetFilter(int index) override;
+	void Statistics(Stats* stats) override;
+
+private:
+	enum Proto { TCP, UDP, FRAGMENTED_UDP };
+
+	// One packet of a template's flow.
+	struct Step {
+		bool from_orig;
+		uint8_t tcp_flags;		// TCP only
+		int payload;			// index into payloads, or -1
+		uint16_t frag_offset;		// FRAGMENTED_UDP only, in bytes
+		uint16_t frag_len;
+		bool more_frags;
+	};
+
+	struct Template {
+		std::string name;
+		Proto proto;
+		uint16_t resp_port;
+		bool patch_id;	// write a per-flow ID into the first two bytes
+		std::vector<std::string> payloads;
+		std::vector<Step> steps;
+		uint32_t weight;
+		uint64_t flows;
+		uint64_t packets;
+	};
+
+	struct Flow {
+		Template* tmpl;
+		uint32_t orig_addr;
+		uint32_t resp_addr;
+		uint16_t orig_port;
+		uint16_t id;
+		uint32_t seq[2];	// next sequence number, by !from_orig
+		size_t step;
+	};
+
+	// Totals at the boundaries of the phases the report covers.
+	struct Mark {
+		double wall;
+		double cpu;
+		uint64_t events;
+	};
+
+	struct Summary {
+		bool ran = false;
+		bool report = false;
+		Mark open;
+		Mark close;
+		uint64_t packets = 0;
+		uint64_t bytes = 0;
+		std::vector<std::pair<std::string, std::pair<uint64_t, uint64_t>>> templates;
+	};
+
+	// Adds the steps of a TCP flow: the handshake, the data segments with
+	// the peer acknowledging every ack_every'th as well as the last one
+	// in a row, and the teardown.
+	static void AddTCPSteps(std::vector<Step>* steps,
+	                        const std::vector<std::pair<bool, int>>& segments,
+	                        size_t ack_every = 1);
+
+	void InitTemplates();
+	bool ParseMix(const std::string& mix);
+	void StartFlow(Flow* f);
+	uint32_t BuildPacket(Flow* f);
+	static Mark Now();
+
+	Properties props;
+	Stats stats;
+
+	std::vector<Template> templates;
+	std::vector<Flow> flows;
+	size_t next_flow;
+	uint64_t num_flows;
+	uint64_t total_weight;
+	uint64_t max_packets;
+	double packet_interval;
+	double start_ts;
+	std::minstd_rand rng;
+	int current_filter;
+
+	u_char buffer[2048];
+	std::vector<u_char> datagram;	// scratch for fragmented templates
+	bool open;
+
+	static Summary summary;
+};
+
+}
+}
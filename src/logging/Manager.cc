@@ -2,6 +2,8 @@
 
 #include "Manager.h"
 
+#include <algorithm>
+#include <unordered_map>
 #include <utility>
 
 #include "Event.h"
@@ -21,7 +23,9 @@
 #include "Desc.h"
 #include "WriterFrontend.h"
 #include "WriterBackend.h"
+#include "PostProcessor.h"
 #include "logging.bif.h"
+#include "const.bif.h"
 #include "plugin/Plugin.h"
 #include "plugin/Manager.h"
 
@@ -58,6 +62,24 @@ struct Manager::Filter {
 	// sub-records.
 	vector<list<int> > indices;
 
+	// The fields that pred and path_func are declared to depend on, as
+	// paths like in *indices*. Their results get cached by these fields'
+	// values, for up to Log::max_batch_size writes.
+	bool cache_pred;
+	bool cache_path;
+	vector<list<int> > pred_deps;
+	vector<list<int> > path_deps;
+	unordered_map<string, bool> pred_cache;
+	unordered_map<string, WriterInfo*> path_cache;
+	bro_uint_t cached_writes;	// Writes since the caches were cleared.
+
+	// The type of path_func's rec parameter, if it's a record.
+	zeek::RecordTypePtr path_func_rec_type;
+
+	// The writer for the fixed path of a filter without path_func,
+	// once known.
+	WriterInfo* writer_handle;
+
 	~Filter();
 };
 
@@ -145,6 +167,14 @@ Manager::~Manager()
 void Manager::InitPostScript()
 	{
 	rotation_format_func = zeek::id::find_func("Log::rotation_format_func");
+
+	// The threads are owned by the threading manager.
+	for ( bro_uint_t i = 0; i < zeek::BifConst::Log::postprocessor_threads; ++i )
+		{
+		auto t = new PostProcessorThread(i);
+		t->Start();
+		postprocessor_threads.push_back(t);
+		}
 	}
 
 WriterBackend* Manager::CreateBackend(WriterFrontend* frontend, zeek::EnumVal* tag)
@@ -173,6 +203,31 @@ Manager::Stream* Manager::FindStream(zeek::EnumVal* id)
 	return streams[idx];
 	}
 
+Manager::writer_stats_list Manager::GetWriterStats()
+	{
+	writer_stats_list stats;
+
+	for ( auto s : streams )
+		{
+		if ( ! s )
+			continue;
+
+		for ( const auto& w : s->writers )
+			{
+			WriterFrontend* writer = w.second->writer;
+
+			if ( writer->Disabled() )
+				continue;
+
+			WriterFrontend::Stats ws;
+			writer->GetStats(&ws);
+			stats.push_back(std::make_pair(writer->Name(), ws));
+			}
+		}
+
+	return stats;
+	}
+
 Manager::WriterInfo* Manager::FindWriter(WriterFrontend* writer)
 	{
 	for ( vector<Stream *>::iterator s = streams.begin(); s != streams.end(); ++s )
@@ -215,6 +270,45 @@ bool Manager::CheckFilterWriterConflict(const WriterInfo* winfo, const Filter* f
 		return winfo->instantiating_filter != filter->name;
 	}
 
+// Builds the key that caches the result of a filter's pred or path_func,
+// from the values of the fields it depends on.
+static void filter_cache_key(zeek::RecordVal* columns, const vector<list<int> >& deps,
+                             string* key)
+	{
+	key->clear();
+
+	for ( const auto& indices : deps )
+		{
+		zeek::Val* val = columns;
+
+		for ( auto j = indices.begin(); val && j != indices.end(); ++j )
+			val = val->AsRecordVal()->GetField(*j).get();
+
+		if ( ! val )
+			{
+			key->append("-", 1);
+			continue;
+			}
+
+		ODesc d;
+		val->Describe(&d);
+
+		// The length keeps values from running into each other.
+		key->append(std::to_string(d.Len()));
+		key->append(":", 1);
+		key->append(reinterpret_cast<const char*>(d.Bytes()), d.Len());
+		}
+	}
+
+void Manager::ClearWriterHandles(Stream* stream)
+	{
+	for ( auto f : stream->filters )
+		{
+		f->path_cache.clear();
+		f->writer_handle = nullptr;
+		}
+	}
+
 void Manager::RemoveDisabledWriters(Stream* stream)
 	{
 	list<Stream::WriterPathPair> disabled;
@@ -231,6 +325,9 @@ void Manager::RemoveDisabledWriters(Stream* stream)
 
 	for ( list<Stream::WriterPathPair>::iterator j = disabled.begin(); j != disabled.end(); j++ )
 		stream->writers.erase(*j);
+
+	if ( ! disabled.empty() )
+		ClearWriterHandles(stream);
 	}
 
 bool Manager::CreateStream(zeek::EnumVal* id, zeek::RecordVal* sval)
@@ -560,6 +657,8 @@ bool Manager::AddFilter(zeek::EnumVal* id, zeek::RecordVal* fval)
 	auto scope_sep = fval->GetFieldOrDefault("scope_sep");
 	auto ext_prefix = fval->GetFieldOrDefault("ext_prefix");
 	auto ext_func = fval->GetFieldOrDefault("ext_func");
+	auto pred_fields = fval->GetField("pred_fields");
+	auto path_func_fields = fval->GetField("path_func_fields");
 
 	Filter* filter = new Filter;
 	filter->fval = fval->Ref();
@@ -577,6 +676,27 @@ bool Manager::AddFilter(zeek::EnumVal* id, zeek::RecordVal* fval)
 	filter->scope_sep = scope_sep->AsString()->CheckString();
 	filter->ext_prefix = ext_prefix->AsString()->CheckString();
 	filter->ext_func = ext_func ? ext_func->AsFunc() : nullptr;
+	filter->cache_pred = filter->pred && pred_fields;
+	filter->cache_path = filter->path_func && path_func_fields;
+	filter->cached_writes = 0;
+	filter->writer_handle = nullptr;
+
+	if ( filter->path_func )
+		{
+		const auto& rt = filter->path_func->GetType()->Params()->GetFieldType("rec");
+
+		if ( rt->Tag() == zeek::TYPE_RECORD )
+			filter->path_func_rec_type = zeek::cast_intrusive<zeek::RecordType>(rt);
+		}
+
+	if ( (filter->cache_pred &&
+	      ! ResolveFields(stream, filter, pred_fields->AsTableVal(), &filter->pred_deps)) ||
+	     (filter->cache_path &&
+	      ! ResolveFields(stream, filter, path_func_fields->AsTableVal(), &filter->path_deps)) )
+		{
+		delete filter;
+		return false;
+		}
 
 	// Build the list of fields that the filter wants included, including
 	// potentially rolling out fields.
@@ -660,6 +780,50 @@ bool Manager::AddFilter(zeek::EnumVal* id, zeek::RecordVal* fval)
 	return true;
 	}
 
+bool Manager::ResolveFields(Stream* stream, Filter* filter, zeek::TableVal* names,
+                            vector<list<int> >* deps)
+	{
+	auto lv = names->ToPureListVal();
+
+	for ( int i = 0; i < lv->Length(); ++i )
+		{
+		string name = lv->Idx(i)->AsString()->CheckString();
+		zeek::RecordType* rt = stream->columns;
+		list<int> indices;
+		string::size_type start = 0;
+
+		// Nested fields go by their names as written out, like with
+		// *include*.
+		while ( true )
+			{
+			auto end = filter->scope_sep.empty() ? string::npos :
+			                                     name.find(filter->scope_sep, start);
+			auto field = name.substr(start, end == string::npos ? end : end - start);
+			int idx = rt ? rt->FieldOffset(field.c_str()) : -1;
+
+			if ( idx < 0 )
+				{
+				reporter->Error("unknown field '%s' that filter '%s' depends on",
+				                name.c_str(), filter->name.c_str());
+				return false;
+				}
+
+			indices.push_back(idx);
+
+			if ( end == string::npos )
+				break;
+
+			const auto& ft = rt->GetFieldType(idx);
+			rt = ft->Tag() == zeek::TYPE_RECORD ? ft->AsRecordType() : nullptr;
+			start = end + filter->scope_sep.size();
+			}
+
+		deps->push_back(std::move(indices));
+		}
+
+	return true;
+	}
+
 bool Manager::RemoveFilter(zeek::EnumVal* id, zeek::StringVal* name)
 	{
 	return RemoveFilter(id, name->AsString()->CheckString());
@@ -718,177 +882,61 @@ bool Manager::Write(zeek::EnumVal* id, zeek::RecordVal* columns_arg)
 	      i != stream->filters.end(); ++i )
 		{
 		Filter* filter = *i;
-		string path = filter->path;
 
-		if ( filter->pred )
+		if ( ++filter->cached_writes > zeek::BifConst::Log::max_batch_size )
 			{
-			// See whether the predicates indicates that we want
-			// to log this record.
-			int result = 1;
-			auto v = filter->pred->Invoke(columns);
-
-			if ( v )
-				result = v->AsBool();
-
-			if ( ! result )
-				continue;
+			filter->pred_cache.clear();
+			filter->path_cache.clear();
+			filter->cached_writes = 1;
 			}
 
-		if ( filter->path_func )
-			{
-			zeek::ValPtr path_arg;
-
-			if ( filter->path_val )
-				path_arg = {zeek::NewRef{}, filter->path_val};
-			else
-				path_arg = zeek::val_mgr->EmptyString();
-
-			zeek::ValPtr rec_arg;
-			const auto& rt = filter->path_func->GetType()->Params()->GetFieldType("rec");
-
-			if ( rt->Tag() == zeek::TYPE_RECORD )
-				rec_arg = columns->CoerceTo(zeek::cast_intrusive<zeek::RecordType>(rt), true);
-			else
-				// Can be TYPE_ANY here.
-				rec_arg = columns;
-
-			auto v = filter->path_func->Invoke(zeek::IntrusivePtr{zeek::NewRef{}, id},
-			                                   std::move(path_arg),
-			                                   std::move(rec_arg));
-
-			if ( ! v )
-				return false;
-
-			if ( v->GetType()->Tag() != zeek::TYPE_STRING )
-				{
-				reporter->Error("path_func did not return string");
-				return false;
-				}
-
-			if ( ! filter->path_val )
-				{
-				filter->path = v->AsString()->CheckString();
-				filter->path_val = v->Ref();
-				}
-
-			path = v->AsString()->CheckString();
-
-#ifdef DEBUG
-			DBG_LOG(DBG_LOGGING, "Path function for filter '%s' on stream '%s' return '%s'",
-				filter->name.c_str(), stream->name.c_str(), path.c_str());
-#endif
-			}
-
-		Stream::WriterPathPair wpp(filter->writer->AsEnum(), path);
+		if ( filter->pred && ! CheckPred(filter, columns) )
+			continue;
 
-		// See if we already have a writer for this path.
-		Stream::WriterMap::iterator w = stream->writers.find(wpp);
+		// A known writer for this write's path, if any.
+		WriterInfo* winfo = filter->path_func ? nullptr : filter->writer_handle;
+		string path_key;
 
-		if ( w != stream->writers.end() &&
-		     CheckFilterWriterConflict(w->second, filter) )
+		if ( filter->cache_path )
 			{
-			// Auto-correct path due to conflict over the writer/path pairs.
-			string instantiator = w->second->instantiating_filter;
-			string new_path;
-			unsigned int i = 2;
-
-			do {
-				char num[32];
-				snprintf(num, sizeof(num), "-%u", i++);
-				new_path = path + num;
-				wpp.second = new_path;
-				w = stream->writers.find(wpp);
-			} while ( w != stream->writers.end() &&
-			          CheckFilterWriterConflict(w->second, filter) );
-
-			Unref(filter->path_val);
-			filter->path_val = new zeek::StringVal(new_path.c_str());
-
-			reporter->Warning("Write using filter '%s' on path '%s' changed to"
-			  " use new path '%s' to avoid conflict with filter '%s'",
-			  filter->name.c_str(), path.c_str(), new_path.c_str(),
-			  instantiator.c_str());
-
-			path = filter->path = filter->path_val->AsString()->CheckString();
+			filter_cache_key(columns.get(), filter->path_deps, &path_key);
+			auto c = filter->path_cache.find(path_key);
+
+			if ( c != filter->path_cache.end() )
+				winfo = c->second;
 			}
 
 		WriterBackend::WriterInfo* info = nullptr;
 		WriterFrontend* writer = nullptr;
 
-		if ( w != stream->writers.end() )
+		if ( winfo )
 			{
-			// We know this writer already.
-			writer = w->second->writer;
-			info = w->second->info;
-
-			if ( ! w->second->hook_initialized )
-				{
-				auto wi = w->second;
-				wi->hook_initialized = true;
-				PLUGIN_HOOK_VOID(HOOK_LOG_INIT,
-				                 HookLogInit(filter->writer->GetType()->AsEnumType()->Lookup(filter->writer->InternalInt()),
-				                             wi->instantiating_filter, filter->local,
-				                             filter->remote, *wi->info,
-				                             filter->num_fields,
-				                             filter->fields));
-				}
+			writer = winfo->writer;
+			info = winfo->info;
 			}
 
 		else
 			{
-			// No, need to create one.
-
-			// Copy the fields for WriterFrontend::Init() as it
-			// will take ownership.
-			threading::Field** arg_fields = new threading::Field*[filter->num_fields];
-
-			for ( int j = 0; j < filter->num_fields; ++j )
-				{
-				// Rename fields if a field name map is set.
-				if ( filter->field_name_map )
-					{
-					const char* name = filter->fields[j]->name;
-					auto fn = zeek::make_intrusive<zeek::StringVal>(name);
-
-					if ( const auto& val = filter->field_name_map->Find(fn) )
-						{
-						delete [] filter->fields[j]->name;
-						filter->fields[j]->name = copy_string(val->AsStringVal()->CheckString());
-						}
-					}
-				arg_fields[j] = new threading::Field(*filter->fields[j]);
-				}
-
-			info = new WriterBackend::WriterInfo;
-			info->path = copy_string(path.c_str());
-			info->network_time = network_time;
+			winfo = WriterForPath(stream, filter, columns);
 
-			HashKey* k;
-			zeek::IterCookie* c = filter->config->AsTable()->InitForIteration();
-
-			zeek::TableEntryVal* v;
-			while ( (v = filter->config->AsTable()->NextEntry(k, c)) )
-				{
-				auto index = filter->config->RecreateIndex(*k);
-				string key = index->Idx(0)->AsString()->CheckString();
-				string value = v->GetVal()->AsString()->CheckString();
-				info->config.insert(std::make_pair(copy_string(key.c_str()), copy_string(value.c_str())));
-				delete k;
-				}
-
-			// CreateWriter() will set the other fields in info.
+			if ( ! winfo )
+				return false;
 
-			writer = CreateWriter(stream->id, filter->writer,
-					      info, filter->num_fields, arg_fields, filter->local,
-					      filter->remote, false, filter->name);
+			writer = winfo->writer;
+			info = winfo->info;
 
-			if ( ! writer )
-				return false;
+			if ( ! filter->path_func )
+				filter->writer_handle = winfo;
+			else if ( filter->cache_path )
+				filter->path_cache.emplace(std::move(path_key), winfo);
 			}
 
 		// Alright, can do the write now.
 
-		threading::Value** vals = RecordToFilterVals(stream, filter, columns.get());
+		// The values go straight into the writer's current batch.
+		assert(writer);
+		threading::Value** vals = RecordToFilterVals(writer->ArenaForWrite(), stream,
+		                                             filter, columns.get());
 
 		if ( ! PLUGIN_HOOK_WITH_RESULT(HOOK_LOG_WRITE,
 		                               HookLogWrite(filter->writer->GetType()->AsEnumType()->Lookup(filter->writer->InternalInt()),
@@ -897,7 +945,7 @@ bool Manager::Write(zeek::EnumVal* id, zeek::RecordVal* columns_arg)
 		                                            filter->fields, vals),
 		                               true) )
 			{
-			DeleteVals(filter->num_fields, vals);
+			writer->CancelWrite();
 
 #ifdef DEBUG
 			DBG_LOG(DBG_LOGGING, "Hook prevented writing to filter '%s' on stream '%s'",
@@ -906,8 +954,6 @@ bool Manager::Write(zeek::EnumVal* id, zeek::RecordVal* columns_arg)
 			return true;
 			}
 
-		// Write takes ownership of vals.
-		assert(writer);
 		writer->Write(filter->num_fields, vals);
 
 #ifdef DEBUG
@@ -919,15 +965,199 @@ bool Manager::Write(zeek::EnumVal* id, zeek::RecordVal* columns_arg)
 	return true;
 	}
 
-threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
+Manager::WriterInfo* Manager::WriterForPath(Stream* stream, Filter* filter,
+                                            const zeek::RecordValPtr& columns)
+	{
+	string path = filter->path;
+
+	if ( filter->path_func )
+		{
+		zeek::ValPtr path_arg;
+
+		if ( filter->path_val )
+			path_arg = {zeek::NewRef{}, filter->path_val};
+		else
+			path_arg = zeek::val_mgr->EmptyString();
+
+		zeek::ValPtr rec_arg;
+
+		if ( filter->path_func_rec_type )
+			rec_arg = columns->CoerceTo(filter->path_func_rec_type, true);
+		else
+			// Can be TYPE_ANY here.
+			rec_arg = columns;
+
+		auto v = filter->path_func->Invoke(zeek::IntrusivePtr{zeek::NewRef{}, stream->id},
+		                                   std::move(path_arg),
+		                                   std::move(rec_arg));
+
+		if ( ! v )
+			return nullptr;
+
+		if ( v->GetType()->Tag() != zeek::TYPE_STRING )
+			{
+			reporter->Error("path_func did not return string");
+			return nullptr;
+			}
+
+		if ( ! filter->path_val )
+			{
+			filter->path = v->AsString()->CheckString();
+			filter->path_val = v->Ref();
+
+			// Cached results came from calls with the old path.
+			filter->path_cache.clear();
+			}
+
+		path = v->AsString()->CheckString();
+
+#ifdef DEBUG
+		DBG_LOG(DBG_LOGGING, "Path function for filter '%s' on stream '%s' return '%s'",
+			filter->name.c_str(), stream->name.c_str(), path.c_str());
+#endif
+		}
+
+	Stream::WriterPathPair wpp(filter->writer->AsEnum(), path);
+
+	// See if we already have a writer for this path.
+	Stream::WriterMap::iterator w = stream->writers.find(wpp);
+
+	if ( w != stream->writers.end() &&
+	     CheckFilterWriterConflict(w->second, filter) )
+		{
+		// Auto-correct path due to conflict over the writer/path pairs.
+		string instantiator = w->second->instantiating_filter;
+		string new_path;
+		unsigned int i = 2;
+
+		do {
+			char num[32];
+			snprintf(num, sizeof(num), "-%u", i++);
+			new_path = path + num;
+			wpp.second = new_path;
+			w = stream->writers.find(wpp);
+		} while ( w != stream->writers.end() &&
+		          CheckFilterWriterConflict(w->second, filter) );
+
+		Unref(filter->path_val);
+		filter->path_val = new zeek::StringVal(new_path.c_str());
+		filter->path_cache.clear();
+
+		reporter->Warning("Write using filter '%s' on path '%s' changed to"
+		  " use new path '%s' to avoid conflict with filter '%s'",
+		  filter->name.c_str(), path.c_str(), new_path.c_str(),
+		  instantiator.c_str());
+
+		path = filter->path = filter->path_val->AsString()->CheckString();
+		}
+
+	if ( w != stream->writers.end() )
+		{
+		// We know this writer already.
+		if ( ! w->second->hook_initialized )
+			{
+			auto wi = w->second;
+			wi->hook_initialized = true;
+			PLUGIN_HOOK_VOID(HOOK_LOG_INIT,
+			                 HookLogInit(filter->writer->GetType()->AsEnumType()->Lookup(filter->writer->InternalInt()),
+			                             wi->instantiating_filter, filter->local,
+			                             filter->remote, *wi->info,
+			                             filter->num_fields,
+			                             filter->fields));
+			}
+
+		return w->second;
+		}
+
+	// No, need to create one.
+
+	// Copy the fields for WriterFrontend::Init() as it
+	// will take ownership.
+	threading::Field** arg_fields = new threading::Field*[filter->num_fields];
+
+	for ( int j = 0; j < filter->num_fields; ++j )
+		{
+		// Rename fields if a field name map is set.
+		if ( filter->field_name_map )
+			{
+			const char* name = filter->fields[j]->name;
+			auto fn = zeek::make_intrusive<zeek::StringVal>(name);
+
+			if ( const auto& val = filter->field_name_map->Find(fn) )
+				{
+				delete [] filter->fields[j]->name;
+				filter->fields[j]->name = copy_string(val->AsStringVal()->CheckString());
+				}
+			}
+		arg_fields[j] = new threading::Field(*filter->fields[j]);
+		}
+
+	auto info = new WriterBackend::WriterInfo;
+	info->path = copy_string(path.c_str());
+	info->network_time = network_time;
+
+	HashKey* k;
+	zeek::IterCookie* c = filter->config->AsTable()->InitForIteration();
+
+	zeek::TableEntryVal* v;
+	while ( (v = filter->config->AsTable()->NextEntry(k, c)) )
+		{
+		auto index = filter->config->RecreateIndex(*k);
+		string key = index->Idx(0)->AsString()->CheckString();
+		string value = v->GetVal()->AsString()->CheckString();
+		info->config.insert(std::make_pair(copy_string(key.c_str()), copy_string(value.c_str())));
+		delete k;
+		}
+
+	// CreateWriter() will set the other fields in info.
+
+	auto writer = CreateWriter(stream->id, filter->writer,
+	                           info, filter->num_fields, arg_fields, filter->local,
+	                           filter->remote, false, filter->name);
+
+	if ( ! writer )
+		return nullptr;
+
+	w = stream->writers.find(wpp);
+	return w != stream->writers.end() ? w->second : nullptr;
+	}
+
+bool Manager::CheckPred(Filter* filter, const zeek::RecordValPtr& columns)
+	{
+	string key;
+
+	if ( filter->cache_pred )
+		{
+		filter_cache_key(columns.get(), filter->pred_deps, &key);
+		auto c = filter->pred_cache.find(key);
+
+		if ( c != filter->pred_cache.end() )
+			return c->second;
+		}
+
+	// See whether the predicates indicates that we want
+	// to log this record.
+	bool result = true;
+	auto v = filter->pred->Invoke(columns);
+
+	if ( v )
+		result = v->AsBool();
+
+	if ( filter->cache_pred )
+		filter->pred_cache.emplace(std::move(key), result);
+
+	return result;
+	}
+
+threading::Value* Manager::ValToLogVal(threading::ValueArena* arena, zeek::Val* val, zeek::Type* ty)
 	{
 	if ( ! ty )
 		ty = val->GetType().get();
 
 	if ( ! val )
-		return new threading::Value(ty->Tag(), false);
+		return arena->NewValue(ty->Tag(), false);
 
-	threading::Value* lval = new threading::Value(ty->Tag());
+	threading::Value* lval = arena->NewValue(ty->Tag());
 
 	switch ( lval->type ) {
 	case zeek::TYPE_BOOL:
@@ -942,14 +1172,14 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 
 		if ( s )
 			{
-			lval->val.string_val.data = copy_string(s);
+			lval->val.string_val.data = arena->NewString(s, strlen(s));
 			lval->val.string_val.length = strlen(s);
 			}
 
 		else
 			{
 			val->GetType()->Error("enum type does not contain value", val);
-			lval->val.string_val.data = copy_string("");
+			lval->val.string_val.data = arena->NewString("", 0);
 			lval->val.string_val.length = 0;
 			}
 		break;
@@ -982,10 +1212,7 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 	case zeek::TYPE_STRING:
 		{
 		const zeek::String* s = val->AsString();
-		char* buf = new char[s->Len()];
-		memcpy(buf, s->Bytes(), s->Len());
-
-		lval->val.string_val.data = buf;
+		lval->val.string_val.data = arena->NewString(reinterpret_cast<const char*>(s->Bytes()), s->Len());
 		lval->val.string_val.length = s->Len();
 		break;
 		}
@@ -994,7 +1221,7 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 		{
 		const BroFile* f = val->AsFile();
 		string s = f->Name();
-		lval->val.string_val.data = copy_string(s.c_str());
+		lval->val.string_val.data = arena->NewString(s.data(), s.size());
 		lval->val.string_val.length = s.size();
 		break;
 		}
@@ -1005,7 +1232,7 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 		const zeek::Func* f = val->AsFunc();
 		f->Describe(&d);
 		const char* s = d.Description();
-		lval->val.string_val.data = copy_string(s);
+		lval->val.string_val.data = arena->NewString(s, strlen(s));
 		lval->val.string_val.length = strlen(s);
 		break;
 		}
@@ -1019,10 +1246,10 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 			set = zeek::make_intrusive<zeek::ListVal>(zeek::TYPE_INT);
 
 		lval->val.set_val.size = set->Length();
-		lval->val.set_val.vals = new threading::Value* [lval->val.set_val.size];
+		lval->val.set_val.vals = arena->NewValueArray(lval->val.set_val.size);
 
 		for ( int i = 0; i < lval->val.set_val.size; i++ )
-			lval->val.set_val.vals[i] = ValToLogVal(set->Idx(i).get());
+			lval->val.set_val.vals[i] = ValToLogVal(arena, set->Idx(i).get());
 
 		break;
 		}
@@ -1031,13 +1258,12 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 		{
 		zeek::VectorVal* vec = val->AsVectorVal();
 		lval->val.vector_val.size = vec->Size();
-		lval->val.vector_val.vals =
-			new threading::Value* [lval->val.vector_val.size];
+		lval->val.vector_val.vals = arena->NewValueArray(lval->val.vector_val.size);
 
 		for ( int i = 0; i < lval->val.vector_val.size; i++ )
 			{
 			lval->val.vector_val.vals[i] =
-				ValToLogVal(vec->At(i).get(),
+				ValToLogVal(arena, vec->At(i).get(),
 					    vec->GetType()->Yield().get());
 			}
 
@@ -1051,7 +1277,8 @@ threading::Value* Manager::ValToLogVal(zeek::Val* val, zeek::Type* ty)
 	return lval;
 	}
 
-threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
+threading::Value** Manager::RecordToFilterVals(threading::ValueArena* arena,
+                                               Stream* stream, Filter* filter,
                                                zeek::RecordVal* columns)
 	{
 	zeek::RecordValPtr ext_rec;
@@ -1064,7 +1291,7 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			ext_rec = {zeek::AdoptRef{}, res.release()->AsRecordVal()};
 		}
 
-	threading::Value** vals = new threading::Value*[filter->num_fields];
+	threading::Value** vals = arena->NewValueArray(filter->num_fields);
 
 	for ( int i = 0; i < filter->num_fields; ++i )
 		{
@@ -1074,7 +1301,7 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			if ( ! ext_rec )
 				{
 				// executing function did not return record. Send empty for all vals.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				vals[i] = arena->NewValue(filter->fields[i]->type, false);
 				continue;
 				}
 
@@ -1094,13 +1321,13 @@ threading::Value** Manager::RecordToFilterVals(Stream* stream, Filter* filter,
 			if ( ! val )
 				{
 				// Value, or any of its parents, is not set.
-				vals[i] = new threading::Value(filter->fields[i]->type, false);
+				vals[i] = arena->NewValue(filter->fields[i]->type, false);
 				break;
 				}
 			}
 
 		if ( val )
-			vals[i] = ValToLogVal(val);
+			vals[i] = ValToLogVal(arena, val);
 		}
 
 	return vals;
@@ -1445,6 +1672,19 @@ void RotationTimer::Dispatch(double t, bool is_expire)
 		}
 	}
 
+// Returns a fraction in [0, 1) that's fixed for a path, across runs and
+// platforms alike.
+static double rotation_offset(const char* path)
+	{
+	// FNV-1a.
+	uint32_t h = 2166136261u;
+
+	for ( const char* p = path; *p; ++p )
+		h = (h ^ static_cast<unsigned char>(*p)) * 16777619u;
+
+	return (h % 1000) / 1000.0;
+	}
+
 void Manager::InstallRotationTimer(WriterInfo* winfo)
 	{
 	if ( terminating )
@@ -1477,6 +1717,22 @@ void Manager::InstallRotationTimer(WriterInfo* winfo)
 			double delta_t =
 				calc_next_rotate(network_time, rotation_interval, base);
 
+			// Spread the writers' rotations over a window after the
+			// rotation time, each at a fixed offset derived from its
+			// path, so that they don't all happen at once.
+			double spread = std::min(zeek::BifConst::Log::rotation_spread,
+			                         rotation_interval);
+
+			if ( spread > 0 )
+				{
+				delta_t += spread * rotation_offset(winfo->writer->Info().path);
+
+				// Still before the offset from the last rotation
+				// time.
+				if ( delta_t > rotation_interval )
+					delta_t -= rotation_interval;
+				}
+
 			winfo->rotation_timer =
 				new RotationTimer(network_time + delta_t, winfo, true);
 			}
@@ -1488,6 +1744,32 @@ void Manager::InstallRotationTimer(WriterInfo* winfo)
 		}
 	}
 
+bool Manager::RunPostProcessorCmd(zeek::RecordValPtr info, std::string cmd)
+	{
+	// Commands of the final rotations go to the background as usual
+	// rather than holding up the shutdown.
+	if ( postprocessor_threads.empty() || terminating )
+		return false;
+
+	// The commands queue up with the thread that has the fewest.
+	auto t = *std::min_element(postprocessor_threads.begin(), postprocessor_threads.end(),
+	                           [](const PostProcessorThread* a, const PostProcessorThread* b)
+	                           { return a->Pending() < b->Pending(); });
+
+	t->Run(cmd, info.release());
+	return true;
+	}
+
+void Manager::PostProcessorDone(std::string cmd, zeek::RecordValPtr info, int status)
+	{
+	DBG_LOG(DBG_LOGGING, "Postprocessor command '%s' exited with %d", cmd.c_str(), status);
+
+	if ( Log::rotation_postprocessed )
+		mgr.Enqueue(Log::rotation_postprocessed, std::move(info),
+		            zeek::make_intrusive<zeek::StringVal>(cmd),
+		            zeek::val_mgr->Int(status));
+	}
+
 static std::string format_rotation_time_fallback(time_t t)
 	{
 	struct tm tm;
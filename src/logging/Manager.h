@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <list>
 #include <string_view>
 
 #include "../Val.h"
@@ -13,8 +14,10 @@
 
 #include "Component.h"
 #include "WriterBackend.h"
+#include "WriterFrontend.h"
 
 namespace broker { struct endpoint_info; }
+namespace threading { class ValueArena; }
 class SerializationFormat;
 class RotationTimer;
 
@@ -22,6 +25,8 @@ namespace logging {
 
 class WriterFrontend;
 class RotationFinishedMessage;
+class PostProcessorThread;
+class CommandDoneMessage;
 
 /**
  * Singleton class for managing log streams.
@@ -222,6 +227,31 @@ public:
 	 */
 	void Terminate();
 
+	/**
+	 * Runs a rotation postprocessor's shell command in one of the
+	 * postprocessor threads, raising Log::rotation_postprocessed once
+	 * it has exited.
+	 *
+	 * @param info  The Log::RotationInfo of the rotation.
+	 * @param cmd  The command.
+	 *
+	 * @return false if there are no postprocessor threads (see
+	 * Log::postprocessor_threads) or Zeek is terminating. The caller
+	 * should then run the command itself.
+	 *
+	 * This methods corresponds directly to the internal BiF defined in
+	 * logging.bif, which just forwards here.
+	 */
+	bool RunPostProcessorCmd(zeek::RecordValPtr info, std::string cmd);
+
+	typedef std::list<std::pair<std::string, WriterFrontend::Stats> > writer_stats_list;
+
+	/**
+	 * Returns batching statistics of all active writers, along with
+	 * their names.
+	 */
+	writer_stats_list GetWriterStats();
+
 	/**
 	 * Enable remote logs for a given stream.
 	 * @param stream_id the stream to enable remote logs for.
@@ -252,6 +282,7 @@ protected:
 	friend class RotationFinishedMessage;
 	friend class RotationFailedMessage;
 	friend class ::RotationTimer;
+	friend class CommandDoneMessage;
 
 	// Instantiates a new WriterBackend of the given type (note that
 	// doing so creates a new thread!).
@@ -269,6 +300,9 @@ protected:
 	bool FinishedRotation(WriterFrontend* writer, const char* new_name, const char* old_name,
 	                      double open, double close, bool success, bool terminating);
 
+	// Signals that a postprocessor command has exited.
+	void PostProcessorDone(std::string cmd, zeek::RecordValPtr info, int status);
+
 	// Deletes the values as passed into Write().
 	void DeleteVals(int num_fields, threading::Value** vals);
 
@@ -281,10 +315,12 @@ private:
 	                    zeek::TableVal* include, zeek::TableVal* exclude,
 	                    const std::string& path, const std::list<int>& indices);
 
-	threading::Value** RecordToFilterVals(Stream* stream, Filter* filter,
+	threading::Value** RecordToFilterVals(threading::ValueArena* arena,
+	                                      Stream* stream, Filter* filter,
 	                                      zeek::RecordVal* columns);
 
-	threading::Value* ValToLogVal(zeek::Val* val, zeek::Type* ty = nullptr);
+	threading::Value* ValToLogVal(threading::ValueArena* arena, zeek::Val* val,
+	                              zeek::Type* ty = nullptr);
 	Stream* FindStream(zeek::EnumVal* id);
 	void RemoveDisabledWriters(Stream* stream);
 	void InstallRotationTimer(WriterInfo* winfo);
@@ -292,10 +328,19 @@ private:
 	WriterInfo* FindWriter(WriterFrontend* writer);
 	bool CompareFields(const Filter* filter, const WriterFrontend* writer);
 	bool CheckFilterWriterConflict(const WriterInfo* winfo, const Filter* filter);
+	bool ResolveFields(Stream* stream, Filter* filter, zeek::TableVal* names,
+	                   std::vector<std::list<int> >* deps);
+	bool CheckPred(Filter* filter, const zeek::RecordValPtr& columns);
+	WriterInfo* WriterForPath(Stream* stream, Filter* filter,
+	                          const zeek::RecordValPtr& columns);
+	void ClearWriterHandles(Stream* stream);
 
 	std::vector<Stream *> streams;	// Indexed by stream enum.
 	int rotations_pending;	// Number of rotations not yet finished.
 	zeek::FuncPtr rotation_format_func;
+
+	// Owned by the threading manager.
+	std::vector<PostProcessorThread*> postprocessor_threads;
 };
 
 }
@@ -0,0 +1,126 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "PostProcessor.h"
+
+#include <errno.h>
+#include <spawn.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "util.h"
+#include "logging/Manager.h"
+#include "threading/Manager.h"
+
+extern char** environ;
+
+namespace logging {
+
+// Runs a command through the shell, with its stdout going to stderr like
+// for system(). posix_spawn() doesn't need to copy the page tables of a
+// large process as fork() does, which is what makes starting many
+// commands at once costly. Returns the command's exit status, or -1 if it
+// couldn't be run or didn't exit normally.
+static int run_command(const std::string& cmd, std::string* error)
+	{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, STDERR_FILENO, STDOUT_FILENO);
+
+	const char* argv[] = { "sh", "-c", cmd.c_str(), nullptr };
+	pid_t pid;
+	int rc = posix_spawn(&pid, "/bin/sh", &actions, nullptr,
+	                     const_cast<char* const*>(argv), environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+
+	if ( rc != 0 )
+		{
+		*error = strerror(rc);
+		return -1;
+		}
+
+	int status;
+
+	while ( waitpid(pid, &status, 0) < 0 )
+		{
+		if ( errno != EINTR )
+			{
+			*error = strerror(errno);
+			return -1;
+			}
+		}
+
+	if ( ! WIFEXITED(status) )
+		return -1;
+
+	return WEXITSTATUS(status);
+	}
+
+// Message sent from the main thread to a postprocessor thread.
+
+class RunCommandMessage final : public threading::InputMessage<PostProcessorThread>
+{
+public:
+	RunCommandMessage(PostProcessorThread* thread, std::string cmd, zeek::RecordVal* info)
+		: threading::InputMessage<PostProcessorThread>("RunCommand", thread),
+		cmd(std::move(cmd)), info(info)
+		{}
+
+	bool Process() override;
+
+private:
+	std::string cmd;
+	zeek::RecordVal* info;
+};
+
+// Message sent from a postprocessor thread to the main thread.
+
+class CommandDoneMessage final : public threading::OutputMessage<PostProcessorThread>
+{
+public:
+	CommandDoneMessage(PostProcessorThread* thread, std::string cmd, zeek::RecordVal* info,
+	                   int status)
+		: threading::OutputMessage<PostProcessorThread>("CommandDone", thread),
+		cmd(std::move(cmd)), info(info), status(status)
+		{}
+
+	bool Process() override
+		{
+		--Object()->pending;
+		log_mgr->PostProcessorDone(std::move(cmd), {zeek::AdoptRef{}, info}, status);
+		return true;
+		}
+
+private:
+	std::string cmd;
+	zeek::RecordVal* info;
+	int status;
+};
+
+bool RunCommandMessage::Process()
+	{
+	std::string error;
+	int status = run_command(cmd, &error);
+
+	if ( ! error.empty() )
+		Object()->Warning(Object()->Fmt("cannot run '%s': %s", cmd.c_str(), error.c_str()));
+
+	Object()->SendOut(new CommandDoneMessage(Object(), std::move(cmd), info, status));
+	return true;
+	}
+
+PostProcessorThread::PostProcessorThread(int num)
+	{
+	SetName(fmt("log-postprocessor/%d", num));
+
+	SetCPUs(thread_mgr->ThreadCPUs("Threading::log_writer_cpus"));
+	}
+
+void PostProcessorThread::Run(const std::string& cmd, zeek::RecordVal* info)
+	{
+	++pending;
+	SendIn(new RunCommandMessage(this, cmd, info));
+	}
+
+} // namespace logging
@@ -0,0 +1,54 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <string>
+
+#include "threading/MsgThread.h"
+
+ZEEK_FORWARD_DECLARE_NAMESPACED(RecordVal, zeek);
+
+namespace logging {
+
+/**
+ * A thread running the shell commands of log rotation postprocessors, so
+ * that starting them and waiting for them doesn't hold up the main
+ * thread. The logging manager keeps \c Log::postprocessor_threads of
+ * them, each running one command at a time.
+ */
+class PostProcessorThread final : public threading::MsgThread {
+public:
+	/**
+	 * Constructor.
+	 * @param num the thread's number, used for its name.
+	 */
+	explicit PostProcessorThread(int num);
+
+	/**
+	 * Queues a command. Once it has exited, the thread sends its exit
+	 * status back to the logging manager, which raises
+	 * \c Log::rotation_postprocessed.
+	 * @param cmd the command, passed to \c /bin/sh.
+	 * @param info the rotation's Log::RotationInfo. The thread takes
+	 * over the reference, without touching it.
+	 */
+	void Run(const std::string& cmd, zeek::RecordVal* info);
+
+	/**
+	 * @return the number of commands queued or running. Main thread only.
+	 */
+	int Pending() const	{ return pending; }
+
+protected:
+	friend class CommandDoneMessage;
+
+	bool OnHeartbeat(double network_time, double current_time) override
+		{ return true; }
+	bool OnFinish(double network_time) override
+		{ return true; }
+
+private:
+	int pending = 0;
+};
+
+} // namespace logging
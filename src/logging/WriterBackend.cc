@@ -3,6 +3,7 @@
 #include <broker/data.hh>
 
 #include "util.h"
+#include "threading/Manager.h"
 #include "threading/SerialTypes.h"
 
 #include "Manager.h"
@@ -130,8 +131,12 @@ WriterBackend::WriterBackend(WriterFrontend* arg_frontend) : MsgThread()
 	frontend = arg_frontend;
 	info = new WriterInfo(frontend->Info());
 	rotation_counter = 0;
+	write_delay = max_write_delay = 0;
+	undelivered = undelivered_bytes = dropped = 0;
 
 	SetName(frontend->Name());
+
+	SetCPUs(thread_mgr->ThreadCPUs("Threading::log_writer_cpus"));
 	}
 
 WriterBackend::~WriterBackend()
@@ -147,8 +152,16 @@ WriterBackend::~WriterBackend()
 	delete info;
 	}
 
-void WriterBackend::DeleteVals(int num_writes, Value*** vals)
+void WriterBackend::DeleteVals(int num_writes, Value*** vals, threading::ValueArena* arena)
 	{
+	if ( arena )
+		{
+		// The arena holds everything but the buffer itself.
+		delete arena;
+		delete [] vals;
+		return;
+		}
+
 	for ( int j = 0; j < num_writes; ++j )
 		{
 		// Note this code is duplicated in Manager::DeleteVals().
@@ -199,7 +212,8 @@ bool WriterBackend::Init(int arg_num_fields, const Field* const* arg_fields)
 	return true;
 	}
 
-bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
+bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals,
+                          threading::ValueArena* arena)
 	{
 	// Double-check that the arguments match. If we get this from remote,
 	// something might be mixed up.
@@ -212,7 +226,7 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 		Debug(DBG_LOGGING, msg);
 #endif
 
-		DeleteVals(num_writes, vals);
+		DeleteVals(num_writes, vals, arena);
 		DisableFrontend();
 		return false;
 		}
@@ -230,7 +244,7 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 				Debug(DBG_LOGGING, msg);
 #endif
 				DisableFrontend();
-				DeleteVals(num_writes, vals);
+				DeleteVals(num_writes, vals, arena);
 				return false;
 				}
 			}
@@ -239,17 +253,9 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	bool success = true;
 
 	if ( ! Failed() )
-		{
-		for ( int j = 0; j < num_writes; j++ )
-			{
-			success = DoWrite(num_fields, fields, vals[j]);
+		success = DoWriteBatch(num_fields, fields, num_writes, vals);
 
-			if ( ! success )
-				break;
-			}
-		}
-
-	DeleteVals(num_writes, vals);
+	DeleteVals(num_writes, vals, arena);
 
 	if ( ! success )
 		DisableFrontend();
@@ -257,6 +263,18 @@ bool WriterBackend::Write(int arg_num_fields, int num_writes, Value*** vals)
 	return success;
 	}
 
+bool WriterBackend::DoWriteBatch(int num_fields, const threading::Field* const* fields,
+                                 int num_writes, threading::Value*** vals)
+	{
+	for ( int j = 0; j < num_writes; j++ )
+		{
+		if ( ! DoWrite(num_fields, fields, vals[j]) )
+			return false;
+		}
+
+	return true;
+	}
+
 bool WriterBackend::SetBuf(bool enabled)
 	{
 	if ( enabled == buffering )
@@ -323,6 +341,27 @@ bool WriterBackend::OnFinish(double network_time)
 	return DoFinish(network_time);
 	}
 
+void WriterBackend::NoteWriteDelay(double delay)
+	{
+	double avg = write_delay.load(std::memory_order_relaxed);
+
+	// The first batch sets the average, later ones move it a bit.
+	avg = avg == 0 ? delay : 0.9 * avg + 0.1 * delay;
+	write_delay.store(avg, std::memory_order_relaxed);
+
+	if ( delay > max_write_delay.load(std::memory_order_relaxed) )
+		max_write_delay.store(delay, std::memory_order_relaxed);
+	}
+
+void WriterBackend::NoteDeliveryState(uint64_t arg_undelivered,
+                                      uint64_t arg_undelivered_bytes,
+                                      uint64_t arg_dropped)
+	{
+	undelivered.store(arg_undelivered, std::memory_order_relaxed);
+	undelivered_bytes.store(arg_undelivered_bytes, std::memory_order_relaxed);
+	dropped.store(arg_dropped, std::memory_order_relaxed);
+	}
+
 bool WriterBackend::OnHeartbeat(double network_time, double current_time)
 	{
 	if ( Failed() )
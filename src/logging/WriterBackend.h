@@ -4,11 +4,14 @@
 
 #pragma once
 
+#include <atomic>
+
 #include "threading/MsgThread.h"
 
 #include "Component.h"
 
 namespace broker { class data; }
+namespace threading { class ValueArena; }
 
 namespace logging  {
 
@@ -153,12 +156,68 @@ public:
 	 * types musst match with the field passed to Init(). The method
 	 * takes ownership of \a vals..
 	 *
+	 * @param arena If given, the arena all of the values live in, which
+	 * the method takes ownership of as well.
+	 *
 	 * Returns false if an error occured, in which case the writer must
 	 * not be used any further.
 	 *
 	 * @return False if an error occured.
 	 */
-	bool Write(int num_fields, int num_writes, threading::Value*** vals);
+	bool Write(int num_fields, int num_writes, threading::Value*** vals,
+	           threading::ValueArena* arena = nullptr);
+
+	/**
+	 * Records how long a batch of writes took from leaving the frontend
+	 * until Write() returned for it.
+	 *
+	 * This method must only be called from the writer thread.
+	 *
+	 * @param delay The time in seconds.
+	 */
+	void NoteWriteDelay(double delay);
+
+	/**
+	 * Returns a moving average of the delays passed to NoteWriteDelay(),
+	 * in seconds.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	double WriteDelay() const	{ return write_delay.load(std::memory_order_relaxed); }
+
+	/**
+	 * Returns the longest delay passed to NoteWriteDelay(), in seconds.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	double MaxWriteDelay() const	{ return max_write_delay.load(std::memory_order_relaxed); }
+
+	/**
+	 * Records how far a writer lags behind that hands its entries on for
+	 * delivery in the background, such as to a message broker.
+	 *
+	 * This method must only be called from the writer thread.
+	 *
+	 * @param undelivered The number of entries accepted but not
+	 * delivered yet.
+	 *
+	 * @param undelivered_bytes Their size in bytes.
+	 *
+	 * @param dropped The number of entries dropped so far because they
+	 * could not be delivered.
+	 */
+	void NoteDeliveryState(uint64_t undelivered, uint64_t undelivered_bytes,
+	                       uint64_t dropped);
+
+	/**
+	 * Returns the values last passed to NoteDeliveryState(), which are
+	 * all zero for writers not using it.
+	 *
+	 * This method is safe to call from any thread.
+	 */
+	uint64_t Undelivered() const	{ return undelivered.load(std::memory_order_relaxed); }
+	uint64_t UndeliveredBytes() const	{ return undelivered_bytes.load(std::memory_order_relaxed); }
+	uint64_t Dropped() const	{ return dropped.load(std::memory_order_relaxed); }
 
 	/**
 	 * Sets the buffering status for the writer, assuming the writer
@@ -258,6 +317,7 @@ public:
 	// Overridden from MsgThread.
 	bool OnHeartbeat(double network_time, double current_time) override;
 	bool OnFinish(double network_time) override;
+	bool CanRunOnPool() const override	{ return true; }
 
 	// Let the compiler know that we are aware that there is a virtual
 	// info function in the base.
@@ -291,6 +351,18 @@ protected:
 	virtual bool DoWrite(int num_fields, const threading::Field* const*  fields,
 			     threading::Value** vals) = 0;
 
+	/**
+	 * Writer-specific output method for a batch of log entries, as
+	 * received together from the frontend.
+	 *
+	 * The default implementation calls DoWrite() for each entry in
+	 * turn. Writers can override it to amortize per-write costs across
+	 * the batch, such as wrapping it into a single transaction. The
+	 * return value has the same meaning as DoWrite()'s.
+	 */
+	virtual bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+				  int num_writes, threading::Value*** vals);
+
 	/**
 	 * Writer-specific method implementing a change of fthe buffering
 	 * state.  If buffering is disabled, the writer should attempt to
@@ -384,7 +456,8 @@ private:
 	/**
 	 * Deletes the values as passed into Write().
 	 */
-	void DeleteVals(int num_writes, threading::Value*** vals);
+	void DeleteVals(int num_writes, threading::Value*** vals,
+	                threading::ValueArena* arena);
 
 	// Frontend that instantiated us. This object must not be access from
 	// this class, it's running in a different thread!
@@ -396,6 +469,13 @@ private:
 	bool buffering;	// True if buffering is enabled.
 
 	int rotation_counter; // Tracks FinishedRotation() calls.
+
+	// Written by the writer thread, read by the main thread for stats.
+	std::atomic<double> write_delay;
+	std::atomic<double> max_write_delay;
+	std::atomic<uint64_t> undelivered;
+	std::atomic<uint64_t> undelivered_bytes;
+	std::atomic<uint64_t> dropped;
 };
 
 
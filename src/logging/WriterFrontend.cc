@@ -1,7 +1,10 @@
 
+#include <algorithm>
+
 #include "Net.h"
 #include "threading/SerialTypes.h"
 #include "broker/Manager.h"
+#include "const.bif.h"
 
 #include "Manager.h"
 #include "WriterFrontend.h"
@@ -55,16 +58,25 @@ private:
 class WriteMessage final : public threading::InputMessage<WriterBackend>
 {
 public:
-	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals)
+	WriteMessage(WriterBackend* backend, int num_fields, int num_writes, Value*** vals,
+	             threading::ValueArena* arena, double sent)
 		: threading::InputMessage<WriterBackend>("Write", backend),
-		num_fields(num_fields), num_writes(num_writes), vals(vals)	{}
+		num_fields(num_fields), num_writes(num_writes), vals(vals), arena(arena),
+		sent(sent)	{}
 
-	bool Process() override { return Object()->Write(num_fields, num_writes, vals); }
+	bool Process() override
+		{
+		bool result = Object()->Write(num_fields, num_writes, vals, arena);
+		Object()->NoteWriteDelay(current_time(true) - sent);
+		return result;
+		}
 
 private:
 	int num_fields;
 	int num_writes;
 	Value ***vals;
+	threading::ValueArena* arena;
+	double sent;	// Wall-clock time the frontend sent the batch.
 };
 
 class SetBufMessage final : public threading::InputMessage<WriterBackend>
@@ -112,8 +124,21 @@ WriterFrontend::WriterFrontend(const WriterBackend::WriterInfo& arg_info, zeek::
 	remote = arg_remote;
 	write_buffer = nullptr;
 	write_buffer_pos = 0;
+	arena = nullptr;
+	buffer_in_arena = arena_write_pending = false;
 	info = new WriterBackend::WriterInfo(arg_info);
 
+	max_batch_size = std::max(int(zeek::BifConst::Log::max_batch_size), 1);
+	max_batch_delay = zeek::BifConst::Log::max_batch_delay;
+	batch_target = 1;
+	batch_start = 0;
+	last_flush = current_time(true);
+	write_rate = 0;
+	num_writes = num_batches = 0;
+
+	for ( auto& b : batch_sizes )
+		b = 0;
+
 	num_fields = 0;
 	fields = nullptr;
 
@@ -143,6 +168,7 @@ WriterFrontend::~WriterFrontend()
 	Unref(writer);
 	delete info;
 	delete [] name;
+	delete arena;
 	}
 
 void WriterFrontend::Stop()
@@ -191,18 +217,51 @@ void WriterFrontend::Init(int arg_num_fields, const Field* const * arg_fields)
 
 	}
 
+threading::ValueArena* WriterFrontend::ArenaForWrite()
+	{
+	if ( write_buffer_pos && ! buffer_in_arena )
+		FlushWriteBuffer();
+
+	if ( ! arena )
+		arena = new threading::ValueArena();
+
+	arena_write_pending = true;
+	arena_write_mark = arena->GetMark();
+	return arena;
+	}
+
+void WriterFrontend::CancelWrite()
+	{
+	if ( ! arena_write_pending )
+		return;
+
+	arena->Rewind(arena_write_mark);
+	arena_write_pending = false;
+	}
+
+void WriterFrontend::DiscardWrite(int num_fields, Value** vals, bool in_arena)
+	{
+	if ( in_arena )
+		arena->Rewind(arena_write_mark);
+	else
+		DeleteVals(num_fields, vals);
+	}
+
 void WriterFrontend::Write(int arg_num_fields, Value** vals)
 	{
+	bool in_arena = arena_write_pending;
+	arena_write_pending = false;
+
 	if ( disabled )
 		{
-		DeleteVals(arg_num_fields, vals);
+		DiscardWrite(arg_num_fields, vals, in_arena);
 		return;
 		}
 
 	if ( arg_num_fields != num_fields )
 		{
 		reporter->Warning("WriterFrontend %s expected %d fields in write, got %d. Skipping line.", name, num_fields, arg_num_fields);
-		DeleteVals(arg_num_fields, vals);
+		DiscardWrite(arg_num_fields, vals, in_arena);
 		return;
 		}
 
@@ -217,21 +276,31 @@ void WriterFrontend::Write(int arg_num_fields, Value** vals)
 
 	if ( ! backend )
 		{
-		DeleteVals(arg_num_fields, vals);
+		DiscardWrite(arg_num_fields, vals, in_arena);
 		return;
 		}
 
+	if ( write_buffer_pos && buffer_in_arena != in_arena )
+		FlushWriteBuffer();
+
 	if ( ! write_buffer )
 		{
 		// Need new buffer.
-		write_buffer = new Value**[WRITER_BUFFER_SIZE];
+		write_buffer = new Value**[max_batch_size];
 		write_buffer_pos = 0;
 		}
 
+	double now = current_time(true);
+
+	if ( ! write_buffer_pos )
+		batch_start = now;
+
 	write_buffer[write_buffer_pos++] = vals;
+	buffer_in_arena = in_arena;
 
-	if ( write_buffer_pos >= WRITER_BUFFER_SIZE || ! buf || terminating )
-		// Buffer full (or no bufferin desired or termiating).
+	if ( write_buffer_pos >= batch_target || now - batch_start >= max_batch_delay ||
+	     ! buf || terminating )
+		// Batch complete or overdue (or no bufferin desired or termiating).
 		FlushWriteBuffer();
 
 	}
@@ -242,12 +311,85 @@ void WriterFrontend::FlushWriteBuffer()
 		// Nothing to do.
 		return;
 
+	threading::ValueArena* batch_arena = nullptr;
+
+	if ( buffer_in_arena )
+		{
+		batch_arena = arena;
+		arena = nullptr;
+		}
+
+	double now = current_time(true);
+	NoteBatch(write_buffer_pos, now);
+
 	if ( backend )
-		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer));
+		backend->SendIn(new WriteMessage(backend, num_fields, write_buffer_pos, write_buffer,
+		                                 batch_arena, now));
 
 	// Clear buffer (no delete, we pass ownership to child thread.)
 	write_buffer = nullptr;
 	write_buffer_pos = 0;
+	buffer_in_arena = false;
+	}
+
+void WriterFrontend::NoteBatch(int size, double now)
+	{
+	++num_batches;
+	num_writes += size;
+
+	int bucket = 0;
+
+	while ( bucket < NUM_BATCH_SIZE_BUCKETS - 1 && (2 << bucket) <= size )
+		++bucket;
+
+	++batch_sizes[bucket];
+
+	// The writes since the previous batch tell the current rate. Aiming
+	// for batches that fill up within the delay bound keeps busy logs at
+	// large batches and has quiet ones send each write right away.
+	double elapsed = now - last_flush;
+	last_flush = now;
+
+	if ( elapsed > 0 )
+		{
+		double rate = size / elapsed;
+		write_rate = write_rate == 0 ? rate : 0.75 * write_rate + 0.25 * rate;
+		}
+
+	double target = write_rate * max_batch_delay;
+
+	if ( target < 1 )
+		batch_target = 1;
+	else if ( target > max_batch_size )
+		batch_target = max_batch_size;
+	else
+		batch_target = int(target);
+	}
+
+void WriterFrontend::GetStats(Stats* stats)
+	{
+	stats->writes = num_writes;
+	stats->batches = num_batches;
+	stats->batch_target = batch_target;
+
+	for ( int i = 0; i < NUM_BATCH_SIZE_BUCKETS; ++i )
+		stats->batch_sizes[i] = batch_sizes[i];
+
+	stats->queue_depth = 0;
+	stats->write_delay = stats->max_write_delay = 0;
+	stats->undelivered = stats->undelivered_bytes = stats->dropped = 0;
+
+	if ( backend )
+		{
+		threading::MsgThread::Stats ts;
+		backend->GetStats(&ts);
+		stats->queue_depth = ts.pending_in;
+		stats->write_delay = backend->WriteDelay();
+		stats->max_write_delay = backend->MaxWriteDelay();
+		stats->undelivered = backend->Undelivered();
+		stats->undelivered_bytes = backend->UndeliveredBytes();
+		stats->dropped = backend->Dropped();
+		}
 	}
 
 void WriterFrontend::SetBuf(bool enabled)
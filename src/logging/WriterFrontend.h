@@ -3,6 +3,7 @@
 #pragma once
 
 #include "WriterBackend.h"
+#include "threading/ValueArena.h"
 
 namespace logging  {
 
@@ -85,14 +86,36 @@ public:
 	 * FlushWriteBuffer(). The backend writer triggers this with a
 	 * message at every heartbeat.
 	 *
+	 * The size of the batches adapts to the rate of writes: at most
+	 * \c Log::max_batch_size of them go into one, and each aims to get
+	 * sent within \c Log::max_batch_delay of its first write. Writes to
+	 * quiet logs thus go out right away.
+	 *
 	 * See WriterBackend::Writer() for arguments (except that this method
 	 * takes only a single record, not an array). The method takes
-	 * ownership of \a vals.
+	 * ownership of \a vals, which either come from ArenaForWrite() or
+	 * are individually heap-allocated.
 	 *
 	 * This method must only be called from the main thread.
 	 */
 	void Write(int num_fields, threading::Value** vals);
 
+	/**
+	 * Returns the arena to allocate the values of the next Write()
+	 * from. Arena values travel to the backend together with the rest of
+	 * the batch they're buffered in, and get released with it in one
+	 * go. Until that Write(), CancelWrite() releases them again.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	threading::ValueArena* ArenaForWrite();
+
+	/**
+	 * Releases the values allocated since the last ArenaForWrite(),
+	 * instead of writing them.
+	 */
+	void CancelWrite();
+
 	/**
 	 * Sets the buffering state.
 	 *
@@ -183,6 +206,40 @@ public:
 	 */
 	const threading::Field* const * Fields() const	{ return fields; }
 
+	/**
+	 * The number of buckets of the batch size histogram in Stats.
+	 */
+	static const int NUM_BATCH_SIZE_BUCKETS = 16;
+
+	/**
+	 * Statistics about a writer's batching.
+	 */
+	struct Stats {
+		uint64_t writes;	// Writes passed to the backend.
+		uint64_t batches;	// Batches sent to the backend.
+		int batch_target;	// The current target batch size.
+
+		// Bucket i counts batches of 2^i up to 2^(i+1)-1 writes, with
+		// the last one counting all larger batches too.
+		uint64_t batch_sizes[NUM_BATCH_SIZE_BUCKETS];
+
+		uint64_t queue_depth;	// Messages the backend hasn't processed yet.
+		double write_delay;	// Moving average from sending a batch to it being written.
+		double max_write_delay;	// Longest such delay.
+
+		// For writers delivering entries in the background.
+		uint64_t undelivered;	// Entries accepted but not delivered yet.
+		uint64_t undelivered_bytes;	// Their size.
+		uint64_t dropped;	// Entries that could not be delivered.
+	};
+
+	/**
+	 * Returns statistics about the writer's batching.
+	 *
+	 * This method must only be called from the main thread.
+	 */
+	void GetStats(Stats* stats);
+
 protected:
 	friend class Manager;
 
@@ -204,9 +261,33 @@ protected:
 	const threading::Field* const*  fields;	// The log fields.
 
 	// Buffer for bulk writes.
-	static const int WRITER_BUFFER_SIZE = 1000;
+	int max_batch_size;	// Size of the buffer, from Log::max_batch_size.
+	double max_batch_delay;	// From Log::max_batch_delay.
 	int write_buffer_pos;	// Position of next write in buffer.
-	threading::Value*** write_buffer;	// Buffer of size WRITER_BUFFER_SIZE.
+	threading::Value*** write_buffer;	// Buffer of size max_batch_size.
+
+	// For adapting the batch size to the rate of writes.
+	int batch_target;	// Buffered writes that trigger a flush.
+	double batch_start;	// Wall-clock time of the first buffered write.
+	double last_flush;	// Wall-clock time the last batch was sent.
+	double write_rate;	// Moving average of writes per second.
+
+	uint64_t num_writes;
+	uint64_t num_batches;
+	uint64_t batch_sizes[NUM_BATCH_SIZE_BUCKETS];
+
+	// Updates the batch target and statistics for a batch being sent.
+	void NoteBatch(int size, double now);
+
+	// Where the values of the buffered writes live, unless they're
+	// heap-allocated ones, which never share a buffer with arena ones.
+	threading::ValueArena* arena;
+	bool buffer_in_arena;	// True if the buffered writes use the arena.
+	bool arena_write_pending;	// True between ArenaForWrite() and Write().
+	threading::ValueArena::Mark arena_write_mark;	// Where the pending write began.
+
+	// Releases the values of a write that doesn't go anywhere.
+	void DiscardWrite(int num_fields, threading::Value** vals, bool in_arena);
 };
 
 }
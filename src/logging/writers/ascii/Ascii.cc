@@ -202,6 +202,11 @@ Ascii::Ascii(WriterFrontend* frontend) : WriterBackend(frontend)
 	formatter = nullptr;
 	gzip_level = 0;
 	gzfile = nullptr;
+	compressor = nullptr;
+	codec = detail::BlockCompressor::GZIP;
+	compression_level = 0;
+	compression_block_size = 0;
+	compression_threads = 0;
 
 	InitConfigOptions();
 	init_options = InitFilterOptions();
@@ -214,6 +219,9 @@ void Ascii::InitConfigOptions()
 	use_json = zeek::BifConst::LogAscii::use_json;
 	enable_utf_8 = zeek::BifConst::LogAscii::enable_utf_8;
 	gzip_level = zeek::BifConst::LogAscii::gzip_level;
+	compression_level = zeek::BifConst::LogAscii::compression_level;
+	compression_block_size = zeek::BifConst::LogAscii::compression_block_size;
+	compression_threads = zeek::BifConst::LogAscii::compression_threads;
 
 	separator.assign(
 			(const char*) zeek::BifConst::LogAscii::separator->Bytes(),
@@ -251,6 +259,11 @@ void Ascii::InitConfigOptions()
 		(const char*) zeek::BifConst::LogAscii::gzip_file_extension->Bytes(),
 		zeek::BifConst::LogAscii::gzip_file_extension->Len()
 		);
+
+	compression.assign(
+		(const char*) zeek::BifConst::LogAscii::compression->Bytes(),
+		zeek::BifConst::LogAscii::compression->Len()
+		);
 	}
 
 bool Ascii::InitFilterOptions()
@@ -343,6 +356,39 @@ bool Ascii::InitFilterOptions()
 
 		else if ( strcmp(i->first, "gzip_file_extension") == 0 )
 			gzip_file_extension.assign(i->second);
+
+		else if ( strcmp(i->first, "compression") == 0 )
+			compression.assign(i->second);
+
+		else if ( strcmp(i->first, "compression_level") == 0 )
+			compression_level = atoi(i->second);
+
+		else if ( strcmp(i->first, "compression_block_size") == 0 )
+			compression_block_size = strtoull(i->second, nullptr, 10);
+		}
+
+	if ( ! compression.empty() )
+		{
+		std::string err;
+
+		if ( ! detail::BlockCompressor::ParseCodec(compression, &codec, &err) )
+			{
+			Error(Fmt("invalid value for 'compression': %s", err.c_str()));
+			return false;
+			}
+		}
+
+	if ( compression_level < 0 )
+		{
+		Error("invalid value for 'compression_level', must not be negative.");
+		return false;
+		}
+
+	// Limited so that a block always fits zlib's 32-bit sizes.
+	if ( compression_block_size == 0 || compression_block_size > (1 << 30) )
+		{
+		Error("invalid value for 'compression_block_size', must be between 1 and 1073741824.");
+		return false;
 		}
 
 	if ( ! InitFormatter() )
@@ -421,6 +467,7 @@ void Ascii::CloseFile(double t)
 	InternalClose(fd);
 	fd = 0;
 	gzfile = nullptr;
+	compressor = nullptr;
 	}
 
 bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const * fields)
@@ -441,10 +488,10 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 		{
 		std::string ext = "." + LogExt();
 
-		if ( gzip_level > 0 )
+		if ( Compressing() )
 			{
 			ext += ".";
-			ext += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
+			ext += CompressedExtension();
 			}
 
 		fname += ext;
@@ -486,7 +533,15 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 		return false;
 		}
 
-	if ( gzip_level > 0 )
+	if ( Compressing() && (codec != detail::BlockCompressor::GZIP || compression_threads > 0) )
+		{
+		int level = codec == detail::BlockCompressor::GZIP ? gzip_level : compression_level;
+		compressor = new detail::BlockCompressor(fd, codec, level, compression_block_size,
+		                                         compression_threads);
+		gzfile = nullptr;
+		}
+
+	else if ( Compressing() )
 		{
 		if ( gzip_level < 0 || gzip_level > 9 )
 			{
@@ -494,8 +549,15 @@ bool Ascii::DoInit(const WriterInfo& info, int num_fields, const Field* const *
 			return false;
 			}
 
+		// A gzip_level of zero means zlib's default level here, as
+		// that's only the case with gzip set explicitly as compression.
 		char mode[4];
-		snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+
+		if ( gzip_level > 0 )
+			snprintf(mode, sizeof(mode), "wb%d", gzip_level);
+		else
+			snprintf(mode, sizeof(mode), "wb");
+
 		errno = 0; // errno will only be set under certain circumstances by gzdopen.
 		gzfile = gzdopen(fd, mode);
 
@@ -574,6 +636,12 @@ bool Ascii::WriteHeader(const string& path)
 
 bool Ascii::DoFlush(double network_time)
 	{
+	if ( compressor && ! compressor->Flush() )
+		{
+		Error(Fmt("error writing to %s: %s", fname.c_str(), compressor->Error().c_str()));
+		return false;
+		}
+
 	fsync(fd);
 	return true;
 	}
@@ -650,10 +718,10 @@ bool Ascii::DoRotate(const char* rotated_path, double open, double close, bool t
 
 	string nname = string(rotated_path) + "." + LogExt();
 
-	if ( gzip_level > 0 )
+	if ( Compressing() )
 		{
 		nname += ".";
-		nname += gzip_file_extension.empty() ? "gz" : gzip_file_extension;
+		nname += CompressedExtension();
 		}
 
 	if ( rename(fname.c_str(), nname.c_str()) != 0 )
@@ -854,8 +922,25 @@ string Ascii::Timestamp(double t)
 	return tmp;
 	}
 
+std::string Ascii::CompressedExtension() const
+	{
+	if ( codec != detail::BlockCompressor::GZIP )
+		return detail::BlockCompressor::Extension(codec);
+
+	return gzip_file_extension.empty() ? "gz" : gzip_file_extension;
+	}
+
 bool Ascii::InternalWrite(int fd, const char* data, int len)
 	{
+	if ( compressor )
+		{
+		if ( compressor->Write(data, len) )
+			return true;
+
+		Error(Fmt("Ascii::InternalWrite error: %s\n", compressor->Error().c_str()));
+		return false;
+		}
+
 	if ( ! gzfile )
 		return safe_write(fd, data, len);
 
@@ -879,6 +964,19 @@ bool Ascii::InternalWrite(int fd, const char* data, int len)
 
 bool Ascii::InternalClose(int fd)
 	{
+	if ( compressor )
+		{
+		bool ok = compressor->Close();
+
+		if ( ! ok )
+			Error(Fmt("Ascii::InternalClose error: %s\n", compressor->Error().c_str()));
+
+		delete compressor;
+		compressor = nullptr;
+		safe_close(fd);
+		return ok;
+		}
+
 	if ( ! gzfile )
 		{
 		safe_close(fd);
@@ -10,6 +10,8 @@
 #include "Desc.h"
 #include "zlib.h"
 
+#include "BlockCompressor.h"
+
 namespace plugin::Zeek_AsciiWriter { class Plugin; }
 
 namespace logging { namespace writer {
@@ -51,9 +53,12 @@ private:
 	bool InitFormatter();
 	bool InternalWrite(int fd, const char* data, int len);
 	bool InternalClose(int fd);
+	bool Compressing() const	{ return gzip_level > 0 || ! compression.empty(); }
+	std::string CompressedExtension() const;
 
 	int fd;
 	gzFile gzfile;
+	detail::BlockCompressor* compressor;
 	std::string fname;
 	ODesc desc;
 	bool ascii_done;
@@ -71,6 +76,11 @@ private:
 
 	int gzip_level; // level > 0 enables gzip compression
 	std::string gzip_file_extension;
+	std::string compression; // codec name, empty for gzip per gzip_level
+	detail::BlockCompressor::Codec codec;
+	int compression_level;
+	uint64_t compression_block_size;
+	int compression_threads;
 	bool use_json;
 	bool enable_utf_8;
 	std::string json_timestamps;
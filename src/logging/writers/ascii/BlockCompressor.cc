@@ -0,0 +1,394 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+#include "BlockCompressor.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef USE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include "util.h"
+
+using namespace logging::writer::detail;
+
+struct BlockCompressor::Block {
+	Codec codec;
+	int level;
+	std::string input;
+	std::string output;
+	std::string error;	// set if compression failed
+
+	std::promise<void> compressed;
+	std::future<void> result;
+};
+
+namespace {
+
+/**
+ * The threads compressing blocks for all ASCII writers.
+ */
+class CompressionPool {
+public:
+	static CompressionPool* Get(int threads);
+
+	~CompressionPool();
+
+	void Submit(BlockCompressor::Block* b);
+
+private:
+	explicit CompressionPool(int threads);
+
+	void Run();
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<BlockCompressor::Block*> queue;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+};
+
+}
+
+static bool compress_gzip(BlockCompressor::Block* b)
+	{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+
+	// Adding 16 to the window bits gets a gzip header and trailer.
+	if ( deflateInit2(&zs, b->level > 0 ? b->level : Z_DEFAULT_COMPRESSION,
+	                  Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK )
+		{
+		b->error = "cannot initialize zlib";
+		return false;
+		}
+
+	b->output.resize(deflateBound(&zs, b->input.size()));
+
+	zs.next_in = reinterpret_cast<Bytef*>(&b->input[0]);
+	zs.avail_in = b->input.size();
+	zs.next_out = reinterpret_cast<Bytef*>(&b->output[0]);
+	zs.avail_out = b->output.size();
+
+	int res = deflate(&zs, Z_FINISH);
+
+	if ( res != Z_STREAM_END )
+		b->error = zs.msg ? zs.msg : "deflate failed";
+	else
+		b->output.resize(zs.total_out);
+
+	deflateEnd(&zs);
+	return res == Z_STREAM_END;
+	}
+
+#ifdef USE_ZSTD
+static bool compress_zstd(BlockCompressor::Block* b)
+	{
+	b->output.resize(ZSTD_compressBound(b->input.size()));
+
+	// A level of zero is zstd's default.
+	size_t n = ZSTD_compress(&b->output[0], b->output.size(),
+	                         b->input.data(), b->input.size(), b->level);
+
+	if ( ZSTD_isError(n) )
+		{
+		b->error = ZSTD_getErrorName(n);
+		return false;
+		}
+
+	b->output.resize(n);
+	return true;
+	}
+#endif
+
+#ifdef USE_LZ4
+static bool compress_lz4(BlockCompressor::Block* b)
+	{
+	LZ4F_preferences_t prefs;
+	memset(&prefs, 0, sizeof(prefs));
+	prefs.compressionLevel = b->level;
+	prefs.frameInfo.contentSize = b->input.size();
+
+	b->output.resize(LZ4F_compressFrameBound(b->input.size(), &prefs));
+
+	size_t n = LZ4F_compressFrame(&b->output[0], b->output.size(),
+	                              b->input.data(), b->input.size(), &prefs);
+
+	if ( LZ4F_isError(n) )
+		{
+		b->error = LZ4F_getErrorName(n);
+		return false;
+		}
+
+	b->output.resize(n);
+	return true;
+	}
+#endif
+
+static void compress_block(BlockCompressor::Block* b)
+	{
+	switch ( b->codec ) {
+	case BlockCompressor::GZIP:
+		compress_gzip(b);
+		break;
+
+#ifdef USE_ZSTD
+	case BlockCompressor::ZSTD:
+		compress_zstd(b);
+		break;
+#endif
+
+#ifdef USE_LZ4
+	case BlockCompressor::LZ4:
+		compress_lz4(b);
+		break;
+#endif
+
+	default:
+		b->error = "codec not available";
+		break;
+	}
+
+	// The input isn't needed anymore, and the output may be waiting
+	// in the queue for a while.
+	std::string().swap(b->input);
+	b->compressed.set_value();
+	}
+
+CompressionPool* CompressionPool::Get(int threads)
+	{
+	// Set up by whichever writer thread gets here first.
+	static CompressionPool pool(threads);
+	return &pool;
+	}
+
+CompressionPool::CompressionPool(int threads)
+	{
+	for ( int i = 0; i < threads; ++i )
+		workers.emplace_back(&CompressionPool::Run, this);
+	}
+
+CompressionPool::~CompressionPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+		}
+
+	cond.notify_all();
+
+	for ( auto& w : workers )
+		w.join();
+	}
+
+void CompressionPool::Submit(BlockCompressor::Block* b)
+	{
+		{
+		std::lock_guard<std::mutex> lock(mutex);
+		queue.push_back(b);
+		}
+
+	cond.notify_one();
+	}
+
+void CompressionPool::Run()
+	{
+	// Signals get handled by the main thread only, as with the threads
+	// of BasicThread.
+	sigset_t mask_set;
+	sigfillset(&mask_set);
+	sigdelset(&mask_set, SIGFPE);
+	sigdelset(&mask_set, SIGILL);
+	sigdelset(&mask_set, SIGSEGV);
+	sigdelset(&mask_set, SIGBUS);
+	pthread_sigmask(SIG_BLOCK, &mask_set, 0);
+
+	while ( true )
+		{
+		BlockCompressor::Block* b = nullptr;
+
+			{
+			std::unique_lock<std::mutex> lock(mutex);
+			cond.wait(lock, [this]{ return stopping || ! queue.empty(); });
+
+			if ( queue.empty() )
+				return;
+
+			b = queue.front();
+			queue.pop_front();
+			}
+
+		compress_block(b);
+		}
+	}
+
+bool BlockCompressor::ParseCodec(const std::string& name, Codec* codec, std::string* error)
+	{
+	if ( name == "gzip" )
+		{
+		*codec = GZIP;
+		return true;
+		}
+
+	if ( name == "zstd" )
+		{
+#ifdef USE_ZSTD
+		*codec = ZSTD;
+		return true;
+#else
+		*error = "zstd compression is not available in this build";
+		return false;
+#endif
+		}
+
+	if ( name == "lz4" )
+		{
+#ifdef USE_LZ4
+		*codec = LZ4;
+		return true;
+#else
+		*error = "lz4 compression is not available in this build";
+		return false;
+#endif
+		}
+
+	*error = "unknown compression '" + name + "', must be gzip, zstd, or lz4";
+	return false;
+	}
+
+const char* BlockCompressor::Extension(Codec codec)
+	{
+	switch ( codec ) {
+	case GZIP:
+		return "gz";
+	case ZSTD:
+		return "zst";
+	case LZ4:
+		return "lz4";
+	}
+
+	return "";
+	}
+
+BlockCompressor::BlockCompressor(int arg_fd, Codec arg_codec, int arg_level,
+                                 uint64_t arg_block_size, int arg_threads)
+	{
+	fd = arg_fd;
+	codec = arg_codec;
+	level = arg_level;
+	block_size = arg_block_size;
+	threads = arg_threads;
+	}
+
+BlockCompressor::~BlockCompressor()
+	{
+	// The pool may still be working on these.
+	for ( auto& b : pending )
+		b->result.wait();
+	}
+
+bool BlockCompressor::Write(const char* data, uint64_t len)
+	{
+	if ( ! current )
+		{
+		current.reset(new Block());
+		current->codec = codec;
+		current->level = level;
+		current->input.reserve(block_size + len);
+		}
+
+	current->input.append(data, len);
+
+	if ( current->input.size() < block_size )
+		return true;
+
+	return Submit();
+	}
+
+bool BlockCompressor::Flush()
+	{
+	return WriteBlocks(false);
+	}
+
+bool BlockCompressor::Close()
+	{
+	return Submit() && WriteBlocks(true);
+	}
+
+bool BlockCompressor::Submit()
+	{
+	if ( ! current )
+		return true;
+
+	auto b = current.release();
+	b->result = b->compressed.get_future();
+
+	if ( threads == 0 )
+		{
+		compress_block(b);
+		std::unique_ptr<Block> owned(b);
+		return WriteBlock(b);
+		}
+
+	pending.emplace_back(b);
+	CompressionPool::Get(threads)->Submit(b);
+
+	return WriteBlocks(false);
+	}
+
+bool BlockCompressor::WriteBlocks(bool wait_all)
+	{
+	// Keeping a couple of blocks per thread in flight bounds the memory
+	// that a writer can tie up if compression falls behind.
+	size_t max_pending = wait_all ? 0 : 2 * threads;
+
+	while ( ! pending.empty() )
+		{
+		auto& b = pending.front();
+
+		if ( pending.size() <= max_pending &&
+		     b->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready )
+			break;
+
+		b->result.wait();
+		bool ok = WriteBlock(b.get());
+		pending.pop_front();
+
+		if ( ! ok )
+			return false;
+		}
+
+	return true;
+	}
+
+bool BlockCompressor::WriteBlock(Block* b)
+	{
+	if ( ! b->error.empty() )
+		{
+		error = "compression failed: " + b->error;
+		return false;
+		}
+
+	if ( ! safe_write(fd, b->output.data(), b->output.size()) )
+		{
+		char buf[256];
+		bro_strerror_r(errno, buf, sizeof(buf));
+		error = buf;
+		return false;
+		}
+
+	return true;
+	}
@@ -0,0 +1,111 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+
+#include <cstdint>
+
+namespace logging { namespace writer { namespace detail {
+
+/**
+ * Compresses a log file's output in independent blocks and writes them
+ * out in order. Each block becomes a complete gzip member, zstd frame, or
+ * LZ4 frame, so that, like with pigz, the result is a valid file for the
+ * usual tools. With compression threads, blocks get compressed on a pool
+ * shared by all ASCII writers, and the writer thread only copies the data
+ * and writes out whatever has finished.
+ */
+class BlockCompressor {
+public:
+	enum Codec { GZIP, ZSTD, LZ4 };
+
+	/**
+	 * Looks up a codec by name ("gzip", "zstd", or "lz4").
+	 *
+	 * @return False if the name is unknown or the codec isn't available
+	 * in this build, with *error* set to why.
+	 */
+	static bool ParseCodec(const std::string& name, Codec* codec, std::string* error);
+
+	/**
+	 * Returns the file name extension for a codec, without a dot.
+	 */
+	static const char* Extension(Codec codec);
+
+	/**
+	 * Constructor.
+	 *
+	 * @param fd The file to write to. It remains owned by the caller.
+	 *
+	 * @param codec The compression to use.
+	 *
+	 * @param level The compression level, with zero selecting the codec's
+	 * default.
+	 *
+	 * @param block_size How much input goes into one block. Blocks end
+	 * at the first write that reaches this size.
+	 *
+	 * @param threads The size of the compression pool. This gets set by
+	 * the first compressor to use a pool; later ones share it. With zero,
+	 * blocks get compressed in the calling thread.
+	 */
+	BlockCompressor(int fd, Codec codec, int level, uint64_t block_size, int threads);
+
+	/**
+	 * Destructor. Call Close() first to write out all data.
+	 */
+	~BlockCompressor();
+
+	/**
+	 * Adds data to the output.
+	 *
+	 * @return False on error, with Error() returning why.
+	 */
+	bool Write(const char* data, uint64_t len);
+
+	/**
+	 * Writes out those blocks that have been compressed already,
+	 * without waiting for any.
+	 *
+	 * @return False on error, with Error() returning why.
+	 */
+	bool Flush();
+
+	/**
+	 * Compresses what's left and writes out all blocks, waiting for
+	 * them as needed. This doesn't close the file.
+	 *
+	 * @return False on error, with Error() returning why.
+	 */
+	bool Close();
+
+	/**
+	 * Returns what went wrong with the last failing call.
+	 */
+	const std::string& Error() const	{ return error; }
+
+	struct Block;
+
+private:
+	bool Submit();
+	bool WriteBlocks(bool wait_all);
+	bool WriteBlock(Block* b);
+
+	int fd;
+	Codec codec;
+	int level;
+	uint64_t block_size;
+	int threads;
+	std::string error;
+
+	std::unique_ptr<Block> current;
+
+	// Blocks handed to the pool, in the order they go out.
+	std::deque<std::unique_ptr<Block>> pending;
+};
+
+} } }
@@ -0,0 +1,327 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "threading/SerialTypes.h"
+
+#include "Kafka.h"
+#include "kafka.bif.h"
+
+using namespace std;
+using namespace logging::writer;
+using threading::Value;
+using threading::Field;
+using threading::formatter::JSON;
+
+// Filter config entries with this prefix go straight to librdkafka.
+static const char* const property_prefix = "kafka.";
+
+Kafka::Kafka(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	producer = nullptr;
+	topic = nullptr;
+	formatter = nullptr;
+	undelivered = undelivered_bytes = dropped = dropped_reported = 0;
+	last_error = RD_KAFKA_RESP_ERR_NO_ERROR;
+
+	brokers.assign(
+		(const char*) zeek::BifConst::LogKafka::brokers->Bytes(),
+		zeek::BifConst::LogKafka::brokers->Len()
+		);
+
+	topic_name.assign(
+		(const char*) zeek::BifConst::LogKafka::topic->Bytes(),
+		zeek::BifConst::LogKafka::topic->Len()
+		);
+
+	ODesc tsfmt;
+	zeek::BifConst::LogKafka::json_timestamps->Describe(&tsfmt);
+	json_timestamps.assign(
+		(const char*) tsfmt.Bytes(),
+		tsfmt.Len()
+		);
+
+	max_buffered_bytes = zeek::BifConst::LogKafka::max_buffered_bytes;
+	linger = zeek::BifConst::LogKafka::linger;
+	flush_timeout = zeek::BifConst::LogKafka::flush_timeout;
+	}
+
+Kafka::~Kafka()
+	{
+	// Entries still queued are lost here. DoFinish() gave them a chance
+	// to go out already.
+	if ( topic )
+		rd_kafka_topic_destroy(topic);
+
+	if ( producer )
+		rd_kafka_destroy(producer);
+
+	delete formatter;
+	}
+
+bool Kafka::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "brokers") == 0 )
+			brokers.assign(i->second);
+
+		else if ( strcmp(i->first, "topic") == 0 )
+			topic_name.assign(i->second);
+
+		else if ( strcmp(i->first, "json_timestamps") == 0 )
+			json_timestamps.assign(i->second);
+
+		else if ( strcmp(i->first, "max_buffered_bytes") == 0 )
+			{
+			max_buffered_bytes = strtoull(i->second, nullptr, 10);
+
+			if ( max_buffered_bytes == 0 )
+				{
+				Error("invalid value for 'max_buffered_bytes', must be a positive number");
+				return false;
+				}
+			}
+		}
+
+	if ( max_buffered_bytes == 0 )
+		{
+		Error("LogKafka::max_buffered_bytes must be positive");
+		return false;
+		}
+
+	return true;
+	}
+
+bool Kafka::SetProperty(rd_kafka_conf_t* conf, const char* name, const char* value)
+	{
+	char errstr[512];
+
+	if ( rd_kafka_conf_set(conf, name, value, errstr, sizeof(errstr)) == RD_KAFKA_CONF_OK )
+		return true;
+
+	Error(Fmt("cannot set Kafka property %s: %s", name, errstr));
+	return false;
+	}
+
+bool Kafka::DoInit(const WriterInfo& info, int num_fields, const Field* const* fields)
+	{
+	if ( ! InitFilterOptions() )
+		return false;
+
+	JSON::TimeFormat tf = JSON::TS_EPOCH;
+
+	if ( json_timestamps == "JSON::TS_EPOCH" )
+		tf = JSON::TS_EPOCH;
+	else if ( json_timestamps == "JSON::TS_MILLIS" )
+		tf = JSON::TS_MILLIS;
+	else if ( json_timestamps == "JSON::TS_ISO8601" )
+		tf = JSON::TS_ISO8601;
+	else
+		{
+		Error(Fmt("Invalid JSON timestamp format: %s", json_timestamps.c_str()));
+		return false;
+		}
+
+	formatter = new JSON(this, tf);
+
+	// librdkafka's buffer limit is in kilobytes.
+	string kbytes = to_string(max<uint64_t>(max_buffered_bytes / 1024, 1));
+	string linger_ms = to_string(static_cast<uint64_t>(linger * 1000));
+
+	rd_kafka_conf_t* conf = rd_kafka_conf_new();
+	bool ok = SetProperty(conf, "bootstrap.servers", brokers.c_str()) &&
+	          SetProperty(conf, "queue.buffering.max.kbytes", kbytes.c_str()) &&
+	          SetProperty(conf, "linger.ms", linger_ms.c_str());
+
+	// Properties from the filter come last, so that they can override
+	// the ones above.
+	size_t prefix_len = strlen(property_prefix);
+
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      ok && i != info.config.end(); ++i )
+		{
+		if ( strncmp(i->first, property_prefix, prefix_len) == 0 )
+			ok = SetProperty(conf, i->first + prefix_len, i->second);
+		}
+
+	if ( ! ok )
+		{
+		rd_kafka_conf_destroy(conf);
+		return false;
+		}
+
+	rd_kafka_conf_set_opaque(conf, this);
+	rd_kafka_conf_set_dr_msg_cb(conf, OnDelivery);
+
+	char errstr[512];
+	producer = rd_kafka_new(RD_KAFKA_PRODUCER, conf, errstr, sizeof(errstr));
+
+	if ( ! producer )
+		{
+		// The producer only takes ownership of the config on success.
+		rd_kafka_conf_destroy(conf);
+		Error(Fmt("cannot create Kafka producer: %s", errstr));
+		return false;
+		}
+
+	const char* tname = topic_name.empty() ? info.path : topic_name.c_str();
+	topic = rd_kafka_topic_new(producer, tname, nullptr);
+
+	if ( ! topic )
+		{
+		Error(Fmt("cannot create Kafka topic %s: %s", tname,
+		          rd_kafka_err2str(rd_kafka_last_error())));
+		return false;
+		}
+
+	return true;
+	}
+
+bool Kafka::DoWrite(int num_fields, const Field* const* fields, Value** vals)
+	{
+	return Produce(num_fields, fields, 1, &vals);
+	}
+
+bool Kafka::DoWriteBatch(int num_fields, const Field* const* fields,
+                         int num_writes, Value*** vals)
+	{
+	return Produce(num_fields, fields, num_writes, vals);
+	}
+
+bool Kafka::Produce(int num_fields, const Field* const* fields,
+                    int num_writes, Value*** vals)
+	{
+	buffer.Clear();
+	offsets.clear();
+
+	for ( int j = 0; j < num_writes; ++j )
+		{
+		offsets.push_back(buffer.Len());
+
+		if ( ! formatter->Describe(&buffer, num_fields, fields, vals[j]) )
+			return false;
+		}
+
+	offsets.push_back(buffer.Len());
+
+	// The messages can only point into the buffer once it's done
+	// growing.
+	char* bytes = (char*) buffer.Bytes();
+	messages.resize(num_writes);
+
+	for ( int j = 0; j < num_writes; ++j )
+		{
+		rd_kafka_message_t& m = messages[j];
+		memset(&m, 0, sizeof(m));
+		m.payload = bytes + offsets[j];
+		m.len = offsets[j + 1] - offsets[j];
+		}
+
+	// Copying the payloads lets the buffer get reused right away, and
+	// makes librdkafka's buffer limit cover them.
+	rd_kafka_produce_batch(topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
+	                       messages.data(), num_writes);
+
+	// Entries that didn't fit, most likely because the buffer is full,
+	// get dropped rather than waiting for the brokers.
+	for ( const auto& m : messages )
+		{
+		if ( m.err )
+			{
+			++dropped;
+			last_error = m.err;
+			}
+		else
+			{
+			++undelivered;
+			undelivered_bytes += m.len;
+			}
+		}
+
+	Poll(0);
+	return true;
+	}
+
+void Kafka::OnDelivery(rd_kafka_t* rk, const rd_kafka_message_t* msg, void* opaque)
+	{
+	Kafka* k = static_cast<Kafka*>(opaque);
+
+	--k->undelivered;
+	k->undelivered_bytes -= msg->len;
+
+	if ( msg->err )
+		{
+		++k->dropped;
+		k->last_error = msg->err;
+		}
+	}
+
+void Kafka::Poll(int timeout_ms)
+	{
+	rd_kafka_poll(producer, timeout_ms);
+	NoteDeliveryState(undelivered, undelivered_bytes, dropped);
+	}
+
+void Kafka::ReportDrops()
+	{
+	if ( dropped == dropped_reported )
+		return;
+
+	Warning(Fmt("dropped %" PRIu64 " log entries: %s", dropped - dropped_reported,
+	            rd_kafka_err2str(last_error)));
+	dropped_reported = dropped;
+	}
+
+bool Kafka::DoFlush(double network_time)
+	{
+	// Waiting for the brokers here would stall the writer thread, which
+	// this writer is all about avoiding. librdkafka sends entries within
+	// LogKafka::linger anyway.
+	Poll(0);
+	return true;
+	}
+
+bool Kafka::DoHeartbeat(double network_time, double current_time)
+	{
+	Poll(0);
+	ReportDrops();
+	return true;
+	}
+
+bool Kafka::DoFinish(double network_time)
+	{
+	if ( ! producer )
+		return true;
+
+	rd_kafka_flush(producer, static_cast<int>(flush_timeout * 1000));
+	Poll(0);
+	ReportDrops();
+
+	if ( undelivered )
+		Warning(Fmt("%" PRIu64 " log entries were not delivered", undelivered));
+
+	return true;
+	}
+
+bool Kafka::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	// There's no file to rotate, but the manager still expects to hear
+	// back.
+	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s", Info().path));
+		return false;
+		}
+
+	return true;
+	}
@@ -0,0 +1,92 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer sending JSON records to Apache Kafka.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <string>
+#include <vector>
+
+#include <librdkafka/rdkafka.h>
+
+#include "logging/WriterBackend.h"
+#include "threading/formatters/JSON.h"
+#include "Desc.h"
+
+namespace logging { namespace writer {
+
+/**
+ * Sends each log entry as a JSON message to a Kafka topic. All entries of
+ * a batch from WriterFrontend get formatted into one reused buffer and
+ * enqueued with a single produce call. librdkafka then delivers them in
+ * the background, so the writer thread never waits for the brokers. Once
+ * LogKafka::max_buffered_bytes await delivery, further entries get
+ * dropped until the brokers catch up. The delivery backlog and the drops
+ * show up in get_log_writer_stats().
+ */
+class Kafka : public WriterBackend {
+public:
+	explicit Kafka(WriterFrontend* frontend);
+	~Kafka() override;
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Kafka(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+			    const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+			     threading::Value** vals) override;
+	bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+			  int num_writes, threading::Value*** vals) override;
+	bool DoSetBuf(bool enabled) override	{ return true; }
+	bool DoRotate(const char* rotated_path, double open,
+			      double close, bool terminating) override;
+	bool DoFlush(double network_time) override;
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override;
+
+private:
+	bool InitFilterOptions();
+	bool SetProperty(rd_kafka_conf_t* conf, const char* name, const char* value);
+	bool Produce(int num_fields, const threading::Field* const* fields,
+	             int num_writes, threading::Value*** vals);
+
+	// Serves delivery reports and updates the writer's stats.
+	void Poll(int timeout_ms);
+
+	// Reports drops since the last call.
+	void ReportDrops();
+
+	static void OnDelivery(rd_kafka_t* rk, const rd_kafka_message_t* msg,
+	                       void* opaque);
+
+	rd_kafka_t* producer;
+	rd_kafka_topic_t* topic;
+	threading::formatter::JSON* formatter;
+
+	// Reused from batch to batch, so that formatting doesn't allocate
+	// once they've grown large enough.
+	ODesc buffer;
+	std::vector<int> offsets;
+	std::vector<rd_kafka_message_t> messages;
+
+	uint64_t undelivered;
+	uint64_t undelivered_bytes;
+	uint64_t dropped;
+	uint64_t dropped_reported;
+	rd_kafka_resp_err_t last_error;
+
+	// Options, which filters can override through their config table.
+	std::string brokers;
+	std::string topic_name;
+	std::string json_timestamps;
+	uint64_t max_buffered_bytes;
+	double linger;
+	double flush_timeout;
+};
+
+}
+}
@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "plugin/Plugin.h"
+
+#include "Kafka.h"
+
+namespace plugin {
+namespace Zeek_KafkaWriter {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new ::logging::Component("Kafka", ::logging::writer::Kafka::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::KafkaWriter";
+		config.description = "Apache Kafka log writer";
+		return config;
+		}
+} plugin;
+
+}
+}
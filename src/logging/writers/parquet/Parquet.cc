@@ -0,0 +1,398 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "zeek-config.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/util/compression.h>
+#include <parquet/arrow/writer.h>
+
+#include "threading/SerialTypes.h"
+#include "threading/Formatter.h"
+
+#include "Parquet.h"
+#include "parquet.bif.h"
+
+using namespace std;
+using namespace logging::writer;
+using threading::Value;
+using threading::Field;
+using threading::formatter::Formatter;
+
+Parquet::Parquet(WriterFrontend* frontend) : WriterBackend(frontend)
+	{
+	buffered_rows = 0;
+	row_group_size = zeek::BifConst::LogParquet::row_group_size;
+	dictionary_encoding = zeek::BifConst::LogParquet::dictionary_encoding;
+
+	compression.assign(
+		(const char*) zeek::BifConst::LogParquet::compression->Bytes(),
+		zeek::BifConst::LogParquet::compression->Len()
+		);
+	}
+
+Parquet::~Parquet()
+	{
+	// DoFinish() normally closed the file already.
+	if ( writer )
+		CloseFile();
+	}
+
+bool Parquet::CheckStatus(const ::arrow::Status& s, const char* what)
+	{
+	if ( s.ok() )
+		return true;
+
+	Error(Fmt("%s %s: %s", what, fname.c_str(), s.ToString().c_str()));
+	return false;
+	}
+
+bool Parquet::InitFilterOptions()
+	{
+	const WriterInfo& info = Info();
+
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "row_group_size") == 0 )
+			{
+			row_group_size = strtoull(i->second, nullptr, 10);
+
+			if ( row_group_size == 0 )
+				{
+				Error("invalid value for 'row_group_size', must be a positive number");
+				return false;
+				}
+			}
+
+		else if ( strcmp(i->first, "compression") == 0 )
+			compression = i->second;
+
+		else if ( strcmp(i->first, "dictionary_encoding") == 0 )
+			{
+			if ( strcmp(i->second, "T") == 0 )
+				dictionary_encoding = true;
+			else if ( strcmp(i->second, "F") == 0 )
+				dictionary_encoding = false;
+			else
+				{
+				Error("invalid value for 'dictionary_encoding', must be a string and either \"T\" or \"F\"");
+				return false;
+				}
+			}
+		}
+
+	if ( row_group_size == 0 )
+		{
+		Error("LogParquet::row_group_size must be positive");
+		return false;
+		}
+
+	return true;
+	}
+
+shared_ptr<::arrow::DataType> Parquet::ColumnType(zeek::TypeTag type, zeek::TypeTag subtype)
+	{
+	switch ( type ) {
+	case zeek::TYPE_BOOL:
+		return ::arrow::boolean();
+
+	case zeek::TYPE_INT:
+		return ::arrow::int64();
+
+	case zeek::TYPE_COUNT:
+	case zeek::TYPE_COUNTER:
+		return ::arrow::uint64();
+
+	case zeek::TYPE_PORT:
+		// Like the ASCII writer, this leaves out the protocol.
+		return ::arrow::uint16();
+
+	case zeek::TYPE_TIME:
+		return ::arrow::timestamp(::arrow::TimeUnit::MICRO, "UTC");
+
+	case zeek::TYPE_INTERVAL:
+	case zeek::TYPE_DOUBLE:
+		return ::arrow::float64();
+
+	case zeek::TYPE_ADDR:
+	case zeek::TYPE_SUBNET:
+	case zeek::TYPE_ENUM:
+	case zeek::TYPE_FILE:
+	case zeek::TYPE_FUNC:
+		return ::arrow::utf8();
+
+	case zeek::TYPE_STRING:
+		// Zeek strings are arbitrary bytes, which Parquet's string type
+		// doesn't allow for.
+		return ::arrow::binary();
+
+	case zeek::TYPE_TABLE:
+	case zeek::TYPE_VECTOR:
+		{
+		auto element = ColumnType(subtype, zeek::TYPE_VOID);
+		return element ? ::arrow::list(element) : nullptr;
+		}
+
+	default:
+		return nullptr;
+	}
+	}
+
+bool Parquet::DoInit(const WriterInfo& info, int num_fields, const Field* const * fields)
+	{
+	if ( ! InitFilterOptions() )
+		return false;
+
+	fname = string(info.path) + "." + LogExt();
+
+	::arrow::FieldVector columns;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		auto type = ColumnType(fields[i]->type, fields[i]->subtype);
+
+		if ( ! type )
+			{
+			Error(Fmt("unsupported type for field %s: %s", fields[i]->name,
+			          zeek::type_name(fields[i]->type)));
+			return false;
+			}
+
+		columns.push_back(::arrow::field(fields[i]->name, type));
+		}
+
+	schema = ::arrow::schema(columns);
+
+	for ( const auto& column : columns )
+		{
+		auto builder = ::arrow::MakeBuilder(column->type());
+
+		if ( ! builder.ok() )
+			return CheckStatus(builder.status(), "cannot set up columns for");
+
+		builders.push_back(move(*builder));
+		}
+
+	return OpenFile();
+	}
+
+bool Parquet::OpenFile()
+	{
+	auto codec = compression == "none" ?
+		::arrow::Result<::arrow::Compression::type>(::arrow::Compression::UNCOMPRESSED) :
+		::arrow::util::Codec::GetCompressionType(compression);
+
+	if ( ! codec.ok() || ! ::arrow::util::Codec::IsAvailable(*codec) )
+		{
+		Error(Fmt("unsupported compression for %s: %s", fname.c_str(), compression.c_str()));
+		return false;
+		}
+
+	::parquet::WriterProperties::Builder props;
+	props.compression(*codec);
+	props.disable_dictionary();
+
+	if ( dictionary_encoding )
+		{
+		for ( const auto& column : schema->fields() )
+			{
+			auto id = column->type()->id();
+
+			if ( id == ::arrow::Type::STRING || id == ::arrow::Type::BINARY )
+				props.enable_dictionary(column->name());
+			}
+		}
+
+	// Storing the Arrow schema keeps the time zone of timestamps.
+	auto arrow_props = ::parquet::ArrowWriterProperties::Builder().store_schema()->build();
+
+	auto f = ::arrow::io::FileOutputStream::Open(fname);
+
+	if ( ! f.ok() )
+		return CheckStatus(f.status(), "cannot open");
+
+	file = *f;
+
+	auto w = ::parquet::arrow::FileWriter::Open(*schema, ::arrow::default_memory_pool(),
+	                                            file, props.build(), arrow_props);
+
+	if ( ! w.ok() )
+		{
+		file.reset();
+		return CheckStatus(w.status(), "cannot write");
+		}
+
+	writer = move(*w);
+	return true;
+	}
+
+bool Parquet::WriteRowGroup()
+	{
+	if ( buffered_rows == 0 )
+		return true;
+
+	::arrow::ArrayVector arrays;
+
+	for ( auto& builder : builders )
+		{
+		shared_ptr<::arrow::Array> array;
+
+		if ( ! CheckStatus(builder->Finish(&array), "cannot build columns for") )
+			return false;
+
+		arrays.push_back(move(array));
+		}
+
+	auto table = ::arrow::Table::Make(schema, arrays, buffered_rows);
+	buffered_rows = 0;
+
+	return CheckStatus(writer->WriteTable(*table, table->num_rows()), "cannot write to");
+	}
+
+bool Parquet::CloseFile()
+	{
+	bool ok = WriteRowGroup();
+
+	ok = CheckStatus(writer->Close(), "cannot finish") && ok;
+	ok = CheckStatus(file->Close(), "cannot close") && ok;
+
+	writer.reset();
+	file.reset();
+
+	return ok;
+	}
+
+::arrow::Status Parquet::AppendValue(::arrow::ArrayBuilder* builder, const Value* val)
+	{
+	if ( ! val->present )
+		return builder->AppendNull();
+
+	switch ( val->type ) {
+	case zeek::TYPE_BOOL:
+		return static_cast<::arrow::BooleanBuilder*>(builder)->Append(val->val.int_val != 0);
+
+	case zeek::TYPE_INT:
+		return static_cast<::arrow::Int64Builder*>(builder)->Append(val->val.int_val);
+
+	case zeek::TYPE_COUNT:
+	case zeek::TYPE_COUNTER:
+		return static_cast<::arrow::UInt64Builder*>(builder)->Append(val->val.uint_val);
+
+	case zeek::TYPE_PORT:
+		return static_cast<::arrow::UInt16Builder*>(builder)->Append(val->val.port_val.port);
+
+	case zeek::TYPE_TIME:
+		{
+		auto usecs = static_cast<int64_t>(llround(val->val.double_val * 1e6));
+		return static_cast<::arrow::TimestampBuilder*>(builder)->Append(usecs);
+		}
+
+	case zeek::TYPE_INTERVAL:
+	case zeek::TYPE_DOUBLE:
+		return static_cast<::arrow::DoubleBuilder*>(builder)->Append(val->val.double_val);
+
+	case zeek::TYPE_ADDR:
+		return static_cast<::arrow::StringBuilder*>(builder)->Append(Formatter::Render(val->val.addr_val));
+
+	case zeek::TYPE_SUBNET:
+		return static_cast<::arrow::StringBuilder*>(builder)->Append(Formatter::Render(val->val.subnet_val));
+
+	case zeek::TYPE_ENUM:
+	case zeek::TYPE_FILE:
+	case zeek::TYPE_FUNC:
+		return static_cast<::arrow::StringBuilder*>(builder)->Append(val->val.string_val.data,
+		                                                             val->val.string_val.length);
+
+	case zeek::TYPE_STRING:
+		return static_cast<::arrow::BinaryBuilder*>(builder)->Append(val->val.string_val.data,
+		                                                             val->val.string_val.length);
+
+	case zeek::TYPE_TABLE:
+	case zeek::TYPE_VECTOR:
+		{
+		auto list = static_cast<::arrow::ListBuilder*>(builder);
+		const auto& elements = val->type == zeek::TYPE_TABLE ? val->val.set_val : val->val.vector_val;
+		auto s = list->Append();
+
+		for ( bro_int_t i = 0; s.ok() && i < elements.size; ++i )
+			s = AppendValue(list->value_builder(), elements.vals[i]);
+
+		return s;
+		}
+
+	default:
+		return ::arrow::Status::TypeError("unsupported field type ", zeek::type_name(val->type));
+	}
+	}
+
+bool Parquet::DoWrite(int num_fields, const Field* const * fields, Value** vals)
+	{
+	// After rotation, the next file gets opened with the first write.
+	if ( ! writer && ! OpenFile() )
+		return false;
+
+	for ( int i = 0; i < num_fields; ++i )
+		{
+		if ( ! CheckStatus(AppendValue(builders[i].get(), vals[i]), "cannot buffer row for") )
+			return false;
+		}
+
+	if ( ++buffered_rows >= static_cast<int64_t>(row_group_size) )
+		return WriteRowGroup();
+
+	return true;
+	}
+
+bool Parquet::DoFlush(double network_time)
+	{
+	// Readers only see data once the footer is written at close, so
+	// there's no point in cutting row groups short here.
+	return true;
+	}
+
+bool Parquet::DoFinish(double network_time)
+	{
+	if ( ! writer )
+		return true;
+
+	return CloseFile();
+	}
+
+bool Parquet::DoRotate(const char* rotated_path, double open, double close, bool terminating)
+	{
+	if ( ! writer )
+		{
+		FinishedRotation();
+		return true;
+		}
+
+	if ( ! CloseFile() )
+		{
+		FinishedRotation();
+		return false;
+		}
+
+	string nname = string(rotated_path) + "." + LogExt();
+
+	if ( rename(fname.c_str(), nname.c_str()) != 0 )
+		{
+		Error(Fmt("failed to rename %s to %s: %s", fname.c_str(),
+		          nname.c_str(), Strerror(errno)));
+		FinishedRotation();
+		return false;
+		}
+
+	if ( ! FinishedRotation(nname.c_str(), fname.c_str(), open, close, terminating) )
+		{
+		Error(Fmt("error rotating %s to %s", fname.c_str(), nname.c_str()));
+		return false;
+		}
+
+	return true;
+	}
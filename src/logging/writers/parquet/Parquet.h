@@ -0,0 +1,82 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+//
+// Log writer for Apache Parquet files.
+
+#pragma once
+
+#include "zeek-config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "logging/WriterBackend.h"
+
+namespace arrow {
+class ArrayBuilder;
+class DataType;
+class Schema;
+class Status;
+namespace io { class FileOutputStream; }
+}
+
+namespace parquet { namespace arrow { class FileWriter; } }
+
+namespace logging { namespace writer {
+
+/**
+ * Writes logs as Parquet files, one column per field. Rows get buffered
+ * in Arrow builders and go out as a row group once there are
+ * LogParquet::row_group_size of them, or when the file gets closed for
+ * rotation or at shutdown. String, enum, and address columns are
+ * dictionary-encoded.
+ */
+class Parquet : public WriterBackend {
+public:
+	explicit Parquet(WriterFrontend* frontend);
+	~Parquet() override;
+
+	static std::string LogExt()	{ return "parquet"; }
+
+	static WriterBackend* Instantiate(WriterFrontend* frontend)
+		{ return new Parquet(frontend); }
+
+protected:
+	bool DoInit(const WriterInfo& info, int num_fields,
+			    const threading::Field* const* fields) override;
+	bool DoWrite(int num_fields, const threading::Field* const* fields,
+			     threading::Value** vals) override;
+	bool DoSetBuf(bool enabled) override	{ return true; }
+	bool DoRotate(const char* rotated_path, double open,
+			      double close, bool terminating) override;
+	bool DoFlush(double network_time) override;
+	bool DoFinish(double network_time) override;
+	bool DoHeartbeat(double network_time, double current_time) override	{ return true; }
+
+private:
+	bool InitFilterOptions();
+	bool OpenFile();
+	bool CloseFile();
+	bool WriteRowGroup();
+	bool CheckStatus(const ::arrow::Status& s, const char* what);
+
+	// Returns the Arrow type for a field, or null if unsupported.
+	std::shared_ptr<::arrow::DataType> ColumnType(zeek::TypeTag type, zeek::TypeTag subtype);
+
+	::arrow::Status AppendValue(::arrow::ArrayBuilder* builder, const threading::Value* val);
+
+	std::string fname;
+	std::shared_ptr<::arrow::Schema> schema;
+	std::vector<std::unique_ptr<::arrow::ArrayBuilder>> builders;
+	std::shared_ptr<::arrow::io::FileOutputStream> file;
+	std::unique_ptr<::parquet::arrow::FileWriter> writer;
+	int64_t buffered_rows;
+
+	// Options, which filters can override through their config table.
+	uint64_t row_group_size;
+	std::string compression;
+	bool dictionary_encoding;
+};
+
+}
+}
@@ -0,0 +1,24 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "plugin/Plugin.h"
+
+#include "Parquet.h"
+
+namespace plugin {
+namespace Zeek_ParquetWriter {
+
+class Plugin : public zeek::plugin::Plugin {
+public:
+	zeek::plugin::Configuration Configure() override
+		{
+		AddComponent(new ::logging::Component("Parquet", ::logging::writer::Parquet::Instantiate));
+
+		zeek::plugin::Configuration config;
+		config.name = "Zeek::ParquetWriter";
+		config.description = "Apache Parquet log writer";
+		return config;
+		}
+} plugin;
+
+}
+}
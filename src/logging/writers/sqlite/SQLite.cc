@@ -2,8 +2,11 @@
 
 #include "zeek-config.h"
 
+#include <algorithm>
 #include <string>
 #include <errno.h>
+#include <strings.h>
+#include <unistd.h>
 #include <vector>
 
 #include "threading/SerialTypes.h"
@@ -19,7 +22,7 @@ using threading::Field;
 
 SQLite::SQLite(WriterFrontend* frontend)
 	: WriterBackend(frontend),
-	  fields(), num_fields(), db(), st()
+	  fields(), num_fields(), db(), st(), multi_st()
 	{
 	set_separator.assign(
 			(const char*) zeek::BifConst::LogSQLite::set_separator->Bytes(),
@@ -36,6 +39,18 @@ SQLite::SQLite(WriterFrontend* frontend)
 			zeek::BifConst::LogSQLite::empty_field->Len()
 			);
 
+	journal_mode.assign(
+			(const char*) zeek::BifConst::LogSQLite::journal_mode->Bytes(),
+			zeek::BifConst::LogSQLite::journal_mode->Len()
+			);
+
+	synchronous.assign(
+			(const char*) zeek::BifConst::LogSQLite::synchronous->Bytes(),
+			zeek::BifConst::LogSQLite::synchronous->Len()
+			);
+
+	rows_per_insert = zeek::BifConst::LogSQLite::rows_per_insert;
+
 	threading::formatter::Ascii::SeparatorInfo sep_info(string(), set_separator, unset_field, empty_field);
 	io = new threading::formatter::Ascii(this, sep_info);
 	}
@@ -45,6 +60,7 @@ SQLite::~SQLite()
 	if ( db != 0 )
 		{
 		sqlite3_finalize(st);
+		sqlite3_finalize(multi_st);
 		if ( ! sqlite3_close(db) )
 			Error("Sqlite could not close connection");
 
@@ -112,6 +128,97 @@ bool SQLite::checkError(int code)
 	return false;
 	}
 
+// The pragma values we accept, as they end up in the statement verbatim.
+static const char* journal_modes[] = { "DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF" };
+static const char* synchronous_modes[] = { "OFF", "NORMAL", "FULL", "EXTRA" };
+
+template <size_t N>
+static bool valid_pragma_value(const string& value, const char* (&values)[N])
+	{
+	for ( const char* v : values )
+		{
+		if ( strcasecmp(value.c_str(), v) == 0 )
+			return true;
+		}
+
+	return false;
+	}
+
+bool SQLite::InitFilterOptions(const WriterInfo& info)
+	{
+	for ( WriterInfo::config_map::const_iterator i = info.config.begin();
+	      i != info.config.end(); ++i )
+		{
+		if ( strcmp(i->first, "journal_mode") == 0 )
+			journal_mode = i->second;
+
+		else if ( strcmp(i->first, "synchronous") == 0 )
+			synchronous = i->second;
+
+		else if ( strcmp(i->first, "rows_per_insert") == 0 )
+			rows_per_insert = strtoul(i->second, nullptr, 10);
+		}
+
+	if ( ! journal_mode.empty() && ! valid_pragma_value(journal_mode, journal_modes) )
+		{
+		Error(Fmt("invalid SQLite journal mode '%s'", journal_mode.c_str()));
+		return false;
+		}
+
+	if ( ! synchronous.empty() && ! valid_pragma_value(synchronous, synchronous_modes) )
+		{
+		Error(Fmt("invalid SQLite synchronous setting '%s'", synchronous.c_str()));
+		return false;
+		}
+
+	if ( rows_per_insert == 0 )
+		{
+		Error("invalid value for 'rows_per_insert', must be a positive number");
+		return false;
+		}
+
+	return true;
+	}
+
+bool SQLite::Exec(const string& statement)
+	{
+	char *errorMsg = 0;
+	int res = sqlite3_exec(db, statement.c_str(), NULL, NULL, &errorMsg);
+	if ( res != SQLITE_OK )
+		{
+		Error(Fmt("Error executing '%s': %s", statement.c_str(), errorMsg));
+		sqlite3_free(errorMsg);
+		return false;
+		}
+
+	return true;
+	}
+
+bool SQLite::BeginTransaction()
+	{
+	// Writers for other logs may share the database file. With the shared
+	// cache, only one of them can have a write transaction open at a time
+	// and SQLite doesn't wait for it by itself, so we retry for a while.
+	const int max_retries = 10000;
+
+	for ( int i = 0; ; ++i )
+		{
+		int res = sqlite3_exec(db, "BEGIN IMMEDIATE", NULL, NULL, NULL);
+		if ( res == SQLITE_OK )
+			return true;
+
+		res &= 0xff;
+
+		if ( (res != SQLITE_LOCKED && res != SQLITE_BUSY) || i == max_retries )
+			{
+			Error(Fmt("SQLite could not begin transaction: %s", sqlite3_errmsg(db)));
+			return false;
+			}
+
+		usleep(1000);
+		}
+	}
+
 bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 			    const Field* const * arg_fields)
 	{
@@ -141,6 +248,9 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 	else
 		tablename = it->second;
 
+	if ( ! InitFilterOptions(info) )
+		return false;
+
 	if ( checkError(sqlite3_open_v2(
 					fullpath.c_str(),
 					&db,
@@ -151,6 +261,15 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 					NULL)) )
 		return false;
 
+	// Wait for other processes writing to the same file.
+	sqlite3_busy_timeout(db, 10000);
+
+	if ( ! journal_mode.empty() && ! Exec("PRAGMA journal_mode = " + journal_mode) )
+		return false;
+
+	if ( ! synchronous.empty() && ! Exec("PRAGMA synchronous = " + synchronous) )
+		return false;
+
 	string create = "CREATE TABLE IF NOT EXISTS " + tablename + " (\n";
 		//"id SERIAL UNIQUE NOT NULL"; // SQLite has rowids, we do not need a counter here.
 
@@ -197,17 +316,13 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 		return false;
 		}
 
-	// create the prepared statement that will be re-used forever...
-	string insert = "VALUES (";
+	// create the prepared statements that will be re-used forever...
+	string insert = "(";
 	string names = "INSERT INTO " + tablename + " ( ";
 
 	for ( unsigned int i = 0; i < num_fields; i++ )
 		{
-		bool ac = true;
-
-		if ( i == 0 )
-			ac = false;
-		else
+		if ( i != 0 )
 			{
 			names += ", ";
 			insert += ", ";
@@ -226,52 +341,69 @@ bool SQLite::DoInit(const WriterInfo& info, int arg_num_fields,
 		sqlite3_free(fieldname);
 		}
 
-	insert += ");";
-	names += ") ";
+	insert += ")";
+	names += ") VALUES ";
 
-	insert = names + insert;
+	string single = names + insert + ";";
 
-	if ( checkError(sqlite3_prepare_v2(db, insert.c_str(), insert.size()+1, &st, NULL)) )
+	if ( checkError(sqlite3_prepare_v2(db, single.c_str(), single.size()+1, &st, NULL)) )
 		return false;
 
+	// Stay within the number of parameters SQLite allows per statement.
+	unsigned int max_rows = sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / std::max(num_fields, 1u);
+	rows_per_insert = std::max(std::min(rows_per_insert, max_rows), 1u);
+
+	if ( rows_per_insert > 1 )
+		{
+		string multi = names + insert;
+
+		for ( unsigned int i = 1; i < rows_per_insert; i++ )
+			multi += ", " + insert;
+
+		multi += ";";
+
+		if ( checkError(sqlite3_prepare_v2(db, multi.c_str(), multi.size()+1, &multi_st, NULL)) )
+			return false;
+		}
+
 	return true;
 	}
 
-int SQLite::AddParams(Value* val, int pos)
+int SQLite::AddParams(sqlite3_stmt* stmt, Value* val, int pos, int field)
 	{
 	if ( ! val->present )
-		return sqlite3_bind_null(st, pos);
+		return sqlite3_bind_null(stmt, pos);
 
 	switch ( val->type ) {
 	case zeek::TYPE_BOOL:
-		return sqlite3_bind_int(st, pos, val->val.int_val != 0 ? 1 : 0 );
+		return sqlite3_bind_int(stmt, pos, val->val.int_val != 0 ? 1 : 0 );
 
 	case zeek::TYPE_INT:
-		return sqlite3_bind_int(st, pos, val->val.int_val);
+		return sqlite3_bind_int(stmt, pos, val->val.int_val);
 
 	case zeek::TYPE_COUNT:
 	case zeek::TYPE_COUNTER:
-		return sqlite3_bind_int(st, pos, val->val.uint_val);
+		return sqlite3_bind_int(stmt, pos, val->val.uint_val);
 
 	case zeek::TYPE_PORT:
-		return sqlite3_bind_int(st, pos, val->val.port_val.port);
+		return sqlite3_bind_int(stmt, pos, val->val.port_val.port);
 
 	case zeek::TYPE_SUBNET:
 		{
 		string out = io->Render(val->val.subnet_val);
-		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_TRANSIENT);
+		return sqlite3_bind_text(stmt, pos, out.data(), out.size(), SQLITE_TRANSIENT);
 		}
 
 	case zeek::TYPE_ADDR:
 		{
 		string out = io->Render(val->val.addr_val);
-		return sqlite3_bind_text(st, pos, out.data(), out.size(), SQLITE_TRANSIENT);
+		return sqlite3_bind_text(stmt, pos, out.data(), out.size(), SQLITE_TRANSIENT);
 		}
 
 	case zeek::TYPE_TIME:
 	case zeek::TYPE_INTERVAL:
 	case zeek::TYPE_DOUBLE:
-		return sqlite3_bind_double(st, pos, val->val.double_val);
+		return sqlite3_bind_double(stmt, pos, val->val.double_val);
 
 	case zeek::TYPE_ENUM:
 	case zeek::TYPE_STRING:
@@ -279,9 +411,9 @@ int SQLite::AddParams(Value* val, int pos)
 	case zeek::TYPE_FUNC:
 		{
 		if ( ! val->val.string_val.length || val->val.string_val.length == 0 )
-			return sqlite3_bind_null(st, pos);
+			return sqlite3_bind_null(stmt, pos);
 
-		return sqlite3_bind_text(st, pos, val->val.string_val.data, val->val.string_val.length, SQLITE_TRANSIENT);
+		return sqlite3_bind_text(stmt, pos, val->val.string_val.data, val->val.string_val.length, SQLITE_TRANSIENT);
 		}
 
 	case zeek::TYPE_TABLE:
@@ -299,11 +431,11 @@ int SQLite::AddParams(Value* val, int pos)
 				if ( j > 0 )
 					desc.AddRaw(set_separator);
 
-				io->Describe(&desc, val->val.set_val.vals[j], fields[pos-1]->name);
+				io->Describe(&desc, val->val.set_val.vals[j], fields[field]->name);
 				}
 
 		desc.RemoveEscapeSequence(set_separator);
-		return sqlite3_bind_text(st, pos, (const char*) desc.Bytes(), desc.Len(), SQLITE_TRANSIENT);
+		return sqlite3_bind_text(stmt, pos, (const char*) desc.Bytes(), desc.Len(), SQLITE_TRANSIENT);
 		}
 
 	case zeek::TYPE_VECTOR:
@@ -321,11 +453,11 @@ int SQLite::AddParams(Value* val, int pos)
 				if ( j > 0 )
 					desc.AddRaw(set_separator);
 
-				io->Describe(&desc, val->val.vector_val.vals[j], fields[pos-1]->name);
+				io->Describe(&desc, val->val.vector_val.vals[j], fields[field]->name);
 				}
 
 		desc.RemoveEscapeSequence(set_separator);
-		return sqlite3_bind_text(st, pos, (const char*) desc.Bytes(), desc.Len(), SQLITE_TRANSIENT);
+		return sqlite3_bind_text(stmt, pos, (const char*) desc.Bytes(), desc.Len(), SQLITE_TRANSIENT);
 		}
 
 	default:
@@ -334,29 +466,67 @@ int SQLite::AddParams(Value* val, int pos)
 	}
 	}
 
-bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
+bool SQLite::Insert(sqlite3_stmt* stmt, int num_rows, Value*** rows)
 	{
 	// bind parameters
-	for ( int i = 0; i < num_fields; i++ )
+	int pos = 1;
+
+	for ( int j = 0; j < num_rows; j++ )
 		{
-		if ( checkError(AddParams(vals[i], i+1)) )
-			return false;
+		for ( unsigned int i = 0; i < num_fields; i++ )
+			{
+			if ( checkError(AddParams(stmt, rows[j][i], pos++, i)) )
+				return false;
+			}
 		}
 
 	// execute query
-	if ( checkError(sqlite3_step(st)) )
+	if ( checkError(sqlite3_step(stmt)) )
 		return false;
 
 	// clean up and make ready for next query execution
-	if ( checkError(sqlite3_clear_bindings(st)) )
+	if ( checkError(sqlite3_clear_bindings(stmt)) )
 		return false;
 
-	if ( checkError(sqlite3_reset(st)) )
+	if ( checkError(sqlite3_reset(stmt)) )
 		return false;
 
 	return true;
 	}
 
+bool SQLite::DoWrite(int num_fields, const Field* const * fields, Value** vals)
+	{
+	return Insert(st, 1, &vals);
+	}
+
+bool SQLite::DoWriteBatch(int num_fields, const Field* const * fields,
+                          int num_writes, Value*** vals)
+	{
+	// Committing once per batch rather than once per row saves a sync
+	// of the database file for every single row.
+	if ( ! BeginTransaction() )
+		return false;
+
+	bool success = true;
+	int j = 0;
+
+	if ( multi_st )
+		{
+		for ( ; success && num_writes - j >= (int)rows_per_insert; j += rows_per_insert )
+			success = Insert(multi_st, rows_per_insert, vals + j);
+		}
+
+	for ( ; success && j < num_writes; j++ )
+		success = Insert(st, 1, vals + j);
+
+	// Keep the rows written before an error, as when writing row by row.
+	// SQLite may have rolled back the transaction already, though.
+	if ( ! sqlite3_get_autocommit(db) && ! Exec("COMMIT") )
+		return false;
+
+	return success;
+	}
+
 bool SQLite::DoRotate(const char* rotated_path, double open, double close, bool terminating)
 	{
 	if ( ! FinishedRotation("/dev/null", Info().path, open, close, terminating))
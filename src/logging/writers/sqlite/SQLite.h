@@ -26,6 +26,8 @@ protected:
 			    const threading::Field* const* arg_fields) override;
 	bool DoWrite(int num_fields, const threading::Field* const* fields,
 			     threading::Value** vals) override;
+	bool DoWriteBatch(int num_fields, const threading::Field* const* fields,
+			  int num_writes, threading::Value*** vals) override;
 	bool DoSetBuf(bool enabled) override { return true; }
 	bool DoRotate(const char* rotated_path, double open,
 			      double close, bool terminating) override;
@@ -35,8 +37,12 @@ protected:
 
 private:
 	bool checkError(int code);
+	bool InitFilterOptions(const WriterInfo& info);
+	bool Exec(const std::string& statement);
+	bool BeginTransaction();
 
-	int AddParams(threading::Value* val, int pos);
+	int AddParams(sqlite3_stmt* stmt, threading::Value* val, int pos, int field);
+	bool Insert(sqlite3_stmt* stmt, int num_rows, threading::Value*** rows);
 	std::string GetTableType(int, int);
 
 	const threading::Field* const * fields; // raw mapping
@@ -44,11 +50,17 @@ private:
 
 	sqlite3 *db;
 	sqlite3_stmt *st;
+	sqlite3_stmt *multi_st; // inserts rows_per_insert rows at once, if more than one
 
 	std::string set_separator;
 	std::string unset_field;
 	std::string empty_field;
 
+	// Options, which filters can override through their config table.
+	std::string journal_mode;
+	std::string synchronous;
+	unsigned int rows_per_insert;
+
 	threading::formatter::Ascii* io;
 };
 
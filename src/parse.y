@@ -28,6 +28,7 @@
 %token TOK_ATTR_BROKER_STORE_ALLOW_COMPLEX TOK_ATTR_BACKEND
 %token TOK_ATTR_PRIORITY TOK_ATTR_LOG TOK_ATTR_ERROR_HANDLER
 %token TOK_ATTR_TYPE_COLUMN TOK_ATTR_DEPRECATED
+%token TOK_ATTR_IF_FIELD TOK_ATTR_IF_PORT TOK_ATTR_IF_ANALYZER
 
 %token TOK_DEBUG
 
@@ -1390,6 +1391,12 @@ attr:
 			{ $$ = new zeek::detail::Attr(zeek::detail::ATTR_LOG); }
 	|	TOK_ATTR_ERROR_HANDLER
 			{ $$ = new zeek::detail::Attr(zeek::detail::ATTR_ERROR_HANDLER); }
+	|	TOK_ATTR_IF_FIELD '=' expr
+			{ $$ = new zeek::detail::Attr(zeek::detail::ATTR_IF_FIELD, {zeek::AdoptRef{}, $3}); }
+	|	TOK_ATTR_IF_PORT '=' expr
+			{ $$ = new zeek::detail::Attr(zeek::detail::ATTR_IF_PORT, {zeek::AdoptRef{}, $3}); }
+	|	TOK_ATTR_IF_ANALYZER '=' expr
+			{ $$ = new zeek::detail::Attr(zeek::detail::ATTR_IF_ANALYZER, {zeek::AdoptRef{}, $3}); }
 	|	TOK_ATTR_DEPRECATED
 			{ $$ = new zeek::detail::Attr(zeek::detail::ATTR_DEPRECATED); }
 	|	TOK_ATTR_DEPRECATED '=' TOK_CONSTANT
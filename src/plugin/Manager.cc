@@ -533,7 +533,10 @@ std::list<std::pair<zeek::plugin::HookType, int> > Manager::HooksEnabledForPlugi
 void Manager::EnableHook(zeek::plugin::HookType hook, Plugin* plugin, int prio)
 	{
 	if ( ! hooks[hook] )
+		{
 		hooks[hook] = new hook_list;
+		enabled_hooks |= uint64_t(1) << hook;
+		}
 
 	hook_list* l = hooks[hook];
 
@@ -568,6 +571,7 @@ void Manager::DisableHook(zeek::plugin::HookType hook, Plugin* plugin)
 		{
 		delete l;
 		hooks[hook] = nullptr;
+		enabled_hooks &= ~(uint64_t(1) << hook);
 		}
 	}
 
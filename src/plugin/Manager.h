@@ -167,8 +167,10 @@ public:
 	 */
 	bool HavePluginForHook(zeek::plugin::HookType hook) const
 		{
-		// Inline to avoid the function call.
-		return hooks[hook] != nullptr;
+		// Inline to avoid the function call. This runs on every
+		// function call and event, so it tests a bit rather than
+		// going through the hook lists.
+		return enabled_hooks & (uint64_t(1) << hook);
 		}
 
 	/**
@@ -437,6 +439,11 @@ private:
 	// of that type enabled.
 	hook_list** hooks;
 
+	// Has the bit of each HookType set that has a non-null entry in
+	// hooks.
+	uint64_t enabled_hooks = 0;
+	static_assert(NUM_HOOKS <= 64, "hook types don't fit into enabled_hooks");
+
 	// A map of all the top-level plugin directories.
 	std::map<std::string, Plugin*> plugins_by_path;
 
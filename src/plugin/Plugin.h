@@ -790,7 +790,8 @@ protected:
 	 * @param fields threading::Field description of the fields being logged.
 	 *
 	 * @param vals threading::Values containing the values being written. Values
-	 *             can be modified in the Hook.
+	 *             can be modified in the Hook, but not deleted or replaced,
+	 *             as they live in the writer's threading::ValueArena.
 	 *
 	 * @return true if log line should be written, false if log line should be
 	 *         skipped and not passed on to the writer.
@@ -2,6 +2,10 @@
 
 #include "BloomFilter.h"
 
+#include <openssl/sha.h>
+#include <string.h>
+
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
@@ -10,6 +14,7 @@
 
 #include "CounterVector.h"
 
+#include "../digest.h"
 #include "../util.h"
 #include "../Reporter.h"
 
@@ -70,6 +75,10 @@ std::unique_ptr<BloomFilter> BloomFilter::Unserialize(const broker::data& data)
 	case Counting:
 		bf = std::unique_ptr<BloomFilter>(new CountingBloomFilter());
 		break;
+
+	case Blocked:
+		bf = std::unique_ptr<BloomFilter>(new BlockedBloomFilter());
+		break;
 	}
 
 	if ( ! bf->DoUnserialize((*v)[2]) )
@@ -193,6 +202,165 @@ bool BasicBloomFilter::DoUnserialize(const broker::data& data)
 	return true;
 	}
 
+BlockedBloomFilter::BlockedBloomFilter()
+	{
+	}
+
+BlockedBloomFilter::BlockedBloomFilter(const Hasher* hasher, size_t cells)
+	: BloomFilter(hasher)
+	{
+	size_t n = std::max((cells + bits_per_block - 1) / bits_per_block, size_t(1));
+	blocks.resize(n, Block{});
+	}
+
+BlockedBloomFilter::~BlockedBloomFilter()
+	{
+	}
+
+bool BlockedBloomFilter::Empty() const
+	{
+	for ( const auto& b : blocks )
+		for ( size_t i = 0; i < words_per_block; ++i )
+			if ( b.words[i] )
+				return false;
+
+	return true;
+	}
+
+void BlockedBloomFilter::Clear()
+	{
+	std::fill(blocks.begin(), blocks.end(), Block{});
+	}
+
+bool BlockedBloomFilter::Merge(const BloomFilter* other)
+	{
+	if ( typeid(*this) != typeid(*other) )
+		return false;
+
+	const BlockedBloomFilter* o = static_cast<const BlockedBloomFilter*>(other);
+
+	if ( ! hasher->Equals(o->hasher) )
+		{
+		reporter->Error("incompatible hashers in BlockedBloomFilter merge");
+		return false;
+		}
+
+	else if ( blocks.size() != o->blocks.size() )
+		{
+		reporter->Error("different number of blocks in BlockedBloomFilter merge");
+		return false;
+		}
+
+	for ( size_t i = 0; i < blocks.size(); ++i )
+		for ( size_t j = 0; j < words_per_block; ++j )
+			blocks[i].words[j] |= o->blocks[i].words[j];
+
+	return true;
+	}
+
+BlockedBloomFilter* BlockedBloomFilter::Clone() const
+	{
+	BlockedBloomFilter* copy = new BlockedBloomFilter();
+
+	copy->hasher = hasher->Clone();
+	copy->blocks = blocks;
+
+	return copy;
+	}
+
+std::string BlockedBloomFilter::InternalState() const
+	{
+	u_char buf[SHA256_DIGEST_LENGTH];
+	uint64_t digest;
+	EVP_MD_CTX* ctx = hash_init(Hash_SHA256);
+
+	for ( const auto& b : blocks )
+		hash_update(ctx, b.words, sizeof(b.words));
+
+	hash_final(ctx, buf);
+	memcpy(&digest, buf, sizeof(digest));
+	return fmt("%" PRIu64, digest);
+	}
+
+size_t BlockedBloomFilter::Locate(const HashKey* key, Block* mask) const
+	{
+	Hasher::digest_vector h = hasher->Hash(key);
+
+	*mask = Block{};
+
+	// The block comes from the low-order bits of the first hash value
+	// (via the modulo), the bit positions from the high-order ones.
+	for ( size_t i = 0; i < h.size(); ++i )
+		{
+		auto bit = h[i] >> 55;
+		mask->words[bit / 64] |= uint64_t(1) << (bit % 64);
+		}
+
+	return h[0] % blocks.size();
+	}
+
+void BlockedBloomFilter::Add(const HashKey* key)
+	{
+	Block mask;
+	auto& b = blocks[Locate(key, &mask)];
+
+	for ( size_t i = 0; i < words_per_block; ++i )
+		b.words[i] |= mask.words[i];
+	}
+
+size_t BlockedBloomFilter::Count(const HashKey* key) const
+	{
+	Block mask;
+	const auto& b = blocks[Locate(key, &mask)];
+
+	// Checks all words without branching, so that the compiler can
+	// vectorize the probe.
+	uint64_t missing = 0;
+
+	for ( size_t i = 0; i < words_per_block; ++i )
+		missing |= mask.words[i] & ~b.words[i];
+
+	return missing ? 0 : 1;
+	}
+
+broker::expected<broker::data> BlockedBloomFilter::DoSerialize() const
+	{
+	broker::vector v = {static_cast<uint64_t>(blocks.size())};
+	v.reserve(1 + blocks.size() * words_per_block);
+
+	for ( const auto& b : blocks )
+		for ( size_t i = 0; i < words_per_block; ++i )
+			v.emplace_back(static_cast<uint64_t>(b.words[i]));
+
+	return {std::move(v)};
+	}
+
+bool BlockedBloomFilter::DoUnserialize(const broker::data& data)
+	{
+	auto v = caf::get_if<broker::vector>(&data);
+	if ( ! (v && v->size() >= 1) )
+		return false;
+
+	auto size = caf::get_if<uint64_t>(&(*v)[0]);
+
+	if ( ! size || *size == 0 || v->size() != 1 + *size * words_per_block )
+		return false;
+
+	blocks.resize(*size);
+
+	for ( size_t i = 0; i < *size; ++i )
+		for ( size_t j = 0; j < words_per_block; ++j )
+			{
+			auto x = caf::get_if<uint64_t>(&(*v)[1 + i * words_per_block + j]);
+			if ( ! x )
+				return false;
+
+			blocks[i].words[j] = *x;
+			}
+
+	return true;
+	}
+
 CountingBloomFilter::CountingBloomFilter()
 	{
 	cells = nullptr;
@@ -18,7 +18,7 @@ namespace probabilistic {
 class CounterVector;
 
 /** Types of derived BloomFilter classes. */
-enum BloomFilterType { Basic, Counting };
+enum BloomFilterType { Basic, Counting, Blocked };
 
 /**
  * The abstract base class for Bloom filters.
@@ -179,6 +179,69 @@ private:
 	BitVector* bits;
 };
 
+/**
+ * A blocked Bloom filter. All bits of an element fall into a single block
+ * the size of a cache line, so that adding and looking up an element
+ * touches only one cache line regardless of the number of hash functions.
+ * In return, the false-positive rate is a bit higher than the one of a
+ * basic Bloom filter with the same number of cells.
+ */
+class BlockedBloomFilter : public BloomFilter {
+public:
+	/**
+	 * Constructs a blocked Bloom filter.
+	 *
+	 * @param hasher The hasher to use. The first hash value selects the
+	 * block, all of them select the bits within it.
+	 *
+	 * @param cells The number of cells, which gets rounded up to a multiple
+	 * of the block size.
+	 */
+	BlockedBloomFilter(const Hasher* hasher, size_t cells);
+
+	/**
+	 * Destructor.
+	 */
+	~BlockedBloomFilter() override;
+
+	// Overridden from BloomFilter.
+	bool Empty() const override;
+	void Clear() override;
+	bool Merge(const BloomFilter* other) override;
+	BlockedBloomFilter* Clone() const override;
+	std::string InternalState() const override;
+
+protected:
+	friend class BloomFilter;
+
+	/**
+	 * Default constructor.
+	 */
+	BlockedBloomFilter();
+
+	// Overridden from BloomFilter.
+	void Add(const HashKey* key) override;
+	size_t Count(const HashKey* key) const override;
+	broker::expected<broker::data> DoSerialize() const override;
+	bool DoUnserialize(const broker::data& data) override;
+	BloomFilterType Type() const override
+		{ return BloomFilterType::Blocked; }
+
+private:
+	static constexpr size_t words_per_block = 8;
+	static constexpr size_t bits_per_block = words_per_block * 64;
+
+	struct alignas(64) Block {
+		uint64_t words[words_per_block];
+	};
+
+	// Returns the index of the block that a key goes into, and fills
+	// *mask* with the bits that it sets in there.
+	size_t Locate(const HashKey* key, Block* mask) const;
+
+	std::vector<Block> blocks;
+};
+
 /**
  * A counting Bloom filter.
  */
@@ -4,6 +4,8 @@
 
 #include <math.h>
 #include <stdint.h>
+
+#include <algorithm>
 #include <utility>
 
 #include <broker/data.hh>
@@ -153,7 +155,7 @@ double CardinalityCounter::Size() const
 	{
 	double answer = 0;
 	for ( unsigned int i = 0; i < m; i++ )
-		answer += pow(2, -((int)buckets[i]));
+		answer += ldexp(1.0, -((int)buckets[i]));
 
 	answer = 1 / answer;
 	answer = (alpha_m * m * m * answer);
@@ -173,18 +175,15 @@ bool CardinalityCounter::Merge(CardinalityCounter* c)
 	if ( m != c->GetM() )
 		return false;
 
-	const std::vector<uint8_t>& temp = c->GetBuckets();
-
-	V = 0;
+	const uint8_t* other = c->GetBuckets().data();
+	uint8_t* own = buckets.data();
 
-	for ( unsigned int i = 0; i < m; i++ )
-		{
-		if ( temp[i] > buckets[i] )
-			buckets[i] = temp[i];
+	// Keep the loops free of branches, so that the compiler can turn
+	// them into vectorized max and compare operations.
+	for ( uint64_t i = 0; i < m; i++ )
+		own[i] = std::max(own[i], other[i]);
 
-		if ( buckets[i] == 0 )
-			++V;
-		}
+	V = std::count(buckets.begin(), buckets.end(), 0);
 
 	return true;
 	}
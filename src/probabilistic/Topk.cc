@@ -7,16 +7,9 @@
 #include "broker/Data.h"
 #include "CompHash.h"
 #include "Reporter.h"
-#include "Dict.h"
 
 namespace probabilistic {
 
-static void topk_element_hash_delete_func(void* val)
-	{
-	Element* e = (Element*) val;
-	delete e;
-	}
-
 void TopkVal::Typify(zeek::TypePtr t)
 	{
 	assert(!hash && !type);
@@ -35,37 +28,158 @@ HashKey* TopkVal::GetHash(Val* v) const
 
 TopkVal::TopkVal(uint64_t arg_size) : OpaqueVal(topk_type)
 	{
-	elementDict = new zeek::PDict<Element>;
-	elementDict->SetDeleteFunc(topk_element_hash_delete_func);
 	size = arg_size;
 	numElements = 0;
 	pruned = false;
 	hash = nullptr;
+	free_elements = free_buckets = TOPK_NONE;
+	min_bucket = max_bucket = TOPK_NONE;
 	}
 
 TopkVal::TopkVal() : OpaqueVal(topk_type)
 	{
-	elementDict = new zeek::PDict<Element>;
-	elementDict->SetDeleteFunc(topk_element_hash_delete_func);
 	size = 0;
 	numElements = 0;
 	hash = nullptr;
+	free_elements = free_buckets = TOPK_NONE;
+	min_bucket = max_bucket = TOPK_NONE;
 	}
 
 TopkVal::~TopkVal()
 	{
-	elementDict->Clear();
-	delete elementDict;
+	delete hash;
+	}
+
+uint32_t TopkVal::Find(const HashKey* key) const
+	{
+	auto it = elementMap.find(KeyRef{key});
+	return it == elementMap.end() ? TOPK_NONE : it->second;
+	}
+
+uint32_t TopkVal::NewElement(zeek::ValPtr value, std::unique_ptr<HashKey> key)
+	{
+	uint32_t e = free_elements;
 
-	// now all elements are already gone - delete the buckets
-	std::list<Bucket*>::iterator bi = buckets.begin();
-	while ( bi != buckets.end() )
+	if ( e != TOPK_NONE )
+		free_elements = elements[e].next;
+	else
 		{
-		delete *bi;
-		bi++;
+		e = elements.size();
+		elements.emplace_back();
 		}
 
-	delete hash;
+	Element& elem = elements[e];
+	elem.epsilon = 0;
+	elem.value = std::move(value);
+	elem.key = std::move(key);
+	elem.bucket = TOPK_NONE;
+	elem.prev = elem.next = TOPK_NONE;
+
+	elementMap.insert_or_assign(KeyRef{elem.key.get()}, e);
+	numElements++;
+	return e;
+	}
+
+void TopkVal::FreeElement(uint32_t e)
+	{
+	Element& elem = elements[e];
+	elementMap.erase(KeyRef{elem.key.get()});
+	elem.value = nullptr;
+	elem.key.reset();
+	elem.next = free_elements;
+	free_elements = e;
+	numElements--;
+	}
+
+void TopkVal::AppendElement(uint32_t b, uint32_t e)
+	{
+	Bucket& bucket = buckets[b];
+	Element& elem = elements[e];
+
+	elem.bucket = b;
+	elem.prev = bucket.last;
+	elem.next = TOPK_NONE;
+
+	if ( bucket.last != TOPK_NONE )
+		elements[bucket.last].next = e;
+	else
+		bucket.first = e;
+
+	bucket.last = e;
+	bucket.num_elements++;
+	}
+
+void TopkVal::UnlinkElement(uint32_t e)
+	{
+	Element& elem = elements[e];
+	Bucket& bucket = buckets[elem.bucket];
+
+	if ( elem.prev != TOPK_NONE )
+		elements[elem.prev].next = elem.next;
+	else
+		bucket.first = elem.next;
+
+	if ( elem.next != TOPK_NONE )
+		elements[elem.next].prev = elem.prev;
+	else
+		bucket.last = elem.prev;
+
+	bucket.num_elements--;
+	elem.bucket = elem.prev = elem.next = TOPK_NONE;
+	}
+
+// Inserts a new bucket in front of the given one, or at the end.
+uint32_t TopkVal::NewBucket(uint64_t count, uint32_t next)
+	{
+	uint32_t b = free_buckets;
+
+	if ( b != TOPK_NONE )
+		free_buckets = buckets[b].next;
+	else
+		{
+		b = buckets.size();
+		buckets.emplace_back();
+		}
+
+	uint32_t prev = next != TOPK_NONE ? buckets[next].prev : max_bucket;
+
+	Bucket& bucket = buckets[b];
+	bucket.count = count;
+	bucket.num_elements = 0;
+	bucket.first = bucket.last = TOPK_NONE;
+	bucket.prev = prev;
+	bucket.next = next;
+
+	if ( prev != TOPK_NONE )
+		buckets[prev].next = b;
+	else
+		min_bucket = b;
+
+	if ( next != TOPK_NONE )
+		buckets[next].prev = b;
+	else
+		max_bucket = b;
+
+	return b;
+	}
+
+void TopkVal::FreeBucket(uint32_t b)
+	{
+	Bucket& bucket = buckets[b];
+	assert(bucket.num_elements == 0);
+
+	if ( bucket.prev != TOPK_NONE )
+		buckets[bucket.prev].next = bucket.next;
+	else
+		min_bucket = bucket.next;
+
+	if ( bucket.next != TOPK_NONE )
+		buckets[bucket.next].prev = bucket.prev;
+	else
+		max_bucket = bucket.prev;
+
+	bucket.next = free_buckets;
+	free_buckets = b;
 	}
 
 void TopkVal::Merge(const TopkVal* value, bool doPrune)
@@ -92,54 +206,36 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 			}
 		}
 
-	std::list<Bucket*>::const_iterator it = value->buckets.begin();
-	while ( it != value->buckets.end() )
+	for ( uint32_t b = value->min_bucket; b != TOPK_NONE; b = value->buckets[b].next )
 		{
-		Bucket* b = *it;
-		uint64_t currcount = b->count;
-		std::list<Element*>::const_iterator eit = b->elements.begin();
+		uint64_t currcount = value->buckets[b].count;
 
-		while ( eit != b->elements.end() )
+		for ( uint32_t e = value->buckets[b].first; e != TOPK_NONE; e = value->elements[e].next )
 			{
-			Element* e = *eit;
+			const zeek::ValPtr& val = value->elements[e].value;
+
 			// lookup if we already know this one...
-			HashKey* key = GetHash(e->value);
-			Element* olde = (Element*) elementDict->Lookup(key);
+			std::unique_ptr<HashKey> key(GetHash(val));
+			uint32_t olde = Find(key.get());
 
-			if ( olde == nullptr )
+			if ( olde == TOPK_NONE )
 				{
-				olde = new Element();
-				olde->epsilon = 0;
-				olde->value = e->value;
 				// insert at bucket position 0
-				if ( buckets.size() > 0 )
+				if ( min_bucket != TOPK_NONE )
 					{
-					assert (buckets.front()-> count > 0 );
+					assert(buckets[min_bucket].count > 0);
 					}
 
-				Bucket* newbucket = new Bucket();
-				newbucket->count = 0;
-				newbucket->bucketPos = buckets.insert(buckets.begin(), newbucket);
-
-				olde->parent = newbucket;
-				newbucket->elements.insert(newbucket->elements.end(), olde);
-
-				elementDict->Insert(key, olde);
-				numElements++;
-
+				olde = NewElement(val, std::move(key));
+				AppendElement(NewBucket(0, min_bucket), olde);
 				}
 
 			// now that we are sure that the old element is present - increment epsilon
-			olde->epsilon += e->epsilon;
+			elements[olde].epsilon += value->elements[e].epsilon;
 
 			// and increment position...
 			IncrementCounter(olde, currcount);
-			delete key;
-
-			eit++;
 			}
-
-		it++;
 		}
 
 	// now we have added everything. And our top-k table could be too big.
@@ -153,25 +249,16 @@ void TopkVal::Merge(const TopkVal* value, bool doPrune)
 	while ( numElements > size )
 		{
 		pruned = true;
-		assert(buckets.size() > 0 );
-		Bucket* b = buckets.front();
-		assert(b->elements.size() > 0);
+		assert(min_bucket != TOPK_NONE);
+		uint32_t b = min_bucket;
+		assert(buckets[b].num_elements > 0);
 
-		Element* e = b->elements.front();
-		HashKey* key = GetHash(e->value);
-		elementDict->RemoveEntry(key);
-		delete key;
-		delete e;
+		uint32_t e = buckets[b].first;
+		UnlinkElement(e);
+		FreeElement(e);
 
-		b->elements.pop_front();
-
-		if ( b->elements.size() == 0 )
-			{
-			delete b;
-			buckets.pop_front();
-			}
-
-		numElements--;
+		if ( buckets[b].num_elements == 0 )
+			FreeBucket(b);
 		}
 	}
 
@@ -197,24 +284,14 @@ zeek::VectorValPtr TopkVal::GetTopK(int k) const // returns vector
 	// in any case - just to make this future-proof (and I am lazy) - this can return more than k.
 
 	int read = 0;
-	std::list<Bucket*>::const_iterator it = buckets.end();
-	it--;
-	while (read < k )
+
+	for ( uint32_t b = max_bucket; b != TOPK_NONE && read < k; b = buckets[b].prev )
 		{
-		//printf("Bucket %llu\n", (*it)->count);
-		std::list<Element*>::iterator eit = (*it)->elements.begin();
-		while ( eit != (*it)->elements.end() )
+		for ( uint32_t e = buckets[b].first; e != TOPK_NONE; e = elements[e].next )
 			{
-			//printf("Size: %ld\n", (*it)->elements.size());
-			t->Assign(read, (*eit)->value);
+			t->Assign(read, elements[e].value);
 			read++;
-			eit++;
 			}
-
-		if ( it == buckets.begin() )
-			break;
-
-		it--;
 		}
 
 	return t;
@@ -222,45 +299,38 @@ zeek::VectorValPtr TopkVal::GetTopK(int k) const // returns vector
 
 uint64_t TopkVal::GetCount(Val* value) const
 	{
-	HashKey* key = GetHash(value);
-	Element* e = (Element*) elementDict->Lookup(key);
-	delete key;
+	std::unique_ptr<HashKey> key(GetHash(value));
+	uint32_t e = Find(key.get());
 
-	if ( e == nullptr )
+	if ( e == TOPK_NONE )
 		{
 		reporter->Error("GetCount for element that is not in top-k");
 		return 0;
 		}
 
-	return e->parent->count;
+	return buckets[elements[e].bucket].count;
 	}
 
 uint64_t TopkVal::GetEpsilon(Val* value) const
 	{
-	HashKey* key = GetHash(value);
-	Element* e = (Element*) elementDict->Lookup(key);
-	delete key;
+	std::unique_ptr<HashKey> key(GetHash(value));
+	uint32_t e = Find(key.get());
 
-	if ( e == nullptr )
+	if ( e == TOPK_NONE )
 		{
 		reporter->Error("GetEpsilon for element that is not in top-k");
 		return 0;
 		}
 
-	return e->epsilon;
+	return elements[e].epsilon;
 	}
 
 uint64_t TopkVal::GetSum() const
 	{
 	uint64_t sum = 0;
 
-	std::list<Bucket*>::const_iterator it = buckets.begin();
-	while ( it != buckets.end() )
-		{
-		sum += (*it)->elements.size() * (*it)->count;
-
-		it++;
-		}
+	for ( uint32_t b = min_bucket; b != TOPK_NONE; b = buckets[b].next )
+		sum += buckets[b].num_elements * buckets[b].count;
 
 	if ( pruned )
 		reporter->Warning("TopkVal::GetSum() was used on a pruned data structure. Result values do not represent total element count");
@@ -282,62 +352,44 @@ void TopkVal::Encountered(zeek::ValPtr encountered)
 			}
 
 	// Step 1 - get the hash.
-	HashKey* key = GetHash(encountered);
-	Element* e = (Element*) elementDict->Lookup(key);
+	std::unique_ptr<HashKey> key(GetHash(encountered));
+	uint32_t e = Find(key.get());
 
-	if ( e == nullptr )
+	if ( e == TOPK_NONE )
 		{
-		e = new Element();
-		e->epsilon = 0;
-		e->value = std::move(encountered);
-
 		// well, we do not know this one yet...
 		if ( numElements < size )
 			{
+			e = NewElement(std::move(encountered), std::move(key));
+
 			// brilliant. just add it at position 1
-			if ( buckets.size() == 0 || (*buckets.begin())->count > 1 )
-				{
-				Bucket* b = new Bucket();
-				b->count = 1;
-				std::list<Bucket*>::iterator pos = buckets.insert(buckets.begin(), b);
-				b->bucketPos = pos;
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
-				}
+			if ( min_bucket == TOPK_NONE || buckets[min_bucket].count > 1 )
+				AppendElement(NewBucket(1, min_bucket), e);
 			else
 				{
-				Bucket* b = *buckets.begin();
-				assert(b->count == 1);
-				b->elements.insert(b->elements.end(), e);
-				e->parent = b;
+				assert(buckets[min_bucket].count == 1);
+				AppendElement(min_bucket, e);
 				}
 
-			elementDict->Insert(key, e);
-			numElements++;
-			delete key;
-
 			return; // done. it is at pos 1.
 			}
 
 		else
 			{
 			// replace element with min-value
-			Bucket* b = *buckets.begin(); // bucket with smallest elements
+			uint32_t b = min_bucket; // bucket with smallest elements
 
-			// evict oldest element with least hits.
-			assert(b->elements.size() > 0);
-			HashKey* deleteKey = GetHash((*(b->elements.begin()))->value);
-			b->elements.erase(b->elements.begin());
-			Element* deleteElement = (Element*) elementDict->RemoveEntry(deleteKey);
-			assert(deleteElement); // there has to have been a minimal element...
-			delete deleteElement;
-			delete deleteKey;
+			// evict oldest element with least hits, reusing
+			// its slot for the new one.
+			assert(buckets[b].num_elements > 0);
+			uint32_t old = buckets[b].first;
+			UnlinkElement(old);
+			FreeElement(old);
 
 			// and add the new one to the end
-			e->epsilon = b->count;
-			b->elements.insert(b->elements.end(), e);
-			elementDict->Insert(key, e);
-			e->parent = b;
+			e = NewElement(std::move(encountered), std::move(key));
+			elements[e].epsilon = buckets[b].count;
+			AppendElement(b, e);
 
 			// fallthrough, increment operation has to run!
 			}
@@ -345,56 +397,38 @@ void TopkVal::Encountered(zeek::ValPtr encountered)
 		}
 
 	// ok, we now have an element in e
-	delete key;
 	IncrementCounter(e); // well, this certainly was anticlimatic.
 	}
 
 // increment by count
-void TopkVal::IncrementCounter(Element* e, unsigned int count)
+void TopkVal::IncrementCounter(uint32_t e, unsigned int count)
 	{
-	Bucket* currBucket = e->parent;
-	uint64_t currcount = currBucket->count;
+	uint32_t currBucket = elements[e].bucket;
+	uint64_t currcount = buckets[currBucket].count;
 
 	// well, let's test if there is a bucket for currcount++
-	std::list<Bucket*>::iterator bucketIter = currBucket->bucketPos;
-
-	Bucket* nextBucket = nullptr;
+	uint32_t bucketIter = buckets[currBucket].next;
 
-	bucketIter++;
+	while ( bucketIter != TOPK_NONE && buckets[bucketIter].count < currcount+count )
+		bucketIter = buckets[bucketIter].next;
 
-	while ( bucketIter != buckets.end() && (*bucketIter)->count < currcount+count )
-		bucketIter++;
+	uint32_t nextBucket = TOPK_NONE;
 
-	if ( bucketIter != buckets.end() && (*bucketIter)->count == currcount+count )
-		nextBucket = *bucketIter;
+	if ( bucketIter != TOPK_NONE && buckets[bucketIter].count == currcount+count )
+		nextBucket = bucketIter;
 
-	if ( nextBucket == nullptr )
-		{
+	if ( nextBucket == TOPK_NONE )
 		// the bucket for the value that we want does not exist.
 		// create it...
-
-		Bucket* b = new Bucket();
-		b->count = currcount+count;
-
-		std::list<Bucket*>::iterator nextBucketPos = buckets.insert(bucketIter, b);
-		b->bucketPos = nextBucketPos; // and give it the iterator we know now.
-
-		nextBucket = b;
-		}
+		nextBucket = NewBucket(currcount+count, bucketIter);
 
 	// ok, now we have the new bucket in nextBucket. Shift the element over...
-	currBucket->elements.remove(e);
-	nextBucket->elements.insert(nextBucket->elements.end(), e);
-
-	e->parent = nextBucket;
+	UnlinkElement(e);
+	AppendElement(nextBucket, e);
 
 	// if currBucket is empty, we have to delete it now
-	if ( currBucket->elements.size() == 0 )
-		{
-		buckets.remove(currBucket);
-		delete currBucket;
-		currBucket = nullptr;
-		}
+	if ( buckets[currBucket].num_elements == 0 )
+		FreeBucket(currBucket);
 	}
 
 IMPLEMENT_OPAQUE_VALUE(TopkVal)
@@ -415,31 +449,22 @@ broker::expected<broker::data> TopkVal::DoSerialize() const
 		d.emplace_back(broker::none());
 
 	uint64_t i = 0;
-	std::list<Bucket*>::const_iterator it = buckets.begin();
-	while ( it != buckets.end() )
-		{
-		Bucket* b = *it;
-		uint32_t elements_count = b->elements.size();
 
-		d.emplace_back(static_cast<uint64_t>(b->elements.size()));
-		d.emplace_back(b->count);
+	for ( uint32_t b = min_bucket; b != TOPK_NONE; b = buckets[b].next )
+		{
+		d.emplace_back(buckets[b].num_elements);
+		d.emplace_back(buckets[b].count);
 
-		std::list<Element*>::const_iterator eit = b->elements.begin();
-		while ( eit != b->elements.end() )
+		for ( uint32_t e = buckets[b].first; e != TOPK_NONE; e = elements[e].next )
 			{
-			Element* element = *eit;
-			d.emplace_back(element->epsilon);
-			auto v = bro_broker::val_to_data(element->value.get());
+			d.emplace_back(elements[e].epsilon);
+			auto v = bro_broker::val_to_data(elements[e].value.get());
 			if ( ! v )
 				return broker::ec::invalid_data;
 
 			d.emplace_back(*v);
-
-			eit++;
 			i++;
 			}
-
-		it++;
 		}
 
 	assert(i == numElements);
@@ -462,7 +487,6 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		return false;
 
 	size = *size_;
-	numElements = *numElements_;
 	pruned = *pruned_;
 
 	auto no_type = caf::get_if<broker::none>(&(*v)[3]);
@@ -476,10 +500,9 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		Typify(t);
 		}
 
-	uint64_t i = 0;
 	uint64_t idx = 4;
 
-	while ( i < numElements )
+	while ( numElements < *numElements_ )
 		{
 		auto elements_count = caf::get_if<uint64_t>(&(*v)[idx++]);
 		auto count = caf::get_if<uint64_t>(&(*v)[idx++]);
@@ -487,9 +510,7 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 		if ( ! (elements_count && count) )
 			return false;
 
-		Bucket* b = new Bucket();
-		b->count = *count;
-		b->bucketPos = buckets.insert(buckets.end(), b);
+		uint32_t b = NewBucket(*count, TOPK_NONE);
 
 		for ( uint64_t j = 0; j < *elements_count; j++ )
 			{
@@ -499,24 +520,15 @@ bool TopkVal::DoUnserialize(const broker::data& data)
 			if ( ! (epsilon && val) )
 				return false;
 
-			Element* e = new Element();
-			e->epsilon = *epsilon;
-			e->value = std::move(val);
-			e->parent = b;
+			std::unique_ptr<HashKey> key(GetHash(val));
+			assert(Find(key.get()) == TOPK_NONE);
 
-			b->elements.insert(b->elements.end(), e);
-
-			HashKey* key = GetHash(e->value);
-			assert (elementDict->Lookup(key) == nullptr);
-
-			elementDict->Insert(key, e);
-			delete key;
-
-			i++;
+			uint32_t e = NewElement(std::move(val), std::move(key));
+			elements[e].epsilon = *epsilon;
+			AppendElement(b, e);
 			}
 		}
 
-	assert(i == numElements);
 	return true;
 	}
 }
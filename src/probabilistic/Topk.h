@@ -2,9 +2,13 @@
 
 #pragma once
 
-#include <list>
+#include <cstring>
+#include <memory>
+#include <vector>
+
 #include "Val.h"
 #include "OpaqueVal.h"
+#include "FlatHashMap.h"
 
 // This class implements the top-k algorithm. Or - to be more precise - an
 // interpretation of it.
@@ -13,22 +17,33 @@ class CompositeHash;
 
 namespace probabilistic {
 
-struct Element;
+// The elements and buckets of the stream summary live in vectors and
+// refer to each other by index, with this marking the absence of one.
+constexpr uint32_t TOPK_NONE = UINT32_MAX;
 
 struct Bucket {
 	uint64_t count;
-	std::list<Element*> elements;
+	uint64_t num_elements;
+
+	// Our elements, oldest first.
+	uint32_t first;
+	uint32_t last;
 
-	// Iterators only get invalidated for removed elements. This one
-	// points to us - so it is invalid when we are no longer there. Cute,
-	// isn't it?
-	std::list<Bucket*>::iterator bucketPos;
+	// Neighbours in the list of buckets, which is ordered by count.
+	uint32_t prev;
+	uint32_t next;
 };
 
 struct Element {
 	uint64_t epsilon;
 	zeek::ValPtr value;
-	Bucket* parent;
+	std::unique_ptr<HashKey> key;
+	uint32_t bucket;
+
+	// Neighbours in our bucket's list of elements, or the next free
+	// element once we are gone.
+	uint32_t prev;
+	uint32_t next;
 };
 
 class TopkVal : public zeek::OpaqueVal {
@@ -143,7 +158,7 @@ private:
 	 *
 	 * @param count increment counter by this much
 	 */
-	void IncrementCounter(Element* e, unsigned int count = 1);
+	void IncrementCounter(uint32_t e, unsigned int count = 1);
 
 	/**
 	 * get the hashkey for a specific value
@@ -163,10 +178,48 @@ private:
 	 */
 	void Typify(zeek::TypePtr t);
 
+	/**
+	 * Looks up the element for a hash key.
+	 *
+	 * @returns the element's index, or TOPK_NONE if unknown
+	 */
+	uint32_t Find(const HashKey* key) const;
+
+	// Management of the element and bucket lists.
+	uint32_t NewElement(zeek::ValPtr value, std::unique_ptr<HashKey> key);
+	void FreeElement(uint32_t e);
+	void AppendElement(uint32_t b, uint32_t e);
+	void UnlinkElement(uint32_t e);
+	uint32_t NewBucket(uint64_t count, uint32_t next);
+	void FreeBucket(uint32_t b);
+
+	// Indexes elements by the hash keys they own.
+	struct KeyRef {
+		const HashKey* key = nullptr;
+
+		bool operator==(const KeyRef& other) const
+			{
+			return key->Size() == other.key->Size() &&
+			       memcmp(key->Key(), other.key->Key(), key->Size()) == 0;
+			}
+	};
+
+	struct KeyRefHash {
+		hash_t operator()(const KeyRef& k) const
+			{ return k.key->Hash(); }
+	};
+
+	using ElementMap = zeek::detail::FlatHashMap<KeyRef, uint32_t, KeyRefHash>;
+
 	zeek::TypePtr type;
 	CompositeHash* hash;
-	std::list<Bucket*> buckets;
-	zeek::PDict<Element>* elementDict;
+	std::vector<Element> elements;
+	std::vector<Bucket> buckets;
+	uint32_t free_elements; // list of unused elements, linked by next
+	uint32_t free_buckets; // list of unused buckets, linked by next
+	uint32_t min_bucket; // bucket with the lowest count
+	uint32_t max_bucket; // bucket with the highest count
+	ElementMap elementMap;
 	uint64_t size; // how many elements are we tracking?
 	uint64_t numElements; // how many elements do we have at the moment
 	bool pruned; // was this data structure pruned?
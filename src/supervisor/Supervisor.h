@@ -206,6 +206,11 @@ public:
 	 * Supervisor process.  The Stem process itself will not return from this,
 	 * function but a node it spawns via fork() will return from it and
 	 * information about it is available in ThisNode().
+	 *
+	 * This needs to happen before any scripts get parsed: a node's
+	 * configuration determines which scripts it loads (the "scripts" field
+	 * and, via CLUSTER_NODE, the cluster framework's node-specific ones),
+	 * and the Stem must not carry threads or I/O state into its nodes.
 	 */
 	static std::optional<detail::SupervisorStemHandle> CreateStem(bool supervisor_mode);
 
@@ -6,6 +6,7 @@
 #include "BasicThread.h"
 #include "Manager.h"
 #include "util.h"
+#include "zeek-affinity.h"
 
 using namespace threading;
 
@@ -47,6 +48,10 @@ void BasicThread::SetName(const char* arg_name)
 void BasicThread::SetOSName(const char* arg_name)
 	{
 	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
+
+	if ( ! thread.joinable() )
+		return;
+
 	zeek::set_thread_name(arg_name, thread.native_handle());
 	}
 
@@ -94,9 +99,14 @@ void BasicThread::Start()
 
 	started = true;
 
-	thread = std::thread(&BasicThread::launcher, this);
+	if ( OnStartPooled() )
+		DBG_LOG(DBG_THREADING, "Started thread %s on the thread pool", name);
 
-	DBG_LOG(DBG_THREADING, "Started thread %s", name);
+	else
+		{
+		thread = std::thread(&BasicThread::launcher, this);
+		DBG_LOG(DBG_THREADING, "Started thread %s", name);
+		}
 
 	OnStart();
 	}
@@ -131,6 +141,8 @@ void BasicThread::Join()
 	if ( ! started )
 		return;
 
+	OnJoin();
+
 	if ( ! thread.joinable() )
 		return;
 
@@ -166,13 +178,9 @@ void BasicThread::Done()
 	killed = true;
 	}
 
-void* BasicThread::launcher(void *arg)
+void BasicThread::BlockSignals()
 	{
-	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
-	BasicThread* thread = (BasicThread *)arg;
-
-	// Block signals in thread. We handle signals only in the main
-	// process.
+	// We handle signals only in the main process.
 	sigset_t mask_set;
 	sigfillset(&mask_set);
 
@@ -185,6 +193,19 @@ void* BasicThread::launcher(void *arg)
 	sigdelset(&mask_set, SIGBUS);
 	int res = pthread_sigmask(SIG_BLOCK, &mask_set, 0);
 	assert(res == 0);
+	}
+
+void* BasicThread::launcher(void *arg)
+	{
+	static_assert(std::is_same<std::thread::native_handle_type, pthread_t>::value, "libstdc++ doesn't use pthread_t");
+	BasicThread* thread = (BasicThread *)arg;
+
+	BlockSignals();
+
+	// Failing that isn't worth stopping for, the thread just runs
+	// wherever the main thread may.
+	if ( thread->cpus )
+		zeek::set_thread_affinity(*thread->cpus);
 
 	// Run thread's main function.
 	thread->Run();
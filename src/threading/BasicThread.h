@@ -4,7 +4,9 @@
 #include <stdint.h>
 
 #include <iosfwd>
+#include <optional>
 #include <thread>
+#include <vector>
 
 namespace threading {
 
@@ -55,7 +57,7 @@ public:
 
 	/**
 	 * Set the name shown by the OS as the thread's description. Not
-	 * supported on all OSs.
+	 * supported on all OSs, and ignored when running on a thread pool.
 	 *
 	 * Must be called only from the child thread.
 	 */
@@ -126,6 +128,22 @@ public:
 	 */
 	const char* Strerror(int err);
 
+	/**
+	 * Blocks the signals that only the main thread handles in the
+	 * calling thread. Threads other than the main one need to call this
+	 * first thing.
+	 */
+	static void BlockSignals();
+
+	/**
+	 * Sets the CPUs that the thread will run on once started, as
+	 * returned by Manager::ThreadCPUs(). Must be called before Start().
+	 *
+	 * @param arg_cpus The CPUs. If unset, the thread keeps those of the
+	 * main thread at the time it's started.
+	 */
+	void SetCPUs(std::optional<std::vector<int>> arg_cpus)	{ cpus = std::move(arg_cpus); }
+
 protected:
 	friend class Manager;
 
@@ -145,6 +163,15 @@ protected:
 	 */
 	virtual void OnStart()	{}
 
+	/**
+	 * Executed with Start() before spawning the OS thread. Derived
+	 * classes that can also run as tasks on the threading::Manager's
+	 * thread pool return true here once they've set themselves up to do
+	 * so, in which case there's no OS thread of their own and Run() won't
+	 * be called.
+	 */
+	virtual bool OnStartPooled()	{ return false; }
+
 	/**
 	 * Executed with SignalStop(). This is a hook into preparing the
 	 * thread for stopping. It will be called from Bro's main thread
@@ -165,6 +192,13 @@ protected:
 	 */
 	virtual void OnKill()	{}
 
+	/**
+	 * Executed with Join() before joining the OS thread. Without one,
+	 * this must wait until the thread's work is done, as it will get
+	 * deleted right after.
+	 */
+	virtual void OnJoin()	{}
+
 	/**
 	 * Destructor. This will be called by the manager.
 	 *
@@ -200,6 +234,7 @@ private:
 	bool started; 		// Set to to true once running.
 	bool terminating;	// Set to to true to signal termination.
 	bool killed;	// Set to true once forcefully killed.
+	std::optional<std::vector<int>> cpus;	// See SetCPUs().
 
 	// For implementing Fmt().
 	char* buf;
@@ -3,10 +3,19 @@
 #include <sys/socket.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
 #include "NetVar.h"
 #include "iosource/Manager.h"
 #include "Event.h"
 #include "IPAddr.h"
+#include "ID.h"
+#include "Reporter.h"
+#include "Val.h"
+#include "zeek-affinity.h"
 
 using namespace threading;
 
@@ -24,7 +33,6 @@ Manager::Manager()
 	DBG_LOG(DBG_THREADING, "Creating thread manager ...");
 
 	did_process = true;
-	next_beat = 0;
 	terminating = false;
 	}
 
@@ -59,9 +67,80 @@ void Manager::Terminate()
 
 	all_threads.clear();
 	msg_threads.clear();
+
+	// All tasks are done now.
+	pool.reset();
+
 	terminating = false;
 	}
 
+ThreadPool* Manager::Pool()
+	{
+	if ( pool || ! zeek::BifConst::Threading::use_pool )
+		return pool.get();
+
+	int n = zeek::BifConst::Threading::pool_threads;
+
+	if ( n <= 0 )
+		n = std::thread::hardware_concurrency();
+
+	// The pool runs both log writers and input readers.
+	auto cpus = ThreadCPUs("Threading::log_writer_cpus");
+	auto reader_cpus = ThreadCPUs("Threading::input_reader_cpus");
+
+	if ( cpus && reader_cpus && ! cpus->empty() && ! reader_cpus->empty() )
+		cpus->insert(cpus->end(), reader_cpus->begin(), reader_cpus->end());
+	else if ( ! cpus || cpus->empty() )
+		cpus = reader_cpus;
+
+	pool = std::make_unique<ThreadPool>(n, std::move(cpus));
+	return pool.get();
+	}
+
+static std::vector<int> cpus_from_option(const char* option)
+	{
+	std::vector<int> cpus;
+	auto set = zeek::id::find_val<zeek::TableVal>(option);
+
+	if ( ! set )
+		return cpus;
+
+	auto lv = set->ToPureListVal();
+
+	for ( int i = 0; i < lv->Length(); ++i )
+		cpus.emplace_back(lv->Idx(i)->AsCount());
+
+	std::sort(cpus.begin(), cpus.end());
+	return cpus;
+	}
+
+std::optional<std::vector<int>> Manager::ThreadCPUs(const char* option)
+	{
+	auto cpus = cpus_from_option(option);
+
+	if ( cpus.empty() && ! main_thread_placed )
+		return {};
+
+	return cpus;
+	}
+
+void Manager::PlaceMainThread(const char* option)
+	{
+	auto cpus = cpus_from_option(option);
+
+	if ( cpus.empty() && ! main_thread_placed )
+		return;
+
+	if ( ! zeek::set_thread_affinity(cpus) )
+		{
+		reporter->Warning("failed to apply %s: %s", option, strerror(errno));
+		return;
+		}
+
+	main_thread_placed = true;
+	DBG_LOG(DBG_THREADING, "Placed main thread as per %s", option);
+	}
+
 void Manager::AddThread(BasicThread* thread)
 	{
 	DBG_LOG(DBG_THREADING, "Adding thread %s ...", thread->Name());
@@ -98,6 +177,11 @@ void Manager::SendHeartbeats()
 
 	// Since this is a regular timer, this is also an ideal place to check whether we have
 	// and dead threads and to delete them.
+	DeleteKilledThreads();
+	}
+
+void Manager::DeleteKilledThreads()
+	{
 	all_thread_list to_delete;
 	for ( all_thread_list::iterator i = all_threads.begin(); i != all_threads.end(); i++ )
 		{
@@ -186,71 +270,20 @@ bool Manager::SendEvent(MsgThread* thread, const std::string& name, const int nu
 
 void Manager::Flush()
 	{
-	bool do_beat = false;
-
-	if ( network_time && (network_time > next_beat || ! next_beat) )
-		{
-		do_beat = true;
-		next_beat = ::network_time + zeek::BifConst::Threading::heartbeat_interval;
-		}
-
 	did_process = false;
 
 	for ( msg_thread_list::iterator i = msg_threads.begin(); i != msg_threads.end(); i++ )
 		{
 		MsgThread* t = *i;
 
-		if ( do_beat )
-			t->Heartbeat();
-
-		while ( t->HasOut() )
-			{
-			Message* msg = t->RetrieveOut();
-			assert(msg);
-
-			if ( msg->Process() )
-				{
-				if ( network_time )
-					did_process = true;
-				}
-
-			else
-				{
-				reporter->Error("%s failed, terminating thread", msg->Name());
-				t->SignalStop();
-				}
-
-			delete msg;
-			}
-		}
-
-	all_thread_list to_delete;
-
-	for ( all_thread_list::iterator i = all_threads.begin(); i != all_threads.end(); i++ )
-		{
-		BasicThread* t = *i;
-
-		if ( t->Killed() )
-			to_delete.push_back(t);
-		}
+		if ( ! t->HasOut() )
+			continue;
 
-	for ( all_thread_list::iterator i = to_delete.begin(); i != to_delete.end(); i++ )
-		{
-		BasicThread* t = *i;
-		t->WaitForStop();
-
-		all_threads.remove(t);
-
-		MsgThread* mt = dynamic_cast<MsgThread *>(t);
-
-		if ( mt )
-			msg_threads.remove(mt);
-
-		t->Join();
-		delete t;
+		t->Process();
+		did_process = true;
 		}
 
-//	fprintf(stderr, "P %.6f %.6f do_beat=%d did_process=%d next_next=%.6f\n", network_time, timer_mgr->Time(), do_beat, (int)did_process, next_beat);
+	DeleteKilledThreads();
 	}
 
 const threading::Manager::msg_stats_list& threading::Manager::GetMsgThreadStats()
@@ -2,10 +2,14 @@
 #pragma once
 
 #include "MsgThread.h"
+#include "ThreadPool.h"
 #include "Timer.h"
 
 #include <list>
+#include <memory>
+#include <optional>
 #include <utility>
+#include <vector>
 
 namespace threading {
 
@@ -27,9 +31,11 @@ protected:
  * once it has terminated.
  *
  * In addition to basic threads, the manager also provides additional
- * functionality specific to MsgThread instances. In particular, it polls
- * their outgoing message queue on a regular basis and feeds data sent into
- * the rest of Bro. It also triggers the regular heartbeats.
+ * functionality specific to MsgThread instances. In particular, it triggers
+ * the regular heartbeats. A MsgThread's output doesn't go through the manager
+ * during normal operation: each thread lights its own flare, registered with
+ * the IO source manager, and the main loop processes only threads that have
+ * output pending.
  */
 class Manager
 {
@@ -78,6 +84,39 @@ public:
 	 */
 	int NumThreads() const { return all_threads.size(); }
 
+	/**
+	 * Returns the thread pool that MsgThreads run on as tasks if
+	 * \c Threading::use_pool is set, starting it on first use. Returns
+	 * null otherwise.
+	 */
+	ThreadPool* Pool();
+
+	/**
+	 * Returns the CPUs that a class of threads should run on, for
+	 * passing to BasicThread::SetCPUs().
+	 *
+	 * @param option The name of the script-level \c set[count] option
+	 * listing them, such as \c Threading::log_writer_cpus.
+	 *
+	 * @return The CPUs in the option. If it's empty, all those the
+	 * process may run on if the main thread got placed elsewhere, and
+	 * unset otherwise.
+	 */
+	std::optional<std::vector<int>> ThreadCPUs(const char* option);
+
+	/**
+	 * Moves the main thread to the CPUs listed in a script-level
+	 * \c set[count] option, reporting a warning if that fails. Threads
+	 * it starts afterwards, including those of libraries, start out on
+	 * these CPUs too. If the option is empty, this moves the main thread
+	 * back to all CPUs the process may run on, if it was placed
+	 * elsewhere before.
+	 *
+	 * @param option The name of the option, such as
+	 * \c Threading::main_thread_cpus.
+	 */
+	void PlaceMainThread(const char* option);
+
 	/**
 	 * Signals a specific threads to terminate immediately.
 	 */
@@ -123,8 +162,18 @@ protected:
 	 */
 	void AddMsgThread(MsgThread* thread);
 
+	/**
+	 * Processes pending output of all message threads and deletes killed
+	 * ones. Used only during termination; otherwise threads' flares wake
+	 * up the main loop to process their output.
+	 */
 	void Flush();
 
+	/**
+	 * Joins and deletes all threads that have been killed.
+	 */
+	void DeleteKilledThreads();
+
 	/**
 	 * Sends heartbeat messages to all active message threads.
 	 */
@@ -142,13 +191,16 @@ private:
 	typedef std::list<MsgThread*> msg_thread_list;
 	msg_thread_list msg_threads;
 
-	bool did_process;	// True if the last Process() found some work to do.
-	double next_beat;	// Timestamp when the next heartbeat will be sent.
+	bool did_process;	// True if the last Flush() found some work to do.
 	bool terminating;	// True if we are in Terminate().
 
 	msg_stats_list stats;
 
 	bool heartbeat_timer_running = false;
+
+	std::unique_ptr<ThreadPool> pool;
+
+	bool main_thread_placed = false;	// True once PlaceMainThread() moved it.
 };
 
 }
@@ -6,10 +6,15 @@
 
 #include "MsgThread.h"
 #include "Manager.h"
+#include "ThreadPool.h"
 #include "iosource/Manager.h"
 
 using namespace threading;
 
+// The most messages a thread processes at a time when running on the
+// thread pool, before giving others their turn.
+static const int MAX_TASK_MESSAGES = 64;
+
 namespace threading  {
 
 ////// Messages.
@@ -151,6 +156,32 @@ private:
 	Value* *val;
 };
 
+class SendEventBatchMessage final : public OutputMessage<MsgThread> {
+public:
+	SendEventBatchMessage(MsgThread* thread, const char* name, const int num_vals,
+	                      std::vector<Value**> vals)
+		: OutputMessage<MsgThread>("SendEventBatch", thread),
+	  name(copy_string(name)), num_vals(num_vals), vals(std::move(vals)) {}
+
+	~SendEventBatchMessage() override	{ delete [] name; }
+
+	bool Process() override
+		{
+		for ( auto val : vals )
+			{
+			if ( ! thread_mgr->SendEvent(Object(), name, num_vals, val) )
+				reporter->Error("SendEvent for event %s failed", name);
+			}
+
+		return true; // We do not want to die if sendEvent fails because the event did not return.
+		}
+
+private:
+	const char* name;
+	const int num_vals;
+	std::vector<Value**> vals;
+};
+
 ////// Methods.
 
 Message::~Message()
@@ -200,10 +231,14 @@ bool ReporterMessage::Process()
 MsgThread::MsgThread() : BasicThread(), queue_in(this, nullptr), queue_out(nullptr, this)
 	{
 	cnt_sent_in = cnt_sent_out = 0;
+	flare_fired = false;
 	main_finished = false;
 	child_finished = false;
 	child_sent_finish = false;
 	failed = false;
+	pooled = false;
+	scheduled = false;
+	task_done = false;
 	thread_mgr->AddMsgThread(this);
 
 	if ( ! iosource_mgr->RegisterFd(flare.FD(), this) )
@@ -268,7 +303,7 @@ void MsgThread::OnWaitForStop()
 			}
 
 		if ( ! Killed() )
-			queue_in.WakeUp();
+			WakeUpIn();
 
 		while ( HasOut() )
 			{
@@ -295,7 +330,49 @@ void MsgThread::OnKill()
 	// Send a message to unblock the reader if its currently waiting for
 	// input. This is just an optimization to make it terminate more
 	// quickly, even without the message it will eventually time out.
-	queue_in.WakeUp();
+	// On the pool, that's what gets it to terminate.
+	WakeUpIn();
+	}
+
+bool MsgThread::OnStartPooled()
+	{
+	if ( ! CanRunOnPool() )
+		return false;
+
+	auto pool = thread_mgr->Pool();
+
+	if ( ! pool )
+		return false;
+
+	pooled = true;
+
+	// There may be messages queued already.
+	Schedule();
+	return true;
+	}
+
+void MsgThread::OnJoin()
+	{
+	if ( ! pooled )
+		return;
+
+	// The task may still be wrapping up on the pool.
+	while ( ! task_done )
+		usleep(1000);
+	}
+
+void MsgThread::Schedule()
+	{
+	if ( ! scheduled.exchange(true) )
+		thread_mgr->Pool()->Schedule(this);
+	}
+
+void MsgThread::WakeUpIn()
+	{
+	if ( pooled )
+		Schedule();
+	else
+		queue_in.WakeUp();
 	}
 
 void MsgThread::Heartbeat()
@@ -370,6 +447,9 @@ void MsgThread::SendIn(BasicInputMessage* msg, bool force)
 
 	queue_in.Put(msg);
 	++cnt_sent_in;
+
+	if ( pooled )
+		Schedule();
 	}
 
 
@@ -385,7 +465,10 @@ void MsgThread::SendOut(BasicOutputMessage* msg, bool force)
 
 	++cnt_sent_out;
 
-	flare.Fire();
+	// Only the first message since the main thread last drained the queue
+	// needs to wake it up, saving a write to the pipe for all others.
+	if ( ! flare_fired.exchange(true) )
+		flare.Fire();
 	}
 
 void MsgThread::SendEvent(const char* name, const int num_vals, Value* *vals)
@@ -393,6 +476,14 @@ void MsgThread::SendEvent(const char* name, const int num_vals, Value* *vals)
 	SendOut(new SendEventMessage(this, name, num_vals, vals));
 	}
 
+void MsgThread::SendEvents(const char* name, const int num_vals, std::vector<Value**> vals)
+	{
+	if ( vals.empty() )
+		return;
+
+	SendOut(new SendEventBatchMessage(this, name, num_vals, std::move(vals)));
+	}
+
 BasicOutputMessage* MsgThread::RetrieveOut()
 	{
 	BasicOutputMessage* msg = queue_out.Get();
@@ -406,7 +497,8 @@ BasicOutputMessage* MsgThread::RetrieveOut()
 
 BasicInputMessage* MsgThread::RetrieveIn()
 	{
-	BasicInputMessage* msg = queue_in.Get();
+	// On the pool, we must not block when there's nothing to do.
+	BasicInputMessage* msg = pooled ? queue_in.TryGet() : queue_in.Get();
 
 	if ( ! msg )
 		return nullptr;
@@ -428,23 +520,65 @@ void MsgThread::Run()
 		if ( ! msg )
 			continue;
 
-		bool result = msg->Process();
+		ProcessIn(msg);
+		}
 
-		delete msg;
+	FinishRun();
+	}
 
-		if ( ! result )
-			{
-			Error("terminating thread");
-
-			// This will eventually kill this thread, but only
-			// after all other outgoing messages (in particular
-			// error messages have been processed by then main
-			// thread).
-			SendOut(new KillMeMessage(this));
-			failed = true;
-			}
+void MsgThread::RunTask()
+	{
+	for ( int i = 0; i < MAX_TASK_MESSAGES; ++i )
+		{
+		if ( child_finished || Killed() )
+			break;
+
+		BasicInputMessage* msg = RetrieveIn();
+
+		if ( ! msg )
+			break;
+
+		ProcessIn(msg);
 		}
 
+	if ( child_finished || Killed() )
+		{
+		// Leaves scheduled set, so that we never run again.
+		FinishRun();
+		BasicThread::Done();
+		task_done = true;
+		return;
+		}
+
+	// A message queued before we clear the flag will be seen by the
+	// check below, one queued after reschedules us itself.
+	scheduled = false;
+
+	if ( queue_in.MaybeReady() )
+		Schedule();
+	}
+
+void MsgThread::ProcessIn(BasicInputMessage* msg)
+	{
+	bool result = msg->Process();
+
+	delete msg;
+
+	if ( ! result )
+		{
+		Error("terminating thread");
+
+		// This will eventually kill this thread, but only
+		// after all other outgoing messages (in particular
+		// error messages have been processed by then main
+		// thread).
+		SendOut(new KillMeMessage(this));
+		failed = true;
+		}
+	}
+
+void MsgThread::FinishRun()
+	{
 	// In case we haven't sent the finish method yet, do it now. Reading
 	// global network_time here should be fine, it isn't changing
 	// anymore.
@@ -467,7 +601,10 @@ void MsgThread::GetStats(Stats* stats)
 
 void MsgThread::Process()
 	{
+	// Reset before draining so that a message queued during the loop
+	// lights the flare again rather than waiting for the next one.
 	flare.Extinguish();
+	flare_fired = false;
 
 	while ( HasOut() )
 		{
@@ -1,6 +1,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <vector>
+
 #include "DebugLogger.h"
 
 #include "BasicThread.h"
@@ -74,6 +77,19 @@ public:
 	 */
 	void SendEvent(const char* name, const int num_vals, threading::Value* *vals);
 
+	/**
+	 * Sends a series of events of the same type with a single message.
+	 * The main thread queues all of them at once, in order, so that no
+	 * other processing happens in between.
+	 *
+	 * @param name name of the Zeek event to send
+	 *
+	 * @param num_vals number of values each event takes
+	 *
+	 * @param vals the values for each event, as SendEvent() takes them
+	 */
+	void SendEvents(const char* name, const int num_vals, std::vector<threading::Value**> vals);
+
 	/**
 	 * Reports an informational message from the child thread. The main
 	 * thread will pass this to the Reporter once received.
@@ -205,6 +221,7 @@ public:
 
 protected:
 	friend class Manager;
+	friend class ThreadPool;
 	friend class HeartbeatMessage;
 	friend class FinishMessage;
 	friend class FinishedMessage;
@@ -255,13 +272,24 @@ protected:
 	 */
 	virtual bool OnFinish(double network_time) = 0;
 
+	/**
+	 * Returns true if the thread may run as a task on the
+	 * threading::Manager's thread pool when that's enabled (see
+	 * \c Threading::use_pool), rather than in an OS thread of its own.
+	 * That's the case for threads that don't block for long when
+	 * processing a message.
+	 */
+	virtual bool CanRunOnPool() const	{ return false; }
+
 	/**
 	 * Overriden from BasicThread.
 	 */
 	void Run() override;
+	bool OnStartPooled() override;
 	void OnWaitForStop() override;
 	void OnSignalStop() override;
 	void OnKill() override;
+	void OnJoin() override;
 
 private:
 	/**
@@ -275,6 +303,42 @@ private:
 	 */
 	BasicInputMessage* RetrieveIn();
 
+	/**
+	 * Processes a message from the main thread, flagging the thread as
+	 * failed if that doesn't succeed. Takes ownership of the message.
+	 *
+	 * Must only be called by the child thread.
+	 */
+	void ProcessIn(BasicInputMessage* msg);
+
+	/**
+	 * Finishes the child's operations if that hasn't happened yet once
+	 * it stops processing messages.
+	 *
+	 * Must only be called by the child thread.
+	 */
+	void FinishRun();
+
+	/**
+	 * Runs the thread as a task on the thread pool: processes a batch of
+	 * the pending messages and reschedules itself if there are more.
+	 *
+	 * Must only be called by the ThreadPool.
+	 */
+	void RunTask();
+
+	/**
+	 * Queues the thread on the thread pool unless it's queued or running
+	 * there already.
+	 */
+	void Schedule();
+
+	/**
+	 * Gets the child to look at its state, such as whether it got
+	 * killed, even if there's no message for it.
+	 */
+	void WakeUpIn();
+
 	/**
 	 * Queues a message for the child.
 	 *
@@ -336,7 +400,12 @@ private:
 	bool child_sent_finish; // Child thread asked to be finished.
 	bool failed;	// Set to true when a command failed.
 
+	bool pooled;	// Runs as a task on the thread pool.
+	std::atomic<bool> scheduled;	// Queued or running on the pool. Stays set once done.
+	std::atomic<bool> task_done;	// The pool is done running the thread for good.
+
 	zeek::detail::Flare flare;
+	std::atomic<bool> flare_fired;	// True if the flare is lit and Process() hasn't run since.
 };
 
 /**
@@ -1,14 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
-#include <condition_variable>
-#include <queue>
 #include <deque>
+#include <vector>
 #include <stdint.h>
-#include <sys/time.h>
+#include <poll.h>
 
 #include "Reporter.h"
 #include "BasicThread.h"
+#include "Flare.h"
 
 #undef Queue // Defined elsewhere unfortunately.
 
@@ -17,13 +18,17 @@ namespace threading {
 /**
  * A thread-safe single-reader single-writer queue.
  *
- * The implementation uses multiple queues and reads/writes in rotary fashion
- * in an attempt to limit contention.
+ * The implementation uses a bounded lock-free ring buffer. If the ring
+ * fills up because the reader can't keep up, further elements spill into
+ * a mutex-protected overflow list until the reader has caught up, so that
+ * writers never block and the queue can't deadlock two threads sending to
+ * each other. The number of spilled elements is reported through
+ * GetStats() as a measure of backpressure.
  *
- * All Queue instances must be instantiated by Bro's main thread.
+ * A reader blocking in Get() sleeps on a flare, which writers fire only
+ * when they see the reader sleeping.
  *
- * TODO: Unclear how critical performance is for this qeueue. We could likely
- * optimize it further if helpful.
+ * All Queue instances must be instantiated by Bro's main thread.
  */
 template<typename T>
 class Queue
@@ -50,24 +55,28 @@ public:
 	 */
 	T Get();
 
+	/**
+	 * Retrieves one element without blocking. Returns null if there's
+	 * none.
+	 */
+	T TryGet();
+
 	/**
 	 * Queues one element.
 	 */
 	void Put(T data);
 
 	/**
-	 * Returns true if the next Get() operation will succeed.
+	 * Returns true if the next Get() operation will succeed. Must only
+	 * be called by the reader.
 	 */
 	bool Ready();
 
 	/**
 	 * Returns true if the next Get() operation might succeed. This
 	 * function may occasionally return a value not indicating the actual
-	 * state, but won't do so very often. Note that this means that it can
-	 * consistently return false even if there is something in the Queue.
-	 * You have to check real queue status from time to time to be sure that
-	 * it is empty. In other words, this method helps to avoid locking the queue
-	 * frequently, but doesn't allow you to forgo it completely.
+	 * state, but won't do so very often. As it doesn't need to look at
+	 * the queue itself, it can be called from any thread.
 	 */
 	bool MaybeReady() { return (num_reads != num_writes); }
 
@@ -89,6 +98,7 @@ public:
 		{
 		uint64_t num_reads;	//! Number of messages read from the queue.
 		uint64_t num_writes;	//! Number of messages written to the queue.
+		uint64_t num_spilled;	//! Number of messages that didn't fit into the ring.
 		};
 
 	/**
@@ -100,23 +110,35 @@ public:
 	void GetStats(Stats* stats);
 
 private:
-	static const int NUM_QUEUES = 8;
+	// Number of ring slots; must be a power of two.
+	static const uint64_t RING_SIZE = 4096;
+
+	// The ring. Only the writer advances tail, only the reader head.
+	T ring[RING_SIZE];
+	alignas(64) std::atomic<uint64_t> head;
+	alignas(64) std::atomic<uint64_t> tail;
 
-	std::vector<std::unique_lock<std::mutex>> LocksForAllQueues();
+	// Elements that didn't fit into the ring. Once there's anything in
+	// here, the writer keeps appending to it to preserve ordering.
+	std::mutex spill_mutex;
+	std::deque<T> spill;
+	std::atomic<uint64_t> spill_size;
 
-	std::mutex mutex[NUM_QUEUES];	// Mutex protected shared accesses.
-	std::condition_variable has_data[NUM_QUEUES];	// Signals when data becomes available
-	std::queue<T> messages[NUM_QUEUES];	// Actually holds the queued messages
+	// Elements the reader has taken over from the spill list. These are
+	// older than anything in the ring.
+	std::deque<T> reader_spill;
 
-	int read_ptr;	// Where the next operation will read from
-	int write_ptr;	// Where the next operation will write to
+	// Set while the reader is blocked waiting for input.
+	std::atomic<bool> sleeping;
+	zeek::detail::Flare wakeup;
 
 	BasicThread* reader;
 	BasicThread* writer;
 
 	// Statistics.
-	uint64_t num_reads;
-	uint64_t num_writes;
+	std::atomic<uint64_t> num_reads;
+	std::atomic<uint64_t> num_writes;
+	std::atomic<uint64_t> num_spilled;
 };
 
 inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
@@ -135,10 +157,10 @@ inline static std::unique_lock<std::mutex> acquire_lock(std::mutex& m)
 
 template<typename T>
 inline Queue<T>::Queue(BasicThread* arg_reader, BasicThread* arg_writer)
+	: head(0), tail(0), spill_size(0), sleeping(false),
+	  num_reads(0), num_writes(0), num_spilled(0)
 	{
-	read_ptr = 0;
-	write_ptr = 0;
-	num_reads = num_writes = 0;
+	static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
 	reader = arg_reader;
 	writer = arg_writer;
 	}
@@ -149,116 +171,135 @@ inline Queue<T>::~Queue()
 	}
 
 template<typename T>
-inline T Queue<T>::Get()
+inline T Queue<T>::TryGet()
 	{
-	auto lock = acquire_lock(mutex[read_ptr]);
-
-	int old_read_ptr = read_ptr;
+	T data;
 
-	if ( messages[read_ptr].empty() && ! ((reader && reader->Killed()) || (writer && writer->Killed())) )
+	if ( ! reader_spill.empty() )
 		{
-		if ( has_data[read_ptr].wait_for(lock, std::chrono::seconds(5)) == std::cv_status::timeout )
-			return nullptr;
+		data = reader_spill.front();
+		reader_spill.pop_front();
 		}
 
-	if ( messages[read_ptr].empty() )
-		return nullptr;
-
-	T data = messages[read_ptr].front();
-	messages[read_ptr].pop();
+	else
+		{
+		uint64_t h = head.load(std::memory_order_relaxed);
+
+		if ( h != tail.load(std::memory_order_acquire) )
+			{
+			data = ring[h & (RING_SIZE - 1)];
+			head.store(h + 1, std::memory_order_release);
+			}
+
+		else
+			{
+			// The ring is empty, so anything that spilled over
+			// comes next.
+			if ( spill_size.load(std::memory_order_acquire) == 0 )
+				return nullptr;
+
+			auto lock = acquire_lock(spill_mutex);
+			reader_spill.swap(spill);
+			spill_size.store(0, std::memory_order_release);
+			lock.unlock();
+
+			if ( reader_spill.empty() )
+				return nullptr;
+
+			data = reader_spill.front();
+			reader_spill.pop_front();
+			}
+		}
 
-	read_ptr = (read_ptr + 1) % NUM_QUEUES;
 	++num_reads;
-
 	return data;
 	}
 
 template<typename T>
-inline void Queue<T>::Put(T data)
+inline T Queue<T>::Get()
 	{
-	auto lock = acquire_lock(mutex[write_ptr]);
+	T data = TryGet();
 
-	int old_write_ptr = write_ptr;
+	if ( data || (reader && reader->Killed()) || (writer && writer->Killed()) )
+		return data;
 
-	bool need_signal = messages[write_ptr].empty();
+	// Announce that we're going to sleep, then check once more to not
+	// miss an element written in between.
+	sleeping.store(true);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
 
-	messages[write_ptr].push(data);
-
-	write_ptr = (write_ptr + 1) % NUM_QUEUES;
-	++num_writes;
+	data = TryGet();
 
-	if ( need_signal )
+	if ( ! data )
 		{
-		lock.unlock();
-		has_data[old_write_ptr].notify_one();
+		struct pollfd pfd = { wakeup.FD(), POLLIN, 0 };
+		poll(&pfd, 1, 5000);
 		}
-	}
-
 
-template<typename T>
-inline bool Queue<T>::Ready()
-	{
-	auto lock = acquire_lock(mutex[read_ptr]);
+	sleeping.store(false);
+	wakeup.Extinguish();
 
-	bool ret = (messages[read_ptr].size());
-
-	return ret;
+	return data ? data : TryGet();
 	}
 
 template<typename T>
-inline std::vector<std::unique_lock<std::mutex>> Queue<T>::LocksForAllQueues()
+inline void Queue<T>::Put(T data)
 	{
-	std::vector<std::unique_lock<std::mutex>> locks;
+	uint64_t t = tail.load(std::memory_order_relaxed);
 
-	try
+	// Count the write before the reader can see the element, so that
+	// Size() never underflows.
+	++num_writes;
+
+	if ( spill_size.load(std::memory_order_acquire) == 0 &&
+	     t - head.load(std::memory_order_acquire) < RING_SIZE )
 		{
-		for ( int i = 0; i < NUM_QUEUES; i++ )
-			locks.emplace_back(std::unique_lock<std::mutex>(mutex[i]));
+		ring[t & (RING_SIZE - 1)] = data;
+		tail.store(t + 1, std::memory_order_release);
 		}
 
-	catch ( const std::system_error& e )
+	else
 		{
-		reporter->FatalErrorWithCore("cannot lock all mutexes: %s", e.what());
-		// Never gets here.
-		throw std::exception();
+		auto lock = acquire_lock(spill_mutex);
+		spill.push_back(data);
+		spill_size.store(spill.size(), std::memory_order_release);
+		++num_spilled;
 		}
 
-	return locks;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if ( sleeping.load() )
+		wakeup.Fire();
 	}
 
 template<typename T>
-inline uint64_t Queue<T>::Size()
+inline bool Queue<T>::Ready()
 	{
-	// Need to lock all queues.
-	auto locks = LocksForAllQueues();
-
-	uint64_t size = 0;
-
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		size += messages[i].size();
+	return ! reader_spill.empty() ||
+		head.load(std::memory_order_relaxed) != tail.load(std::memory_order_acquire) ||
+		spill_size.load(std::memory_order_acquire) != 0;
+	}
 
-	return size;
+template<typename T>
+inline uint64_t Queue<T>::Size()
+	{
+	// Load reads first: a write is always counted before its read.
+	uint64_t reads = num_reads;
+	return num_writes - reads;
 	}
 
 template<typename T>
 inline void Queue<T>::GetStats(Stats* stats)
 	{
-	// To be safe, we look all queues. That's probably unneccessary, but
-	// doesn't really hurt.
-	auto locks = LocksForAllQueues();
-
 	stats->num_reads = num_reads;
 	stats->num_writes = num_writes;
+	stats->num_spilled = num_spilled;
 	}
 
 template<typename T>
 inline void Queue<T>::WakeUp()
 	{
-	for ( int i = 0; i < NUM_QUEUES; i++ )
-		{
-		auto lock = acquire_lock(mutex[i]);
-		has_data[i].notify_all();
-		}
+	wakeup.Fire();
 	}
 
 }
@@ -0,0 +1,124 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "ThreadPool.h"
+
+#include <cstdio>
+
+#include "BasicThread.h"
+#include "DebugLogger.h"
+#include "MsgThread.h"
+#include "util.h"
+#include "zeek-affinity.h"
+
+using namespace threading;
+
+// The index of the pool thread the current thread is, or -1 if it's none.
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(int num_threads, std::optional<std::vector<int>> arg_cpus)
+	: cpus(std::move(arg_cpus)), num_queued(0), stopping(false), next_worker(0)
+	{
+	if ( num_threads < 1 )
+		num_threads = 1;
+
+	for ( int i = 0; i < num_threads; ++i )
+		workers.emplace_back(new Worker());
+
+	for ( int i = 0; i < num_threads; ++i )
+		workers[i]->thread = std::thread(&ThreadPool::Run, this, i);
+
+	DBG_LOG(DBG_THREADING, "Started thread pool with %d threads", num_threads);
+	}
+
+ThreadPool::~ThreadPool()
+	{
+		{
+		std::lock_guard<std::mutex> lock(idle_mutex);
+		stopping = true;
+		}
+
+	idle_cond.notify_all();
+
+	for ( auto& w : workers )
+		w->thread.join();
+	}
+
+void ThreadPool::Schedule(MsgThread* task)
+	{
+	int idx = current_worker;
+
+	if ( idx < 0 )
+		idx = next_worker++ % workers.size();
+
+	auto& w = *workers[idx];
+	std::unique_lock<std::mutex> lock(w.mutex);
+	w.tasks.push_back(task);
+	lock.unlock();
+
+	std::unique_lock<std::mutex> idle_lock(idle_mutex);
+	++num_queued;
+	idle_lock.unlock();
+
+	idle_cond.notify_one();
+	}
+
+MsgThread* ThreadPool::Next(int idx)
+	{
+	int n = workers.size();
+
+	for ( int i = 0; i < n; ++i )
+		{
+		auto& w = *workers[(idx + i) % n];
+		std::lock_guard<std::mutex> lock(w.mutex);
+
+		if ( w.tasks.empty() )
+			continue;
+
+		MsgThread* task;
+
+		// Our own tasks come from the front, stolen ones from the back.
+		if ( i == 0 )
+			{
+			task = w.tasks.front();
+			w.tasks.pop_front();
+			}
+		else
+			{
+			task = w.tasks.back();
+			w.tasks.pop_back();
+			}
+
+		--num_queued;
+		return task;
+		}
+
+	return nullptr;
+	}
+
+void ThreadPool::Run(int idx)
+	{
+	current_worker = idx;
+	BasicThread::BlockSignals();
+
+	if ( cpus )
+		zeek::set_thread_affinity(*cpus);
+
+	char name[32];
+	snprintf(name, sizeof(name), "zk.pool-%d", idx);
+	zeek::set_thread_name(name);
+
+	while ( true )
+		{
+		if ( auto task = Next(idx) )
+			{
+			task->RunTask();
+			continue;
+			}
+
+		std::unique_lock<std::mutex> lock(idle_mutex);
+		idle_cond.wait(lock, [this] { return stopping || num_queued > 0; });
+
+		if ( stopping )
+			break;
+		}
+	}
@@ -0,0 +1,93 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace threading {
+
+class MsgThread;
+
+/**
+ * A fixed set of OS threads that MsgThreads can run on as tasks, rather
+ * than each having a thread of its own (see \c Threading::use_pool). A
+ * MsgThread gets scheduled when there are messages for it and then
+ * processes a batch of them on one of the pool's threads.
+ *
+ * Each pool thread has its own queue of scheduled tasks, and threads
+ * running out of work steal from the others. A task that reschedules
+ * itself goes to the back of the queue of the thread it ran on, so that
+ * the others waiting there get their turn first.
+ *
+ * A task is never scheduled more than once at a time, see
+ * MsgThread::Schedule(), so a MsgThread still processes its messages one
+ * by one and in order.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * Constructor, which starts the pool's threads.
+	 *
+	 * @param num_threads The number of threads, at least one.
+	 *
+	 * @param cpus The CPUs for the threads to run on, see
+	 * BasicThread::SetCPUs().
+	 */
+	explicit ThreadPool(int num_threads, std::optional<std::vector<int>> cpus = {});
+
+	/**
+	 * Destructor. Stops the pool's threads once they're done with the
+	 * tasks they're running, dropping those not yet started.
+	 */
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * Queues a task for execution by one of the pool's threads. Safe to
+	 * call from any thread.
+	 */
+	void Schedule(MsgThread* task);
+
+	/**
+	 * Returns the number of the pool's threads.
+	 */
+	int NumThreads() const	{ return workers.size(); }
+
+private:
+	struct Worker {
+		std::mutex mutex;
+		std::deque<MsgThread*> tasks;
+		std::thread thread;
+	};
+
+	// Main loop of the pool's threads.
+	void Run(int idx);
+
+	// Takes the next task off the given thread's queue, or else steals
+	// one from another's. Returns null if there is none.
+	MsgThread* Next(int idx);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::optional<std::vector<int>> cpus;
+
+	// Idle threads wait for the number of queued tasks to go up.
+	std::mutex idle_mutex;
+	std::condition_variable idle_cond;
+	std::atomic<uint64_t> num_queued;
+	std::atomic<bool> stopping;
+
+	// For spreading tasks scheduled from outside the pool.
+	std::atomic<uint64_t> next_worker;
+};
+
+}
@@ -0,0 +1,77 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#include "ValueArena.h"
+
+#include <algorithm>
+#include <new>
+
+#include <string.h>
+
+using namespace threading;
+
+// The first chunk has room for a few hundred typical log lines' worth of
+// values; later ones double up to the maximum.
+static constexpr size_t min_chunk_size = 16 * 1024;
+static constexpr size_t max_chunk_size = 1024 * 1024;
+
+ValueArena::~ValueArena()
+	{
+	for ( auto& c : chunks )
+		delete [] c.data;
+
+	delete [] cur.data;
+	}
+
+void* ValueArena::Allocate(size_t size)
+	{
+	size = (size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+
+	if ( used + size > cur.size )
+		{
+		if ( cur.data )
+			{
+			cur.used = used;
+			chunks.push_back(cur);
+			}
+
+		size_t chunk_size = std::min(std::max(cur.size * 2, min_chunk_size), max_chunk_size);
+		chunk_size = std::max(chunk_size, size);
+		cur.data = new char[chunk_size];
+		cur.size = chunk_size;
+		used = 0;
+		}
+
+	void* p = cur.data + used;
+	used += size;
+	return p;
+	}
+
+void ValueArena::Rewind(const Mark& m)
+	{
+	while ( chunks.size() > m.chunk )
+		{
+		delete [] cur.data;
+		cur = chunks.back();
+		chunks.pop_back();
+		}
+
+	used = m.used;
+	}
+
+Value* ValueArena::NewValue(zeek::TypeTag type, bool present)
+	{
+	return new (Allocate(sizeof(Value))) Value(type, present);
+	}
+
+Value** ValueArena::NewValueArray(size_t n)
+	{
+	return static_cast<Value**>(Allocate(n * sizeof(Value*)));
+	}
+
+char* ValueArena::NewString(const char* data, size_t len)
+	{
+	auto s = static_cast<char*>(Allocate(len + 1));
+	memcpy(s, data, len);
+	s[len] = '\0';
+	return s;
+	}
@@ -0,0 +1,75 @@
+// See the file "COPYING" in the main distribution directory for copyright.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "SerialTypes.h"
+
+namespace threading {
+
+/**
+ * Memory for the values of a batch of log writes, which goes away with
+ * the batch in one step instead of value by value. It hands out the
+ * Value objects themselves, their arrays, and their string data, all from
+ * a few contiguous chunks. Values allocated here must not be deleted
+ * individually; their destructors never run.
+ */
+class ValueArena {
+public:
+	/**
+	 * A position to go back to with Rewind().
+	 */
+	struct Mark {
+		size_t chunk;
+		size_t used;
+	};
+
+	ValueArena()	{ }
+	~ValueArena();
+
+	ValueArena(const ValueArena&) = delete;
+	ValueArena& operator=(const ValueArena&) = delete;
+
+	/**
+	 * Returns a new value of the given type.
+	 */
+	Value* NewValue(zeek::TypeTag type, bool present = true);
+
+	/**
+	 * Returns an uninitialized array of n value pointers.
+	 */
+	Value** NewValueArray(size_t n);
+
+	/**
+	 * Returns a copy of len bytes, for a value's string data.
+	 */
+	char* NewString(const char* data, size_t len);
+
+	/**
+	 * Returns the current position.
+	 */
+	Mark GetMark() const	{ return {chunks.size(), used}; }
+
+	/**
+	 * Releases everything allocated since a mark was taken.
+	 */
+	void Rewind(const Mark& m);
+
+private:
+	void* Allocate(size_t size);
+
+	struct Chunk {
+		char* data;
+		size_t size;
+		size_t used;
+	};
+
+	// All chunks but the current one, which is "cur".
+	std::vector<Chunk> chunks;
+	Chunk cur = {nullptr, 0, 0};
+	size_t used = 0;	// of the current chunk
+};
+
+}
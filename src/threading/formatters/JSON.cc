@@ -4,7 +4,10 @@
 
 #include "JSON.h"
 #include "rapidjson/internal/ieee754.h"
+#include "rapidjson/internal/dtoa.h"
+#include "rapidjson/internal/itoa.h"
 #include "Desc.h"
+#include "ConvertUTF.h"
 #include "threading/MsgThread.h"
 
 #ifndef __STDC_LIMIT_MACROS
@@ -16,6 +19,10 @@
 #include <math.h>
 #include <stdint.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 using namespace threading::formatter;
 
 bool JSON::NullDoubleWriter::Double(double d)
@@ -26,6 +33,146 @@ bool JSON::NullDoubleWriter::Double(double d)
 	return rapidjson::Writer<rapidjson::StringBuffer>::Double(d);
 	}
 
+// Returns the first byte that can't go into a JSON string as it is:
+// control characters, quotes, backslashes, and non-ASCII bytes, which
+// need UTF-8 validation.
+static const char* find_special(const char* p, const char* end)
+	{
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(0x20);
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+
+	for ( ; end - p >= 16; p += 16 )
+		{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+
+		// As the comparison is signed, this catches bytes >= 0x80 too.
+		__m128i hits = _mm_cmplt_epi8(block, space);
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, quote));
+		hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, backslash));
+
+		if ( int mask = _mm_movemask_epi8(hits) )
+			return p + __builtin_ctz(mask);
+		}
+#endif
+
+	for ( ; p < end; ++p )
+		{
+		auto c = static_cast<unsigned char>(*p);
+
+		if ( c < 0x20 || c >= 0x80 || c == '"' || c == '\\' )
+			break;
+		}
+
+	return p;
+	}
+
+// Appends a quoted JSON string. With escape_invalid, this matches what
+// json_escape_utf8() followed by rapidjson's writer used to produce:
+// control characters other than the common ones, as well as bytes that
+// aren't part of valid UTF-8, become "\\xNN" escapes. Without it, only
+// what JSON requires gets escaped, the way rapidjson does it.
+static void add_json_string(ODesc* desc, const char* s, size_t len, bool escape_invalid)
+	{
+	static constexpr char hex_chars[] = "0123456789ABCDEF";
+	auto p = s;
+	auto end = s + len;
+
+	desc->AddN("\"", 1);
+
+	while ( p < end )
+		{
+		auto q = find_special(p, end);
+
+		if ( q > p )
+			desc->AddN(p, q - p);
+
+		if ( q == end )
+			break;
+
+		auto c = static_cast<unsigned char>(*q);
+		p = q + 1;
+
+		switch ( c ) {
+		case '"': desc->AddN("\\\"", 2); continue;
+		case '\\': desc->AddN("\\\\", 2); continue;
+		case '\b': desc->AddN("\\b", 2); continue;
+		case '\f': desc->AddN("\\f", 2); continue;
+		case '\n': desc->AddN("\\n", 2); continue;
+		case '\r': desc->AddN("\\r", 2); continue;
+		case '\t': desc->AddN("\\t", 2); continue;
+		}
+
+		if ( c >= 0x80 )
+			{
+			auto u = reinterpret_cast<const UTF8*>(q);
+			unsigned int n = getNumBytesForUTF8(c);
+
+			if ( ! escape_invalid ||
+			     (n > 0 && q + n <= end && isLegalUTF8Sequence(u, u + n)) )
+				{
+				if ( ! escape_invalid )
+					n = 1;
+
+				desc->AddN(q, n);
+				p = q + n;
+				continue;
+				}
+			}
+
+		if ( escape_invalid )
+			{
+			char buf[5] = {'\\', '\\', 'x'};
+			bytetohex(c, buf + 3);
+			desc->AddN(buf, 5);
+			}
+		else
+			{
+			char buf[6] = {'\\', 'u', '0', '0'};
+			buf[4] = hex_chars[c >> 4];
+			buf[5] = hex_chars[c & 0xf];
+			desc->AddN(buf, 6);
+			}
+		}
+
+	desc->AddN("\"", 1);
+	}
+
+static void add_json_string(ODesc* desc, const std::string& s, bool escape_invalid)
+	{
+	add_json_string(desc, s.data(), s.size(), escape_invalid);
+	}
+
+static void add_json_double(ODesc* desc, double d)
+	{
+	if ( rapidjson::internal::Double(d).IsNanOrInf() )
+		{
+		desc->AddN("null", 4);
+		return;
+		}
+
+	// The same shortest round-trip formatting that rapidjson's writer
+	// applies, without going through it.
+	char buf[32];
+	char* end = rapidjson::internal::dtoa(d, buf);
+	desc->AddN(buf, end - buf);
+	}
+
+static void add_json_int(ODesc* desc, int64_t i)
+	{
+	char buf[24];
+	char* end = rapidjson::internal::i64toa(i, buf);
+	desc->AddN(buf, end - buf);
+	}
+
+static void add_json_uint(ODesc* desc, uint64_t u)
+	{
+	char buf[24];
+	char* end = rapidjson::internal::u64toa(u, buf);
+	desc->AddN(buf, end - buf);
+	}
+
 JSON::JSON(MsgThread* t, TimeFormat tf) : Formatter(t), surrounding_braces(true)
 	{
 	timestamps = tf;
@@ -38,19 +185,23 @@ JSON::~JSON()
 bool JSON::Describe(ODesc* desc, int num_fields, const Field* const * fields,
                     Value** vals) const
 	{
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	bool first = true;
 
-	writer.StartObject();
+	desc->AddN("{", 1);
 
 	for ( int i = 0; i < num_fields; i++ )
 		{
-		if ( vals[i]->present )
-			BuildJSON(writer, vals[i], fields[i]->name);
+		if ( ! vals[i]->present )
+			continue;
+
+		if ( ! first )
+			desc->AddN(",", 1);
+
+		BuildJSON(desc, vals[i], fields[i]->name);
+		first = false;
 		}
 
-	writer.EndObject();
-	desc->Add(buffer.GetString());
+	desc->AddN("}", 1);
 
 	return true;
 	}
@@ -66,15 +217,10 @@ bool JSON::Describe(ODesc* desc, Value* val, const std::string& name) const
 	if ( ! val->present || name.empty() )
 		return true;
 
-	rapidjson::Document doc;
-	rapidjson::StringBuffer buffer;
-	NullDoubleWriter writer(buffer);
+	desc->AddN("{", 1);
+	BuildJSON(desc, val, name.c_str());
+	desc->AddN("}", 1);
 
-	writer.StartObject();
-	BuildJSON(writer, val, name);
-	writer.EndObject();
-
-	desc->Add(buffer.GetString());
 	return true;
 	}
 
@@ -84,47 +230,53 @@ threading::Value* JSON::ParseValue(const std::string& s, const std::string& name
 	return nullptr;
 	}
 
-void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name) const
+void JSON::BuildJSON(ODesc* desc, const Value* val, const char* name) const
 	{
+	if ( name )
+		{
+		add_json_string(desc, name, strlen(name), false);
+		desc->AddN(":", 1);
+		}
+
 	if ( ! val->present )
 		{
-		writer.Null();
+		desc->AddN("null", 4);
 		return;
 		}
 
-	if ( ! name.empty() )
-		writer.Key(name);
-
 	switch ( val->type )
 		{
 		case zeek::TYPE_BOOL:
-			writer.Bool(val->val.int_val != 0);
+			if ( val->val.int_val != 0 )
+				desc->AddN("true", 4);
+			else
+				desc->AddN("false", 5);
 			break;
 
 		case zeek::TYPE_INT:
-			writer.Int64(val->val.int_val);
+			add_json_int(desc, val->val.int_val);
 			break;
 
 		case zeek::TYPE_COUNT:
 		case zeek::TYPE_COUNTER:
-			writer.Uint64(val->val.uint_val);
+			add_json_uint(desc, val->val.uint_val);
 			break;
 
 		case zeek::TYPE_PORT:
-			writer.Uint64(val->val.port_val.port);
+			add_json_uint(desc, val->val.port_val.port);
 			break;
 
 		case zeek::TYPE_SUBNET:
-			writer.String(Formatter::Render(val->val.subnet_val));
+			add_json_string(desc, Formatter::Render(val->val.subnet_val), false);
 			break;
 
 		case zeek::TYPE_ADDR:
-			writer.String(Formatter::Render(val->val.addr_val));
+			add_json_string(desc, Formatter::Render(val->val.addr_val), false);
 			break;
 
 		case zeek::TYPE_DOUBLE:
 		case zeek::TYPE_INTERVAL:
-			writer.Double(val->val.double_val);
+			add_json_double(desc, val->val.double_val);
 			break;
 
 		case zeek::TYPE_TIME:
@@ -142,7 +294,7 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 					GetThread()->Error(GetThread()->Fmt("json formatter: failure getting time: (%lf)", val->val.double_val));
 					// This was a failure, doesn't really matter what gets put here
 					// but it should probably stand out...
-					writer.String("2000-01-01T00:00:00.000000");
+					add_json_string(desc, "2000-01-01T00:00:00.000000", false);
 					}
 				else
 					{
@@ -153,17 +305,17 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 						frac += 1;
 
 					snprintf(buffer2, sizeof(buffer2), "%s.%06.0fZ", buffer, fabs(frac) * 1000000);
-					writer.String(buffer2, strlen(buffer2));
+					add_json_string(desc, buffer2, strlen(buffer2), false);
 					}
 				}
 
 			else if ( timestamps == TS_EPOCH )
-				writer.Double(val->val.double_val);
+				add_json_double(desc, val->val.double_val);
 
 			else if ( timestamps == TS_MILLIS )
 				{
 				// ElasticSearch uses milliseconds for timestamps
-				writer.Uint64((uint64_t) (val->val.double_val * 1000));
+				add_json_uint(desc, (uint64_t) (val->val.double_val * 1000));
 				}
 
 			break;
@@ -174,29 +326,26 @@ void JSON::BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& na
 		case zeek::TYPE_FILE:
 		case zeek::TYPE_FUNC:
 			{
-			writer.String(json_escape_utf8(std::string(val->val.string_val.data, val->val.string_val.length)));
+			add_json_string(desc, val->val.string_val.data, val->val.string_val.length, true);
 			break;
 			}
 
 		case zeek::TYPE_TABLE:
+		case zeek::TYPE_VECTOR:
 			{
-			writer.StartArray();
-
-			for ( int idx = 0; idx < val->val.set_val.size; idx++ )
-				BuildJSON(writer, val->val.set_val.vals[idx]);
+			const auto& elements = val->type == zeek::TYPE_TABLE ? val->val.set_val : val->val.vector_val;
 
-			writer.EndArray();
-			break;
-			}
+			desc->AddN("[", 1);
 
-		case zeek::TYPE_VECTOR:
-			{
-			writer.StartArray();
+			for ( int idx = 0; idx < elements.size; idx++ )
+				{
+				if ( idx > 0 )
+					desc->AddN(",", 1);
 
-			for ( int idx = 0; idx < val->val.vector_val.size; idx++ )
-				BuildJSON(writer, val->val.vector_val.vals[idx]);
+				BuildJSON(desc, elements.vals[idx]);
+				}
 
-			writer.EndArray();
+			desc->AddN("]", 1);
 			break;
 			}
 
@@ -37,7 +37,8 @@ public:
 	};
 
 private:
-	void BuildJSON(NullDoubleWriter& writer, Value* val, const std::string& name = "") const;
+	// Appends a value, along with its key if there's a name.
+	void BuildJSON(ODesc* desc, const Value* val, const char* name = nullptr) const;
 
 	TimeFormat timestamps;
 	bool surrounding_braces;
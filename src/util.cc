@@ -731,6 +731,19 @@ TEST_CASE("util strstr_n")
 
 	out = strstr_n(16, s, 9, reinterpret_cast<const u_char*>("not there"));
 	CHECK(out == -1);
+
+	out = strstr_n(16, s, 2, reinterpret_cast<const u_char*>("ng"));
+	CHECK(out == 14);
+
+	out = strstr_n(16, s, 16, s);
+	CHECK(out == 0);
+
+	out = strstr_n(16, s, 0, s);
+	CHECK(out == 0);
+
+	const u_char* r = reinterpret_cast<const u_char*>("aaab");
+	out = strstr_n(4, r, 2, reinterpret_cast<const u_char*>("ab"));
+	CHECK(out == 2);
 	}
 
 int strstr_n(const int big_len, const u_char* big,
@@ -739,10 +752,24 @@ int strstr_n(const int big_len, const u_char* big,
 	if ( little_len > big_len )
 		return -1;
 
-	for ( int i = 0; i <= big_len - little_len; ++i )
+	if ( little_len == 0 )
+		return 0;
+
+	// Let memchr(), which is vectorized, find the candidates.
+	const u_char* p = big;
+	const u_char* last = big + big_len - little_len;
+
+	while ( p <= last )
 		{
-		if ( ! memcmp(big + i, little, little_len) )
-			return i;
+		p = static_cast<const u_char*>(memchr(p, little[0], last - p + 1));
+
+		if ( ! p )
+			return -1;
+
+		if ( ! memcmp(p + 1, little + 1, little_len - 1) )
+			return p - big;
+
+		++p;
 		}
 
 	return -1;
@@ -2058,6 +2085,76 @@ int time_compare(struct timeval* tv_a, struct timeval* tv_b)
 		return tv_a->tv_sec - tv_b->tv_sec;
 	}
 
+// Number of ChaCha rounds for UID generation. Twelve rounds keep a wide
+// security margin while taking about half the time of the full twenty.
+static constexpr int UID_CHACHA_ROUNDS = 12;
+
+static inline uint32_t rotl32(uint32_t v, int n)
+	{
+	return (v << n) | (v >> (32 - n));
+	}
+
+#define CHACHA_QUARTER_ROUND(a, b, c, d) \
+	a += b; d ^= a; d = rotl32(d, 16); \
+	c += d; b ^= c; b = rotl32(b, 12); \
+	a += b; d ^= a; d = rotl32(d, 8); \
+	c += d; b ^= c; b = rotl32(b, 7);
+
+// Computes one ChaCha block for a 256-bit key, a 64-bit block counter, and
+// a 64-bit nonce, returning the 512-bit keystream as eight 64-bit words.
+static void chacha_block(const uint32_t key[8], uint64_t counter, uint64_t nonce,
+                         int rounds, uint64_t out[8])
+	{
+	uint32_t in[16] = {
+		0x61707865, 0x3320646e, 0x79622d32, 0x6b206574,
+		key[0], key[1], key[2], key[3], key[4], key[5], key[6], key[7],
+		static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+		static_cast<uint32_t>(nonce), static_cast<uint32_t>(nonce >> 32),
+	};
+
+	uint32_t x[16];
+	std::copy(in, in + 16, x);
+
+	for ( int i = 0; i < rounds; i += 2 )
+		{
+		CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+		CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+		CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+		CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+		CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+		CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+		CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+		CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+		}
+
+	for ( int i = 0; i < 8; ++i )
+		out[i] = static_cast<uint64_t>(x[2 * i] + in[2 * i]) |
+		         (static_cast<uint64_t>(x[2 * i + 1] + in[2 * i + 1]) << 32);
+	}
+
+#undef CHACHA_QUARTER_ROUND
+
+TEST_CASE("util chacha_block")
+	{
+	// Test vector from RFC 8439, section 2.3.2. Its 96-bit nonce and
+	// 32-bit counter map onto our 64-bit counter and nonce.
+	uint32_t key[8];
+	for ( int i = 0; i < 8; ++i )
+		key[i] = (4 * i) | ((4 * i + 1) << 8) | ((4 * i + 2) << 16) | ((4 * i + 3) << 24);
+
+	uint64_t out[8];
+	chacha_block(key, 0x0900000000000001, 0x4a000000, 20, out);
+
+	CHECK(out[0] == 0x15593bd1e4e7f110);
+	CHECK(out[1] == 0xc47120a31fdd0f50);
+	CHECK(out[2] == 0x0368c033c7f4d1c7);
+	CHECK(out[3] == 0x4e6cd4c39aaa2204);
+	CHECK(out[4] == 0x09aa9f07466482d2);
+	CHECK(out[5] == 0xa2028bd905d7c214);
+	CHECK(out[6] == 0xb94e16ded19c12b5);
+	CHECK(out[7] == 0x4e3c50a2e883d0cb);
+	}
+
 struct UIDEntry {
 	UIDEntry() : key(0, 0), needs_init(true) { }
 	UIDEntry(const uint64_t i) : key(i, 0), needs_init(false) { }
@@ -2069,6 +2166,14 @@ struct UIDEntry {
 	} key;
 
 	bool needs_init;
+
+	// Keystream state when not running deterministically. The IDs are
+	// the output of ChaCha in counter mode, a block of eight at a time.
+	bool use_chacha = false;
+	uint32_t chacha_key[8];
+	uint64_t block = 0;
+	uint64_t batch[8];
+	size_t next = 8;
 };
 
 static std::vector<UIDEntry> uid_pool;
@@ -2080,7 +2185,24 @@ uint64_t calculate_unique_id()
 
 uint64_t calculate_unique_id(size_t pool)
 	{
-	uint64_t uid_instance = 0;
+	if ( pool < uid_pool.size() && ! uid_pool[pool].needs_init )
+		{
+		UIDEntry& e = uid_pool[pool];
+
+		if ( e.use_chacha )
+			{
+			if ( e.next == 8 )
+				{
+				chacha_block(e.chacha_key, e.block++, pool, UID_CHACHA_ROUNDS, e.batch);
+				e.next = 0;
+				}
+
+			return e.batch[e.next++];
+			}
+
+		++e.key.counter;
+		return HashKey::HashBytes(&e.key, sizeof(e.key));
+		}
 
 	if( pool >= uid_pool.size() )
 		{
@@ -2090,6 +2212,9 @@ uint64_t calculate_unique_id(size_t pool)
 			{
 			reporter->Warning("pool passed to calculate_unique_id() too large, using default");
 			pool = UID_POOL_DEFAULT_INTERNAL;
+
+			if ( pool >= uid_pool.size() )
+				uid_pool.resize(pool + 1);
 			}
 		}
 
@@ -2099,9 +2224,8 @@ uint64_t calculate_unique_id(size_t pool)
 		if ( ! have_random_seed() )
 			{
 			// If we don't need deterministic output (as
-			// indicated by a set seed), we calculate the
-			// instance ID by hashing something likely to be
-			// globally unique.
+			// indicated by a set seed), we key the generator by
+			// hashing something likely to be globally unique.
 			struct {
 				char hostname[120];
 				uint64_t pool;
@@ -2118,22 +2242,28 @@ uint64_t calculate_unique_id(size_t pool)
 			unique.pid = getpid();
 			unique.rnd = static_cast<int>(zeek::random_number());
 
-			uid_instance = HashKey::HashBytes(&unique, sizeof(unique));
-			++uid_instance; // Now it's larger than zero.
+			hash256_t digest;
+			KeyedHash::Hash256(&unique, sizeof(unique), &digest);
+
+			UIDEntry e(digest[0] + 1);
+			e.use_chacha = true;
+
+			for ( int i = 0; i < 4; ++i )
+				{
+				e.chacha_key[2 * i] = static_cast<uint32_t>(digest[i]);
+				e.chacha_key[2 * i + 1] = static_cast<uint32_t>(digest[i] >> 32);
+				}
+
+			uid_pool[pool] = e;
 			}
 		else
-			// Generate determistic UIDs for each individual pool.
-			uid_instance = pool;
-
-		// Our instance is unique.  Huzzah.
-		uid_pool[pool] = UIDEntry(uid_instance);
+			// Generate determistic UIDs for each individual pool,
+			// hashing a counter as before so that they remain
+			// stable across versions.
+			uid_pool[pool] = UIDEntry(pool);
 		}
 
-	assert(!uid_pool[pool].needs_init);
-	assert(uid_pool[pool].key.instance != 0);
-
-	++uid_pool[pool].key.counter;
-	return HashKey::HashBytes(&(uid_pool[pool].key), sizeof(uid_pool[pool].key));
+	return calculate_unique_id(pool);
 	}
 
 bool safe_write(int fd, const char* data, int len)
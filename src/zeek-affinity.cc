@@ -13,6 +13,10 @@
 #endif
 
 #include <sched.h>
+#include <cerrno>
+#include <mutex>
+
+#include "zeek-affinity.h"
 
 namespace zeek {
 bool set_affinity(int core_number)
@@ -23,12 +27,59 @@ bool set_affinity(int core_number)
 	auto res = sched_setaffinity(0, sizeof(cpus), &cpus);
 	return res == 0;
 	}
+
+bool set_thread_affinity(const std::vector<int>& cores)
+	{
+	static cpu_set_t initial_cpus;
+	static bool have_initial_cpus = false;
+	static std::once_flag once;
+
+	std::call_once(once, []
+		{
+		CPU_ZERO(&initial_cpus);
+		have_initial_cpus =
+			sched_getaffinity(0, sizeof(initial_cpus), &initial_cpus) == 0;
+		});
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+
+	if ( cores.empty() )
+		{
+		if ( ! have_initial_cpus )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		cpus = initial_cpus;
+		}
+
+	for ( auto c : cores )
+		{
+		if ( c < 0 || c >= CPU_SETSIZE )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		CPU_SET(c, &cpus);
+		}
+
+	// On Linux, this applies to the calling thread only.
+	auto res = sched_setaffinity(0, sizeof(cpus), &cpus);
+	return res == 0;
+	}
 } // namespace zeek
 
 #elif defined(__FreeBSD__)
 
 #include <sys/param.h>
 #include <sys/cpuset.h>
+#include <cerrno>
+#include <mutex>
+
+#include "zeek-affinity.h"
 
 namespace zeek {
 bool set_affinity(int core_number)
@@ -40,18 +91,70 @@ bool set_affinity(int core_number)
 	                              sizeof(cpus), &cpus);
 	return res == 0;
 	}
+
+bool set_thread_affinity(const std::vector<int>& cores)
+	{
+	static cpuset_t initial_cpus;
+	static bool have_initial_cpus = false;
+	static std::once_flag once;
+
+	std::call_once(once, []
+		{
+		CPU_ZERO(&initial_cpus);
+		have_initial_cpus =
+			cpuset_getaffinity(CPU_LEVEL_WHICH, CPU_WHICH_PID, -1,
+			                   sizeof(initial_cpus), &initial_cpus) == 0;
+		});
+
+	cpuset_t cpus;
+	CPU_ZERO(&cpus);
+
+	if ( cores.empty() )
+		{
+		if ( ! have_initial_cpus )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		cpus = initial_cpus;
+		}
+
+	for ( auto c : cores )
+		{
+		if ( c < 0 || c >= CPU_SETSIZE )
+			{
+			errno = EINVAL;
+			return false;
+			}
+
+		CPU_SET(c, &cpus);
+		}
+
+	auto res = cpuset_setaffinity(CPU_LEVEL_WHICH, CPU_WHICH_TID, -1,
+	                              sizeof(cpus), &cpus);
+	return res == 0;
+	}
 } // namespace zeek
 
 #else
 
 #include <cerrno>
 
+#include "zeek-affinity.h"
+
 namespace zeek {
 bool set_affinity(int core_number)
 	{
 	errno = ENOTSUP;
 	return false;
 	}
+
+bool set_thread_affinity(const std::vector<int>& cores)
+	{
+	errno = ENOTSUP;
+	return false;
+	}
 } // namespace zeek
 
 #endif
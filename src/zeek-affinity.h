@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <vector>
+
 namespace zeek {
 
 /**
@@ -14,4 +16,14 @@ namespace zeek {
  */
 bool set_affinity(int core_number);
 
+/**
+ * Restricts the calling thread to a set of CPUs. Threads started by it
+ * afterwards inherit that. Currently only supported on Linux and FreeBSD.
+ * @param cores  the CPUs the thread may run on. If empty, the thread may
+ * run on those that the process could when this was first called.
+ * @return true if the affinity is successfully set and false if not with
+ * errno additionally being set to indicate the reason.
+ */
+bool set_thread_affinity(const std::vector<int>& cores);
+
 } // namespace zeek
@@ -27,6 +27,7 @@ extern "C" {
 #include "Frame.h"
 #include "Scope.h"
 #include "Event.h"
+#include "EventTrace.h"
 #include "File.h"
 #include "Reporter.h"
 #include "Net.h"
@@ -37,6 +38,11 @@ extern "C" {
 #include "Desc.h"
 #include "Debug.h"
 #include "DFA.h"
+#include "DFACache.h"
+#include "Metrics.h"
+#include "HugePages.h"
+#include "MemoryAccount.h"
+#include "HyperscanEngine.h"
 #include "RuleMatcher.h"
 #include "Anon.h"
 #include "EventRegistry.h"
@@ -46,6 +52,11 @@ extern "C" {
 #include "Trigger.h"
 #include "Hash.h"
 #include "Func.h"
+#include "Bytecode.h"
+#include "ConstFold.h"
+#include "FuncInline.h"
+#include "Overload.h"
+#include "ConnMemory.h"
 
 #include "supervisor/Supervisor.h"
 #include "threading/Manager.h"
@@ -58,6 +69,7 @@ extern "C" {
 #include "file_analysis/Manager.h"
 #include "zeekygen/Manager.h"
 #include "iosource/Manager.h"
+#include "iosource/PacketBalancer.h"
 #include "broker/Manager.h"
 
 #include "binpac_bro.h"
@@ -108,6 +120,12 @@ EventRegistry* event_registry = nullptr;
 ProfileLogger* profiling_logger = nullptr;
 ProfileLogger* segment_logger = nullptr;
 SampleLogger* sample_logger = nullptr;
+EventProfiler* event_profiler = nullptr;
+AnalyzerProfiler* analyzer_profiler = nullptr;
+PacketLatencyProfiler* packet_latency_profiler = nullptr;
+OverloadController* overload_controller = nullptr;
+ConnMemoryLimiter* conn_memory_limiter = nullptr;
+ScriptSampler* script_sampler = nullptr;
 int signal_val = 0;
 extern char version[];
 const char* command_line_policy = nullptr;
@@ -125,6 +143,9 @@ zeek::OpaqueTypePtr bloomfilter_type;
 zeek::OpaqueTypePtr x509_opaque_type;
 zeek::OpaqueTypePtr ocsp_resp_opaque_type;
 zeek::OpaqueTypePtr paraglob_type;
+zeek::OpaqueTypePtr pattern_set_type;
+zeek::OpaqueTypePtr intel_store_type;
+zeek::OpaqueTypePtr sumstats_agg_type;
 
 // Keep copy of command line
 int bro_argc;
@@ -268,6 +289,12 @@ void terminate_bro()
 	// the termination process.
 	file_mgr->Terminate();
 
+	if ( zeek::detail::event_trace_recorder )
+		{
+		delete zeek::detail::event_trace_recorder;
+		zeek::detail::event_trace_recorder = nullptr;
+		}
+
 	brofiler.WriteStats();
 
 	if ( zeek_done )
@@ -286,6 +313,39 @@ void terminate_bro()
 		delete profiling_logger;
 		}
 
+	if ( event_profiler )
+		{
+		event_profiler->Log();
+
+		const auto& folded = zeek::id::find_val("event_profiling_folded_file")->AsStringVal();
+
+		if ( folded->Len() > 0 && ! event_profiler->WriteFoldedStacks(folded->CheckString()) )
+			reporter->Error("failed to write event profiling stacks to %s",
+			                folded->CheckString());
+
+		delete event_profiler;
+		event_profiler = nullptr;
+		}
+
+	delete analyzer_profiler;
+	analyzer_profiler = nullptr;
+
+	delete overload_controller;
+	overload_controller = nullptr;
+
+	delete conn_memory_limiter;
+	conn_memory_limiter = nullptr;
+
+	if ( script_sampler )
+		{
+		if ( ! script_sampler->WriteFoldedStacks() )
+			reporter->Error("failed to write script samples to %s",
+			                script_sampler->Path().c_str());
+
+		delete script_sampler;
+		script_sampler = nullptr;
+		}
+
 	mgr.Drain();
 
 	notifier::registry.Terminate();
@@ -304,6 +364,9 @@ void terminate_bro()
 	delete file_mgr;
 	// broker_mgr, timer_mgr, and supervisor are deleted via iosource_mgr
 	delete iosource_mgr;
+	delete zeek::detail::metrics_registry;
+	// The metrics refer to its histograms.
+	delete packet_latency_profiler;
 	delete event_registry;
 	delete log_mgr;
 	delete reporter;
@@ -436,6 +499,8 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 		tokenize_string(zeek_prefixes, ":", &zeek_script_prefixes);
 
 	pseudo_realtime = options.pseudo_realtime;
+	flow_shard = options.flow_shard;
+	num_flow_shards = options.num_flow_shards;
 
 #ifdef USE_PERFTOOLS_DEBUG
 	perftools_leaks = options.perftools_check_leaks;
@@ -523,7 +588,12 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	createCurrentDoc("1.0");		// Set a global XML document
 #endif
 
-	timer_mgr = new PQ_TimerMgr();
+	const char* timer_mgr_type = zeekenv("ZEEK_TIMER_MGR");
+
+	if ( timer_mgr_type && streq(timer_mgr_type, "wheel") )
+		timer_mgr = new Wheel_TimerMgr();
+	else
+		timer_mgr = new PQ_TimerMgr();
 
 	auto zeekygen_cfg = options.zeekygen_config_file.value_or("");
 	zeekygen_mgr = new zeekygen::Manager(zeekygen_cfg, bro_argv[0]);
@@ -572,6 +642,9 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	broker_mgr = new bro_broker::Manager(broker_real_time);
 	trigger_mgr = new zeek::detail::trigger::Manager();
 
+	zeek::detail::metrics_registry = new zeek::detail::MetricsRegistry();
+	zeek::detail::register_core_metrics(zeek::detail::metrics_registry);
+
 	plugin_mgr->InitPreScript();
 	analyzer_mgr->InitPreScript();
 	file_mgr->InitPreScript();
@@ -593,6 +666,30 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 
 	init_event_handlers();
 
+	// Needs to exist before parsing the scripts, as that compiles their
+	// patterns.
+	if ( options.dfa_cache_file || options.dfa_cache_output_file )
+		{
+		zeek::detail::dfa_cache = new zeek::detail::DFA_Cache();
+
+		if ( options.dfa_cache_file &&
+		     ! zeek::detail::dfa_cache->Load(*options.dfa_cache_file) )
+			exit(1);
+
+		if ( options.dfa_cache_output_file )
+			zeek::detail::dfa_cache->RecordMachines();
+		}
+
+	if ( options.use_hyperscan )
+		{
+#ifdef USE_HYPERSCAN
+		zeek::detail::re_engine_factory = zeek::detail::make_hyperscan_engine;
+#else
+		fprintf(stderr, "error: Zeek was built without Hyperscan support\n");
+		exit(1);
+#endif
+		}
+
 	md5_type = zeek::make_intrusive<zeek::OpaqueType>("md5");
 	sha1_type = zeek::make_intrusive<zeek::OpaqueType>("sha1");
 	sha256_type = zeek::make_intrusive<zeek::OpaqueType>("sha256");
@@ -603,6 +700,9 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	x509_opaque_type = zeek::make_intrusive<zeek::OpaqueType>("x509");
 	ocsp_resp_opaque_type = zeek::make_intrusive<zeek::OpaqueType>("ocsp_resp");
 	paraglob_type = zeek::make_intrusive<zeek::OpaqueType>("paraglob");
+	pattern_set_type = zeek::make_intrusive<zeek::OpaqueType>("pattern_set");
+	intel_store_type = zeek::make_intrusive<zeek::OpaqueType>("intel_store");
+	sumstats_agg_type = zeek::make_intrusive<zeek::OpaqueType>("sumstats_agg");
 
 	// The leak-checker tends to produce some false
 	// positives (memory which had already been
@@ -637,6 +737,10 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 		"BinPAC::flowbuffer_contract_threshold")->GetVal()->AsCount();
 	binpac::init(&flowbuffer_policy);
 
+	zeek::detail::configure_huge_pages(zeek::BifConst::use_huge_pages,
+	                                   zeek::BifConst::huge_page_size);
+	zeek::detail::init_global_memory_accounts(zeek::detail::metrics_registry);
+
 	plugin_mgr->InitBifs();
 
 	if ( reporter->Errors() > 0 )
@@ -646,7 +750,12 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	log_mgr->InitPostScript();
 	plugin_mgr->InitPostScript();
 	zeekygen_mgr->InitPostScript();
+
+	// Broker's threads start out on the CPUs of the thread creating them.
+	thread_mgr->PlaceMainThread("Threading::broker_cpus");
 	broker_mgr->InitPostScript();
+	thread_mgr->PlaceMainThread("Threading::main_thread_cpus");
+
 	timer_mgr->InitPostScript();
 	mgr.InitPostScript();
 
@@ -718,11 +827,60 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 		file_mgr->InitMagic();
 		}
 
+	if ( zeek::detail::dfa_cache )
+		{
+		std::vector<std::string> loaded_files;
+
+		for ( const auto& sf : files_scanned )
+			if ( ! sf.skipped && ! sf.canonical_path.empty() )
+				loaded_files.emplace_back(sf.canonical_path);
+
+		for ( const auto& sf : all_signature_files )
+			loaded_files.emplace_back(find_file(sf, bro_path(), ".sig"));
+
+		auto files_digest = zeek::detail::DFA_Cache::FilesDigest(
+			loaded_files, command_line_policy ? command_line_policy : "");
+
+		if ( options.dfa_cache_file &&
+		     ! zeek::detail::dfa_cache->BuiltFrom(files_digest) )
+			reporter->Warning("DFA cache %s was built for different scripts or signatures, rebuild it with --build-dfa-cache",
+			                  options.dfa_cache_file->c_str());
+
+		zeek::detail::dfa_cache->SetFilesDigest(std::move(files_digest));
+		}
+
+	if ( options.dfa_cache_output_file )
+		{
+		bool success = zeek::detail::dfa_cache->Save(*options.dfa_cache_output_file);
+		delete dns_mgr;
+		exit(success ? 0 : 1);
+		}
+
 	if ( g_policy_debug )
 		// ### Add support for debug command file.
 		dbg_init_debugger(nullptr);
 
-	if ( ! options.pcap_file && ! options.interface )
+	// Folding removes statements, which would confuse both the debugger
+	// and the coverage statistics.
+	if ( options.const_fold_mode != "off" && ! g_policy_debug &&
+	     ! zeekenv("ZEEK_PROFILER_FILE") )
+		zeek::detail::fold_script_constants(options.const_fold_mode == "report");
+
+	// Likewise, inlined calls don't show up where the debugger and the
+	// coverage statistics expect them.
+	if ( options.inline_funcs_mode != "off" && ! g_policy_debug &&
+	     ! zeekenv("ZEEK_PROFILER_FILE") )
+		zeek::detail::inline_script_functions(options.inline_funcs_mode == "report");
+
+	if ( options.script_exec_mode != "ast" )
+		{
+		if ( g_policy_debug )
+			reporter->Warning("script debugging requires the AST interpreter, not compiling scripts");
+		else
+			zeek::detail::compile_script_functions(options.script_exec_mode == "validate");
+		}
+
+	if ( ! options.pcap_file && ! options.interface && ! options.replay_events_file )
 		{
 		const auto& interfaces_val = zeek::id::find_val("interfaces");
 		if ( interfaces_val )
@@ -740,6 +898,31 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	if ( dns_type != DNS_PRIME )
 		net_init(options.interface, options.pcap_file, options.pcap_output_file, options.use_watchdog);
 
+	if ( options.replay_events_file )
+		{
+		std::string error;
+		zeek::detail::event_trace_replayer =
+			zeek::detail::EventTraceReplayer::Open(*options.replay_events_file, &error);
+
+		if ( ! zeek::detail::event_trace_replayer )
+			reporter->FatalError("can't replay events from %s: %s",
+			                     options.replay_events_file->c_str(), error.c_str());
+
+		// Network time comes from the recorded events.
+		reading_traces = true;
+		iosource_mgr->Register(zeek::detail::event_trace_replayer);
+		}
+
+	if ( options.balance_packets )
+		{
+		std::string error;
+		packet_balancer = iosource::PacketBalancer::Open(*options.balance_packets, &error);
+
+		if ( ! packet_balancer )
+			reporter->FatalError("can't balance packets across %s: %s",
+			                     options.balance_packets->c_str(), error.c_str());
+		}
+
 	if ( ! g_policy_debug )
 		{
 		(void) setsignal(SIGTERM, sig_handler);
@@ -790,6 +973,54 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 			segment_logger = profiling_logger;
 		}
 
+	const auto& metrics_port = zeek::id::find_val("Metrics::listen_port")->AsPortVal();
+
+	if ( metrics_port->Port() != 0 )
+		{
+		auto server = new zeek::detail::MetricsServer(zeek::detail::metrics_registry);
+		const auto& metrics_addr = zeek::id::find_val("Metrics::listen_addr")->AsAddr();
+
+		// Zeek keeps running without, the problem has been reported.
+		if ( server->Listen(metrics_addr, metrics_port->Port()) )
+			iosource_mgr->Register(server, true);
+		else
+			delete server;
+		}
+
+	auto event_profiling_interval = zeek::id::find_val("event_profiling_interval")->AsInterval();
+
+	if ( event_profiling_interval > 0 )
+		{
+		const auto& event_profiling_file = zeek::id::find_val("event_profiling_file");
+
+		if ( event_profiling_file )
+			event_profiler = new EventProfiler(event_profiling_file->AsFile(),
+			                                   event_profiling_interval);
+		else
+			reporter->Error("event profiling enabled without setting event_profiling_file");
+		}
+
+	auto script_sampling_frequency = zeek::id::find_val("script_sampling_frequency")->AsCount();
+
+	if ( script_sampling_frequency > 0 )
+		script_sampler = ScriptSampler::Create(
+			script_sampling_frequency,
+			zeek::id::find_val("script_sampling_file")->AsStringVal()->ToStdString(),
+			zeek::id::find_val("script_sampling_write_interval")->AsInterval());
+
+	overload_controller = OverloadController::Create();
+	conn_memory_limiter = ConnMemoryLimiter::Create();
+
+	if ( zeek::id::find_val("analyzer_profiling")->AsBool() )
+		analyzer_profiler = new AnalyzerProfiler(
+			zeek::id::find_val("analyzer_profiling_connections")->AsCount());
+
+	if ( zeek::id::find_val("packet_latency_profiling")->AsBool() )
+		{
+		packet_latency_profiler = new PacketLatencyProfiler();
+		packet_latency_profiler->RegisterMetrics(zeek::detail::metrics_registry);
+		}
+
 	if ( ! reading_live && ! reading_traces )
 		// Set up network_time to track real-time, since
 		// we don't have any other source for it.
@@ -857,6 +1088,18 @@ zeek::detail::SetupResult zeek::detail::setup(int argc, char** argv,
 	if ( reporter->Errors() > 0 && ! zeekenv("ZEEK_ALLOW_INIT_ERRORS") )
 		reporter->FatalError("errors occurred while initializing");
 
+	// Only what the core raises from here on makes for a replayable trace.
+	if ( options.record_events_file )
+		{
+		std::string error;
+		zeek::detail::event_trace_recorder =
+			zeek::detail::EventTraceRecorder::Open(*options.record_events_file, &error);
+
+		if ( ! zeek::detail::event_trace_recorder )
+			reporter->FatalError("can't record events to %s: %s",
+			                     options.record_events_file->c_str(), error.c_str());
+		}
+
 	broker_mgr->ZeekInitDone();
 	reporter->ZeekInitDone();
 	analyzer_mgr->DumpDebug();